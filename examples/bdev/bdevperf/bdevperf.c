@@ -24,6 +24,8 @@
 #define BDEVPERF_CONFIG_MAX_FILENAME 1024
 #define BDEVPERF_CONFIG_UNDEFINED -1
 #define BDEVPERF_CONFIG_ERROR -2
+#define BDEVPERF_KV_DEFAULT_NUM_KEYS 1000000
+#define BDEVPERF_KV_DEFAULT_QUERY "SELECT * FROM s3object"
 
 struct bdevperf_task {
 	struct iovec			iov;
@@ -34,6 +36,10 @@ struct bdevperf_task {
 	uint64_t			offset_blocks;
 	struct bdevperf_task		*task_to_abort;
 	enum spdk_bdev_io_type		io_type;
+	unsigned char			key[NVME_KV_MAX_KEY_LENGTH];
+	uint64_t			kv_nbytes;
+	uint64_t			kv_offset;
+	uint32_t			select_id;
 	TAILQ_ENTRY(bdevperf_task)	link;
 	struct spdk_bdev_io_wait_entry	bdev_io_wait;
 };
@@ -69,6 +75,11 @@ static int g_timeout_in_sec;
 static struct spdk_conf *g_bdevperf_conf = NULL;
 static const char *g_bdevperf_conf_file = NULL;
 static double g_zipf_theta;
+static uint64_t g_kv_num_keys = BDEVPERF_KV_DEFAULT_NUM_KEYS;
+static int g_kv_min_value_size = 0;
+static int g_kv_exist_percentage = 0;
+static int g_kv_delete_percentage = 0;
+static const char *g_kv_query = BDEVPERF_KV_DEFAULT_QUERY;
 
 static struct spdk_cpuset g_all_cpuset;
 static struct spdk_poller *g_perf_timer = NULL;
@@ -123,12 +134,19 @@ struct bdevperf_job {
 	bool				write_zeroes;
 	bool				flush;
 	bool				abort;
+	bool				kv;
+	bool				kv_select;
+	int				kv_min_value_size;
+	int				kv_exist_percentage;
+	int				kv_delete_percentage;
 	int				queue_depth;
 	unsigned int			seed;
 
 	uint64_t			io_completed;
 	uint64_t			io_failed;
 	uint64_t			io_timeout;
+	uint64_t			kv_bytes;
+	uint64_t			kv_misses;
 	uint64_t			prev_io_completed;
 	double				ema_io_per_second;
 	int				current_queue_depth;
@@ -172,6 +190,10 @@ enum job_config_rw {
 	JOB_CONFIG_RW_UNMAP,
 	JOB_CONFIG_RW_FLUSH,
 	JOB_CONFIG_RW_WRITE_ZEROES,
+	JOB_CONFIG_RW_KVSTORE,
+	JOB_CONFIG_RW_KVRETRIEVE,
+	JOB_CONFIG_RW_KVMIXED,
+	JOB_CONFIG_RW_KVSELECT,
 };
 
 /* Storing values from a section of job config file */
@@ -279,6 +301,10 @@ performance_dump_job(struct bdevperf_aggregate_stats *stats, struct bdevperf_job
 		printf("\t Verification LBA range: start 0x%" PRIx64 " length 0x%" PRIx64 "\n",
 		       job->ios_base, job->size_in_ios);
 	}
+	if (job->kv) {
+		printf("\t KV key space: %" PRIu64 " keys, %" PRIu64 " not found\n",
+		       job->size_in_ios, job->kv_misses);
+	}
 
 	if (g_performance_dump_active == true) {
 		/* Use job's actual run time as Job has ended */
@@ -298,7 +324,13 @@ performance_dump_job(struct bdevperf_aggregate_stats *stats, struct bdevperf_job
 	}
 
 	tsc_rate = spdk_get_ticks_hz();
-	mb_per_second = io_per_second * job->io_size / (1024 * 1024);
+	if (job->kv) {
+		/* KV value sizes vary, so use the bytes actually transferred. */
+		mb_per_second = job->io_completed == 0 ? 0.0 :
+				io_per_second * job->kv_bytes / job->io_completed / (1024 * 1024);
+	} else {
+		mb_per_second = io_per_second * job->io_size / (1024 * 1024);
+	}
 
 	spdk_histogram_data_iterate(job->histogram, get_avg_latency, &latency_info);
 
@@ -883,6 +915,84 @@ bdevperf_verify_write_complete(struct spdk_bdev_io *bdev_io, bool success,
 	}
 }
 
+static void bdevperf_kv_complete(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg);
+
+static void
+bdevperf_kv_submit_retrieve_select(void *cb_arg)
+{
+	struct bdevperf_job	*job;
+	struct bdevperf_task	*task = cb_arg;
+	int			rc;
+
+	job = task->job;
+
+	/* Fetch the next chunk of the result. The device frees it once all of it has been read. */
+	rc = spdk_bdev_kv_retrieve_select(job->bdev_desc, job->ch, task->buf, task->kv_offset,
+					  job->buf_size, task->select_id,
+					  NVME_KV_SELECT_CMD_OPTION_DO_NOT_FREE_IF_NOT_ALL_DATA_FETCHED,
+					  bdevperf_kv_complete, task);
+
+	if (rc == -ENOMEM) {
+		bdevperf_queue_io_wait_with_cb(task, bdevperf_kv_submit_retrieve_select);
+	} else if (rc != 0) {
+		printf("Failed to submit retrieve select: %d\n", rc);
+		bdevperf_job_drain(job);
+		g_run_rc = rc;
+	}
+}
+
+static void
+bdevperf_kv_complete(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct bdevperf_task	*task = cb_arg;
+	struct bdevperf_job	*job = task->job;
+	uint32_t		cdw0;
+	int			sct, sc;
+
+	spdk_bdev_io_get_nvme_status(bdev_io, &cdw0, &sct, &sc);
+
+	if (!success) {
+		/* Keys that were never stored, or were deleted, are expected in a random key space. */
+		if (sct == SPDK_NVME_SCT_GENERIC && sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST &&
+		    task->io_type != SPDK_BDEV_IO_KV_RETRIEVE_SELECT) {
+			job->kv_misses++;
+			success = true;
+		}
+		bdevperf_complete(bdev_io, success, cb_arg);
+		return;
+	}
+
+	switch (task->io_type) {
+	case SPDK_BDEV_IO_KV_STORE:
+		job->kv_bytes += task->kv_nbytes;
+		break;
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+		job->kv_bytes += spdk_min(cdw0, job->buf_size);
+		break;
+	case SPDK_BDEV_IO_KV_SEND_SELECT:
+		/* One kvselect I/O is the query plus draining its whole result. */
+		task->select_id = cdw0;
+		task->kv_offset = 0;
+		task->io_type = SPDK_BDEV_IO_KV_RETRIEVE_SELECT;
+		spdk_bdev_free_io(bdev_io);
+		bdevperf_kv_submit_retrieve_select(task);
+		return;
+	case SPDK_BDEV_IO_KV_RETRIEVE_SELECT:
+		job->kv_bytes += spdk_min(cdw0 - task->kv_offset, job->buf_size);
+		task->kv_offset += job->buf_size;
+		if (task->kv_offset < cdw0) {
+			spdk_bdev_free_io(bdev_io);
+			bdevperf_kv_submit_retrieve_select(task);
+			return;
+		}
+		break;
+	default:
+		break;
+	}
+
+	bdevperf_complete(bdev_io, success, cb_arg);
+}
+
 static void
 bdevperf_zcopy_populate_complete(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
 {
@@ -993,6 +1103,29 @@ bdevperf_submit_task(void *arg)
 	case SPDK_BDEV_IO_TYPE_ABORT:
 		rc = spdk_bdev_abort(desc, ch, task->task_to_abort, bdevperf_abort_complete, task);
 		break;
+	case SPDK_BDEV_IO_KV_STORE:
+		rc = spdk_bdev_kv_store(desc, ch, task->key, sizeof(task->key), task->buf,
+					task->kv_nbytes, 0, bdevperf_kv_complete, task);
+		break;
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+		rc = spdk_bdev_kv_retrieve(desc, ch, task->key, sizeof(task->key), task->buf, 0,
+					   job->buf_size, bdevperf_kv_complete, task);
+		break;
+	case SPDK_BDEV_IO_KV_EXIST:
+		rc = spdk_bdev_kv_exist(desc, ch, task->key, sizeof(task->key),
+					bdevperf_kv_complete, task);
+		break;
+	case SPDK_BDEV_IO_KV_DELETE:
+		rc = spdk_bdev_kv_delete(desc, ch, task->key, sizeof(task->key),
+					 bdevperf_kv_complete, task);
+		break;
+	case SPDK_BDEV_IO_KV_SEND_SELECT:
+		/* The query must be in a DMA-able buffer; task->buf is free until the result drain. */
+		snprintf(task->buf, job->buf_size, "%s", g_kv_query);
+		rc = spdk_bdev_kv_send_select(desc, ch, task->key, sizeof(task->key), task->buf,
+					      strlen(g_kv_query) + 1, 0, NVME_KV_SELECT_TYPE_CSV,
+					      NVME_KV_SELECT_TYPE_CSV, bdevperf_kv_complete, task);
+		break;
 	default:
 		assert(false);
 		rc = -EINVAL;
@@ -1090,6 +1223,37 @@ bdevperf_job_get_task(struct bdevperf_job *job)
 	return task;
 }
 
+static void
+bdevperf_kv_prep_task(struct bdevperf_job *job, struct bdevperf_task *task, uint64_t key_index)
+{
+	char key[NVME_KV_MAX_KEY_LENGTH + 1];
+	int pct;
+
+	/* Keys are the zero padded index into the key space and use the full key length. */
+	snprintf(key, sizeof(key), "%016" PRIx64, key_index);
+	memcpy(task->key, key, sizeof(task->key));
+	task->offset_blocks = key_index;
+
+	if (job->kv_select) {
+		task->io_type = SPDK_BDEV_IO_KV_SEND_SELECT;
+		return;
+	}
+
+	pct = rand_r(&job->seed) % 100;
+	if (pct < job->kv_exist_percentage) {
+		task->io_type = SPDK_BDEV_IO_KV_EXIST;
+	} else if (pct < job->kv_exist_percentage + job->kv_delete_percentage) {
+		task->io_type = SPDK_BDEV_IO_KV_DELETE;
+	} else if ((job->rw_percentage == 100) ||
+		   (job->rw_percentage != 0 && ((rand_r(&job->seed) % 100) < job->rw_percentage))) {
+		task->io_type = SPDK_BDEV_IO_KV_RETRIEVE;
+	} else {
+		task->io_type = SPDK_BDEV_IO_KV_STORE;
+		task->kv_nbytes = job->kv_min_value_size +
+				  rand_r(&job->seed) % (job->io_size - job->kv_min_value_size + 1);
+	}
+}
+
 static void
 bdevperf_submit_single(struct bdevperf_job *job, struct bdevperf_task *task)
 {
@@ -1128,6 +1292,12 @@ bdevperf_submit_single(struct bdevperf_job *job, struct bdevperf_task *task)
 		}
 	}
 
+	if (job->kv) {
+		bdevperf_kv_prep_task(job, task, offset_in_ios);
+		bdevperf_submit_task(task);
+		return;
+	}
+
 	/* For multi-thread to same job, offset_in_ios is relative
 	 * to the LBA range assigned for that job. job->offset_blocks
 	 * is absolute (entire bdev LBA range).
@@ -1576,6 +1746,46 @@ job_init_rw(struct bdevperf_job *job, enum job_config_rw rw)
 	case JOB_CONFIG_RW_WRITE_ZEROES:
 		job->write_zeroes = true;
 		break;
+	case JOB_CONFIG_RW_KVSTORE:
+		job->kv = true;
+		job->is_random = true;
+		job->rw_percentage = 0;
+		job->seed = rand();
+		break;
+	case JOB_CONFIG_RW_KVRETRIEVE:
+		job->kv = true;
+		job->is_random = true;
+		job->rw_percentage = 100;
+		job->seed = rand();
+		break;
+	case JOB_CONFIG_RW_KVMIXED:
+		job->kv = true;
+		job->is_random = true;
+		job->seed = rand();
+		break;
+	case JOB_CONFIG_RW_KVSELECT:
+		job->kv = true;
+		job->kv_select = true;
+		job->is_random = true;
+		job->seed = rand();
+		break;
+	}
+}
+
+/* Fill a KV value with CSV rows, so that stored values can also be used by kvselect. */
+static void
+kv_generate_value(char *buf, uint64_t buf_len)
+{
+	char row[64];
+	uint64_t pos = 0, i = 0;
+	int len;
+
+	while (pos < buf_len) {
+		len = snprintf(row, sizeof(row), "%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+			       i, i * 7 % 1000, i * 13 % 100);
+		memcpy(buf + pos, row, spdk_min((uint64_t)len, buf_len - pos));
+		pos += len;
+		i++;
 	}
 }
 
@@ -1616,7 +1826,28 @@ bdevperf_construct_job(struct spdk_bdev *bdev, struct job_config *config,
 	job->abort = g_abort;
 	job_init_rw(job, config->rw);
 
-	if ((job->io_size % data_block_size) != 0) {
+	if (job->kv) {
+		/* Values are byte granular, so io_size is the largest value size. */
+		job->buf_size = job->io_size;
+		job->kv_min_value_size = g_kv_min_value_size > 0 ?
+					 spdk_min(g_kv_min_value_size, job->io_size) : job->io_size;
+		job->kv_exist_percentage = g_kv_exist_percentage;
+		job->kv_delete_percentage = g_kv_delete_percentage;
+
+		if (!spdk_bdev_io_type_supported(bdev, job->kv_select ? SPDK_BDEV_IO_KV_SEND_SELECT :
+						 SPDK_BDEV_IO_KV_STORE)) {
+			printf("Skipping %s because it does not support KV commands\n",
+			       spdk_bdev_get_name(bdev));
+			bdevperf_job_free(job);
+			return -ENOTSUP;
+		}
+
+		if (job->kv_select && strlen(g_kv_query) >= job->buf_size) {
+			SPDK_ERRLOG("IO size (%d) must be larger than the SELECT query\n", job->io_size);
+			bdevperf_job_free(job);
+			return -EINVAL;
+		}
+	} else if ((job->io_size % data_block_size) != 0) {
 		SPDK_ERRLOG("IO size (%d) is not multiples of data block size of bdev %s (%"PRIu32")\n",
 			    job->io_size, spdk_bdev_get_name(bdev), data_block_size);
 		bdevperf_job_free(job);
@@ -1638,7 +1869,11 @@ bdevperf_construct_job(struct spdk_bdev *bdev, struct job_config *config,
 
 	job->offset_in_ios = 0;
 
-	if (config->length != 0) {
+	if (job->kv) {
+		/* Every job covers the whole key space. */
+		job->size_in_ios = g_kv_num_keys;
+		job->ios_base = 0;
+	} else if (config->length != 0) {
 		/* Use subset of disk */
 		job->size_in_ios = config->length / job->io_size_blocks;
 		job->ios_base = config->offset / job->io_size_blocks;
@@ -1703,6 +1938,10 @@ bdevperf_construct_job(struct spdk_bdev *bdev, struct job_config *config,
 			return -ENOMEM;
 		}
 
+		if (job->kv) {
+			kv_generate_value(task->buf, job->buf_size);
+		}
+
 		if (spdk_bdev_is_md_separate(job->bdev)) {
 			task->md_buf = spdk_zmalloc(job->io_size_blocks *
 						    spdk_bdev_get_md_size(job->bdev), 0, NULL,
@@ -1758,9 +1997,18 @@ parse_rw(const char *str, enum job_config_rw ret)
 		ret = JOB_CONFIG_RW_RW;
 	} else if (!strcmp(str, "randrw")) {
 		ret = JOB_CONFIG_RW_RANDRW;
+	} else if (!strcmp(str, "kvstore")) {
+		ret = JOB_CONFIG_RW_KVSTORE;
+	} else if (!strcmp(str, "kvretrieve")) {
+		ret = JOB_CONFIG_RW_KVRETRIEVE;
+	} else if (!strcmp(str, "kvmixed")) {
+		ret = JOB_CONFIG_RW_KVMIXED;
+	} else if (!strcmp(str, "kvselect")) {
+		ret = JOB_CONFIG_RW_KVSELECT;
 	} else {
 		fprintf(stderr, "rw must be one of\n"
-			"(read, write, randread, randwrite, rw, randrw, verify, reset, unmap, flush)\n");
+			"(read, write, randread, randwrite, rw, randrw, verify, reset, unmap, flush,\n"
+			" kvstore, kvretrieve, kvmixed, kvselect)\n");
 		ret = BDEVPERF_CONFIG_ERROR;
 	}
 
@@ -2320,6 +2568,8 @@ bdevperf_parse_arg(int ch, char *arg)
 		g_continue_on_failure = true;
 	} else if (ch == 'j') {
 		g_bdevperf_conf_file = optarg;
+	} else if (ch == 'Q') {
+		g_kv_query = optarg;
 	} else if (ch == 'F') {
 		char *endptr;
 
@@ -2365,6 +2615,18 @@ bdevperf_parse_arg(int ch, char *arg)
 			g_show_performance_real_time = 1;
 			g_show_performance_period_in_usec = tmp * SPDK_SEC_TO_USEC;
 			break;
+		case 'K':
+			g_kv_num_keys = tmp;
+			break;
+		case 'V':
+			g_kv_min_value_size = tmp;
+			break;
+		case 'E':
+			g_kv_exist_percentage = tmp;
+			break;
+		case 'D':
+			g_kv_delete_percentage = tmp;
+			break;
 		default:
 			return -EINVAL;
 		}
@@ -2377,7 +2639,8 @@ bdevperf_usage(void)
 {
 	printf(" -q <depth>                io depth\n");
 	printf(" -o <size>                 io size in bytes\n");
-	printf(" -w <type>                 io pattern type, must be one of (read, write, randread, randwrite, rw, randrw, verify, reset, unmap, flush)\n");
+	printf(" -w <type>                 io pattern type, must be one of (read, write, randread, randwrite, rw, randrw, verify, reset, unmap, flush,\n");
+	printf("                           kvstore, kvretrieve, kvmixed, kvselect)\n");
 	printf(" -t <time>                 time in seconds\n");
 	printf(" -k <timeout>              timeout in seconds to detect starved I/O (default is 0 and disabled)\n");
 	printf(" -M <percent>              rwmixread (100 for reads, 0 for writes)\n");
@@ -2388,13 +2651,20 @@ bdevperf_usage(void)
 	printf(" -S <period>               show performance result in real time every <period> seconds\n");
 	printf(" -T <bdev>                 bdev to run against. Default: all available bdevs.\n");
 	printf(" -f                        continue processing I/O even after failures\n");
-	printf(" -F <zipf theta>           use zipf distribution for random I/O\n");
+	printf(" -F <zipf theta>           use zipf distribution for random I/O and KV key popularity\n");
 	printf(" -Z                        enable using zcopy bdev API for read or write I/O\n");
 	printf(" -z                        start bdevperf, but wait for RPC to start tests\n");
 	printf(" -X                        abort timed out I/O\n");
 	printf(" -C                        enable every core to send I/Os to each bdev\n");
 	printf(" -j <filename>             use job config file\n");
 	printf(" -l                        display latency histogram, default: disable. -l display summary, -ll display details\n");
+	printf(" -K <num>                  number of keys in the key space of KV workloads, default: %d\n",
+	       BDEVPERF_KV_DEFAULT_NUM_KEYS);
+	printf(" -V <size>                 minimum KV value size in bytes; values are uniformly sized up to the io size\n");
+	printf(" -E <percent>              percentage of KV I/O that are EXIST commands\n");
+	printf(" -D <percent>              percentage of KV I/O that are DELETE commands\n");
+	printf(" -Q <query>                SELECT query used by kvselect, default: \"%s\"\n",
+	       BDEVPERF_KV_DEFAULT_QUERY);
 }
 
 static int
@@ -2435,6 +2705,22 @@ verify_test_params(struct spdk_app_opts *opts)
 		return 1;
 	}
 
+	if (g_kv_num_keys == 0) {
+		fprintf(stderr, "-K must be greater than 0\n");
+		return 1;
+	}
+
+	if (g_kv_exist_percentage > 100 || g_kv_delete_percentage > 100 ||
+	    g_kv_exist_percentage + g_kv_delete_percentage > 100) {
+		fprintf(stderr, "-E and -D together must not exceed 100 percent\n");
+		return 1;
+	}
+
+	if (!g_bdevperf_conf_file && g_kv_min_value_size > g_io_size) {
+		fprintf(stderr, "-V must not be larger than the io size\n");
+		return 1;
+	}
+
 	if (g_io_size > SPDK_BDEV_LARGE_BUF_MAX_SIZE) {
 		printf("I/O size of %d is greater than zero copy threshold (%d).\n",
 		       g_io_size, SPDK_BDEV_LARGE_BUF_MAX_SIZE);
@@ -2469,7 +2755,10 @@ verify_test_params(struct spdk_app_opts *opts)
 	    !strcmp(g_workload_type, "reset") ||
 	    !strcmp(g_workload_type, "unmap") ||
 	    !strcmp(g_workload_type, "write_zeroes") ||
-	    !strcmp(g_workload_type, "flush")) {
+	    !strcmp(g_workload_type, "flush") ||
+	    !strcmp(g_workload_type, "kvstore") ||
+	    !strcmp(g_workload_type, "kvretrieve") ||
+	    !strcmp(g_workload_type, "kvselect")) {
 		if (g_mix_specified) {
 			fprintf(stderr, "Ignoring -M option... Please use -M option"
 				" only when using rw or randrw.\n");
@@ -2477,11 +2766,12 @@ verify_test_params(struct spdk_app_opts *opts)
 	}
 
 	if (!strcmp(g_workload_type, "rw") ||
-	    !strcmp(g_workload_type, "randrw")) {
+	    !strcmp(g_workload_type, "randrw") ||
+	    !strcmp(g_workload_type, "kvmixed")) {
 		if (g_rw_percentage < 0 || g_rw_percentage > 100) {
 			fprintf(stderr,
 				"-M must be specified to value from 0 to 100 "
-				"for rw or randrw.\n");
+				"for rw, randrw or kvmixed.\n");
 			return 1;
 		}
 	}
@@ -2507,7 +2797,7 @@ main(int argc, char **argv)
 	opts.rpc_addr = NULL;
 	opts.shutdown_cb = spdk_bdevperf_shutdown_cb;
 
-	if ((rc = spdk_app_parse_args(argc, argv, &opts, "Zzfq:o:t:w:k:CF:M:P:S:T:Xlj:", NULL,
+	if ((rc = spdk_app_parse_args(argc, argv, &opts, "Zzfq:o:t:w:k:CF:M:P:S:T:Xlj:K:V:E:D:Q:", NULL,
 				      bdevperf_parse_arg, bdevperf_usage)) !=
 	    SPDK_APP_PARSE_ARGS_SUCCESS) {
 		return rc;
@@ -8,6 +8,7 @@
 
 #include "spdk/bdev.h"
 #include "spdk/bdev_zone.h"
+#include "spdk/nvme_spec.h"
 #include "spdk/accel.h"
 #include "spdk/env.h"
 #include "spdk/init.h"
@@ -47,11 +48,24 @@ struct spdk_fio_options {
 	int initial_zone_reset;
 	int zone_append;
 	char *rpc_listen_addr;
+	int kv;
+	unsigned kv_key_stride;
+	int kv_exist;
+	char *kv_select_query_file;
+	char *kv_select_format;
 };
 
 struct spdk_fio_request {
 	struct io_u		*io;
 	struct thread_data	*td;
+
+	/* KV mode */
+	struct spdk_fio_target		*target;
+	enum spdk_bdev_io_type		kv_io_type;
+	unsigned char			key[NVME_KV_MAX_KEY_LENGTH];
+	uint32_t			select_id;
+	uint64_t			select_offset;
+	struct spdk_bdev_io_wait_entry	bdev_io_wait;
 };
 
 struct spdk_fio_target {
@@ -59,6 +73,12 @@ struct spdk_fio_target {
 	struct spdk_bdev_desc	*desc;
 	struct spdk_io_channel	*ch;
 	bool zone_append_enabled;
+	bool kv_enabled;
+
+	/* SELECT query sent instead of KV retrieves, including its terminating NUL. */
+	char			*kv_query;
+	uint32_t		kv_query_len;
+	uint8_t			kv_select_type;
 
 	TAILQ_ENTRY(spdk_fio_target) link;
 };
@@ -221,6 +241,7 @@ spdk_fio_bdev_close_targets(void *arg)
 		TAILQ_REMOVE(&fio_thread->targets, target, link);
 		spdk_put_io_channel(target->ch);
 		spdk_bdev_close(target->desc);
+		free(target->kv_query);
 		free(target);
 	}
 }
@@ -851,6 +872,126 @@ spdk_fio_zone_bytes_to_blocks(struct spdk_bdev *bdev, uint64_t offset_bytes, uin
 	return (offset_bytes % block_size) | (num_bytes % block_size);
 }
 
+static void spdk_fio_kv_completion_cb(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg);
+
+static void
+spdk_fio_kv_submit_retrieve_select(void *cb_arg)
+{
+	struct spdk_fio_request	*fio_req = cb_arg;
+	struct spdk_fio_target	*target = fio_req->target;
+	struct spdk_fio_thread	*fio_thread = fio_req->td->io_ops_data;
+	struct io_u		*io_u = fio_req->io;
+	int			rc;
+
+	/* Fetch the next chunk of the result. The device frees it once all of it has been read. */
+	fio_req->kv_io_type = SPDK_BDEV_IO_KV_RETRIEVE_SELECT;
+	rc = spdk_bdev_kv_retrieve_select(target->desc, target->ch, io_u->buf, fio_req->select_offset,
+					  io_u->xfer_buflen, fio_req->select_id,
+					  NVME_KV_SELECT_CMD_OPTION_DO_NOT_FREE_IF_NOT_ALL_DATA_FETCHED,
+					  spdk_fio_kv_completion_cb, fio_req);
+	if (rc == -ENOMEM) {
+		fio_req->bdev_io_wait.bdev = target->bdev;
+		fio_req->bdev_io_wait.cb_fn = spdk_fio_kv_submit_retrieve_select;
+		fio_req->bdev_io_wait.cb_arg = fio_req;
+		rc = spdk_bdev_queue_io_wait(target->bdev, target->ch, &fio_req->bdev_io_wait);
+	}
+	if (rc != 0) {
+		assert(fio_thread->iocq_count < fio_thread->iocq_size);
+		io_u->error = abs(rc);
+		fio_thread->iocq[fio_thread->iocq_count++] = io_u;
+	}
+}
+
+static void
+spdk_fio_kv_completion_cb(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct spdk_fio_request	*fio_req = cb_arg;
+	struct spdk_fio_thread	*fio_thread = fio_req->td->io_ops_data;
+	enum spdk_bdev_io_type	io_type = fio_req->kv_io_type;
+	uint32_t		cdw0;
+	int			sct, sc;
+
+	spdk_bdev_io_get_nvme_status(bdev_io, &cdw0, &sct, &sc);
+	spdk_bdev_free_io(bdev_io);
+
+	if (!success) {
+		/* Keys that were never stored, or were deleted, are expected in a random key space. */
+		success = sct == SPDK_NVME_SCT_GENERIC && sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST &&
+			  io_type != SPDK_BDEV_IO_KV_RETRIEVE_SELECT;
+	} else if (io_type == SPDK_BDEV_IO_KV_SEND_SELECT) {
+		/* One read is the query plus draining its whole result. */
+		fio_req->select_id = cdw0;
+		fio_req->select_offset = 0;
+		spdk_fio_kv_submit_retrieve_select(fio_req);
+		return;
+	} else if (io_type == SPDK_BDEV_IO_KV_RETRIEVE_SELECT) {
+		fio_req->select_offset += fio_req->io->xfer_buflen;
+		if (fio_req->select_offset < cdw0) {
+			spdk_fio_kv_submit_retrieve_select(fio_req);
+			return;
+		}
+	}
+
+	assert(fio_thread->iocq_count < fio_thread->iocq_size);
+	fio_req->io->error = success ? 0 : EIO;
+	fio_thread->iocq[fio_thread->iocq_count++] = fio_req->io;
+}
+
+/*
+ * KV mode maps each fio offset to a key, so that the block size and offset
+ * options drive value sizes and key popularity. Keys are the zero padded index
+ * of the offset in units of kv_key_stride, the same keys bdevperf uses.
+ */
+static int
+spdk_fio_kv_queue(struct thread_data *td, struct spdk_fio_target *target,
+		  struct spdk_fio_request *fio_req)
+{
+	struct spdk_fio_options	*fio_options = td->eo;
+	struct io_u		*io_u = fio_req->io;
+	char			key[NVME_KV_MAX_KEY_LENGTH + 1];
+
+	snprintf(key, sizeof(key), "%016" PRIx64, (uint64_t)(io_u->offset / fio_options->kv_key_stride));
+	memcpy(fio_req->key, key, sizeof(fio_req->key));
+	fio_req->target = target;
+
+	switch (io_u->ddir) {
+	case DDIR_READ:
+		if (target->kv_query != NULL) {
+			if (target->kv_query_len > io_u->xfer_buflen) {
+				return -EINVAL;
+			}
+			memcpy(io_u->buf, target->kv_query, target->kv_query_len);
+			fio_req->kv_io_type = SPDK_BDEV_IO_KV_SEND_SELECT;
+			return spdk_bdev_kv_send_select(target->desc, target->ch, fio_req->key,
+							sizeof(fio_req->key), io_u->buf,
+							target->kv_query_len, 0, target->kv_select_type,
+							target->kv_select_type, spdk_fio_kv_completion_cb,
+							fio_req);
+		}
+		if (fio_options->kv_exist) {
+			fio_req->kv_io_type = SPDK_BDEV_IO_KV_EXIST;
+			return spdk_bdev_kv_exist(target->desc, target->ch, fio_req->key,
+						  sizeof(fio_req->key), spdk_fio_kv_completion_cb, fio_req);
+		}
+		fio_req->kv_io_type = SPDK_BDEV_IO_KV_RETRIEVE;
+		return spdk_bdev_kv_retrieve(target->desc, target->ch, fio_req->key,
+					     sizeof(fio_req->key), io_u->buf, 0, io_u->xfer_buflen,
+					     spdk_fio_kv_completion_cb, fio_req);
+	case DDIR_WRITE:
+		fio_req->kv_io_type = SPDK_BDEV_IO_KV_STORE;
+		return spdk_bdev_kv_store(target->desc, target->ch, fio_req->key, sizeof(fio_req->key),
+					  io_u->buf, io_u->xfer_buflen, 0,
+					  spdk_fio_kv_completion_cb, fio_req);
+	case DDIR_TRIM:
+		fio_req->kv_io_type = SPDK_BDEV_IO_KV_DELETE;
+		return spdk_bdev_kv_delete(target->desc, target->ch, fio_req->key, sizeof(fio_req->key),
+					   spdk_fio_kv_completion_cb, fio_req);
+	default:
+		/* KV bdevs have nothing to flush. */
+		return -ENOTSUP;
+	}
+}
+
 static fio_q_status_t
 spdk_fio_queue(struct thread_data *td, struct io_u *io_u)
 {
@@ -866,6 +1007,11 @@ spdk_fio_queue(struct thread_data *td, struct io_u *io_u)
 		return FIO_Q_COMPLETED;
 	}
 
+	if (target->kv_enabled) {
+		rc = spdk_fio_kv_queue(td, target, fio_req);
+		goto out;
+	}
+
 	switch (io_u->ddir) {
 	case DDIR_READ:
 		rc = spdk_bdev_read(target->desc, target->ch,
@@ -904,6 +1050,7 @@ spdk_fio_queue(struct thread_data *td, struct io_u *io_u)
 		break;
 	}
 
+out:
 	if (rc == -ENOMEM) {
 		return FIO_Q_BUSY;
 	}
@@ -1317,6 +1464,89 @@ spdk_fio_handle_options(struct thread_data *td, struct fio_file *f, struct spdk_
 	return 0;
 }
 
+static int
+spdk_fio_kv_load_query(struct spdk_fio_target *target, const char *path)
+{
+	FILE *file;
+	long size;
+	int rc = 0;
+
+	file = fopen(path, "r");
+	if (file == NULL) {
+		SPDK_ERRLOG("Unable to open SELECT query file %s: %s\n", path, spdk_strerror(errno));
+		return -errno;
+	}
+
+	if (fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) <= 0 || fseek(file, 0, SEEK_SET) != 0) {
+		SPDK_ERRLOG("Unable to read SELECT query file %s\n", path);
+		rc = -EINVAL;
+		goto out;
+	}
+
+	/* The query is sent with its terminating NUL. */
+	target->kv_query = calloc(1, size + 1);
+	if (target->kv_query == NULL) {
+		rc = -ENOMEM;
+		goto out;
+	}
+	if (fread(target->kv_query, 1, size, file) != (size_t)size) {
+		SPDK_ERRLOG("Unable to read SELECT query file %s\n", path);
+		free(target->kv_query);
+		target->kv_query = NULL;
+		rc = -EIO;
+		goto out;
+	}
+	target->kv_query_len = strlen(target->kv_query) + 1;
+
+out:
+	fclose(file);
+	return rc;
+}
+
+static int
+spdk_fio_kv_handle_options(struct thread_data *td, struct fio_file *f)
+{
+	struct spdk_fio_target *target = f->engine_data;
+	struct spdk_fio_options *fio_options = td->eo;
+	const char *format = fio_options->kv_select_format;
+	int rc;
+
+	if (!spdk_bdev_io_type_supported(target->bdev, SPDK_BDEV_IO_KV_STORE) ||
+	    !spdk_bdev_io_type_supported(target->bdev, SPDK_BDEV_IO_KV_RETRIEVE)) {
+		SPDK_ERRLOG("kv=1 but bdev %s does not support KV commands\n", f->file_name);
+		return -ENOTSUP;
+	}
+
+	if (fio_options->kv_key_stride == 0) {
+		SPDK_ERRLOG("kv_key_stride must not be 0\n");
+		return -EINVAL;
+	}
+
+	if (format == NULL || strcmp(format, "csv") == 0) {
+		target->kv_select_type = NVME_KV_SELECT_TYPE_CSV;
+	} else if (strcmp(format, "json") == 0) {
+		target->kv_select_type = NVME_KV_SELECT_TYPE_JSON;
+	} else {
+		SPDK_ERRLOG("Invalid kv_select_format %s\n", format);
+		return -EINVAL;
+	}
+
+	if (fio_options->kv_select_query_file != NULL) {
+		if (!spdk_bdev_io_type_supported(target->bdev, SPDK_BDEV_IO_KV_SEND_SELECT)) {
+			SPDK_ERRLOG("bdev %s does not support SELECT\n", f->file_name);
+			return -ENOTSUP;
+		}
+		rc = spdk_fio_kv_load_query(target, fio_options->kv_select_query_file);
+		if (rc != 0) {
+			return rc;
+		}
+	}
+
+	SPDK_DEBUGLOG(fio_bdev, "Using KV commands on: '%s'\n", f->file_name);
+	target->kv_enabled = true;
+	return 0;
+}
+
 static int
 spdk_fio_handle_options_per_target(struct thread_data *td, struct fio_file *f)
 {
@@ -1334,6 +1564,10 @@ spdk_fio_handle_options_per_target(struct thread_data *td, struct fio_file *f)
 		}
 	}
 
+	if (fio_options->kv) {
+		return spdk_fio_kv_handle_options(td, f);
+	}
+
 	return 0;
 }
 
@@ -1422,6 +1656,54 @@ static struct fio_option options[] = {
 		.category	= FIO_OPT_C_ENGINE,
 		.group		= FIO_OPT_G_INVALID,
 	},
+	{
+		.name		= "kv",
+		.lname		= "Issue KV commands instead of block I/O",
+		.type		= FIO_OPT_INT,
+		.off1		= offsetof(struct spdk_fio_options, kv),
+		.def		= "0",
+		.help		= "Map reads, writes and trims to KV retrieve, store and delete (1=KV, 0=block)",
+		.category	= FIO_OPT_C_ENGINE,
+		.group		= FIO_OPT_G_INVALID,
+	},
+	{
+		.name		= "kv_key_stride",
+		.lname		= "Bytes of offset per KV key",
+		.type		= FIO_OPT_INT,
+		.off1		= offsetof(struct spdk_fio_options, kv_key_stride),
+		.def		= "4096",
+		.help		= "Offsets within the same stride map to the same key",
+		.category	= FIO_OPT_C_ENGINE,
+		.group		= FIO_OPT_G_INVALID,
+	},
+	{
+		.name		= "kv_exist",
+		.lname		= "Issue KV exist instead of retrieve",
+		.type		= FIO_OPT_INT,
+		.off1		= offsetof(struct spdk_fio_options, kv_exist),
+		.def		= "0",
+		.help		= "Reads check whether the key exists instead of retrieving it (1=exist, 0=retrieve)",
+		.category	= FIO_OPT_C_ENGINE,
+		.group		= FIO_OPT_G_INVALID,
+	},
+	{
+		.name		= "kv_select_query_file",
+		.lname		= "SELECT query file",
+		.type		= FIO_OPT_STR_STORE,
+		.off1		= offsetof(struct spdk_fio_options, kv_select_query_file),
+		.help		= "Reads send the SELECT query in this file and drain its result",
+		.category	= FIO_OPT_C_ENGINE,
+		.group		= FIO_OPT_G_INVALID,
+	},
+	{
+		.name		= "kv_select_format",
+		.lname		= "SELECT input and output format",
+		.type		= FIO_OPT_STR_STORE,
+		.off1		= offsetof(struct spdk_fio_options, kv_select_format),
+		.help		= "Format of stored values and SELECT results (csv or json)",
+		.category	= FIO_OPT_C_ENGINE,
+		.group		= FIO_OPT_G_INVALID,
+	},
 	{
 		.name		= NULL,
 	},
@@ -11,6 +11,7 @@
 #include "spdk/env.h"
 #include "spdk/fd.h"
 #include "spdk/nvme.h"
+#include "spdk/nvme_kv.h"
 #include "spdk/vmd.h"
 #include "spdk/queue.h"
 #include "spdk/string.h"
@@ -32,6 +33,19 @@
 #include <libaio.h>
 #endif
 
+#define PERF_KV_KEY_LENGTH		16
+#define PERF_KV_DEFAULT_NUM_KEYS	1000000
+#define PERF_KV_DEFAULT_QUERY		"SELECT * FROM s3object"
+
+enum perf_kv_workload {
+	PERF_KV_NONE,
+	PERF_KV_STORE,
+	PERF_KV_RETRIEVE,
+	PERF_KV_EXIST,
+	PERF_KV_MIXED,
+	PERF_KV_SELECT,
+};
+
 struct ctrlr_entry {
 	struct spdk_nvme_ctrlr			*ctrlr;
 	enum spdk_nvme_transport_type		trtype;
@@ -118,6 +132,9 @@ struct ns_worker_stats {
 	uint64_t		idle_tsc;
 	uint64_t		last_busy_tsc;
 	uint64_t		last_idle_tsc;
+	uint64_t		kv_bytes;
+	uint64_t		kv_misses;
+	uint64_t		kv_miscompares;
 };
 
 struct ns_worker_ctx {
@@ -168,6 +185,13 @@ struct perf_task {
 	uint64_t		submit_tsc;
 	bool			is_read;
 	struct spdk_dif_ctx	dif_ctx;
+	/* KV workloads */
+	struct spdk_nvme_qpair	*kv_qpair;
+	unsigned char		kv_key[PERF_KV_KEY_LENGTH];
+	uint32_t		kv_select_id;
+	uint32_t		kv_offset;
+	uint32_t		kv_value_len;
+	bool			kv_selecting;
 #if HAVE_LIBAIO
 	struct iocb		iocb;
 #endif
@@ -246,6 +270,11 @@ static bool g_exit;
 static uint32_t g_keep_alive_timeout_in_ms = 10000;
 static uint32_t g_quiet_count = 1;
 static double g_zipf_theta;
+static enum perf_kv_workload g_kv_workload;
+static uint64_t g_kv_num_keys = PERF_KV_DEFAULT_NUM_KEYS;
+static uint32_t g_kv_min_value_size;
+static const char *g_kv_query = PERF_KV_DEFAULT_QUERY;
+static bool g_kv_verify;
 /* Set default io_queue_size to UINT16_MAX, NVMe driver will then reduce this
  * to MQES to maximize the io_queue_size as much as possible.
  */
@@ -819,6 +848,20 @@ nvme_setup_payload(struct perf_task *task, uint8_t pattern)
 	}
 }
 
+static int
+nvme_next_qpair(struct ns_worker_ctx *ns_ctx)
+{
+	int qp_num;
+
+	qp_num = ns_ctx->u.nvme.last_qpair;
+	ns_ctx->u.nvme.last_qpair++;
+	if (ns_ctx->u.nvme.last_qpair == ns_ctx->u.nvme.num_active_qpairs) {
+		ns_ctx->u.nvme.last_qpair = 0;
+	}
+
+	return qp_num;
+}
+
 static int
 nvme_submit_io(struct perf_task *task, struct ns_worker_ctx *ns_ctx,
 	       struct ns_entry *entry, uint64_t offset_in_ios)
@@ -843,11 +886,7 @@ nvme_submit_io(struct perf_task *task, struct ns_worker_ctx *ns_ctx,
 		}
 	}
 
-	qp_num = ns_ctx->u.nvme.last_qpair;
-	ns_ctx->u.nvme.last_qpair++;
-	if (ns_ctx->u.nvme.last_qpair == ns_ctx->u.nvme.num_active_qpairs) {
-		ns_ctx->u.nvme.last_qpair = 0;
-	}
+	qp_num = nvme_next_qpair(ns_ctx);
 
 	if (mode != DIF_MODE_NONE) {
 		rc = spdk_dif_ctx_init(&task->dif_ctx, entry->block_size, entry->md_size,
@@ -1152,6 +1191,193 @@ static const struct ns_fn_table nvme_fn_table = {
 	.dump_transport_stats	= nvme_dump_transport_stats
 };
 
+static int
+nvme_kv_value_row(char *row, size_t size, uint64_t i)
+{
+	return snprintf(row, size, "%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+			i, i * 7 % 1000, i * 13 % 100);
+}
+
+/*
+ * KV values are CSV rows, so that stored values can also be used by kvselect.
+ * Every value stored is a prefix of the same stream of rows.
+ */
+static void
+nvme_kv_fill_value(char *buf, uint64_t len)
+{
+	char row[64];
+	uint64_t pos = 0, i = 0;
+	int row_len;
+
+	while (pos < len) {
+		row_len = nvme_kv_value_row(row, sizeof(row), i++);
+		memcpy(buf + pos, row, spdk_min((uint64_t)row_len, len - pos));
+		pos += row_len;
+	}
+}
+
+static bool
+nvme_kv_value_matches(const char *buf, uint64_t len)
+{
+	char row[64];
+	uint64_t pos = 0, i = 0;
+	int row_len;
+
+	while (pos < len) {
+		row_len = nvme_kv_value_row(row, sizeof(row), i++);
+		if (memcmp(buf + pos, row, spdk_min((uint64_t)row_len, len - pos)) != 0) {
+			return false;
+		}
+		pos += row_len;
+	}
+	return true;
+}
+
+static void
+nvme_kv_setup_payload(struct perf_task *task, uint8_t pattern)
+{
+	nvme_setup_payload(task, pattern);
+	nvme_kv_fill_value(task->iovs[0].iov_base, g_io_size_bytes);
+}
+
+static void nvme_kv_io_complete(void *ctx, const struct spdk_nvme_cpl *cpl);
+
+static int
+nvme_kv_submit_retrieve_select(struct perf_task *task)
+{
+	struct ns_entry *entry = task->ns_ctx->entry;
+
+	/* Fetch the next chunk of the result. The device frees it once all of it has been read. */
+	return spdk_nvme_ns_cmd_kvselect_retrieve(entry->u.nvme.ns, task->kv_qpair, task->kv_select_id,
+			task->kv_offset, task->iovs[0].iov_base, g_io_size_bytes,
+			SPDK_NVME_KV_SELECT_FREE_IF_FIT, nvme_kv_io_complete, task, 0);
+}
+
+/*
+ * KV workloads treat offset_in_ios as an index into the key space. Keys are the
+ * zero padded index and use the full key length, the same keys bdevperf uses.
+ */
+static int
+nvme_kv_submit_io(struct perf_task *task, struct ns_worker_ctx *ns_ctx,
+		  struct ns_entry *entry, uint64_t offset_in_ios)
+{
+	char key[PERF_KV_KEY_LENGTH + 1];
+	uint32_t value_size;
+
+	snprintf(key, sizeof(key), "%016" PRIx64, offset_in_ios);
+	memcpy(task->kv_key, key, sizeof(task->kv_key));
+	task->kv_qpair = ns_ctx->u.nvme.qpair[nvme_next_qpair(ns_ctx)];
+	task->kv_selecting = false;
+
+	if (!task->is_read) {
+		value_size = g_io_size_bytes;
+		if (g_kv_min_value_size != 0) {
+			value_size = g_kv_min_value_size +
+				     rand_r(&entry->seed) % (g_io_size_bytes - g_kv_min_value_size + 1);
+		}
+		ns_ctx->stats.kv_bytes += value_size;
+		return spdk_nvme_ns_cmd_kvstore(entry->u.nvme.ns, task->kv_qpair, task->kv_key,
+						sizeof(task->kv_key), task->iovs[0].iov_base, value_size,
+						nvme_kv_io_complete, task, 0, 0);
+	}
+
+	switch (g_kv_workload) {
+	case PERF_KV_EXIST:
+		return spdk_nvme_ns_cmd_kvexist(entry->u.nvme.ns, task->kv_qpair, task->kv_key,
+						sizeof(task->kv_key), nvme_kv_io_complete, task, 0);
+	case PERF_KV_SELECT:
+		return spdk_nvme_ns_cmd_kvselect_send(entry->u.nvme.ns, task->kv_qpair, task->kv_key,
+						      sizeof(task->kv_key), (char *)g_kv_query,
+						      SPDK_NVME_KV_DATATYPE_CSV, SPDK_NVME_KV_DATATYPE_CSV, 0,
+						      nvme_kv_io_complete, task, 0);
+	default:
+		return spdk_nvme_ns_cmd_kvretrieve(entry->u.nvme.ns, task->kv_qpair, task->kv_key,
+						   sizeof(task->kv_key), task->iovs[0].iov_base,
+						   g_io_size_bytes, nvme_kv_io_complete, task, 0, 0);
+	}
+}
+
+static void
+nvme_kv_io_complete(void *ctx, const struct spdk_nvme_cpl *cpl)
+{
+	struct perf_task *task = ctx;
+	struct ns_worker_ctx *ns_ctx = task->ns_ctx;
+	int rc;
+
+	if (spdk_unlikely(spdk_nvme_cpl_is_error(cpl))) {
+		/* Keys that were never stored, or were deleted, are expected in a random key space. */
+		if (cpl->status.sct == SPDK_NVME_SCT_GENERIC &&
+		    cpl->status.sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST && !task->kv_selecting) {
+			ns_ctx->stats.kv_misses++;
+			task_complete(task);
+			return;
+		}
+		io_complete(ctx, cpl);
+		return;
+	}
+
+	if (!task->is_read || g_kv_workload == PERF_KV_EXIST) {
+		task_complete(task);
+		return;
+	}
+
+	if (g_kv_workload != PERF_KV_SELECT) {
+		ns_ctx->stats.kv_bytes += spdk_min(cpl->cdw0, g_io_size_bytes);
+		if (g_kv_verify) {
+			task->kv_value_len = cpl->cdw0;
+			ns_ctx->entry->fn_table->verify_io(task, ns_ctx->entry);
+		}
+		task_complete(task);
+		return;
+	}
+
+	/* One kvselect I/O is the query plus draining its whole result. */
+	if (!task->kv_selecting) {
+		task->kv_selecting = true;
+		task->kv_select_id = cpl->cdw0;
+		task->kv_offset = 0;
+	} else {
+		ns_ctx->stats.kv_bytes += spdk_min(cpl->cdw0 - task->kv_offset, g_io_size_bytes);
+		task->kv_offset += g_io_size_bytes;
+		if (task->kv_offset >= cpl->cdw0) {
+			task_complete(task);
+			return;
+		}
+	}
+
+	rc = nvme_kv_submit_retrieve_select(task);
+	if (spdk_unlikely(rc != 0)) {
+		RATELIMIT_LOG("starting retrieve select failed\n");
+		task_complete(task);
+	}
+}
+
+/*
+ * KV commands carry no protection information, so verification checks the
+ * retrieved value against the pattern perf stores. A corrupted buffer is
+ * refilled so the next store from this task does not propagate it.
+ */
+static void
+nvme_kv_verify_io(struct perf_task *task, struct ns_entry *entry)
+{
+	uint64_t len = spdk_min(task->kv_value_len, g_io_size_bytes);
+
+	if (spdk_unlikely(!nvme_kv_value_matches(task->iovs[0].iov_base, len))) {
+		task->ns_ctx->stats.kv_miscompares++;
+		nvme_kv_fill_value(task->iovs[0].iov_base, len);
+	}
+}
+
+static const struct ns_fn_table nvme_kv_fn_table = {
+	.setup_payload		= nvme_kv_setup_payload,
+	.submit_io		= nvme_kv_submit_io,
+	.check_io		= nvme_check_io,
+	.verify_io		= nvme_kv_verify_io,
+	.init_ns_worker_ctx	= nvme_init_ns_worker_ctx,
+	.cleanup_ns_worker_ctx	= nvme_cleanup_ns_worker_ctx,
+	.dump_transport_stats	= nvme_dump_transport_stats
+};
+
 static int
 build_nvme_name(char *name, size_t length, struct spdk_nvme_ctrlr *ctrlr)
 {
@@ -1218,7 +1444,8 @@ register_ns(struct spdk_nvme_ctrlr *ctrlr, struct spdk_nvme_ns *ns)
 	ns_size = spdk_nvme_ns_get_size(ns);
 	sector_size = spdk_nvme_ns_get_sector_size(ns);
 
-	if (ns_size < g_io_size_bytes || sector_size > g_io_size_bytes) {
+	/* KV workloads address keys, not blocks, so the namespace format does not matter. */
+	if (!g_kv_workload && (ns_size < g_io_size_bytes || sector_size > g_io_size_bytes)) {
 		printf("WARNING: controller %-20.20s (%-20.20s) ns %u has invalid "
 		       "ns size %" PRIu64 " / block size %u for I/O size %u\n",
 		       cdata->mn, cdata->sn, spdk_nvme_ns_get_id(ns),
@@ -1257,8 +1484,14 @@ register_ns(struct spdk_nvme_ctrlr *ctrlr, struct spdk_nvme_ns *ns)
 	entry->u.nvme.ns = ns;
 	entry->num_io_requests = g_queue_depth * entries;
 
-	entry->size_in_ios = ns_size / g_io_size_bytes;
-	entry->io_size_blocks = g_io_size_bytes / sector_size;
+	if (g_kv_workload) {
+		entry->fn_table = &nvme_kv_fn_table;
+		entry->size_in_ios = g_kv_num_keys;
+		entry->io_size_blocks = 1;
+	} else {
+		entry->size_in_ios = ns_size / g_io_size_bytes;
+		entry->io_size_blocks = g_io_size_bytes / sector_size;
+	}
 
 	if (g_is_random) {
 		entry->seed = rand();
@@ -1273,7 +1506,10 @@ register_ns(struct spdk_nvme_ctrlr *ctrlr, struct spdk_nvme_ns *ns)
 	entry->pi_loc = spdk_nvme_ns_get_data(ns)->dps.md_start;
 	entry->pi_type = spdk_nvme_ns_get_pi_type(ns);
 
-	if (spdk_nvme_ns_get_flags(ns) & SPDK_NVME_NS_DPS_PI_SUPPORTED) {
+	if (g_kv_workload) {
+		/* No protection information or metadata is transferred with KV commands. */
+		entry->md_size = 0;
+	} else if (spdk_nvme_ns_get_flags(ns) & SPDK_NVME_NS_DPS_PI_SUPPORTED) {
 		entry->io_flags = g_metacfg_pract_flag | g_metacfg_prchk_flags;
 	}
 
@@ -1286,7 +1522,7 @@ register_ns(struct spdk_nvme_ctrlr *ctrlr, struct spdk_nvme_ns *ns)
 		entry->block_size = spdk_nvme_ns_get_sector_size(ns);
 	}
 
-	if (g_io_size_bytes % entry->block_size != 0) {
+	if (!g_kv_workload && g_io_size_bytes % entry->block_size != 0) {
 		printf("WARNING: IO size %u (-o) is not a multiple of nsid %u sector size %u."
 		       " Removing this ns from test\n", g_io_size_bytes, spdk_nvme_ns_get_id(ns), entry->block_size);
 		g_warn = true;
@@ -1790,8 +2026,15 @@ usage(char *program_name)
 	printf("\t[-P, --num-qpairs <val> number of io queues per namespace. default: 1]\n");
 	printf("\t[-U, --num-unused-qpairs <val> number of unused io queues per controller. default: 0]\n");
 	printf("\t[-w, --io-pattern <pattern> io pattern type, must be one of\n");
-	printf("\t\t(read, write, randread, randwrite, rw, randrw)]\n");
+	printf("\t\t(read, write, randread, randwrite, rw, randrw,\n");
+	printf("\t\t kvstore, kvretrieve, kvexist, kvmixed, kvselect and their rand variants)]\n");
 	printf("\t[-M, --rwmixread <0-100> rwmixread (100 for reads, 0 for writes)]\n");
+	printf("\t[--kv-keys <num> number of keys in the key space of KV workloads, default: %d]\n",
+	       PERF_KV_DEFAULT_NUM_KEYS);
+	printf("\t[--kv-min-value-size <bytes> smallest KV value stored, -o is the largest. default: -o]\n");
+	printf("\t[--kv-query <query> SELECT query sent by kvselect, default: \"%s\"]\n",
+	       PERF_KV_DEFAULT_QUERY);
+	printf("\t[--kv-verify check retrieved KV values against the pattern stored by perf]\n");
 	printf("\t[-F, --zipf <theta> use zipf distribution for random I/O]\n");
 	printf("\t[-L, --enable-sw-latency-tracking enable latency tracking via sw, default: disabled]\n");
 	printf("\t\t-L for latency summary, -LL for detailed histogram\n");
@@ -1934,7 +2177,13 @@ print_performance(void)
 		TAILQ_FOREACH(ns_ctx, &worker->ns_ctx, link) {
 			if (ns_ctx->stats.io_completed != 0) {
 				io_per_second = (double)ns_ctx->stats.io_completed * 1000 * 1000 / g_elapsed_time_in_usec;
-				mb_per_second = io_per_second * g_io_size_bytes / (1024 * 1024);
+				if (g_kv_workload) {
+					/* KV values vary in size, so count the bytes actually transferred. */
+					mb_per_second = (double)ns_ctx->stats.kv_bytes * 1000 * 1000 / g_elapsed_time_in_usec /
+							(1024 * 1024);
+				} else {
+					mb_per_second = io_per_second * g_io_size_bytes / (1024 * 1024);
+				}
 				average_latency = ((double)ns_ctx->stats.total_tsc / ns_ctx->stats.io_completed) * 1000 * 1000 /
 						  g_tsc_rate;
 				min_latency = (double)ns_ctx->stats.min_tsc * 1000 * 1000 / g_tsc_rate;
@@ -1969,6 +2218,22 @@ print_performance(void)
 		printf("\n");
 	}
 
+	if (g_kv_workload) {
+		TAILQ_FOREACH(worker, &g_workers, link) {
+			TAILQ_FOREACH(ns_ctx, &worker->ns_ctx, link) {
+				printf("%-*.*s from core %2u: %" PRIu64 " of %" PRIu64 " KV commands found no key\n",
+				       max_strlen, max_strlen, ns_ctx->entry->name, worker->lcore,
+				       ns_ctx->stats.kv_misses, ns_ctx->stats.io_completed);
+				if (g_kv_verify) {
+					printf("%-*.*s from core %2u: %" PRIu64 " KV values did not match the stored pattern\n",
+					       max_strlen, max_strlen, ns_ctx->entry->name, worker->lcore,
+					       ns_ctx->stats.kv_miscompares);
+				}
+			}
+		}
+		printf("\n");
+	}
+
 	if (g_latency_sw_tracking_level == 0 || total_io_completed == 0) {
 		return;
 	}
@@ -2373,6 +2638,14 @@ static const struct option g_perf_cmdline_opts[] = {
 	{"transport-tos", required_argument, NULL, PERF_TRANSPORT_TOS},
 #define PERF_RDMA_SRQ_SIZE	268
 	{"rdma-srq-size", required_argument, NULL, PERF_RDMA_SRQ_SIZE},
+#define PERF_KV_KEYS		269
+	{"kv-keys", required_argument, NULL, PERF_KV_KEYS},
+#define PERF_KV_MIN_VALUE_SIZE	270
+	{"kv-min-value-size", required_argument, NULL, PERF_KV_MIN_VALUE_SIZE},
+#define PERF_KV_QUERY		271
+	{"kv-query", required_argument, NULL, PERF_KV_QUERY},
+#define PERF_KV_VERIFY		272
+	{"kv-verify", no_argument, NULL, PERF_KV_VERIFY},
 	/* Should be the last element */
 	{0, 0, 0, 0}
 };
@@ -2629,6 +2902,28 @@ parse_args(int argc, char **argv, struct spdk_env_opts *env_opts)
 			}
 			g_transport_tos = val;
 			break;
+		case PERF_KV_KEYS:
+			val2 = spdk_strtoll(optarg, 10);
+			if (val2 <= 0) {
+				fprintf(stderr, "Invalid KV key space size %s\n", optarg);
+				return 1;
+			}
+			g_kv_num_keys = (uint64_t)val2;
+			break;
+		case PERF_KV_MIN_VALUE_SIZE:
+			val = spdk_strtol(optarg, 10);
+			if (val <= 0) {
+				fprintf(stderr, "Invalid KV value size %s\n", optarg);
+				return 1;
+			}
+			g_kv_min_value_size = val;
+			break;
+		case PERF_KV_QUERY:
+			g_kv_query = optarg;
+			break;
+		case PERF_KV_VERIFY:
+			g_kv_verify = true;
+			break;
 		default:
 			usage(argv[0]);
 			return 1;
@@ -2695,10 +2990,49 @@ parse_args(int argc, char **argv, struct spdk_env_opts *env_opts)
 				"for rw or randrw.\n");
 			return 1;
 		}
+	} else if (strcmp(g_workload_type, "kvstore") == 0) {
+		g_kv_workload = PERF_KV_STORE;
+		g_rw_percentage = 0;
+	} else if (strcmp(g_workload_type, "kvretrieve") == 0) {
+		g_kv_workload = PERF_KV_RETRIEVE;
+		g_rw_percentage = 100;
+	} else if (strcmp(g_workload_type, "kvexist") == 0) {
+		g_kv_workload = PERF_KV_EXIST;
+		g_rw_percentage = 100;
+	} else if (strcmp(g_workload_type, "kvselect") == 0) {
+		g_kv_workload = PERF_KV_SELECT;
+		g_rw_percentage = 100;
+	} else if (strcmp(g_workload_type, "kvmixed") == 0) {
+		g_kv_workload = PERF_KV_MIXED;
+		if (g_rw_percentage < 0 || g_rw_percentage > 100) {
+			fprintf(stderr,
+				"-M (--rwmixread) must be specified to value from 0 to 100 "
+				"for kvmixed or randkvmixed.\n");
+			return 1;
+		}
 	} else {
 		fprintf(stderr,
 			"-w (--io-pattern) io pattern type must be one of\n"
-			"(read, write, randread, randwrite, rw, randrw)\n");
+			"(read, write, randread, randwrite, rw, randrw,\n"
+			" kvstore, kvretrieve, kvexist, kvmixed, kvselect and their rand variants)\n");
+		return 1;
+	}
+
+	if (g_kv_workload) {
+		if (g_use_uring || optind < argc) {
+			fprintf(stderr, "KV workloads can only be run on NVMe namespaces\n");
+			return 1;
+		}
+		if (g_kv_min_value_size > g_io_size_bytes) {
+			fprintf(stderr, "--kv-min-value-size must not be larger than -o (--io-size)\n");
+			return 1;
+		}
+		if (g_kv_workload == PERF_KV_SELECT && strlen(g_kv_query) >= g_io_size_bytes) {
+			fprintf(stderr, "--kv-query must be shorter than -o (--io-size)\n");
+			return 1;
+		}
+	} else if (g_kv_verify) {
+		fprintf(stderr, "--kv-verify can only be used with KV workloads\n");
 		return 1;
 	}
 
@@ -128,6 +128,7 @@ enum spdk_bdev_io_type {
 	SPDK_BDEV_IO_KV_RETRIEVE,
 	SPDK_BDEV_IO_KV_SEND_SELECT,
 	SPDK_BDEV_IO_KV_RETRIEVE_SELECT,
+	SPDK_BDEV_IO_KV_BATCH,
 	SPDK_BDEV_NUM_IO_TYPES /* Keep last */
 };
 
@@ -141,6 +142,12 @@ enum spdk_bdev_qos_rate_limit_type {
 	SPDK_BDEV_QOS_R_BPS_RATE_LIMIT,
 	/** Byte per second rate limit for write only */
 	SPDK_BDEV_QOS_W_BPS_RATE_LIMIT,
+	/** Operations per second rate limit for KV commands, each key of a batch counts */
+	SPDK_BDEV_QOS_KV_OPS_RATE_LIMIT,
+	/** Byte per second rate limit for KV commands */
+	SPDK_BDEV_QOS_KV_BPS_RATE_LIMIT,
+	/** Number of KV SELECTs in flight; a limit on concurrency, not a rate */
+	SPDK_BDEV_QOS_KV_SELECTS_LIMIT,
 	/** Keep last */
 	SPDK_BDEV_QOS_NUM_RATE_LIMIT_TYPES
 };
@@ -160,6 +167,26 @@ typedef void (*spdk_bdev_io_completion_cb)(struct spdk_bdev_io *bdev_io,
 
 struct spdk_bdev_io_error_stat;
 
+/** KV command types with their own entry in struct spdk_bdev_io_stat */
+enum spdk_bdev_kv_stat_op {
+	SPDK_BDEV_KV_STAT_STORE = 0,
+	SPDK_BDEV_KV_STAT_RETRIEVE,
+	SPDK_BDEV_KV_STAT_EXIST,
+	SPDK_BDEV_KV_STAT_DELETE,
+	SPDK_BDEV_KV_STAT_LIST,
+	SPDK_BDEV_KV_STAT_SEND_SELECT,
+	SPDK_BDEV_KV_STAT_RETRIEVE_SELECT,
+	SPDK_BDEV_KV_STAT_NUM_OPS,
+};
+
+/** Counters of one KV command type. Keys of a batch I/O count as separate ops. */
+struct spdk_bdev_kv_op_stat {
+	uint64_t num_ops;
+	uint64_t latency_ticks;
+	uint64_t max_latency_ticks;
+	uint64_t min_latency_ticks;
+};
+
 struct spdk_bdev_io_stat {
 	uint64_t bytes_read;
 	uint64_t num_read_ops;
@@ -188,7 +215,14 @@ struct spdk_bdev_io_stat {
 	 */
 	struct spdk_bdev_io_error_stat *io_error;
 
-	/* For efficient deep copy, no members should be added after io_error. */
+	/* Value bytes written by KV stores and returned by KV retrieves. */
+	uint64_t bytes_kv_stored;
+	uint64_t bytes_kv_retrieved;
+	/* Result bytes returned by KV retrieve select. */
+	uint64_t bytes_select_returned;
+	struct spdk_bdev_kv_op_stat kv_ops[SPDK_BDEV_KV_STAT_NUM_OPS];
+
+	/* For efficient deep copy, members after io_error must not be pointers. */
 };
 
 struct spdk_bdev_opts {
@@ -2093,6 +2127,15 @@ int spdk_bdev_kv_listv(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
                    struct iovec *iov, int iovcnt, uint64_t nbytes,
                    spdk_bdev_io_completion_cb cb, void *cb_arg);
 
+/**
+ * Same as spdk_bdev_kv_listv(), with extended options. See spdk_bdev_kv_storev_ext().
+ */
+int spdk_bdev_kv_listv_ext(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+                   unsigned char *key, size_t key_length,
+                   struct iovec *iov, int iovcnt, uint64_t nbytes,
+                   spdk_bdev_io_completion_cb cb, void *cb_arg,
+                   struct spdk_bdev_ext_io_opts *opts);
+
 int spdk_bdev_kv_exist(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
                    unsigned char *key, size_t key_length,
 		   spdk_bdev_io_completion_cb cb, void *cb_arg);
@@ -2111,16 +2154,94 @@ int spdk_bdev_kv_storev(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
                    struct iovec *iov, int iovcnt, uint64_t nbytes, uint8_t options,
                    spdk_bdev_io_completion_cb cb, void *cb_arg);
 
+/**
+ * Store a value from a vector of buffers, with extended options.
+ *
+ * opts may describe the buffers with a memory domain. If the bdev supports that
+ * memory domain the buffers are handed to it as they are, otherwise the value is
+ * pulled into a buffer from the bdev iobuf pool first, which limits it to the
+ * size of a large iobuf buffer. KV commands carry no metadata, so opts->metadata
+ * must be NULL. opts must remain valid until cb is called.
+ *
+ * \param desc Block device descriptor.
+ * \param ch I/O channel. Obtained by calling spdk_bdev_get_io_channel().
+ * \param key Key of the value.
+ * \param key_length Length of key.
+ * \param iov A scatter gather list of buffers holding the value.
+ * \param iovcnt The number of elements in iov.
+ * \param nbytes Length of the value.
+ * \param options NVME_KV_STORE_CMD_OPTION_* flags.
+ * \param cb Called when the request is complete.
+ * \param cb_arg Argument passed to cb.
+ * \param opts Optional extended options, may be NULL.
+ *
+ * \return 0 on success. On success, the callback will always be called (even if
+ * the request ultimately failed). Return negated errno on failure, in which case
+ * the callback will not be called.
+ *   * -EINVAL - key_length or opts is invalid
+ *   * -EBADF - desc not open for writing
+ *   * -ENOMEM - spdk_bdev_io buffer cannot be allocated
+ */
+int spdk_bdev_kv_storev_ext(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+                   unsigned char *key, size_t key_length,
+                   struct iovec *iov, int iovcnt, uint64_t nbytes, uint8_t options,
+                   spdk_bdev_io_completion_cb cb, void *cb_arg,
+                   struct spdk_bdev_ext_io_opts *opts);
+
+/**
+ * Retrieve the value of a key, or part of it.
+ *
+ * The completion DW0 (see spdk_bdev_io_get_nvme_status()) is the total length of
+ * the value, which may be more than was read.
+ *
+ * If buf is NULL, the bdev layer provides the buffer from the bdev iobuf pool and
+ * nbytes is only a hint of the value length; 0 selects 4 KiB. A value longer than
+ * the hint is read again into a buffer large enough for it, up to the size of a
+ * large iobuf buffer. The data is available from spdk_bdev_io_get_iovec() in the
+ * completion callback and the buffer goes back to the pool with spdk_bdev_free_io().
+ *
+ * \param desc Block device descriptor.
+ * \param ch I/O channel. Obtained by calling spdk_bdev_get_io_channel().
+ * \param key Key of the value.
+ * \param key_length Length of key.
+ * \param buf Data buffer, or NULL to let the bdev layer provide one.
+ * \param offset Offset into the value to read from.
+ * \param nbytes Size of buf, or the expected length of the value if buf is NULL.
+ * \param cb Called when the request is complete.
+ * \param cb_arg Argument passed to cb.
+ *
+ * \return 0 on success. On success, the callback will always be called (even if
+ * the request ultimately failed). Return negated errno on failure, in which case
+ * the callback will not be called.
+ *   * -EINVAL - key_length is invalid
+ *   * -ENOMEM - spdk_bdev_io buffer cannot be allocated
+ */
 int spdk_bdev_kv_retrieve(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
                    unsigned char *key, size_t key_length,
                    void *buf, uint64_t offset, uint64_t nbytes,
                    spdk_bdev_io_completion_cb cb, void *cb_arg);
 
+/**
+ * Retrieve the value of a key, or part of it, into a vector of buffers.
+ *
+ * Same as spdk_bdev_kv_retrieve(). If iov is NULL, iovcnt is ignored and the bdev
+ * layer provides the buffer.
+ */
 int spdk_bdev_kv_retrievev(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
                    unsigned char *key, size_t key_length,
                    struct iovec *iov, int iovcnt, uint64_t offset, uint64_t nbytes,
                    spdk_bdev_io_completion_cb cb, void *cb_arg);
 
+/**
+ * Same as spdk_bdev_kv_retrievev(), with extended options. See
+ * spdk_bdev_kv_storev_ext(). With a memory domain, iov must be provided.
+ */
+int spdk_bdev_kv_retrievev_ext(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+                   unsigned char *key, size_t key_length,
+                   struct iovec *iov, int iovcnt, uint64_t offset, uint64_t nbytes,
+                   spdk_bdev_io_completion_cb cb, void *cb_arg,
+                   struct spdk_bdev_ext_io_opts *opts);
+
 int spdk_bdev_kv_send_select(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
                    unsigned char *key, size_t key_length,
                    void *buf, uint64_t nbytes, uint8_t options,
@@ -2133,6 +2254,16 @@ int spdk_bdev_kv_send_selectv(struct spdk_bdev_desc *desc, struct spdk_io_channe
                    uint8_t input_type, uint8_t output_type,
                    spdk_bdev_io_completion_cb cb, void *cb_arg);
 
+/**
+ * Same as spdk_bdev_kv_send_selectv(), with extended options. See spdk_bdev_kv_storev_ext().
+ */
+int spdk_bdev_kv_send_selectv_ext(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+                   unsigned char *key, size_t key_length,
+                   struct iovec *iov, int iovcnt, uint64_t nbytes, uint8_t options,
+                   uint8_t input_type, uint8_t output_type,
+                   spdk_bdev_io_completion_cb cb, void *cb_arg,
+                   struct spdk_bdev_ext_io_opts *opts);
+
 int spdk_bdev_kv_retrieve_select(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
                    void *buf, uint64_t offset, uint64_t nbytes,
                    uint32_t select_id, uint8_t options,
@@ -2143,6 +2274,508 @@ int spdk_bdev_kv_retrieve_selectv(struct spdk_bdev_desc *desc, struct spdk_io_ch
                    uint32_t select_id, uint8_t options,
                    spdk_bdev_io_completion_cb cb, void *cb_arg);
 
+/**
+ * Same as spdk_bdev_kv_retrieve_selectv(), with extended options. See
+ * spdk_bdev_kv_storev_ext().
+ */
+int spdk_bdev_kv_retrieve_selectv_ext(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+                   struct iovec *iov, int iovcnt, uint64_t offset, uint64_t nbytes,
+                   uint32_t select_id, uint8_t options,
+                   spdk_bdev_io_completion_cb cb, void *cb_arg,
+                   struct spdk_bdev_ext_io_opts *opts);
+
+/**
+ * One key of a batched KV request submitted through spdk_bdev_kv_mget(),
+ * spdk_bdev_kv_mput() or spdk_bdev_kv_mexist().
+ */
+struct spdk_bdev_kv_batch_entry {
+	/** Key and its length in bytes. */
+	unsigned char key[NVME_KV_MAX_KEY_LENGTH];
+	size_t key_length;
+
+	/** Value buffer. Not used by spdk_bdev_kv_mexist(). */
+	struct iovec *iovs;
+	int iovcnt;
+	uint64_t nbytes;
+
+	/** Offset into the value to retrieve from. Only used by spdk_bdev_kv_mget(). */
+	uint64_t offset;
+
+	/** NVME_KV_STORE_CMD_OPTION_* flags. Only used by spdk_bdev_kv_mput(). */
+	uint8_t options;
+
+	/**
+	 * Per-key completion, valid once the batch has completed. cdw0 holds the
+	 * total value length for spdk_bdev_kv_mget().
+	 */
+	uint32_t cdw0;
+	int sct;
+	int sc;
+
+	/** Used by the bdev module while the batch is outstanding. */
+	struct {
+		void *ctx;
+		int iovpos;
+		uint32_t iov_offset;
+	} internal;
+};
+
+/**
+ * Retrieve the values of several keys with a single bdev I/O.
+ *
+ * All keys are submitted to the device together and cb is called once, after
+ * every key has completed. The per-key status is reported in each entry. A key
+ * that does not exist does not fail the batch; any other per-key error
+ * completes the batch with that NVMe status.
+ *
+ * The entries array must remain valid until cb is called.
+ *
+ * \param desc Block device descriptor.
+ * \param ch I/O channel. Obtained by calling spdk_bdev_get_io_channel().
+ * \param entries Array of keys and value buffers.
+ * \param num_entries Number of entries in the array.
+ * \param cb Called when the request is complete.
+ * \param cb_arg Argument passed to cb.
+ *
+ * \return 0 on success. On success, the callback will always
+ * be called (even if the request ultimately failed). Return
+ * negated errno on failure, in which case the callback will not be called.
+ *   * -EINVAL - num_entries is 0 or a key length is invalid
+ *   * -ENOTSUP - the bdev does not support batched KV requests
+ *   * -ENOMEM - spdk_bdev_io buffer cannot be allocated
+ */
+int spdk_bdev_kv_mget(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+		      struct spdk_bdev_kv_batch_entry *entries, uint32_t num_entries,
+		      spdk_bdev_io_completion_cb cb, void *cb_arg);
+
+/**
+ * Store the values of several keys with a single bdev I/O.
+ *
+ * See spdk_bdev_kv_mget() for completion semantics.
+ *
+ * \return 0 on success, negated errno on failure. In addition to the errors
+ * of spdk_bdev_kv_mget(), -EBADF is returned if desc is not open for writing.
+ */
+int spdk_bdev_kv_mput(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+		      struct spdk_bdev_kv_batch_entry *entries, uint32_t num_entries,
+		      spdk_bdev_io_completion_cb cb, void *cb_arg);
+
+/**
+ * Check the existence of several keys with a single bdev I/O.
+ *
+ * See spdk_bdev_kv_mget() for completion semantics. A missing key is
+ * reported as SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST in its entry.
+ *
+ * \return 0 on success, negated errno on failure.
+ */
+int spdk_bdev_kv_mexist(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+			struct spdk_bdev_kv_batch_entry *entries, uint32_t num_entries,
+			spdk_bdev_io_completion_cb cb, void *cb_arg);
+
+/** Streaming reader over the results of a SELECT query. */
+struct spdk_bdev_kv_select_cursor;
+
+/**
+ * Called for each chunk of SELECT results, in offset order.
+ *
+ * \param cb_arg Argument passed to spdk_bdev_kv_select_cursor_open().
+ * \param buf Result data. Only valid until the callback returns.
+ * \param len Number of valid bytes in buf.
+ * \param offset Offset of buf within the result set.
+ *
+ * \return 0 to keep reading. Any other value stops the cursor and is
+ * reported as the status of the done callback.
+ */
+typedef int (*spdk_bdev_kv_select_chunk_cb)(void *cb_arg, const void *buf, uint32_t len,
+		uint64_t offset);
+
+/**
+ * Called once when the cursor is finished. The cursor is freed on return.
+ *
+ * \param cb_arg Argument passed to spdk_bdev_kv_select_cursor_open().
+ * \param status 0 if the whole result set was delivered, the value returned by
+ * the chunk callback if it stopped the cursor, -ECANCELED if the cursor was
+ * closed, or another negated errno on failure.
+ * \param total_len Length of the result set, or 0 if it is not known.
+ */
+typedef void (*spdk_bdev_kv_select_done_cb)(void *cb_arg, int status, uint64_t total_len);
+
+/**
+ * Send a SELECT query and stream its results.
+ *
+ * The cursor copies the query, sends it and then keeps up to queue_depth
+ * retrieve select commands in flight over successive offsets of the result
+ * set. Each command reads into its own buffer from the bdev iobuf pool.
+ * Chunks are handed to chunk_cb in offset order as they land. The select is
+ * released on the device when the cursor finishes, including when it stops
+ * early.
+ *
+ * \param desc Block device descriptor.
+ * \param ch I/O channel. Obtained by calling spdk_bdev_get_io_channel().
+ * \param key Key of the object to query.
+ * \param key_length Length of key.
+ * \param query SELECT statement.
+ * \param query_len Length of query. Must not exceed the chunk size.
+ * \param options NVME_KV_SELECT_CMD_OUTPUT_TYPE_* header options.
+ * \param input_type NVME_KV_SELECT_TYPE_* format of the stored object.
+ * \param output_type NVME_KV_SELECT_TYPE_* format of the results.
+ * \param chunk_size Size of each retrieve select command. 0 selects the default.
+ * \param queue_depth Number of retrieve select commands kept in flight. 0 selects
+ * the default.
+ * \param chunk_cb Called for each chunk of results.
+ * \param done_cb Called once when the cursor is finished.
+ * \param cb_arg Argument passed to chunk_cb and done_cb.
+ * \param cursor On success, the cursor. Valid until done_cb is called.
+ *
+ * \return 0 on success, in which case done_cb will always be called. Return
+ * negated errno on failure, in which case no callback will be called.
+ *   * -EINVAL - a length or the queue depth is invalid
+ *   * -ENOMEM - the cursor cannot be allocated
+ */
+int spdk_bdev_kv_select_cursor_open(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+				    unsigned char *key, size_t key_length,
+				    const char *query, uint32_t query_len, uint8_t options,
+				    uint8_t input_type, uint8_t output_type,
+				    uint32_t chunk_size, uint32_t queue_depth,
+				    spdk_bdev_kv_select_chunk_cb chunk_cb,
+				    spdk_bdev_kv_select_done_cb done_cb, void *cb_arg,
+				    struct spdk_bdev_kv_select_cursor **cursor);
+
+/**
+ * Stop a cursor before the end of the result set.
+ *
+ * No more chunks are delivered. done_cb is called with -ECANCELED once the
+ * commands in flight have completed and the select has been released.
+ *
+ * \param cursor Cursor returned by spdk_bdev_kv_select_cursor_open().
+ */
+void spdk_bdev_kv_select_cursor_close(struct spdk_bdev_kv_select_cursor *cursor);
+
+/** Iterator over the keys of a KV bdev. */
+struct spdk_bdev_kv_list_iter;
+
+/**
+ * Called for each key found by a list iterator.
+ *
+ * \param cb_arg Argument passed to spdk_bdev_kv_list_iter_open().
+ * \param key Key. Points into the listing buffer and is only valid until the
+ * callback returns.
+ * \param key_length Length of key.
+ *
+ * \return 0 to keep listing. Any other value stops the iterator and is
+ * reported as the status of the done callback.
+ */
+typedef int (*spdk_bdev_kv_list_key_cb)(void *cb_arg, const unsigned char *key,
+					size_t key_length);
+
+/**
+ * Called once when a list iterator is finished. The iterator is freed on return.
+ *
+ * \param cb_arg Argument passed to spdk_bdev_kv_list_iter_open().
+ * \param status 0 if all keys were listed, the value returned by the key
+ * callback if it stopped the iterator, -ECANCELED if the iterator was closed,
+ * or another negated errno on failure.
+ * \param num_keys Number of keys passed to the key callback.
+ */
+typedef void (*spdk_bdev_kv_list_done_cb)(void *cb_arg, int status, uint64_t num_keys);
+
+/**
+ * List all keys starting with a prefix.
+ *
+ * The iterator issues as many KV list commands as it takes to return every key.
+ * When a listing fills its buffer, the prefix is split into 256 longer ones that
+ * are listed in turn. Each key is reported exactly once, in ascending order
+ * within a shard.
+ *
+ * The key space under the prefix can be split into num_shards ranges of the
+ * next key byte. Up to queue_depth shards are walked concurrently, each with
+ * its own buffer from the bdev iobuf pool. To spread a listing over several
+ * queue pairs, open one iterator per thread, each with a disjoint range of
+ * shards.
+ *
+ * \param desc Block device descriptor.
+ * \param ch I/O channel. Obtained by calling spdk_bdev_get_io_channel().
+ * \param prefix Key prefix. Copied, so it does not need to remain valid.
+ * \param prefix_length Length of prefix. 0 lists all keys.
+ * \param num_shards Number of shards to split the key space into, up to 256.
+ * 0 or 1 does not split it.
+ * \param first_shard First shard walked by this iterator.
+ * \param shard_count Number of shards walked by this iterator. 0 walks all
+ * shards from first_shard on.
+ * \param queue_depth Number of shards walked concurrently. 0 selects the default.
+ * \param key_cb Called for each key.
+ * \param done_cb Called once when the iterator is finished.
+ * \param cb_arg Argument passed to key_cb and done_cb.
+ * \param iter On success, the iterator. Valid until done_cb is called.
+ *
+ * \return 0 on success, in which case done_cb will always be called. Return
+ * negated errno on failure, in which case no callback will be called.
+ *   * -EINVAL - the prefix length, a shard parameter or the queue depth is invalid
+ *   * -ENOMEM - the iterator cannot be allocated
+ */
+int spdk_bdev_kv_list_iter_open(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+				const unsigned char *prefix, size_t prefix_length,
+				uint32_t num_shards, uint32_t first_shard, uint32_t shard_count,
+				uint32_t queue_depth,
+				spdk_bdev_kv_list_key_cb key_cb,
+				spdk_bdev_kv_list_done_cb done_cb, void *cb_arg,
+				struct spdk_bdev_kv_list_iter **iter);
+
+/**
+ * Stop a list iterator before all keys were listed.
+ *
+ * No more keys are reported. done_cb is called with -ECANCELED once the
+ * commands in flight have completed.
+ *
+ * \param iter Iterator returned by spdk_bdev_kv_list_iter_open().
+ */
+void spdk_bdev_kv_list_iter_close(struct spdk_bdev_kv_list_iter *iter);
+
+/** SELECT query over many keys, with the results merged on the host. */
+struct spdk_bdev_kv_multi_select;
+
+/** How the partial results of one aggregate column are combined across keys. */
+enum spdk_bdev_kv_select_agg {
+	SPDK_BDEV_KV_SELECT_AGG_COUNT,
+	SPDK_BDEV_KV_SELECT_AGG_SUM,
+	SPDK_BDEV_KV_SELECT_AGG_MIN,
+	SPDK_BDEV_KV_SELECT_AGG_MAX,
+};
+
+struct spdk_bdev_kv_multi_select_opts {
+	/**
+	 * Keys to query. Copied, so they do not need to remain valid. If NULL, every
+	 * key starting with prefix is queried instead.
+	 */
+	const unsigned char *const *keys;
+	const size_t *key_lengths;
+	uint32_t num_keys;
+
+	/** Key prefix, used when keys is NULL. A zero length queries all keys. */
+	const unsigned char *prefix;
+	size_t prefix_length;
+
+	/** SELECT statement, header options and formats, as for a select cursor. */
+	const char *query;
+	uint32_t query_len;
+	uint8_t options;
+	uint8_t input_type;
+	uint8_t output_type;
+
+	/** Number of keys queried concurrently. 0 selects the default. */
+	uint32_t queue_depth;
+
+	/** Chunk size and queue depth of the cursor for each key. 0 selects the defaults. */
+	uint32_t chunk_size;
+	uint32_t chunk_depth;
+
+	/**
+	 * For a query made only of aggregates, how each result column is combined,
+	 * in the order of the query. AVG cannot be combined from per-key averages;
+	 * query SUM and COUNT instead and divide. 0 concatenates the results.
+	 */
+	const enum spdk_bdev_kv_select_agg *aggs;
+	uint32_t num_aggs;
+};
+
+/**
+ * Called with the merged results of a multi-key select.
+ *
+ * \param cb_arg Argument passed to spdk_bdev_kv_multi_select_open().
+ * \param key Key the rows were selected from, or NULL for the final row of
+ * combined aggregates.
+ * \param key_length Length of key.
+ * \param buf Whole rows. Only valid until the callback returns.
+ * \param len Number of valid bytes in buf.
+ *
+ * \return 0 to keep going. Any other value stops the select and is reported
+ * as the status of the done callback.
+ */
+typedef int (*spdk_bdev_kv_multi_select_data_cb)(void *cb_arg, const unsigned char *key,
+		size_t key_length, const void *buf, size_t len);
+
+/**
+ * Called once when a multi-key select is finished. It is freed on return.
+ *
+ * \param cb_arg Argument passed to spdk_bdev_kv_multi_select_open().
+ * \param status 0 if every key was queried, the value returned by the data
+ * callback if it stopped the select, -ECANCELED if it was closed, or the
+ * first error of a query, cursor or listing.
+ * \param num_keys Number of keys whose results were delivered or combined.
+ */
+typedef void (*spdk_bdev_kv_multi_select_done_cb)(void *cb_arg, int status, uint64_t num_keys);
+
+/**
+ * Run a SELECT query on many keys and merge the results.
+ *
+ * The keys come from a list or from a list iterator over a prefix. Up to
+ * queue_depth keys are queried at once, each through a select cursor that
+ * keeps its retrieve select commands pipelined. The results of one key are
+ * buffered until they are complete, then handed to data_cb, so rows of
+ * different keys never interleave. Keys are delivered in completion order.
+ *
+ * CSV and JSON lines results are concatenated. With CSV output headers, only
+ * the first key to return rows keeps its header line. When aggregates are
+ * given, each key must return one row of partial aggregates; these are folded
+ * together and data_cb is called once, at the end, with the final row in the
+ * same format the device uses.
+ *
+ * \param desc Block device descriptor.
+ * \param ch I/O channel. Obtained by calling spdk_bdev_get_io_channel().
+ * \param opts Keys, query and merge options. Copied.
+ * \param data_cb Called with results.
+ * \param done_cb Called once when the select is finished.
+ * \param cb_arg Argument passed to data_cb and done_cb.
+ * \param ms On success, the select. Valid until done_cb is called.
+ *
+ * \return 0 on success, in which case done_cb will always be called, and
+ * never before this function returns. Return negated errno on failure, in
+ * which case no callback will be called.
+ *   * -EINVAL - a key, the prefix, the query, an aggregate or the queue depth is invalid
+ *   * -ENOMEM - the select cannot be allocated
+ */
+int spdk_bdev_kv_multi_select_open(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+				   const struct spdk_bdev_kv_multi_select_opts *opts,
+				   spdk_bdev_kv_multi_select_data_cb data_cb,
+				   spdk_bdev_kv_multi_select_done_cb done_cb, void *cb_arg,
+				   struct spdk_bdev_kv_multi_select **ms);
+
+/**
+ * Stop a multi-key select.
+ *
+ * No more results are delivered and no more keys are queried. done_cb is
+ * called with -ECANCELED once the cursors and the listing have finished.
+ *
+ * \param ms Select returned by spdk_bdev_kv_multi_select_open().
+ */
+void spdk_bdev_kv_multi_select_close(struct spdk_bdev_kv_multi_select *ms);
+
+/*
+ * Long keys
+ *
+ * Keys longer than NVME_KV_MAX_KEY_LENGTH are mapped to device keys by hashing
+ * them. The full key is kept in a header in front of the value on the device and
+ * is compared on every access, so keys whose hashes collide do not clash. A bdev
+ * used with these functions should not also be accessed with plain KV commands.
+ */
+
+#define SPDK_BDEV_KV_LONG_KEY_MAX_LENGTH 1024
+
+/**
+ * Completion of a long key request.
+ *
+ * \param cb_arg Argument passed to the request.
+ * \param cdw0 For a retrieve, the total length of the value.
+ * \param sct NVMe status code type.
+ * \param sc NVMe status code. SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST if the key
+ * does not exist.
+ */
+typedef void (*spdk_bdev_kv_long_key_cb)(void *cb_arg, uint32_t cdw0, int sct, int sc);
+
+/**
+ * Store the value of a long key.
+ *
+ * Takes one header read per device key probed and one store. If all device keys
+ * the key can map to are taken by other keys, the request fails with
+ * SPDK_NVME_SC_CAPACITY_EXCEEDED.
+ *
+ * \param desc Block device descriptor.
+ * \param ch I/O channel. Obtained by calling spdk_bdev_get_io_channel().
+ * \param key Key. Copied, so it does not need to remain valid.
+ * \param key_length Length of key, up to SPDK_BDEV_KV_LONG_KEY_MAX_LENGTH.
+ * \param iov Value buffers. Must remain valid until cb is called.
+ * \param iovcnt Number of value buffers.
+ * \param nbytes Length of the value.
+ * \param options NVME_KV_STORE_CMD_OPTION_* flags.
+ * \param cb Called when the request is complete.
+ * \param cb_arg Argument passed to cb.
+ *
+ * \return 0 on success, in which case cb will always be called. Return negated
+ * errno on failure, in which case cb will not be called.
+ *   * -EINVAL - the key length is invalid
+ *   * -ENOMEM - the request cannot be allocated
+ */
+int spdk_bdev_kv_long_key_store(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+				const unsigned char *key, size_t key_length,
+				struct iovec *iov, int iovcnt, uint64_t nbytes, uint8_t options,
+				spdk_bdev_kv_long_key_cb cb, void *cb_arg);
+
+/**
+ * Retrieve the value of a long key.
+ *
+ * A retrieve from offset 0 reads the header and the value with a single command
+ * per device key probed. The contents of iov are undefined if the key does not
+ * exist.
+ *
+ * See spdk_bdev_kv_long_key_store() for the parameters and return values.
+ */
+int spdk_bdev_kv_long_key_retrieve(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+				   const unsigned char *key, size_t key_length,
+				   struct iovec *iov, int iovcnt, uint64_t offset, uint64_t nbytes,
+				   spdk_bdev_kv_long_key_cb cb, void *cb_arg);
+
+/**
+ * Check whether a long key exists.
+ *
+ * See spdk_bdev_kv_long_key_store() for the parameters and return values.
+ */
+int spdk_bdev_kv_long_key_exist(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+				const unsigned char *key, size_t key_length,
+				spdk_bdev_kv_long_key_cb cb, void *cb_arg);
+
+/**
+ * Delete a long key.
+ *
+ * See spdk_bdev_kv_long_key_store() for the parameters and return values.
+ */
+int spdk_bdev_kv_long_key_delete(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+				 const unsigned char *key, size_t key_length,
+				 spdk_bdev_kv_long_key_cb cb, void *cb_arg);
+
+/**
+ * Called for each long key found by spdk_bdev_kv_long_key_list().
+ *
+ * \param cb_arg Argument passed to spdk_bdev_kv_long_key_list().
+ * \param key Key. Only valid until the callback returns.
+ * \param key_length Length of key.
+ *
+ * \return 0 to keep listing. Any other value stops the listing and is reported
+ * as the status of the done callback.
+ */
+typedef int (*spdk_bdev_kv_long_key_list_cb)(void *cb_arg, const unsigned char *key,
+		size_t key_length);
+
+/**
+ * Called once when a long key listing is finished.
+ *
+ * \param cb_arg Argument passed to spdk_bdev_kv_long_key_list().
+ * \param status 0 if all keys were listed, the value returned by the key
+ * callback if it stopped the listing, or a negated errno on failure.
+ */
+typedef void (*spdk_bdev_kv_long_key_list_done_cb)(void *cb_arg, int status);
+
+/**
+ * List the long keys starting with a prefix.
+ *
+ * Hashing does not preserve key order, so every device key is listed and its
+ * header read. Keys are reported in no particular order.
+ *
+ * \param desc Block device descriptor.
+ * \param ch I/O channel. Obtained by calling spdk_bdev_get_io_channel().
+ * \param prefix Key prefix. Copied, so it does not need to remain valid.
+ * \param prefix_length Length of prefix. 0 lists all keys.
+ * \param name_cb Called for each key.
+ * \param done_cb Called once when the listing is finished.
+ * \param cb_arg Argument passed to name_cb and done_cb.
+ *
+ * \return 0 on success, in which case done_cb will always be called. Return
+ * negated errno on failure, in which case no callback will be called.
+ */
+int spdk_bdev_kv_long_key_list(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+			       const unsigned char *prefix, size_t prefix_length,
+			       spdk_bdev_kv_long_key_list_cb name_cb,
+			       spdk_bdev_kv_long_key_list_done_cb done_cb, void *cb_arg);
+
 #ifdef __cplusplus
 }
 #endif
@@ -521,6 +521,9 @@ struct spdk_bdev {
 		/** True if the state of the QoS is being modified */
 		bool qos_mod_in_progress;
 
+		/** KV SELECTs admitted by QoS that have not completed yet */
+		uint32_t qos_kv_selects_outstanding;
+
 		/**
 		 * SPDK spinlock protecting many of the internal fields of this structure. If
 		 * multiple locks need to be held, the following order must be used:
@@ -735,6 +738,11 @@ struct spdk_bdev_io {
 				uint8_t select_output_type;
 				uint32_t offset;
 				uint32_t buffer_size;
+				/** Entries of a SPDK_BDEV_IO_KV_BATCH request */
+				struct spdk_bdev_kv_batch_entry *batch;
+				uint32_t batch_count;
+				/** Per-key I/O type of a SPDK_BDEV_IO_KV_BATCH request */
+				uint8_t batch_type;
 			} nvme_kv;
 		} bdev;
 		struct {
@@ -844,6 +852,9 @@ struct spdk_bdev_io {
 		/** Status for the IO */
 		int8_t status;
 
+		/** True if this I/O counts against the QoS limit of KV SELECTs in flight */
+		bool qos_kv_select;
+
 		/** bdev allocated memory associated with this request */
 		void *buf;
 
@@ -1107,6 +1118,94 @@ void spdk_bdev_io_set_md_buf(struct spdk_bdev_io *bdev_io, void *md_buf, size_t
 void spdk_bdev_io_complete(struct spdk_bdev_io *bdev_io,
 			   enum spdk_bdev_io_status status);
 
+/**
+ * Submit a KV bdev_io received by a virtual bdev to the bdev opened by desc.
+ *
+ * The key, options, offsets and data buffers of bdev_io are reused as they are,
+ * so bdev_io must not be completed before cb is called. Complete it from cb with
+ * spdk_bdev_kv_io_complete_from().
+ *
+ * \param desc Descriptor of the bdev to submit to.
+ * \param ch I/O channel of that bdev.
+ * \param bdev_io A bdev_io of one of the SPDK_BDEV_IO_KV_* types.
+ * \param cb Called when the I/O submitted to desc completes.
+ * \param cb_arg Argument passed to cb.
+ *
+ * \return 0 on success, or the negated errno of the matching spdk_bdev_kv_*()
+ * call. -EINVAL if bdev_io is not a KV I/O.
+ */
+int spdk_bdev_kv_io_forward(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+			    struct spdk_bdev_io *bdev_io,
+			    spdk_bdev_io_completion_cb cb, void *cb_arg);
+
+/**
+ * Complete a bdev_io with the NVMe status and DW0 of another, completed, bdev_io.
+ *
+ * Used by virtual bdevs to hand the result of a KV command, such as the value
+ * length or the select id in DW0, back to their caller.
+ *
+ * \param bdev_io I/O to complete.
+ * \param child Completed I/O to take the status from.
+ */
+void spdk_bdev_kv_io_complete_from(struct spdk_bdev_io *bdev_io, const struct spdk_bdev_io *child);
+
+/**
+ * Check whether an I/O type is one of the SPDK_BDEV_IO_KV_* types.
+ *
+ * \param io_type I/O type to check.
+ *
+ * \return true for KV I/O types, false otherwise.
+ */
+static inline bool
+spdk_bdev_io_type_is_kv(enum spdk_bdev_io_type io_type)
+{
+	return io_type >= SPDK_BDEV_IO_KV_LIST && io_type <= SPDK_BDEV_IO_KV_BATCH;
+}
+
+/**
+ * The 64 bit finalizer of MurmurHash3.
+ *
+ * \param h Value to mix.
+ *
+ * \return h with every bit mixed into every other.
+ */
+static inline uint64_t
+spdk_bdev_kv_fmix64(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+/**
+ * Hash a KV key, for the in-memory key indexes of KV bdev modules. The result is
+ * not stable across releases and must not be stored.
+ *
+ * \param key Key to hash.
+ * \param key_len Length of the key, at most NVME_KV_MAX_KEY_LENGTH.
+ *
+ * \return Hash of the key.
+ */
+static inline uint64_t
+spdk_bdev_kv_key_hash(const uint8_t *key, size_t key_len)
+{
+	uint64_t lo = 0, hi = 0, h;
+
+	memcpy(&lo, key, spdk_min(key_len, 8));
+	if (key_len > 8) {
+		memcpy(&hi, key + 8, key_len - 8);
+	}
+
+	h = lo * 0x9e3779b97f4a7c15ULL ^ hi * 0xc2b2ae3d27d4eb4fULL ^ key_len;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return h;
+}
+
 /**
  * Complete a bdev_io with an NVMe status code and DW0 completion queue entry
  *
@@ -1380,12 +1479,18 @@ int spdk_bdev_part_submit_request(struct spdk_bdev_part_channel *ch, struct spdk
  * spdk_bdev_part_construct to the I/O. The user should not manually
  * apply this offset before submitting any I/O through this function.
  *
+ * KV I/O is passed to the underlying bdev as it is, so all partitions of a KV
+ * capable bdev share its key space.
+ *
  * This function enables user to specify a completion callback. It is required that
  * the completion callback calls spdk_bdev_io_complete() for the forwarded I/O.
+ * For KV I/O it should call spdk_bdev_kv_io_complete_from() instead, so the NVMe
+ * status and DW0 reach the caller.
  *
  * \param ch The I/O channel associated with the spdk_bdev_part.
  * \param bdev_io The I/O to be submitted to the underlying bdev.
- * \param cb Called when the forwarded I/O completes.
+ * \param cb Called when the forwarded I/O completes. Its cb_arg is the completed
+ * I/O submitted to the underlying bdev, valid until cb returns.
  * \return 0 on success or non-zero if submit request failed.
  */
 int spdk_bdev_part_submit_request_ext(struct spdk_bdev_part_channel *ch,
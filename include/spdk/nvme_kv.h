@@ -72,6 +72,17 @@ int spdk_nvme_ns_cmd_kvlistv(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *qp
 			    spdk_nvme_req_reset_sgl_cb reset_sgl_fn,
 			    spdk_nvme_req_next_sge_cb next_sge_fn);
 
+/**
+ * Same as spdk_nvme_ns_cmd_kvlistv(), with extended options. See
+ * spdk_nvme_ns_cmd_kvstorev_ext().
+ */
+int spdk_nvme_ns_cmd_kvlistv_ext(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *qpair,
+				 unsigned char *prefix, size_t prefix_len, uint64_t buffer_size,
+				 spdk_nvme_cmd_cb cb_fn, void *cb_arg,
+				 spdk_nvme_req_reset_sgl_cb reset_sgl_fn,
+				 spdk_nvme_req_next_sge_cb next_sge_fn,
+				 struct spdk_nvme_ns_cmd_ext_io_opts *opts);
+
 /**
  * Deletes a key-value pair.
  *
@@ -143,6 +154,15 @@ int spdk_nvme_ns_cmd_kvexist(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *qp
  * The user must ensure that only one thread submits I/O on a given qpair at any
  * given time.
  *
+ * Values larger than the controller's maximum transfer size are written as an
+ * initial store followed by SPDK_NVME_KV_STORE_FLAG_APPEND stores of the
+ * remaining chunks. Each append is submitted once the previous chunk has
+ * completed, and cb_fn is invoked once after the last chunk or the first error.
+ * The requests for all of the chunks are allocated when the store is submitted,
+ * so -ENOMEM is returned before anything has been written. Such a split store
+ * is not atomic: if a chunk fails, the chunks written before it stay on the
+ * device and the key is left holding a partial value.
+ *
  * \param ns NVMe namespace to submit the write I/O.
  * \param qpair I/O queue pair to submit the request.
  * \param key Key to associate with data
@@ -174,6 +194,41 @@ int spdk_nvme_ns_cmd_kvstorev(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *q
 					spdk_nvme_req_reset_sgl_cb reset_sgl_fn,
 					spdk_nvme_req_next_sge_cb next_sge_fn);
 
+/**
+ * Stores a key-value pair from a scattered payload, with extended options.
+ *
+ * Same as spdk_nvme_ns_cmd_kvstorev(), except that the I/O flags come from opts,
+ * and opts may describe the payload with a memory domain, which the controller
+ * must support, refer to spdk_nvme_ctrlr_get_memory_domains(). KV commands carry
+ * no metadata, so opts->metadata must be NULL. opts must remain valid until
+ * cb_fn is called.
+ *
+ * \param ns NVMe namespace to submit the write I/O.
+ * \param qpair I/O queue pair to submit the request.
+ * \param key Key to associate with data
+ * \param key_len Length of key
+ * \param payload_size Size of data payload
+ * \param cb_fn Callback function to invoke when the I/O is completed.
+ * \param cb_arg Argument to pass to the callback function.
+ * \param store_flags Option flags for KV store operation
+ * \param reset_sgl_fn Callback function to reset scattered payload.
+ * \param next_sge_fn Callback function to iterate each scattered payload memory segment.
+ * \param opts Optional structure with extended IO request options, may be NULL.
+ *
+ * \return 0 if successfully submitted, negated errnos on the following error conditions:
+ * -EINVAL: The request is malformed.
+ * -ENOMEM: The request cannot be allocated.
+ * -ENXIO: The qpair is failed at the transport level.
+ */
+int spdk_nvme_ns_cmd_kvstorev_ext(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *qpair,
+				  unsigned char *key, size_t key_len,
+				  uint64_t payload_size,
+				  spdk_nvme_cmd_cb cb_fn, void *cb_arg,
+				  uint8_t store_flags,
+				  spdk_nvme_req_reset_sgl_cb reset_sgl_fn,
+				  spdk_nvme_req_next_sge_cb next_sge_fn,
+				  struct spdk_nvme_ns_cmd_ext_io_opts *opts);
+
 /**
  * Retrieves the data blob associated with the given key.
  *
@@ -181,6 +236,11 @@ int spdk_nvme_ns_cmd_kvstorev(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *q
  * The user must ensure that only one thread submits I/O on a given qpair at any
  * given time.
  *
+ * Buffers larger than the controller's maximum transfer size are filled by
+ * retrieves at advancing offsets which are all submitted together. The
+ * completion reports the total value length in cdw0 as for a single retrieve.
+ * offset + buffer_size must not exceed 4 GiB.
+ *
  * \param ns NVMe namespace to submit the write I/O.
  * \param qpair I/O queue pair to submit the request.
  * \param key Key to associate with data
@@ -189,6 +249,7 @@ int spdk_nvme_ns_cmd_kvstorev(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *q
  * \param buffer_size Size of data buffer
  * \param cb_fn Callback function to invoke when the I/O is completed.
  * \param cb_arg Argument to pass to the callback function.
+ * \param offset Offset (in bytes) into the value to start retrieving from
  * \param io_flags Set flags, defined by the SPDK_NVME_IO_FLAGS_* entries in
  * spdk/nvme_spec.h, for this I/O.
  *
@@ -211,6 +272,19 @@ int spdk_nvme_ns_cmd_kvretrievev(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair
 				spdk_nvme_req_reset_sgl_cb reset_sgl_fn,
 				spdk_nvme_req_next_sge_cb next_sge_fn);
 
+/**
+ * Same as spdk_nvme_ns_cmd_kvretrievev(), with extended options. See
+ * spdk_nvme_ns_cmd_kvstorev_ext().
+ */
+int spdk_nvme_ns_cmd_kvretrievev_ext(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *qpair,
+				     unsigned char *key, size_t key_len,
+				     uint64_t buffer_size,
+				     spdk_nvme_cmd_cb cb_fn, void *cb_arg,
+				     uint64_t offset,
+				     spdk_nvme_req_reset_sgl_cb reset_sgl_fn,
+				     spdk_nvme_req_next_sge_cb next_sge_fn,
+				     struct spdk_nvme_ns_cmd_ext_io_opts *opts);
+
 
 /*
  * KV_SEND_SELECT Format Types
@@ -262,6 +336,18 @@ int spdk_nvme_ns_cmd_kvselect_sendv(struct spdk_nvme_ns *ns, struct spdk_nvme_qp
 				   uint32_t io_flags, spdk_nvme_req_reset_sgl_cb reset_sgl_fn,
 				   spdk_nvme_req_next_sge_cb next_sge_fn);
 
+/**
+ * Same as spdk_nvme_ns_cmd_kvselect_sendv(), with extended options. See
+ * spdk_nvme_ns_cmd_kvstorev_ext().
+ */
+int spdk_nvme_ns_cmd_kvselect_sendv_ext(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *qpair,
+					unsigned char *key, size_t key_len, uint64_t query_len,
+					spdk_nvme_kv_datatype input_type, spdk_nvme_kv_datatype output_type,
+					uint8_t header_opts, spdk_nvme_cmd_cb cb_fn, void *cb_arg,
+					spdk_nvme_req_reset_sgl_cb reset_sgl_fn,
+					spdk_nvme_req_next_sge_cb next_sge_fn,
+					struct spdk_nvme_ns_cmd_ext_io_opts *opts);
+
 /* Options on retrieving selection */
 typedef enum {
 	SPDK_NVME_KV_SELECT_FREE_ALL 	= 0,
@@ -304,6 +390,18 @@ int spdk_nvme_ns_cmd_kvselect_retrievev(struct spdk_nvme_ns *ns, struct spdk_nvm
 				       uint32_t io_flags, spdk_nvme_req_reset_sgl_cb reset_sgl_fn,
 				       spdk_nvme_req_next_sge_cb next_sge_fn);
 
+/**
+ * Same as spdk_nvme_ns_cmd_kvselect_retrievev(), with extended options. See
+ * spdk_nvme_ns_cmd_kvstorev_ext().
+ */
+int spdk_nvme_ns_cmd_kvselect_retrievev_ext(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *qpair,
+		uint32_t select_id, uint32_t offset,
+		uint32_t buffer_size, spdk_nvme_kv_select_opts select_opts,
+		spdk_nvme_cmd_cb cb_fn, void *cb_arg,
+		spdk_nvme_req_reset_sgl_cb reset_sgl_fn,
+		spdk_nvme_req_next_sge_cb next_sge_fn,
+		struct spdk_nvme_ns_cmd_ext_io_opts *opts);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,113 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+/** \file
+ * Host-side SELECT for KV bdev modules
+ */
+
+#ifndef SPDK_KV_SELECT_H
+#define SPDK_KV_SELECT_H
+
+#include "spdk/stdinc.h"
+
+#include "spdk/queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Evaluate a SELECT query on the host, for KV modules that store values in a
+ * form the device cannot query.
+ *
+ * \param value Value to query. value[value_len] must be writable.
+ * \param value_len Length of the value.
+ * \param query SELECT statement. Need not be NUL terminated.
+ * \param query_len Length of query.
+ * \param input_type NVME_KV_SELECT_TYPE_* format of the value.
+ * \param output_type NVME_KV_SELECT_TYPE_* format of the result.
+ * \param header_opts NVME_KV_SELECT_CMD_OUTPUT_TYPE_* header options.
+ * \param result On success, the result, to be released with free().
+ * \param result_len On success, the length of the result.
+ *
+ * \return 0 on success, -ENOMEM if memory ran out, -ENOTSUP for an unsupported
+ * format or another negated errno if the query or the value cannot be parsed.
+ */
+int spdk_kv_select_eval(char *value, size_t value_len, const char *query, size_t query_len,
+			uint8_t input_type, uint8_t output_type, uint8_t header_opts,
+			char **result, size_t *result_len);
+
+struct spdk_kv_select_result;
+
+/**
+ * SELECT results evaluated on the host, kept until they are retrieved by id as
+ * the device keeps its own. Not thread safe; the module serializes access.
+ */
+struct spdk_kv_select_results {
+	TAILQ_HEAD(, spdk_kv_select_result)	results;
+	uint32_t				num_results;
+	uint32_t				max_results;
+	uint32_t				id_flag;
+	uint32_t				next_id;
+};
+
+/**
+ * Initialize a table of host SELECT results.
+ *
+ * \param results Table to initialize.
+ * \param max_results Number of results kept. Adding one more evicts the oldest.
+ * \param id_flag 0, or a single bit set in every id of this table so they can be
+ * told apart from the ids of the device. Ids are otherwise kept below this bit.
+ */
+void spdk_kv_select_results_init(struct spdk_kv_select_results *results, uint32_t max_results,
+				 uint32_t id_flag);
+
+/**
+ * Free all results of a table.
+ *
+ * \param results Table to empty.
+ */
+void spdk_kv_select_results_fini(struct spdk_kv_select_results *results);
+
+/**
+ * Add a result to a table.
+ *
+ * \param results Table to add to.
+ * \param buf Result, as returned by spdk_kv_select_eval(). The table takes
+ * ownership of it, also on failure.
+ * \param len Length of the result.
+ * \param id On success, the non-zero id of the result.
+ *
+ * \return 0 on success, -ENOMEM if memory ran out.
+ */
+int spdk_kv_select_results_add(struct spdk_kv_select_results *results, char *buf, size_t len,
+			       uint32_t *id);
+
+/**
+ * Copy part of a result out of a table, with the semantics of a retrieve select
+ * command: the result is freed when options is 0, or when it includes
+ * NVME_KV_SELECT_CMD_OPTION_DO_NOT_FREE_IF_NOT_ALL_DATA_FETCHED and the read
+ * reaches the end of the result.
+ *
+ * \param results Table to read from.
+ * \param id Id of the result.
+ * \param offset Offset into the result.
+ * \param options NVME_KV_SELECT_CMD_OPTION_* flags.
+ * \param iovs Buffer to copy to.
+ * \param iovcnt Number of elements in iovs.
+ * \param len Number of bytes to copy at most.
+ * \param result_len On success, the total length of the result.
+ *
+ * \return 0 on success, -ENOENT if there is no result with this id, -EINVAL if
+ * offset is past its end.
+ */
+int spdk_kv_select_results_read(struct spdk_kv_select_results *results, uint32_t id,
+				uint64_t offset, uint8_t options, struct iovec *iovs, int iovcnt,
+				uint64_t len, uint32_t *result_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SPDK_KV_SELECT_H */
@@ -62,13 +62,19 @@ int __itt_init_ittlib(const char *, __itt_group_id);
  */
 #define SPDK_BDEV_MAX_CHILDREN_COPY_REQS (8)
 
+/* Size of the first read of a KV RETRIEVE submitted without a buffer and without
+ * a size hint.
+ */
+#define SPDK_BDEV_KV_RETRIEVE_DEFAULT_SIZE (4 * 1024)
+
 SPDK_LOG_DEPRECATION_REGISTER(bdev_register_examine_thread,
 			      "bdev register and examine on non-app thread", "SPDK 23.05", 0);
 
 SPDK_LOG_DEPRECATION_REGISTER(vtune_support, "Intel(R) VTune integration", "SPDK 23.05", 0);
 
 static const char *qos_rpc_type[] = {"rw_ios_per_sec",
-				     "rw_mbytes_per_sec", "r_mbytes_per_sec", "w_mbytes_per_sec"
+				     "rw_mbytes_per_sec", "r_mbytes_per_sec", "w_mbytes_per_sec",
+				     "kv_ops_per_sec", "kv_mbytes_per_sec", "kv_max_selects"
 				    };
 
 TAILQ_HEAD(spdk_bdev_list, spdk_bdev);
@@ -814,6 +820,35 @@ bdev_io_use_memory_domain(struct spdk_bdev_io *bdev_io)
 	return bdev_io->internal.ext_opts && bdev_io->internal.ext_opts->memory_domain;
 }
 
+/* I/O types whose data buffers are written to the bdev */
+static inline bool
+bdev_io_is_data_out(struct spdk_bdev_io *bdev_io)
+{
+	switch (bdev_io->type) {
+	case SPDK_BDEV_IO_TYPE_WRITE:
+	case SPDK_BDEV_IO_KV_STORE:
+	case SPDK_BDEV_IO_KV_SEND_SELECT:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/* I/O types whose data buffers are filled by the bdev */
+static inline bool
+bdev_io_is_data_in(struct spdk_bdev_io *bdev_io)
+{
+	switch (bdev_io->type) {
+	case SPDK_BDEV_IO_TYPE_READ:
+	case SPDK_BDEV_IO_KV_LIST:
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+	case SPDK_BDEV_IO_KV_RETRIEVE_SELECT:
+		return true;
+	default:
+		return false;
+	}
+}
+
 void
 spdk_bdev_io_set_buf(struct spdk_bdev_io *bdev_io, void *buf, size_t len)
 {
@@ -992,7 +1027,7 @@ _bdev_io_pull_bounce_data_buf(struct spdk_bdev_io *bdev_io, void *buf, size_t le
 	bdev_io->u.bdev.iovs[0].iov_base = buf;
 	bdev_io->u.bdev.iovs[0].iov_len = len;
 	/* if this is write path, copy data from original buffer to bounce buffer */
-	if (bdev_io->type == SPDK_BDEV_IO_TYPE_WRITE) {
+	if (bdev_io_is_data_out(bdev_io)) {
 		if (bdev_io_use_memory_domain(bdev_io)) {
 			rc = spdk_memory_domain_pull_data(bdev_io->internal.ext_opts->memory_domain,
 							  bdev_io->internal.ext_opts->memory_domain_ctx,
@@ -1246,7 +1281,7 @@ _bdev_io_push_bounce_data_buffer(struct spdk_bdev_io *bdev_io, bdev_copy_bounce_
 	bdev_io->internal.data_transfer_cpl = cpl_cb;
 
 	/* if this is read path, copy data from bounce buffer to original buffer */
-	if (bdev_io->type == SPDK_BDEV_IO_TYPE_READ &&
+	if (bdev_io_is_data_in(bdev_io) &&
 	    bdev_io->internal.status == SPDK_BDEV_IO_STATUS_SUCCESS) {
 		if (bdev_io_use_memory_domain(bdev_io)) {
 			/* If memory domain is used then we need to call async push function */
@@ -1952,6 +1987,12 @@ bdev_channel_get_io(struct spdk_bdev_channel *channel)
 	return bdev_io;
 }
 
+struct spdk_iobuf_channel *
+bdev_channel_get_iobuf(struct spdk_bdev_channel *channel)
+{
+	return &channel->shared_resource->mgmt_ch->iobuf;
+}
+
 void
 spdk_bdev_free_io(struct spdk_bdev_io *bdev_io)
 {
@@ -1990,10 +2031,13 @@ bdev_qos_is_iops_rate_limit(enum spdk_bdev_qos_rate_limit_type limit)
 
 	switch (limit) {
 	case SPDK_BDEV_QOS_RW_IOPS_RATE_LIMIT:
+	case SPDK_BDEV_QOS_KV_OPS_RATE_LIMIT:
 		return true;
 	case SPDK_BDEV_QOS_RW_BPS_RATE_LIMIT:
 	case SPDK_BDEV_QOS_R_BPS_RATE_LIMIT:
 	case SPDK_BDEV_QOS_W_BPS_RATE_LIMIT:
+	case SPDK_BDEV_QOS_KV_BPS_RATE_LIMIT:
+	case SPDK_BDEV_QOS_KV_SELECTS_LIMIT:
 		return false;
 	case SPDK_BDEV_QOS_NUM_RATE_LIMIT_TYPES:
 	default:
@@ -2001,6 +2045,13 @@ bdev_qos_is_iops_rate_limit(enum spdk_bdev_qos_rate_limit_type limit)
 	}
 }
 
+/* The SELECT limit caps the number of commands in flight and is not refilled each timeslice. */
+static bool
+bdev_qos_is_concurrency_limit(enum spdk_bdev_qos_rate_limit_type limit)
+{
+	return limit == SPDK_BDEV_QOS_KV_SELECTS_LIMIT;
+}
+
 static bool
 bdev_qos_io_to_limit(struct spdk_bdev_io *bdev_io)
 {
@@ -2016,6 +2067,15 @@ bdev_qos_io_to_limit(struct spdk_bdev_io *bdev_io)
 		} else {
 			return false;
 		}
+	case SPDK_BDEV_IO_KV_LIST:
+	case SPDK_BDEV_IO_KV_DELETE:
+	case SPDK_BDEV_IO_KV_EXIST:
+	case SPDK_BDEV_IO_KV_STORE:
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+	case SPDK_BDEV_IO_KV_SEND_SELECT:
+	case SPDK_BDEV_IO_KV_RETRIEVE_SELECT:
+	case SPDK_BDEV_IO_KV_BATCH:
+		return true;
 	default:
 		return false;
 	}
@@ -2071,9 +2131,40 @@ bdev_get_io_size_in_byte(struct spdk_bdev_io *bdev_io)
 	}
 }
 
+static uint64_t
+bdev_get_kv_io_size_in_byte(struct spdk_bdev_io *bdev_io)
+{
+	uint64_t nbytes = 0;
+	uint32_t i;
+
+	switch (bdev_io->type) {
+	case SPDK_BDEV_IO_KV_LIST:
+	case SPDK_BDEV_IO_KV_STORE:
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+	case SPDK_BDEV_IO_KV_SEND_SELECT:
+	case SPDK_BDEV_IO_KV_RETRIEVE_SELECT:
+		return bdev_io->u.bdev.nvme_kv.buffer_size;
+	case SPDK_BDEV_IO_KV_BATCH:
+		if (bdev_io->u.bdev.nvme_kv.batch_type == SPDK_BDEV_IO_KV_EXIST) {
+			return 0;
+		}
+		for (i = 0; i < bdev_io->u.bdev.nvme_kv.batch_count; i++) {
+			nbytes += bdev_io->u.bdev.nvme_kv.batch[i].nbytes;
+		}
+		return nbytes;
+	default:
+		return 0;
+	}
+}
+
 static bool
 bdev_qos_rw_queue_io(const struct spdk_bdev_qos_limit *limit, struct spdk_bdev_io *io)
 {
+	/* KV commands are only held back by the KV limits. */
+	if (spdk_bdev_io_type_is_kv(io->type)) {
+		return false;
+	}
+
 	if (limit->max_per_timeslice > 0 && limit->remaining_this_timeslice <= 0) {
 		return true;
 	} else {
@@ -2101,12 +2192,69 @@ bdev_qos_w_queue_io(const struct spdk_bdev_qos_limit *limit, struct spdk_bdev_io
 	return bdev_qos_rw_queue_io(limit, io);
 }
 
+static bool
+bdev_qos_kv_queue_io(const struct spdk_bdev_qos_limit *limit, struct spdk_bdev_io *io)
+{
+	if (!spdk_bdev_io_type_is_kv(io->type)) {
+		return false;
+	}
+
+	if (limit->max_per_timeslice > 0 && limit->remaining_this_timeslice <= 0) {
+		return true;
+	} else {
+		return false;
+	}
+}
+
+static bool
+bdev_qos_kv_select_queue_io(const struct spdk_bdev_qos_limit *limit, struct spdk_bdev_io *io)
+{
+	if (io->type != SPDK_BDEV_IO_KV_SEND_SELECT) {
+		return false;
+	}
+
+	return __atomic_load_n(&io->bdev->internal.qos_kv_selects_outstanding,
+			       __ATOMIC_RELAXED) >= limit->limit;
+}
+
 static void
 bdev_qos_rw_iops_update_quota(struct spdk_bdev_qos_limit *limit, struct spdk_bdev_io *io)
 {
+	if (spdk_bdev_io_type_is_kv(io->type)) {
+		return;
+	}
+
 	limit->remaining_this_timeslice--;
 }
 
+static void
+bdev_qos_kv_ops_update_quota(struct spdk_bdev_qos_limit *limit, struct spdk_bdev_io *io)
+{
+	if (io->type == SPDK_BDEV_IO_KV_BATCH) {
+		limit->remaining_this_timeslice -= io->u.bdev.nvme_kv.batch_count;
+	} else if (spdk_bdev_io_type_is_kv(io->type)) {
+		limit->remaining_this_timeslice--;
+	}
+}
+
+static void
+bdev_qos_kv_bps_update_quota(struct spdk_bdev_qos_limit *limit, struct spdk_bdev_io *io)
+{
+	limit->remaining_this_timeslice -= bdev_get_kv_io_size_in_byte(io);
+}
+
+static void
+bdev_qos_kv_select_update_quota(struct spdk_bdev_qos_limit *limit, struct spdk_bdev_io *io)
+{
+	if (io->type != SPDK_BDEV_IO_KV_SEND_SELECT) {
+		return;
+	}
+
+	/* Released in bdev_io_complete(), which runs on the submitting thread. */
+	__atomic_fetch_add(&io->bdev->internal.qos_kv_selects_outstanding, 1, __ATOMIC_RELAXED);
+	io->internal.qos_kv_select = true;
+}
+
 static void
 bdev_qos_rw_bps_update_quota(struct spdk_bdev_qos_limit *limit, struct spdk_bdev_io *io)
 {
@@ -2133,6 +2281,14 @@ bdev_qos_w_bps_update_quota(struct spdk_bdev_qos_limit *limit, struct spdk_bdev_
 	return bdev_qos_rw_bps_update_quota(limit, io);
 }
 
+static void
+bdev_qos_kv_select_done(struct spdk_bdev_io *bdev_io)
+{
+	/* SELECTs held back by the limit are let through on the next QoS timeslice. */
+	__atomic_fetch_sub(&bdev_io->bdev->internal.qos_kv_selects_outstanding, 1, __ATOMIC_RELAXED);
+	bdev_io->internal.qos_kv_select = false;
+}
+
 static void
 bdev_qos_set_ops(struct spdk_bdev_qos *qos)
 {
@@ -2162,6 +2318,18 @@ bdev_qos_set_ops(struct spdk_bdev_qos *qos)
 			qos->rate_limits[i].queue_io = bdev_qos_w_queue_io;
 			qos->rate_limits[i].update_quota = bdev_qos_w_bps_update_quota;
 			break;
+		case SPDK_BDEV_QOS_KV_OPS_RATE_LIMIT:
+			qos->rate_limits[i].queue_io = bdev_qos_kv_queue_io;
+			qos->rate_limits[i].update_quota = bdev_qos_kv_ops_update_quota;
+			break;
+		case SPDK_BDEV_QOS_KV_BPS_RATE_LIMIT:
+			qos->rate_limits[i].queue_io = bdev_qos_kv_queue_io;
+			qos->rate_limits[i].update_quota = bdev_qos_kv_bps_update_quota;
+			break;
+		case SPDK_BDEV_QOS_KV_SELECTS_LIMIT:
+			qos->rate_limits[i].queue_io = bdev_qos_kv_select_queue_io;
+			qos->rate_limits[i].update_quota = bdev_qos_kv_select_update_quota;
+			break;
 		default:
 			break;
 		}
@@ -2412,6 +2580,9 @@ bdev_io_should_split(struct spdk_bdev_io *bdev_io)
 		return bdev_write_zeroes_should_split(bdev_io);
 	case SPDK_BDEV_IO_TYPE_COPY:
 		return bdev_copy_should_split(bdev_io);
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+		/* The bdev layer sizes and allocates the buffer of a RETRIEVE that has none. */
+		return bdev_io->u.bdev.iovs[0].iov_base == NULL;
 	default:
 		return false;
 	}
@@ -2828,6 +2999,8 @@ bdev_io_split_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
 static void bdev_rw_split_get_buf_cb(struct spdk_io_channel *ch, struct spdk_bdev_io *bdev_io,
 				     bool success);
 
+static void bdev_kv_retrieve_split(struct spdk_bdev_io *bdev_io);
+
 static void
 bdev_io_split(struct spdk_io_channel *ch, struct spdk_bdev_io *bdev_io)
 {
@@ -2856,6 +3029,9 @@ bdev_io_split(struct spdk_io_channel *ch, struct spdk_bdev_io *bdev_io)
 	case SPDK_BDEV_IO_TYPE_COPY:
 		bdev_copy_split(bdev_io);
 		break;
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+		bdev_kv_retrieve_split(bdev_io);
+		break;
 	default:
 		assert(false);
 		break;
@@ -2873,6 +3049,113 @@ bdev_rw_split_get_buf_cb(struct spdk_io_channel *ch, struct spdk_bdev_io *bdev_i
 	_bdev_rw_split(bdev_io);
 }
 
+/*
+ * A KV RETRIEVE without a buffer is served by a child RETRIEVE into a buffer from
+ * the iobuf pool. The first child reads as much as the caller's size hint. Its
+ * completion reports the length of the value, so a value that did not fit is read
+ * again, whole, into a buffer of that size. Reading it again rather than only the
+ * missing tail keeps the data from a single command, so a concurrent STORE cannot
+ * tear it. The buffer stays attached to the parent and is released by
+ * spdk_bdev_free_io().
+ */
+static uint64_t
+bdev_kv_retrieve_max_buf_len(struct spdk_bdev_io *bdev_io)
+{
+	struct spdk_bdev_mgmt_channel *mgmt_ch = bdev_io->internal.ch->shared_resource->mgmt_ch;
+
+	return mgmt_ch->iobuf.large.bufsize - (spdk_bdev_get_buf_align(bdev_io->bdev) - 1);
+}
+
+static void
+bdev_kv_retrieve_split_complete(struct spdk_bdev_io *bdev_io)
+{
+	spdk_trace_record(TRACE_BDEV_IO_DONE, 0, 0, (uintptr_t)bdev_io, bdev_io->internal.caller_ctx);
+	TAILQ_REMOVE(&bdev_io->internal.ch->io_submitted, bdev_io, internal.ch_link);
+	parent_bdev_io_complete(bdev_io, 0);
+}
+
+static void bdev_kv_retrieve_split_get_buf_cb(struct spdk_io_channel *ch,
+		struct spdk_bdev_io *bdev_io, bool success);
+
+static void
+bdev_kv_retrieve_split_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct spdk_bdev_io *parent_io = cb_arg;
+	uint64_t offset = parent_io->u.bdev.nvme_kv.offset;
+	uint64_t value_len;
+
+	/* The parent completes with the status and value length of its last child. */
+	parent_io->internal.status = bdev_io->internal.status;
+	parent_io->internal.error = bdev_io->internal.error;
+	spdk_bdev_free_io(bdev_io);
+
+	value_len = parent_io->internal.error.nvme.cdw0;
+	if (success && value_len > offset + parent_io->u.bdev.nvme_kv.buffer_size &&
+	    parent_io->u.bdev.nvme_kv.buffer_size < bdev_kv_retrieve_max_buf_len(parent_io)) {
+		bdev_io_put_buf(parent_io);
+		parent_io->u.bdev.iovs[0].iov_base = NULL;
+		parent_io->u.bdev.nvme_kv.buffer_size = spdk_min(value_len - offset,
+							bdev_kv_retrieve_max_buf_len(parent_io));
+		spdk_bdev_io_get_buf(parent_io, bdev_kv_retrieve_split_get_buf_cb,
+				     parent_io->u.bdev.nvme_kv.buffer_size);
+		return;
+	}
+
+	bdev_kv_retrieve_split_complete(parent_io);
+}
+
+static void
+bdev_kv_retrieve_split_submit(void *_bdev_io)
+{
+	struct spdk_bdev_io *bdev_io = _bdev_io;
+	int rc;
+
+	rc = spdk_bdev_kv_retrievev(bdev_io->internal.desc,
+				    spdk_io_channel_from_ctx(bdev_io->internal.ch),
+				    bdev_io->u.bdev.nvme_kv.key, bdev_io->u.bdev.nvme_kv.key_length,
+				    bdev_io->u.bdev.iovs, 1, bdev_io->u.bdev.nvme_kv.offset,
+				    bdev_io->u.bdev.nvme_kv.buffer_size,
+				    bdev_kv_retrieve_split_done, bdev_io);
+	if (spdk_unlikely(rc != 0)) {
+		if (rc == -ENOMEM) {
+			bdev_queue_io_wait_with_cb(bdev_io, bdev_kv_retrieve_split_submit);
+			return;
+		}
+		SPDK_ERRLOG("KV retrieve child submission failed, rc=%d\n", rc);
+		bdev_io->internal.status = SPDK_BDEV_IO_STATUS_FAILED;
+		bdev_kv_retrieve_split_complete(bdev_io);
+	}
+}
+
+static void
+bdev_kv_retrieve_split_get_buf_cb(struct spdk_io_channel *ch, struct spdk_bdev_io *bdev_io,
+				  bool success)
+{
+	if (!success) {
+		bdev_io->internal.status = SPDK_BDEV_IO_STATUS_FAILED;
+		bdev_kv_retrieve_split_complete(bdev_io);
+		return;
+	}
+
+	bdev_kv_retrieve_split_submit(bdev_io);
+}
+
+static void
+bdev_kv_retrieve_split(struct spdk_bdev_io *bdev_io)
+{
+	uint64_t len = bdev_io->u.bdev.nvme_kv.buffer_size;
+
+	if (len == 0) {
+		len = SPDK_BDEV_KV_RETRIEVE_DEFAULT_SIZE;
+	}
+	bdev_io->u.bdev.nvme_kv.buffer_size = spdk_min(len, bdev_kv_retrieve_max_buf_len(bdev_io));
+	/* No metadata goes with a KV buffer. */
+	bdev_io->u.bdev.num_blocks = 0;
+
+	spdk_bdev_io_get_buf(bdev_io, bdev_kv_retrieve_split_get_buf_cb,
+			     bdev_io->u.bdev.nvme_kv.buffer_size);
+}
+
 /* Explicitly mark this inline, since it's used as a function pointer and otherwise won't
  *  be inlined, at least on some compilers.
  */
@@ -3025,6 +3308,8 @@ _bdev_io_copy_ext_opts(struct spdk_bdev_io *bdev_io, struct spdk_bdev_ext_io_opt
 static inline void
 _bdev_io_ext_use_bounce_buffer(struct spdk_bdev_io *bdev_io)
 {
+	uint64_t len;
+
 	/* bdev doesn't support memory domains, thereby buffers in this IO request can't
 	 * be accessed directly. It is needed to allocate buffers before issuing IO operation.
 	 * For write operation we need to pull buffers from memory domain before submitting IO.
@@ -3034,8 +3319,21 @@ _bdev_io_ext_use_bounce_buffer(struct spdk_bdev_io *bdev_io)
 	 * the copied ext_opts */
 	bdev_io->internal.ext_opts_copy.memory_domain = NULL;
 	bdev_io->internal.ext_opts_copy.memory_domain_ctx = NULL;
-	_bdev_memory_domain_io_get_buf(bdev_io, _bdev_memory_domain_get_io_cb,
-				       bdev_io->u.bdev.num_blocks * bdev_io->bdev->blocklen);
+
+	switch (bdev_io->type) {
+	case SPDK_BDEV_IO_KV_LIST:
+	case SPDK_BDEV_IO_KV_STORE:
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+	case SPDK_BDEV_IO_KV_SEND_SELECT:
+	case SPDK_BDEV_IO_KV_RETRIEVE_SELECT:
+		len = bdev_io->u.bdev.nvme_kv.buffer_size;
+		break;
+	default:
+		len = bdev_io->u.bdev.num_blocks * bdev_io->bdev->blocklen;
+		break;
+	}
+
+	_bdev_memory_domain_io_get_buf(bdev_io, _bdev_memory_domain_get_io_cb, len);
 }
 
 static inline void
@@ -3060,6 +3358,13 @@ _bdev_io_submit_ext(struct spdk_bdev_desc *desc, struct spdk_bdev_io *bdev_io,
 	bdev_io_submit(bdev_io);
 }
 
+void
+bdev_io_submit_ext(struct spdk_bdev_desc *desc, struct spdk_bdev_io *bdev_io,
+		   struct spdk_bdev_ext_io_opts *opts)
+{
+	_bdev_io_submit_ext(desc, bdev_io, opts, false);
+}
+
 static void
 bdev_io_submit_reset(struct spdk_bdev_io *bdev_io)
 {
@@ -3084,6 +3389,7 @@ bdev_io_init(struct spdk_bdev_io *bdev_io,
 	bdev_io->internal.cb = cb;
 	bdev_io->internal.status = SPDK_BDEV_IO_STATUS_PENDING;
 	bdev_io->internal.in_submit_request = false;
+	bdev_io->internal.qos_kv_select = false;
 	bdev_io->internal.buf = NULL;
 	bdev_io->internal.io_submit_ch = NULL;
 	bdev_io->internal.orig_iovs = NULL;
@@ -3147,7 +3453,8 @@ bdev_qos_update_max_quota_per_timeslice(struct spdk_bdev_qos *qos)
 	int i;
 
 	for (i = 0; i < SPDK_BDEV_QOS_NUM_RATE_LIMIT_TYPES; i++) {
-		if (qos->rate_limits[i].limit == SPDK_BDEV_QOS_LIMIT_NOT_DEFINED) {
+		if (qos->rate_limits[i].limit == SPDK_BDEV_QOS_LIMIT_NOT_DEFINED ||
+		    bdev_qos_is_concurrency_limit(i)) {
 			qos->rate_limits[i].max_per_timeslice = 0;
 			continue;
 		}
@@ -3722,6 +4029,8 @@ bdev_qos_destroy(struct spdk_bdev *bdev)
 void
 spdk_bdev_add_io_stat(struct spdk_bdev_io_stat *total, struct spdk_bdev_io_stat *add)
 {
+	int i;
+
 	total->bytes_read += add->bytes_read;
 	total->num_read_ops += add->num_read_ops;
 	total->bytes_written += add->bytes_written;
@@ -3758,12 +4067,27 @@ spdk_bdev_add_io_stat(struct spdk_bdev_io_stat *total, struct spdk_bdev_io_stat
 	if (total->min_copy_latency_ticks > add->min_copy_latency_ticks) {
 		total->min_copy_latency_ticks = add->min_copy_latency_ticks;
 	}
+	total->bytes_kv_stored += add->bytes_kv_stored;
+	total->bytes_kv_retrieved += add->bytes_kv_retrieved;
+	total->bytes_select_returned += add->bytes_select_returned;
+	for (i = 0; i < SPDK_BDEV_KV_STAT_NUM_OPS; i++) {
+		total->kv_ops[i].num_ops += add->kv_ops[i].num_ops;
+		total->kv_ops[i].latency_ticks += add->kv_ops[i].latency_ticks;
+		if (total->kv_ops[i].max_latency_ticks < add->kv_ops[i].max_latency_ticks) {
+			total->kv_ops[i].max_latency_ticks = add->kv_ops[i].max_latency_ticks;
+		}
+		if (total->kv_ops[i].min_latency_ticks > add->kv_ops[i].min_latency_ticks) {
+			total->kv_ops[i].min_latency_ticks = add->kv_ops[i].min_latency_ticks;
+		}
+	}
 }
 
 static void
 bdev_get_io_stat(struct spdk_bdev_io_stat *to_stat, struct spdk_bdev_io_stat *from_stat)
 {
 	memcpy(to_stat, from_stat, offsetof(struct spdk_bdev_io_stat, io_error));
+	memcpy(&to_stat->bytes_kv_stored, &from_stat->bytes_kv_stored,
+	       sizeof(*to_stat) - offsetof(struct spdk_bdev_io_stat, bytes_kv_stored));
 
 	if (to_stat->io_error != NULL && from_stat->io_error != NULL) {
 		memcpy(to_stat->io_error, from_stat->io_error,
@@ -3774,6 +4098,8 @@ bdev_get_io_stat(struct spdk_bdev_io_stat *to_stat, struct spdk_bdev_io_stat *fr
 void
 spdk_bdev_reset_io_stat(struct spdk_bdev_io_stat *stat, enum spdk_bdev_reset_stat_mode mode)
 {
+	int i;
+
 	stat->max_read_latency_ticks = 0;
 	stat->min_read_latency_ticks = UINT64_MAX;
 	stat->max_write_latency_ticks = 0;
@@ -3782,6 +4108,10 @@ spdk_bdev_reset_io_stat(struct spdk_bdev_io_stat *stat, enum spdk_bdev_reset_sta
 	stat->min_unmap_latency_ticks = UINT64_MAX;
 	stat->max_copy_latency_ticks = 0;
 	stat->min_copy_latency_ticks = UINT64_MAX;
+	for (i = 0; i < SPDK_BDEV_KV_STAT_NUM_OPS; i++) {
+		stat->kv_ops[i].max_latency_ticks = 0;
+		stat->kv_ops[i].min_latency_ticks = UINT64_MAX;
+	}
 
 	if (mode != SPDK_BDEV_RESET_STAT_ALL) {
 		return;
@@ -3799,6 +4129,13 @@ spdk_bdev_reset_io_stat(struct spdk_bdev_io_stat *stat, enum spdk_bdev_reset_sta
 	stat->write_latency_ticks = 0;
 	stat->unmap_latency_ticks = 0;
 	stat->copy_latency_ticks = 0;
+	stat->bytes_kv_stored = 0;
+	stat->bytes_kv_retrieved = 0;
+	stat->bytes_select_returned = 0;
+	for (i = 0; i < SPDK_BDEV_KV_STAT_NUM_OPS; i++) {
+		stat->kv_ops[i].num_ops = 0;
+		stat->kv_ops[i].latency_ticks = 0;
+	}
 
 	if (stat->io_error != NULL) {
 		memset(stat->io_error, 0, sizeof(struct spdk_bdev_io_error_stat));
@@ -3839,6 +4176,49 @@ bdev_free_io_stat(struct spdk_bdev_io_stat *stat)
 	}
 }
 
+static const char *g_bdev_kv_stat_op_names[SPDK_BDEV_KV_STAT_NUM_OPS] = {
+	[SPDK_BDEV_KV_STAT_STORE] = "store",
+	[SPDK_BDEV_KV_STAT_RETRIEVE] = "retrieve",
+	[SPDK_BDEV_KV_STAT_EXIST] = "exist",
+	[SPDK_BDEV_KV_STAT_DELETE] = "delete",
+	[SPDK_BDEV_KV_STAT_LIST] = "list",
+	[SPDK_BDEV_KV_STAT_SEND_SELECT] = "send_select",
+	[SPDK_BDEV_KV_STAT_RETRIEVE_SELECT] = "retrieve_select",
+};
+
+static void
+bdev_dump_kv_stat_json(struct spdk_bdev_io_stat *stat, struct spdk_json_write_ctx *w)
+{
+	struct spdk_bdev_kv_op_stat *op;
+	int i;
+
+	for (i = 0; i < SPDK_BDEV_KV_STAT_NUM_OPS; i++) {
+		if (stat->kv_ops[i].num_ops != 0) {
+			break;
+		}
+	}
+	/* Keep the output of block-only bdevs unchanged. */
+	if (i == SPDK_BDEV_KV_STAT_NUM_OPS) {
+		return;
+	}
+
+	spdk_json_write_named_object_begin(w, "kv");
+	spdk_json_write_named_uint64(w, "bytes_stored", stat->bytes_kv_stored);
+	spdk_json_write_named_uint64(w, "bytes_retrieved", stat->bytes_kv_retrieved);
+	spdk_json_write_named_uint64(w, "bytes_select_returned", stat->bytes_select_returned);
+	for (i = 0; i < SPDK_BDEV_KV_STAT_NUM_OPS; i++) {
+		op = &stat->kv_ops[i];
+		spdk_json_write_named_object_begin(w, g_bdev_kv_stat_op_names[i]);
+		spdk_json_write_named_uint64(w, "num_ops", op->num_ops);
+		spdk_json_write_named_uint64(w, "latency_ticks", op->latency_ticks);
+		spdk_json_write_named_uint64(w, "max_latency_ticks", op->max_latency_ticks);
+		spdk_json_write_named_uint64(w, "min_latency_ticks",
+					     op->min_latency_ticks != UINT64_MAX ? op->min_latency_ticks : 0);
+		spdk_json_write_object_end(w);
+	}
+	spdk_json_write_object_end(w);
+}
+
 void
 spdk_bdev_dump_io_stat_json(struct spdk_bdev_io_stat *stat, struct spdk_json_write_ctx *w)
 {
@@ -3873,6 +4253,8 @@ spdk_bdev_dump_io_stat_json(struct spdk_bdev_io_stat *stat, struct spdk_json_wri
 				     stat->min_copy_latency_ticks != UINT64_MAX ?
 				     stat->min_copy_latency_ticks : 0);
 
+	bdev_dump_kv_stat_json(stat, w);
+
 	if (stat->io_error != NULL) {
 		spdk_json_write_named_object_begin(w, "io_error");
 		for (i = 0; i < -SPDK_MIN_BDEV_IO_STATUS; i++) {
@@ -4119,7 +4501,8 @@ spdk_bdev_get_qos_rate_limits(struct spdk_bdev *bdev, uint64_t *limits)
 			if (bdev->internal.qos->rate_limits[i].limit !=
 			    SPDK_BDEV_QOS_LIMIT_NOT_DEFINED) {
 				limits[i] = bdev->internal.qos->rate_limits[i].limit;
-				if (bdev_qos_is_iops_rate_limit(i) == false) {
+				if (bdev_qos_is_iops_rate_limit(i) == false &&
+				    bdev_qos_is_concurrency_limit(i) == false) {
 					/* Change from Byte to Megabyte which is user visible. */
 					limits[i] = limits[i] / 1024 / 1024;
 				}
@@ -4782,6 +5165,12 @@ _bdev_io_check_opts(struct spdk_bdev_ext_io_opts *opts, struct iovec *iov)
 	       (!opts->memory_domain || (iov && iov[0].iov_base));
 }
 
+bool
+bdev_check_ext_io_opts(struct spdk_bdev_ext_io_opts *opts, struct iovec *iov)
+{
+	return _bdev_io_check_opts(opts, iov);
+}
+
 int
 spdk_bdev_readv_blocks_ext(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
 			   struct iovec *iov, int iovcnt,
@@ -6271,6 +6660,113 @@ spdk_bdev_queue_io_wait(struct spdk_bdev *bdev, struct spdk_io_channel *ch,
 	return 0;
 }
 
+static inline void
+bdev_kv_op_stat_update(struct spdk_bdev_kv_op_stat *op, uint64_t num_ops, uint64_t tsc_diff)
+{
+	op->num_ops += num_ops;
+	op->latency_ticks += tsc_diff;
+	if (op->max_latency_ticks < tsc_diff) {
+		op->max_latency_ticks = tsc_diff;
+	}
+	if (op->min_latency_ticks > tsc_diff) {
+		op->min_latency_ticks = tsc_diff;
+	}
+}
+
+/* Bytes transferred by a read-like KV command: at most the buffer, at most what is left past offset. */
+static inline uint64_t
+bdev_kv_bytes_returned(uint32_t total_len, uint64_t offset, uint64_t buf_len)
+{
+	return total_len > offset ? spdk_min(total_len - offset, buf_len) : 0;
+}
+
+static void
+bdev_io_update_kv_batch_stat(struct spdk_bdev_io *bdev_io, struct spdk_bdev_io_stat *io_stat,
+			     uint64_t tsc_diff)
+{
+	struct spdk_bdev_kv_batch_entry *entry;
+	enum spdk_bdev_kv_stat_op op;
+	uint64_t num_ops = 0;
+	uint32_t i;
+
+	switch (bdev_io->u.bdev.nvme_kv.batch_type) {
+	case SPDK_BDEV_IO_KV_STORE:
+		op = SPDK_BDEV_KV_STAT_STORE;
+		break;
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+		op = SPDK_BDEV_KV_STAT_RETRIEVE;
+		break;
+	case SPDK_BDEV_IO_KV_EXIST:
+		op = SPDK_BDEV_KV_STAT_EXIST;
+		break;
+	default:
+		return;
+	}
+
+	for (i = 0; i < bdev_io->u.bdev.nvme_kv.batch_count; i++) {
+		entry = &bdev_io->u.bdev.nvme_kv.batch[i];
+		if (entry->sct != SPDK_NVME_SCT_GENERIC || entry->sc != SPDK_NVME_SC_SUCCESS) {
+			continue;
+		}
+		num_ops++;
+		if (op == SPDK_BDEV_KV_STAT_STORE) {
+			io_stat->bytes_kv_stored += entry->nbytes;
+		} else if (op == SPDK_BDEV_KV_STAT_RETRIEVE) {
+			io_stat->bytes_kv_retrieved += bdev_kv_bytes_returned(entry->cdw0, entry->offset,
+						       entry->nbytes);
+		}
+	}
+
+	/* The whole batch shares one latency. */
+	if (num_ops != 0) {
+		bdev_kv_op_stat_update(&io_stat->kv_ops[op], num_ops, tsc_diff);
+	}
+}
+
+static void
+bdev_io_update_kv_stat(struct spdk_bdev_io *bdev_io, struct spdk_bdev_io_stat *io_stat,
+		       uint64_t tsc_diff)
+{
+	uint32_t cdw0 = bdev_io->internal.error.nvme.cdw0;
+	uint64_t buf_len = bdev_io->u.bdev.nvme_kv.buffer_size;
+	uint64_t offset = bdev_io->u.bdev.nvme_kv.offset;
+
+	switch (bdev_io->type) {
+	case SPDK_BDEV_IO_KV_STORE:
+		io_stat->bytes_kv_stored += buf_len;
+		bdev_kv_op_stat_update(&io_stat->kv_ops[SPDK_BDEV_KV_STAT_STORE], 1, tsc_diff);
+		break;
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+		/* cdw0 is the total length of the value. */
+		io_stat->bytes_kv_retrieved += bdev_kv_bytes_returned(cdw0, offset, buf_len);
+		bdev_kv_op_stat_update(&io_stat->kv_ops[SPDK_BDEV_KV_STAT_RETRIEVE], 1, tsc_diff);
+		break;
+	case SPDK_BDEV_IO_KV_EXIST:
+		bdev_kv_op_stat_update(&io_stat->kv_ops[SPDK_BDEV_KV_STAT_EXIST], 1, tsc_diff);
+		break;
+	case SPDK_BDEV_IO_KV_DELETE:
+		bdev_kv_op_stat_update(&io_stat->kv_ops[SPDK_BDEV_KV_STAT_DELETE], 1, tsc_diff);
+		break;
+	case SPDK_BDEV_IO_KV_LIST:
+		bdev_kv_op_stat_update(&io_stat->kv_ops[SPDK_BDEV_KV_STAT_LIST], 1, tsc_diff);
+		break;
+	case SPDK_BDEV_IO_KV_SEND_SELECT:
+		bdev_kv_op_stat_update(&io_stat->kv_ops[SPDK_BDEV_KV_STAT_SEND_SELECT], 1, tsc_diff);
+		break;
+	case SPDK_BDEV_IO_KV_RETRIEVE_SELECT:
+		/* cdw0 is the total length of the result. */
+		io_stat->bytes_select_returned += bdev_kv_bytes_returned(cdw0, offset, buf_len);
+		bdev_kv_op_stat_update(&io_stat->kv_ops[SPDK_BDEV_KV_STAT_RETRIEVE_SELECT], 1,
+				       tsc_diff);
+		break;
+	case SPDK_BDEV_IO_KV_BATCH:
+		bdev_io_update_kv_batch_stat(bdev_io, io_stat, tsc_diff);
+		break;
+	default:
+		break;
+	}
+}
+
 static inline void
 bdev_io_update_io_stat(struct spdk_bdev_io *bdev_io, uint64_t tsc_diff)
 {
@@ -6351,6 +6847,16 @@ bdev_io_update_io_stat(struct spdk_bdev_io *bdev_io, uint64_t tsc_diff)
 				io_stat->min_copy_latency_ticks = tsc_diff;
 			}
 			break;
+		case SPDK_BDEV_IO_KV_LIST:
+		case SPDK_BDEV_IO_KV_DELETE:
+		case SPDK_BDEV_IO_KV_EXIST:
+		case SPDK_BDEV_IO_KV_STORE:
+		case SPDK_BDEV_IO_KV_RETRIEVE:
+		case SPDK_BDEV_IO_KV_SEND_SELECT:
+		case SPDK_BDEV_IO_KV_RETRIEVE_SELECT:
+		case SPDK_BDEV_IO_KV_BATCH:
+			bdev_io_update_kv_stat(bdev_io, io_stat, tsc_diff);
+			break;
 		default:
 			break;
 		}
@@ -6409,6 +6915,10 @@ bdev_io_complete(void *ctx)
 
 	TAILQ_REMOVE(&bdev_ch->io_submitted, bdev_io, internal.ch_link);
 
+	if (spdk_unlikely(bdev_io->internal.qos_kv_select)) {
+		bdev_qos_kv_select_done(bdev_io);
+	}
+
 	if (bdev_io->internal.ch->histogram) {
 		spdk_histogram_data_tally(bdev_io->internal.ch->histogram, tsc_diff);
 	}
@@ -7739,6 +8249,11 @@ spdk_bdev_set_qos_rate_limits(struct spdk_bdev *bdev, uint64_t *limits,
 			disable_rate_limit = false;
 		}
 
+		if (bdev_qos_is_concurrency_limit(i) == true) {
+			/* A number of commands, taken as is. */
+			continue;
+		}
+
 		if (bdev_qos_is_iops_rate_limit(i) == true) {
 			min_limit_per_sec = SPDK_BDEV_QOS_MIN_IOS_PER_SEC;
 		} else {
@@ -14,13 +14,18 @@
 struct spdk_bdev;
 struct spdk_bdev_io;
 struct spdk_bdev_channel;
+struct spdk_iobuf_channel;
 
 struct spdk_bdev_io *bdev_channel_get_io(struct spdk_bdev_channel *channel);
+struct spdk_iobuf_channel *bdev_channel_get_iobuf(struct spdk_bdev_channel *channel);
 
 void bdev_io_init(struct spdk_bdev_io *bdev_io, struct spdk_bdev *bdev, void *cb_arg,
 		  spdk_bdev_io_completion_cb cb);
 
 void bdev_io_submit(struct spdk_bdev_io *bdev_io);
+void bdev_io_submit_ext(struct spdk_bdev_desc *desc, struct spdk_bdev_io *bdev_io,
+			struct spdk_bdev_ext_io_opts *opts);
+bool bdev_check_ext_io_opts(struct spdk_bdev_ext_io_opts *opts, struct iovec *iov);
 
 struct spdk_bdev_io_stat *bdev_alloc_io_stat(bool io_error_stat);
 void bdev_free_io_stat(struct spdk_bdev_io_stat *stat);
@@ -30,6 +30,34 @@
 
 #define __io_ch_to_bdev_ch(io_ch)       ((struct spdk_bdev_channel *)spdk_io_channel_get_ctx(io_ch))
 
+static int kv_check_ext_opts(struct spdk_bdev_ext_io_opts *opts, struct iovec *iov) {
+    if (opts == NULL) {
+        return 0;
+    }
+    /* KV commands carry no metadata */
+    if (!bdev_check_ext_io_opts(opts, iov) || opts->metadata != NULL) {
+        return -EINVAL;
+    }
+    return 0;
+}
+
+/*
+ * Common tail of the vectored KV calls. With a memory domain the bdev either
+ * hands it to the module, or bounces the data through an iobuf buffer if the
+ * module does not support memory domains, as for block reads and writes.
+ */
+static void kv_submit_ext(struct spdk_bdev_io *bdev_io, struct iovec *iov, int iovcnt,
+                   uint64_t nbytes, struct spdk_bdev_ext_io_opts *opts) {
+    bdev_io->u.bdev.iovs = iov;
+    bdev_io->u.bdev.iovcnt = iovcnt;
+    bdev_io->u.bdev.md_buf = NULL;
+    bdev_io->u.bdev.num_blocks = 0;
+    bdev_io->u.bdev.nvme_kv.buffer_size = nbytes;
+    bdev_io->internal.ext_opts = opts;
+    bdev_io->u.bdev.ext_opts = opts;
+    bdev_io_submit_ext(bdev_io->internal.desc, bdev_io, opts);
+}
+
 static int kv_list_helper(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
                    unsigned char *key, size_t key_length,
                    spdk_bdev_io_completion_cb cb, void *cb_arg, struct spdk_bdev_io **bdev_io) {
@@ -72,6 +100,7 @@ int spdk_bdev_kv_list(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
     bdev_io->u.bdev.iovs[0].iov_base = buf;
     bdev_io->u.bdev.iovs[0].iov_len = nbytes;
     bdev_io->u.bdev.iovcnt = 1;
+    bdev_io->u.bdev.nvme_kv.buffer_size = nbytes;
     bdev_io_submit(bdev_io);
     return 0;        
 }
@@ -80,16 +109,25 @@ int spdk_bdev_kv_listv(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
                    unsigned char *key, size_t key_length,
                    struct iovec *iov, int iovcnt, uint64_t nbytes,
                    spdk_bdev_io_completion_cb cb, void *cb_arg) {
+    return spdk_bdev_kv_listv_ext(desc, ch, key, key_length, iov, iovcnt, nbytes, cb, cb_arg, NULL);
+}
+
+int spdk_bdev_kv_listv_ext(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+                   unsigned char *key, size_t key_length,
+                   struct iovec *iov, int iovcnt, uint64_t nbytes,
+                   spdk_bdev_io_completion_cb cb, void *cb_arg,
+                   struct spdk_bdev_ext_io_opts *opts) {
     struct spdk_bdev_io *bdev_io;
-    int rc = kv_list_helper(desc, ch, key, key_length, cb, cb_arg, &bdev_io);
+    int rc = kv_check_ext_opts(opts, iov);
     if (rc) {
         return rc;
     }
-    bdev_io->u.bdev.iovs = iov;
-    bdev_io->u.bdev.iovcnt = iovcnt;
-    bdev_io->u.bdev.nvme_kv.buffer_size = nbytes;
-    bdev_io_submit(bdev_io);
-    return 0;        
+    rc = kv_list_helper(desc, ch, key, key_length, cb, cb_arg, &bdev_io);
+    if (rc) {
+        return rc;
+    }
+    kv_submit_ext(bdev_io, iov, iovcnt, nbytes, opts);
+    return 0;
 }
 
 int spdk_bdev_kv_delete(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
@@ -195,6 +233,7 @@ int spdk_bdev_kv_store(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
     bdev_io->u.bdev.iovs[0].iov_base = buf;
     bdev_io->u.bdev.iovs[0].iov_len = nbytes;
     bdev_io->u.bdev.iovcnt = 1;
+    bdev_io->u.bdev.nvme_kv.buffer_size = nbytes;
     bdev_io_submit(bdev_io);
     return 0;
 }
@@ -203,16 +242,25 @@ int spdk_bdev_kv_storev(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
                    unsigned char *key, size_t key_length,
                    struct iovec *iov, int iovcnt, uint64_t nbytes, uint8_t options,
                    spdk_bdev_io_completion_cb cb, void *cb_arg) {
+    return spdk_bdev_kv_storev_ext(desc, ch, key, key_length, iov, iovcnt, nbytes, options,
+                                   cb, cb_arg, NULL);
+}
+
+int spdk_bdev_kv_storev_ext(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+                   unsigned char *key, size_t key_length,
+                   struct iovec *iov, int iovcnt, uint64_t nbytes, uint8_t options,
+                   spdk_bdev_io_completion_cb cb, void *cb_arg,
+                   struct spdk_bdev_ext_io_opts *opts) {
     struct spdk_bdev_io *bdev_io;
-    int rc = kv_store_helper(desc, ch, key, key_length, options, cb, cb_arg, &bdev_io);
+    int rc = kv_check_ext_opts(opts, iov);
     if (rc) {
         return rc;
     }
-
-    bdev_io->u.bdev.iovs = iov;
-    bdev_io->u.bdev.iovcnt = iovcnt;
-    bdev_io->u.bdev.nvme_kv.buffer_size = nbytes;
-    bdev_io_submit(bdev_io);
+    rc = kv_store_helper(desc, ch, key, key_length, options, cb, cb_arg, &bdev_io);
+    if (rc) {
+        return rc;
+    }
+    kv_submit_ext(bdev_io, iov, iovcnt, nbytes, opts);
     return 0;
 }
 
@@ -255,6 +303,7 @@ int spdk_bdev_kv_retrieve(struct spdk_bdev_desc *desc, struct spdk_io_channel *c
     bdev_io->u.bdev.iovs[0].iov_base = buf;
     bdev_io->u.bdev.iovs[0].iov_len = nbytes;
     bdev_io->u.bdev.iovcnt = 1;
+    bdev_io->u.bdev.nvme_kv.buffer_size = nbytes;
     bdev_io_submit(bdev_io);
     return 0;
 }
@@ -263,15 +312,32 @@ int spdk_bdev_kv_retrievev(struct spdk_bdev_desc *desc, struct spdk_io_channel *
                    unsigned char *key, size_t key_length,
                    struct iovec *iov, int iovcnt, uint64_t offset, uint64_t nbytes,
                    spdk_bdev_io_completion_cb cb, void *cb_arg) {
+    return spdk_bdev_kv_retrievev_ext(desc, ch, key, key_length, iov, iovcnt, offset, nbytes,
+                                      cb, cb_arg, NULL);
+}
+
+int spdk_bdev_kv_retrievev_ext(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+                   unsigned char *key, size_t key_length,
+                   struct iovec *iov, int iovcnt, uint64_t offset, uint64_t nbytes,
+                   spdk_bdev_io_completion_cb cb, void *cb_arg,
+                   struct spdk_bdev_ext_io_opts *opts) {
     struct spdk_bdev_io *bdev_io;
-    int rc = kv_retrieve_helper(desc, ch, key, key_length, offset, cb, cb_arg, &bdev_io);
+    int rc = kv_check_ext_opts(opts, iov);
     if (rc) {
         return rc;
     }
-    bdev_io->u.bdev.iovs = iov;
-    bdev_io->u.bdev.iovcnt = iovcnt;
-    bdev_io->u.bdev.nvme_kv.buffer_size = nbytes;
-    bdev_io_submit(bdev_io);
+    rc = kv_retrieve_helper(desc, ch, key, key_length, offset, cb, cb_arg, &bdev_io);
+    if (rc) {
+        return rc;
+    }
+    if (iov == NULL) {
+        /* The bdev layer gets the buffer, see spdk_bdev_kv_retrieve(). */
+        bdev_io->iov.iov_base = NULL;
+        bdev_io->iov.iov_len = nbytes;
+        iov = &bdev_io->iov;
+        iovcnt = 1;
+    }
+    kv_submit_ext(bdev_io, iov, iovcnt, nbytes, opts);
     return 0;
 }
 
@@ -328,6 +394,7 @@ int spdk_bdev_kv_send_select(struct spdk_bdev_desc *desc, struct spdk_io_channel
     bdev_io->u.bdev.iovs[0].iov_base = buf;
     bdev_io->u.bdev.iovs[0].iov_len = nbytes;
     bdev_io->u.bdev.iovcnt = 1;
+    bdev_io->u.bdev.nvme_kv.buffer_size = nbytes;
     bdev_io_submit(bdev_io);
     return 0;
 }
@@ -337,15 +404,26 @@ int spdk_bdev_kv_send_selectv(struct spdk_bdev_desc *desc, struct spdk_io_channe
                    struct iovec *iov, int iovcnt, uint64_t nbytes, uint8_t options,
                    uint8_t input_type, uint8_t output_type,
                    spdk_bdev_io_completion_cb cb, void *cb_arg) {
+    return spdk_bdev_kv_send_selectv_ext(desc, ch, key, key_length, iov, iovcnt, nbytes, options,
+                                         input_type, output_type, cb, cb_arg, NULL);
+}
+
+int spdk_bdev_kv_send_selectv_ext(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+                   unsigned char *key, size_t key_length,
+                   struct iovec *iov, int iovcnt, uint64_t nbytes, uint8_t options,
+                   uint8_t input_type, uint8_t output_type,
+                   spdk_bdev_io_completion_cb cb, void *cb_arg,
+                   struct spdk_bdev_ext_io_opts *opts) {
     struct spdk_bdev_io *bdev_io;
-    int rc = kv_send_select_helper(desc, ch, key, key_length, options, input_type, output_type, cb, cb_arg, &bdev_io);
+    int rc = kv_check_ext_opts(opts, iov);
     if (rc) {
         return rc;
     }
-    bdev_io->u.bdev.iovs = iov;
-    bdev_io->u.bdev.iovcnt = iovcnt;
-    bdev_io->u.bdev.nvme_kv.buffer_size = nbytes;
-    bdev_io_submit(bdev_io);
+    rc = kv_send_select_helper(desc, ch, key, key_length, options, input_type, output_type, cb, cb_arg, &bdev_io);
+    if (rc) {
+        return rc;
+    }
+    kv_submit_ext(bdev_io, iov, iovcnt, nbytes, opts);
     return 0;
 }
 
@@ -386,6 +464,7 @@ int spdk_bdev_kv_retrieve_select(struct spdk_bdev_desc *desc, struct spdk_io_cha
     bdev_io->u.bdev.iovs[0].iov_base = buf; 
     bdev_io->u.bdev.iovs[0].iov_len = nbytes;
     bdev_io->u.bdev.iovcnt = 1;
+    bdev_io->u.bdev.nvme_kv.buffer_size = nbytes;
     bdev_io_submit(bdev_io);
     return 0;
 }
@@ -394,15 +473,1611 @@ int spdk_bdev_kv_retrieve_selectv(struct spdk_bdev_desc *desc, struct spdk_io_ch
                    struct iovec *iov, int iovcnt, uint64_t offset, uint64_t nbytes,
                    uint32_t select_id, uint8_t options,
                    spdk_bdev_io_completion_cb cb, void *cb_arg) {
+    return spdk_bdev_kv_retrieve_selectv_ext(desc, ch, iov, iovcnt, offset, nbytes, select_id,
+                                             options, cb, cb_arg, NULL);
+}
+
+int spdk_bdev_kv_retrieve_selectv_ext(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+                   struct iovec *iov, int iovcnt, uint64_t offset, uint64_t nbytes,
+                   uint32_t select_id, uint8_t options,
+                   spdk_bdev_io_completion_cb cb, void *cb_arg,
+                   struct spdk_bdev_ext_io_opts *opts) {
     struct spdk_bdev_io *bdev_io;
-    int rc = kv_retrieve_select_helper(desc, ch, offset, select_id, options, cb, cb_arg, &bdev_io);
+    int rc = kv_check_ext_opts(opts, iov);
+    if (rc) {
+        return rc;
+    }
+    rc = kv_retrieve_select_helper(desc, ch, offset, select_id, options, cb, cb_arg, &bdev_io);
     if (rc) {
         return rc;
     }
+    kv_submit_ext(bdev_io, iov, iovcnt, nbytes, opts);
+    return 0;
+}
 
-    bdev_io->u.bdev.iovs = iov;
-    bdev_io->u.bdev.iovcnt = iovcnt;
-    bdev_io->u.bdev.nvme_kv.buffer_size = nbytes;
+static int kv_batch_helper(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+                   uint8_t batch_type,
+                   struct spdk_bdev_kv_batch_entry *entries, uint32_t num_entries,
+                   spdk_bdev_io_completion_cb cb, void *cb_arg) {
+    struct spdk_bdev *bdev = spdk_bdev_desc_get_bdev(desc);
+    struct spdk_bdev_channel *channel = __io_ch_to_bdev_ch(ch);
+    struct spdk_bdev_io *bdev_io;
+    uint32_t i;
+
+    if (num_entries == 0 || entries == NULL) {
+        return -EINVAL;
+    }
+
+    for (i = 0; i < num_entries; i++) {
+        if (entries[i].key_length == 0 || entries[i].key_length > NVME_KV_MAX_KEY_LENGTH) {
+            return -EINVAL;
+        }
+    }
+
+    if (batch_type == SPDK_BDEV_IO_KV_STORE && !spdk_bdev_check_desc_write(desc)) {
+        return -EBADF;
+    }
+
+    if (!spdk_bdev_io_type_supported(bdev, SPDK_BDEV_IO_KV_BATCH)) {
+        return -ENOTSUP;
+    }
+
+    bdev_io = bdev_channel_get_io(channel);
+    if (!bdev_io) {
+        return -ENOMEM;
+    }
+
+    bdev_io->internal.ch = channel;
+    bdev_io->internal.desc = desc;
+    bdev_io->type = SPDK_BDEV_IO_KV_BATCH;
+    bdev_io->u.bdev.iovs = NULL;
+    bdev_io->u.bdev.iovcnt = 0;
+    bdev_io->u.bdev.ext_opts = NULL;
+    bdev_io->u.bdev.nvme_kv.key_length = 0;
+    bdev_io->u.bdev.nvme_kv.batch = entries;
+    bdev_io->u.bdev.nvme_kv.batch_count = num_entries;
+    bdev_io->u.bdev.nvme_kv.batch_type = batch_type;
+    bdev_io_init(bdev_io, bdev, cb_arg, cb);
     bdev_io_submit(bdev_io);
     return 0;
 }
+
+int spdk_bdev_kv_mget(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+                   struct spdk_bdev_kv_batch_entry *entries, uint32_t num_entries,
+                   spdk_bdev_io_completion_cb cb, void *cb_arg) {
+    return kv_batch_helper(desc, ch, SPDK_BDEV_IO_KV_RETRIEVE, entries, num_entries, cb, cb_arg);
+}
+
+int spdk_bdev_kv_mput(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+                   struct spdk_bdev_kv_batch_entry *entries, uint32_t num_entries,
+                   spdk_bdev_io_completion_cb cb, void *cb_arg) {
+    return kv_batch_helper(desc, ch, SPDK_BDEV_IO_KV_STORE, entries, num_entries, cb, cb_arg);
+}
+
+int spdk_bdev_kv_mexist(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+                   struct spdk_bdev_kv_batch_entry *entries, uint32_t num_entries,
+                   spdk_bdev_io_completion_cb cb, void *cb_arg) {
+    return kv_batch_helper(desc, ch, SPDK_BDEV_IO_KV_EXIST, entries, num_entries, cb, cb_arg);
+}
+
+int spdk_bdev_kv_io_forward(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+                   struct spdk_bdev_io *bdev_io,
+                   spdk_bdev_io_completion_cb cb, void *cb_arg) {
+    struct spdk_bdev_io *io = bdev_io;
+
+    switch (io->type) {
+    case SPDK_BDEV_IO_KV_LIST:
+        return spdk_bdev_kv_listv_ext(desc, ch, io->u.bdev.nvme_kv.key, io->u.bdev.nvme_kv.key_length,
+                                      io->u.bdev.iovs, io->u.bdev.iovcnt, io->u.bdev.nvme_kv.buffer_size,
+                                      cb, cb_arg, io->u.bdev.ext_opts);
+    case SPDK_BDEV_IO_KV_DELETE:
+        return spdk_bdev_kv_delete(desc, ch, io->u.bdev.nvme_kv.key, io->u.bdev.nvme_kv.key_length,
+                                   cb, cb_arg);
+    case SPDK_BDEV_IO_KV_EXIST:
+        return spdk_bdev_kv_exist(desc, ch, io->u.bdev.nvme_kv.key, io->u.bdev.nvme_kv.key_length,
+                                  cb, cb_arg);
+    case SPDK_BDEV_IO_KV_STORE:
+        return spdk_bdev_kv_storev_ext(desc, ch, io->u.bdev.nvme_kv.key, io->u.bdev.nvme_kv.key_length,
+                                       io->u.bdev.iovs, io->u.bdev.iovcnt, io->u.bdev.nvme_kv.buffer_size,
+                                       io->u.bdev.nvme_kv.options, cb, cb_arg, io->u.bdev.ext_opts);
+    case SPDK_BDEV_IO_KV_RETRIEVE:
+        return spdk_bdev_kv_retrievev_ext(desc, ch, io->u.bdev.nvme_kv.key, io->u.bdev.nvme_kv.key_length,
+                                          io->u.bdev.iovs, io->u.bdev.iovcnt, io->u.bdev.nvme_kv.offset,
+                                          io->u.bdev.nvme_kv.buffer_size, cb, cb_arg, io->u.bdev.ext_opts);
+    case SPDK_BDEV_IO_KV_SEND_SELECT:
+        return spdk_bdev_kv_send_selectv_ext(desc, ch, io->u.bdev.nvme_kv.key, io->u.bdev.nvme_kv.key_length,
+                                             io->u.bdev.iovs, io->u.bdev.iovcnt, io->u.bdev.nvme_kv.buffer_size,
+                                             io->u.bdev.nvme_kv.options, io->u.bdev.nvme_kv.select_input_type,
+                                             io->u.bdev.nvme_kv.select_output_type, cb, cb_arg,
+                                             io->u.bdev.ext_opts);
+    case SPDK_BDEV_IO_KV_RETRIEVE_SELECT:
+        return spdk_bdev_kv_retrieve_selectv_ext(desc, ch, io->u.bdev.iovs, io->u.bdev.iovcnt,
+                                                 io->u.bdev.nvme_kv.offset, io->u.bdev.nvme_kv.buffer_size,
+                                                 io->u.bdev.nvme_kv.select_id, io->u.bdev.nvme_kv.options,
+                                                 cb, cb_arg, io->u.bdev.ext_opts);
+    case SPDK_BDEV_IO_KV_BATCH:
+        return kv_batch_helper(desc, ch, io->u.bdev.nvme_kv.batch_type, io->u.bdev.nvme_kv.batch,
+                               io->u.bdev.nvme_kv.batch_count, cb, cb_arg);
+    default:
+        return -EINVAL;
+    }
+}
+
+void spdk_bdev_kv_io_complete_from(struct spdk_bdev_io *bdev_io, const struct spdk_bdev_io *child) {
+    uint32_t cdw0;
+    int sct, sc;
+
+    spdk_bdev_io_get_nvme_status(child, &cdw0, &sct, &sc);
+    spdk_bdev_io_complete_nvme_status(bdev_io, cdw0, sct, sc);
+}
+
+#define KV_SELECT_CURSOR_DEFAULT_CHUNK_SIZE    (64 * 1024)
+#define KV_SELECT_CURSOR_DEFAULT_DEPTH         4
+#define KV_SELECT_CURSOR_MAX_DEPTH             32
+
+struct kv_select_slot {
+    struct spdk_bdev_kv_select_cursor *cursor;
+    struct spdk_iobuf_entry iobuf;
+    void *buf;
+    bool buf_pending;
+    bool busy;
+    bool ready;
+    uint64_t offset;
+    uint32_t len;
+};
+
+/*
+ * The cursor keeps a ring of queue_depth buffers. The chunk at offset N * chunk_size
+ * always lands in slot N % queue_depth, so a slot can be reused as soon as the
+ * chunk in it has been delivered. Chunks are delivered strictly in offset order.
+ */
+struct spdk_bdev_kv_select_cursor {
+    struct spdk_bdev_desc *desc;
+    struct spdk_io_channel *ch;
+    struct spdk_iobuf_channel *iobuf;
+    struct spdk_bdev_io_wait_entry wait;
+
+    unsigned char key[NVME_KV_MAX_KEY_LENGTH];
+    size_t key_length;
+    char *query;
+    uint32_t query_len;
+    uint8_t options;
+    uint8_t input_type;
+    uint8_t output_type;
+
+    uint32_t chunk_size;
+    uint32_t depth;
+    uint32_t select_id;
+    uint64_t total;
+    uint64_t next_offset;
+    uint64_t deliver_offset;
+    uint32_t outstanding;
+    int status;
+
+    bool sent;
+    bool selected;
+    bool released;
+    bool total_known;
+    bool stopping;
+    bool waiting;
+    bool delivering;
+
+    spdk_bdev_kv_select_chunk_cb chunk_cb;
+    spdk_bdev_kv_select_done_cb done_cb;
+    void *cb_arg;
+
+    struct kv_select_slot slots[];
+};
+
+static void kv_select_cursor_continue(struct spdk_bdev_kv_select_cursor *cursor);
+
+static void kv_select_cursor_stop(struct spdk_bdev_kv_select_cursor *cursor, int status) {
+    if (!cursor->stopping) {
+        cursor->stopping = true;
+        cursor->status = status;
+    }
+}
+
+static struct kv_select_slot *kv_select_cursor_slot(struct spdk_bdev_kv_select_cursor *cursor,
+                   uint64_t offset) {
+    return &cursor->slots[(offset / cursor->chunk_size) % cursor->depth];
+}
+
+static void kv_select_cursor_resume(void *arg) {
+    struct spdk_bdev_kv_select_cursor *cursor = arg;
+
+    cursor->waiting = false;
+    kv_select_cursor_continue(cursor);
+}
+
+/* Returns true if the caller should retry once a bdev_io is available. */
+static bool kv_select_cursor_submit_failed(struct spdk_bdev_kv_select_cursor *cursor, int rc) {
+    if (rc == -ENOMEM) {
+        cursor->wait.bdev = spdk_bdev_desc_get_bdev(cursor->desc);
+        cursor->wait.cb_fn = kv_select_cursor_resume;
+        cursor->wait.cb_arg = cursor;
+        if (spdk_bdev_queue_io_wait(cursor->wait.bdev, cursor->ch, &cursor->wait) == 0) {
+            cursor->waiting = true;
+            return true;
+        }
+    }
+    SPDK_ERRLOG("kv select cursor failed to submit: %s\n", spdk_strerror(-rc));
+    kv_select_cursor_stop(cursor, rc);
+    return false;
+}
+
+static void kv_select_cursor_free(struct spdk_bdev_kv_select_cursor *cursor) {
+    struct kv_select_slot *slot;
+    uint32_t i;
+
+    /* Abort our own waiters first so putting a buffer cannot hand it back to this cursor. */
+    for (i = 0; i < cursor->depth; i++) {
+        slot = &cursor->slots[i];
+        if (slot->buf_pending) {
+            spdk_iobuf_entry_abort(cursor->iobuf, &slot->iobuf, cursor->chunk_size);
+        }
+    }
+    for (i = 0; i < cursor->depth; i++) {
+        slot = &cursor->slots[i];
+        if (slot->buf != NULL) {
+            spdk_iobuf_put(cursor->iobuf, slot->buf, cursor->chunk_size);
+        }
+    }
+    free(cursor->query);
+    free(cursor);
+}
+
+static void kv_select_cursor_send_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg) {
+    struct spdk_bdev_kv_select_cursor *cursor = cb_arg;
+    uint32_t cdw0;
+    int sct, sc;
+
+    spdk_bdev_io_get_nvme_status(bdev_io, &cdw0, &sct, &sc);
+    spdk_bdev_free_io(bdev_io);
+
+    cursor->outstanding--;
+    if (success) {
+        cursor->select_id = cdw0;
+        cursor->selected = true;
+    } else {
+        kv_select_cursor_stop(cursor, -EIO);
+    }
+    kv_select_cursor_continue(cursor);
+}
+
+static void kv_select_cursor_release_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg) {
+    struct spdk_bdev_kv_select_cursor *cursor = cb_arg;
+
+    spdk_bdev_free_io(bdev_io);
+    cursor->outstanding--;
+    if (!success) {
+        SPDK_ERRLOG("kv select cursor failed to release select id %u\n", cursor->select_id);
+    }
+    kv_select_cursor_continue(cursor);
+}
+
+static void kv_select_cursor_deliver(struct spdk_bdev_kv_select_cursor *cursor) {
+    struct kv_select_slot *slot;
+    int rc;
+
+    while (!cursor->stopping && cursor->deliver_offset < cursor->total) {
+        slot = kv_select_cursor_slot(cursor, cursor->deliver_offset);
+        if (!slot->ready) {
+            break;
+        }
+        cursor->delivering = true;
+        rc = cursor->chunk_cb(cursor->cb_arg, slot->buf, slot->len, cursor->deliver_offset);
+        cursor->delivering = false;
+        slot->ready = false;
+        slot->busy = false;
+        cursor->deliver_offset += cursor->chunk_size;
+        if (rc != 0) {
+            kv_select_cursor_stop(cursor, rc);
+        }
+    }
+}
+
+static void kv_select_cursor_retrieve_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg) {
+    struct kv_select_slot *slot = cb_arg;
+    struct spdk_bdev_kv_select_cursor *cursor = slot->cursor;
+    uint64_t offset = slot->offset;
+    uint32_t cdw0;
+    int sct, sc;
+
+    spdk_bdev_io_get_nvme_status(bdev_io, &cdw0, &sct, &sc);
+    spdk_bdev_free_io(bdev_io);
+    cursor->outstanding--;
+
+    if (!success) {
+        slot->busy = false;
+        kv_select_cursor_stop(cursor, -EIO);
+        kv_select_cursor_continue(cursor);
+        return;
+    }
+
+    if (!cursor->total_known) {
+        cursor->total = cdw0;
+        cursor->total_known = true;
+    }
+    if (offset + cursor->chunk_size >= cursor->total) {
+        /* The chunk reaching the end of the results is fetched with a free option. */
+        cursor->released = true;
+    }
+
+    slot->len = offset < cursor->total ? spdk_min(cursor->chunk_size, cursor->total - offset) : 0;
+    slot->ready = true;
+    kv_select_cursor_deliver(cursor);
+    kv_select_cursor_continue(cursor);
+}
+
+static void kv_select_cursor_pump(struct spdk_bdev_kv_select_cursor *cursor) {
+    struct kv_select_slot *slot;
+    uint8_t opts;
+    bool tail;
+    int rc;
+
+    if (!cursor->sent) {
+        slot = &cursor->slots[0];
+        if (slot->buf == NULL) {
+            return;
+        }
+        /* The query is sent from an iobuf buffer so it is always DMA-able. */
+        memcpy(slot->buf, cursor->query, cursor->query_len);
+        rc = spdk_bdev_kv_send_select(cursor->desc, cursor->ch, cursor->key, cursor->key_length,
+                                      slot->buf, cursor->query_len, cursor->options,
+                                      cursor->input_type, cursor->output_type,
+                                      kv_select_cursor_send_done, cursor);
+        if (rc != 0) {
+            kv_select_cursor_submit_failed(cursor, rc);
+            return;
+        }
+        cursor->sent = true;
+        cursor->outstanding++;
+        return;
+    }
+
+    if (!cursor->selected) {
+        return;
+    }
+
+    while (cursor->outstanding < cursor->depth) {
+        if (cursor->total_known) {
+            if (cursor->next_offset >= cursor->total) {
+                break;
+            }
+            tail = cursor->next_offset + cursor->chunk_size >= cursor->total;
+        } else if (cursor->next_offset == 0) {
+            /* The first chunk tells us the result length. If it all fits, the device frees it. */
+            tail = true;
+        } else {
+            break;
+        }
+
+        /*
+         * Commands on a queue are not ordered, so the chunk that frees the select
+         * must not be sent until every chunk before it has completed.
+         */
+        if (tail && cursor->outstanding > 0) {
+            break;
+        }
+
+        slot = kv_select_cursor_slot(cursor, cursor->next_offset);
+        if (slot->busy || slot->buf == NULL) {
+            break;
+        }
+
+        if (cursor->total_known) {
+            opts = tail ? 0 : NVME_KV_SELECT_CMD_OPTION_DO_NOT_FREE;
+        } else {
+            opts = NVME_KV_SELECT_CMD_OPTION_DO_NOT_FREE_IF_NOT_ALL_DATA_FETCHED;
+        }
+        rc = spdk_bdev_kv_retrieve_select(cursor->desc, cursor->ch, slot->buf, cursor->next_offset,
+                                          cursor->chunk_size, cursor->select_id, opts,
+                                          kv_select_cursor_retrieve_done, slot);
+        if (rc != 0) {
+            kv_select_cursor_submit_failed(cursor, rc);
+            return;
+        }
+        slot->busy = true;
+        slot->offset = cursor->next_offset;
+        cursor->next_offset += cursor->chunk_size;
+        cursor->outstanding++;
+    }
+}
+
+static void kv_select_cursor_release(struct spdk_bdev_kv_select_cursor *cursor) {
+    struct kv_select_slot *slot = NULL;
+    uint32_t i;
+    int rc;
+
+    for (i = 0; i < cursor->depth; i++) {
+        if (cursor->slots[i].buf != NULL) {
+            slot = &cursor->slots[i];
+            break;
+        }
+    }
+    assert(slot != NULL);
+
+    rc = spdk_bdev_kv_retrieve_select(cursor->desc, cursor->ch, slot->buf, 0, cursor->chunk_size,
+                                      cursor->select_id, 0,
+                                      kv_select_cursor_release_done, cursor);
+    if (rc != 0) {
+        if (kv_select_cursor_submit_failed(cursor, rc)) {
+            return;
+        }
+        SPDK_ERRLOG("kv select cursor leaked select id %u\n", cursor->select_id);
+    } else {
+        cursor->outstanding++;
+    }
+    cursor->released = true;
+}
+
+static void kv_select_cursor_continue(struct spdk_bdev_kv_select_cursor *cursor) {
+    if (cursor->waiting) {
+        return;
+    }
+
+    if (cursor->total_known && cursor->deliver_offset >= cursor->total) {
+        kv_select_cursor_stop(cursor, 0);
+    }
+
+    if (!cursor->stopping) {
+        kv_select_cursor_pump(cursor);
+    }
+
+    if (!cursor->stopping || cursor->waiting || cursor->outstanding > 0) {
+        return;
+    }
+
+    if (cursor->selected && !cursor->released) {
+        kv_select_cursor_release(cursor);
+        if (cursor->waiting || cursor->outstanding > 0) {
+            return;
+        }
+    }
+
+    cursor->done_cb(cursor->cb_arg, cursor->status, cursor->total_known ? cursor->total : 0);
+    kv_select_cursor_free(cursor);
+}
+
+static void kv_select_cursor_iobuf_cb(struct spdk_iobuf_entry *iobuf, void *buf) {
+    struct kv_select_slot *slot = SPDK_CONTAINEROF(iobuf, struct kv_select_slot, iobuf);
+    struct spdk_bdev_kv_select_cursor *cursor = slot->cursor;
+
+    slot->buf_pending = false;
+    slot->buf = buf;
+    kv_select_cursor_continue(cursor);
+}
+
+int spdk_bdev_kv_select_cursor_open(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+                   unsigned char *key, size_t key_length,
+                   const char *query, uint32_t query_len, uint8_t options,
+                   uint8_t input_type, uint8_t output_type,
+                   uint32_t chunk_size, uint32_t queue_depth,
+                   spdk_bdev_kv_select_chunk_cb chunk_cb,
+                   spdk_bdev_kv_select_done_cb done_cb, void *cb_arg,
+                   struct spdk_bdev_kv_select_cursor **_cursor) {
+    struct spdk_bdev_channel *channel = __io_ch_to_bdev_ch(ch);
+    struct spdk_iobuf_channel *iobuf = bdev_channel_get_iobuf(channel);
+    struct spdk_bdev_kv_select_cursor *cursor;
+    struct kv_select_slot *slot;
+    uint32_t i;
+    int rc;
+
+    if (key_length == 0 || key_length > NVME_KV_MAX_KEY_LENGTH || query_len == 0 ||
+        chunk_cb == NULL || done_cb == NULL) {
+        return -EINVAL;
+    }
+
+    if (chunk_size == 0) {
+        chunk_size = spdk_min(KV_SELECT_CURSOR_DEFAULT_CHUNK_SIZE, iobuf->large.bufsize);
+    }
+    if (queue_depth == 0) {
+        queue_depth = KV_SELECT_CURSOR_DEFAULT_DEPTH;
+    }
+    if (chunk_size > iobuf->large.bufsize || query_len > chunk_size ||
+        queue_depth > KV_SELECT_CURSOR_MAX_DEPTH) {
+        return -EINVAL;
+    }
+
+    cursor = calloc(1, sizeof(*cursor) + queue_depth * sizeof(struct kv_select_slot));
+    if (cursor == NULL) {
+        return -ENOMEM;
+    }
+    cursor->query = malloc(query_len);
+    if (cursor->query == NULL) {
+        free(cursor);
+        return -ENOMEM;
+    }
+
+    cursor->desc = desc;
+    cursor->ch = ch;
+    cursor->iobuf = iobuf;
+    memcpy(cursor->key, key, key_length);
+    cursor->key_length = key_length;
+    memcpy(cursor->query, query, query_len);
+    cursor->query_len = query_len;
+    cursor->options = options;
+    cursor->input_type = input_type;
+    cursor->output_type = output_type;
+    cursor->chunk_size = chunk_size;
+    cursor->depth = queue_depth;
+    cursor->chunk_cb = chunk_cb;
+    cursor->done_cb = done_cb;
+    cursor->cb_arg = cb_arg;
+
+    for (i = 0; i < queue_depth; i++) {
+        slot = &cursor->slots[i];
+        slot->cursor = cursor;
+        slot->buf = spdk_iobuf_get(iobuf, chunk_size, &slot->iobuf, kv_select_cursor_iobuf_cb);
+        slot->buf_pending = slot->buf == NULL;
+    }
+
+    /* Sending the query is the only step that can fail synchronously. */
+    if (cursor->slots[0].buf != NULL) {
+        kv_select_cursor_pump(cursor);
+        if (cursor->stopping) {
+            rc = cursor->status;
+            kv_select_cursor_free(cursor);
+            return rc;
+        }
+    }
+
+    *_cursor = cursor;
+    return 0;
+}
+
+void spdk_bdev_kv_select_cursor_close(struct spdk_bdev_kv_select_cursor *cursor) {
+    kv_select_cursor_stop(cursor, -ECANCELED);
+    /* When called from the chunk callback, the delivery loop picks up the stop. */
+    if (!cursor->delivering) {
+        kv_select_cursor_continue(cursor);
+    }
+}
+
+#define KV_LIST_ITER_DEFAULT_BUF_SIZE    (64 * 1024)
+#define KV_LIST_ITER_DEFAULT_DEPTH       4
+#define KV_LIST_ITER_MAX_DEPTH           32
+#define KV_LIST_ITER_MAX_SHARDS          256
+
+/*
+ * A walker lists one shard of the key space, one prefix at a time. A listing
+ * returns as many of the matching keys as fit into the buffer, in ascending
+ * order; when it might not have returned all of them, the prefix is split into
+ * 256 longer ones. The walk of a shard ends when the prefix climbs back to the
+ * shard's base prefix.
+ */
+struct kv_list_walker {
+    struct spdk_bdev_kv_list_iter *iter;
+    struct spdk_iobuf_entry iobuf;
+    void *buf;
+    bool buf_pending;
+    bool busy;
+    bool active;
+    unsigned char prefix[NVME_KV_MAX_KEY_LENGTH];
+    size_t prefix_len;
+    /* Last value of the first byte after the base prefix for a sharded walk. */
+    uint8_t last;
+};
+
+struct spdk_bdev_kv_list_iter {
+    struct spdk_bdev_desc *desc;
+    struct spdk_io_channel *ch;
+    struct spdk_iobuf_channel *iobuf;
+    struct spdk_bdev_io_wait_entry wait;
+
+    unsigned char prefix[NVME_KV_MAX_KEY_LENGTH];
+    size_t prefix_len;
+    uint32_t buf_size;
+    uint32_t depth;
+    uint32_t num_shards;
+    uint32_t next_shard;
+    uint32_t end_shard;
+    uint32_t outstanding;
+    uint64_t num_keys;
+    int status;
+
+    /* A sharded walk never lists the base prefix, so a key equal to it is checked on its own. */
+    bool check_prefix;
+    bool stopping;
+    bool waiting;
+    bool delivering;
+
+    spdk_bdev_kv_list_key_cb key_cb;
+    spdk_bdev_kv_list_done_cb done_cb;
+    void *cb_arg;
+
+    struct kv_list_walker walkers[];
+};
+
+static void kv_list_iter_continue(struct spdk_bdev_kv_list_iter *iter);
+
+static void kv_list_iter_stop(struct spdk_bdev_kv_list_iter *iter, int status) {
+    if (!iter->stopping) {
+        iter->stopping = true;
+        iter->status = status;
+    }
+}
+
+static void kv_list_iter_resume(void *arg) {
+    struct spdk_bdev_kv_list_iter *iter = arg;
+
+    iter->waiting = false;
+    kv_list_iter_continue(iter);
+}
+
+static void kv_list_iter_submit_failed(struct spdk_bdev_kv_list_iter *iter, int rc) {
+    if (rc == -ENOMEM) {
+        iter->wait.bdev = spdk_bdev_desc_get_bdev(iter->desc);
+        iter->wait.cb_fn = kv_list_iter_resume;
+        iter->wait.cb_arg = iter;
+        if (spdk_bdev_queue_io_wait(iter->wait.bdev, iter->ch, &iter->wait) == 0) {
+            iter->waiting = true;
+            return;
+        }
+    }
+    SPDK_ERRLOG("kv list iterator failed to submit: %s\n", spdk_strerror(-rc));
+    kv_list_iter_stop(iter, rc);
+}
+
+static void kv_list_iter_free(struct spdk_bdev_kv_list_iter *iter) {
+    struct kv_list_walker *walker;
+    uint32_t i;
+
+    for (i = 0; i < iter->depth; i++) {
+        walker = &iter->walkers[i];
+        if (walker->buf_pending) {
+            spdk_iobuf_entry_abort(iter->iobuf, &walker->iobuf, iter->buf_size);
+        }
+    }
+    for (i = 0; i < iter->depth; i++) {
+        walker = &iter->walkers[i];
+        if (walker->buf != NULL) {
+            spdk_iobuf_put(iter->iobuf, walker->buf, iter->buf_size);
+        }
+    }
+    free(iter);
+}
+
+static void kv_list_iter_deliver(struct spdk_bdev_kv_list_iter *iter, const unsigned char *key,
+                   size_t key_length) {
+    int rc;
+
+    if (iter->stopping) {
+        return;
+    }
+
+    iter->delivering = true;
+    rc = iter->key_cb(iter->cb_arg, key, key_length);
+    iter->delivering = false;
+    iter->num_keys++;
+    if (rc != 0) {
+        kv_list_iter_stop(iter, rc);
+    }
+}
+
+static void kv_list_iter_exist_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg) {
+    struct spdk_bdev_kv_list_iter *iter = cb_arg;
+    uint32_t cdw0;
+    int sct, sc;
+
+    spdk_bdev_io_get_nvme_status(bdev_io, &cdw0, &sct, &sc);
+    spdk_bdev_free_io(bdev_io);
+    iter->outstanding--;
+
+    if (success) {
+        kv_list_iter_deliver(iter, iter->prefix, iter->prefix_len);
+    } else if (!(sct == SPDK_NVME_SCT_GENERIC && sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST)) {
+        kv_list_iter_stop(iter, -EIO);
+    }
+    kv_list_iter_continue(iter);
+}
+
+/* Move the walker past its current prefix. Returns false once the shard is done. */
+static bool kv_list_walker_advance(struct kv_list_walker *walker, bool truncated) {
+    struct spdk_bdev_kv_list_iter *iter = walker->iter;
+    size_t base = iter->prefix_len;
+
+    if (truncated) {
+        walker->prefix[walker->prefix_len++] = 0;
+        return true;
+    }
+
+    while (walker->prefix_len > base) {
+        if (walker->prefix_len == base + 1 ? walker->prefix[base] != walker->last :
+            walker->prefix[walker->prefix_len - 1] != UINT8_MAX) {
+            walker->prefix[walker->prefix_len - 1]++;
+            return true;
+        }
+        walker->prefix_len--;
+    }
+    return false;
+}
+
+static void kv_list_iter_list_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg) {
+    struct kv_list_walker *walker = cb_arg;
+    struct spdk_bdev_kv_list_iter *iter = walker->iter;
+    uint8_t *buf = walker->buf;
+    uint32_t num, i, pos = sizeof(num), end;
+    uint16_t key_len;
+    bool truncated;
+
+    spdk_bdev_free_io(bdev_io);
+    iter->outstanding--;
+    walker->busy = false;
+
+    if (!success) {
+        kv_list_iter_stop(iter, -EIO);
+        kv_list_iter_continue(iter);
+        return;
+    }
+
+    memcpy(&num, buf, sizeof(num));
+    for (i = 0; i < num; i++) {
+        if (pos + sizeof(key_len) > iter->buf_size) {
+            break;
+        }
+        memcpy(&key_len, buf + pos, sizeof(key_len));
+        if (key_len > NVME_KV_MAX_KEY_LENGTH || pos + sizeof(key_len) + key_len > iter->buf_size) {
+            break;
+        }
+        pos += sizeof(key_len) + SPDK_ALIGN_CEIL(key_len, 4);
+    }
+    if (i != num) {
+        SPDK_ERRLOG("kv list iterator got a malformed key list\n");
+        kv_list_iter_stop(iter, -EIO);
+        kv_list_iter_continue(iter);
+        return;
+    }
+    end = pos;
+
+    /* Another key might not have fit. Only the prefix itself can't be in a longer prefix. */
+    truncated = end + sizeof(key_len) + NVME_KV_MAX_KEY_LENGTH > iter->buf_size &&
+                walker->prefix_len < NVME_KV_MAX_KEY_LENGTH;
+
+    /* Keys in a truncated listing are delivered again under the longer prefixes. */
+    for (pos = sizeof(num); pos < end && !iter->stopping;
+         pos += sizeof(key_len) + SPDK_ALIGN_CEIL(key_len, 4)) {
+        memcpy(&key_len, buf + pos, sizeof(key_len));
+        if (!truncated || key_len == walker->prefix_len) {
+            kv_list_iter_deliver(iter, buf + pos + sizeof(key_len), key_len);
+        }
+    }
+
+    walker->active = kv_list_walker_advance(walker, truncated);
+    kv_list_iter_continue(iter);
+}
+
+static void kv_list_walker_start(struct kv_list_walker *walker, uint32_t shard) {
+    struct spdk_bdev_kv_list_iter *iter = walker->iter;
+
+    memcpy(walker->prefix, iter->prefix, iter->prefix_len);
+    walker->prefix_len = iter->prefix_len;
+    if (iter->num_shards > 1) {
+        walker->prefix[walker->prefix_len++] = shard * 256 / iter->num_shards;
+        walker->last = (shard + 1) * 256 / iter->num_shards - 1;
+    }
+    walker->active = true;
+}
+
+static void kv_list_iter_pump(struct spdk_bdev_kv_list_iter *iter) {
+    struct kv_list_walker *walker;
+    uint32_t i;
+    int rc;
+
+    if (iter->check_prefix) {
+        rc = spdk_bdev_kv_exist(iter->desc, iter->ch, iter->prefix, iter->prefix_len,
+                                kv_list_iter_exist_done, iter);
+        if (rc != 0) {
+            kv_list_iter_submit_failed(iter, rc);
+            return;
+        }
+        iter->check_prefix = false;
+        iter->outstanding++;
+    }
+
+    for (i = 0; i < iter->depth; i++) {
+        walker = &iter->walkers[i];
+        if (walker->busy || walker->buf == NULL) {
+            continue;
+        }
+        if (!walker->active) {
+            if (iter->next_shard == iter->end_shard) {
+                continue;
+            }
+            kv_list_walker_start(walker, iter->next_shard++);
+        }
+
+        rc = spdk_bdev_kv_list(iter->desc, iter->ch, walker->prefix, walker->prefix_len,
+                               walker->buf, iter->buf_size, kv_list_iter_list_done, walker);
+        if (rc != 0) {
+            kv_list_iter_submit_failed(iter, rc);
+            return;
+        }
+        walker->busy = true;
+        iter->outstanding++;
+    }
+}
+
+static void kv_list_iter_continue(struct spdk_bdev_kv_list_iter *iter) {
+    uint32_t i;
+
+    if (iter->waiting) {
+        return;
+    }
+
+    if (!iter->stopping) {
+        kv_list_iter_pump(iter);
+    }
+
+    if (iter->waiting || iter->outstanding > 0) {
+        return;
+    }
+
+    if (!iter->stopping) {
+        if (iter->next_shard < iter->end_shard) {
+            /* Still waiting for a buffer. */
+            return;
+        }
+        for (i = 0; i < iter->depth; i++) {
+            if (iter->walkers[i].active) {
+                return;
+            }
+        }
+        kv_list_iter_stop(iter, 0);
+    }
+
+    iter->done_cb(iter->cb_arg, iter->status, iter->num_keys);
+    kv_list_iter_free(iter);
+}
+
+static void kv_list_iter_iobuf_cb(struct spdk_iobuf_entry *iobuf, void *buf) {
+    struct kv_list_walker *walker = SPDK_CONTAINEROF(iobuf, struct kv_list_walker, iobuf);
+
+    walker->buf_pending = false;
+    walker->buf = buf;
+    kv_list_iter_continue(walker->iter);
+}
+
+int spdk_bdev_kv_list_iter_open(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+                   const unsigned char *prefix, size_t prefix_length,
+                   uint32_t num_shards, uint32_t first_shard, uint32_t shard_count,
+                   uint32_t queue_depth,
+                   spdk_bdev_kv_list_key_cb key_cb,
+                   spdk_bdev_kv_list_done_cb done_cb, void *cb_arg,
+                   struct spdk_bdev_kv_list_iter **_iter) {
+    struct spdk_bdev_channel *channel = __io_ch_to_bdev_ch(ch);
+    struct spdk_iobuf_channel *iobuf = bdev_channel_get_iobuf(channel);
+    struct spdk_bdev_kv_list_iter *iter;
+    struct kv_list_walker *walker;
+    uint32_t i;
+    int rc;
+
+    if (num_shards == 0) {
+        num_shards = 1;
+    }
+    if (shard_count == 0) {
+        shard_count = num_shards - spdk_min(first_shard, num_shards);
+    }
+    if (queue_depth == 0) {
+        queue_depth = spdk_min(shard_count, KV_LIST_ITER_DEFAULT_DEPTH);
+    }
+    if (prefix_length > NVME_KV_MAX_KEY_LENGTH || key_cb == NULL || done_cb == NULL ||
+        num_shards > KV_LIST_ITER_MAX_SHARDS ||
+        (num_shards > 1 && prefix_length == NVME_KV_MAX_KEY_LENGTH) ||
+        first_shard >= num_shards || shard_count > num_shards - first_shard ||
+        queue_depth > KV_LIST_ITER_MAX_DEPTH) {
+        return -EINVAL;
+    }
+    /* No more walkers than shards are ever busy. */
+    queue_depth = spdk_min(queue_depth, shard_count);
+
+    iter = calloc(1, sizeof(*iter) + queue_depth * sizeof(struct kv_list_walker));
+    if (iter == NULL) {
+        return -ENOMEM;
+    }
+
+    iter->desc = desc;
+    iter->ch = ch;
+    iter->iobuf = iobuf;
+    if (prefix_length > 0) {
+        memcpy(iter->prefix, prefix, prefix_length);
+    }
+    iter->prefix_len = prefix_length;
+    iter->buf_size = spdk_min(KV_LIST_ITER_DEFAULT_BUF_SIZE, iobuf->large.bufsize);
+    iter->depth = queue_depth;
+    iter->num_shards = num_shards;
+    iter->next_shard = first_shard;
+    iter->end_shard = first_shard + shard_count;
+    iter->check_prefix = num_shards > 1 && first_shard == 0 && prefix_length > 0;
+    iter->key_cb = key_cb;
+    iter->done_cb = done_cb;
+    iter->cb_arg = cb_arg;
+
+    for (i = 0; i < queue_depth; i++) {
+        walker = &iter->walkers[i];
+        walker->iter = iter;
+        walker->last = UINT8_MAX;
+        walker->buf = spdk_iobuf_get(iobuf, iter->buf_size, &walker->iobuf, kv_list_iter_iobuf_cb);
+        walker->buf_pending = walker->buf == NULL;
+    }
+
+    /* Fail synchronously only if nothing was submitted. Otherwise done_cb reports the error. */
+    kv_list_iter_pump(iter);
+    if (iter->stopping && iter->outstanding == 0) {
+        rc = iter->status;
+        kv_list_iter_free(iter);
+        return rc;
+    }
+
+    *_iter = iter;
+    return 0;
+}
+
+void spdk_bdev_kv_list_iter_close(struct spdk_bdev_kv_list_iter *iter) {
+    kv_list_iter_stop(iter, -ECANCELED);
+    /* When called from the key callback, the listing completion picks up the stop. */
+    if (!iter->delivering) {
+        kv_list_iter_continue(iter);
+    }
+}
+
+#define KV_MULTI_SELECT_DEFAULT_DEPTH    8
+#define KV_MULTI_SELECT_MAX_DEPTH        64
+
+struct kv_multi_select_key {
+    unsigned char key[NVME_KV_MAX_KEY_LENGTH];
+    size_t key_length;
+    TAILQ_ENTRY(kv_multi_select_key) link;
+};
+
+/* One key being queried. Its results are buffered until the cursor is done. */
+struct kv_multi_select_task {
+    struct spdk_bdev_kv_multi_select *ms;
+    struct spdk_bdev_kv_select_cursor *cursor;
+    unsigned char key[NVME_KV_MAX_KEY_LENGTH];
+    size_t key_length;
+    char *buf;
+    size_t len;
+    size_t cap;
+    bool closed;
+};
+
+struct kv_multi_select_acc {
+    double value;
+    bool has_value;
+};
+
+struct spdk_bdev_kv_multi_select {
+    struct spdk_bdev_desc *desc;
+    struct spdk_io_channel *ch;
+
+    char *query;
+    uint32_t query_len;
+    uint8_t options;
+    uint8_t input_type;
+    uint8_t output_type;
+    uint32_t chunk_size;
+    uint32_t chunk_depth;
+
+    enum spdk_bdev_kv_select_agg *aggs;
+    struct kv_multi_select_acc *acc;
+    uint32_t num_aggs;
+    /* CSV header line or JSON row of the first key, which names the merged columns. */
+    char *names;
+    size_t names_len;
+
+    TAILQ_HEAD(, kv_multi_select_key) pending;
+    struct spdk_bdev_kv_list_iter *iter;
+    bool listing;
+    bool iter_closed;
+    /* Keeps the select alive until open has returned, so done_cb is never called from it. */
+    bool kick_pending;
+
+    uint32_t depth;
+    uint32_t active;
+    uint64_t num_keys;
+    int status;
+
+    bool header_sent;
+    bool stopping;
+    bool delivering;
+    /* Set while kv_multi_select_continue() runs, which cursor callbacks can reenter. */
+    bool running;
+    bool rerun;
+
+    spdk_bdev_kv_multi_select_data_cb data_cb;
+    spdk_bdev_kv_multi_select_done_cb done_cb;
+    void *cb_arg;
+
+    struct kv_multi_select_task tasks[];
+};
+
+static void kv_multi_select_continue(struct spdk_bdev_kv_multi_select *ms);
+
+static void kv_multi_select_stop(struct spdk_bdev_kv_multi_select *ms, int status) {
+    if (!ms->stopping) {
+        ms->stopping = true;
+        ms->status = status;
+    }
+}
+
+static void kv_multi_select_free(struct spdk_bdev_kv_multi_select *ms) {
+    struct kv_multi_select_key *k;
+    uint32_t i;
+
+    while ((k = TAILQ_FIRST(&ms->pending)) != NULL) {
+        TAILQ_REMOVE(&ms->pending, k, link);
+        free(k);
+    }
+    for (i = 0; i < ms->depth; i++) {
+        free(ms->tasks[i].buf);
+    }
+    free(ms->aggs);
+    free(ms->acc);
+    free(ms->names);
+    free(ms->query);
+    free(ms);
+}
+
+static int kv_multi_select_queue_key(struct spdk_bdev_kv_multi_select *ms,
+                   const unsigned char *key, size_t key_length) {
+    struct kv_multi_select_key *k;
+
+    k = calloc(1, sizeof(*k));
+    if (k == NULL) {
+        return -ENOMEM;
+    }
+    memcpy(k->key, key, key_length);
+    k->key_length = key_length;
+    TAILQ_INSERT_TAIL(&ms->pending, k, link);
+    return 0;
+}
+
+static int kv_multi_select_deliver(struct spdk_bdev_kv_multi_select *ms, const unsigned char *key,
+                   size_t key_length, const char *buf, size_t len) {
+    int rc;
+
+    if (len == 0) {
+        return 0;
+    }
+    ms->delivering = true;
+    rc = ms->data_cb(ms->cb_arg, key, key_length, buf, len);
+    ms->delivering = false;
+    return rc;
+}
+
+/* Returns the offset just past the first line of buf, or len if it has no line break. */
+static size_t kv_multi_select_skip_line(const char *buf, size_t len) {
+    const char *nl = memchr(buf, '\n', len);
+
+    return nl != NULL ? (size_t)(nl - buf) + 1 : len;
+}
+
+/*
+ * Parse one aggregate value. An empty CSV field or a JSON null means the
+ * aggregate saw no values on that key.
+ */
+static int kv_multi_select_parse_value(const char *s, size_t len, double *value, bool *has_value) {
+    char tmp[64];
+    char *end;
+
+    while (len > 0 && isspace((unsigned char)*s)) {
+        s++;
+        len--;
+    }
+    while (len > 0 && isspace((unsigned char)s[len - 1])) {
+        len--;
+    }
+    if (len == 0 || (len == 4 && memcmp(s, "null", 4) == 0)) {
+        *has_value = false;
+        return 0;
+    }
+    if (len >= sizeof(tmp)) {
+        return -EBADMSG;
+    }
+    memcpy(tmp, s, len);
+    tmp[len] = '\0';
+    *value = strtod(tmp, &end);
+    if (end != tmp + len) {
+        return -EBADMSG;
+    }
+    *has_value = true;
+    return 0;
+}
+
+static void kv_multi_select_accumulate(struct spdk_bdev_kv_multi_select *ms, uint32_t i,
+                   double value) {
+    struct kv_multi_select_acc *acc = &ms->acc[i];
+
+    if (!acc->has_value) {
+        acc->value = value;
+        acc->has_value = true;
+        return;
+    }
+    switch (ms->aggs[i]) {
+    case SPDK_BDEV_KV_SELECT_AGG_COUNT:
+    case SPDK_BDEV_KV_SELECT_AGG_SUM:
+        acc->value += value;
+        break;
+    case SPDK_BDEV_KV_SELECT_AGG_MIN:
+        acc->value = spdk_min(acc->value, value);
+        break;
+    case SPDK_BDEV_KV_SELECT_AGG_MAX:
+        acc->value = spdk_max(acc->value, value);
+        break;
+    }
+}
+
+/*
+ * Fold the single row of partial aggregates returned for one key into the
+ * accumulators. A CSV row is a list of fields, a JSON row an object with one
+ * member per aggregate, in the order of the query.
+ */
+static int kv_multi_select_merge(struct spdk_bdev_kv_multi_select *ms, const char *buf, size_t len) {
+    const char *p, *end, *field;
+    uint32_t i;
+    double value;
+    bool has_value, more = true;
+    int rc;
+
+    p = buf;
+    end = buf + len;
+    if (ms->output_type == NVME_KV_SELECT_TYPE_CSV &&
+        (ms->options & NVME_KV_SELECT_CMD_OUTPUT_TYPE_USE_CSV_HEADERS_OUTPUT)) {
+        p += kv_multi_select_skip_line(p, len);
+    }
+    while (end > p && (end[-1] == '\n' || end[-1] == '\r')) {
+        end--;
+    }
+
+    if (ms->output_type == NVME_KV_SELECT_TYPE_JSON) {
+        if (end - p < 2 || *p != '{' || end[-1] != '}') {
+            return -EBADMSG;
+        }
+        p++;
+        end--;
+    }
+
+    for (i = 0; i < ms->num_aggs; i++) {
+        if (!more) {
+            return -EBADMSG;
+        }
+        if (ms->output_type == NVME_KV_SELECT_TYPE_JSON) {
+            /* Member names are generated by the device and never contain a colon. */
+            p = memchr(p, ':', end - p);
+            if (p == NULL) {
+                return -EBADMSG;
+            }
+            p++;
+        }
+        field = p;
+        while (p < end && *p != ',') {
+            p++;
+        }
+        rc = kv_multi_select_parse_value(field, p - field, &value, &has_value);
+        if (rc != 0) {
+            return rc;
+        }
+        if (has_value) {
+            kv_multi_select_accumulate(ms, i, value);
+        }
+        more = p < end;
+        if (more) {
+            p++;
+        }
+    }
+    /* A row with more fields than aggregates does not match the query. */
+    return more ? -EBADMSG : 0;
+}
+
+/* Keep the column names of the first row, so that aliases in the query survive the merge. */
+static int kv_multi_select_save_names(struct spdk_bdev_kv_multi_select *ms, const char *buf,
+                   size_t len) {
+    if (ms->names != NULL || len == 0) {
+        return 0;
+    }
+    if (ms->output_type == NVME_KV_SELECT_TYPE_CSV) {
+        if (!(ms->options & NVME_KV_SELECT_CMD_OUTPUT_TYPE_USE_CSV_HEADERS_OUTPUT)) {
+            return 0;
+        }
+        len = kv_multi_select_skip_line(buf, len);
+    }
+    ms->names = malloc(len);
+    if (ms->names == NULL) {
+        return -ENOMEM;
+    }
+    memcpy(ms->names, buf, len);
+    ms->names_len = len;
+    return 0;
+}
+
+static int kv_multi_select_finalize(struct spdk_bdev_kv_multi_select *ms) {
+    const char *name = ms->names, *names_end = NULL, *sep;
+    char *row, num[64];
+    size_t len = 0, cap;
+    uint32_t i;
+    double v;
+    int rc;
+
+    /* Each column takes at most a name, a separator and a number. */
+    cap = (size_t)ms->num_aggs * (2 * 16 + 8 + sizeof(num)) + ms->names_len + 8;
+    row = malloc(cap);
+    if (row == NULL) {
+        return -ENOMEM;
+    }
+    if (name != NULL) {
+        names_end = name + ms->names_len;
+    }
+
+    if (ms->output_type == NVME_KV_SELECT_TYPE_CSV &&
+        (ms->options & NVME_KV_SELECT_CMD_OUTPUT_TYPE_USE_CSV_HEADERS_OUTPUT)) {
+        if (name != NULL) {
+            memcpy(row, name, ms->names_len);
+            len = ms->names_len;
+            if (row[len - 1] != '\n') {
+                row[len++] = '\n';
+            }
+        } else {
+            /* No key returned a header to take the names from. */
+            for (i = 0; i < ms->num_aggs; i++) {
+                len += snprintf(row + len, cap - len, "%s_%u", i > 0 ? "," : "", i + 1);
+            }
+            len += snprintf(row + len, cap - len, "\n");
+        }
+    }
+
+    for (i = 0; i < ms->num_aggs; i++) {
+        if (ms->output_type == NVME_KV_SELECT_TYPE_JSON) {
+            /* Copy the member name along with the brace or comma before it. */
+            sep = name != NULL ? memchr(name, ':', names_end - name) : NULL;
+            if (sep != NULL) {
+                memcpy(row + len, name, sep + 1 - name);
+                len += sep + 1 - name;
+                name = sep + 1;
+                while (name < names_end && *name != ',') {
+                    name++;
+                }
+            } else {
+                name = NULL;
+                len += snprintf(row + len, cap - len, "%s\"_%u\":", i > 0 ? "," : "{", i + 1);
+            }
+        } else if (i > 0) {
+            len += snprintf(row + len, cap - len, ",");
+        }
+
+        if (ms->aggs[i] == SPDK_BDEV_KV_SELECT_AGG_COUNT && !ms->acc[i].has_value) {
+            /* No keys were queried. */
+            snprintf(num, sizeof(num), "0");
+        } else if (!ms->acc[i].has_value) {
+            snprintf(num, sizeof(num), "%s",
+                     ms->output_type == NVME_KV_SELECT_TYPE_JSON ? "null" : "");
+        } else {
+            /* Same formatting as the device uses for aggregates. */
+            v = ms->acc[i].value;
+            if (v > -1e15 && v < 1e15 && v == (double)(int64_t)v) {
+                snprintf(num, sizeof(num), "%" PRId64, (int64_t)v);
+            } else {
+                snprintf(num, sizeof(num), "%.17g", v);
+            }
+        }
+        len += snprintf(row + len, cap - len, "%s", num);
+    }
+    len += snprintf(row + len, cap - len,
+                    ms->output_type == NVME_KV_SELECT_TYPE_JSON ? "}\n" : "\n");
+
+    rc = kv_multi_select_deliver(ms, NULL, 0, row, len);
+    free(row);
+    return rc;
+}
+
+/* Hand the complete results of one key to the caller, or fold them into the aggregates. */
+static int kv_multi_select_complete_task(struct kv_multi_select_task *task) {
+    struct spdk_bdev_kv_multi_select *ms = task->ms;
+    size_t skip = 0;
+    int rc;
+
+    ms->num_keys++;
+    if (ms->num_aggs > 0) {
+        rc = kv_multi_select_merge(ms, task->buf, task->len);
+        if (rc != 0) {
+            return rc;
+        }
+        return kv_multi_select_save_names(ms, task->buf, task->len);
+    }
+
+    if (task->len == 0) {
+        return 0;
+    }
+    /* Rows of one key must not run into the first row of the next. */
+    if (task->buf[task->len - 1] != '\n') {
+        task->buf[task->len++] = '\n';
+    }
+    /* Only the first key to return rows keeps its CSV header line. */
+    if (ms->output_type == NVME_KV_SELECT_TYPE_CSV &&
+        (ms->options & NVME_KV_SELECT_CMD_OUTPUT_TYPE_USE_CSV_HEADERS_OUTPUT)) {
+        if (ms->header_sent) {
+            skip = kv_multi_select_skip_line(task->buf, task->len);
+        }
+        ms->header_sent = true;
+    }
+    return kv_multi_select_deliver(ms, task->key, task->key_length, task->buf + skip,
+                                   task->len - skip);
+}
+
+static int kv_multi_select_chunk_cb(void *cb_arg, const void *buf, uint32_t len, uint64_t offset) {
+    struct kv_multi_select_task *task = cb_arg;
+    size_t cap;
+    char *tmp;
+
+    if (task->ms->stopping) {
+        return -ECANCELED;
+    }
+    /* Keep a spare byte to terminate the last row. */
+    if (task->len + len + 1 > task->cap) {
+        cap = spdk_max(task->cap * 2, task->len + len + 1);
+        tmp = realloc(task->buf, cap);
+        if (tmp == NULL) {
+            return -ENOMEM;
+        }
+        task->buf = tmp;
+        task->cap = cap;
+    }
+    memcpy(task->buf + task->len, buf, len);
+    task->len += len;
+    return 0;
+}
+
+static void kv_multi_select_done_cb(void *cb_arg, int status, uint64_t total_len) {
+    struct kv_multi_select_task *task = cb_arg;
+    struct spdk_bdev_kv_multi_select *ms = task->ms;
+    int rc;
+
+    task->cursor = NULL;
+    ms->active--;
+
+    if (status != 0) {
+        kv_multi_select_stop(ms, status);
+    } else if (!ms->stopping) {
+        rc = kv_multi_select_complete_task(task);
+        if (rc != 0) {
+            kv_multi_select_stop(ms, rc);
+        }
+    }
+    task->len = 0;
+    kv_multi_select_continue(ms);
+}
+
+static int kv_multi_select_list_key_cb(void *cb_arg, const unsigned char *key, size_t key_length) {
+    struct spdk_bdev_kv_multi_select *ms = cb_arg;
+    int rc;
+
+    if (ms->stopping) {
+        return -ECANCELED;
+    }
+    rc = kv_multi_select_queue_key(ms, key, key_length);
+    if (rc == 0) {
+        kv_multi_select_continue(ms);
+    }
+    return rc;
+}
+
+static void kv_multi_select_list_done_cb(void *cb_arg, int status, uint64_t num_keys) {
+    struct spdk_bdev_kv_multi_select *ms = cb_arg;
+
+    ms->iter = NULL;
+    ms->listing = false;
+    if (status != 0) {
+        kv_multi_select_stop(ms, status);
+    }
+    kv_multi_select_continue(ms);
+}
+
+static void kv_multi_select_start(struct spdk_bdev_kv_multi_select *ms) {
+    struct kv_multi_select_task *task;
+    struct kv_multi_select_key *k;
+    uint32_t i;
+    int rc;
+
+    for (i = 0; i < ms->depth && !ms->stopping; i++) {
+        task = &ms->tasks[i];
+        if (task->cursor != NULL) {
+            continue;
+        }
+        k = TAILQ_FIRST(&ms->pending);
+        if (k == NULL) {
+            break;
+        }
+        TAILQ_REMOVE(&ms->pending, k, link);
+        memcpy(task->key, k->key, k->key_length);
+        task->key_length = k->key_length;
+        free(k);
+
+        task->closed = false;
+        rc = spdk_bdev_kv_select_cursor_open(ms->desc, ms->ch, task->key, task->key_length,
+                                             ms->query, ms->query_len, ms->options,
+                                             ms->input_type, ms->output_type,
+                                             ms->chunk_size, ms->chunk_depth,
+                                             kv_multi_select_chunk_cb, kv_multi_select_done_cb,
+                                             task, &task->cursor);
+        if (rc != 0) {
+            task->cursor = NULL;
+            kv_multi_select_stop(ms, rc);
+            break;
+        }
+        ms->active++;
+    }
+}
+
+static void kv_multi_select_continue(struct spdk_bdev_kv_multi_select *ms) {
+    struct kv_multi_select_task *task;
+    uint32_t i;
+    int rc;
+
+    if (ms->running) {
+        ms->rerun = true;
+        return;
+    }
+    ms->running = true;
+
+    do {
+        ms->rerun = false;
+
+        if (!ms->stopping) {
+            kv_multi_select_start(ms);
+        }
+        if (!ms->stopping) {
+            continue;
+        }
+
+        /* Closing a cursor or the iterator may complete it before the call returns. */
+        for (i = 0; i < ms->depth; i++) {
+            task = &ms->tasks[i];
+            if (task->cursor != NULL && !task->closed) {
+                task->closed = true;
+                spdk_bdev_kv_select_cursor_close(task->cursor);
+            }
+        }
+        if (ms->iter != NULL && !ms->iter_closed) {
+            ms->iter_closed = true;
+            spdk_bdev_kv_list_iter_close(ms->iter);
+        }
+    } while (ms->rerun);
+
+    ms->running = false;
+
+    if (ms->kick_pending || ms->active > 0 || ms->listing ||
+        (!ms->stopping && !TAILQ_EMPTY(&ms->pending))) {
+        return;
+    }
+
+    if (!ms->stopping && ms->num_aggs > 0) {
+        rc = kv_multi_select_finalize(ms);
+        if (rc != 0) {
+            kv_multi_select_stop(ms, rc);
+        }
+    }
+    ms->done_cb(ms->cb_arg, ms->status, ms->num_keys);
+    kv_multi_select_free(ms);
+}
+
+static void kv_multi_select_kick(void *arg) {
+    struct spdk_bdev_kv_multi_select *ms = arg;
+
+    ms->kick_pending = false;
+    kv_multi_select_continue(ms);
+}
+
+int spdk_bdev_kv_multi_select_open(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+                   const struct spdk_bdev_kv_multi_select_opts *opts,
+                   spdk_bdev_kv_multi_select_data_cb data_cb,
+                   spdk_bdev_kv_multi_select_done_cb done_cb, void *cb_arg,
+                   struct spdk_bdev_kv_multi_select **_ms) {
+    struct spdk_bdev_kv_multi_select *ms;
+    uint32_t depth, i;
+    int rc;
+
+    if (opts == NULL || opts->query == NULL || opts->query_len == 0 ||
+        data_cb == NULL || done_cb == NULL ||
+        (opts->keys == NULL && opts->prefix_length > NVME_KV_MAX_KEY_LENGTH) ||
+        (opts->num_aggs > 0 && opts->aggs == NULL)) {
+        return -EINVAL;
+    }
+    for (i = 0; opts->keys != NULL && i < opts->num_keys; i++) {
+        if (opts->key_lengths[i] == 0 || opts->key_lengths[i] > NVME_KV_MAX_KEY_LENGTH) {
+            return -EINVAL;
+        }
+    }
+    for (i = 0; i < opts->num_aggs; i++) {
+        if (opts->aggs[i] > SPDK_BDEV_KV_SELECT_AGG_MAX) {
+            return -EINVAL;
+        }
+    }
+
+    depth = opts->queue_depth != 0 ? opts->queue_depth : KV_MULTI_SELECT_DEFAULT_DEPTH;
+    if (depth > KV_MULTI_SELECT_MAX_DEPTH) {
+        return -EINVAL;
+    }
+
+    ms = calloc(1, sizeof(*ms) + depth * sizeof(struct kv_multi_select_task));
+    if (ms == NULL) {
+        return -ENOMEM;
+    }
+    TAILQ_INIT(&ms->pending);
+    ms->query = malloc(opts->query_len);
+    if (ms->query == NULL) {
+        goto nomem;
+    }
+    if (opts->num_aggs > 0) {
+        ms->aggs = calloc(opts->num_aggs, sizeof(*ms->aggs));
+        ms->acc = calloc(opts->num_aggs, sizeof(*ms->acc));
+        if (ms->aggs == NULL || ms->acc == NULL) {
+            goto nomem;
+        }
+        memcpy(ms->aggs, opts->aggs, opts->num_aggs * sizeof(*ms->aggs));
+        ms->num_aggs = opts->num_aggs;
+    }
+    for (i = 0; opts->keys != NULL && i < opts->num_keys; i++) {
+        if (kv_multi_select_queue_key(ms, opts->keys[i], opts->key_lengths[i]) != 0) {
+            goto nomem;
+        }
+    }
+
+    ms->desc = desc;
+    ms->ch = ch;
+    memcpy(ms->query, opts->query, opts->query_len);
+    ms->query_len = opts->query_len;
+    ms->options = opts->options;
+    ms->input_type = opts->input_type;
+    ms->output_type = opts->output_type;
+    ms->chunk_size = opts->chunk_size;
+    ms->chunk_depth = opts->chunk_depth;
+    ms->depth = depth;
+    ms->data_cb = data_cb;
+    ms->done_cb = done_cb;
+    ms->cb_arg = cb_arg;
+    for (i = 0; i < depth; i++) {
+        ms->tasks[i].ms = ms;
+    }
+
+    /*
+     * Everything after this point is reported through done_cb, which the kick
+     * defers until open has returned, even for an empty key list.
+     */
+    rc = spdk_thread_send_msg(spdk_get_thread(), kv_multi_select_kick, ms);
+    if (rc != 0) {
+        kv_multi_select_free(ms);
+        return rc;
+    }
+    ms->kick_pending = true;
+
+    if (opts->keys == NULL) {
+        /* The listing feeds the pending queue while earlier keys are being queried. */
+        ms->listing = true;
+        rc = spdk_bdev_kv_list_iter_open(desc, ch, opts->prefix, opts->prefix_length,
+                                         0, 0, 0, 0,
+                                         kv_multi_select_list_key_cb,
+                                         kv_multi_select_list_done_cb, ms, &ms->iter);
+        if (rc != 0) {
+            ms->listing = false;
+            kv_multi_select_stop(ms, rc);
+        }
+    } else {
+        kv_multi_select_start(ms);
+    }
+
+    *_ms = ms;
+    return 0;
+
+nomem:
+    kv_multi_select_free(ms);
+    return -ENOMEM;
+}
+
+void spdk_bdev_kv_multi_select_close(struct spdk_bdev_kv_multi_select *ms) {
+    kv_multi_select_stop(ms, -ECANCELED);
+    /* When called from the data callback, the completion that delivered the data picks up the stop. */
+    if (!ms->delivering) {
+        kv_multi_select_continue(ms);
+    }
+}
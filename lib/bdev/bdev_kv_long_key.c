@@ -0,0 +1,740 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+/*
+ * Long KV keys on top of the 16 byte device keys.
+ *
+ * A key is stored under a 16 byte device key made of its 128 bit MurmurHash3.
+ * The value on the device starts with a header holding the whole key, which is
+ * compared on every access, so keys that hash to the same device key are told
+ * apart. When the device key is taken by another key, the hash seeded with the
+ * next probe number is tried, up to KV_LONG_KEY_MAX_PROBES device keys per key.
+ *
+ * Deleting a key whose next device key is in use leaves a tombstone header in
+ * place, so lookups of keys further down the probe sequence do not stop early.
+ * Stores reuse the first tombstone they find.
+ */
+
+#include "spdk/stdinc.h"
+
+#include "spdk/bdev.h"
+#include "spdk/bdev_module.h"
+#include "spdk/endian.h"
+#include "spdk/env.h"
+#include "spdk/nvme_spec.h"
+#include "spdk/util.h"
+
+#include "spdk/log.h"
+
+#define KV_LONG_KEY_MAGIC		0x4c4b4559	/* "LKEY" */
+#define KV_LONG_KEY_MAX_PROBES		4
+#define KV_LONG_KEY_FLAG_TOMBSTONE	0x01
+#define KV_LONG_KEY_LIST_BUF_SIZE	(64 * 1024)
+
+struct kv_long_key_hdr {
+	uint32_t	magic;
+	uint16_t	key_len;
+	uint8_t		flags;
+	uint8_t		reserved;
+	uint8_t		key[];
+};
+SPDK_STATIC_ASSERT(sizeof(struct kv_long_key_hdr) == 8, "Incorrect size");
+
+enum kv_long_key_step {
+	/* Read the header at the current probe. */
+	KV_LONG_KEY_PROBE,
+	/* Read the header and the value at the current probe together. */
+	KV_LONG_KEY_READ,
+	/* Read the value past the header. */
+	KV_LONG_KEY_READ_DATA,
+	KV_LONG_KEY_WRITE,
+	/* Check whether the device key of the next probe is in use. */
+	KV_LONG_KEY_CHECK_NEXT,
+	KV_LONG_KEY_TOMBSTONE,
+	KV_LONG_KEY_DELETE,
+};
+
+struct kv_long_key_op {
+	struct spdk_bdev_desc		*desc;
+	struct spdk_io_channel		*ch;
+	enum spdk_bdev_io_type		type;
+	enum kv_long_key_step		step;
+	uint32_t			probe;
+	/* First probe that holds a tombstone, or -1. */
+	int32_t				tombstone;
+	uint8_t				options;
+	uint8_t				write_options;
+	uint8_t				dev_key[NVME_KV_MAX_KEY_LENGTH];
+	uint64_t			offset;
+	uint64_t			nbytes;
+	spdk_bdev_kv_long_key_cb	cb;
+	void				*cb_arg;
+	struct spdk_bdev_io_wait_entry	bdev_io_wait;
+
+	/* Header with the key, written in front of stored values. */
+	struct kv_long_key_hdr		*hdr;
+	/* Header read from the device. */
+	struct kv_long_key_hdr		*dev_hdr;
+
+	struct iovec			*iovs;
+	int				iovcnt;
+	/* The header followed by iovs. */
+	struct iovec			io_iovs[];
+};
+
+static inline uint64_t
+kv_long_key_rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+/* MurmurHash3_x64_128 of the key, seeded with the probe number. */
+static void
+kv_long_key_hash(const uint8_t *key, size_t len, uint32_t probe,
+		 uint8_t dev_key[NVME_KV_MAX_KEY_LENGTH])
+{
+	const uint64_t c1 = 0x87c37b91114253d5ULL;
+	const uint64_t c2 = 0x4cf5ad432745937fULL;
+	const uint8_t *tail = key + (len & ~(size_t)15);
+	size_t rem = len & 15, i;
+	uint64_t h1 = probe, h2 = probe, k1, k2;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		k1 = from_le64(key + i);
+		k2 = from_le64(key + i + 8);
+
+		k1 *= c1;
+		k1 = kv_long_key_rotl64(k1, 31);
+		k1 *= c2;
+		h1 ^= k1;
+		h1 = kv_long_key_rotl64(h1, 27);
+		h1 += h2;
+		h1 = h1 * 5 + 0x52dce729;
+
+		k2 *= c2;
+		k2 = kv_long_key_rotl64(k2, 33);
+		k2 *= c1;
+		h2 ^= k2;
+		h2 = kv_long_key_rotl64(h2, 31);
+		h2 += h1;
+		h2 = h2 * 5 + 0x38495ab5;
+	}
+
+	k1 = 0;
+	k2 = 0;
+	for (i = rem; i > 8; i--) {
+		k2 ^= (uint64_t)tail[i - 1] << ((i - 9) * 8);
+	}
+	if (rem > 8) {
+		k2 *= c2;
+		k2 = kv_long_key_rotl64(k2, 33);
+		k2 *= c1;
+		h2 ^= k2;
+	}
+	for (i = spdk_min(rem, 8); i > 0; i--) {
+		k1 ^= (uint64_t)tail[i - 1] << ((i - 1) * 8);
+	}
+	if (rem > 0) {
+		k1 *= c1;
+		k1 = kv_long_key_rotl64(k1, 31);
+		k1 *= c2;
+		h1 ^= k1;
+	}
+
+	h1 ^= len;
+	h2 ^= len;
+	h1 += h2;
+	h2 += h1;
+	h1 = spdk_bdev_kv_fmix64(h1);
+	h2 = spdk_bdev_kv_fmix64(h2);
+	h1 += h2;
+	h2 += h1;
+
+	to_be64(&dev_key[0], h1);
+	to_be64(&dev_key[8], h2);
+}
+
+static inline uint32_t
+kv_long_key_hdr_len(uint16_t key_len)
+{
+	return sizeof(struct kv_long_key_hdr) + key_len;
+}
+
+static void
+kv_long_key_complete(struct kv_long_key_op *op, uint32_t cdw0, int sct, int sc)
+{
+	op->cb(op->cb_arg, cdw0, sct, sc);
+	spdk_dma_free(op->hdr);
+	free(op);
+}
+
+static void kv_long_key_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg);
+
+static int
+kv_long_key_submit(struct kv_long_key_op *op)
+{
+	uint32_t hdr_len = kv_long_key_hdr_len(op->hdr->key_len);
+	uint32_t probe = op->probe;
+
+	if (op->step == KV_LONG_KEY_CHECK_NEXT) {
+		probe++;
+	}
+	kv_long_key_hash(op->hdr->key, op->hdr->key_len, probe, op->dev_key);
+
+	op->io_iovs[0].iov_len = hdr_len;
+	if (op->iovcnt > 0) {
+		memcpy(&op->io_iovs[1], op->iovs, op->iovcnt * sizeof(*op->iovs));
+	}
+
+	switch (op->step) {
+	case KV_LONG_KEY_PROBE:
+		return spdk_bdev_kv_retrieve(op->desc, op->ch, op->dev_key, sizeof(op->dev_key),
+					     op->dev_hdr, 0, hdr_len, kv_long_key_done, op);
+	case KV_LONG_KEY_READ:
+		op->io_iovs[0].iov_base = op->dev_hdr;
+		return spdk_bdev_kv_retrievev(op->desc, op->ch, op->dev_key, sizeof(op->dev_key),
+					      op->io_iovs, op->iovcnt + 1, 0, hdr_len + op->nbytes,
+					      kv_long_key_done, op);
+	case KV_LONG_KEY_READ_DATA:
+		return spdk_bdev_kv_retrievev(op->desc, op->ch, op->dev_key, sizeof(op->dev_key),
+					      op->iovs, op->iovcnt, hdr_len + op->offset, op->nbytes,
+					      kv_long_key_done, op);
+	case KV_LONG_KEY_WRITE:
+		if (op->write_options & NVME_KV_STORE_CMD_OPTION_APPEND) {
+			return spdk_bdev_kv_storev(op->desc, op->ch, op->dev_key, sizeof(op->dev_key),
+						   op->iovs, op->iovcnt, op->nbytes, op->write_options,
+						   kv_long_key_done, op);
+		}
+		op->io_iovs[0].iov_base = op->hdr;
+		return spdk_bdev_kv_storev(op->desc, op->ch, op->dev_key, sizeof(op->dev_key),
+					   op->io_iovs, op->iovcnt + 1, hdr_len + op->nbytes,
+					   op->write_options, kv_long_key_done, op);
+	case KV_LONG_KEY_CHECK_NEXT:
+		return spdk_bdev_kv_exist(op->desc, op->ch, op->dev_key, sizeof(op->dev_key),
+					  kv_long_key_done, op);
+	case KV_LONG_KEY_TOMBSTONE:
+		memset(op->dev_hdr, 0, sizeof(*op->dev_hdr));
+		op->dev_hdr->magic = KV_LONG_KEY_MAGIC;
+		op->dev_hdr->flags = KV_LONG_KEY_FLAG_TOMBSTONE;
+		return spdk_bdev_kv_store(op->desc, op->ch, op->dev_key, sizeof(op->dev_key),
+					  op->dev_hdr, sizeof(*op->dev_hdr), 0, kv_long_key_done, op);
+	case KV_LONG_KEY_DELETE:
+		return spdk_bdev_kv_delete(op->desc, op->ch, op->dev_key, sizeof(op->dev_key),
+					   kv_long_key_done, op);
+	default:
+		assert(false);
+		return -EINVAL;
+	}
+}
+
+static void
+kv_long_key_resubmit(void *arg)
+{
+	struct kv_long_key_op *op = arg;
+	int rc;
+
+	rc = kv_long_key_submit(op);
+	if (rc == -ENOMEM) {
+		op->bdev_io_wait.bdev = spdk_bdev_desc_get_bdev(op->desc);
+		op->bdev_io_wait.cb_fn = kv_long_key_resubmit;
+		op->bdev_io_wait.cb_arg = op;
+		rc = spdk_bdev_queue_io_wait(op->bdev_io_wait.bdev, op->ch, &op->bdev_io_wait);
+	}
+	if (rc != 0) {
+		SPDK_ERRLOG("Failed to submit long key request: %d\n", rc);
+		kv_long_key_complete(op, 0, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+	}
+}
+
+static void
+kv_long_key_next(struct kv_long_key_op *op, enum kv_long_key_step step)
+{
+	op->step = step;
+	kv_long_key_resubmit(op);
+}
+
+/* The key was not found at any probe up to and including the current one. */
+static void
+kv_long_key_not_found(struct kv_long_key_op *op, bool slot_free)
+{
+	if (op->type != SPDK_BDEV_IO_KV_STORE ||
+	    (op->options & NVME_KV_STORE_CMD_OPTION_MUST_EXIST)) {
+		kv_long_key_complete(op, 0, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+		return;
+	}
+
+	op->write_options = op->options & NVME_KV_STORE_CMD_OPTION_NOT_COMPRESS;
+	if (op->tombstone >= 0) {
+		op->probe = op->tombstone;
+	} else if (slot_free) {
+		/* Fails if another key claims the device key first. */
+		op->write_options |= NVME_KV_STORE_CMD_OPTION_MUST_NOT_EXIST;
+	} else {
+		kv_long_key_complete(op, 0, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_CAPACITY_EXCEEDED);
+		return;
+	}
+
+	kv_long_key_next(op, KV_LONG_KEY_WRITE);
+}
+
+/* The current probe holds the key. value_len is the length of the value on the device. */
+static void
+kv_long_key_found(struct kv_long_key_op *op, uint32_t value_len)
+{
+	uint32_t hdr_len = kv_long_key_hdr_len(op->hdr->key_len);
+
+	switch (op->type) {
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+		if (op->step == KV_LONG_KEY_READ) {
+			kv_long_key_complete(op, value_len - hdr_len, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_SUCCESS);
+		} else {
+			kv_long_key_next(op, KV_LONG_KEY_READ_DATA);
+		}
+		break;
+	case SPDK_BDEV_IO_KV_EXIST:
+		kv_long_key_complete(op, 0, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_SUCCESS);
+		break;
+	case SPDK_BDEV_IO_KV_DELETE:
+		if (op->probe + 1 < KV_LONG_KEY_MAX_PROBES) {
+			kv_long_key_next(op, KV_LONG_KEY_CHECK_NEXT);
+		} else {
+			kv_long_key_next(op, KV_LONG_KEY_DELETE);
+		}
+		break;
+	case SPDK_BDEV_IO_KV_STORE:
+		if (op->options & NVME_KV_STORE_CMD_OPTION_MUST_NOT_EXIST) {
+			kv_long_key_complete(op, 0, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_KEY_EXISTS);
+			break;
+		}
+		op->write_options = op->options & (NVME_KV_STORE_CMD_OPTION_NOT_COMPRESS |
+						   NVME_KV_STORE_CMD_OPTION_APPEND);
+		kv_long_key_next(op, KV_LONG_KEY_WRITE);
+		break;
+	default:
+		assert(false);
+		break;
+	}
+}
+
+static void
+kv_long_key_probe_done(struct kv_long_key_op *op, uint32_t value_len)
+{
+	struct kv_long_key_hdr *dev_hdr = op->dev_hdr;
+	uint32_t hdr_len = kv_long_key_hdr_len(op->hdr->key_len);
+
+	/* Values not written through this file are skipped like those of other keys. */
+	if (value_len >= sizeof(*dev_hdr) && dev_hdr->magic == KV_LONG_KEY_MAGIC) {
+		if (dev_hdr->flags & KV_LONG_KEY_FLAG_TOMBSTONE) {
+			if (op->tombstone < 0) {
+				op->tombstone = op->probe;
+			}
+		} else if (dev_hdr->key_len == op->hdr->key_len && value_len >= hdr_len &&
+			   memcmp(dev_hdr->key, op->hdr->key, dev_hdr->key_len) == 0) {
+			kv_long_key_found(op, value_len);
+			return;
+		}
+	}
+
+	if (++op->probe == KV_LONG_KEY_MAX_PROBES) {
+		kv_long_key_not_found(op, false);
+		return;
+	}
+	kv_long_key_next(op, op->step);
+}
+
+static void
+kv_long_key_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct kv_long_key_op *op = cb_arg;
+	uint32_t cdw0, hdr_len;
+	int sct, sc;
+	bool not_exist;
+
+	spdk_bdev_io_get_nvme_status(bdev_io, &cdw0, &sct, &sc);
+	spdk_bdev_free_io(bdev_io);
+
+	not_exist = sct == SPDK_NVME_SCT_GENERIC && sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST;
+	if (!success && !not_exist &&
+	    !(op->step == KV_LONG_KEY_WRITE && sct == SPDK_NVME_SCT_GENERIC &&
+	      sc == SPDK_NVME_SC_KEY_EXISTS)) {
+		kv_long_key_complete(op, cdw0, sct, sc);
+		return;
+	}
+
+	switch (op->step) {
+	case KV_LONG_KEY_PROBE:
+	case KV_LONG_KEY_READ:
+		if (not_exist) {
+			kv_long_key_not_found(op, true);
+		} else {
+			kv_long_key_probe_done(op, cdw0);
+		}
+		break;
+	case KV_LONG_KEY_READ_DATA:
+		/* The key may have been deleted or replaced since it was found. */
+		hdr_len = kv_long_key_hdr_len(op->hdr->key_len);
+		kv_long_key_complete(op, cdw0 > hdr_len ? cdw0 - hdr_len : 0, sct, sc);
+		break;
+	case KV_LONG_KEY_WRITE:
+		if (!success) {
+			/* Another key took the device key, or the key changed in the meantime. */
+			op->probe = 0;
+			op->tombstone = -1;
+			kv_long_key_next(op, KV_LONG_KEY_PROBE);
+		} else {
+			kv_long_key_complete(op, 0, sct, sc);
+		}
+		break;
+	case KV_LONG_KEY_CHECK_NEXT:
+		kv_long_key_next(op, not_exist ? KV_LONG_KEY_DELETE : KV_LONG_KEY_TOMBSTONE);
+		break;
+	case KV_LONG_KEY_TOMBSTONE:
+	case KV_LONG_KEY_DELETE:
+		kv_long_key_complete(op, 0, sct, sc);
+		break;
+	default:
+		assert(false);
+		break;
+	}
+}
+
+static int
+kv_long_key_start(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+		  enum spdk_bdev_io_type type, const unsigned char *key, size_t key_length,
+		  struct iovec *iov, int iovcnt, uint64_t offset, uint64_t nbytes, uint8_t options,
+		  spdk_bdev_kv_long_key_cb cb, void *cb_arg)
+{
+	struct spdk_bdev *bdev = spdk_bdev_desc_get_bdev(desc);
+	struct kv_long_key_op *op;
+	uint32_t hdr_size;
+	int rc;
+
+	if (key_length == 0 || key_length > SPDK_BDEV_KV_LONG_KEY_MAX_LENGTH || iovcnt < 0) {
+		return -EINVAL;
+	}
+
+	/* The header and the value are sent to the device as one value. */
+	if (nbytes > UINT32_MAX - kv_long_key_hdr_len(key_length)) {
+		return -EINVAL;
+	}
+
+	op = calloc(1, sizeof(*op) + (iovcnt + 1) * sizeof(struct iovec));
+	if (op == NULL) {
+		return -ENOMEM;
+	}
+
+	hdr_size = SPDK_ALIGN_CEIL(kv_long_key_hdr_len(key_length), 64);
+	op->hdr = spdk_dma_zmalloc(2 * hdr_size, spdk_bdev_get_buf_align(bdev), NULL);
+	if (op->hdr == NULL) {
+		free(op);
+		return -ENOMEM;
+	}
+	op->dev_hdr = (struct kv_long_key_hdr *)((uint8_t *)op->hdr + hdr_size);
+
+	op->hdr->magic = KV_LONG_KEY_MAGIC;
+	op->hdr->key_len = key_length;
+	memcpy(op->hdr->key, key, key_length);
+
+	op->desc = desc;
+	op->ch = ch;
+	op->type = type;
+	op->tombstone = -1;
+	op->options = options;
+	op->offset = offset;
+	op->nbytes = nbytes;
+	op->iovs = iov;
+	op->iovcnt = iovcnt;
+	op->cb = cb;
+	op->cb_arg = cb_arg;
+
+	/* A retrieve from the start of the value reads it along with the header. */
+	if (type == SPDK_BDEV_IO_KV_RETRIEVE && offset == 0) {
+		op->step = KV_LONG_KEY_READ;
+	} else {
+		op->step = KV_LONG_KEY_PROBE;
+	}
+
+	rc = kv_long_key_submit(op);
+	if (rc != 0) {
+		spdk_dma_free(op->hdr);
+		free(op);
+	}
+
+	return rc;
+}
+
+int
+spdk_bdev_kv_long_key_store(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+			    const unsigned char *key, size_t key_length,
+			    struct iovec *iov, int iovcnt, uint64_t nbytes, uint8_t options,
+			    spdk_bdev_kv_long_key_cb cb, void *cb_arg)
+{
+	return kv_long_key_start(desc, ch, SPDK_BDEV_IO_KV_STORE, key, key_length,
+				 iov, iovcnt, 0, nbytes, options, cb, cb_arg);
+}
+
+int
+spdk_bdev_kv_long_key_retrieve(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+			       const unsigned char *key, size_t key_length,
+			       struct iovec *iov, int iovcnt, uint64_t offset, uint64_t nbytes,
+			       spdk_bdev_kv_long_key_cb cb, void *cb_arg)
+{
+	return kv_long_key_start(desc, ch, SPDK_BDEV_IO_KV_RETRIEVE, key, key_length,
+				 iov, iovcnt, offset, nbytes, 0, cb, cb_arg);
+}
+
+int
+spdk_bdev_kv_long_key_exist(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+			    const unsigned char *key, size_t key_length,
+			    spdk_bdev_kv_long_key_cb cb, void *cb_arg)
+{
+	return kv_long_key_start(desc, ch, SPDK_BDEV_IO_KV_EXIST, key, key_length,
+				 NULL, 0, 0, 0, 0, cb, cb_arg);
+}
+
+int
+spdk_bdev_kv_long_key_delete(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+			     const unsigned char *key, size_t key_length,
+			     spdk_bdev_kv_long_key_cb cb, void *cb_arg)
+{
+	return kv_long_key_start(desc, ch, SPDK_BDEV_IO_KV_DELETE, key, key_length,
+				 NULL, 0, 0, 0, 0, cb, cb_arg);
+}
+
+/*
+ * Listing walks the whole device key space, since hashing does not keep key
+ * prefixes, and reads the header of each device key to get its name.
+ *
+ * The device keys are listed one prefix at a time. A listing returns as many
+ * of the matching keys as fit into the buffer, in ascending order; when it
+ * might not have returned all of them, the prefix is split into 256 longer ones.
+ */
+struct kv_long_key_list {
+	struct spdk_bdev_desc			*desc;
+	struct spdk_io_channel			*ch;
+	spdk_bdev_kv_long_key_list_cb		name_cb;
+	spdk_bdev_kv_long_key_list_done_cb	done_cb;
+	void					*cb_arg;
+	struct spdk_bdev_io_wait_entry		bdev_io_wait;
+
+	uint8_t					*buf;
+	struct kv_long_key_hdr			*hdr;
+	/* Position of the next device key in buf, and the end of the listed keys. */
+	uint32_t				pos;
+	uint32_t				end;
+	bool					truncated;
+	bool					reading_hdr;
+	uint8_t					dev_prefix[NVME_KV_MAX_KEY_LENGTH];
+	size_t					dev_prefix_len;
+
+	size_t					prefix_len;
+	uint8_t					prefix[];
+};
+
+static void
+kv_long_key_list_finish(struct kv_long_key_list *list, int status)
+{
+	list->done_cb(list->cb_arg, status);
+	spdk_dma_free(list->buf);
+	free(list);
+}
+
+static void kv_long_key_list_hdr_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg);
+static void kv_long_key_list_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg);
+
+static int
+kv_long_key_list_submit(struct kv_long_key_list *list)
+{
+	uint16_t key_len;
+
+	if (list->reading_hdr) {
+		memcpy(&key_len, list->buf + list->pos, sizeof(key_len));
+		return spdk_bdev_kv_retrieve(list->desc, list->ch, list->buf + list->pos + sizeof(key_len),
+					     key_len, list->hdr, 0,
+					     kv_long_key_hdr_len(SPDK_BDEV_KV_LONG_KEY_MAX_LENGTH),
+					     kv_long_key_list_hdr_done, list);
+	}
+
+	return spdk_bdev_kv_list(list->desc, list->ch, list->dev_prefix, list->dev_prefix_len,
+				 list->buf, KV_LONG_KEY_LIST_BUF_SIZE, kv_long_key_list_done, list);
+}
+
+static void
+kv_long_key_list_resubmit(void *arg)
+{
+	struct kv_long_key_list *list = arg;
+	int rc;
+
+	rc = kv_long_key_list_submit(list);
+	if (rc == -ENOMEM) {
+		list->bdev_io_wait.bdev = spdk_bdev_desc_get_bdev(list->desc);
+		list->bdev_io_wait.cb_fn = kv_long_key_list_resubmit;
+		list->bdev_io_wait.cb_arg = list;
+		rc = spdk_bdev_queue_io_wait(list->bdev_io_wait.bdev, list->ch, &list->bdev_io_wait);
+	}
+	if (rc != 0) {
+		kv_long_key_list_finish(list, rc);
+	}
+}
+
+/* Read the header of the next listed device key, or list the next prefix. */
+static void
+kv_long_key_list_advance(struct kv_long_key_list *list)
+{
+	uint16_t key_len;
+
+	for (; list->pos < list->end; list->pos += sizeof(key_len) + SPDK_ALIGN_CEIL(key_len, 4)) {
+		memcpy(&key_len, list->buf + list->pos, sizeof(key_len));
+		if (key_len != NVME_KV_MAX_KEY_LENGTH) {
+			continue;
+		}
+		/* Keys in a truncated listing are seen again under the longer prefixes. */
+		if (!list->truncated || key_len == list->dev_prefix_len) {
+			list->reading_hdr = true;
+			kv_long_key_list_resubmit(list);
+			return;
+		}
+	}
+
+	list->reading_hdr = false;
+	if (list->truncated) {
+		list->dev_prefix[list->dev_prefix_len++] = 0;
+	} else {
+		while (list->dev_prefix_len > 0 && list->dev_prefix[list->dev_prefix_len - 1] == UINT8_MAX) {
+			list->dev_prefix_len--;
+		}
+		if (list->dev_prefix_len == 0) {
+			kv_long_key_list_finish(list, 0);
+			return;
+		}
+		list->dev_prefix[list->dev_prefix_len - 1]++;
+	}
+
+	kv_long_key_list_resubmit(list);
+}
+
+static void
+kv_long_key_list_hdr_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct kv_long_key_list *list = cb_arg;
+	struct kv_long_key_hdr *hdr = list->hdr;
+	uint32_t cdw0;
+	int sct, sc, rc;
+	uint16_t key_len;
+
+	spdk_bdev_io_get_nvme_status(bdev_io, &cdw0, &sct, &sc);
+	spdk_bdev_free_io(bdev_io);
+
+	if (success) {
+		if (cdw0 >= sizeof(*hdr) && hdr->magic == KV_LONG_KEY_MAGIC &&
+		    !(hdr->flags & KV_LONG_KEY_FLAG_TOMBSTONE) &&
+		    hdr->key_len <= SPDK_BDEV_KV_LONG_KEY_MAX_LENGTH &&
+		    cdw0 >= kv_long_key_hdr_len(hdr->key_len) &&
+		    hdr->key_len >= list->prefix_len &&
+		    memcmp(hdr->key, list->prefix, list->prefix_len) == 0) {
+			rc = list->name_cb(list->cb_arg, hdr->key, hdr->key_len);
+			if (rc != 0) {
+				kv_long_key_list_finish(list, rc);
+				return;
+			}
+		}
+	} else if (!(sct == SPDK_NVME_SCT_GENERIC && sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST)) {
+		/* A key that was deleted since it was listed is skipped; anything else is an error. */
+		kv_long_key_list_finish(list, -EIO);
+		return;
+	}
+
+	memcpy(&key_len, list->buf + list->pos, sizeof(key_len));
+	list->pos += sizeof(key_len) + SPDK_ALIGN_CEIL(key_len, 4);
+	kv_long_key_list_advance(list);
+}
+
+static void
+kv_long_key_list_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct kv_long_key_list *list = cb_arg;
+	uint32_t num, i, pos = sizeof(num);
+	uint16_t key_len;
+
+	spdk_bdev_free_io(bdev_io);
+
+	if (!success) {
+		kv_long_key_list_finish(list, -EIO);
+		return;
+	}
+
+	memcpy(&num, list->buf, sizeof(num));
+	for (i = 0; i < num; i++) {
+		if (pos + sizeof(key_len) > KV_LONG_KEY_LIST_BUF_SIZE) {
+			break;
+		}
+		memcpy(&key_len, list->buf + pos, sizeof(key_len));
+		if (key_len > NVME_KV_MAX_KEY_LENGTH ||
+		    pos + sizeof(key_len) + key_len > KV_LONG_KEY_LIST_BUF_SIZE) {
+			break;
+		}
+		pos += sizeof(key_len) + SPDK_ALIGN_CEIL(key_len, 4);
+	}
+	if (i != num) {
+		SPDK_ERRLOG("Malformed key list\n");
+		kv_long_key_list_finish(list, -EIO);
+		return;
+	}
+
+	list->pos = sizeof(num);
+	list->end = pos;
+	/* Another key might not have fit. Only the prefix itself can't be in a longer prefix. */
+	list->truncated = pos + sizeof(key_len) + NVME_KV_MAX_KEY_LENGTH > KV_LONG_KEY_LIST_BUF_SIZE &&
+			  list->dev_prefix_len < NVME_KV_MAX_KEY_LENGTH;
+
+	kv_long_key_list_advance(list);
+}
+
+int
+spdk_bdev_kv_long_key_list(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+			   const unsigned char *prefix, size_t prefix_length,
+			   spdk_bdev_kv_long_key_list_cb name_cb,
+			   spdk_bdev_kv_long_key_list_done_cb done_cb, void *cb_arg)
+{
+	struct spdk_bdev *bdev = spdk_bdev_desc_get_bdev(desc);
+	struct kv_long_key_list *list;
+	uint32_t hdr_size;
+	int rc;
+
+	if (prefix_length > SPDK_BDEV_KV_LONG_KEY_MAX_LENGTH) {
+		return -EINVAL;
+	}
+
+	list = calloc(1, sizeof(*list) + prefix_length);
+	if (list == NULL) {
+		return -ENOMEM;
+	}
+
+	hdr_size = SPDK_ALIGN_CEIL(kv_long_key_hdr_len(SPDK_BDEV_KV_LONG_KEY_MAX_LENGTH), 64);
+	list->buf = spdk_dma_zmalloc(KV_LONG_KEY_LIST_BUF_SIZE + hdr_size,
+				     spdk_bdev_get_buf_align(bdev), NULL);
+	if (list->buf == NULL) {
+		free(list);
+		return -ENOMEM;
+	}
+	list->hdr = (struct kv_long_key_hdr *)(list->buf + KV_LONG_KEY_LIST_BUF_SIZE);
+
+	list->desc = desc;
+	list->ch = ch;
+	list->name_cb = name_cb;
+	list->done_cb = done_cb;
+	list->cb_arg = cb_arg;
+	list->prefix_len = prefix_length;
+	if (prefix_length > 0) {
+		memcpy(list->prefix, prefix, prefix_length);
+	}
+
+	rc = kv_long_key_list_submit(list);
+	if (rc != 0) {
+		spdk_dma_free(list->buf);
+		free(list);
+	}
+
+	return rc;
+}
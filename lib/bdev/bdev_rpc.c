@@ -997,6 +997,21 @@ static const struct spdk_json_object_decoder rpc_bdev_set_qos_limit_decoders[] =
 					     limits[SPDK_BDEV_QOS_W_BPS_RATE_LIMIT]),
 		spdk_json_decode_uint64, true
 	},
+	{
+		"kv_ops_per_sec", offsetof(struct rpc_bdev_set_qos_limit,
+					   limits[SPDK_BDEV_QOS_KV_OPS_RATE_LIMIT]),
+		spdk_json_decode_uint64, true
+	},
+	{
+		"kv_mbytes_per_sec", offsetof(struct rpc_bdev_set_qos_limit,
+					      limits[SPDK_BDEV_QOS_KV_BPS_RATE_LIMIT]),
+		spdk_json_decode_uint64, true
+	},
+	{
+		"kv_max_selects", offsetof(struct rpc_bdev_set_qos_limit,
+					   limits[SPDK_BDEV_QOS_KV_SELECTS_LIMIT]),
+		spdk_json_decode_uint64, true
+	},
 };
 
 static void
@@ -1018,7 +1033,8 @@ static void
 rpc_bdev_set_qos_limit(struct spdk_jsonrpc_request *request,
 		       const struct spdk_json_val *params)
 {
-	struct rpc_bdev_set_qos_limit req = {NULL, {UINT64_MAX, UINT64_MAX, UINT64_MAX, UINT64_MAX}};
+	struct rpc_bdev_set_qos_limit req = {NULL, {UINT64_MAX, UINT64_MAX, UINT64_MAX, UINT64_MAX,
+						    UINT64_MAX, UINT64_MAX, UINT64_MAX}};
 	struct spdk_bdev_desc *desc;
 	int i, rc;
 
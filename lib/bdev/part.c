@@ -265,7 +265,10 @@ bdev_part_complete_io(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
 
 	cb = part_io->u.bdev.stored_user_cb;
 	if (cb != NULL) {
-		cb(part_io, success, NULL);
+		cb(part_io, success, bdev_io);
+	} else if (spdk_bdev_io_type_is_kv(part_io->type)) {
+		/* KV results, such as the value length, are in the NVMe completion. */
+		spdk_bdev_kv_io_complete_from(part_io, bdev_io);
 	} else {
 		status = success ? SPDK_BDEV_IO_STATUS_SUCCESS : SPDK_BDEV_IO_STATUS_FAILED;
 
@@ -386,6 +389,18 @@ spdk_bdev_part_submit_request_ext(struct spdk_bdev_part_channel *ch, struct spdk
 					   bdev_io->u.bdev.num_blocks, bdev_part_complete_io,
 					   bdev_io);
 		break;
+	case SPDK_BDEV_IO_KV_LIST:
+	case SPDK_BDEV_IO_KV_DELETE:
+	case SPDK_BDEV_IO_KV_EXIST:
+	case SPDK_BDEV_IO_KV_STORE:
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+	case SPDK_BDEV_IO_KV_SEND_SELECT:
+	case SPDK_BDEV_IO_KV_RETRIEVE_SELECT:
+	case SPDK_BDEV_IO_KV_BATCH:
+		/* Keys are not remapped; partitions share the key space of the base bdev. */
+		rc = spdk_bdev_kv_io_forward(base_desc, base_ch, bdev_io, bdev_part_complete_io,
+					     bdev_io);
+		break;
 	default:
 		SPDK_ERRLOG("unknown I/O type %d\n", bdev_io->type);
 		return SPDK_BDEV_IO_STATUS_FAILED;
@@ -0,0 +1,1200 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+/*
+ * Host-side evaluation of SELECT, for KV bdev modules that keep values the device
+ * cannot query itself, and the table those modules keep the results in until
+ * they are retrieved. Not part of lib/bdev; only the modules that need it link
+ * against it. The subset understood is:
+ *
+ *   SELECT * | col [, col ...] | agg(col|*) [, agg(col) ...]
+ *   FROM ident [alias]
+ *   [WHERE col op literal [AND col op literal ...] | [OR col op literal ...]]
+ *   [LIMIT n]
+ *
+ * Columns are named by the CSV header (when the input header option is set) or
+ * by JSON member name, or positionally as _1, _2, ... Supported operators are
+ * =, !=, <>, <, <=, > and >=. Literals are 'quoted strings' or numbers; two
+ * values compare numerically when both parse as numbers. Aggregates are COUNT,
+ * SUM, MIN, MAX and AVG and cannot be mixed with plain columns.
+ *
+ * Input is CSV (RFC 4180 quoting) or a sequence of flat JSON objects. Output is
+ * CSV or JSON lines.
+ */
+
+#include "spdk/stdinc.h"
+
+#include "spdk/bdev.h"
+#include "spdk/json.h"
+#include "spdk/nvme_spec.h"
+#include "spdk/queue.h"
+#include "spdk/string.h"
+#include "spdk/util.h"
+
+#include "spdk_internal/kv_select.h"
+
+#define KV_SELECT_MAX_COLUMNS	32
+#define KV_SELECT_MAX_CONDS		16
+#define KV_SELECT_MAX_FIELDS	256
+#define KV_SELECT_MAX_JSON_VALUES	(KV_SELECT_MAX_FIELDS * 2 + 2)
+
+enum kv_select_op {
+	KV_SELECT_OP_EQ,
+	KV_SELECT_OP_NE,
+	KV_SELECT_OP_LT,
+	KV_SELECT_OP_LE,
+	KV_SELECT_OP_GT,
+	KV_SELECT_OP_GE,
+};
+
+enum kv_select_agg {
+	KV_SELECT_AGG_NONE,
+	KV_SELECT_AGG_COUNT,
+	KV_SELECT_AGG_SUM,
+	KV_SELECT_AGG_MIN,
+	KV_SELECT_AGG_MAX,
+	KV_SELECT_AGG_AVG,
+};
+
+struct kv_select_col {
+	char		name[64];
+	/* 0-based position for _N references, -1 when referenced by name. */
+	int		pos;
+};
+
+struct kv_select_proj {
+	struct kv_select_col	col;
+	enum kv_select_agg		agg;
+	bool			star;
+	uint64_t		count;
+	double			acc;
+	bool			has_acc;
+};
+
+struct kv_select_cond {
+	struct kv_select_col	col;
+	enum kv_select_op		op;
+	char			lit[256];
+	size_t			lit_len;
+	bool			lit_is_num;
+	double			num;
+};
+
+struct kv_select_query {
+	bool			star;
+	struct kv_select_proj	proj[KV_SELECT_MAX_COLUMNS];
+	int			num_proj;
+	bool			aggregate;
+	struct kv_select_cond	cond[KV_SELECT_MAX_CONDS];
+	int			num_cond;
+	bool			cond_or;
+	bool			has_limit;
+	uint64_t		limit;
+};
+
+struct kv_select_field {
+	const char	*name;
+	size_t		name_len;
+	const char	*val;
+	size_t		val_len;
+	bool		is_string;
+	bool		is_null;
+};
+
+struct kv_select_row {
+	struct kv_select_field	fields[KV_SELECT_MAX_FIELDS];
+	int			num_fields;
+};
+
+struct kv_select_out {
+	char	*buf;
+	size_t	len;
+	size_t	cap;
+	int	rc;
+};
+
+struct kv_select_lexer {
+	const char	*p;
+	const char	*end;
+};
+
+static void
+out_append(struct kv_select_out *out, const char *s, size_t len)
+{
+	char *buf;
+	size_t cap;
+
+	if (out->rc != 0) {
+		return;
+	}
+	if (out->len + len > out->cap) {
+		cap = spdk_max(out->cap * 2, out->len + len);
+		cap = spdk_max(cap, 4096);
+		buf = realloc(out->buf, cap);
+		if (buf == NULL) {
+			out->rc = -ENOMEM;
+			return;
+		}
+		out->buf = buf;
+		out->cap = cap;
+	}
+	memcpy(out->buf + out->len, s, len);
+	out->len += len;
+}
+
+static void
+out_str(struct kv_select_out *out, const char *s)
+{
+	out_append(out, s, strlen(s));
+}
+
+static void
+out_csv_field(struct kv_select_out *out, const char *val, size_t len)
+{
+	size_t i;
+
+	if (memchr(val, ',', len) == NULL && memchr(val, '"', len) == NULL &&
+	    memchr(val, '\n', len) == NULL && memchr(val, '\r', len) == NULL) {
+		out_append(out, val, len);
+		return;
+	}
+
+	out_append(out, "\"", 1);
+	for (i = 0; i < len; i++) {
+		if (val[i] == '"') {
+			out_append(out, "\"\"", 2);
+		} else {
+			out_append(out, &val[i], 1);
+		}
+	}
+	out_append(out, "\"", 1);
+}
+
+static void
+out_json_string(struct kv_select_out *out, const char *val, size_t len)
+{
+	char esc[8];
+	size_t i;
+
+	out_append(out, "\"", 1);
+	for (i = 0; i < len; i++) {
+		unsigned char c = val[i];
+
+		if (c == '"' || c == '\\') {
+			esc[0] = '\\';
+			esc[1] = c;
+			out_append(out, esc, 2);
+		} else if (c < 0x20) {
+			snprintf(esc, sizeof(esc), "\\u%04x", c);
+			out_append(out, esc, 6);
+		} else {
+			out_append(out, &val[i], 1);
+		}
+	}
+	out_append(out, "\"", 1);
+}
+
+static void
+out_number(struct kv_select_out *out, double v)
+{
+	char num[64];
+
+	if (v > -1e15 && v < 1e15 && v == (double)(int64_t)v) {
+		snprintf(num, sizeof(num), "%" PRId64, (int64_t)v);
+	} else {
+		snprintf(num, sizeof(num), "%.17g", v);
+	}
+	out_str(out, num);
+}
+
+static bool
+parse_number(const char *s, size_t len, double *v)
+{
+	char tmp[64];
+	char *end;
+
+	while (len > 0 && isspace((unsigned char)*s)) {
+		s++;
+		len--;
+	}
+	while (len > 0 && isspace((unsigned char)s[len - 1])) {
+		len--;
+	}
+	if (len == 0 || len >= sizeof(tmp)) {
+		return false;
+	}
+	memcpy(tmp, s, len);
+	tmp[len] = '\0';
+	errno = 0;
+	*v = strtod(tmp, &end);
+	return errno == 0 && *end == '\0';
+}
+
+/* Lexer */
+
+static void
+lex_skip_ws(struct kv_select_lexer *lx)
+{
+	while (lx->p < lx->end && (isspace((unsigned char)*lx->p) || *lx->p == '\0')) {
+		lx->p++;
+	}
+	if (lx->p < lx->end && *lx->p == ';') {
+		lx->p++;
+		lex_skip_ws(lx);
+	}
+}
+
+static bool
+lex_is_ident_char(char c, bool first)
+{
+	return isalpha((unsigned char)c) || c == '_' || (!first && isdigit((unsigned char)c));
+}
+
+/* Consume keyword kw (case-insensitive) if it is the next token. */
+static bool
+lex_keyword(struct kv_select_lexer *lx, const char *kw)
+{
+	size_t len = strlen(kw);
+
+	lex_skip_ws(lx);
+	if ((size_t)(lx->end - lx->p) < len || strncasecmp(lx->p, kw, len) != 0) {
+		return false;
+	}
+	if (lx->p + len < lx->end && lex_is_ident_char(lx->p[len], false)) {
+		return false;
+	}
+	lx->p += len;
+	return true;
+}
+
+static bool
+lex_char(struct kv_select_lexer *lx, char c)
+{
+	lex_skip_ws(lx);
+	if (lx->p < lx->end && *lx->p == c) {
+		lx->p++;
+		return true;
+	}
+	return false;
+}
+
+static int
+lex_ident(struct kv_select_lexer *lx, char *buf, size_t size)
+{
+	const char *start;
+	size_t len;
+
+	lex_skip_ws(lx);
+	if (lx->p < lx->end && *lx->p == '"') {
+		/* Quoted identifier */
+		start = ++lx->p;
+		while (lx->p < lx->end && *lx->p != '"') {
+			lx->p++;
+		}
+		if (lx->p == lx->end) {
+			return -EINVAL;
+		}
+		len = lx->p++ - start;
+	} else {
+		if (lx->p == lx->end || !lex_is_ident_char(*lx->p, true)) {
+			return -EINVAL;
+		}
+		start = lx->p;
+		while (lx->p < lx->end && lex_is_ident_char(*lx->p, false)) {
+			lx->p++;
+		}
+		len = lx->p - start;
+	}
+	if (len >= size) {
+		return -ENAMETOOLONG;
+	}
+	memcpy(buf, start, len);
+	buf[len] = '\0';
+	return 0;
+}
+
+static int
+parse_col(struct kv_select_lexer *lx, struct kv_select_col *col)
+{
+	char *endp;
+	long pos;
+	int rc;
+
+	rc = lex_ident(lx, col->name, sizeof(col->name));
+	if (rc != 0) {
+		return rc;
+	}
+	/* alias.column - the alias is not checked */
+	if (lex_char(lx, '.')) {
+		rc = lex_ident(lx, col->name, sizeof(col->name));
+		if (rc != 0) {
+			return rc;
+		}
+	}
+
+	col->pos = -1;
+	if (col->name[0] == '_' && isdigit((unsigned char)col->name[1])) {
+		pos = strtol(&col->name[1], &endp, 10);
+		if (*endp == '\0' && pos > 0 && pos <= KV_SELECT_MAX_FIELDS) {
+			col->pos = pos - 1;
+		}
+	}
+	return 0;
+}
+
+static int
+parse_literal(struct kv_select_lexer *lx, struct kv_select_cond *cond)
+{
+	const char *start;
+
+	lex_skip_ws(lx);
+	if (lx->p == lx->end) {
+		return -EINVAL;
+	}
+
+	cond->lit_len = 0;
+	if (*lx->p == '\'') {
+		lx->p++;
+		while (lx->p < lx->end) {
+			if (*lx->p == '\'') {
+				if (lx->p + 1 < lx->end && lx->p[1] == '\'') {
+					lx->p++;
+				} else {
+					break;
+				}
+			}
+			if (cond->lit_len + 1 >= sizeof(cond->lit)) {
+				return -ENAMETOOLONG;
+			}
+			cond->lit[cond->lit_len++] = *lx->p++;
+		}
+		if (lx->p == lx->end) {
+			return -EINVAL;
+		}
+		lx->p++;
+		cond->lit[cond->lit_len] = '\0';
+		cond->lit_is_num = parse_number(cond->lit, cond->lit_len, &cond->num);
+		return 0;
+	}
+
+	start = lx->p;
+	while (lx->p < lx->end && (isalnum((unsigned char)*lx->p) || *lx->p == '.' ||
+				   *lx->p == '-' || *lx->p == '+')) {
+		lx->p++;
+	}
+	cond->lit_len = lx->p - start;
+	if (cond->lit_len == 0 || cond->lit_len >= sizeof(cond->lit)) {
+		return -EINVAL;
+	}
+	memcpy(cond->lit, start, cond->lit_len);
+	cond->lit[cond->lit_len] = '\0';
+	cond->lit_is_num = parse_number(cond->lit, cond->lit_len, &cond->num);
+	if (!cond->lit_is_num) {
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static int
+parse_op(struct kv_select_lexer *lx, enum kv_select_op *op)
+{
+	lex_skip_ws(lx);
+	if (lx->end - lx->p >= 2) {
+		if (!strncmp(lx->p, "!=", 2) || !strncmp(lx->p, "<>", 2)) {
+			*op = KV_SELECT_OP_NE;
+			lx->p += 2;
+			return 0;
+		}
+		if (!strncmp(lx->p, "<=", 2)) {
+			*op = KV_SELECT_OP_LE;
+			lx->p += 2;
+			return 0;
+		}
+		if (!strncmp(lx->p, ">=", 2)) {
+			*op = KV_SELECT_OP_GE;
+			lx->p += 2;
+			return 0;
+		}
+	}
+	if (lex_char(lx, '=')) {
+		*op = KV_SELECT_OP_EQ;
+	} else if (lex_char(lx, '<')) {
+		*op = KV_SELECT_OP_LT;
+	} else if (lex_char(lx, '>')) {
+		*op = KV_SELECT_OP_GT;
+	} else {
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static int
+parse_proj(struct kv_select_lexer *lx, struct kv_select_proj *proj)
+{
+	static const struct {
+		const char *name;
+		enum kv_select_agg agg;
+	} aggs[] = {
+		{ "COUNT", KV_SELECT_AGG_COUNT },
+		{ "SUM", KV_SELECT_AGG_SUM },
+		{ "MIN", KV_SELECT_AGG_MIN },
+		{ "MAX", KV_SELECT_AGG_MAX },
+		{ "AVG", KV_SELECT_AGG_AVG },
+	};
+	struct kv_select_lexer save = *lx;
+	size_t i;
+	int rc;
+
+	for (i = 0; i < SPDK_COUNTOF(aggs); i++) {
+		if (!lex_keyword(lx, aggs[i].name)) {
+			continue;
+		}
+		if (!lex_char(lx, '(')) {
+			/* A column that happens to be called e.g. "count" */
+			*lx = save;
+			break;
+		}
+		proj->agg = aggs[i].agg;
+		if (lex_char(lx, '*')) {
+			if (proj->agg != KV_SELECT_AGG_COUNT) {
+				return -EINVAL;
+			}
+			proj->star = true;
+		} else {
+			rc = parse_col(lx, &proj->col);
+			if (rc != 0) {
+				return rc;
+			}
+		}
+		return lex_char(lx, ')') ? 0 : -EINVAL;
+	}
+
+	proj->agg = KV_SELECT_AGG_NONE;
+	return parse_col(lx, &proj->col);
+}
+
+static int
+parse_query(const char *text, size_t len, struct kv_select_query *q)
+{
+	struct kv_select_lexer lx = { .p = text, .end = text + len };
+	struct kv_select_cond *cond;
+	char ident[64];
+	bool saw_and = false, saw_or = false;
+	int rc, i;
+
+	memset(q, 0, sizeof(*q));
+
+	if (!lex_keyword(&lx, "SELECT")) {
+		return -EINVAL;
+	}
+
+	if (lex_char(&lx, '*')) {
+		q->star = true;
+	} else {
+		do {
+			if (q->num_proj == KV_SELECT_MAX_COLUMNS) {
+				return -E2BIG;
+			}
+			rc = parse_proj(&lx, &q->proj[q->num_proj]);
+			if (rc != 0) {
+				return rc;
+			}
+			q->num_proj++;
+		} while (lex_char(&lx, ','));
+
+		q->aggregate = q->proj[0].agg != KV_SELECT_AGG_NONE;
+		for (i = 1; i < q->num_proj; i++) {
+			if ((q->proj[i].agg != KV_SELECT_AGG_NONE) != q->aggregate) {
+				return -EINVAL;
+			}
+		}
+	}
+
+	if (!lex_keyword(&lx, "FROM")) {
+		return -EINVAL;
+	}
+	rc = lex_ident(&lx, ident, sizeof(ident));
+	if (rc != 0) {
+		return rc;
+	}
+	/* Optional table alias */
+	lex_skip_ws(&lx);
+	if (lx.p < lx.end && lex_is_ident_char(*lx.p, true)) {
+		struct kv_select_lexer save = lx;
+
+		if (lex_keyword(&lx, "WHERE") || lex_keyword(&lx, "LIMIT")) {
+			lx = save;
+		} else {
+			rc = lex_ident(&lx, ident, sizeof(ident));
+			if (rc != 0) {
+				return rc;
+			}
+		}
+	}
+
+	if (lex_keyword(&lx, "WHERE")) {
+		do {
+			if (q->num_cond == KV_SELECT_MAX_CONDS) {
+				return -E2BIG;
+			}
+			cond = &q->cond[q->num_cond++];
+			rc = parse_col(&lx, &cond->col);
+			if (rc != 0) {
+				return rc;
+			}
+			rc = parse_op(&lx, &cond->op);
+			if (rc != 0) {
+				return rc;
+			}
+			rc = parse_literal(&lx, cond);
+			if (rc != 0) {
+				return rc;
+			}
+			if (lex_keyword(&lx, "AND")) {
+				saw_and = true;
+			} else if (lex_keyword(&lx, "OR")) {
+				saw_or = true;
+			} else {
+				break;
+			}
+		} while (true);
+
+		/* Mixing AND and OR would need precedence rules this subset does not have. */
+		if (saw_and && saw_or) {
+			return -ENOTSUP;
+		}
+		q->cond_or = saw_or;
+	}
+
+	if (lex_keyword(&lx, "LIMIT")) {
+		struct kv_select_cond lim = {};
+
+		rc = parse_literal(&lx, &lim);
+		if (rc != 0 || lim.num < 0) {
+			return -EINVAL;
+		}
+		q->has_limit = true;
+		q->limit = (uint64_t)lim.num;
+	}
+
+	lex_skip_ws(&lx);
+	return lx.p == lx.end ? 0 : -EINVAL;
+}
+
+/* Row access */
+
+static const struct kv_select_field *
+row_lookup(const struct kv_select_row *row, const struct kv_select_row *header,
+	   const struct kv_select_col *col)
+{
+	const struct kv_select_field *names;
+	size_t len;
+	int i;
+
+	if (col->pos >= 0) {
+		return col->pos < row->num_fields ? &row->fields[col->pos] : NULL;
+	}
+
+	len = strlen(col->name);
+	for (i = 0; i < row->num_fields; i++) {
+		if (header != NULL) {
+			if (i >= header->num_fields) {
+				break;
+			}
+			names = &header->fields[i];
+			if (names->val_len == len && !strncasecmp(names->val, col->name, len)) {
+				return &row->fields[i];
+			}
+		} else if (row->fields[i].name_len == len &&
+			   !strncasecmp(row->fields[i].name, col->name, len)) {
+			return &row->fields[i];
+		}
+	}
+	return NULL;
+}
+
+static bool
+cond_match(const struct kv_select_cond *cond, const struct kv_select_field *f)
+{
+	double v;
+	int cmp;
+
+	if (f == NULL || f->is_null) {
+		return false;
+	}
+
+	if (cond->lit_is_num && parse_number(f->val, f->val_len, &v)) {
+		cmp = v < cond->num ? -1 : v > cond->num;
+	} else {
+		cmp = memcmp(f->val, cond->lit, spdk_min(f->val_len, cond->lit_len));
+		if (cmp == 0) {
+			cmp = f->val_len < cond->lit_len ? -1 : f->val_len > cond->lit_len;
+		}
+	}
+
+	switch (cond->op) {
+	case KV_SELECT_OP_EQ:
+		return cmp == 0;
+	case KV_SELECT_OP_NE:
+		return cmp != 0;
+	case KV_SELECT_OP_LT:
+		return cmp < 0;
+	case KV_SELECT_OP_LE:
+		return cmp <= 0;
+	case KV_SELECT_OP_GT:
+		return cmp > 0;
+	case KV_SELECT_OP_GE:
+		return cmp >= 0;
+	}
+	return false;
+}
+
+static bool
+row_match(const struct kv_select_query *q, const struct kv_select_row *row,
+	  const struct kv_select_row *header)
+{
+	bool match;
+	int i;
+
+	for (i = 0; i < q->num_cond; i++) {
+		match = cond_match(&q->cond[i], row_lookup(row, header, &q->cond[i].col));
+		if (q->cond_or && match) {
+			return true;
+		}
+		if (!q->cond_or && !match) {
+			return false;
+		}
+	}
+	return q->num_cond == 0 || !q->cond_or;
+}
+
+static void
+field_name(const struct kv_select_row *row, const struct kv_select_row *header, int i,
+	   char *buf, size_t size, const char **name, size_t *len)
+{
+	if (header != NULL && i < header->num_fields) {
+		*name = header->fields[i].val;
+		*len = header->fields[i].val_len;
+	} else if (header == NULL && row->fields[i].name != NULL) {
+		*name = row->fields[i].name;
+		*len = row->fields[i].name_len;
+	} else {
+		*len = snprintf(buf, size, "_%d", i + 1);
+		*name = buf;
+	}
+}
+
+static void
+emit_field(struct kv_select_out *out, uint8_t output_type, bool first,
+	   const char *name, size_t name_len, const struct kv_select_field *f)
+{
+	if (output_type == NVME_KV_SELECT_TYPE_JSON) {
+		out_str(out, first ? "{" : ",");
+		out_json_string(out, name, name_len);
+		out_append(out, ":", 1);
+		if (f == NULL || f->is_null) {
+			out_str(out, "null");
+		} else if (f->is_string) {
+			out_json_string(out, f->val, f->val_len);
+		} else {
+			out_append(out, f->val, f->val_len);
+		}
+	} else {
+		if (!first) {
+			out_append(out, ",", 1);
+		}
+		if (f != NULL && !f->is_null) {
+			out_csv_field(out, f->val, f->val_len);
+		}
+	}
+}
+
+static void
+emit_row_end(struct kv_select_out *out, uint8_t output_type, bool empty)
+{
+	if (output_type == NVME_KV_SELECT_TYPE_JSON) {
+		out_str(out, empty ? "{}\n" : "}\n");
+	} else {
+		out_append(out, "\n", 1);
+	}
+}
+
+static void
+emit_row(struct kv_select_out *out, const struct kv_select_query *q,
+	 const struct kv_select_row *row, const struct kv_select_row *header, uint8_t output_type)
+{
+	char buf[16];
+	const char *name;
+	size_t name_len;
+	int i, n;
+
+	n = q->star ? row->num_fields : q->num_proj;
+	for (i = 0; i < n; i++) {
+		if (q->star) {
+			field_name(row, header, i, buf, sizeof(buf), &name, &name_len);
+			emit_field(out, output_type, i == 0, name, name_len, &row->fields[i]);
+		} else {
+			name = q->proj[i].col.name;
+			name_len = strlen(name);
+			emit_field(out, output_type, i == 0, name, name_len,
+				   row_lookup(row, header, &q->proj[i].col));
+		}
+	}
+	emit_row_end(out, output_type, n == 0);
+}
+
+static void
+emit_csv_header(struct kv_select_out *out, const struct kv_select_query *q,
+		const struct kv_select_row *first_row, const struct kv_select_row *header)
+{
+	char buf[16];
+	const char *name;
+	size_t name_len;
+	int i, n;
+
+	if (q->star) {
+		n = header != NULL ? header->num_fields : first_row->num_fields;
+		for (i = 0; i < n; i++) {
+			field_name(header != NULL ? header : first_row, header, i, buf, sizeof(buf),
+				   &name, &name_len);
+			if (i > 0) {
+				out_append(out, ",", 1);
+			}
+			out_csv_field(out, name, name_len);
+		}
+	} else {
+		for (i = 0; i < q->num_proj; i++) {
+			if (i > 0) {
+				out_append(out, ",", 1);
+			}
+			if (q->aggregate) {
+				snprintf(buf, sizeof(buf), "_%d", i + 1);
+				out_str(out, buf);
+			} else {
+				out_str(out, q->proj[i].col.name);
+			}
+		}
+	}
+	out_append(out, "\n", 1);
+}
+
+static void
+aggregate_row(struct kv_select_query *q, const struct kv_select_row *row,
+	      const struct kv_select_row *header)
+{
+	const struct kv_select_field *f;
+	struct kv_select_proj *p;
+	double v;
+	int i;
+
+	for (i = 0; i < q->num_proj; i++) {
+		p = &q->proj[i];
+		if (p->star) {
+			p->count++;
+			continue;
+		}
+		f = row_lookup(row, header, &p->col);
+		if (f == NULL || f->is_null) {
+			continue;
+		}
+		if (p->agg == KV_SELECT_AGG_COUNT) {
+			p->count++;
+			continue;
+		}
+		if (!parse_number(f->val, f->val_len, &v)) {
+			continue;
+		}
+		p->count++;
+		if (!p->has_acc) {
+			p->acc = v;
+			p->has_acc = true;
+		} else if (p->agg == KV_SELECT_AGG_MIN) {
+			p->acc = spdk_min(p->acc, v);
+		} else if (p->agg == KV_SELECT_AGG_MAX) {
+			p->acc = spdk_max(p->acc, v);
+		} else {
+			p->acc += v;
+		}
+	}
+}
+
+static void
+emit_aggregates(struct kv_select_out *out, const struct kv_select_query *q, uint8_t output_type)
+{
+	const struct kv_select_proj *p;
+	char name[16];
+	int i;
+
+	for (i = 0; i < q->num_proj; i++) {
+		p = &q->proj[i];
+		if (output_type == NVME_KV_SELECT_TYPE_JSON) {
+			snprintf(name, sizeof(name), "_%d", i + 1);
+			out_str(out, i == 0 ? "{" : ",");
+			out_json_string(out, name, strlen(name));
+			out_append(out, ":", 1);
+		} else if (i > 0) {
+			out_append(out, ",", 1);
+		}
+
+		if (p->agg == KV_SELECT_AGG_COUNT) {
+			out_number(out, (double)p->count);
+		} else if (!p->has_acc) {
+			if (output_type == NVME_KV_SELECT_TYPE_JSON) {
+				out_str(out, "null");
+			}
+		} else if (p->agg == KV_SELECT_AGG_AVG) {
+			out_number(out, p->acc / p->count);
+		} else {
+			out_number(out, p->acc);
+		}
+	}
+	emit_row_end(out, output_type, q->num_proj == 0);
+}
+
+/* Input parsing */
+
+/*
+ * Parse one CSV record starting at *pos. Quoted fields are unescaped into
+ * scratch, which must be at least as large as the remaining input.
+ */
+static int
+csv_next_row(const char *data, size_t len, size_t *pos, char *scratch, struct kv_select_row *row)
+{
+	size_t i = *pos, s = 0;
+	struct kv_select_field *f;
+	bool quoted;
+
+	row->num_fields = 0;
+	while (i < len && (data[i] == '\n' || data[i] == '\r')) {
+		i++;
+	}
+	if (i >= len) {
+		return -ENOENT;
+	}
+
+	do {
+		if (row->num_fields == KV_SELECT_MAX_FIELDS) {
+			return -E2BIG;
+		}
+		f = &row->fields[row->num_fields++];
+		memset(f, 0, sizeof(*f));
+		f->is_string = true;
+
+		quoted = i < len && data[i] == '"';
+		if (quoted) {
+			f->val = &scratch[s];
+			i++;
+			while (i < len) {
+				if (data[i] == '"') {
+					if (i + 1 < len && data[i + 1] == '"') {
+						i++;
+					} else {
+						break;
+					}
+				}
+				scratch[s++] = data[i++];
+			}
+			if (i == len) {
+				return -EINVAL;
+			}
+			f->val_len = &scratch[s] - f->val;
+			i++;
+		} else {
+			f->val = &data[i];
+			while (i < len && data[i] != ',' && data[i] != '\n' && data[i] != '\r') {
+				i++;
+			}
+			f->val_len = &data[i] - f->val;
+		}
+	} while (i < len && data[i++] == ',');
+
+	/* i is past the record separator; swallow the \n of a \r\n pair. */
+	if (i < len && data[i - 1] == '\r' && data[i] == '\n') {
+		i++;
+	}
+	*pos = i;
+	return 0;
+}
+
+static int
+json_next_row(char *data, size_t len, size_t *pos, struct spdk_json_val *values,
+	      struct kv_select_row *row)
+{
+	struct spdk_json_val *v, *end_val;
+	struct kv_select_field *f;
+	void *end;
+	ssize_t rc;
+
+	row->num_fields = 0;
+	while (*pos < len && (isspace((unsigned char)data[*pos]) || data[*pos] == '\0')) {
+		(*pos)++;
+	}
+	if (*pos >= len) {
+		return -ENOENT;
+	}
+
+	rc = spdk_json_parse(&data[*pos], len - *pos, values, KV_SELECT_MAX_JSON_VALUES, &end,
+			     SPDK_JSON_PARSE_FLAG_DECODE_IN_PLACE);
+	if (rc < 0) {
+		return -EINVAL;
+	}
+	if (rc > KV_SELECT_MAX_JSON_VALUES) {
+		return -E2BIG;
+	}
+	*pos = (char *)end - data;
+
+	if (values[0].type != SPDK_JSON_VAL_OBJECT_BEGIN) {
+		return -EINVAL;
+	}
+
+	end_val = &values[values[0].len + 1];
+	for (v = &values[1]; v < end_val; v = spdk_json_next(v)) {
+		if (v->type != SPDK_JSON_VAL_NAME) {
+			return -EINVAL;
+		}
+		f = &row->fields[row->num_fields++];
+		memset(f, 0, sizeof(*f));
+		f->name = v->start;
+		f->name_len = v->len;
+		v++;
+		switch (v->type) {
+		case SPDK_JSON_VAL_STRING:
+			f->is_string = true;
+		/* fallthrough */
+		case SPDK_JSON_VAL_NUMBER:
+		case SPDK_JSON_VAL_TRUE:
+		case SPDK_JSON_VAL_FALSE:
+			f->val = v->start;
+			f->val_len = v->len;
+			break;
+		case SPDK_JSON_VAL_NULL:
+			f->is_null = true;
+			break;
+		default:
+			/* Nested objects and arrays are not supported and read as null. */
+			f->is_null = true;
+			break;
+		}
+	}
+	return 0;
+}
+
+int
+spdk_kv_select_eval(char *data, size_t value_len, const char *query, size_t query_len,
+		    uint8_t input_type, uint8_t output_type, uint8_t header_opts,
+		    char **result, size_t *result_len)
+{
+	struct kv_select_query *q;
+	struct kv_select_row *row = NULL, *header = NULL, *hdr = NULL;
+	struct spdk_json_val *values = NULL;
+	struct kv_select_out out = {};
+	char *scratch = NULL;
+	bool header_done = false;
+	uint64_t matched = 0;
+	size_t pos = 0;
+	int rc;
+
+	if (input_type != NVME_KV_SELECT_TYPE_CSV && input_type != NVME_KV_SELECT_TYPE_JSON) {
+		return -ENOTSUP;
+	}
+	if (output_type != NVME_KV_SELECT_TYPE_CSV && output_type != NVME_KV_SELECT_TYPE_JSON) {
+		return -ENOTSUP;
+	}
+
+	q = calloc(1, sizeof(*q));
+	row = calloc(1, sizeof(*row));
+	header = calloc(1, sizeof(*header));
+	scratch = malloc(value_len + 1);
+	if (q == NULL || row == NULL || header == NULL || scratch == NULL) {
+		rc = -ENOMEM;
+		goto out;
+	}
+	data[value_len] = '\0';
+
+	rc = parse_query(query, query_len, q);
+	if (rc != 0) {
+		goto out;
+	}
+
+	if (input_type == NVME_KV_SELECT_TYPE_JSON) {
+		values = calloc(KV_SELECT_MAX_JSON_VALUES, sizeof(*values));
+		if (values == NULL) {
+			rc = -ENOMEM;
+			goto out;
+		}
+	} else if (header_opts & NVME_KV_SELECT_CMD_OUTPUT_TYPE_USE_CSV_HEADERS_INPUT) {
+		/* The header row lives in the first part of scratch; rows use the rest. */
+		rc = csv_next_row(data, value_len, &pos, scratch, header);
+		if (rc != 0 && rc != -ENOENT) {
+			goto out;
+		}
+		hdr = header;
+	}
+
+	while (!q->has_limit || matched < q->limit) {
+		if (input_type == NVME_KV_SELECT_TYPE_JSON) {
+			rc = json_next_row(data, value_len, &pos, values, row);
+		} else {
+			rc = csv_next_row(data, value_len, &pos, scratch + pos, row);
+		}
+		if (rc == -ENOENT) {
+			break;
+		}
+		if (rc != 0) {
+			goto out;
+		}
+
+		if (!row_match(q, row, hdr)) {
+			continue;
+		}
+		matched++;
+
+		if (q->aggregate) {
+			aggregate_row(q, row, hdr);
+			continue;
+		}
+
+		if (!header_done && output_type == NVME_KV_SELECT_TYPE_CSV &&
+		    (header_opts & NVME_KV_SELECT_CMD_OUTPUT_TYPE_USE_CSV_HEADERS_OUTPUT)) {
+			emit_csv_header(&out, q, row, hdr);
+			header_done = true;
+		}
+		emit_row(&out, q, row, hdr, output_type);
+	}
+
+	if (q->aggregate) {
+		if (output_type == NVME_KV_SELECT_TYPE_CSV &&
+		    (header_opts & NVME_KV_SELECT_CMD_OUTPUT_TYPE_USE_CSV_HEADERS_OUTPUT)) {
+			emit_csv_header(&out, q, row, NULL);
+		}
+		emit_aggregates(&out, q, output_type);
+	}
+
+	rc = out.rc;
+	if (rc == 0) {
+		*result = out.buf;
+		*result_len = out.len;
+		out.buf = NULL;
+	}
+
+out:
+	free(out.buf);
+	free(values);
+	free(scratch);
+	free(header);
+	free(row);
+	free(q);
+	return rc;
+}
+
+/* Host results */
+
+struct spdk_kv_select_result {
+	uint32_t					id;
+	char						*buf;
+	size_t						len;
+	TAILQ_ENTRY(spdk_kv_select_result)		link;
+};
+
+void
+spdk_kv_select_results_init(struct spdk_kv_select_results *results, uint32_t max_results,
+			    uint32_t id_flag)
+{
+	assert(max_results > 0);
+	assert(id_flag == 0 || spdk_u32_is_pow2(id_flag));
+
+	TAILQ_INIT(&results->results);
+	results->num_results = 0;
+	results->max_results = max_results;
+	results->id_flag = id_flag;
+	results->next_id = 0;
+}
+
+static struct spdk_kv_select_result *
+kv_select_result_find(struct spdk_kv_select_results *results, uint32_t id)
+{
+	struct spdk_kv_select_result *res;
+
+	TAILQ_FOREACH(res, &results->results, link) {
+		if (res->id == id) {
+			return res;
+		}
+	}
+	return NULL;
+}
+
+static void
+kv_select_result_free(struct spdk_kv_select_results *results, struct spdk_kv_select_result *res)
+{
+	TAILQ_REMOVE(&results->results, res, link);
+	results->num_results--;
+	free(res->buf);
+	free(res);
+}
+
+void
+spdk_kv_select_results_fini(struct spdk_kv_select_results *results)
+{
+	struct spdk_kv_select_result *res;
+
+	while ((res = TAILQ_FIRST(&results->results)) != NULL) {
+		kv_select_result_free(results, res);
+	}
+}
+
+int
+spdk_kv_select_results_add(struct spdk_kv_select_results *results, char *buf, size_t len,
+			   uint32_t *id)
+{
+	struct spdk_kv_select_result *res;
+	/* Ids stay below the flag bit, so they cannot run into the ids of other tables. */
+	uint32_t mask = results->id_flag ? results->id_flag - 1 : UINT32_MAX;
+
+	res = calloc(1, sizeof(*res));
+	if (res == NULL) {
+		free(buf);
+		return -ENOMEM;
+	}
+	res->buf = buf;
+	res->len = len;
+
+	if (results->num_results == results->max_results) {
+		/* Results that are never retrieved must not pile up forever. */
+		kv_select_result_free(results, TAILQ_FIRST(&results->results));
+	}
+	do {
+		res->id = (++results->next_id & mask) | results->id_flag;
+	} while ((res->id & mask) == 0 || kv_select_result_find(results, res->id) != NULL);
+	TAILQ_INSERT_TAIL(&results->results, res, link);
+	results->num_results++;
+
+	*id = res->id;
+	return 0;
+}
+
+int
+spdk_kv_select_results_read(struct spdk_kv_select_results *results, uint32_t id,
+			    uint64_t offset, uint8_t options, struct iovec *iovs, int iovcnt,
+			    uint64_t len, uint32_t *result_len)
+{
+	struct spdk_kv_select_result *res;
+
+	res = kv_select_result_find(results, id);
+	if (res == NULL) {
+		return -ENOENT;
+	}
+	if (offset > res->len) {
+		return -EINVAL;
+	}
+
+	spdk_copy_buf_to_iovs(iovs, iovcnt, res->buf + offset, spdk_min(len, res->len - offset));
+	*result_len = res->len;
+
+	if (options == 0 ||
+	    ((options & NVME_KV_SELECT_CMD_OPTION_DO_NOT_FREE_IF_NOT_ALL_DATA_FETCHED) &&
+	     offset + len >= res->len)) {
+		kv_select_result_free(results, res);
+	}
+	return 0;
+}
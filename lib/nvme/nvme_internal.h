@@ -368,6 +368,13 @@ struct nvme_request {
 	 */
 	struct spdk_nvme_cpl		parent_status;
 
+	/**
+	 * Offset of the lowest failed chunk of a split KV retrieve, relative to
+	 *  the retrieve offset, or UINT32_MAX if no chunk failed. The completion
+	 *  of that chunk is kept in cpl.
+	 */
+	uint32_t			kv_error_offset;
+
 	/**
 	 * The user_cb_fn and user_cb_arg fields are used for holding the original
 	 * callback data when using nvme_allocate_request_user_copy.
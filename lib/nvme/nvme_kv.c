@@ -15,6 +15,7 @@
  */
 static int
 _nvme_cmd_kv_add_key(struct spdk_nvme_cmd *cmd, unsigned char *key, size_t key_len, uint32_t flags) {
+	uint8_t padded[16];
 
 	if (key_len > 16) {
 		return -1;
@@ -39,12 +40,42 @@ _nvme_cmd_kv_add_key(struct spdk_nvme_cmd *cmd, unsigned char *key, size_t key_l
 			cmd->cdw11 = key_len & 0xff;
 	}
 
-	/* key stored in 4 dwords */
-	/* TODO - implement as loop for only key_len chars */
-	cmd->cdw15 = (uint32_t) key[3] | (uint32_t) (key[2] << 8) |(uint32_t) key[1] << 16 | (uint32_t) key[0] << 24;
-	cmd->cdw14 = (uint32_t) key[7] | (uint32_t) (key[6] << 8) |(uint32_t) key[5] << 16 | (uint32_t) key[4] << 24;
-	cmd->rsvd3 = (uint32_t) key[11] | (uint32_t) (key[10] << 8) |(uint32_t) key[9] << 16 | (uint32_t) key[8] << 24;
-	cmd->rsvd2 = (uint32_t) key[15] | (uint32_t) (key[14] << 8) |(uint32_t) key[13] << 16 | (uint32_t) key[12] << 24;
+	/* key stored big endian in 4 dwords, zero padded; only key_len bytes of key are read */
+	memset(padded, 0, sizeof(padded));
+	if (key_len > 0) {
+		memcpy(padded, key, key_len);
+	}
+	cmd->cdw15 = from_be32(&padded[0]);
+	cmd->cdw14 = from_be32(&padded[4]);
+	cmd->rsvd3 = from_be32(&padded[8]);
+	cmd->rsvd2 = from_be32(&padded[12]);
+
+	return 0;
+}
+
+/*
+ * Build the SGL payload of an _ext KV command. The extended options go with the
+ * payload so that the transport can translate a memory domain, as it does for
+ * spdk_nvme_ns_cmd_readv_ext(). KV commands carry no metadata.
+ */
+static int
+_nvme_kv_ext_payload(struct nvme_payload *payload, spdk_nvme_req_reset_sgl_cb reset_sgl_fn,
+		     spdk_nvme_req_next_sge_cb next_sge_fn, void *cb_arg,
+		     struct spdk_nvme_ns_cmd_ext_io_opts *opts, uint32_t *io_flags) {
+	if (reset_sgl_fn == NULL || next_sge_fn == NULL) {
+		return -EINVAL;
+	}
+
+	*payload = NVME_PAYLOAD_SGL(reset_sgl_fn, next_sge_fn, cb_arg, NULL);
+	*io_flags = 0;
+
+	if (opts) {
+		if (opts->metadata != NULL) {
+			return -EINVAL;
+		}
+		payload->opts = opts;
+		*io_flags = opts->io_flags;
+	}
 
 	return 0;
 }
@@ -97,6 +128,25 @@ spdk_nvme_ns_cmd_kvlistv(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *qpair,
 	return send_kvlist_request(ns, qpair, prefix, prefix_len, &payload, buffer_size, cb_fn, cb_arg, io_flags);
 }
 
+int
+spdk_nvme_ns_cmd_kvlistv_ext(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *qpair,
+			     unsigned char *prefix, size_t prefix_len, uint64_t buffer_size,
+			     spdk_nvme_cmd_cb cb_fn, void *cb_arg,
+			     spdk_nvme_req_reset_sgl_cb reset_sgl_fn,
+			     spdk_nvme_req_next_sge_cb next_sge_fn,
+			     struct spdk_nvme_ns_cmd_ext_io_opts *opts) {
+	struct nvme_payload	payload;
+	uint32_t		io_flags;
+	int			rc;
+
+	rc = _nvme_kv_ext_payload(&payload, reset_sgl_fn, next_sge_fn, cb_arg, opts, &io_flags);
+	if (rc != 0) {
+		return rc;
+	}
+
+	return send_kvlist_request(ns, qpair, prefix, prefix_len, &payload, buffer_size, cb_fn, cb_arg, io_flags);
+}
+
 int
 spdk_nvme_ns_cmd_kvdelete(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *qpair,
 			  unsigned char *key, size_t key_len,
@@ -151,16 +201,35 @@ spdk_nvme_ns_cmd_kvexist(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *qpair,
 	return nvme_qpair_submit_request(qpair, req);
 }
 
-static int send_kvstore_request(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *qpair,
-			 unsigned char *key, size_t key_len,
-			 struct nvme_payload *payload, uint64_t buffer_size,
-			 spdk_nvme_cmd_cb cb_fn, void *cb_arg,
-			 uint8_t store_flags, uint32_t io_flags) {
-	int rc;
-	struct nvme_request	*req;
-	struct spdk_nvme_cmd	*cmd;
+/*
+ * Largest value chunk that can be carried by a single KV command. The
+ * transfer size lives in the 32-bit cdw10, and the controller further
+ * limits it to MDTS.
+ */
+static inline uint32_t
+_nvme_kv_max_xfer_size(struct spdk_nvme_ns *ns) {
+	uint32_t max_xfer_size = ns->ctrlr->max_xfer_size;
 
-	/* validate storage flags */
+	return max_xfer_size ? max_xfer_size : UINT32_MAX;
+}
+
+/*
+ * Point a request at the chunk of the caller's payload starting at the given
+ * byte offset. Contiguous buffers are rebased directly so that values larger
+ * than 4 GiB can be addressed; SGL payloads rely on payload_offset being
+ * handed back to the caller's reset_sgl_fn.
+ */
+static inline void
+_nvme_kv_request_set_payload_offset(struct nvme_request *req, uint64_t offset) {
+	if (nvme_payload_type(&req->payload) == NVME_PAYLOAD_TYPE_CONTIG) {
+		req->payload.contig_or_cb_arg = (uint8_t *)req->payload.contig_or_cb_arg + offset;
+	} else {
+		req->payload_offset = (uint32_t)offset;
+	}
+}
+
+static int
+_nvme_kv_validate_store_flags(uint8_t store_flags) {
 	if (store_flags & ~SPDK_NVME_KV_STORE_FLAG_VALID_MASK) {
 		SPDK_ERRLOG("Invalid store_flags 0x%x\n", store_flags);
 		return -1;
@@ -169,25 +238,177 @@ static int send_kvstore_request(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair
 		return -1;
 	}
 
-	req = nvme_allocate_request(qpair, payload, buffer_size, 0, cb_fn, cb_arg);
+	return 0;
+}
+
+static struct nvme_request *
+_nvme_kv_allocate_store_request(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *qpair,
+			 unsigned char *key, size_t key_len,
+			 struct nvme_payload *payload, uint64_t payload_offset, uint32_t chunk_size,
+			 spdk_nvme_cmd_cb cb_fn, void *cb_arg, uint8_t store_flags, int *rc) {
+	struct nvme_request	*req;
+	struct spdk_nvme_cmd	*cmd;
+
+	req = nvme_allocate_request(qpair, payload, chunk_size, 0, cb_fn, cb_arg);
 	if (req == NULL) {
-		return -ENOMEM;
+		*rc = -ENOMEM;
+		return NULL;
 	}
+	_nvme_kv_request_set_payload_offset(req, payload_offset);
 
 	cmd = &req->cmd;
 	cmd->opc = SPDK_NVME_OPC_KV_STORE;
 	cmd->nsid = ns->id;
 
-	rc = _nvme_cmd_kv_add_key(cmd, key, key_len, store_flags);
-	if (rc != 0) {
+	if (_nvme_cmd_kv_add_key(cmd, key, key_len, store_flags) != 0) {
+		nvme_free_request(req);
+		*rc = -EINVAL;
+		return NULL;
+	}
+
+	cmd->cdw10 = chunk_size;
+
+	return req;
+}
+
+/*
+ * A store larger than MDTS is written as an initial store carrying the
+ * caller's flags followed by APPEND stores for the remaining chunks.
+ * NVMe does not order commands within a queue, so each append is only
+ * submitted once the previous chunk has completed. The requests for all of
+ * the chunks are allocated up front, like the children of a split retrieve,
+ * so running out of requests is reported to the caller before anything has
+ * been written rather than part way through the value.
+ */
+struct _kvstore_split_ctx {
+	STAILQ_HEAD(, nvme_request)	reqs;
+	struct spdk_nvme_qpair		*qpair;
+	spdk_nvme_cmd_cb		cb_fn;
+	void				*cb_arg;
+};
+
+static void
+_kvstore_split_free(struct _kvstore_split_ctx *ctx) {
+	struct nvme_request	*req;
+
+	while ((req = STAILQ_FIRST(&ctx->reqs)) != NULL) {
+		STAILQ_REMOVE_HEAD(&ctx->reqs, stailq);
+		nvme_free_request(req);
+	}
+	free(ctx);
+}
+
+static int
+_kvstore_split_submit_next(struct _kvstore_split_ctx *ctx) {
+	struct nvme_request	*req;
+
+	req = STAILQ_FIRST(&ctx->reqs);
+	STAILQ_REMOVE_HEAD(&ctx->reqs, stailq);
+
+	return nvme_qpair_submit_request(ctx->qpair, req);
+}
+
+static void
+_kvstore_split_cb(void *arg, const struct spdk_nvme_cpl *cpl) {
+	struct _kvstore_split_ctx	*ctx = arg;
+	struct spdk_nvme_cpl		err_cpl;
+
+	if (!spdk_nvme_cpl_is_error(cpl) && !STAILQ_EMPTY(&ctx->reqs)) {
+		if (_kvstore_split_submit_next(ctx) == 0) {
+			return;
+		}
+		memset(&err_cpl, 0, sizeof(err_cpl));
+		err_cpl.status.sct = SPDK_NVME_SCT_GENERIC;
+		err_cpl.status.sc = SPDK_NVME_SC_INTERNAL_DEVICE_ERROR;
+		cpl = &err_cpl;
+	}
+
+	ctx->cb_fn(ctx->cb_arg, cpl);
+	_kvstore_split_free(ctx);
+}
+
+static int
+_nvme_kv_split_store(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *qpair,
+		     unsigned char *key, size_t key_len,
+		     struct nvme_payload *payload, uint64_t buffer_size, uint32_t chunk_size,
+		     spdk_nvme_cmd_cb cb_fn, void *cb_arg, uint8_t store_flags) {
+	struct _kvstore_split_ctx	*ctx;
+	struct nvme_request		*req;
+	uint64_t			payload_offset = 0;
+	uint32_t			size;
+	int				rc = 0;
+
+	if (nvme_payload_type(payload) == NVME_PAYLOAD_TYPE_SGL && buffer_size > UINT32_MAX) {
+		/* payload_offset handed to reset_sgl_fn is only 32 bits wide */
 		return -EINVAL;
 	}
 
-	cmd->cdw10 = buffer_size;
+	ctx = calloc(1, sizeof(*ctx));
+	if (ctx == NULL) {
+		return -ENOMEM;
+	}
 
-	return nvme_qpair_submit_request(qpair, req);
+	STAILQ_INIT(&ctx->reqs);
+	ctx->qpair = qpair;
+	ctx->cb_fn = cb_fn;
+	ctx->cb_arg = cb_arg;
+
+	while (payload_offset < buffer_size) {
+		size = spdk_min(buffer_size - payload_offset, chunk_size);
+
+		req = _nvme_kv_allocate_store_request(ns, qpair, key, key_len, payload,
+						      payload_offset, size, _kvstore_split_cb, ctx,
+						      payload_offset == 0 ? store_flags :
+						      SPDK_NVME_KV_STORE_FLAG_APPEND, &rc);
+		if (req == NULL) {
+			_kvstore_split_free(ctx);
+			if (rc == -ENOMEM &&
+			    buffer_size / chunk_size >= qpair->ctrlr->opts.io_queue_requests) {
+				/* can never be satisfied, see nvme_ns_map_failure_rc() */
+				rc = -EINVAL;
+			}
+			return rc;
+		}
+
+		STAILQ_INSERT_TAIL(&ctx->reqs, req, stailq);
+		payload_offset += size;
+	}
+
+	rc = _kvstore_split_submit_next(ctx);
+	if (rc != 0) {
+		_kvstore_split_free(ctx);
+	}
+
+	return rc;
 }
 
+static int send_kvstore_request(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *qpair,
+			 unsigned char *key, size_t key_len,
+			 struct nvme_payload *payload, uint64_t buffer_size,
+			 spdk_nvme_cmd_cb cb_fn, void *cb_arg,
+			 uint8_t store_flags, uint32_t io_flags) {
+	int rc = 0;
+	struct nvme_request	*req;
+	uint32_t		max_xfer_size = _nvme_kv_max_xfer_size(ns);
+
+	/* validate storage flags */
+	if (_nvme_kv_validate_store_flags(store_flags) != 0) {
+		return -1;
+	}
+
+	if (buffer_size > max_xfer_size) {
+		return _nvme_kv_split_store(ns, qpair, key, key_len, payload, buffer_size,
+					    max_xfer_size, cb_fn, cb_arg, store_flags);
+	}
+
+	req = _nvme_kv_allocate_store_request(ns, qpair, key, key_len, payload, 0, buffer_size,
+					      cb_fn, cb_arg, store_flags, &rc);
+	if (req == NULL) {
+		return rc;
+	}
+
+	return nvme_qpair_submit_request(qpair, req);
+}
 
 int
 spdk_nvme_ns_cmd_kvstore(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *qpair,
@@ -215,29 +436,186 @@ spdk_nvme_ns_cmd_kvstorev(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *qpair
 	return send_kvstore_request(ns, qpair, key, key_len, &payload, buffer_size, cb_fn, cb_arg, store_flags, io_flags);
 }
 
-static int send_kvretrieve_request(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *qpair,
+int
+spdk_nvme_ns_cmd_kvstorev_ext(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *qpair,
+			      unsigned char *key, size_t key_len,
+			      uint64_t buffer_size,
+			      spdk_nvme_cmd_cb cb_fn, void *cb_arg,
+			      uint8_t store_flags,
+			      spdk_nvme_req_reset_sgl_cb reset_sgl_fn,
+			      spdk_nvme_req_next_sge_cb next_sge_fn,
+			      struct spdk_nvme_ns_cmd_ext_io_opts *opts) {
+	struct nvme_payload	payload;
+	uint32_t		io_flags;
+	int			rc;
+
+	rc = _nvme_kv_ext_payload(&payload, reset_sgl_fn, next_sge_fn, cb_arg, opts, &io_flags);
+	if (rc != 0) {
+		return rc;
+	}
+
+	return send_kvstore_request(ns, qpair, key, key_len, &payload, buffer_size, cb_fn, cb_arg, store_flags, io_flags);
+}
+
+static struct nvme_request *
+_nvme_kv_allocate_retrieve_request(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *qpair,
 			    unsigned char *key, size_t key_len,
-			    struct nvme_payload *payload, uint64_t buffer_size,
-			    spdk_nvme_cmd_cb cb_fn, void *cb_arg,
-					uint64_t offset, uint32_t io_flags) {
-	int rc;
+			    struct nvme_payload *payload, uint64_t payload_offset, uint32_t chunk_size,
+			    spdk_nvme_cmd_cb cb_fn, void *cb_arg, uint64_t offset, int *rc) {
 	struct nvme_request	*req;
 	struct spdk_nvme_cmd	*cmd;
-	req = nvme_allocate_request(qpair, payload, buffer_size, 0, cb_fn, cb_arg);
+
+	req = nvme_allocate_request(qpair, payload, chunk_size, 0, cb_fn, cb_arg);
 	if (req == NULL) {
-		return -ENOMEM;
+		*rc = -ENOMEM;
+		return NULL;
 	}
+	_nvme_kv_request_set_payload_offset(req, payload_offset);
 
 	cmd = &req->cmd;
 	cmd->opc = SPDK_NVME_OPC_KV_RETRIEVE;
 	cmd->nsid = ns->id;
 
-	rc = _nvme_cmd_kv_add_key(cmd, key, key_len, 0);
-	if (rc != 0) {
-		return -EINVAL;
+	if (_nvme_cmd_kv_add_key(cmd, key, key_len, 0) != 0) {
+		nvme_free_request(req);
+		*rc = -EINVAL;
+		return NULL;
 	}
 	cmd->cdw12 = offset;
-	cmd->cdw10 = buffer_size;
+	cmd->cdw10 = chunk_size;
+
+	return req;
+}
+
+/*
+ * If submitting the children of a split retrieve failed part way, the chunks
+ * that were not submitted are missing, so the retrieve must fail whatever the
+ * submitted ones report. nvme_qpair_submit_request() marks that by setting an
+ * error in the parent's cpl, which no chunk has claimed.
+ */
+static inline bool
+_nvme_kv_retrieve_submit_failed(struct nvme_request *parent) {
+	return parent->kv_error_offset == UINT32_MAX && spdk_nvme_cpl_is_error(&parent->cpl);
+}
+
+/*
+ * Completion for one chunk of a split retrieve. The device reports the total
+ * value length in cdw0 and the parent hands that back to the caller, exactly
+ * as for an unsplit retrieve. Callers routinely pass buffers larger than the
+ * value, so a chunk that starts beyond the end of the value is allowed to
+ * fail; only the lowest failing chunk is remembered and the parent fails only
+ * if that chunk lies within the value.
+ */
+static void
+_nvme_kv_retrieve_child_cb(void *child_arg, const struct spdk_nvme_cpl *cpl) {
+	struct nvme_request	*child = child_arg;
+	struct nvme_request	*parent = child->parent;
+	uint32_t		chunk_offset = child->cmd.cdw12 - parent->cmd.cdw12;
+
+	nvme_request_remove_child(parent, child);
+
+	if (!spdk_nvme_cpl_is_error(cpl)) {
+		parent->parent_status.cdw0 = cpl->cdw0;
+	} else if (chunk_offset <= parent->kv_error_offset &&
+		   !_nvme_kv_retrieve_submit_failed(parent)) {
+		parent->kv_error_offset = chunk_offset;
+		memcpy(&parent->cpl, cpl, sizeof(*cpl));
+	}
+
+	if (parent->num_children != 0) {
+		return;
+	}
+
+	if (_nvme_kv_retrieve_submit_failed(parent) ||
+	    (parent->kv_error_offset != UINT32_MAX &&
+	     (parent->kv_error_offset == 0 ||
+	      parent->cmd.cdw12 + parent->kv_error_offset < parent->parent_status.cdw0))) {
+		nvme_complete_request(parent->cb_fn, parent->cb_arg, parent->qpair,
+				      parent, &parent->cpl);
+	} else {
+		nvme_complete_request(parent->cb_fn, parent->cb_arg, parent->qpair,
+				      parent, &parent->parent_status);
+	}
+	nvme_free_request(parent);
+}
+
+/*
+ * Split a retrieve larger than MDTS into offset-advancing child retrieves,
+ * the same way _nvme_ns_cmd_split_request() does for block I/O. All of the
+ * children are submitted together when the parent is submitted.
+ */
+static struct nvme_request *
+_nvme_kv_split_retrieve(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *qpair,
+			unsigned char *key, size_t key_len,
+			struct nvme_payload *payload, uint64_t buffer_size, uint32_t chunk_size,
+			spdk_nvme_cmd_cb cb_fn, void *cb_arg, uint64_t offset, int *rc) {
+	struct nvme_request	*parent, *child;
+	uint64_t		payload_offset = 0;
+	uint32_t		size;
+
+	parent = nvme_allocate_request(qpair, payload, 0, 0, cb_fn, cb_arg);
+	if (parent == NULL) {
+		*rc = -ENOMEM;
+		return NULL;
+	}
+
+	/* Only kept for the child completion path, the parent itself is never submitted. */
+	parent->cmd.opc = SPDK_NVME_OPC_KV_RETRIEVE;
+	parent->cmd.cdw12 = offset;
+	parent->kv_error_offset = UINT32_MAX;
+	memset(&parent->cpl, 0, sizeof(parent->cpl));
+
+	while (payload_offset < buffer_size) {
+		size = spdk_min(buffer_size - payload_offset, chunk_size);
+
+		child = _nvme_kv_allocate_retrieve_request(ns, qpair, key, key_len, payload,
+				payload_offset, size, NULL, NULL,
+				offset + payload_offset, rc);
+		if (child == NULL) {
+			nvme_request_free_children(parent);
+			nvme_free_request(parent);
+			return NULL;
+		}
+
+		nvme_request_add_child(parent, child);
+		child->cb_fn = _nvme_kv_retrieve_child_cb;
+
+		payload_offset += size;
+	}
+
+	return parent;
+}
+
+static int send_kvretrieve_request(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *qpair,
+			    unsigned char *key, size_t key_len,
+			    struct nvme_payload *payload, uint64_t buffer_size,
+			    spdk_nvme_cmd_cb cb_fn, void *cb_arg,
+					uint64_t offset, uint32_t io_flags) {
+	int rc = 0;
+	struct nvme_request	*req;
+	uint32_t		max_xfer_size = _nvme_kv_max_xfer_size(ns);
+
+	/* the value offset is carried in the 32-bit cdw12 */
+	if (offset + buffer_size > (uint64_t)UINT32_MAX + 1) {
+		return -EINVAL;
+	}
+
+	if (buffer_size > max_xfer_size) {
+		req = _nvme_kv_split_retrieve(ns, qpair, key, key_len, payload, buffer_size,
+					      max_xfer_size, cb_fn, cb_arg, offset, &rc);
+		if (req == NULL && rc == -ENOMEM &&
+		    buffer_size / max_xfer_size >= qpair->ctrlr->opts.io_queue_requests) {
+			/* can never be satisfied, see nvme_ns_map_failure_rc() */
+			rc = -EINVAL;
+		}
+	} else {
+		req = _nvme_kv_allocate_retrieve_request(ns, qpair, key, key_len, payload, 0,
+				buffer_size, cb_fn, cb_arg, offset, &rc);
+	}
+
+	if (req == NULL) {
+		return rc;
+	}
 
 	return nvme_qpair_submit_request(qpair, req);
 }
@@ -268,6 +646,27 @@ spdk_nvme_ns_cmd_kvretrievev(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *qp
 	return send_kvretrieve_request(ns, qpair, key, key_len, &payload, buffer_size, cb_fn, cb_arg, offset, io_flags);
 }
 
+int
+spdk_nvme_ns_cmd_kvretrievev_ext(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *qpair,
+				 unsigned char *key, size_t key_len,
+				 uint64_t buffer_size,
+				 spdk_nvme_cmd_cb cb_fn, void *cb_arg,
+				 uint64_t offset,
+				 spdk_nvme_req_reset_sgl_cb reset_sgl_fn,
+				 spdk_nvme_req_next_sge_cb next_sge_fn,
+				 struct spdk_nvme_ns_cmd_ext_io_opts *opts) {
+	struct nvme_payload	payload;
+	uint32_t		io_flags;
+	int			rc;
+
+	rc = _nvme_kv_ext_payload(&payload, reset_sgl_fn, next_sge_fn, cb_arg, opts, &io_flags);
+	if (rc != 0) {
+		return rc;
+	}
+
+	return send_kvretrieve_request(ns, qpair, key, key_len, &payload, buffer_size, cb_fn, cb_arg, offset, io_flags);
+}
+
 struct _kvselect_send_cb_internal_ctx {
 	char *buffer;
 	spdk_nvme_cmd_cb cb_fn;
@@ -370,6 +769,39 @@ spdk_nvme_ns_cmd_kvselect_sendv(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair
 	return send_kvselect_send_request(ns, qpair, key, key_len, &payload, query_len, input_type, output_type, header_opts, _kvselect_send_cb_internal, io_flags, _ctx);
 }
 
+int
+spdk_nvme_ns_cmd_kvselect_sendv_ext(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *qpair,
+				    unsigned char *key, size_t key_len, uint64_t query_len,
+				    spdk_nvme_kv_datatype input_type, spdk_nvme_kv_datatype output_type,
+				    uint8_t header_opts, spdk_nvme_cmd_cb cb_fn, void *cb_arg,
+				    spdk_nvme_req_reset_sgl_cb reset_sgl_fn,
+				    spdk_nvme_req_next_sge_cb next_sge_fn,
+				    struct spdk_nvme_ns_cmd_ext_io_opts *opts) {
+	struct _kvselect_send_cb_internal_ctx	*_ctx;
+	struct nvme_payload			payload;
+	uint32_t				io_flags;
+	int					rc;
+
+	rc = _nvme_kv_ext_payload(&payload, reset_sgl_fn, next_sge_fn, cb_arg, opts, &io_flags);
+	if (rc != 0) {
+		return rc;
+	}
+
+	_ctx = calloc(1, sizeof(*_ctx));
+	if (_ctx == NULL) {
+		return -ENOMEM;
+	}
+	_ctx->cb_fn = cb_fn;
+	_ctx->cb_arg = cb_arg;
+
+	rc = send_kvselect_send_request(ns, qpair, key, key_len, &payload, query_len, input_type, output_type, header_opts, _kvselect_send_cb_internal, io_flags, _ctx);
+	if (rc != 0) {
+		free(_ctx);
+	}
+
+	return rc;
+}
+
 static int send_kvselect_retrieve_request(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *qpair,
 				   uint32_t select_id, uint32_t offset, struct nvme_payload *payload,
 				   uint32_t buffer_size, spdk_nvme_kv_select_opts opts,
@@ -416,4 +848,24 @@ spdk_nvme_ns_cmd_kvselect_retrievev(struct spdk_nvme_ns *ns, struct spdk_nvme_qp
 	struct nvme_payload	payload;
 	payload = NVME_PAYLOAD_SGL(reset_sgl_fn, next_sge_fn, cb_arg, NULL);
 	return send_kvselect_retrieve_request(ns, qpair, select_id, offset, &payload, buffer_size, opts, cb_fn, cb_arg, io_flags);
+}
+
+int
+spdk_nvme_ns_cmd_kvselect_retrievev_ext(struct spdk_nvme_ns *ns, struct spdk_nvme_qpair *qpair,
+					uint32_t select_id, uint32_t offset,
+					uint32_t buffer_size, spdk_nvme_kv_select_opts select_opts,
+					spdk_nvme_cmd_cb cb_fn, void *cb_arg,
+					spdk_nvme_req_reset_sgl_cb reset_sgl_fn,
+					spdk_nvme_req_next_sge_cb next_sge_fn,
+					struct spdk_nvme_ns_cmd_ext_io_opts *opts) {
+	struct nvme_payload	payload;
+	uint32_t		io_flags;
+	int			rc;
+
+	rc = _nvme_kv_ext_payload(&payload, reset_sgl_fn, next_sge_fn, cb_arg, opts, &io_flags);
+	if (rc != 0) {
+		return rc;
+	}
+
+	return send_kvselect_retrieve_request(ns, qpair, select_id, offset, &payload, buffer_size, select_opts, cb_fn, cb_arg, io_flags);
 }
\ No newline at end of file
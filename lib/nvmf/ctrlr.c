@@ -15,6 +15,7 @@
 #include "spdk/endian.h"
 #include "spdk/thread.h"
 #include "spdk/nvme_spec.h"
+#include "spdk/nvme_kv.h"
 #include "spdk/nvmf_cmd.h"
 #include "spdk/string.h"
 #include "spdk/util.h"
@@ -2456,6 +2457,7 @@ nvmf_get_cmds_and_effects_log_page(struct spdk_nvmf_ctrlr *ctrlr, struct iovec *
 	size_t copy_len = 0;
 	struct copy_iovs_ctx copy_ctx;
 	struct spdk_nvme_cmds_and_effect_log_page cmds_and_effect_log_page = g_cmds_and_effect_log_page;
+	struct spdk_nvme_cmds_and_effect_entry csupp_effect_entry = {1, 0, 0, 0, 0, 0, 0, 0};
 	struct spdk_nvme_cmds_and_effect_entry csupp_and_lbcc_effect_entry = {1, 1, 0, 0, 0, 0, 0, 0};
 
 	_init_copy_iovs_ctx(&copy_ctx, iovs, iovcnt);
@@ -2465,6 +2467,19 @@ nvmf_get_cmds_and_effects_log_page(struct spdk_nvmf_ctrlr *ctrlr, struct iovec *
 			cmds_and_effect_log_page.io_cmds_supported[SPDK_NVME_OPC_ZONE_APPEND] =
 				csupp_and_lbcc_effect_entry;
 		}
+		if (nvmf_ctrlr_kv_supported(ctrlr)) {
+			cmds_and_effect_log_page.io_cmds_supported[SPDK_NVME_OPC_KV_LIST] = csupp_effect_entry;
+			cmds_and_effect_log_page.io_cmds_supported[SPDK_NVME_OPC_KV_DELETE] =
+				csupp_and_lbcc_effect_entry;
+			cmds_and_effect_log_page.io_cmds_supported[SPDK_NVME_OPC_KV_EXIST] = csupp_effect_entry;
+			cmds_and_effect_log_page.io_cmds_supported[SPDK_NVME_OPC_KV_STORE] =
+				csupp_and_lbcc_effect_entry;
+			cmds_and_effect_log_page.io_cmds_supported[SPDK_NVME_OPC_KV_RETRIEVE] = csupp_effect_entry;
+			cmds_and_effect_log_page.io_cmds_supported[SPDK_NVME_OPC_KV_SEND_SELECT] =
+				csupp_effect_entry;
+			cmds_and_effect_log_page.io_cmds_supported[SPDK_NVME_OPC_KV_RETRIEVE_SELECT] =
+				csupp_effect_entry;
+		}
 		copy_len = spdk_min(page_size - offset, length);
 		_copy_buf_to_iovs(&copy_ctx, (char *)(&cmds_and_effect_log_page) + offset, copy_len);
 	}
@@ -4271,6 +4286,14 @@ nvmf_ctrlr_process_io_cmd(struct spdk_nvmf_request *req)
 			return SPDK_NVMF_REQUEST_EXEC_STATUS_ASYNCHRONOUS;
 		case SPDK_NVME_OPC_COPY:
 			return nvmf_bdev_ctrlr_copy_cmd(bdev, desc, ch, req);
+		case SPDK_NVME_OPC_KV_LIST:
+		case SPDK_NVME_OPC_KV_DELETE:
+		case SPDK_NVME_OPC_KV_EXIST:
+		case SPDK_NVME_OPC_KV_STORE:
+		case SPDK_NVME_OPC_KV_RETRIEVE:
+		case SPDK_NVME_OPC_KV_SEND_SELECT:
+		case SPDK_NVME_OPC_KV_RETRIEVE_SELECT:
+			return nvmf_bdev_ctrlr_kv_cmd(bdev, desc, ch, req);
 		default:
 			return nvmf_bdev_ctrlr_nvme_passthru_io(bdev, desc, ch, req);
 		}
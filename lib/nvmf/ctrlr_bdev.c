@@ -13,6 +13,7 @@
 #include "spdk/thread.h"
 #include "spdk/likely.h"
 #include "spdk/nvme.h"
+#include "spdk/nvme_kv.h"
 #include "spdk/nvmf_cmd.h"
 #include "spdk/nvmf_spec.h"
 #include "spdk/trace.h"
@@ -66,6 +67,12 @@ nvmf_ctrlr_copy_supported(struct spdk_nvmf_ctrlr *ctrlr)
 	return nvmf_subsystem_bdev_io_type_supported(ctrlr->subsys, SPDK_BDEV_IO_TYPE_COPY);
 }
 
+bool
+nvmf_ctrlr_kv_supported(struct spdk_nvmf_ctrlr *ctrlr)
+{
+	return nvmf_subsystem_bdev_io_type_supported(ctrlr->subsys, SPDK_BDEV_IO_KV_STORE);
+}
+
 static void
 nvmf_bdev_ctrlr_complete_cmd(struct spdk_bdev_io *bdev_io, bool success,
 			     void *cb_arg)
@@ -726,6 +733,146 @@ nvmf_bdev_ctrlr_copy_cmd(struct spdk_bdev *bdev, struct spdk_bdev_desc *desc,
 	return SPDK_NVMF_REQUEST_EXEC_STATUS_ASYNCHRONOUS;
 }
 
+static enum spdk_bdev_io_type
+nvmf_bdev_ctrlr_kv_io_type(uint8_t opc)
+{
+	switch (opc) {
+	case SPDK_NVME_OPC_KV_LIST:
+		return SPDK_BDEV_IO_KV_LIST;
+	case SPDK_NVME_OPC_KV_DELETE:
+		return SPDK_BDEV_IO_KV_DELETE;
+	case SPDK_NVME_OPC_KV_EXIST:
+		return SPDK_BDEV_IO_KV_EXIST;
+	case SPDK_NVME_OPC_KV_STORE:
+		return SPDK_BDEV_IO_KV_STORE;
+	case SPDK_NVME_OPC_KV_RETRIEVE:
+		return SPDK_BDEV_IO_KV_RETRIEVE;
+	case SPDK_NVME_OPC_KV_SEND_SELECT:
+		return SPDK_BDEV_IO_KV_SEND_SELECT;
+	case SPDK_NVME_OPC_KV_RETRIEVE_SELECT:
+		return SPDK_BDEV_IO_KV_RETRIEVE_SELECT;
+	default:
+		return SPDK_BDEV_IO_TYPE_INVALID;
+	}
+}
+
+/*
+ * The key is carried most significant byte first in CDW15, CDW14, CDW3 and
+ * CDW2, and its length in CDW11 bits 07:00.
+ */
+static void
+nvmf_bdev_ctrlr_get_kv_key(const struct spdk_nvme_cmd *cmd, unsigned char *key)
+{
+	to_be32(&key[0], cmd->cdw15);
+	to_be32(&key[4], cmd->cdw14);
+	to_be32(&key[8], cmd->rsvd3);
+	to_be32(&key[12], cmd->rsvd2);
+}
+
+static bool
+nvmf_bdev_ctrlr_kv_query_terminated(struct spdk_nvmf_request *req, uint32_t query_len)
+{
+	/* A single buffer is handed to the backend as a C string */
+	if (req->iovcnt != 1) {
+		return true;
+	}
+
+	return memchr(req->iov[0].iov_base, '\0', spdk_min(query_len, req->iov[0].iov_len)) != NULL;
+}
+
+int
+nvmf_bdev_ctrlr_kv_cmd(struct spdk_bdev *bdev, struct spdk_bdev_desc *desc,
+		       struct spdk_io_channel *ch, struct spdk_nvmf_request *req)
+{
+	struct spdk_nvme_cmd *cmd = &req->cmd->nvme_cmd;
+	struct spdk_nvme_cpl *response = &req->rsp->nvme_cpl;
+	enum spdk_bdev_io_type io_type = nvmf_bdev_ctrlr_kv_io_type(cmd->opc);
+	unsigned char key[NVME_KV_MAX_KEY_LENGTH];
+	uint32_t key_len = cmd->cdw11 & 0xff;
+	uint32_t nbytes = cmd->cdw10;
+	int rc;
+
+	assert(io_type != SPDK_BDEV_IO_TYPE_INVALID);
+
+	/* Keep forwarding the raw command to bdevs that do not implement the KV API */
+	if (!spdk_bdev_io_type_supported(bdev, io_type)) {
+		return nvmf_bdev_ctrlr_nvme_passthru_io(bdev, desc, ch, req);
+	}
+
+	if (io_type != SPDK_BDEV_IO_KV_RETRIEVE_SELECT) {
+		if (spdk_unlikely(key_len > NVME_KV_MAX_KEY_LENGTH ||
+				  (key_len == 0 && io_type != SPDK_BDEV_IO_KV_LIST))) {
+			response->status.sct = SPDK_NVME_SCT_GENERIC;
+			response->status.sc = SPDK_NVME_SC_INVALID_KEY_SIZE;
+			response->status.dnr = 1;
+			return SPDK_NVMF_REQUEST_EXEC_STATUS_COMPLETE;
+		}
+		nvmf_bdev_ctrlr_get_kv_key(cmd, key);
+	}
+
+	if (io_type != SPDK_BDEV_IO_KV_DELETE && io_type != SPDK_BDEV_IO_KV_EXIST &&
+	    spdk_unlikely(nbytes > req->length)) {
+		SPDK_ERRLOG("KV opcode 0x%x length %" PRIu32 " > SGL length %" PRIu32 "\n",
+			    cmd->opc, nbytes, req->length);
+		response->status.sct = SPDK_NVME_SCT_GENERIC;
+		response->status.sc = SPDK_NVME_SC_DATA_SGL_LENGTH_INVALID;
+		return SPDK_NVMF_REQUEST_EXEC_STATUS_COMPLETE;
+	}
+
+	switch (io_type) {
+	case SPDK_BDEV_IO_KV_LIST:
+		rc = spdk_bdev_kv_listv(desc, ch, key, key_len, req->iov, req->iovcnt, nbytes,
+					nvmf_bdev_ctrlr_complete_cmd, req);
+		break;
+	case SPDK_BDEV_IO_KV_DELETE:
+		rc = spdk_bdev_kv_delete(desc, ch, key, key_len, nvmf_bdev_ctrlr_complete_cmd, req);
+		break;
+	case SPDK_BDEV_IO_KV_EXIST:
+		rc = spdk_bdev_kv_exist(desc, ch, key, key_len, nvmf_bdev_ctrlr_complete_cmd, req);
+		break;
+	case SPDK_BDEV_IO_KV_STORE:
+		rc = spdk_bdev_kv_storev(desc, ch, key, key_len, req->iov, req->iovcnt, nbytes,
+					 (cmd->cdw11 >> 8) & 0xff, nvmf_bdev_ctrlr_complete_cmd, req);
+		break;
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+		rc = spdk_bdev_kv_retrievev(desc, ch, key, key_len, req->iov, req->iovcnt, cmd->cdw12,
+					    nbytes, nvmf_bdev_ctrlr_complete_cmd, req);
+		break;
+	case SPDK_BDEV_IO_KV_SEND_SELECT:
+		if (spdk_unlikely(!nvmf_bdev_ctrlr_kv_query_terminated(req, nbytes))) {
+			response->status.sct = SPDK_NVME_SCT_GENERIC;
+			response->status.sc = SPDK_NVME_SC_INVALID_FIELD;
+			response->status.dnr = 1;
+			return SPDK_NVMF_REQUEST_EXEC_STATUS_COMPLETE;
+		}
+		rc = spdk_bdev_kv_send_selectv(desc, ch, key, key_len, req->iov, req->iovcnt, nbytes,
+					       (cmd->cdw11 >> 8) & 0xff, (cmd->cdw11 >> 16) & 0xff,
+					       cmd->cdw11 >> 24, nvmf_bdev_ctrlr_complete_cmd, req);
+		break;
+	case SPDK_BDEV_IO_KV_RETRIEVE_SELECT:
+		rc = spdk_bdev_kv_retrieve_selectv(desc, ch, req->iov, req->iovcnt, cmd->cdw12, nbytes,
+						   cmd->cdw13, cmd->cdw11 & 0xff,
+						   nvmf_bdev_ctrlr_complete_cmd, req);
+		break;
+	default:
+		rc = -EINVAL;
+		break;
+	}
+
+	if (spdk_unlikely(rc)) {
+		if (rc == -ENOMEM) {
+			nvmf_bdev_ctrl_queue_io(req, bdev, ch, nvmf_ctrlr_process_io_cmd_resubmit, req);
+			return SPDK_NVMF_REQUEST_EXEC_STATUS_ASYNCHRONOUS;
+		}
+		response->status.sct = SPDK_NVME_SCT_GENERIC;
+		response->status.sc = rc == -EINVAL ? SPDK_NVME_SC_INVALID_FIELD :
+				      SPDK_NVME_SC_INTERNAL_DEVICE_ERROR;
+		return SPDK_NVMF_REQUEST_EXEC_STATUS_COMPLETE;
+	}
+
+	return SPDK_NVMF_REQUEST_EXEC_STATUS_ASYNCHRONOUS;
+}
+
 int
 nvmf_bdev_ctrlr_nvme_passthru_io(struct spdk_bdev *bdev, struct spdk_bdev_desc *desc,
 				 struct spdk_io_channel *ch, struct spdk_nvmf_request *req)
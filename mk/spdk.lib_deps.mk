@@ -50,6 +50,7 @@ endif
 DEPDIRS-blob := log util thread dma
 DEPDIRS-accel := log util thread json rpc jsonrpc dma
 DEPDIRS-jsonrpc := log util json
+DEPDIRS-kv_select := log util json
 DEPDIRS-virtio := log util json thread vfio_user
 
 DEPDIRS-lvol := log util blob
@@ -140,6 +141,14 @@ DEPDIRS-bdev_compress := $(BDEV_DEPS_THREAD) reduce accel
 DEPDIRS-bdev_crypto := $(BDEV_DEPS_THREAD) accel
 DEPDIRS-bdev_delay := $(BDEV_DEPS_THREAD)
 DEPDIRS-bdev_iscsi := $(BDEV_DEPS_THREAD)
+DEPDIRS-bdev_kv_append := $(BDEV_DEPS_THREAD)
+DEPDIRS-bdev_kv_cache := $(BDEV_DEPS_THREAD)
+DEPDIRS-bdev_kv_compress := $(BDEV_DEPS_THREAD) accel kv_select
+DEPDIRS-bdev_kv_crc := $(BDEV_DEPS_THREAD) accel kv_select
+DEPDIRS-bdev_kv_emu := $(BDEV_DEPS_THREAD) kv_select
+DEPDIRS-bdev_kv_mirror := $(BDEV_DEPS_THREAD)
+DEPDIRS-bdev_kv_shard := $(BDEV_DEPS_THREAD)
+DEPDIRS-bdev_kv_zns := $(BDEV_DEPS_THREAD) kv_select
 DEPDIRS-bdev_malloc := $(BDEV_DEPS_THREAD) accel
 DEPDIRS-bdev_null := $(BDEV_DEPS_THREAD)
 DEPDIRS-bdev_nvme = $(BDEV_DEPS_THREAD) accel nvme trace
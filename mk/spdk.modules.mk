@@ -14,6 +14,10 @@ INTR_BLOCKDEV_MODULES_LIST = bdev_malloc bdev_passthru bdev_error bdev_gpt bdev_
 # Logical volume, blobstore and blobfs can directly run in both interrupt mode and poll mode.
 INTR_BLOCKDEV_MODULES_LIST += bdev_lvol blobfs blobfs_bdev blob_bdev blob lvol
 
+ifeq ($(CONFIG_KV_VBDEVS),y)
+BLOCKDEV_MODULES_LIST += bdev_kv_emu bdev_kv_cache bdev_kv_shard bdev_kv_mirror bdev_kv_compress bdev_kv_crc bdev_kv_append bdev_kv_zns
+endif
+
 ifeq ($(CONFIG_XNVME),y)
 BLOCKDEV_MODULES_LIST += bdev_xnvme
 endif
@@ -65,6 +65,11 @@ static TAILQ_HEAD(, vbdev_delay) g_delay_nodes = TAILQ_HEAD_INITIALIZER(g_delay_
 struct delay_bdev_io {
 	int status;
 
+	/* NVMe completion of a KV command, which carries its results. */
+	uint32_t cdw0;
+	int sct;
+	int sc;
+
 	uint64_t completion_tick;
 
 	enum delay_io_type type;
@@ -137,6 +142,18 @@ vbdev_delay_destruct(void *ctx)
 	return 0;
 }
 
+static void
+_delay_complete_orig_io(struct delay_bdev_io *io_ctx)
+{
+	struct spdk_bdev_io *orig_io = spdk_bdev_io_from_ctx(io_ctx);
+
+	if (spdk_bdev_io_type_is_kv(orig_io->type)) {
+		spdk_bdev_io_complete_nvme_status(orig_io, io_ctx->cdw0, io_ctx->sct, io_ctx->sc);
+	} else {
+		spdk_bdev_io_complete(orig_io, io_ctx->status);
+	}
+}
+
 static int
 _process_io_stailq(void *arg, uint64_t ticks)
 {
@@ -147,7 +164,7 @@ _process_io_stailq(void *arg, uint64_t ticks)
 	STAILQ_FOREACH_SAFE(io_ctx, head, link, tmp) {
 		if (io_ctx->completion_tick <= ticks) {
 			STAILQ_REMOVE(head, io_ctx, delay_bdev_io, link);
-			spdk_bdev_io_complete(spdk_bdev_io_from_ctx(io_ctx), io_ctx->status);
+			_delay_complete_orig_io(io_ctx);
 			completions++;
 		} else {
 			/* In the general case, I/O will become ready in an fifo order. When timeouts are dynamically
@@ -192,6 +209,10 @@ _delay_complete_io(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
 	struct delay_io_channel *delay_ch = spdk_io_channel_get_ctx(io_ctx->ch);
 
 	io_ctx->status = success ? SPDK_BDEV_IO_STATUS_SUCCESS : SPDK_BDEV_IO_STATUS_FAILED;
+	if (spdk_bdev_io_type_is_kv(orig_io->type)) {
+		/* Keep the completion, the child is freed before the delay expires. */
+		spdk_bdev_io_get_nvme_status(bdev_io, &io_ctx->cdw0, &io_ctx->sct, &io_ctx->sc);
+	}
 
 	if (bdev_io->type == SPDK_BDEV_IO_TYPE_ZCOPY && bdev_io->u.bdev.zcopy.start && success) {
 		io_ctx->zcopy_bdev_io = bdev_io;
@@ -221,7 +242,7 @@ _delay_complete_io(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
 		break;
 	case DELAY_NONE:
 	default:
-		spdk_bdev_io_complete(orig_io, io_ctx->status);
+		_delay_complete_orig_io(io_ctx);
 		break;
 	}
 }
@@ -451,6 +472,32 @@ vbdev_delay_submit_request(struct spdk_io_channel *ch, struct spdk_bdev_io *bdev
 						 _delay_complete_io, bdev_io);
 		}
 		break;
+	case SPDK_BDEV_IO_KV_BATCH:
+		/* Each BATCH carries a single KV opcode. */
+		if (bdev_io->u.bdev.nvme_kv.batch_type == SPDK_BDEV_IO_KV_STORE ||
+		    bdev_io->u.bdev.nvme_kv.batch_type == SPDK_BDEV_IO_KV_DELETE) {
+			io_ctx->type = is_p99 ? DELAY_P99_WRITE : DELAY_AVG_WRITE;
+		} else {
+			io_ctx->type = is_p99 ? DELAY_P99_READ : DELAY_AVG_READ;
+		}
+		rc = spdk_bdev_kv_io_forward(delay_node->base_desc, delay_ch->base_ch, bdev_io,
+					     _delay_complete_io, bdev_io);
+		break;
+	case SPDK_BDEV_IO_KV_STORE:
+	case SPDK_BDEV_IO_KV_DELETE:
+		io_ctx->type = is_p99 ? DELAY_P99_WRITE : DELAY_AVG_WRITE;
+		rc = spdk_bdev_kv_io_forward(delay_node->base_desc, delay_ch->base_ch, bdev_io,
+					     _delay_complete_io, bdev_io);
+		break;
+	case SPDK_BDEV_IO_KV_LIST:
+	case SPDK_BDEV_IO_KV_EXIST:
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+	case SPDK_BDEV_IO_KV_SEND_SELECT:
+	case SPDK_BDEV_IO_KV_RETRIEVE_SELECT:
+		io_ctx->type = is_p99 ? DELAY_P99_READ : DELAY_AVG_READ;
+		rc = spdk_bdev_kv_io_forward(delay_node->base_desc, delay_ch->base_ch, bdev_io,
+					     _delay_complete_io, bdev_io);
+		break;
 	default:
 		SPDK_ERRLOG("delay: unknown I/O type %d\n", bdev_io->type);
 		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
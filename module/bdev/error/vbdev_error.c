@@ -37,7 +37,7 @@ struct vbdev_error_info {
 /* Context for each error bdev */
 struct error_disk {
 	struct spdk_bdev_part		part;
-	struct vbdev_error_info		error_vector[SPDK_BDEV_IO_TYPE_RESET];
+	struct vbdev_error_info		error_vector[SPDK_BDEV_NUM_IO_TYPES];
 	TAILQ_HEAD(, spdk_bdev_io)	pending_ios;
 };
 
@@ -159,6 +159,14 @@ vbdev_error_get_error_type(struct error_disk *error_disk, uint32_t io_type)
 	case SPDK_BDEV_IO_TYPE_WRITE:
 	case SPDK_BDEV_IO_TYPE_UNMAP:
 	case SPDK_BDEV_IO_TYPE_FLUSH:
+	case SPDK_BDEV_IO_KV_LIST:
+	case SPDK_BDEV_IO_KV_DELETE:
+	case SPDK_BDEV_IO_KV_EXIST:
+	case SPDK_BDEV_IO_KV_STORE:
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+	case SPDK_BDEV_IO_KV_SEND_SELECT:
+	case SPDK_BDEV_IO_KV_RETRIEVE_SELECT:
+	case SPDK_BDEV_IO_KV_BATCH:
 		break;
 	default:
 		return 0;
@@ -200,7 +208,9 @@ vbdev_error_complete_request(struct spdk_bdev_io *bdev_io, bool success, void *c
 	struct error_disk *error_disk = bdev_io->bdev->ctxt;
 	uint32_t error_type;
 
-	if (success && bdev_io->type == SPDK_BDEV_IO_TYPE_READ) {
+	if (success && (bdev_io->type == SPDK_BDEV_IO_TYPE_READ ||
+			bdev_io->type == SPDK_BDEV_IO_KV_RETRIEVE ||
+			bdev_io->type == SPDK_BDEV_IO_KV_RETRIEVE_SELECT)) {
 		error_type = vbdev_error_get_error_type(error_disk, bdev_io->type);
 		if (error_type == VBDEV_IO_CORRUPT_DATA) {
 			error_disk->error_vector[bdev_io->type].error_num--;
@@ -211,6 +221,11 @@ vbdev_error_complete_request(struct spdk_bdev_io *bdev_io, bool success, void *c
 		}
 	}
 
+	if (spdk_bdev_io_type_is_kv(bdev_io->type)) {
+		spdk_bdev_kv_io_complete_from(bdev_io, cb_arg);
+		return;
+	}
+
 	spdk_bdev_io_complete(bdev_io, status);
 }
 
@@ -238,7 +253,8 @@ vbdev_error_submit_request(struct spdk_io_channel *_ch, struct spdk_bdev_io *bde
 		error_disk->error_vector[bdev_io->type].error_num--;
 		break;
 	case VBDEV_IO_CORRUPT_DATA:
-		if (bdev_io->type == SPDK_BDEV_IO_TYPE_WRITE) {
+		if (bdev_io->type == SPDK_BDEV_IO_TYPE_WRITE ||
+		    bdev_io->type == SPDK_BDEV_IO_KV_STORE) {
 			error_disk->error_vector[bdev_io->type].error_num--;
 
 			vbdev_error_corrupt_io_data(bdev_io,
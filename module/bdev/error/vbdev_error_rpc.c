@@ -24,6 +24,22 @@ rpc_error_bdev_decode_io_type(const struct spdk_json_val *val, void *out)
 		*io_type = SPDK_BDEV_IO_TYPE_FLUSH;
 	} else if (spdk_json_strequal(val, "unmap") == true) {
 		*io_type = SPDK_BDEV_IO_TYPE_UNMAP;
+	} else if (spdk_json_strequal(val, "kv_list") == true) {
+		*io_type = SPDK_BDEV_IO_KV_LIST;
+	} else if (spdk_json_strequal(val, "kv_delete") == true) {
+		*io_type = SPDK_BDEV_IO_KV_DELETE;
+	} else if (spdk_json_strequal(val, "kv_exist") == true) {
+		*io_type = SPDK_BDEV_IO_KV_EXIST;
+	} else if (spdk_json_strequal(val, "kv_store") == true) {
+		*io_type = SPDK_BDEV_IO_KV_STORE;
+	} else if (spdk_json_strequal(val, "kv_retrieve") == true) {
+		*io_type = SPDK_BDEV_IO_KV_RETRIEVE;
+	} else if (spdk_json_strequal(val, "kv_send_select") == true) {
+		*io_type = SPDK_BDEV_IO_KV_SEND_SELECT;
+	} else if (spdk_json_strequal(val, "kv_retrieve_select") == true) {
+		*io_type = SPDK_BDEV_IO_KV_RETRIEVE_SELECT;
+	} else if (spdk_json_strequal(val, "kv_batch") == true) {
+		*io_type = SPDK_BDEV_IO_KV_BATCH;
 	} else if (spdk_json_strequal(val, "all") == true) {
 		*io_type = 0xffffffff;
 	} else if (spdk_json_strequal(val, "clear") == true) {
@@ -0,0 +1,1018 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+/*
+ * KV append coalescing. Sits on top of a KV capable bdev and merges small
+ * STOREs with NVME_KV_STORE_CMD_OPTION_APPEND to the same key into one APPEND
+ * command, so log style objects built from many short records cost one device
+ * command per batch instead of one per record.
+ *
+ * Appends are staged per key in the I/O channel, so each thread merges its own
+ * appends without locks. The merged command gathers the callers' buffers with
+ * no copy, in submission order, and every merged caller completes with its
+ * status once it finishes. A key has at most one merged command in flight;
+ * appends arriving meanwhile are staged behind it, so a key's appends reach the
+ * device in the order they were submitted on that channel.
+ *
+ * Staged appends are sent when they add up to max_bytes, when the channel
+ * poller runs every flush_us, or, with flush_us 0, as soon as the key has no
+ * command in flight. Any other command on a key with staged appends sends them
+ * first. It is not held back until they complete, as outstanding commands were
+ * never ordered.
+ *
+ * A FLUSH sends everything staged on its channel and completes once all appends
+ * submitted before it on that channel completed, after being passed to the base
+ * bdev when it supports FLUSH. Appends that are large, carry other options or a
+ * memory domain are passed on as they are, like all other commands.
+ */
+
+#include "spdk/stdinc.h"
+
+#include "vbdev_kv_append.h"
+#include "spdk/likely.h"
+#include "spdk/string.h"
+#include "spdk/thread.h"
+#include "spdk/util.h"
+
+#include "spdk/log.h"
+
+#define KV_APPEND_DEFAULT_MAX_BYTES	(64 * 1024)
+/* Caller iovecs a merged APPEND may gather. */
+#define KV_APPEND_MAX_IOVS		64
+#define KV_APPEND_NUM_BUCKETS		256
+
+static int vbdev_kv_append_init(void);
+static int vbdev_kv_append_get_ctx_size(void);
+static void vbdev_kv_append_examine(struct spdk_bdev *bdev);
+static void vbdev_kv_append_finish(void);
+static int vbdev_kv_append_config_json(struct spdk_json_write_ctx *w);
+
+static struct spdk_bdev_module kv_append_if = {
+	.name = "kv_append",
+	.module_init = vbdev_kv_append_init,
+	.get_ctx_size = vbdev_kv_append_get_ctx_size,
+	.examine_config = vbdev_kv_append_examine,
+	.module_fini = vbdev_kv_append_finish,
+	.config_json = vbdev_kv_append_config_json
+};
+
+SPDK_BDEV_MODULE_REGISTER(kv_append, &kv_append_if)
+
+/* Bdevs requested over RPC, kept so they can be created when their base bdev appears. */
+struct kv_append_config {
+	char				*name;
+	char				*base_bdev_name;
+	uint32_t			max_bytes;
+	uint32_t			flush_us;
+	TAILQ_ENTRY(kv_append_config)	link;
+};
+static TAILQ_HEAD(, kv_append_config) g_kv_append_configs = TAILQ_HEAD_INITIALIZER(
+			g_kv_append_configs);
+
+struct vbdev_kv_append {
+	struct spdk_bdev		bdev;
+	struct spdk_bdev		*base_bdev;
+	struct spdk_bdev_desc		*base_desc;
+	struct spdk_thread		*thread;
+	uint32_t			max_bytes;
+	uint32_t			flush_us;
+	struct vbdev_kv_append_stats	stats;
+	TAILQ_ENTRY(vbdev_kv_append)	link;
+};
+static TAILQ_HEAD(, vbdev_kv_append) g_kv_append_nodes = TAILQ_HEAD_INITIALIZER(
+			g_kv_append_nodes);
+
+typedef int (*kv_append_submit_fn)(struct spdk_bdev_io *bdev_io);
+
+struct kv_append_bdev_io {
+	struct spdk_io_channel		*ch;
+	/* Order of the append, or of the FLUSH, on its channel. */
+	uint64_t			seq;
+	/* On the key's staged or in flight list, or on the channel's FLUSH list. */
+	TAILQ_ENTRY(kv_append_bdev_io)	link;
+	/* On the channel's list of appends not completed yet. */
+	TAILQ_ENTRY(kv_append_bdev_io)	pending_link;
+	/* Child submission to retry once the base bdev has a bdev_io to spare. */
+	kv_append_submit_fn		submit_fn;
+	struct spdk_bdev_io_wait_entry	bdev_io_wait;
+};
+TAILQ_HEAD(kv_append_io_list, kv_append_bdev_io);
+
+struct kv_append_io_channel;
+
+/* Appends to one key on one channel. */
+struct kv_append_key {
+	struct kv_append_io_channel	*ach;
+	uint8_t				key[NVME_KV_MAX_KEY_LENGTH];
+	uint8_t				key_len;
+	uint32_t			bucket;
+	struct kv_append_io_list	staged;
+	uint64_t			staged_bytes;
+	int				staged_iovcnt;
+	/* The poller or a FLUSH wanted the staged appends sent while a command was in flight. */
+	bool				flush_now;
+	bool				dirty;
+	/* Appends merged into the command in flight, and its payload. */
+	struct kv_append_io_list	inflight;
+	struct iovec			iovs[KV_APPEND_MAX_IOVS];
+	int				iovcnt;
+	uint64_t			bytes;
+	struct spdk_bdev_io_wait_entry	bdev_io_wait;
+	TAILQ_ENTRY(kv_append_key)	link;
+	/* On the channel's list of keys with staged appends. */
+	TAILQ_ENTRY(kv_append_key)	dirty_link;
+};
+TAILQ_HEAD(kv_append_key_list, kv_append_key);
+
+struct kv_append_io_channel {
+	struct vbdev_kv_append		*append;
+	struct spdk_io_channel		*base_ch;
+	struct spdk_poller		*poller;
+	struct kv_append_key_list	buckets[KV_APPEND_NUM_BUCKETS];
+	struct kv_append_key_list	free_keys;
+	struct kv_append_key_list	dirty;
+	/* Appends staged or in flight, in submission order. */
+	struct kv_append_io_list	pending;
+	/* FLUSHes waiting for the appends submitted before them. */
+	struct kv_append_io_list	flushes;
+	uint64_t			next_seq;
+};
+
+#define KV_APPEND_STAT_ADD(append, field, val) \
+	__atomic_fetch_add(&(append)->stats.field, (val), __ATOMIC_RELAXED)
+
+static inline struct vbdev_kv_append *
+kv_append_from_io(struct spdk_bdev_io *bdev_io)
+{
+	return SPDK_CONTAINEROF(bdev_io->bdev, struct vbdev_kv_append, bdev);
+}
+
+static inline struct kv_append_io_channel *
+kv_append_io_ch(struct spdk_bdev_io *bdev_io)
+{
+	struct kv_append_bdev_io *io_ctx = (struct kv_append_bdev_io *)bdev_io->driver_ctx;
+
+	return spdk_io_channel_get_ctx(io_ctx->ch);
+}
+
+static void kv_append_submit(struct spdk_bdev_io *bdev_io, kv_append_submit_fn fn);
+
+static void
+kv_append_resubmit_io(void *arg)
+{
+	struct spdk_bdev_io *bdev_io = (struct spdk_bdev_io *)arg;
+	struct kv_append_bdev_io *io_ctx = (struct kv_append_bdev_io *)bdev_io->driver_ctx;
+
+	kv_append_submit(bdev_io, io_ctx->submit_fn);
+}
+
+/* Submit a child I/O to the base bdev, waiting for a bdev_io if there is none. */
+static void
+kv_append_submit(struct spdk_bdev_io *bdev_io, kv_append_submit_fn fn)
+{
+	struct kv_append_bdev_io *io_ctx = (struct kv_append_bdev_io *)bdev_io->driver_ctx;
+	int rc;
+
+	rc = fn(bdev_io);
+	if (rc == 0) {
+		return;
+	}
+
+	if (rc == -ENOMEM) {
+		io_ctx->submit_fn = fn;
+		io_ctx->bdev_io_wait.bdev = bdev_io->bdev;
+		io_ctx->bdev_io_wait.cb_fn = kv_append_resubmit_io;
+		io_ctx->bdev_io_wait.cb_arg = bdev_io;
+
+		rc = spdk_bdev_queue_io_wait(bdev_io->bdev, kv_append_io_ch(bdev_io)->base_ch,
+					     &io_ctx->bdev_io_wait);
+		if (rc == 0) {
+			return;
+		}
+		SPDK_ERRLOG("Queue io failed in kv_append_submit, rc=%d.\n", rc);
+	} else {
+		SPDK_ERRLOG("ERROR on bdev_io submission!\n");
+	}
+	spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+}
+
+static void
+kv_append_forward_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	spdk_bdev_kv_io_complete_from(cb_arg, bdev_io);
+	spdk_bdev_free_io(bdev_io);
+}
+
+static int
+kv_append_forward(struct spdk_bdev_io *bdev_io)
+{
+	struct vbdev_kv_append *append = kv_append_from_io(bdev_io);
+
+	return spdk_bdev_kv_io_forward(append->base_desc, kv_append_io_ch(bdev_io)->base_ch, bdev_io,
+				       kv_append_forward_done, bdev_io);
+}
+
+/* Keys */
+
+static inline uint32_t
+kv_append_hash(const uint8_t *key, size_t key_len)
+{
+	return spdk_bdev_kv_key_hash(key, key_len) & (KV_APPEND_NUM_BUCKETS - 1);
+}
+
+static struct kv_append_key *
+kv_append_key_find(struct kv_append_io_channel *ach, const uint8_t *key, size_t key_len)
+{
+	struct kv_append_key *k;
+
+	TAILQ_FOREACH(k, &ach->buckets[kv_append_hash(key, key_len)], link) {
+		if (k->key_len == key_len && memcmp(k->key, key, key_len) == 0) {
+			return k;
+		}
+	}
+	return NULL;
+}
+
+static struct kv_append_key *
+kv_append_key_get(struct kv_append_io_channel *ach, const uint8_t *key, size_t key_len)
+{
+	struct kv_append_key *k;
+
+	k = kv_append_key_find(ach, key, key_len);
+	if (k != NULL) {
+		return k;
+	}
+
+	k = TAILQ_FIRST(&ach->free_keys);
+	if (k != NULL) {
+		TAILQ_REMOVE(&ach->free_keys, k, link);
+	} else {
+		k = calloc(1, sizeof(*k));
+		if (k == NULL) {
+			return NULL;
+		}
+	}
+
+	k->ach = ach;
+	memcpy(k->key, key, key_len);
+	k->key_len = key_len;
+	k->bucket = kv_append_hash(key, key_len);
+	TAILQ_INIT(&k->staged);
+	TAILQ_INIT(&k->inflight);
+	k->staged_bytes = 0;
+	k->staged_iovcnt = 0;
+	k->flush_now = false;
+	k->dirty = false;
+	TAILQ_INSERT_HEAD(&ach->buckets[k->bucket], k, link);
+	return k;
+}
+
+/* Drop a key with nothing staged or in flight, keeping it for reuse. */
+static void
+kv_append_key_put(struct kv_append_key *k)
+{
+	struct kv_append_io_channel *ach = k->ach;
+
+	assert(TAILQ_EMPTY(&k->staged) && TAILQ_EMPTY(&k->inflight));
+	TAILQ_REMOVE(&ach->buckets[k->bucket], k, link);
+	TAILQ_INSERT_HEAD(&ach->free_keys, k, link);
+}
+
+/* Append to iovs the first len bytes of an iovec array. Returns the new count. */
+static int
+kv_append_iovs_add(struct iovec *iovs, int iovcnt, const struct iovec *src, int src_cnt,
+		   uint64_t len)
+{
+	int i;
+
+	for (i = 0; i < src_cnt && len > 0; i++) {
+		iovs[iovcnt].iov_base = src[i].iov_base;
+		iovs[iovcnt].iov_len = spdk_min(src[i].iov_len, len);
+		len -= iovs[iovcnt].iov_len;
+		iovcnt++;
+	}
+	return iovcnt;
+}
+
+/* Merged APPEND */
+
+static void kv_append_key_issue(struct kv_append_key *k);
+
+static void
+kv_append_flush_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	spdk_bdev_io_complete(cb_arg, success ? SPDK_BDEV_IO_STATUS_SUCCESS : SPDK_BDEV_IO_STATUS_FAILED);
+	spdk_bdev_free_io(bdev_io);
+}
+
+static int
+kv_append_flush_base(struct spdk_bdev_io *bdev_io)
+{
+	struct vbdev_kv_append *append = kv_append_from_io(bdev_io);
+
+	return spdk_bdev_flush_blocks(append->base_desc, kv_append_io_ch(bdev_io)->base_ch,
+				      bdev_io->u.bdev.offset_blocks, bdev_io->u.bdev.num_blocks,
+				      kv_append_flush_done, bdev_io);
+}
+
+/* Complete the FLUSHes whose appends all completed. */
+static void
+kv_append_flushes_check(struct kv_append_io_channel *ach)
+{
+	struct kv_append_bdev_io *oldest = TAILQ_FIRST(&ach->pending);
+	struct kv_append_bdev_io *io_ctx;
+	struct spdk_bdev_io *bdev_io;
+
+	while ((io_ctx = TAILQ_FIRST(&ach->flushes)) != NULL) {
+		if (oldest != NULL && oldest->seq < io_ctx->seq) {
+			break;
+		}
+		TAILQ_REMOVE(&ach->flushes, io_ctx, link);
+
+		bdev_io = spdk_bdev_io_from_ctx(io_ctx);
+		if (spdk_bdev_io_type_supported(ach->append->base_bdev, SPDK_BDEV_IO_TYPE_FLUSH)) {
+			kv_append_submit(bdev_io, kv_append_flush_base);
+		} else {
+			spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_SUCCESS);
+		}
+	}
+}
+
+/* The merged command of a key finished. child is NULL if it could not be submitted. */
+static void
+kv_append_key_done(struct kv_append_key *k, struct spdk_bdev_io *child)
+{
+	struct kv_append_io_channel *ach = k->ach;
+	struct vbdev_kv_append *append = ach->append;
+	struct kv_append_io_list done;
+	struct kv_append_bdev_io *io_ctx;
+
+	TAILQ_INIT(&done);
+	TAILQ_SWAP(&done, &k->inflight, kv_append_bdev_io, link);
+	TAILQ_FOREACH(io_ctx, &done, link) {
+		TAILQ_REMOVE(&ach->pending, io_ctx, pending_link);
+	}
+
+	/* Settle the key first, the callers may append to it again from their callbacks. */
+	if (TAILQ_EMPTY(&k->staged)) {
+		kv_append_key_put(k);
+	} else if (k->flush_now || append->flush_us == 0 || !TAILQ_EMPTY(&ach->flushes) ||
+		   k->staged_bytes >= append->max_bytes || k->staged_iovcnt >= KV_APPEND_MAX_IOVS) {
+		kv_append_key_issue(k);
+	}
+
+	while ((io_ctx = TAILQ_FIRST(&done)) != NULL) {
+		TAILQ_REMOVE(&done, io_ctx, link);
+		if (child != NULL) {
+			spdk_bdev_kv_io_complete_from(spdk_bdev_io_from_ctx(io_ctx), child);
+		} else {
+			spdk_bdev_io_complete(spdk_bdev_io_from_ctx(io_ctx), SPDK_BDEV_IO_STATUS_FAILED);
+		}
+	}
+	if (child != NULL) {
+		spdk_bdev_free_io(child);
+	}
+
+	kv_append_flushes_check(ach);
+}
+
+static void
+kv_append_merged_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	kv_append_key_done(cb_arg, bdev_io);
+}
+
+static void
+kv_append_key_fail(void *arg)
+{
+	kv_append_key_done(arg, NULL);
+}
+
+static void
+kv_append_key_submit(void *arg)
+{
+	struct kv_append_key *k = arg;
+	struct kv_append_io_channel *ach = k->ach;
+	struct vbdev_kv_append *append = ach->append;
+	int rc;
+
+	rc = spdk_bdev_kv_storev(append->base_desc, ach->base_ch, k->key, k->key_len, k->iovs,
+				 k->iovcnt, k->bytes, NVME_KV_STORE_CMD_OPTION_APPEND,
+				 kv_append_merged_done, k);
+	if (rc == 0) {
+		KV_APPEND_STAT_ADD(append, merged_commands, 1);
+		return;
+	}
+
+	if (rc == -ENOMEM) {
+		k->bdev_io_wait.bdev = &append->bdev;
+		k->bdev_io_wait.cb_fn = kv_append_key_submit;
+		k->bdev_io_wait.cb_arg = k;
+
+		rc = spdk_bdev_queue_io_wait(&append->bdev, ach->base_ch, &k->bdev_io_wait);
+		if (rc == 0) {
+			return;
+		}
+		SPDK_ERRLOG("Queue io failed in kv_append_key_submit, rc=%d.\n", rc);
+	} else {
+		SPDK_ERRLOG("ERROR on bdev_io submission!\n");
+	}
+
+	/* Fail the callers from a message, so issuing never calls back into them. */
+	spdk_thread_send_msg(spdk_get_thread(), kv_append_key_fail, k);
+}
+
+/* Send the staged appends of a key that fit one command, unless it has one in flight. */
+static void
+kv_append_key_issue(struct kv_append_key *k)
+{
+	struct kv_append_io_channel *ach = k->ach;
+	struct vbdev_kv_append *append = ach->append;
+	struct kv_append_bdev_io *io_ctx;
+	struct spdk_bdev_io *bdev_io;
+	uint64_t len;
+
+	if (!TAILQ_EMPTY(&k->inflight) || TAILQ_EMPTY(&k->staged)) {
+		return;
+	}
+
+	k->iovcnt = 0;
+	k->bytes = 0;
+	while ((io_ctx = TAILQ_FIRST(&k->staged)) != NULL) {
+		bdev_io = spdk_bdev_io_from_ctx(io_ctx);
+		len = bdev_io->u.bdev.nvme_kv.buffer_size;
+		if (!TAILQ_EMPTY(&k->inflight) &&
+		    (k->bytes + len > append->max_bytes ||
+		     k->iovcnt + bdev_io->u.bdev.iovcnt > KV_APPEND_MAX_IOVS)) {
+			break;
+		}
+
+		k->iovcnt = kv_append_iovs_add(k->iovs, k->iovcnt, bdev_io->u.bdev.iovs,
+					       bdev_io->u.bdev.iovcnt, len);
+		k->bytes += len;
+		k->staged_bytes -= len;
+		k->staged_iovcnt -= bdev_io->u.bdev.iovcnt;
+		TAILQ_REMOVE(&k->staged, io_ctx, link);
+		TAILQ_INSERT_TAIL(&k->inflight, io_ctx, link);
+	}
+
+	k->flush_now = false;
+	if (TAILQ_EMPTY(&k->staged) && k->dirty) {
+		TAILQ_REMOVE(&ach->dirty, k, dirty_link);
+		k->dirty = false;
+	}
+
+	kv_append_key_submit(k);
+}
+
+static bool
+kv_append_can_merge(struct vbdev_kv_append *append, struct spdk_bdev_io *bdev_io)
+{
+	return bdev_io->u.bdev.nvme_kv.options == NVME_KV_STORE_CMD_OPTION_APPEND &&
+	       bdev_io->u.bdev.ext_opts == NULL &&
+	       bdev_io->u.bdev.nvme_kv.key_length <= NVME_KV_MAX_KEY_LENGTH &&
+	       bdev_io->u.bdev.nvme_kv.buffer_size < append->max_bytes &&
+	       bdev_io->u.bdev.iovcnt <= KV_APPEND_MAX_IOVS;
+}
+
+static void
+kv_append_stage(struct spdk_bdev_io *bdev_io)
+{
+	struct vbdev_kv_append *append = kv_append_from_io(bdev_io);
+	struct kv_append_io_channel *ach = kv_append_io_ch(bdev_io);
+	struct kv_append_bdev_io *io_ctx = (struct kv_append_bdev_io *)bdev_io->driver_ctx;
+	struct kv_append_key *k;
+
+	k = kv_append_key_get(ach, bdev_io->u.bdev.nvme_kv.key, bdev_io->u.bdev.nvme_kv.key_length);
+	if (spdk_unlikely(k == NULL)) {
+		KV_APPEND_STAT_ADD(append, passthrough, 1);
+		kv_append_submit(bdev_io, kv_append_forward);
+		return;
+	}
+
+	io_ctx->seq = ach->next_seq++;
+	TAILQ_INSERT_TAIL(&ach->pending, io_ctx, pending_link);
+	TAILQ_INSERT_TAIL(&k->staged, io_ctx, link);
+	k->staged_bytes += bdev_io->u.bdev.nvme_kv.buffer_size;
+	k->staged_iovcnt += bdev_io->u.bdev.iovcnt;
+	KV_APPEND_STAT_ADD(append, appends, 1);
+	KV_APPEND_STAT_ADD(append, bytes, bdev_io->u.bdev.nvme_kv.buffer_size);
+
+	if (!k->dirty) {
+		TAILQ_INSERT_TAIL(&ach->dirty, k, dirty_link);
+		k->dirty = true;
+	}
+
+	if (append->flush_us == 0 || k->staged_bytes >= append->max_bytes ||
+	    k->staged_iovcnt >= KV_APPEND_MAX_IOVS) {
+		kv_append_key_issue(k);
+	}
+}
+
+/* Send, or mark to be sent, everything staged on a channel. */
+static void
+kv_append_flush_staged(struct kv_append_io_channel *ach)
+{
+	struct kv_append_key *k, *tmp;
+
+	TAILQ_FOREACH_SAFE(k, &ach->dirty, dirty_link, tmp) {
+		if (TAILQ_EMPTY(&k->inflight)) {
+			kv_append_key_issue(k);
+		} else {
+			k->flush_now = true;
+		}
+	}
+}
+
+static int
+kv_append_poll(void *arg)
+{
+	struct kv_append_io_channel *ach = arg;
+
+	if (TAILQ_EMPTY(&ach->dirty)) {
+		return SPDK_POLLER_IDLE;
+	}
+
+	kv_append_flush_staged(ach);
+	return SPDK_POLLER_BUSY;
+}
+
+static void
+kv_append_flush(struct spdk_bdev_io *bdev_io)
+{
+	struct kv_append_io_channel *ach = kv_append_io_ch(bdev_io);
+	struct kv_append_bdev_io *io_ctx = (struct kv_append_bdev_io *)bdev_io->driver_ctx;
+
+	KV_APPEND_STAT_ADD(ach->append, flushes, 1);
+	io_ctx->seq = ach->next_seq++;
+	TAILQ_INSERT_TAIL(&ach->flushes, io_ctx, link);
+
+	kv_append_flush_staged(ach);
+	kv_append_flushes_check(ach);
+}
+
+/* I/O path */
+
+static void
+vbdev_kv_append_submit_request(struct spdk_io_channel *ch, struct spdk_bdev_io *bdev_io)
+{
+	struct vbdev_kv_append *append = kv_append_from_io(bdev_io);
+	struct kv_append_bdev_io *io_ctx = (struct kv_append_bdev_io *)bdev_io->driver_ctx;
+	struct kv_append_key *k;
+
+	io_ctx->ch = ch;
+
+	switch (bdev_io->type) {
+	case SPDK_BDEV_IO_KV_STORE:
+		if (kv_append_can_merge(append, bdev_io)) {
+			kv_append_stage(bdev_io);
+			break;
+		}
+		if (bdev_io->u.bdev.nvme_kv.options & NVME_KV_STORE_CMD_OPTION_APPEND) {
+			KV_APPEND_STAT_ADD(append, passthrough, 1);
+		}
+	/* fallthrough */
+	case SPDK_BDEV_IO_KV_DELETE:
+	case SPDK_BDEV_IO_KV_EXIST:
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+	case SPDK_BDEV_IO_KV_SEND_SELECT:
+		/* Do not let the command overtake the appends staged for its key. */
+		if (bdev_io->u.bdev.nvme_kv.key_length <= NVME_KV_MAX_KEY_LENGTH) {
+			k = kv_append_key_find(spdk_io_channel_get_ctx(ch), bdev_io->u.bdev.nvme_kv.key,
+					       bdev_io->u.bdev.nvme_kv.key_length);
+			if (k != NULL) {
+				kv_append_key_issue(k);
+			}
+		}
+		kv_append_submit(bdev_io, kv_append_forward);
+		break;
+	case SPDK_BDEV_IO_KV_LIST:
+	case SPDK_BDEV_IO_KV_RETRIEVE_SELECT:
+	case SPDK_BDEV_IO_KV_BATCH:
+		kv_append_submit(bdev_io, kv_append_forward);
+		break;
+	case SPDK_BDEV_IO_TYPE_FLUSH:
+		kv_append_flush(bdev_io);
+		break;
+	default:
+		SPDK_ERRLOG("kv_append: unsupported I/O type %d\n", bdev_io->type);
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		break;
+	}
+}
+
+static bool
+vbdev_kv_append_io_type_supported(void *ctx, enum spdk_bdev_io_type io_type)
+{
+	struct vbdev_kv_append *append = ctx;
+
+	switch (io_type) {
+	case SPDK_BDEV_IO_KV_LIST:
+	case SPDK_BDEV_IO_KV_DELETE:
+	case SPDK_BDEV_IO_KV_EXIST:
+	case SPDK_BDEV_IO_KV_STORE:
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+	case SPDK_BDEV_IO_KV_SEND_SELECT:
+	case SPDK_BDEV_IO_KV_RETRIEVE_SELECT:
+	case SPDK_BDEV_IO_KV_BATCH:
+		return spdk_bdev_io_type_supported(append->base_bdev, io_type);
+	case SPDK_BDEV_IO_TYPE_FLUSH:
+		/* Sends the staged appends, the base bdev need not support it. */
+		return true;
+	default:
+		return false;
+	}
+}
+
+static struct spdk_io_channel *
+vbdev_kv_append_get_io_channel(void *ctx)
+{
+	return spdk_get_io_channel(ctx);
+}
+
+static void
+vbdev_kv_append_write_params_json(struct vbdev_kv_append *append, struct spdk_json_write_ctx *w)
+{
+	spdk_json_write_named_string(w, "name", spdk_bdev_get_name(&append->bdev));
+	spdk_json_write_named_string(w, "base_bdev_name", spdk_bdev_get_name(append->base_bdev));
+	spdk_json_write_named_uint32(w, "max_bytes", append->max_bytes);
+	spdk_json_write_named_uint32(w, "flush_us", append->flush_us);
+}
+
+static int
+vbdev_kv_append_dump_info_json(void *ctx, struct spdk_json_write_ctx *w)
+{
+	struct vbdev_kv_append *append = ctx;
+
+	spdk_json_write_name(w, "kv_append");
+	spdk_json_write_object_begin(w);
+	vbdev_kv_append_write_params_json(append, w);
+	spdk_json_write_object_end(w);
+
+	return 0;
+}
+
+static int
+vbdev_kv_append_config_json(struct spdk_json_write_ctx *w)
+{
+	struct vbdev_kv_append *append;
+
+	TAILQ_FOREACH(append, &g_kv_append_nodes, link) {
+		spdk_json_write_object_begin(w);
+		spdk_json_write_named_string(w, "method", "bdev_kv_append_create");
+		spdk_json_write_named_object_begin(w, "params");
+		vbdev_kv_append_write_params_json(append, w);
+		spdk_json_write_object_end(w);
+		spdk_json_write_object_end(w);
+	}
+	return 0;
+}
+
+static void
+vbdev_kv_append_write_config_json(struct spdk_bdev *bdev, struct spdk_json_write_ctx *w)
+{
+	/* No config per bdev needed */
+}
+
+static void
+kv_append_free(struct vbdev_kv_append *append)
+{
+	free(append->bdev.name);
+	free(append);
+}
+
+static void
+_device_unregister_cb(void *io_device)
+{
+	kv_append_free(io_device);
+}
+
+static void
+_vbdev_kv_append_destruct(void *ctx)
+{
+	struct spdk_bdev_desc *desc = ctx;
+
+	spdk_bdev_close(desc);
+}
+
+static int
+vbdev_kv_append_destruct(void *ctx)
+{
+	struct vbdev_kv_append *append = ctx;
+
+	TAILQ_REMOVE(&g_kv_append_nodes, append, link);
+
+	spdk_bdev_module_release_bdev(append->base_bdev);
+
+	/* Close the underlying bdev on its same opened thread. */
+	if (append->thread && append->thread != spdk_get_thread()) {
+		spdk_thread_send_msg(append->thread, _vbdev_kv_append_destruct, append->base_desc);
+	} else {
+		spdk_bdev_close(append->base_desc);
+	}
+
+	spdk_io_device_unregister(append, _device_unregister_cb);
+
+	return 0;
+}
+
+static const struct spdk_bdev_fn_table vbdev_kv_append_fn_table = {
+	.destruct		= vbdev_kv_append_destruct,
+	.submit_request		= vbdev_kv_append_submit_request,
+	.io_type_supported	= vbdev_kv_append_io_type_supported,
+	.get_io_channel		= vbdev_kv_append_get_io_channel,
+	.dump_info_json		= vbdev_kv_append_dump_info_json,
+	.write_config_json	= vbdev_kv_append_write_config_json,
+};
+
+static int
+kv_append_ch_create_cb(void *io_device, void *ctx_buf)
+{
+	struct kv_append_io_channel *ach = ctx_buf;
+	struct vbdev_kv_append *append = io_device;
+	int i;
+
+	ach->append = append;
+	for (i = 0; i < KV_APPEND_NUM_BUCKETS; i++) {
+		TAILQ_INIT(&ach->buckets[i]);
+	}
+	TAILQ_INIT(&ach->free_keys);
+	TAILQ_INIT(&ach->dirty);
+	TAILQ_INIT(&ach->pending);
+	TAILQ_INIT(&ach->flushes);
+	ach->next_seq = 0;
+
+	ach->base_ch = spdk_bdev_get_io_channel(append->base_desc);
+	if (ach->base_ch == NULL) {
+		return -ENOMEM;
+	}
+
+	if (append->flush_us != 0) {
+		ach->poller = SPDK_POLLER_REGISTER(kv_append_poll, ach, append->flush_us);
+	}
+
+	return 0;
+}
+
+static void
+kv_append_ch_destroy_cb(void *io_device, void *ctx_buf)
+{
+	struct kv_append_io_channel *ach = ctx_buf;
+	struct kv_append_key *k;
+	int i;
+
+	assert(TAILQ_EMPTY(&ach->pending));
+
+	spdk_poller_unregister(&ach->poller);
+	for (i = 0; i < KV_APPEND_NUM_BUCKETS; i++) {
+		while ((k = TAILQ_FIRST(&ach->buckets[i])) != NULL) {
+			TAILQ_REMOVE(&ach->buckets[i], k, link);
+			free(k);
+		}
+	}
+	while ((k = TAILQ_FIRST(&ach->free_keys)) != NULL) {
+		TAILQ_REMOVE(&ach->free_keys, k, link);
+		free(k);
+	}
+	spdk_put_io_channel(ach->base_ch);
+}
+
+static void
+vbdev_kv_append_base_bdev_hotremove_cb(struct spdk_bdev *bdev_find)
+{
+	struct vbdev_kv_append *append, *tmp;
+
+	TAILQ_FOREACH_SAFE(append, &g_kv_append_nodes, link, tmp) {
+		if (bdev_find == append->base_bdev) {
+			spdk_bdev_unregister(&append->bdev, NULL, NULL);
+		}
+	}
+}
+
+static void
+vbdev_kv_append_base_bdev_event_cb(enum spdk_bdev_event_type type, struct spdk_bdev *bdev,
+				   void *event_ctx)
+{
+	switch (type) {
+	case SPDK_BDEV_EVENT_REMOVE:
+		vbdev_kv_append_base_bdev_hotremove_cb(bdev);
+		break;
+	default:
+		SPDK_NOTICELOG("Unsupported bdev event: type %d\n", type);
+		break;
+	}
+}
+
+static int
+vbdev_kv_append_register(struct kv_append_config *config)
+{
+	struct vbdev_kv_append *append;
+	struct spdk_bdev *bdev;
+	int rc;
+
+	append = calloc(1, sizeof(*append));
+	if (append == NULL) {
+		return -ENOMEM;
+	}
+
+	append->bdev.name = strdup(config->name);
+	if (append->bdev.name == NULL) {
+		rc = -ENOMEM;
+		goto free_append;
+	}
+	append->bdev.product_name = "kv_append";
+	append->max_bytes = config->max_bytes;
+	append->flush_us = config->flush_us;
+
+	rc = spdk_bdev_open_ext(config->base_bdev_name, true, vbdev_kv_append_base_bdev_event_cb,
+				NULL, &append->base_desc);
+	if (rc) {
+		if (rc != -ENODEV) {
+			SPDK_ERRLOG("could not open bdev %s\n", config->base_bdev_name);
+		}
+		goto free_append;
+	}
+
+	bdev = spdk_bdev_desc_get_bdev(append->base_desc);
+	if (!spdk_bdev_io_type_supported(bdev, SPDK_BDEV_IO_KV_STORE)) {
+		SPDK_ERRLOG("bdev %s does not support KV commands\n", config->base_bdev_name);
+		rc = -ENOTSUP;
+		goto close_base;
+	}
+	append->base_bdev = bdev;
+
+	append->bdev.write_cache = bdev->write_cache;
+	append->bdev.required_alignment = bdev->required_alignment;
+	append->bdev.blocklen = bdev->blocklen;
+	append->bdev.blockcnt = bdev->blockcnt;
+
+	append->bdev.ctxt = append;
+	append->bdev.fn_table = &vbdev_kv_append_fn_table;
+	append->bdev.module = &kv_append_if;
+	append->thread = spdk_get_thread();
+
+	spdk_io_device_register(append, kv_append_ch_create_cb, kv_append_ch_destroy_cb,
+				sizeof(struct kv_append_io_channel), config->name);
+
+	rc = spdk_bdev_module_claim_bdev(bdev, append->base_desc, append->bdev.module);
+	if (rc) {
+		SPDK_ERRLOG("could not claim bdev %s\n", config->base_bdev_name);
+		goto unregister_device;
+	}
+
+	rc = spdk_bdev_register(&append->bdev);
+	if (rc) {
+		SPDK_ERRLOG("could not register kv_append bdev %s\n", config->name);
+		spdk_bdev_module_release_bdev(bdev);
+		goto unregister_device;
+	}
+
+	TAILQ_INSERT_TAIL(&g_kv_append_nodes, append, link);
+	SPDK_NOTICELOG("created kv_append bdev %s on %s\n", config->name, config->base_bdev_name);
+	return 0;
+
+unregister_device:
+	spdk_io_device_unregister(append, NULL);
+close_base:
+	spdk_bdev_close(append->base_desc);
+free_append:
+	kv_append_free(append);
+	return rc;
+}
+
+static void
+kv_append_config_free(struct kv_append_config *config)
+{
+	free(config->name);
+	free(config->base_bdev_name);
+	free(config);
+}
+
+int
+bdev_kv_append_create(const struct vbdev_kv_append_opts *opts)
+{
+	struct kv_append_config *config;
+	int rc;
+
+	if (opts->name == NULL || opts->base_bdev_name == NULL) {
+		return -EINVAL;
+	}
+
+	TAILQ_FOREACH(config, &g_kv_append_configs, link) {
+		if (strcmp(config->name, opts->name) == 0) {
+			SPDK_ERRLOG("kv_append bdev %s already exists\n", opts->name);
+			return -EEXIST;
+		}
+	}
+
+	config = calloc(1, sizeof(*config));
+	if (config == NULL) {
+		return -ENOMEM;
+	}
+
+	config->name = strdup(opts->name);
+	config->base_bdev_name = strdup(opts->base_bdev_name);
+	if (config->name == NULL || config->base_bdev_name == NULL) {
+		kv_append_config_free(config);
+		return -ENOMEM;
+	}
+	config->max_bytes = opts->max_bytes ? opts->max_bytes : KV_APPEND_DEFAULT_MAX_BYTES;
+	config->flush_us = opts->flush_us;
+
+	rc = vbdev_kv_append_register(config);
+	if (rc == -ENODEV) {
+		SPDK_NOTICELOG("kv_append creation deferred pending base bdev arrival\n");
+		rc = 0;
+	} else if (rc != 0) {
+		kv_append_config_free(config);
+		return rc;
+	}
+
+	TAILQ_INSERT_TAIL(&g_kv_append_configs, config, link);
+	return 0;
+}
+
+void
+bdev_kv_append_delete(const char *name, spdk_bdev_unregister_cb cb_fn, void *cb_arg)
+{
+	struct kv_append_config *config;
+	int rc;
+
+	rc = spdk_bdev_unregister_by_name(name, &kv_append_if, cb_fn, cb_arg);
+	if (rc != 0) {
+		cb_fn(cb_arg, rc);
+		return;
+	}
+
+	/* Forget the bdev so it is not re-created when its base bdev comes back. */
+	TAILQ_FOREACH(config, &g_kv_append_configs, link) {
+		if (strcmp(config->name, name) == 0) {
+			TAILQ_REMOVE(&g_kv_append_configs, config, link);
+			kv_append_config_free(config);
+			break;
+		}
+	}
+}
+
+int
+bdev_kv_append_get_stats(const char *name, struct vbdev_kv_append_stats *stats)
+{
+	struct vbdev_kv_append *append;
+
+	TAILQ_FOREACH(append, &g_kv_append_nodes, link) {
+		if (strcmp(spdk_bdev_get_name(&append->bdev), name) == 0) {
+			break;
+		}
+	}
+	if (append == NULL) {
+		return -ENODEV;
+	}
+
+	stats->appends = __atomic_load_n(&append->stats.appends, __ATOMIC_RELAXED);
+	stats->merged_commands = __atomic_load_n(&append->stats.merged_commands, __ATOMIC_RELAXED);
+	stats->bytes = __atomic_load_n(&append->stats.bytes, __ATOMIC_RELAXED);
+	stats->passthrough = __atomic_load_n(&append->stats.passthrough, __ATOMIC_RELAXED);
+	stats->flushes = __atomic_load_n(&append->stats.flushes, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+static int
+vbdev_kv_append_init(void)
+{
+	return 0;
+}
+
+static void
+vbdev_kv_append_finish(void)
+{
+	struct kv_append_config *config;
+
+	while ((config = TAILQ_FIRST(&g_kv_append_configs))) {
+		TAILQ_REMOVE(&g_kv_append_configs, config, link);
+		kv_append_config_free(config);
+	}
+}
+
+static int
+vbdev_kv_append_get_ctx_size(void)
+{
+	return sizeof(struct kv_append_bdev_io);
+}
+
+static void
+vbdev_kv_append_examine(struct spdk_bdev *bdev)
+{
+	struct kv_append_config *config;
+
+	TAILQ_FOREACH(config, &g_kv_append_configs, link) {
+		if (strcmp(config->base_bdev_name, bdev->name) == 0) {
+			vbdev_kv_append_register(config);
+		}
+	}
+
+	spdk_bdev_module_examine_done(&kv_append_if);
+}
+
+SPDK_LOG_REGISTER_COMPONENT(vbdev_kv_append)
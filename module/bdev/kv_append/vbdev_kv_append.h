@@ -0,0 +1,67 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+#ifndef SPDK_VBDEV_KV_APPEND_H
+#define SPDK_VBDEV_KV_APPEND_H
+
+#include "spdk/stdinc.h"
+
+#include "spdk/bdev.h"
+#include "spdk/bdev_module.h"
+
+/* flush_us used when none is given over RPC. */
+#define VBDEV_KV_APPEND_DEFAULT_FLUSH_US	100
+
+struct vbdev_kv_append_opts {
+	const char *name;
+	const char *base_bdev_name;
+	/* Bytes of appends to one key merged into a single command. 0 selects the default. */
+	uint32_t max_bytes;
+	/*
+	 * Longest time, in microseconds, an append waits for others to the same key.
+	 * 0 only merges the appends that arrive while the previous one is in flight.
+	 */
+	uint32_t flush_us;
+};
+
+struct vbdev_kv_append_stats {
+	/* APPENDs submitted to the coalescing bdev, and commands sent for them. */
+	uint64_t appends;
+	uint64_t merged_commands;
+	uint64_t bytes;
+	/* APPENDs passed on as they are, e.g. too large or with other options. */
+	uint64_t passthrough;
+	uint64_t flushes;
+};
+
+/**
+ * Create a KV append coalescing bdev on top of a KV capable bdev. If the base
+ * bdev does not exist yet, it is created once it shows up.
+ *
+ * \param opts Creation options.
+ *
+ * \return 0 on success, negated errno otherwise.
+ */
+int bdev_kv_append_create(const struct vbdev_kv_append_opts *opts);
+
+/**
+ * Delete a KV append coalescing bdev.
+ *
+ * \param name Name of the coalescing bdev.
+ * \param cb_fn Function to call after deletion.
+ * \param cb_arg Argument to pass to cb_fn.
+ */
+void bdev_kv_append_delete(const char *name, spdk_bdev_unregister_cb cb_fn, void *cb_arg);
+
+/**
+ * Get the counters of a KV append coalescing bdev.
+ *
+ * \param name Name of the coalescing bdev.
+ * \param stats Filled in with the counters.
+ *
+ * \return 0 on success, -ENODEV if there is no such bdev.
+ */
+int bdev_kv_append_get_stats(const char *name, struct vbdev_kv_append_stats *stats);
+
+#endif /* SPDK_VBDEV_KV_APPEND_H */
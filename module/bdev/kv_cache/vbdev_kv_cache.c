@@ -0,0 +1,1990 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+/*
+ * KV read cache. Sits on top of a KV capable bdev and serves RETRIEVE and EXIST
+ * for recently read keys from host memory. All other KV commands are passed to
+ * the base bdev.
+ *
+ * The cache is split into shards selected by key hash, each with its own lock,
+ * hash table and LRU list, so threads working on different keys rarely meet on
+ * the same lock. Only whole values are cached: a RETRIEVE miss populates the
+ * cache when it read the value from offset 0 and the buffer held all of it.
+ *
+ * STORE, DELETE and batched stores drop the key both when they are submitted
+ * and when they complete. Every drop bumps the shard generation, and a read
+ * that missed only fills the cache if the generation did not move while it was
+ * outstanding, so a value read before a concurrent write can never be cached
+ * after it.
+ *
+ * Optionally each shard also keeps a counting Bloom filter of the keys on the
+ * base bdev, so EXIST and RETRIEVE of keys that definitely do not exist complete
+ * without device I/O. The filter is filled by listing the whole key space when
+ * the cache is created. A STORE counts its key when submitted, before the device
+ * can make it visible, and a DELETE uncounts it once it succeeded; filter
+ * answers are only used after the listing finished. Counters are 4 bits wide
+ * and stick once saturated, so errors are always false positives. Overwrites
+ * count a key more than once, which only makes the filter less precise.
+ *
+ * All probes of a key fall into one 64 byte block and are derived from the same
+ * 64 bit hash as the cache lookup, so a filter check costs one cache miss.
+ *
+ * If given a SELECT capacity, the cache also keeps SELECT results, keyed on the
+ * key, the query with its white space normalized, the input and output types
+ * and the header options. Every SEND_SELECT on the cache bdev returns an id of
+ * the cache's own. A hit opens it on the cached result right away. A miss sends
+ * the query to the base bdev and fetches the whole result into hugepage memory
+ * before completing, so it can be cached; results too large for that stay on
+ * the base bdev and the id just maps to the base bdev's one. RETRIEVE_SELECT
+ * frees ids following the same options as the device does. STORE, DELETE and
+ * batched stores drop all results of their key and bump a generation, which
+ * keeps results fetched before a concurrent write out of the cache, like for
+ * values. Evicted results stay alive until their last id is freed.
+ */
+
+#include "spdk/stdinc.h"
+
+#include "vbdev_kv_cache.h"
+#include "spdk/env.h"
+#include "spdk/likely.h"
+#include "spdk/string.h"
+#include "spdk/thread.h"
+#include "spdk/util.h"
+
+#include "spdk/log.h"
+
+#define KV_CACHE_NUM_SHARDS		16
+#define KV_CACHE_DEFAULT_MAX_VALUE_SIZE	(64 * 1024)
+#define KV_CACHE_MIN_BUCKETS		64
+#define KV_CACHE_MAX_BUCKETS		(1U << 20)
+/* Expected bytes per entry, used to size the hash tables. */
+#define KV_CACHE_BUCKET_BYTES		512
+
+/* Bloom filter: 6 probes into a block of 128 4 bit counters, 16 counters per key. */
+#define KV_CACHE_FILTER_PROBES		6
+#define KV_CACHE_FILTER_BLOCK_WORDS	8
+#define KV_CACHE_FILTER_KEYS_PER_BLOCK	8
+#define KV_CACHE_FILTER_COUNTER_MAX	0xf
+#define KV_CACHE_SWEEP_SHARDS		16
+
+#define KV_CACHE_SELECT_BUCKETS		1024
+#define KV_CACHE_SELECT_ID_BUCKETS	256
+/* Ids that are never read to the end are dropped, oldest first, past this. */
+#define KV_CACHE_MAX_SELECT_IDS		4096
+#define KV_CACHE_MAX_SELECT_QUERY	(64 * 1024)
+#define KV_CACHE_DEFAULT_MAX_SELECT_RESULT	(1024 * 1024)
+
+static int vbdev_kv_cache_init(void);
+static int vbdev_kv_cache_get_ctx_size(void);
+static void vbdev_kv_cache_examine(struct spdk_bdev *bdev);
+static void vbdev_kv_cache_finish(void);
+static int vbdev_kv_cache_config_json(struct spdk_json_write_ctx *w);
+
+static struct spdk_bdev_module kv_cache_if = {
+	.name = "kv_cache",
+	.module_init = vbdev_kv_cache_init,
+	.get_ctx_size = vbdev_kv_cache_get_ctx_size,
+	.examine_config = vbdev_kv_cache_examine,
+	.module_fini = vbdev_kv_cache_finish,
+	.config_json = vbdev_kv_cache_config_json
+};
+
+SPDK_BDEV_MODULE_REGISTER(kv_cache, &kv_cache_if)
+
+/* Caches requested over RPC, kept so they can be created when their base bdev appears. */
+struct kv_cache_config {
+	char				*name;
+	char				*base_bdev_name;
+	uint64_t			capacity;
+	uint32_t			max_value_size;
+	enum vbdev_kv_cache_write_policy write_policy;
+	uint64_t			filter_keys;
+	uint64_t			select_capacity;
+	uint32_t			max_select_result_size;
+	TAILQ_ENTRY(kv_cache_config)	link;
+};
+static TAILQ_HEAD(, kv_cache_config) g_kv_cache_configs = TAILQ_HEAD_INITIALIZER(
+			g_kv_cache_configs);
+
+struct kv_cache_entry {
+	TAILQ_ENTRY(kv_cache_entry)	lru;
+	struct kv_cache_entry		*next;
+	uint64_t			hash;
+	uint32_t			value_len;
+	uint8_t				key_len;
+	uint8_t				key[NVME_KV_MAX_KEY_LENGTH];
+	uint8_t				value[];
+};
+
+struct kv_cache_shard {
+	pthread_spinlock_t		lock;
+	struct kv_cache_entry		**buckets;
+	uint32_t			mask;
+	TAILQ_HEAD(kv_cache_lru, kv_cache_entry) lru;
+	uint64_t			capacity;
+	uint64_t			bytes_used;
+	uint64_t			num_entries;
+	/* Bumped whenever a key of this shard is dropped. */
+	uint64_t			generation;
+	/* Counting Bloom filter, NULL if disabled. */
+	uint64_t			*filter;
+	uint32_t			filter_mask;
+	bool				filter_ready;
+	/* Generation at the time filter_ready was set. */
+	uint64_t			filter_ready_gen;
+	struct vbdev_kv_cache_stats	stats;
+} __attribute__((aligned(SPDK_CACHE_LINE_SIZE)));
+
+struct kv_cache_select_result {
+	TAILQ_ENTRY(kv_cache_select_result) lru;
+	TAILQ_ENTRY(kv_cache_select_result) link;
+	/* Open ids; a result that is no longer cached is freed with the last one. */
+	uint32_t			refs;
+	bool				cached;
+	uint64_t			key_hash;
+	uint64_t			query_hash;
+	uint8_t				key_len;
+	uint8_t				key[NVME_KV_MAX_KEY_LENGTH];
+	uint8_t				options;
+	uint8_t				input_type;
+	uint8_t				output_type;
+	/* Result data, in DMA-able memory. */
+	void				*data;
+	uint32_t			len;
+	uint32_t			query_len;
+	char				query[];
+};
+TAILQ_HEAD(kv_cache_select_list, kv_cache_select_result);
+
+struct kv_cache_select_bucket {
+	struct kv_cache_select_list	results;
+	/* Bumped whenever a key of this bucket is written. */
+	uint64_t			generation;
+};
+
+/* An id returned by SEND_SELECT on the cache bdev. */
+struct kv_cache_select_id {
+	TAILQ_ENTRY(kv_cache_select_id)	link;
+	TAILQ_ENTRY(kv_cache_select_id)	age;
+	uint32_t			id;
+	/* Cached result, or NULL if the result is read from the base bdev. */
+	struct kv_cache_select_result	*result;
+	uint32_t			base_id;
+};
+TAILQ_HEAD(kv_cache_select_id_list, kv_cache_select_id);
+
+struct kv_cache_selects {
+	pthread_spinlock_t		lock;
+	/* Hashed by key; NULL if the SELECT cache is disabled. */
+	struct kv_cache_select_bucket	*buckets;
+	struct kv_cache_select_list	lru;
+	struct kv_cache_select_id_list	ids[KV_CACHE_SELECT_ID_BUCKETS];
+	struct kv_cache_select_id_list	ids_by_age;
+	uint32_t			num_ids;
+	uint32_t			next_id;
+	uint64_t			capacity;
+	uint32_t			max_result_size;
+	uint64_t			bytes_used;
+	uint64_t			num_entries;
+	struct vbdev_kv_cache_stats	stats;
+};
+
+struct vbdev_kv_cache {
+	struct spdk_bdev		bdev;
+	struct spdk_bdev		*base_bdev;
+	struct spdk_bdev_desc		*base_desc;
+	struct spdk_thread		*thread;
+	uint32_t			max_value_size;
+	enum vbdev_kv_cache_write_policy write_policy;
+	uint64_t			filter_keys;
+	/* Key space listing that fills the filters, NULL once done. */
+	struct kv_cache_sweep		*sweep;
+	struct kv_cache_shard		shards[KV_CACHE_NUM_SHARDS];
+	struct kv_cache_selects		selects;
+	TAILQ_ENTRY(vbdev_kv_cache)	link;
+};
+static TAILQ_HEAD(, vbdev_kv_cache) g_kv_cache_nodes = TAILQ_HEAD_INITIALIZER(g_kv_cache_nodes);
+
+struct kv_cache_io_channel {
+	struct spdk_io_channel	*base_ch;
+};
+
+enum kv_cache_lookup {
+	/* The key is cached. */
+	KV_CACHE_HIT,
+	/* The key is not cached and the filter was not consulted. */
+	KV_CACHE_MISS,
+	/* The key is not cached and the filter says it may exist. */
+	KV_CACHE_MAYBE,
+	/* The filter says the key does not exist. */
+	KV_CACHE_ABSENT,
+};
+
+struct kv_cache_bdev_io {
+	struct spdk_io_channel		*ch;
+	/* Generation of the key's shard when the command was submitted. */
+	uint64_t			generation;
+	enum kv_cache_lookup		lookup;
+	/* SEND_SELECT miss: the lookup key, later the cached result, and the fetch buffer. */
+	struct kv_cache_select_result	*select;
+	void				*select_buf;
+	uint32_t			select_base_id;
+	struct spdk_bdev_io_wait_entry	bdev_io_wait;
+};
+
+static void vbdev_kv_cache_submit_request(struct spdk_io_channel *ch, struct spdk_bdev_io *bdev_io);
+static void kv_cache_select_invalidate(struct vbdev_kv_cache *cache, const uint8_t *key,
+				       size_t key_len, uint64_t hash);
+
+/* Cache */
+
+/*
+ * The top 4 bits of the hash pick the shard, the low bits the hash bucket and
+ * bits 32-59 the filter block.
+ */
+static inline struct kv_cache_shard *
+kv_cache_shard(struct vbdev_kv_cache *cache, uint64_t hash)
+{
+	return &cache->shards[hash >> 60];
+}
+
+static inline uint64_t
+kv_cache_entry_size(uint32_t value_len)
+{
+	return sizeof(struct kv_cache_entry) + value_len;
+}
+
+static struct kv_cache_entry **
+kv_cache_find(struct kv_cache_shard *shard, const uint8_t *key, size_t key_len, uint64_t hash)
+{
+	struct kv_cache_entry **pos = &shard->buckets[hash & shard->mask];
+
+	for (; *pos != NULL; pos = &(*pos)->next) {
+		if ((*pos)->hash == hash && (*pos)->key_len == key_len &&
+		    memcmp((*pos)->key, key, key_len) == 0) {
+			break;
+		}
+	}
+
+	return pos;
+}
+
+static void
+kv_cache_unlink(struct kv_cache_shard *shard, struct kv_cache_entry **pos)
+{
+	struct kv_cache_entry *entry = *pos;
+
+	*pos = entry->next;
+	TAILQ_REMOVE(&shard->lru, entry, lru);
+	shard->bytes_used -= kv_cache_entry_size(entry->value_len);
+	shard->num_entries--;
+	free(entry);
+}
+
+/*
+ * Adjust the filter counters of a key by delta, which is 1 or -1. Saturated
+ * counters are left alone, as they no longer know how many keys they count.
+ */
+static void
+kv_cache_filter_update(struct kv_cache_shard *shard, uint64_t hash, int delta)
+{
+	uint64_t *block = &shard->filter[((hash >> 32) & shard->filter_mask) * KV_CACHE_FILTER_BLOCK_WORDS];
+	uint64_t probes = hash * 0xc2b2ae3d27d4eb4fULL;
+	uint64_t counter;
+	uint32_t word, shift;
+	int i;
+
+	for (i = 0; i < KV_CACHE_FILTER_PROBES; i++, probes >>= 7) {
+		word = (probes >> 4) & (KV_CACHE_FILTER_BLOCK_WORDS - 1);
+		shift = (probes & 0xf) * 4;
+		counter = (block[word] >> shift) & KV_CACHE_FILTER_COUNTER_MAX;
+		if (counter == KV_CACHE_FILTER_COUNTER_MAX || (counter == 0 && delta < 0)) {
+			continue;
+		}
+		block[word] += (uint64_t)(int64_t)delta << shift;
+	}
+}
+
+/* Returns false only if the key is definitely not on the base bdev. */
+static bool
+kv_cache_filter_may_contain(struct kv_cache_shard *shard, uint64_t hash)
+{
+	uint64_t *block, probes;
+	uint32_t word, shift;
+	int i;
+
+	if (shard->filter == NULL || !shard->filter_ready) {
+		return true;
+	}
+
+	block = &shard->filter[((hash >> 32) & shard->filter_mask) * KV_CACHE_FILTER_BLOCK_WORDS];
+	probes = hash * 0xc2b2ae3d27d4eb4fULL;
+	for (i = 0; i < KV_CACHE_FILTER_PROBES; i++, probes >>= 7) {
+		word = (probes >> 4) & (KV_CACHE_FILTER_BLOCK_WORDS - 1);
+		shift = (probes & 0xf) * 4;
+		if (((block[word] >> shift) & KV_CACHE_FILTER_COUNTER_MAX) == 0) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void
+kv_cache_filter_add(struct vbdev_kv_cache *cache, const uint8_t *key, size_t key_len)
+{
+	uint64_t hash = spdk_bdev_kv_key_hash(key, key_len);
+	struct kv_cache_shard *shard = kv_cache_shard(cache, hash);
+
+	if (shard->filter == NULL) {
+		return;
+	}
+
+	pthread_spin_lock(&shard->lock);
+	kv_cache_filter_update(shard, hash, 1);
+	pthread_spin_unlock(&shard->lock);
+}
+
+/*
+ * Uncount a key that was counted before. generation is the shard generation
+ * returned by kv_cache_invalidate() when the command that removed the key was
+ * submitted; keys deleted before the filter was ready may never have been
+ * counted, so they are left alone.
+ */
+static void
+kv_cache_filter_remove(struct vbdev_kv_cache *cache, const uint8_t *key, size_t key_len,
+		       uint64_t generation)
+{
+	uint64_t hash = spdk_bdev_kv_key_hash(key, key_len);
+	struct kv_cache_shard *shard = kv_cache_shard(cache, hash);
+
+	if (shard->filter == NULL) {
+		return;
+	}
+
+	pthread_spin_lock(&shard->lock);
+	if (shard->filter_ready && generation > shard->filter_ready_gen) {
+		kv_cache_filter_update(shard, hash, -1);
+	}
+	pthread_spin_unlock(&shard->lock);
+}
+
+/* Drop a key from the cache. Returns the new shard generation. */
+static uint64_t
+kv_cache_invalidate(struct vbdev_kv_cache *cache, const uint8_t *key, size_t key_len)
+{
+	uint64_t hash = spdk_bdev_kv_key_hash(key, key_len);
+	struct kv_cache_shard *shard = kv_cache_shard(cache, hash);
+	struct kv_cache_entry **pos;
+	uint64_t generation;
+
+	pthread_spin_lock(&shard->lock);
+	pos = kv_cache_find(shard, key, key_len, hash);
+	if (*pos != NULL) {
+		kv_cache_unlink(shard, pos);
+		shard->stats.invalidations++;
+	}
+	generation = ++shard->generation;
+	pthread_spin_unlock(&shard->lock);
+
+	kv_cache_select_invalidate(cache, key, key_len, hash);
+
+	return generation;
+}
+
+/*
+ * Cache the value held in iovs, unless the key's shard has seen an invalidation
+ * since generation was sampled.
+ */
+static void
+kv_cache_insert(struct vbdev_kv_cache *cache, const uint8_t *key, size_t key_len,
+		struct iovec *iovs, int iovcnt, uint32_t value_len, uint64_t generation)
+{
+	uint64_t hash = spdk_bdev_kv_key_hash(key, key_len);
+	struct kv_cache_shard *shard = kv_cache_shard(cache, hash);
+	struct kv_cache_entry *entry, *victim, **pos;
+	uint64_t size = kv_cache_entry_size(value_len);
+
+	if (value_len > cache->max_value_size || size > shard->capacity) {
+		return;
+	}
+
+	/* Copy outside of the lock; the entry is thrown away if it turns out to be stale. */
+	entry = malloc(size);
+	if (entry == NULL) {
+		return;
+	}
+	entry->hash = hash;
+	entry->key_len = key_len;
+	memcpy(entry->key, key, key_len);
+	entry->value_len = value_len;
+	spdk_copy_iovs_to_buf(entry->value, value_len, iovs, iovcnt);
+
+	pthread_spin_lock(&shard->lock);
+	if (shard->generation != generation) {
+		pthread_spin_unlock(&shard->lock);
+		free(entry);
+		return;
+	}
+
+	pos = kv_cache_find(shard, key, key_len, hash);
+	if (*pos != NULL) {
+		kv_cache_unlink(shard, pos);
+	}
+
+	while (shard->bytes_used + size > shard->capacity) {
+		victim = TAILQ_LAST(&shard->lru, kv_cache_lru);
+		assert(victim != NULL);
+		kv_cache_unlink(shard, kv_cache_find(shard, victim->key, victim->key_len, victim->hash));
+		shard->stats.evictions++;
+	}
+
+	pos = &shard->buckets[hash & shard->mask];
+	entry->next = *pos;
+	*pos = entry;
+	TAILQ_INSERT_HEAD(&shard->lru, entry, lru);
+	shard->bytes_used += size;
+	shard->num_entries++;
+	shard->stats.insertions++;
+	pthread_spin_unlock(&shard->lock);
+}
+
+static enum kv_cache_lookup
+kv_cache_lookup_miss(struct kv_cache_shard *shard, uint64_t hash)
+{
+	if (shard->filter == NULL || !shard->filter_ready) {
+		return KV_CACHE_MISS;
+	}
+
+	if (kv_cache_filter_may_contain(shard, hash)) {
+		return KV_CACHE_MAYBE;
+	}
+
+	shard->stats.filter_negatives++;
+	return KV_CACHE_ABSENT;
+}
+
+/*
+ * Serve a RETRIEVE from the cache. Fills the buffer if the key is cached;
+ * on a miss samples the shard generation for the fill.
+ */
+static enum kv_cache_lookup
+kv_cache_retrieve(struct vbdev_kv_cache *cache, struct spdk_bdev_io *bdev_io,
+		  uint32_t *value_len, uint64_t *generation)
+{
+	const uint8_t *key = bdev_io->u.bdev.nvme_kv.key;
+	size_t key_len = bdev_io->u.bdev.nvme_kv.key_length;
+	uint64_t offset = bdev_io->u.bdev.nvme_kv.offset;
+	uint64_t hash = spdk_bdev_kv_key_hash(key, key_len);
+	struct kv_cache_shard *shard = kv_cache_shard(cache, hash);
+	struct kv_cache_entry *entry;
+	enum kv_cache_lookup rc;
+
+	pthread_spin_lock(&shard->lock);
+	entry = *kv_cache_find(shard, key, key_len, hash);
+	/* Leave reads past the end of the value to the device, whatever it makes of them. */
+	if (entry == NULL || offset > entry->value_len) {
+		shard->stats.retrieve_misses++;
+		rc = entry == NULL ? kv_cache_lookup_miss(shard, hash) : KV_CACHE_MISS;
+		*generation = shard->generation;
+		pthread_spin_unlock(&shard->lock);
+		return rc;
+	}
+
+	spdk_copy_buf_to_iovs(bdev_io->u.bdev.iovs, bdev_io->u.bdev.iovcnt, entry->value + offset,
+			      spdk_min(entry->value_len - offset, bdev_io->u.bdev.nvme_kv.buffer_size));
+	*value_len = entry->value_len;
+	TAILQ_REMOVE(&shard->lru, entry, lru);
+	TAILQ_INSERT_HEAD(&shard->lru, entry, lru);
+	shard->stats.retrieve_hits++;
+	pthread_spin_unlock(&shard->lock);
+
+	return KV_CACHE_HIT;
+}
+
+static enum kv_cache_lookup
+kv_cache_exist(struct vbdev_kv_cache *cache, const uint8_t *key, size_t key_len)
+{
+	uint64_t hash = spdk_bdev_kv_key_hash(key, key_len);
+	struct kv_cache_shard *shard = kv_cache_shard(cache, hash);
+	enum kv_cache_lookup rc;
+
+	pthread_spin_lock(&shard->lock);
+	if (*kv_cache_find(shard, key, key_len, hash) != NULL) {
+		shard->stats.exist_hits++;
+		rc = KV_CACHE_HIT;
+	} else {
+		shard->stats.exist_misses++;
+		rc = kv_cache_lookup_miss(shard, hash);
+	}
+	pthread_spin_unlock(&shard->lock);
+
+	return rc;
+}
+
+/* Count a key the filter let through but the base bdev does not have. */
+static void
+kv_cache_filter_false_positive(struct vbdev_kv_cache *cache, const uint8_t *key, size_t key_len)
+{
+	struct kv_cache_shard *shard = kv_cache_shard(cache, spdk_bdev_kv_key_hash(key, key_len));
+
+	pthread_spin_lock(&shard->lock);
+	shard->stats.filter_false_positives++;
+	pthread_spin_unlock(&shard->lock);
+}
+
+static int
+kv_cache_shards_init(struct vbdev_kv_cache *cache, uint64_t capacity, uint64_t filter_keys)
+{
+	struct kv_cache_shard *shard;
+	uint64_t shard_capacity = capacity / KV_CACHE_NUM_SHARDS;
+	uint64_t filter_size = 0;
+	uint32_t num_buckets, num_blocks = 0;
+	int i;
+
+	num_buckets = spdk_min(shard_capacity / KV_CACHE_BUCKET_BYTES, KV_CACHE_MAX_BUCKETS);
+	num_buckets = spdk_align32pow2(spdk_max(num_buckets, KV_CACHE_MIN_BUCKETS));
+
+	if (filter_keys != 0) {
+		num_blocks = spdk_min(filter_keys / KV_CACHE_FILTER_KEYS_PER_BLOCK / KV_CACHE_NUM_SHARDS,
+				      1ULL << 28);
+		num_blocks = spdk_align32pow2(spdk_max(num_blocks, 1));
+		filter_size = (uint64_t)num_blocks * KV_CACHE_FILTER_BLOCK_WORDS * sizeof(uint64_t);
+	}
+
+	for (i = 0; i < KV_CACHE_NUM_SHARDS; i++) {
+		shard = &cache->shards[i];
+		shard->buckets = calloc(num_buckets, sizeof(*shard->buckets));
+		if (shard->buckets == NULL) {
+			return -ENOMEM;
+		}
+		shard->mask = num_buckets - 1;
+		shard->capacity = shard_capacity;
+		TAILQ_INIT(&shard->lru);
+		pthread_spin_init(&shard->lock, PTHREAD_PROCESS_PRIVATE);
+
+		if (filter_size != 0) {
+			/* Blocks must not straddle cache lines. */
+			if (posix_memalign((void **)&shard->filter, SPDK_CACHE_LINE_SIZE, filter_size)) {
+				shard->filter = NULL;
+				return -ENOMEM;
+			}
+			memset(shard->filter, 0, filter_size);
+			shard->filter_mask = num_blocks - 1;
+		}
+	}
+
+	return 0;
+}
+
+static void
+kv_cache_shards_free(struct vbdev_kv_cache *cache)
+{
+	struct kv_cache_shard *shard;
+	struct kv_cache_entry *entry;
+	int i;
+
+	for (i = 0; i < KV_CACHE_NUM_SHARDS; i++) {
+		shard = &cache->shards[i];
+		if (shard->buckets == NULL) {
+			continue;
+		}
+		while ((entry = TAILQ_FIRST(&shard->lru)) != NULL) {
+			TAILQ_REMOVE(&shard->lru, entry, lru);
+			free(entry);
+		}
+		free(shard->buckets);
+		free(shard->filter);
+		pthread_spin_destroy(&shard->lock);
+	}
+}
+
+/* SELECT cache */
+
+static inline uint64_t
+kv_cache_select_result_size(const struct kv_cache_select_result *result)
+{
+	return sizeof(*result) + result->query_len + result->len;
+}
+
+/*
+ * Normalize a query in place, so that queries differing only in white space
+ * share a result: runs of white space outside of quotes become one space, and
+ * leading and trailing white space is dropped. The query ends at the first NUL,
+ * as the contiguous API passes NUL terminated queries. Returns the new length.
+ */
+static uint32_t
+kv_cache_select_normalize(char *query, uint32_t len)
+{
+	uint32_t i, out = 0;
+	bool space = false;
+	char quote = 0;
+
+	for (i = 0; i < len && query[i] != '\0'; i++) {
+		if (quote == 0 && isspace((unsigned char)query[i])) {
+			space = true;
+			continue;
+		}
+		if (space && out != 0) {
+			query[out++] = ' ';
+		}
+		space = false;
+
+		/* A doubled quote inside a literal closes and reopens it, which is fine. */
+		if (quote == 0 && (query[i] == '\'' || query[i] == '"')) {
+			quote = query[i];
+		} else if (query[i] == quote) {
+			quote = 0;
+		}
+		query[out++] = query[i];
+	}
+
+	return out;
+}
+
+static uint64_t
+kv_cache_select_query_hash(const char *query, uint32_t len)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	uint32_t i;
+
+	for (i = 0; i < len; i++) {
+		h = (h ^ (uint8_t)query[i]) * 0x100000001b3ULL;
+	}
+
+	return h;
+}
+
+/* Build the lookup key of a SEND_SELECT. Returns NULL if it is not to be cached. */
+static struct kv_cache_select_result *
+kv_cache_select_key(struct spdk_bdev_io *bdev_io)
+{
+	struct kv_cache_select_result *result;
+	uint32_t query_len = bdev_io->u.bdev.nvme_kv.buffer_size;
+
+	if (query_len > KV_CACHE_MAX_SELECT_QUERY) {
+		return NULL;
+	}
+
+	result = calloc(1, sizeof(*result) + query_len);
+	if (result == NULL) {
+		return NULL;
+	}
+
+	spdk_copy_iovs_to_buf(result->query, query_len, bdev_io->u.bdev.iovs, bdev_io->u.bdev.iovcnt);
+	result->query_len = kv_cache_select_normalize(result->query, query_len);
+	result->query_hash = kv_cache_select_query_hash(result->query, result->query_len);
+	result->key_len = bdev_io->u.bdev.nvme_kv.key_length;
+	memcpy(result->key, bdev_io->u.bdev.nvme_kv.key, result->key_len);
+	result->key_hash = spdk_bdev_kv_key_hash(result->key, result->key_len);
+	result->options = bdev_io->u.bdev.nvme_kv.options;
+	result->input_type = bdev_io->u.bdev.nvme_kv.select_input_type;
+	result->output_type = bdev_io->u.bdev.nvme_kv.select_output_type;
+
+	return result;
+}
+
+static inline struct kv_cache_select_bucket *
+kv_cache_select_bucket(struct kv_cache_selects *selects, uint64_t key_hash)
+{
+	return &selects->buckets[key_hash & (KV_CACHE_SELECT_BUCKETS - 1)];
+}
+
+static struct kv_cache_select_result *
+kv_cache_select_find(struct kv_cache_selects *selects, const struct kv_cache_select_result *key)
+{
+	struct kv_cache_select_result *result;
+
+	TAILQ_FOREACH(result, &kv_cache_select_bucket(selects, key->key_hash)->results, link) {
+		if (result->query_hash == key->query_hash && result->query_len == key->query_len &&
+		    result->key_len == key->key_len && result->options == key->options &&
+		    result->input_type == key->input_type && result->output_type == key->output_type &&
+		    memcmp(result->key, key->key, key->key_len) == 0 &&
+		    memcmp(result->query, key->query, key->query_len) == 0) {
+			return result;
+		}
+	}
+
+	return NULL;
+}
+
+static void
+kv_cache_select_result_free(struct kv_cache_select_result *result)
+{
+	spdk_free(result->data);
+	free(result);
+}
+
+static void
+kv_cache_select_result_put(struct kv_cache_select_result *result)
+{
+	assert(result->refs > 0);
+	if (--result->refs == 0 && !result->cached) {
+		kv_cache_select_result_free(result);
+	}
+}
+
+/* Drop a result from the cache. It is freed once no id refers to it any more. */
+static void
+kv_cache_select_unlink(struct kv_cache_selects *selects, struct kv_cache_select_result *result)
+{
+	TAILQ_REMOVE(&kv_cache_select_bucket(selects, result->key_hash)->results, result, link);
+	TAILQ_REMOVE(&selects->lru, result, lru);
+	selects->bytes_used -= kv_cache_select_result_size(result);
+	selects->num_entries--;
+	result->cached = false;
+	if (result->refs == 0) {
+		kv_cache_select_result_free(result);
+	}
+}
+
+/*
+ * Cache a fetched result, unless its key was written since generation was
+ * sampled. Called with the lock held.
+ */
+static void
+kv_cache_select_insert(struct kv_cache_selects *selects, struct kv_cache_select_result *result,
+		       uint64_t generation)
+{
+	struct kv_cache_select_bucket *bucket = kv_cache_select_bucket(selects, result->key_hash);
+	struct kv_cache_select_result *victim;
+	uint64_t size = kv_cache_select_result_size(result);
+
+	if (bucket->generation != generation || size > selects->capacity) {
+		return;
+	}
+
+	victim = kv_cache_select_find(selects, result);
+	if (victim != NULL) {
+		kv_cache_select_unlink(selects, victim);
+	}
+
+	while (selects->bytes_used + size > selects->capacity) {
+		victim = TAILQ_LAST(&selects->lru, kv_cache_select_list);
+		assert(victim != NULL);
+		kv_cache_select_unlink(selects, victim);
+		selects->stats.select_evictions++;
+	}
+
+	TAILQ_INSERT_HEAD(&bucket->results, result, link);
+	TAILQ_INSERT_HEAD(&selects->lru, result, lru);
+	result->cached = true;
+	selects->bytes_used += size;
+	selects->num_entries++;
+	selects->stats.select_insertions++;
+}
+
+/* Drop all results of a key, and keep results fetched before now out of the cache. */
+static void
+kv_cache_select_invalidate(struct vbdev_kv_cache *cache, const uint8_t *key, size_t key_len,
+			   uint64_t hash)
+{
+	struct kv_cache_selects *selects = &cache->selects;
+	struct kv_cache_select_bucket *bucket;
+	struct kv_cache_select_result *result, *tmp;
+
+	if (selects->buckets == NULL) {
+		return;
+	}
+
+	bucket = kv_cache_select_bucket(selects, hash);
+	pthread_spin_lock(&selects->lock);
+	TAILQ_FOREACH_SAFE(result, &bucket->results, link, tmp) {
+		if (result->key_len == key_len && memcmp(result->key, key, key_len) == 0) {
+			kv_cache_select_unlink(selects, result);
+			selects->stats.select_invalidations++;
+		}
+	}
+	bucket->generation++;
+	pthread_spin_unlock(&selects->lock);
+}
+
+static struct kv_cache_select_id *
+kv_cache_select_id_find(struct kv_cache_selects *selects, uint32_t id)
+{
+	struct kv_cache_select_id *select_id;
+
+	TAILQ_FOREACH(select_id, &selects->ids[id % KV_CACHE_SELECT_ID_BUCKETS], link) {
+		if (select_id->id == id) {
+			return select_id;
+		}
+	}
+
+	return NULL;
+}
+
+static void
+kv_cache_select_id_free(struct kv_cache_selects *selects, struct kv_cache_select_id *select_id)
+{
+	TAILQ_REMOVE(&selects->ids[select_id->id % KV_CACHE_SELECT_ID_BUCKETS], select_id, link);
+	TAILQ_REMOVE(&selects->ids_by_age, select_id, age);
+	selects->num_ids--;
+	if (select_id->result != NULL) {
+		kv_cache_select_result_put(select_id->result);
+	}
+	free(select_id);
+}
+
+/*
+ * Hand out an id for a cached result, or for the select base_id on the base
+ * bdev if result is NULL. Called with the lock held. Returns the id.
+ */
+static uint32_t
+kv_cache_select_id_open(struct kv_cache_selects *selects, struct kv_cache_select_id *select_id,
+			struct kv_cache_select_result *result, uint32_t base_id)
+{
+	if (selects->num_ids == KV_CACHE_MAX_SELECT_IDS) {
+		kv_cache_select_id_free(selects, TAILQ_FIRST(&selects->ids_by_age));
+	}
+
+	do {
+		select_id->id = ++selects->next_id;
+	} while (select_id->id == 0 || kv_cache_select_id_find(selects, select_id->id) != NULL);
+
+	select_id->result = result;
+	select_id->base_id = base_id;
+	if (result != NULL) {
+		result->refs++;
+	}
+	TAILQ_INSERT_TAIL(&selects->ids[select_id->id % KV_CACHE_SELECT_ID_BUCKETS], select_id, link);
+	TAILQ_INSERT_TAIL(&selects->ids_by_age, select_id, age);
+	selects->num_ids++;
+
+	return select_id->id;
+}
+
+/* Whether a RETRIEVE_SELECT frees the select, the same way the device decides it. */
+static inline bool
+kv_cache_select_retrieve_frees(uint8_t options, uint64_t offset, uint64_t nbytes, uint32_t len)
+{
+	return options == 0 ||
+	       ((options & NVME_KV_SELECT_CMD_OPTION_DO_NOT_FREE_IF_NOT_ALL_DATA_FETCHED) &&
+		offset + nbytes >= len);
+}
+
+static int
+kv_cache_selects_init(struct vbdev_kv_cache *cache, uint64_t capacity, uint32_t max_result_size)
+{
+	struct kv_cache_selects *selects = &cache->selects;
+	int i;
+
+	if (capacity == 0) {
+		return 0;
+	}
+
+	selects->buckets = calloc(KV_CACHE_SELECT_BUCKETS, sizeof(*selects->buckets));
+	if (selects->buckets == NULL) {
+		return -ENOMEM;
+	}
+	for (i = 0; i < KV_CACHE_SELECT_BUCKETS; i++) {
+		TAILQ_INIT(&selects->buckets[i].results);
+	}
+	for (i = 0; i < KV_CACHE_SELECT_ID_BUCKETS; i++) {
+		TAILQ_INIT(&selects->ids[i]);
+	}
+	TAILQ_INIT(&selects->ids_by_age);
+	TAILQ_INIT(&selects->lru);
+	selects->capacity = capacity;
+	selects->max_result_size = max_result_size;
+	pthread_spin_init(&selects->lock, PTHREAD_PROCESS_PRIVATE);
+
+	return 0;
+}
+
+static void
+kv_cache_selects_free(struct vbdev_kv_cache *cache)
+{
+	struct kv_cache_selects *selects = &cache->selects;
+	struct kv_cache_select_id *select_id;
+	struct kv_cache_select_result *result;
+
+	if (selects->buckets == NULL) {
+		return;
+	}
+
+	while ((select_id = TAILQ_FIRST(&selects->ids_by_age)) != NULL) {
+		kv_cache_select_id_free(selects, select_id);
+	}
+	while ((result = TAILQ_FIRST(&selects->lru)) != NULL) {
+		kv_cache_select_unlink(selects, result);
+	}
+	free(selects->buckets);
+	pthread_spin_destroy(&selects->lock);
+}
+
+/* I/O path */
+
+static void
+kv_cache_complete_io(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct spdk_bdev_io *orig_io = cb_arg;
+
+	spdk_bdev_kv_io_complete_from(orig_io, bdev_io);
+	spdk_bdev_free_io(bdev_io);
+}
+
+static void
+kv_cache_retrieve_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct spdk_bdev_io *orig_io = cb_arg;
+	struct vbdev_kv_cache *cache = SPDK_CONTAINEROF(orig_io->bdev, struct vbdev_kv_cache, bdev);
+	struct kv_cache_bdev_io *io_ctx = (struct kv_cache_bdev_io *)orig_io->driver_ctx;
+	uint32_t value_len;
+	int sct, sc;
+
+	spdk_bdev_io_get_nvme_status(bdev_io, &value_len, &sct, &sc);
+	if (success && orig_io->u.bdev.nvme_kv.offset == 0 &&
+	    value_len <= orig_io->u.bdev.nvme_kv.buffer_size) {
+		kv_cache_insert(cache, orig_io->u.bdev.nvme_kv.key, orig_io->u.bdev.nvme_kv.key_length,
+				orig_io->u.bdev.iovs, orig_io->u.bdev.iovcnt, value_len, io_ctx->generation);
+	} else if (io_ctx->lookup == KV_CACHE_MAYBE && sct == SPDK_NVME_SCT_GENERIC &&
+		   sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST) {
+		kv_cache_filter_false_positive(cache, orig_io->u.bdev.nvme_kv.key,
+					       orig_io->u.bdev.nvme_kv.key_length);
+	}
+
+	kv_cache_complete_io(bdev_io, success, orig_io);
+}
+
+static void
+kv_cache_exist_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct spdk_bdev_io *orig_io = cb_arg;
+	struct vbdev_kv_cache *cache = SPDK_CONTAINEROF(orig_io->bdev, struct vbdev_kv_cache, bdev);
+	struct kv_cache_bdev_io *io_ctx = (struct kv_cache_bdev_io *)orig_io->driver_ctx;
+	uint32_t cdw0;
+	int sct, sc;
+
+	spdk_bdev_io_get_nvme_status(bdev_io, &cdw0, &sct, &sc);
+	if (io_ctx->lookup == KV_CACHE_MAYBE && sct == SPDK_NVME_SCT_GENERIC &&
+	    sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST) {
+		kv_cache_filter_false_positive(cache, orig_io->u.bdev.nvme_kv.key,
+					       orig_io->u.bdev.nvme_kv.key_length);
+	}
+
+	kv_cache_complete_io(bdev_io, success, orig_io);
+}
+
+static void
+kv_cache_store_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct spdk_bdev_io *orig_io = cb_arg;
+	struct vbdev_kv_cache *cache = SPDK_CONTAINEROF(orig_io->bdev, struct vbdev_kv_cache, bdev);
+	struct kv_cache_bdev_io *io_ctx = (struct kv_cache_bdev_io *)orig_io->driver_ctx;
+	unsigned char *key = orig_io->u.bdev.nvme_kv.key;
+	size_t key_len = orig_io->u.bdev.nvme_kv.key_length;
+	uint8_t options = orig_io->u.bdev.nvme_kv.options;
+	uint32_t cdw0;
+	int sct, sc;
+
+	if (success && cache->write_policy == VBDEV_KV_CACHE_WRITE_THROUGH &&
+	    !(options & NVME_KV_STORE_CMD_OPTION_APPEND)) {
+		/* Cached only if no other write to the shard raced with this one. */
+		kv_cache_insert(cache, key, key_len, orig_io->u.bdev.iovs, orig_io->u.bdev.iovcnt,
+				orig_io->u.bdev.nvme_kv.buffer_size, io_ctx->generation);
+		kv_cache_select_invalidate(cache, key, key_len,
+					   spdk_bdev_kv_key_hash(key, key_len));
+	} else {
+		kv_cache_invalidate(cache, key, key_len);
+	}
+
+	/*
+	 * The key was counted at submit. If the device says it already existed,
+	 * it was counted before, so take the extra count back.
+	 */
+	spdk_bdev_io_get_nvme_status(bdev_io, &cdw0, &sct, &sc);
+	if ((success && (options & NVME_KV_STORE_CMD_OPTION_MUST_EXIST)) ||
+	    (sct == SPDK_NVME_SCT_GENERIC && sc == SPDK_NVME_SC_KEY_EXISTS)) {
+		kv_cache_filter_remove(cache, key, key_len, io_ctx->generation);
+	}
+
+	kv_cache_complete_io(bdev_io, success, orig_io);
+}
+
+static void
+kv_cache_delete_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct spdk_bdev_io *orig_io = cb_arg;
+	struct vbdev_kv_cache *cache = SPDK_CONTAINEROF(orig_io->bdev, struct vbdev_kv_cache, bdev);
+	struct kv_cache_bdev_io *io_ctx = (struct kv_cache_bdev_io *)orig_io->driver_ctx;
+
+	kv_cache_invalidate(cache, orig_io->u.bdev.nvme_kv.key, orig_io->u.bdev.nvme_kv.key_length);
+	if (success) {
+		kv_cache_filter_remove(cache, orig_io->u.bdev.nvme_kv.key, orig_io->u.bdev.nvme_kv.key_length,
+				       io_ctx->generation);
+	}
+
+	kv_cache_complete_io(bdev_io, success, orig_io);
+}
+
+static void
+kv_cache_batch_invalidate(struct vbdev_kv_cache *cache, struct spdk_bdev_io *bdev_io, bool count)
+{
+	struct spdk_bdev_kv_batch_entry *entries = bdev_io->u.bdev.nvme_kv.batch;
+	uint32_t i;
+
+	for (i = 0; i < bdev_io->u.bdev.nvme_kv.batch_count; i++) {
+		kv_cache_invalidate(cache, entries[i].key, entries[i].key_length);
+		if (count) {
+			kv_cache_filter_add(cache, entries[i].key, entries[i].key_length);
+		}
+	}
+}
+
+static void
+kv_cache_batch_store_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct spdk_bdev_io *orig_io = cb_arg;
+	struct vbdev_kv_cache *cache = SPDK_CONTAINEROF(orig_io->bdev, struct vbdev_kv_cache, bdev);
+
+	kv_cache_batch_invalidate(cache, orig_io, false);
+	kv_cache_complete_io(bdev_io, success, orig_io);
+}
+
+static void
+vbdev_kv_cache_resubmit_io(void *arg)
+{
+	struct spdk_bdev_io *bdev_io = (struct spdk_bdev_io *)arg;
+	struct kv_cache_bdev_io *io_ctx = (struct kv_cache_bdev_io *)bdev_io->driver_ctx;
+
+	vbdev_kv_cache_submit_request(io_ctx->ch, bdev_io);
+}
+
+static void
+vbdev_kv_cache_queue_io(struct spdk_bdev_io *bdev_io)
+{
+	struct kv_cache_bdev_io *io_ctx = (struct kv_cache_bdev_io *)bdev_io->driver_ctx;
+	struct kv_cache_io_channel *cache_ch = spdk_io_channel_get_ctx(io_ctx->ch);
+	int rc;
+
+	io_ctx->bdev_io_wait.bdev = bdev_io->bdev;
+	io_ctx->bdev_io_wait.cb_fn = vbdev_kv_cache_resubmit_io;
+	io_ctx->bdev_io_wait.cb_arg = bdev_io;
+
+	rc = spdk_bdev_queue_io_wait(bdev_io->bdev, cache_ch->base_ch, &io_ctx->bdev_io_wait);
+	if (rc != 0) {
+		SPDK_ERRLOG("Queue io failed in vbdev_kv_cache_queue_io, rc=%d.\n", rc);
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+	}
+}
+
+/*
+ * Serve a SEND_SELECT from the SELECT cache. Completes the I/O and returns true
+ * on a hit; on a miss keeps the lookup key for the fill and returns false.
+ */
+static bool
+kv_cache_send_select(struct vbdev_kv_cache *cache, struct spdk_bdev_io *bdev_io)
+{
+	struct kv_cache_bdev_io *io_ctx = (struct kv_cache_bdev_io *)bdev_io->driver_ctx;
+	struct kv_cache_selects *selects = &cache->selects;
+	struct kv_cache_select_result *key, *result;
+	struct kv_cache_select_id *select_id;
+	uint32_t id;
+
+	io_ctx->select = NULL;
+	key = kv_cache_select_key(bdev_io);
+	select_id = calloc(1, sizeof(*select_id));
+	if (key == NULL || select_id == NULL) {
+		/* Still sent through the cache, so that the id is one of ours. */
+		free(key);
+		free(select_id);
+		return false;
+	}
+
+	pthread_spin_lock(&selects->lock);
+	result = kv_cache_select_find(selects, key);
+	if (result == NULL) {
+		selects->stats.select_misses++;
+		io_ctx->generation = kv_cache_select_bucket(selects, key->key_hash)->generation;
+		pthread_spin_unlock(&selects->lock);
+		io_ctx->select = key;
+		free(select_id);
+		return false;
+	}
+
+	TAILQ_REMOVE(&selects->lru, result, lru);
+	TAILQ_INSERT_HEAD(&selects->lru, result, lru);
+	selects->stats.select_hits++;
+	id = kv_cache_select_id_open(selects, select_id, result, 0);
+	pthread_spin_unlock(&selects->lock);
+
+	free(key);
+	spdk_bdev_io_complete_nvme_status(bdev_io, id, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_SUCCESS);
+	return true;
+}
+
+/*
+ * Complete a SEND_SELECT that went to the base bdev, with an id for the fetched
+ * result, or for the select on the base bdev if result is NULL.
+ */
+static void
+kv_cache_select_open_done(struct spdk_bdev_io *orig_io, struct kv_cache_select_result *result)
+{
+	struct vbdev_kv_cache *cache = SPDK_CONTAINEROF(orig_io->bdev, struct vbdev_kv_cache, bdev);
+	struct kv_cache_bdev_io *io_ctx = (struct kv_cache_bdev_io *)orig_io->driver_ctx;
+	struct kv_cache_selects *selects = &cache->selects;
+	struct kv_cache_select_id *select_id;
+	uint32_t id;
+
+	select_id = calloc(1, sizeof(*select_id));
+	if (select_id == NULL) {
+		if (result != NULL) {
+			kv_cache_select_result_free(result);
+		}
+		spdk_bdev_io_complete_nvme_status(orig_io, 0, SPDK_NVME_SCT_GENERIC,
+						  SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+		return;
+	}
+
+	pthread_spin_lock(&selects->lock);
+	if (result != NULL) {
+		kv_cache_select_insert(selects, result, io_ctx->generation);
+	}
+	id = kv_cache_select_id_open(selects, select_id, result, io_ctx->select_base_id);
+	pthread_spin_unlock(&selects->lock);
+
+	spdk_bdev_io_complete_nvme_status(orig_io, id, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_SUCCESS);
+}
+
+static void
+kv_cache_select_fetched(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct spdk_bdev_io *orig_io = cb_arg;
+	struct vbdev_kv_cache *cache = SPDK_CONTAINEROF(orig_io->bdev, struct vbdev_kv_cache, bdev);
+	struct kv_cache_bdev_io *io_ctx = (struct kv_cache_bdev_io *)orig_io->driver_ctx;
+	struct kv_cache_select_result *result = io_ctx->select;
+	uint32_t len;
+	int sct, sc;
+
+	spdk_bdev_io_get_nvme_status(bdev_io, &len, &sct, &sc);
+	spdk_bdev_free_io(bdev_io);
+
+	if (!success || len > cache->selects.max_result_size) {
+		/*
+		 * Not fetched, or only partly. The SELECT itself succeeded and is still
+		 * open on the base bdev, so the result is read from there.
+		 */
+		spdk_free(io_ctx->select_buf);
+		free(result);
+		kv_cache_select_open_done(orig_io, NULL);
+		return;
+	}
+
+	/* Keep only as much hugepage memory as the result needs. */
+	result->len = len;
+	result->data = spdk_malloc(len, 0, NULL, SPDK_ENV_LCORE_ID_ANY, SPDK_MALLOC_DMA);
+	if (result->data != NULL) {
+		memcpy(result->data, io_ctx->select_buf, len);
+		spdk_free(io_ctx->select_buf);
+	} else {
+		result->data = io_ctx->select_buf;
+	}
+	kv_cache_select_open_done(orig_io, result);
+}
+
+/* Fetch the result of a SEND_SELECT miss in one go, freeing it on the base bdev if it fit. */
+static void
+kv_cache_select_fetch(void *arg)
+{
+	struct spdk_bdev_io *orig_io = arg;
+	struct vbdev_kv_cache *cache = SPDK_CONTAINEROF(orig_io->bdev, struct vbdev_kv_cache, bdev);
+	struct kv_cache_bdev_io *io_ctx = (struct kv_cache_bdev_io *)orig_io->driver_ctx;
+	struct kv_cache_io_channel *cache_ch = spdk_io_channel_get_ctx(io_ctx->ch);
+	int rc;
+
+	rc = spdk_bdev_kv_retrieve_select(cache->base_desc, cache_ch->base_ch, io_ctx->select_buf, 0,
+					  cache->selects.max_result_size, io_ctx->select_base_id,
+					  NVME_KV_SELECT_CMD_OPTION_DO_NOT_FREE_IF_NOT_ALL_DATA_FETCHED,
+					  kv_cache_select_fetched, orig_io);
+	if (rc == -ENOMEM) {
+		io_ctx->bdev_io_wait.bdev = orig_io->bdev;
+		io_ctx->bdev_io_wait.cb_fn = kv_cache_select_fetch;
+		io_ctx->bdev_io_wait.cb_arg = orig_io;
+		rc = spdk_bdev_queue_io_wait(orig_io->bdev, cache_ch->base_ch, &io_ctx->bdev_io_wait);
+	}
+	if (rc != 0) {
+		/* The select is still open on the base bdev; read it from there. */
+		spdk_free(io_ctx->select_buf);
+		free(io_ctx->select);
+		kv_cache_select_open_done(orig_io, NULL);
+	}
+}
+
+static void
+kv_cache_select_sent(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct spdk_bdev_io *orig_io = cb_arg;
+	struct vbdev_kv_cache *cache = SPDK_CONTAINEROF(orig_io->bdev, struct vbdev_kv_cache, bdev);
+	struct kv_cache_bdev_io *io_ctx = (struct kv_cache_bdev_io *)orig_io->driver_ctx;
+	int sct, sc;
+
+	if (!success) {
+		free(io_ctx->select);
+		kv_cache_complete_io(bdev_io, success, orig_io);
+		return;
+	}
+
+	spdk_bdev_io_get_nvme_status(bdev_io, &io_ctx->select_base_id, &sct, &sc);
+	spdk_bdev_free_io(bdev_io);
+
+	if (io_ctx->select != NULL) {
+		io_ctx->select_buf = spdk_malloc(cache->selects.max_result_size, 0, NULL,
+						 SPDK_ENV_LCORE_ID_ANY, SPDK_MALLOC_DMA);
+		if (io_ctx->select_buf != NULL) {
+			kv_cache_select_fetch(orig_io);
+			return;
+		}
+		free(io_ctx->select);
+	}
+
+	kv_cache_select_open_done(orig_io, NULL);
+}
+
+static void
+kv_cache_select_retrieved(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct spdk_bdev_io *orig_io = cb_arg;
+	struct vbdev_kv_cache *cache = SPDK_CONTAINEROF(orig_io->bdev, struct vbdev_kv_cache, bdev);
+	struct kv_cache_bdev_io *io_ctx = (struct kv_cache_bdev_io *)orig_io->driver_ctx;
+	struct kv_cache_selects *selects = &cache->selects;
+	struct kv_cache_select_id *select_id;
+	uint32_t len;
+	int sct, sc;
+
+	spdk_bdev_io_get_nvme_status(bdev_io, &len, &sct, &sc);
+	if (success && kv_cache_select_retrieve_frees(orig_io->u.bdev.nvme_kv.options,
+			orig_io->u.bdev.nvme_kv.offset,
+			orig_io->u.bdev.nvme_kv.buffer_size, len)) {
+		pthread_spin_lock(&selects->lock);
+		select_id = kv_cache_select_id_find(selects, orig_io->u.bdev.nvme_kv.select_id);
+		if (select_id != NULL && select_id->result == NULL &&
+		    select_id->base_id == io_ctx->select_base_id) {
+			kv_cache_select_id_free(selects, select_id);
+		}
+		pthread_spin_unlock(&selects->lock);
+	}
+
+	kv_cache_complete_io(bdev_io, success, orig_io);
+}
+
+static void
+kv_cache_retrieve_select(struct vbdev_kv_cache *cache, struct spdk_io_channel *ch,
+			 struct spdk_bdev_io *bdev_io)
+{
+	struct kv_cache_io_channel *cache_ch = spdk_io_channel_get_ctx(ch);
+	struct kv_cache_bdev_io *io_ctx = (struct kv_cache_bdev_io *)bdev_io->driver_ctx;
+	struct kv_cache_selects *selects = &cache->selects;
+	struct kv_cache_select_id *select_id;
+	struct kv_cache_select_result *result;
+	uint64_t offset = bdev_io->u.bdev.nvme_kv.offset;
+	uint64_t nbytes = bdev_io->u.bdev.nvme_kv.buffer_size;
+	uint8_t options = bdev_io->u.bdev.nvme_kv.options;
+	uint32_t len;
+	int rc;
+
+	pthread_spin_lock(&selects->lock);
+	select_id = kv_cache_select_id_find(selects, bdev_io->u.bdev.nvme_kv.select_id);
+	if (select_id == NULL || (select_id->result != NULL && offset > select_id->result->len)) {
+		pthread_spin_unlock(&selects->lock);
+		spdk_bdev_io_complete_nvme_status(bdev_io, 0, SPDK_NVME_SCT_GENERIC,
+						  SPDK_NVME_SC_INVALID_FIELD);
+		return;
+	}
+
+	result = select_id->result;
+	if (result == NULL) {
+		io_ctx->select_base_id = select_id->base_id;
+		pthread_spin_unlock(&selects->lock);
+
+		rc = spdk_bdev_kv_retrieve_selectv(cache->base_desc, cache_ch->base_ch,
+						   bdev_io->u.bdev.iovs, bdev_io->u.bdev.iovcnt,
+						   offset, nbytes, io_ctx->select_base_id, options,
+						   kv_cache_select_retrieved, bdev_io);
+		if (rc == -ENOMEM) {
+			io_ctx->ch = ch;
+			vbdev_kv_cache_queue_io(bdev_io);
+		} else if (rc != 0) {
+			SPDK_ERRLOG("ERROR on bdev_io submission!\n");
+			spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		}
+		return;
+	}
+
+	/* Copy outside of the lock; the reference keeps the result alive meanwhile. */
+	result->refs++;
+	len = result->len;
+	if (kv_cache_select_retrieve_frees(options, offset, nbytes, len)) {
+		kv_cache_select_id_free(selects, select_id);
+	}
+	pthread_spin_unlock(&selects->lock);
+
+	spdk_copy_buf_to_iovs(bdev_io->u.bdev.iovs, bdev_io->u.bdev.iovcnt,
+			      (uint8_t *)result->data + offset, spdk_min(nbytes, len - offset));
+
+	pthread_spin_lock(&selects->lock);
+	kv_cache_select_result_put(result);
+	pthread_spin_unlock(&selects->lock);
+
+	spdk_bdev_io_complete_nvme_status(bdev_io, len, SPDK_NVME_SCT_GENERIC,
+					  SPDK_NVME_SC_SUCCESS);
+}
+
+static void
+vbdev_kv_cache_submit_request(struct spdk_io_channel *ch, struct spdk_bdev_io *bdev_io)
+{
+	struct vbdev_kv_cache *cache = SPDK_CONTAINEROF(bdev_io->bdev, struct vbdev_kv_cache, bdev);
+	struct kv_cache_io_channel *cache_ch = spdk_io_channel_get_ctx(ch);
+	struct kv_cache_bdev_io *io_ctx = (struct kv_cache_bdev_io *)bdev_io->driver_ctx;
+	spdk_bdev_io_completion_cb cb = kv_cache_complete_io;
+	unsigned char *key = bdev_io->u.bdev.nvme_kv.key;
+	size_t key_len = bdev_io->u.bdev.nvme_kv.key_length;
+	uint32_t value_len = 0;
+	int rc;
+
+	switch (bdev_io->type) {
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+		io_ctx->lookup = kv_cache_retrieve(cache, bdev_io, &value_len, &io_ctx->generation);
+		if (io_ctx->lookup == KV_CACHE_HIT) {
+			spdk_bdev_io_complete_nvme_status(bdev_io, value_len, SPDK_NVME_SCT_GENERIC,
+							  SPDK_NVME_SC_SUCCESS);
+			return;
+		} else if (io_ctx->lookup == KV_CACHE_ABSENT) {
+			spdk_bdev_io_complete_nvme_status(bdev_io, 0, SPDK_NVME_SCT_GENERIC,
+							  SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+			return;
+		}
+		cb = kv_cache_retrieve_done;
+		break;
+	case SPDK_BDEV_IO_KV_EXIST:
+		io_ctx->lookup = kv_cache_exist(cache, key, key_len);
+		if (io_ctx->lookup == KV_CACHE_HIT) {
+			spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_SUCCESS);
+			return;
+		} else if (io_ctx->lookup == KV_CACHE_ABSENT) {
+			spdk_bdev_io_complete_nvme_status(bdev_io, 0, SPDK_NVME_SCT_GENERIC,
+							  SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+			return;
+		}
+		cb = kv_cache_exist_done;
+		break;
+	case SPDK_BDEV_IO_KV_STORE:
+		io_ctx->generation = kv_cache_invalidate(cache, key, key_len);
+		kv_cache_filter_add(cache, key, key_len);
+		cb = kv_cache_store_done;
+		break;
+	case SPDK_BDEV_IO_KV_DELETE:
+		io_ctx->generation = kv_cache_invalidate(cache, key, key_len);
+		cb = kv_cache_delete_done;
+		break;
+	case SPDK_BDEV_IO_KV_BATCH:
+		if (bdev_io->u.bdev.nvme_kv.batch_type == SPDK_BDEV_IO_KV_STORE) {
+			kv_cache_batch_invalidate(cache, bdev_io, true);
+			cb = kv_cache_batch_store_done;
+		}
+		break;
+	case SPDK_BDEV_IO_KV_SEND_SELECT:
+		if (cache->selects.buckets != NULL) {
+			if (kv_cache_send_select(cache, bdev_io)) {
+				return;
+			}
+			io_ctx->ch = ch;
+			cb = kv_cache_select_sent;
+		}
+		break;
+	case SPDK_BDEV_IO_KV_RETRIEVE_SELECT:
+		if (cache->selects.buckets != NULL) {
+			kv_cache_retrieve_select(cache, ch, bdev_io);
+			return;
+		}
+		break;
+	case SPDK_BDEV_IO_KV_LIST:
+		break;
+	default:
+		SPDK_ERRLOG("kv_cache: unsupported I/O type %d\n", bdev_io->type);
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		return;
+	}
+
+	rc = spdk_bdev_kv_io_forward(cache->base_desc, cache_ch->base_ch, bdev_io, cb, bdev_io);
+	if (rc != 0) {
+		if (cb == kv_cache_select_sent) {
+			/* Looked up again if resubmitted. */
+			free(io_ctx->select);
+		}
+		if (rc == -ENOMEM) {
+			io_ctx->ch = ch;
+			vbdev_kv_cache_queue_io(bdev_io);
+		} else {
+			SPDK_ERRLOG("ERROR on bdev_io submission!\n");
+			spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		}
+	}
+}
+
+static bool
+vbdev_kv_cache_io_type_supported(void *ctx, enum spdk_bdev_io_type io_type)
+{
+	struct vbdev_kv_cache *cache = ctx;
+
+	switch (io_type) {
+	case SPDK_BDEV_IO_KV_LIST:
+	case SPDK_BDEV_IO_KV_DELETE:
+	case SPDK_BDEV_IO_KV_EXIST:
+	case SPDK_BDEV_IO_KV_STORE:
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+	case SPDK_BDEV_IO_KV_SEND_SELECT:
+	case SPDK_BDEV_IO_KV_RETRIEVE_SELECT:
+	case SPDK_BDEV_IO_KV_BATCH:
+		return spdk_bdev_io_type_supported(cache->base_bdev, io_type);
+	default:
+		/* Block I/O would bypass the cache and leave it stale. */
+		return false;
+	}
+}
+
+static struct spdk_io_channel *
+vbdev_kv_cache_get_io_channel(void *ctx)
+{
+	return spdk_get_io_channel(ctx);
+}
+
+static void
+vbdev_kv_cache_write_params_json(struct vbdev_kv_cache *cache, struct spdk_json_write_ctx *w)
+{
+	uint64_t capacity = cache->shards[0].capacity * KV_CACHE_NUM_SHARDS;
+
+	spdk_json_write_named_string(w, "name", spdk_bdev_get_name(&cache->bdev));
+	spdk_json_write_named_string(w, "base_bdev_name", spdk_bdev_get_name(cache->base_bdev));
+	spdk_json_write_named_uint64(w, "capacity_mb", capacity / (1024 * 1024));
+	spdk_json_write_named_uint32(w, "max_value_size", cache->max_value_size);
+	spdk_json_write_named_string(w, "write_policy",
+				     cache->write_policy == VBDEV_KV_CACHE_WRITE_THROUGH ?
+				     "write_through" : "write_around");
+	spdk_json_write_named_uint64(w, "filter_keys", cache->filter_keys);
+	spdk_json_write_named_uint64(w, "select_capacity_mb", cache->selects.capacity / (1024 * 1024));
+	if (cache->selects.capacity != 0) {
+		spdk_json_write_named_uint32(w, "max_select_result_size", cache->selects.max_result_size);
+	}
+}
+
+static int
+vbdev_kv_cache_dump_info_json(void *ctx, struct spdk_json_write_ctx *w)
+{
+	struct vbdev_kv_cache *cache = ctx;
+
+	spdk_json_write_name(w, "kv_cache");
+	spdk_json_write_object_begin(w);
+	vbdev_kv_cache_write_params_json(cache, w);
+	spdk_json_write_object_end(w);
+
+	return 0;
+}
+
+static int
+vbdev_kv_cache_config_json(struct spdk_json_write_ctx *w)
+{
+	struct vbdev_kv_cache *cache;
+
+	TAILQ_FOREACH(cache, &g_kv_cache_nodes, link) {
+		spdk_json_write_object_begin(w);
+		spdk_json_write_named_string(w, "method", "bdev_kv_cache_create");
+		spdk_json_write_named_object_begin(w, "params");
+		vbdev_kv_cache_write_params_json(cache, w);
+		spdk_json_write_object_end(w);
+		spdk_json_write_object_end(w);
+	}
+	return 0;
+}
+
+static void
+vbdev_kv_cache_write_config_json(struct spdk_bdev *bdev, struct spdk_json_write_ctx *w)
+{
+	/* No config per bdev needed */
+}
+
+static void
+_device_unregister_cb(void *io_device)
+{
+	struct vbdev_kv_cache *cache = io_device;
+
+	kv_cache_shards_free(cache);
+	kv_cache_selects_free(cache);
+	free(cache->bdev.name);
+	free(cache);
+}
+
+/* Second half of the destruct of a cache with a filter, on the cache thread. */
+static void
+vbdev_kv_cache_destruct_done(struct vbdev_kv_cache *cache)
+{
+	spdk_bdev_close(cache->base_desc);
+	spdk_bdev_destruct_done(&cache->bdev, 0);
+	spdk_io_device_unregister(cache, _device_unregister_cb);
+}
+
+/* Filter loading */
+
+struct kv_cache_sweep {
+	struct vbdev_kv_cache		*cache;
+	struct spdk_io_channel		*ch;
+	struct spdk_bdev_kv_list_iter	*iter;
+	bool				cancelled;
+};
+
+static int
+kv_cache_sweep_key(void *cb_arg, const unsigned char *key, size_t key_length)
+{
+	struct kv_cache_sweep *sweep = cb_arg;
+
+	kv_cache_filter_add(sweep->cache, key, key_length);
+	return 0;
+}
+
+static void
+kv_cache_sweep_done(void *cb_arg, int rc, uint64_t num_keys)
+{
+	struct kv_cache_sweep *sweep = cb_arg;
+	struct vbdev_kv_cache *cache = sweep->cache;
+	struct kv_cache_shard *shard;
+	bool cancelled = sweep->cancelled;
+	int i;
+
+	if (cancelled) {
+		SPDK_NOTICELOG("%s: key listing cancelled\n", cache->bdev.name);
+	} else if (rc != 0) {
+		SPDK_ERRLOG("%s: key listing failed (%d), not using the filter\n", cache->bdev.name, rc);
+	} else {
+		for (i = 0; i < KV_CACHE_NUM_SHARDS; i++) {
+			shard = &cache->shards[i];
+			pthread_spin_lock(&shard->lock);
+			shard->filter_ready = true;
+			shard->filter_ready_gen = shard->generation;
+			pthread_spin_unlock(&shard->lock);
+		}
+		SPDK_NOTICELOG("%s: filter loaded with %" PRIu64 " keys\n", cache->bdev.name, num_keys);
+	}
+
+	spdk_put_io_channel(sweep->ch);
+	free(sweep);
+	cache->sweep = NULL;
+
+	if (cancelled) {
+		vbdev_kv_cache_destruct_done(cache);
+	}
+}
+
+/* List all keys on the base bdev to fill the filter. Runs on the cache thread. */
+static void
+kv_cache_sweep_start(struct vbdev_kv_cache *cache)
+{
+	struct kv_cache_sweep *sweep;
+	int rc;
+
+	sweep = calloc(1, sizeof(*sweep));
+	if (sweep == NULL) {
+		goto err;
+	}
+
+	sweep->cache = cache;
+	sweep->ch = spdk_bdev_get_io_channel(cache->base_desc);
+	if (sweep->ch == NULL) {
+		free(sweep);
+		goto err;
+	}
+
+	/* Shard the key space so that several listings are in flight at a time. */
+	rc = spdk_bdev_kv_list_iter_open(cache->base_desc, sweep->ch, NULL, 0,
+					 KV_CACHE_SWEEP_SHARDS, 0, 0, 0,
+					 kv_cache_sweep_key, kv_cache_sweep_done, sweep, &sweep->iter);
+	if (rc != 0) {
+		spdk_put_io_channel(sweep->ch);
+		free(sweep);
+		goto err;
+	}
+
+	cache->sweep = sweep;
+	return;
+err:
+	SPDK_ERRLOG("%s: could not start key listing, not using the filter\n", cache->bdev.name);
+}
+
+static void
+_vbdev_kv_cache_destruct(void *ctx)
+{
+	struct spdk_bdev_desc *desc = ctx;
+
+	spdk_bdev_close(desc);
+}
+
+static void
+_vbdev_kv_cache_stop_sweep(void *ctx)
+{
+	struct vbdev_kv_cache *cache = ctx;
+
+	if (cache->sweep != NULL) {
+		/* The listing finishes the destruct once its I/O came back. */
+		cache->sweep->cancelled = true;
+		spdk_bdev_kv_list_iter_close(cache->sweep->iter);
+		return;
+	}
+
+	vbdev_kv_cache_destruct_done(cache);
+}
+
+static int
+vbdev_kv_cache_destruct(void *ctx)
+{
+	struct vbdev_kv_cache *cache = ctx;
+
+	TAILQ_REMOVE(&g_kv_cache_nodes, cache, link);
+
+	spdk_bdev_module_release_bdev(cache->base_bdev);
+
+	if (cache->filter_keys != 0) {
+		/* The key listing may still be using the base bdev on the cache thread. */
+		if (cache->thread != spdk_get_thread()) {
+			spdk_thread_send_msg(cache->thread, _vbdev_kv_cache_stop_sweep, cache);
+		} else {
+			_vbdev_kv_cache_stop_sweep(cache);
+		}
+		return 1;
+	}
+
+	/* Close the underlying bdev on its same opened thread. */
+	if (cache->thread && cache->thread != spdk_get_thread()) {
+		spdk_thread_send_msg(cache->thread, _vbdev_kv_cache_destruct, cache->base_desc);
+	} else {
+		spdk_bdev_close(cache->base_desc);
+	}
+
+	spdk_io_device_unregister(cache, _device_unregister_cb);
+
+	return 0;
+}
+
+static const struct spdk_bdev_fn_table vbdev_kv_cache_fn_table = {
+	.destruct		= vbdev_kv_cache_destruct,
+	.submit_request		= vbdev_kv_cache_submit_request,
+	.io_type_supported	= vbdev_kv_cache_io_type_supported,
+	.get_io_channel		= vbdev_kv_cache_get_io_channel,
+	.dump_info_json		= vbdev_kv_cache_dump_info_json,
+	.write_config_json	= vbdev_kv_cache_write_config_json,
+};
+
+static int
+kv_cache_ch_create_cb(void *io_device, void *ctx_buf)
+{
+	struct kv_cache_io_channel *cache_ch = ctx_buf;
+	struct vbdev_kv_cache *cache = io_device;
+
+	cache_ch->base_ch = spdk_bdev_get_io_channel(cache->base_desc);
+	if (cache_ch->base_ch == NULL) {
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static void
+kv_cache_ch_destroy_cb(void *io_device, void *ctx_buf)
+{
+	struct kv_cache_io_channel *cache_ch = ctx_buf;
+
+	spdk_put_io_channel(cache_ch->base_ch);
+}
+
+static void
+vbdev_kv_cache_base_bdev_hotremove_cb(struct spdk_bdev *bdev_find)
+{
+	struct vbdev_kv_cache *cache, *tmp;
+
+	TAILQ_FOREACH_SAFE(cache, &g_kv_cache_nodes, link, tmp) {
+		if (bdev_find == cache->base_bdev) {
+			spdk_bdev_unregister(&cache->bdev, NULL, NULL);
+		}
+	}
+}
+
+static void
+vbdev_kv_cache_base_bdev_event_cb(enum spdk_bdev_event_type type, struct spdk_bdev *bdev,
+				  void *event_ctx)
+{
+	switch (type) {
+	case SPDK_BDEV_EVENT_REMOVE:
+		vbdev_kv_cache_base_bdev_hotremove_cb(bdev);
+		break;
+	default:
+		SPDK_NOTICELOG("Unsupported bdev event: type %d\n", type);
+		break;
+	}
+}
+
+static int
+vbdev_kv_cache_register(struct kv_cache_config *config)
+{
+	struct vbdev_kv_cache *cache;
+	struct spdk_bdev *bdev;
+	int rc;
+
+	cache = calloc(1, sizeof(*cache));
+	if (cache == NULL) {
+		return -ENOMEM;
+	}
+
+	rc = kv_cache_shards_init(cache, config->capacity, config->filter_keys);
+	if (rc) {
+		goto free_cache;
+	}
+
+	rc = kv_cache_selects_init(cache, config->select_capacity, config->max_select_result_size);
+	if (rc) {
+		goto free_cache;
+	}
+
+	cache->bdev.name = strdup(config->name);
+	if (cache->bdev.name == NULL) {
+		rc = -ENOMEM;
+		goto free_cache;
+	}
+	cache->bdev.product_name = "kv_cache";
+	cache->max_value_size = config->max_value_size;
+	cache->write_policy = config->write_policy;
+	cache->filter_keys = config->filter_keys;
+
+	rc = spdk_bdev_open_ext(config->base_bdev_name, true, vbdev_kv_cache_base_bdev_event_cb,
+				NULL, &cache->base_desc);
+	if (rc) {
+		if (rc != -ENODEV) {
+			SPDK_ERRLOG("could not open bdev %s\n", config->base_bdev_name);
+		}
+		goto free_cache;
+	}
+
+	bdev = spdk_bdev_desc_get_bdev(cache->base_desc);
+	if (!spdk_bdev_io_type_supported(bdev, SPDK_BDEV_IO_KV_RETRIEVE)) {
+		SPDK_ERRLOG("bdev %s does not support KV commands\n", config->base_bdev_name);
+		rc = -ENOTSUP;
+		goto close_base;
+	}
+	cache->base_bdev = bdev;
+
+	cache->bdev.write_cache = bdev->write_cache;
+	cache->bdev.required_alignment = bdev->required_alignment;
+	cache->bdev.blocklen = bdev->blocklen;
+	cache->bdev.blockcnt = bdev->blockcnt;
+
+	cache->bdev.ctxt = cache;
+	cache->bdev.fn_table = &vbdev_kv_cache_fn_table;
+	cache->bdev.module = &kv_cache_if;
+	cache->thread = spdk_get_thread();
+
+	spdk_io_device_register(cache, kv_cache_ch_create_cb, kv_cache_ch_destroy_cb,
+				sizeof(struct kv_cache_io_channel), config->name);
+
+	rc = spdk_bdev_module_claim_bdev(bdev, cache->base_desc, cache->bdev.module);
+	if (rc) {
+		SPDK_ERRLOG("could not claim bdev %s\n", config->base_bdev_name);
+		goto unregister_device;
+	}
+
+	rc = spdk_bdev_register(&cache->bdev);
+	if (rc) {
+		SPDK_ERRLOG("could not register kv_cache bdev %s\n", config->name);
+		spdk_bdev_module_release_bdev(bdev);
+		goto unregister_device;
+	}
+
+	TAILQ_INSERT_TAIL(&g_kv_cache_nodes, cache, link);
+	SPDK_NOTICELOG("created kv_cache bdev %s on %s\n", config->name, config->base_bdev_name);
+
+	if (cache->filter_keys != 0) {
+		kv_cache_sweep_start(cache);
+	}
+	return 0;
+
+unregister_device:
+	spdk_io_device_unregister(cache, NULL);
+close_base:
+	spdk_bdev_close(cache->base_desc);
+free_cache:
+	kv_cache_shards_free(cache);
+	kv_cache_selects_free(cache);
+	free(cache->bdev.name);
+	free(cache);
+	return rc;
+}
+
+static void
+kv_cache_config_free(struct kv_cache_config *config)
+{
+	free(config->name);
+	free(config->base_bdev_name);
+	free(config);
+}
+
+int
+bdev_kv_cache_create(const struct vbdev_kv_cache_opts *opts)
+{
+	struct kv_cache_config *config;
+	int rc;
+
+	if (opts->name == NULL || opts->base_bdev_name == NULL) {
+		return -EINVAL;
+	}
+
+	if (opts->capacity / KV_CACHE_NUM_SHARDS < sizeof(struct kv_cache_entry)) {
+		SPDK_ERRLOG("kv_cache capacity %" PRIu64 " is too small\n", opts->capacity);
+		return -EINVAL;
+	}
+
+	TAILQ_FOREACH(config, &g_kv_cache_configs, link) {
+		if (strcmp(config->name, opts->name) == 0) {
+			SPDK_ERRLOG("kv_cache bdev %s already exists\n", opts->name);
+			return -EEXIST;
+		}
+	}
+
+	config = calloc(1, sizeof(*config));
+	if (config == NULL) {
+		return -ENOMEM;
+	}
+
+	config->name = strdup(opts->name);
+	config->base_bdev_name = strdup(opts->base_bdev_name);
+	if (config->name == NULL || config->base_bdev_name == NULL) {
+		kv_cache_config_free(config);
+		return -ENOMEM;
+	}
+	config->capacity = opts->capacity;
+	config->max_value_size = opts->max_value_size ? opts->max_value_size :
+				 KV_CACHE_DEFAULT_MAX_VALUE_SIZE;
+	config->write_policy = opts->write_policy;
+	config->filter_keys = opts->filter_keys;
+	config->select_capacity = opts->select_capacity;
+	config->max_select_result_size = opts->max_select_result_size ? opts->max_select_result_size :
+					 KV_CACHE_DEFAULT_MAX_SELECT_RESULT;
+
+	rc = vbdev_kv_cache_register(config);
+	if (rc == -ENODEV) {
+		SPDK_NOTICELOG("kv_cache creation deferred pending base bdev arrival\n");
+		rc = 0;
+	} else if (rc != 0) {
+		kv_cache_config_free(config);
+		return rc;
+	}
+
+	TAILQ_INSERT_TAIL(&g_kv_cache_configs, config, link);
+	return 0;
+}
+
+void
+bdev_kv_cache_delete(const char *name, spdk_bdev_unregister_cb cb_fn, void *cb_arg)
+{
+	struct kv_cache_config *config;
+	int rc;
+
+	rc = spdk_bdev_unregister_by_name(name, &kv_cache_if, cb_fn, cb_arg);
+	if (rc != 0) {
+		cb_fn(cb_arg, rc);
+		return;
+	}
+
+	/* Forget the cache so it is not re-created when its base bdev comes back. */
+	TAILQ_FOREACH(config, &g_kv_cache_configs, link) {
+		if (strcmp(config->name, name) == 0) {
+			TAILQ_REMOVE(&g_kv_cache_configs, config, link);
+			kv_cache_config_free(config);
+			break;
+		}
+	}
+}
+
+int
+bdev_kv_cache_get_stats(const char *name, struct vbdev_kv_cache_stats *stats)
+{
+	struct vbdev_kv_cache *cache;
+	struct kv_cache_shard *shard;
+	int i;
+
+	TAILQ_FOREACH(cache, &g_kv_cache_nodes, link) {
+		if (strcmp(spdk_bdev_get_name(&cache->bdev), name) == 0) {
+			break;
+		}
+	}
+	if (cache == NULL) {
+		return -ENODEV;
+	}
+
+	memset(stats, 0, sizeof(*stats));
+	for (i = 0; i < KV_CACHE_NUM_SHARDS; i++) {
+		shard = &cache->shards[i];
+		pthread_spin_lock(&shard->lock);
+		stats->retrieve_hits += shard->stats.retrieve_hits;
+		stats->retrieve_misses += shard->stats.retrieve_misses;
+		stats->exist_hits += shard->stats.exist_hits;
+		stats->exist_misses += shard->stats.exist_misses;
+		stats->insertions += shard->stats.insertions;
+		stats->evictions += shard->stats.evictions;
+		stats->invalidations += shard->stats.invalidations;
+		stats->filter_negatives += shard->stats.filter_negatives;
+		stats->filter_false_positives += shard->stats.filter_false_positives;
+		stats->num_entries += shard->num_entries;
+		stats->bytes_used += shard->bytes_used;
+		stats->filter_ready = shard->filter_ready;
+		pthread_spin_unlock(&shard->lock);
+	}
+
+	if (cache->selects.buckets != NULL) {
+		pthread_spin_lock(&cache->selects.lock);
+		stats->select_hits = cache->selects.stats.select_hits;
+		stats->select_misses = cache->selects.stats.select_misses;
+		stats->select_insertions = cache->selects.stats.select_insertions;
+		stats->select_evictions = cache->selects.stats.select_evictions;
+		stats->select_invalidations = cache->selects.stats.select_invalidations;
+		stats->select_entries = cache->selects.num_entries;
+		stats->select_bytes_used = cache->selects.bytes_used;
+		pthread_spin_unlock(&cache->selects.lock);
+	}
+
+	return 0;
+}
+
+static int
+vbdev_kv_cache_init(void)
+{
+	return 0;
+}
+
+static void
+vbdev_kv_cache_finish(void)
+{
+	struct kv_cache_config *config;
+
+	while ((config = TAILQ_FIRST(&g_kv_cache_configs))) {
+		TAILQ_REMOVE(&g_kv_cache_configs, config, link);
+		kv_cache_config_free(config);
+	}
+}
+
+static int
+vbdev_kv_cache_get_ctx_size(void)
+{
+	return sizeof(struct kv_cache_bdev_io);
+}
+
+static void
+vbdev_kv_cache_examine(struct spdk_bdev *bdev)
+{
+	struct kv_cache_config *config;
+
+	TAILQ_FOREACH(config, &g_kv_cache_configs, link) {
+		if (strcmp(config->base_bdev_name, bdev->name) == 0) {
+			vbdev_kv_cache_register(config);
+		}
+	}
+
+	spdk_bdev_module_examine_done(&kv_cache_if);
+}
+
+SPDK_LOG_REGISTER_COMPONENT(vbdev_kv_cache)
@@ -0,0 +1,96 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+#ifndef SPDK_VBDEV_KV_CACHE_H
+#define SPDK_VBDEV_KV_CACHE_H
+
+#include "spdk/stdinc.h"
+
+#include "spdk/bdev.h"
+#include "spdk/bdev_module.h"
+
+enum vbdev_kv_cache_write_policy {
+	/* A successful STORE replaces the cached value with the stored one. */
+	VBDEV_KV_CACHE_WRITE_THROUGH,
+	/* A STORE only drops the cached value; it is cached again on the next miss. */
+	VBDEV_KV_CACHE_WRITE_AROUND,
+};
+
+struct vbdev_kv_cache_opts {
+	const char *name;
+	const char *base_bdev_name;
+	/* Memory for cached keys and values, in bytes. */
+	uint64_t capacity;
+	/* Values larger than this are never cached. 0 selects the default. */
+	uint32_t max_value_size;
+	enum vbdev_kv_cache_write_policy write_policy;
+	/*
+	 * Expected number of keys on the base bdev. If not 0, a Bloom filter
+	 * sized for that many keys answers lookups of keys that do not exist.
+	 * It assumes that the base bdev is written only through this cache.
+	 */
+	uint64_t filter_keys;
+	/*
+	 * Memory for cached SELECT results, in bytes. 0 disables the SELECT
+	 * cache and passes SELECTs to the base bdev.
+	 */
+	uint64_t select_capacity;
+	/* Results larger than this are never cached. 0 selects the default. */
+	uint32_t max_select_result_size;
+};
+
+struct vbdev_kv_cache_stats {
+	uint64_t retrieve_hits;
+	uint64_t retrieve_misses;
+	uint64_t exist_hits;
+	uint64_t exist_misses;
+	uint64_t insertions;
+	uint64_t evictions;
+	uint64_t invalidations;
+	uint64_t num_entries;
+	uint64_t bytes_used;
+	/* Lookups answered by the filter, and those it let through in vain. */
+	uint64_t filter_negatives;
+	uint64_t filter_false_positives;
+	bool filter_ready;
+	/* SELECT result cache; invalidations count results dropped by writes to their key. */
+	uint64_t select_hits;
+	uint64_t select_misses;
+	uint64_t select_insertions;
+	uint64_t select_evictions;
+	uint64_t select_invalidations;
+	uint64_t select_entries;
+	uint64_t select_bytes_used;
+};
+
+/**
+ * Create a KV cache on top of a KV capable bdev. If the base bdev does not
+ * exist yet, the cache is created once it shows up.
+ *
+ * \param opts Creation options.
+ *
+ * \return 0 on success, negated errno otherwise.
+ */
+int bdev_kv_cache_create(const struct vbdev_kv_cache_opts *opts);
+
+/**
+ * Delete a KV cache bdev.
+ *
+ * \param name Name of the cache bdev.
+ * \param cb_fn Function to call after deletion.
+ * \param cb_arg Argument to pass to cb_fn.
+ */
+void bdev_kv_cache_delete(const char *name, spdk_bdev_unregister_cb cb_fn, void *cb_arg);
+
+/**
+ * Get the counters of a KV cache bdev.
+ *
+ * \param name Name of the cache bdev.
+ * \param stats Filled in with the counters summed over all shards.
+ *
+ * \return 0 on success, -ENODEV if there is no such cache bdev.
+ */
+int bdev_kv_cache_get_stats(const char *name, struct vbdev_kv_cache_stats *stats);
+
+#endif /* SPDK_VBDEV_KV_CACHE_H */
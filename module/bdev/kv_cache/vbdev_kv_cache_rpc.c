@@ -0,0 +1,202 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+#include "spdk/rpc.h"
+#include "spdk/util.h"
+#include "spdk/string.h"
+#include "spdk/bdev_module.h"
+#include "spdk/log.h"
+
+#include "vbdev_kv_cache.h"
+
+struct rpc_bdev_kv_cache_create {
+	char *name;
+	char *base_bdev_name;
+	uint64_t capacity_mb;
+	uint32_t max_value_size;
+	char *write_policy;
+	uint64_t filter_keys;
+	uint64_t select_capacity_mb;
+	uint32_t max_select_result_size;
+};
+
+static void
+free_rpc_bdev_kv_cache_create(struct rpc_bdev_kv_cache_create *req)
+{
+	free(req->name);
+	free(req->base_bdev_name);
+	free(req->write_policy);
+}
+
+static const struct spdk_json_object_decoder rpc_bdev_kv_cache_create_decoders[] = {
+	{"name", offsetof(struct rpc_bdev_kv_cache_create, name), spdk_json_decode_string},
+	{"base_bdev_name", offsetof(struct rpc_bdev_kv_cache_create, base_bdev_name), spdk_json_decode_string},
+	{"capacity_mb", offsetof(struct rpc_bdev_kv_cache_create, capacity_mb), spdk_json_decode_uint64},
+	{"max_value_size", offsetof(struct rpc_bdev_kv_cache_create, max_value_size), spdk_json_decode_uint32, true},
+	{"write_policy", offsetof(struct rpc_bdev_kv_cache_create, write_policy), spdk_json_decode_string, true},
+	{"filter_keys", offsetof(struct rpc_bdev_kv_cache_create, filter_keys), spdk_json_decode_uint64, true},
+	{"select_capacity_mb", offsetof(struct rpc_bdev_kv_cache_create, select_capacity_mb), spdk_json_decode_uint64, true},
+	{"max_select_result_size", offsetof(struct rpc_bdev_kv_cache_create, max_select_result_size), spdk_json_decode_uint32, true},
+};
+
+static void
+rpc_bdev_kv_cache_create(struct spdk_jsonrpc_request *request,
+			 const struct spdk_json_val *params)
+{
+	struct rpc_bdev_kv_cache_create req = {};
+	struct vbdev_kv_cache_opts opts = {};
+	struct spdk_json_write_ctx *w;
+	int rc;
+
+	if (spdk_json_decode_object(params, rpc_bdev_kv_cache_create_decoders,
+				    SPDK_COUNTOF(rpc_bdev_kv_cache_create_decoders),
+				    &req)) {
+		SPDK_DEBUGLOG(vbdev_kv_cache, "spdk_json_decode_object failed\n");
+		spdk_jsonrpc_send_error_response(request, SPDK_JSONRPC_ERROR_INTERNAL_ERROR,
+						 "spdk_json_decode_object failed");
+		goto cleanup;
+	}
+
+	if (req.capacity_mb == 0) {
+		spdk_jsonrpc_send_error_response(request, -EINVAL,
+						 "Capacity must be greater than 0");
+		goto cleanup;
+	}
+
+	if (req.write_policy == NULL || strcmp(req.write_policy, "write_through") == 0) {
+		opts.write_policy = VBDEV_KV_CACHE_WRITE_THROUGH;
+	} else if (strcmp(req.write_policy, "write_around") == 0) {
+		opts.write_policy = VBDEV_KV_CACHE_WRITE_AROUND;
+	} else {
+		spdk_jsonrpc_send_error_response_fmt(request, -EINVAL,
+						     "Invalid write policy: %s", req.write_policy);
+		goto cleanup;
+	}
+
+	opts.name = req.name;
+	opts.base_bdev_name = req.base_bdev_name;
+	opts.capacity = req.capacity_mb * 1024 * 1024;
+	opts.max_value_size = req.max_value_size;
+	opts.filter_keys = req.filter_keys;
+	opts.select_capacity = req.select_capacity_mb * 1024 * 1024;
+	opts.max_select_result_size = req.max_select_result_size;
+	rc = bdev_kv_cache_create(&opts);
+	if (rc != 0) {
+		spdk_jsonrpc_send_error_response(request, rc, spdk_strerror(-rc));
+		goto cleanup;
+	}
+
+	w = spdk_jsonrpc_begin_result(request);
+	spdk_json_write_string(w, req.name);
+	spdk_jsonrpc_end_result(request, w);
+
+cleanup:
+	free_rpc_bdev_kv_cache_create(&req);
+}
+SPDK_RPC_REGISTER("bdev_kv_cache_create", rpc_bdev_kv_cache_create, SPDK_RPC_RUNTIME)
+
+struct rpc_bdev_kv_cache_name {
+	char *name;
+};
+
+static void
+free_rpc_bdev_kv_cache_name(struct rpc_bdev_kv_cache_name *req)
+{
+	free(req->name);
+}
+
+static const struct spdk_json_object_decoder rpc_bdev_kv_cache_name_decoders[] = {
+	{"name", offsetof(struct rpc_bdev_kv_cache_name, name), spdk_json_decode_string},
+};
+
+static void
+rpc_bdev_kv_cache_delete_cb(void *cb_arg, int bdeverrno)
+{
+	struct spdk_jsonrpc_request *request = cb_arg;
+
+	if (bdeverrno == 0) {
+		spdk_jsonrpc_send_bool_response(request, true);
+	} else {
+		spdk_jsonrpc_send_error_response(request, bdeverrno, spdk_strerror(-bdeverrno));
+	}
+}
+
+static void
+rpc_bdev_kv_cache_delete(struct spdk_jsonrpc_request *request,
+			 const struct spdk_json_val *params)
+{
+	struct rpc_bdev_kv_cache_name req = {NULL};
+
+	if (spdk_json_decode_object(params, rpc_bdev_kv_cache_name_decoders,
+				    SPDK_COUNTOF(rpc_bdev_kv_cache_name_decoders),
+				    &req)) {
+		spdk_jsonrpc_send_error_response(request, SPDK_JSONRPC_ERROR_INTERNAL_ERROR,
+						 "spdk_json_decode_object failed");
+		goto cleanup;
+	}
+
+	bdev_kv_cache_delete(req.name, rpc_bdev_kv_cache_delete_cb, request);
+
+cleanup:
+	free_rpc_bdev_kv_cache_name(&req);
+}
+SPDK_RPC_REGISTER("bdev_kv_cache_delete", rpc_bdev_kv_cache_delete, SPDK_RPC_RUNTIME)
+
+static void
+rpc_bdev_kv_cache_get_stats(struct spdk_jsonrpc_request *request,
+			    const struct spdk_json_val *params)
+{
+	struct rpc_bdev_kv_cache_name req = {NULL};
+	struct vbdev_kv_cache_stats stats;
+	struct spdk_json_write_ctx *w;
+	uint64_t lookups;
+	int rc;
+
+	if (spdk_json_decode_object(params, rpc_bdev_kv_cache_name_decoders,
+				    SPDK_COUNTOF(rpc_bdev_kv_cache_name_decoders),
+				    &req)) {
+		spdk_jsonrpc_send_error_response(request, SPDK_JSONRPC_ERROR_INTERNAL_ERROR,
+						 "spdk_json_decode_object failed");
+		goto cleanup;
+	}
+
+	rc = bdev_kv_cache_get_stats(req.name, &stats);
+	if (rc != 0) {
+		spdk_jsonrpc_send_error_response(request, rc, spdk_strerror(-rc));
+		goto cleanup;
+	}
+
+	lookups = stats.retrieve_hits + stats.retrieve_misses;
+
+	w = spdk_jsonrpc_begin_result(request);
+	spdk_json_write_object_begin(w);
+	spdk_json_write_named_string(w, "name", req.name);
+	spdk_json_write_named_uint64(w, "retrieve_hits", stats.retrieve_hits);
+	spdk_json_write_named_uint64(w, "retrieve_misses", stats.retrieve_misses);
+	spdk_json_write_named_double(w, "retrieve_hit_rate",
+				     lookups ? (double)stats.retrieve_hits / lookups : 0.0);
+	spdk_json_write_named_uint64(w, "exist_hits", stats.exist_hits);
+	spdk_json_write_named_uint64(w, "exist_misses", stats.exist_misses);
+	spdk_json_write_named_uint64(w, "insertions", stats.insertions);
+	spdk_json_write_named_uint64(w, "evictions", stats.evictions);
+	spdk_json_write_named_uint64(w, "invalidations", stats.invalidations);
+	spdk_json_write_named_uint64(w, "num_entries", stats.num_entries);
+	spdk_json_write_named_uint64(w, "bytes_used", stats.bytes_used);
+	spdk_json_write_named_bool(w, "filter_ready", stats.filter_ready);
+	spdk_json_write_named_uint64(w, "filter_negatives", stats.filter_negatives);
+	spdk_json_write_named_uint64(w, "filter_false_positives", stats.filter_false_positives);
+	spdk_json_write_named_uint64(w, "select_hits", stats.select_hits);
+	spdk_json_write_named_uint64(w, "select_misses", stats.select_misses);
+	spdk_json_write_named_uint64(w, "select_insertions", stats.select_insertions);
+	spdk_json_write_named_uint64(w, "select_evictions", stats.select_evictions);
+	spdk_json_write_named_uint64(w, "select_invalidations", stats.select_invalidations);
+	spdk_json_write_named_uint64(w, "select_entries", stats.select_entries);
+	spdk_json_write_named_uint64(w, "select_bytes_used", stats.select_bytes_used);
+	spdk_json_write_object_end(w);
+	spdk_jsonrpc_end_result(request, w);
+
+cleanup:
+	free_rpc_bdev_kv_cache_name(&req);
+}
+SPDK_RPC_REGISTER("bdev_kv_cache_get_stats", rpc_bdev_kv_cache_get_stats, SPDK_RPC_RUNTIME)
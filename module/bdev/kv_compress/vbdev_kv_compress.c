@@ -0,0 +1,1164 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+/*
+ * KV value compression. Sits on top of a KV capable bdev and compresses values
+ * on the host before STORE and decompresses them after RETRIEVE, through the
+ * accel framework, so the work lands on whichever accel module provides
+ * compression (software ISA-L, QAT, IAA).
+ *
+ * A compressed value is stored behind a 16 byte header recording the codec and
+ * the original length. The header starts with a NUL byte, which text values such
+ * as CSV or JSON never do, so values are told apart without a lookup. Values that
+ * are short or do not compress are stored as they are; the rare raw value that
+ * starts with the header magic is wrapped in a header with the "none" codec, so
+ * the magic is never ambiguous. Compressed values are stored with
+ * NVME_KV_STORE_CMD_OPTION_NOT_COMPRESS, as compressing them again is wasted work.
+ *
+ * A RETRIEVE from offset 0 reads straight into the caller's buffer, so raw values
+ * cost no extra copy. Other reads fetch the header first. Either way a compressed
+ * value is read whole, decompressed into a bounce buffer, and the requested range
+ * is copied out, with the original length reported in cdw0.
+ *
+ * The device cannot run a SELECT over a compressed value. SEND_SELECT checks the
+ * header of the key: raw values are selected on the device, compressed values are
+ * decompressed and evaluated on the host with spdk_kv_select_eval(). Host
+ * results are kept here, under select ids with KV_COMPRESS_SELECT_ID_HOST set,
+ * and RETRIEVE_SELECT is routed by that bit.
+ *
+ * APPEND cannot extend a compressed value in place and is rejected. Batched
+ * commands are not supported, as they would bypass the value format.
+ */
+
+#include "spdk/stdinc.h"
+
+#include "vbdev_kv_compress.h"
+#include "spdk/accel.h"
+#include "spdk/env.h"
+#include "spdk/likely.h"
+#include "spdk/string.h"
+#include "spdk/thread.h"
+#include "spdk/util.h"
+
+#include "spdk/log.h"
+
+#include "spdk_internal/kv_select.h"
+
+#define KV_COMPRESS_DEFAULT_MIN_SIZE	256
+#define KV_COMPRESS_MAX_SELECTS		64
+/* Marks the ids of SELECT results evaluated on the host. */
+#define KV_COMPRESS_SELECT_ID_HOST	0x80000000U
+
+#define KV_COMPRESS_MAGIC		"\0KVZ"
+#define KV_COMPRESS_MAGIC_LEN		4
+#define KV_COMPRESS_VERSION		1
+
+enum kv_compress_codec {
+	/* Raw value that happens to start with the magic. */
+	KV_COMPRESS_CODEC_NONE		= 0,
+	/* Deflate stream, as produced by ACCEL_OPC_COMPRESS. */
+	KV_COMPRESS_CODEC_DEFLATE	= 1,
+};
+
+struct kv_compress_hdr {
+	uint8_t		magic[KV_COMPRESS_MAGIC_LEN];
+	uint8_t		version;
+	uint8_t		codec;
+	uint16_t	reserved;
+	/* Length of the value as stored by the caller. */
+	uint32_t	orig_len;
+	uint32_t	reserved2;
+};
+SPDK_STATIC_ASSERT(sizeof(struct kv_compress_hdr) == 16, "Incorrect size");
+
+#define KV_COMPRESS_HDR_SIZE		sizeof(struct kv_compress_hdr)
+
+static int vbdev_kv_compress_init(void);
+static int vbdev_kv_compress_get_ctx_size(void);
+static void vbdev_kv_compress_examine(struct spdk_bdev *bdev);
+static void vbdev_kv_compress_finish(void);
+static int vbdev_kv_compress_config_json(struct spdk_json_write_ctx *w);
+
+static struct spdk_bdev_module kv_compress_if = {
+	.name = "kv_compress",
+	.module_init = vbdev_kv_compress_init,
+	.get_ctx_size = vbdev_kv_compress_get_ctx_size,
+	.examine_config = vbdev_kv_compress_examine,
+	.module_fini = vbdev_kv_compress_finish,
+	.config_json = vbdev_kv_compress_config_json
+};
+
+SPDK_BDEV_MODULE_REGISTER(kv_compress, &kv_compress_if)
+
+/* Bdevs requested over RPC, kept so they can be created when their base bdev appears. */
+struct kv_compress_config {
+	char				*name;
+	char				*base_bdev_name;
+	uint32_t			min_size;
+	TAILQ_ENTRY(kv_compress_config)	link;
+};
+static TAILQ_HEAD(, kv_compress_config) g_kv_compress_configs = TAILQ_HEAD_INITIALIZER(
+			g_kv_compress_configs);
+
+struct vbdev_kv_compress {
+	struct spdk_bdev		bdev;
+	struct spdk_bdev		*base_bdev;
+	struct spdk_bdev_desc		*base_desc;
+	struct spdk_thread		*thread;
+	uint32_t			min_size;
+	pthread_spinlock_t		lock;
+	struct spdk_kv_select_results selects;
+	struct vbdev_kv_compress_stats	stats;
+	TAILQ_ENTRY(vbdev_kv_compress)	link;
+};
+static TAILQ_HEAD(, vbdev_kv_compress) g_kv_compress_nodes = TAILQ_HEAD_INITIALIZER(
+			g_kv_compress_nodes);
+
+struct kv_compress_io_channel {
+	struct spdk_io_channel	*base_ch;
+	struct spdk_io_channel	*accel_ch;
+};
+
+typedef int (*kv_compress_submit_fn)(struct spdk_bdev_io *bdev_io);
+
+struct kv_compress_bdev_io {
+	struct spdk_io_channel		*ch;
+	/* Value as stored on the base bdev, header included. */
+	uint8_t				*buf;
+	uint32_t			buf_len;
+	/* Decompressed value. */
+	uint8_t				*out;
+	/* Value as stored by the caller, in buf or out. */
+	uint8_t				*value;
+	uint32_t			value_len;
+	uint32_t			output_size;
+	struct iovec			src_iov;
+	struct iovec			dst_iov;
+	/* Child submission to retry once the base bdev has a bdev_io to spare. */
+	kv_compress_submit_fn		submit_fn;
+	struct spdk_bdev_io_wait_entry	bdev_io_wait;
+};
+
+#define KV_COMPRESS_STAT_ADD(comp, field, val) \
+	__atomic_fetch_add(&(comp)->stats.field, (val), __ATOMIC_RELAXED)
+
+static inline struct vbdev_kv_compress *
+kv_compress_from_io(struct spdk_bdev_io *bdev_io)
+{
+	return SPDK_CONTAINEROF(bdev_io->bdev, struct vbdev_kv_compress, bdev);
+}
+
+static inline struct kv_compress_io_channel *
+kv_compress_io_ch(struct spdk_bdev_io *bdev_io)
+{
+	struct kv_compress_bdev_io *io_ctx = (struct kv_compress_bdev_io *)bdev_io->driver_ctx;
+
+	return spdk_io_channel_get_ctx(io_ctx->ch);
+}
+
+static bool
+kv_compress_has_magic(struct iovec *iovs, int iovcnt, uint64_t len)
+{
+	uint8_t magic[KV_COMPRESS_MAGIC_LEN];
+
+	if (len < KV_COMPRESS_MAGIC_LEN) {
+		return false;
+	}
+
+	spdk_copy_iovs_to_buf(magic, sizeof(magic), iovs, iovcnt);
+	return memcmp(magic, KV_COMPRESS_MAGIC, KV_COMPRESS_MAGIC_LEN) == 0;
+}
+
+static void
+kv_compress_hdr_init(struct kv_compress_hdr *hdr, enum kv_compress_codec codec, uint32_t orig_len)
+{
+	memset(hdr, 0, sizeof(*hdr));
+	memcpy(hdr->magic, KV_COMPRESS_MAGIC, KV_COMPRESS_MAGIC_LEN);
+	hdr->version = KV_COMPRESS_VERSION;
+	hdr->codec = codec;
+	hdr->orig_len = orig_len;
+}
+
+/* Completion */
+
+static void
+kv_compress_io_free(struct kv_compress_bdev_io *io_ctx)
+{
+	spdk_dma_free(io_ctx->buf);
+	spdk_dma_free(io_ctx->out);
+	io_ctx->buf = NULL;
+	io_ctx->out = NULL;
+}
+
+static void
+kv_compress_complete(struct spdk_bdev_io *bdev_io, enum spdk_bdev_io_status status)
+{
+	kv_compress_io_free((struct kv_compress_bdev_io *)bdev_io->driver_ctx);
+	spdk_bdev_io_complete(bdev_io, status);
+}
+
+static void
+kv_compress_complete_nvme(struct spdk_bdev_io *bdev_io, uint32_t cdw0, int sc)
+{
+	kv_compress_io_free((struct kv_compress_bdev_io *)bdev_io->driver_ctx);
+	spdk_bdev_io_complete_nvme_status(bdev_io, cdw0, SPDK_NVME_SCT_GENERIC, sc);
+}
+
+static void
+kv_compress_complete_from(struct spdk_bdev_io *orig_io, struct spdk_bdev_io *bdev_io)
+{
+	kv_compress_io_free((struct kv_compress_bdev_io *)orig_io->driver_ctx);
+	spdk_bdev_kv_io_complete_from(orig_io, bdev_io);
+	spdk_bdev_free_io(bdev_io);
+}
+
+static void kv_compress_submit(struct spdk_bdev_io *bdev_io, kv_compress_submit_fn fn);
+
+static void
+kv_compress_resubmit_io(void *arg)
+{
+	struct spdk_bdev_io *bdev_io = (struct spdk_bdev_io *)arg;
+	struct kv_compress_bdev_io *io_ctx = (struct kv_compress_bdev_io *)bdev_io->driver_ctx;
+
+	kv_compress_submit(bdev_io, io_ctx->submit_fn);
+}
+
+/* Submit a child I/O to the base bdev, waiting for a bdev_io if there is none. */
+static void
+kv_compress_submit(struct spdk_bdev_io *bdev_io, kv_compress_submit_fn fn)
+{
+	struct kv_compress_bdev_io *io_ctx = (struct kv_compress_bdev_io *)bdev_io->driver_ctx;
+	int rc;
+
+	rc = fn(bdev_io);
+	if (rc == 0) {
+		return;
+	}
+
+	if (rc == -ENOMEM) {
+		io_ctx->submit_fn = fn;
+		io_ctx->bdev_io_wait.bdev = bdev_io->bdev;
+		io_ctx->bdev_io_wait.cb_fn = kv_compress_resubmit_io;
+		io_ctx->bdev_io_wait.cb_arg = bdev_io;
+
+		rc = spdk_bdev_queue_io_wait(bdev_io->bdev, kv_compress_io_ch(bdev_io)->base_ch,
+					     &io_ctx->bdev_io_wait);
+		if (rc == 0) {
+			return;
+		}
+		SPDK_ERRLOG("Queue io failed in kv_compress_submit, rc=%d.\n", rc);
+	} else {
+		SPDK_ERRLOG("ERROR on bdev_io submission!\n");
+	}
+	kv_compress_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+}
+
+static void
+kv_compress_forward_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	kv_compress_complete_from(cb_arg, bdev_io);
+}
+
+static int
+kv_compress_forward(struct spdk_bdev_io *bdev_io)
+{
+	struct vbdev_kv_compress *comp = kv_compress_from_io(bdev_io);
+
+	return spdk_bdev_kv_io_forward(comp->base_desc, kv_compress_io_ch(bdev_io)->base_ch, bdev_io,
+				       kv_compress_forward_done, bdev_io);
+}
+
+/* STORE */
+
+static void
+kv_compress_store_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct spdk_bdev_io *orig_io = cb_arg;
+	struct vbdev_kv_compress *comp = kv_compress_from_io(orig_io);
+	struct kv_compress_bdev_io *io_ctx = (struct kv_compress_bdev_io *)orig_io->driver_ctx;
+	struct kv_compress_hdr *hdr = (struct kv_compress_hdr *)io_ctx->buf;
+
+	if (success) {
+		if (hdr != NULL && hdr->codec == KV_COMPRESS_CODEC_DEFLATE) {
+			KV_COMPRESS_STAT_ADD(comp, stores_compressed, 1);
+			KV_COMPRESS_STAT_ADD(comp, bytes_out, io_ctx->buf_len);
+		} else {
+			KV_COMPRESS_STAT_ADD(comp, stores_raw, 1);
+			KV_COMPRESS_STAT_ADD(comp, bytes_out, hdr != NULL ? io_ctx->buf_len :
+					     orig_io->u.bdev.nvme_kv.buffer_size);
+		}
+		KV_COMPRESS_STAT_ADD(comp, bytes_in, orig_io->u.bdev.nvme_kv.buffer_size);
+	}
+
+	kv_compress_complete_from(orig_io, bdev_io);
+}
+
+static int
+kv_compress_store_raw(struct spdk_bdev_io *bdev_io)
+{
+	struct vbdev_kv_compress *comp = kv_compress_from_io(bdev_io);
+
+	return spdk_bdev_kv_storev(comp->base_desc, kv_compress_io_ch(bdev_io)->base_ch,
+				   bdev_io->u.bdev.nvme_kv.key, bdev_io->u.bdev.nvme_kv.key_length,
+				   bdev_io->u.bdev.iovs, bdev_io->u.bdev.iovcnt,
+				   bdev_io->u.bdev.nvme_kv.buffer_size, bdev_io->u.bdev.nvme_kv.options,
+				   kv_compress_store_done, bdev_io);
+}
+
+static int
+kv_compress_store_buf(struct spdk_bdev_io *bdev_io)
+{
+	struct vbdev_kv_compress *comp = kv_compress_from_io(bdev_io);
+	struct kv_compress_bdev_io *io_ctx = (struct kv_compress_bdev_io *)bdev_io->driver_ctx;
+	struct kv_compress_hdr *hdr = (struct kv_compress_hdr *)io_ctx->buf;
+	uint8_t options = bdev_io->u.bdev.nvme_kv.options;
+
+	if (hdr->codec != KV_COMPRESS_CODEC_NONE) {
+		options |= NVME_KV_STORE_CMD_OPTION_NOT_COMPRESS;
+	}
+
+	return spdk_bdev_kv_store(comp->base_desc, kv_compress_io_ch(bdev_io)->base_ch,
+				  bdev_io->u.bdev.nvme_kv.key, bdev_io->u.bdev.nvme_kv.key_length,
+				  io_ctx->buf, io_ctx->buf_len, options, kv_compress_store_done, bdev_io);
+}
+
+/* Store a raw value, wrapping it in a header if it would be taken for one. */
+static void
+kv_compress_store_uncompressed(struct spdk_bdev_io *bdev_io)
+{
+	struct kv_compress_bdev_io *io_ctx = (struct kv_compress_bdev_io *)bdev_io->driver_ctx;
+	uint64_t len = bdev_io->u.bdev.nvme_kv.buffer_size;
+
+	spdk_dma_free(io_ctx->buf);
+	io_ctx->buf = NULL;
+
+	if (!kv_compress_has_magic(bdev_io->u.bdev.iovs, bdev_io->u.bdev.iovcnt, len)) {
+		kv_compress_submit(bdev_io, kv_compress_store_raw);
+		return;
+	}
+
+	io_ctx->buf_len = KV_COMPRESS_HDR_SIZE + len;
+	io_ctx->buf = spdk_dma_malloc(io_ctx->buf_len, 0, NULL);
+	if (io_ctx->buf == NULL) {
+		kv_compress_complete(bdev_io, SPDK_BDEV_IO_STATUS_NOMEM);
+		return;
+	}
+
+	kv_compress_hdr_init((struct kv_compress_hdr *)io_ctx->buf, KV_COMPRESS_CODEC_NONE, len);
+	spdk_copy_iovs_to_buf(io_ctx->buf + KV_COMPRESS_HDR_SIZE, len, bdev_io->u.bdev.iovs,
+			      bdev_io->u.bdev.iovcnt);
+	kv_compress_submit(bdev_io, kv_compress_store_buf);
+}
+
+static void
+kv_compress_compress_done(void *cb_arg, int status)
+{
+	struct spdk_bdev_io *bdev_io = cb_arg;
+	struct kv_compress_bdev_io *io_ctx = (struct kv_compress_bdev_io *)bdev_io->driver_ctx;
+
+	if (status != 0) {
+		/* The value did not shrink, or no accel module compresses: store it as it is. */
+		SPDK_DEBUGLOG(vbdev_kv_compress, "compression failed (%d), storing raw\n", status);
+		kv_compress_store_uncompressed(bdev_io);
+		return;
+	}
+
+	kv_compress_hdr_init((struct kv_compress_hdr *)io_ctx->buf, KV_COMPRESS_CODEC_DEFLATE,
+			     bdev_io->u.bdev.nvme_kv.buffer_size);
+	io_ctx->buf_len = KV_COMPRESS_HDR_SIZE + io_ctx->output_size;
+	kv_compress_submit(bdev_io, kv_compress_store_buf);
+}
+
+static void
+kv_compress_store(struct spdk_bdev_io *bdev_io)
+{
+	struct vbdev_kv_compress *comp = kv_compress_from_io(bdev_io);
+	struct kv_compress_bdev_io *io_ctx = (struct kv_compress_bdev_io *)bdev_io->driver_ctx;
+	uint64_t len = bdev_io->u.bdev.nvme_kv.buffer_size;
+	int rc;
+
+	if (bdev_io->u.bdev.nvme_kv.options & NVME_KV_STORE_CMD_OPTION_APPEND) {
+		SPDK_ERRLOG("%s: APPEND is not supported on compressed values\n", comp->bdev.name);
+		kv_compress_complete_nvme(bdev_io, 0, SPDK_NVME_SC_INVALID_FIELD);
+		return;
+	}
+
+	if (len < comp->min_size || len <= KV_COMPRESS_HDR_SIZE + 1 || len > UINT32_MAX) {
+		kv_compress_store_uncompressed(bdev_io);
+		return;
+	}
+
+	/* Header and compressed data must come out shorter than the value. */
+	io_ctx->buf_len = len;
+	io_ctx->buf = spdk_dma_malloc(len, 0, NULL);
+	if (io_ctx->buf == NULL) {
+		kv_compress_complete(bdev_io, SPDK_BDEV_IO_STATUS_NOMEM);
+		return;
+	}
+
+	rc = spdk_accel_submit_compress(kv_compress_io_ch(bdev_io)->accel_ch,
+					io_ctx->buf + KV_COMPRESS_HDR_SIZE, len - KV_COMPRESS_HDR_SIZE - 1,
+					bdev_io->u.bdev.iovs, bdev_io->u.bdev.iovcnt,
+					&io_ctx->output_size, 0, kv_compress_compress_done, bdev_io);
+	if (rc != 0) {
+		kv_compress_compress_done(bdev_io, rc);
+	}
+}
+
+/* RETRIEVE and SEND_SELECT */
+
+static void kv_compress_host_select(struct spdk_bdev_io *bdev_io);
+
+/* The whole value is in value/value_len: finish the command on it. */
+static void
+kv_compress_value_ready(struct spdk_bdev_io *bdev_io)
+{
+	struct kv_compress_bdev_io *io_ctx = (struct kv_compress_bdev_io *)bdev_io->driver_ctx;
+	uint64_t offset = bdev_io->u.bdev.nvme_kv.offset;
+
+	if (bdev_io->type == SPDK_BDEV_IO_KV_SEND_SELECT) {
+		kv_compress_host_select(bdev_io);
+		return;
+	}
+
+	if (offset > io_ctx->value_len) {
+		kv_compress_complete_nvme(bdev_io, 0, SPDK_NVME_SC_INVALID_FIELD);
+		return;
+	}
+
+	spdk_copy_buf_to_iovs(bdev_io->u.bdev.iovs, bdev_io->u.bdev.iovcnt, io_ctx->value + offset,
+			      spdk_min(bdev_io->u.bdev.nvme_kv.buffer_size, io_ctx->value_len - offset));
+	kv_compress_complete_nvme(bdev_io, io_ctx->value_len, SPDK_NVME_SC_SUCCESS);
+}
+
+static void
+kv_compress_decompress_done(void *cb_arg, int status)
+{
+	struct spdk_bdev_io *bdev_io = cb_arg;
+	struct vbdev_kv_compress *comp = kv_compress_from_io(bdev_io);
+	struct kv_compress_bdev_io *io_ctx = (struct kv_compress_bdev_io *)bdev_io->driver_ctx;
+
+	if (status != 0 || io_ctx->output_size != io_ctx->value_len) {
+		SPDK_ERRLOG("%s: could not decompress value (%d, %u of %u bytes)\n", comp->bdev.name,
+			    status, io_ctx->output_size, io_ctx->value_len);
+		kv_compress_complete_nvme(bdev_io, 0, SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+		return;
+	}
+
+	KV_COMPRESS_STAT_ADD(comp, retrieves_decompressed, 1);
+	io_ctx->value = io_ctx->out;
+	kv_compress_value_ready(bdev_io);
+}
+
+/* The stored value, header included, is in buf: decode it. */
+static void
+kv_compress_decode(struct spdk_bdev_io *bdev_io)
+{
+	struct vbdev_kv_compress *comp = kv_compress_from_io(bdev_io);
+	struct kv_compress_bdev_io *io_ctx = (struct kv_compress_bdev_io *)bdev_io->driver_ctx;
+	struct kv_compress_hdr *hdr = (struct kv_compress_hdr *)io_ctx->buf;
+	int rc;
+
+	if (hdr->version != KV_COMPRESS_VERSION) {
+		SPDK_ERRLOG("%s: unknown value header version %u\n", comp->bdev.name, hdr->version);
+		kv_compress_complete_nvme(bdev_io, 0, SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+		return;
+	}
+
+	io_ctx->value_len = hdr->orig_len;
+	switch (hdr->codec) {
+	case KV_COMPRESS_CODEC_NONE:
+		if (io_ctx->buf_len - KV_COMPRESS_HDR_SIZE != hdr->orig_len) {
+			break;
+		}
+		io_ctx->value = io_ctx->buf + KV_COMPRESS_HDR_SIZE;
+		kv_compress_value_ready(bdev_io);
+		return;
+	case KV_COMPRESS_CODEC_DEFLATE:
+		/* One byte of room past the value for the SELECT evaluator. */
+		io_ctx->out = spdk_dma_malloc((uint64_t)hdr->orig_len + 1, 0, NULL);
+		if (io_ctx->out == NULL) {
+			kv_compress_complete(bdev_io, SPDK_BDEV_IO_STATUS_NOMEM);
+			return;
+		}
+		io_ctx->src_iov.iov_base = io_ctx->buf + KV_COMPRESS_HDR_SIZE;
+		io_ctx->src_iov.iov_len = io_ctx->buf_len - KV_COMPRESS_HDR_SIZE;
+		io_ctx->dst_iov.iov_base = io_ctx->out;
+		io_ctx->dst_iov.iov_len = hdr->orig_len;
+		rc = spdk_accel_submit_decompress(kv_compress_io_ch(bdev_io)->accel_ch,
+						  &io_ctx->dst_iov, 1, &io_ctx->src_iov, 1,
+						  &io_ctx->output_size, 0, kv_compress_decompress_done,
+						  bdev_io);
+		if (rc != 0) {
+			kv_compress_decompress_done(bdev_io, rc);
+		}
+		return;
+	default:
+		break;
+	}
+
+	SPDK_ERRLOG("%s: malformed value header (codec %u)\n", comp->bdev.name, hdr->codec);
+	kv_compress_complete_nvme(bdev_io, 0, SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+}
+
+static void kv_compress_start_read_hdr(struct spdk_bdev_io *bdev_io);
+
+static void
+kv_compress_read_value_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct spdk_bdev_io *orig_io = cb_arg;
+	struct kv_compress_bdev_io *io_ctx = (struct kv_compress_bdev_io *)orig_io->driver_ctx;
+	uint32_t value_len;
+	int sct, sc;
+
+	if (!success) {
+		kv_compress_complete_from(orig_io, bdev_io);
+		return;
+	}
+
+	spdk_bdev_io_get_nvme_status(bdev_io, &value_len, &sct, &sc);
+	spdk_bdev_free_io(bdev_io);
+	if (value_len != io_ctx->buf_len) {
+		/* Overwritten since the header was read. Start over. */
+		spdk_dma_free(io_ctx->buf);
+		io_ctx->buf = NULL;
+		kv_compress_start_read_hdr(orig_io);
+		return;
+	}
+
+	kv_compress_decode(orig_io);
+}
+
+static int
+kv_compress_read_value(struct spdk_bdev_io *bdev_io)
+{
+	struct vbdev_kv_compress *comp = kv_compress_from_io(bdev_io);
+	struct kv_compress_bdev_io *io_ctx = (struct kv_compress_bdev_io *)bdev_io->driver_ctx;
+
+	return spdk_bdev_kv_retrieve(comp->base_desc, kv_compress_io_ch(bdev_io)->base_ch,
+				     bdev_io->u.bdev.nvme_kv.key, bdev_io->u.bdev.nvme_kv.key_length,
+				     io_ctx->buf, 0, io_ctx->buf_len, kv_compress_read_value_done, bdev_io);
+}
+
+/* Read a whole stored value of value_len bytes into buf. */
+static void
+kv_compress_fetch(struct spdk_bdev_io *bdev_io, uint32_t value_len)
+{
+	struct kv_compress_bdev_io *io_ctx = (struct kv_compress_bdev_io *)bdev_io->driver_ctx;
+
+	spdk_dma_free(io_ctx->buf);
+	io_ctx->buf_len = value_len;
+	/* One byte of room past the value for the SELECT evaluator. */
+	io_ctx->buf = spdk_dma_malloc((uint64_t)value_len + 1, 0, NULL);
+	if (io_ctx->buf == NULL) {
+		kv_compress_complete(bdev_io, SPDK_BDEV_IO_STATUS_NOMEM);
+		return;
+	}
+
+	kv_compress_submit(bdev_io, kv_compress_read_value);
+}
+
+static void
+kv_compress_read_hdr_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct spdk_bdev_io *orig_io = cb_arg;
+	struct kv_compress_bdev_io *io_ctx = (struct kv_compress_bdev_io *)orig_io->driver_ctx;
+	uint32_t value_len;
+	int sct, sc;
+
+	if (!success) {
+		kv_compress_complete_from(orig_io, bdev_io);
+		return;
+	}
+
+	spdk_bdev_io_get_nvme_status(bdev_io, &value_len, &sct, &sc);
+	spdk_bdev_free_io(bdev_io);
+	if (value_len < KV_COMPRESS_HDR_SIZE ||
+	    memcmp(io_ctx->buf, KV_COMPRESS_MAGIC, KV_COMPRESS_MAGIC_LEN) != 0) {
+		/* A raw value: let the base bdev handle the command. */
+		spdk_dma_free(io_ctx->buf);
+		io_ctx->buf = NULL;
+		kv_compress_submit(orig_io, kv_compress_forward);
+		return;
+	}
+
+	kv_compress_fetch(orig_io, value_len);
+}
+
+static int
+kv_compress_read_hdr(struct spdk_bdev_io *bdev_io)
+{
+	struct vbdev_kv_compress *comp = kv_compress_from_io(bdev_io);
+	struct kv_compress_bdev_io *io_ctx = (struct kv_compress_bdev_io *)bdev_io->driver_ctx;
+
+	return spdk_bdev_kv_retrieve(comp->base_desc, kv_compress_io_ch(bdev_io)->base_ch,
+				     bdev_io->u.bdev.nvme_kv.key, bdev_io->u.bdev.nvme_kv.key_length,
+				     io_ctx->buf, 0, KV_COMPRESS_HDR_SIZE, kv_compress_read_hdr_done, bdev_io);
+}
+
+/* Read the header of the key to learn how the command must be handled. */
+static void
+kv_compress_start_read_hdr(struct spdk_bdev_io *bdev_io)
+{
+	struct kv_compress_bdev_io *io_ctx = (struct kv_compress_bdev_io *)bdev_io->driver_ctx;
+
+	io_ctx->buf_len = KV_COMPRESS_HDR_SIZE;
+	io_ctx->buf = spdk_dma_malloc(KV_COMPRESS_HDR_SIZE, 0, NULL);
+	if (io_ctx->buf == NULL) {
+		kv_compress_complete(bdev_io, SPDK_BDEV_IO_STATUS_NOMEM);
+		return;
+	}
+
+	kv_compress_submit(bdev_io, kv_compress_read_hdr);
+}
+
+static void
+kv_compress_retrieve_direct_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct spdk_bdev_io *orig_io = cb_arg;
+	struct kv_compress_bdev_io *io_ctx = (struct kv_compress_bdev_io *)orig_io->driver_ctx;
+	uint64_t buffer_size = orig_io->u.bdev.nvme_kv.buffer_size;
+	uint32_t value_len;
+	int sct, sc;
+
+	spdk_bdev_io_get_nvme_status(bdev_io, &value_len, &sct, &sc);
+	if (!success || value_len < KV_COMPRESS_HDR_SIZE ||
+	    !kv_compress_has_magic(orig_io->u.bdev.iovs, orig_io->u.bdev.iovcnt, buffer_size)) {
+		/* Raw values are already where the caller wants them. */
+		kv_compress_complete_from(orig_io, bdev_io);
+		return;
+	}
+	spdk_bdev_free_io(bdev_io);
+
+	if (value_len > buffer_size) {
+		kv_compress_fetch(orig_io, value_len);
+		return;
+	}
+
+	io_ctx->buf_len = value_len;
+	io_ctx->buf = spdk_dma_malloc((uint64_t)value_len + 1, 0, NULL);
+	if (io_ctx->buf == NULL) {
+		kv_compress_complete(orig_io, SPDK_BDEV_IO_STATUS_NOMEM);
+		return;
+	}
+	spdk_copy_iovs_to_buf(io_ctx->buf, value_len, orig_io->u.bdev.iovs, orig_io->u.bdev.iovcnt);
+	kv_compress_decode(orig_io);
+}
+
+static int
+kv_compress_retrieve_direct(struct spdk_bdev_io *bdev_io)
+{
+	struct vbdev_kv_compress *comp = kv_compress_from_io(bdev_io);
+
+	return spdk_bdev_kv_io_forward(comp->base_desc, kv_compress_io_ch(bdev_io)->base_ch, bdev_io,
+				       kv_compress_retrieve_direct_done, bdev_io);
+}
+
+/* Host SELECT */
+
+static void
+kv_compress_host_select(struct spdk_bdev_io *bdev_io)
+{
+	struct vbdev_kv_compress *comp = kv_compress_from_io(bdev_io);
+	struct kv_compress_bdev_io *io_ctx = (struct kv_compress_bdev_io *)bdev_io->driver_ctx;
+	char *query, *result;
+	size_t query_len = bdev_io->u.bdev.nvme_kv.buffer_size;
+	size_t result_len;
+	uint32_t id;
+	int rc;
+
+	query = malloc(query_len);
+	if (query == NULL) {
+		kv_compress_complete(bdev_io, SPDK_BDEV_IO_STATUS_NOMEM);
+		return;
+	}
+	spdk_copy_iovs_to_buf(query, query_len, bdev_io->u.bdev.iovs, bdev_io->u.bdev.iovcnt);
+	if (bdev_io->u.bdev.iovcnt == 1) {
+		/* The contiguous API takes a NUL terminated query. */
+		query_len = strnlen(query, query_len);
+	}
+
+	rc = spdk_kv_select_eval((char *)io_ctx->value, io_ctx->value_len, query, query_len,
+				 bdev_io->u.bdev.nvme_kv.select_input_type,
+				 bdev_io->u.bdev.nvme_kv.select_output_type,
+				 bdev_io->u.bdev.nvme_kv.options, &result, &result_len);
+	free(query);
+	if (rc != 0) {
+		SPDK_DEBUGLOG(vbdev_kv_compress, "host select failed: %s\n", spdk_strerror(-rc));
+		kv_compress_complete_nvme(bdev_io, 0, rc == -ENOMEM ? SPDK_NVME_SC_INTERNAL_DEVICE_ERROR :
+					  SPDK_NVME_SC_INVALID_FIELD);
+		return;
+	}
+
+	pthread_spin_lock(&comp->lock);
+	rc = spdk_kv_select_results_add(&comp->selects, result, result_len, &id);
+	pthread_spin_unlock(&comp->lock);
+	if (rc != 0) {
+		kv_compress_complete(bdev_io, SPDK_BDEV_IO_STATUS_NOMEM);
+		return;
+	}
+
+	KV_COMPRESS_STAT_ADD(comp, host_selects, 1);
+	kv_compress_complete_nvme(bdev_io, id, SPDK_NVME_SC_SUCCESS);
+}
+
+static void
+kv_compress_host_retrieve_select(struct spdk_bdev_io *bdev_io)
+{
+	struct vbdev_kv_compress *comp = kv_compress_from_io(bdev_io);
+	uint32_t result_len;
+	int rc;
+
+	pthread_spin_lock(&comp->lock);
+	rc = spdk_kv_select_results_read(&comp->selects, bdev_io->u.bdev.nvme_kv.select_id,
+					 bdev_io->u.bdev.nvme_kv.offset,
+					 bdev_io->u.bdev.nvme_kv.options,
+					 bdev_io->u.bdev.iovs, bdev_io->u.bdev.iovcnt,
+					 bdev_io->u.bdev.nvme_kv.buffer_size, &result_len);
+	pthread_spin_unlock(&comp->lock);
+	if (rc != 0) {
+		kv_compress_complete_nvme(bdev_io, 0, SPDK_NVME_SC_INVALID_FIELD);
+		return;
+	}
+
+	kv_compress_complete_nvme(bdev_io, result_len, SPDK_NVME_SC_SUCCESS);
+}
+
+/* I/O path */
+
+static void
+vbdev_kv_compress_submit_request(struct spdk_io_channel *ch, struct spdk_bdev_io *bdev_io)
+{
+	struct kv_compress_bdev_io *io_ctx = (struct kv_compress_bdev_io *)bdev_io->driver_ctx;
+
+	memset(io_ctx, 0, sizeof(*io_ctx));
+	io_ctx->ch = ch;
+
+	switch (bdev_io->type) {
+	case SPDK_BDEV_IO_KV_STORE:
+		kv_compress_store(bdev_io);
+		break;
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+		if (bdev_io->u.bdev.nvme_kv.offset == 0 &&
+		    bdev_io->u.bdev.nvme_kv.buffer_size >= KV_COMPRESS_HDR_SIZE) {
+			kv_compress_submit(bdev_io, kv_compress_retrieve_direct);
+		} else {
+			kv_compress_start_read_hdr(bdev_io);
+		}
+		break;
+	case SPDK_BDEV_IO_KV_SEND_SELECT:
+		kv_compress_start_read_hdr(bdev_io);
+		break;
+	case SPDK_BDEV_IO_KV_RETRIEVE_SELECT:
+		if (bdev_io->u.bdev.nvme_kv.select_id & KV_COMPRESS_SELECT_ID_HOST) {
+			kv_compress_host_retrieve_select(bdev_io);
+		} else {
+			kv_compress_submit(bdev_io, kv_compress_forward);
+		}
+		break;
+	case SPDK_BDEV_IO_KV_LIST:
+	case SPDK_BDEV_IO_KV_DELETE:
+	case SPDK_BDEV_IO_KV_EXIST:
+		kv_compress_submit(bdev_io, kv_compress_forward);
+		break;
+	default:
+		SPDK_ERRLOG("kv_compress: unsupported I/O type %d\n", bdev_io->type);
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		break;
+	}
+}
+
+static bool
+vbdev_kv_compress_io_type_supported(void *ctx, enum spdk_bdev_io_type io_type)
+{
+	struct vbdev_kv_compress *comp = ctx;
+
+	switch (io_type) {
+	case SPDK_BDEV_IO_KV_LIST:
+	case SPDK_BDEV_IO_KV_DELETE:
+	case SPDK_BDEV_IO_KV_EXIST:
+	case SPDK_BDEV_IO_KV_STORE:
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+	case SPDK_BDEV_IO_KV_SEND_SELECT:
+	case SPDK_BDEV_IO_KV_RETRIEVE_SELECT:
+		return spdk_bdev_io_type_supported(comp->base_bdev, io_type);
+	default:
+		/* Block I/O and batches would bypass the value format. */
+		return false;
+	}
+}
+
+static struct spdk_io_channel *
+vbdev_kv_compress_get_io_channel(void *ctx)
+{
+	return spdk_get_io_channel(ctx);
+}
+
+static void
+vbdev_kv_compress_write_params_json(struct vbdev_kv_compress *comp, struct spdk_json_write_ctx *w)
+{
+	spdk_json_write_named_string(w, "name", spdk_bdev_get_name(&comp->bdev));
+	spdk_json_write_named_string(w, "base_bdev_name", spdk_bdev_get_name(comp->base_bdev));
+	spdk_json_write_named_uint32(w, "min_size", comp->min_size);
+}
+
+static int
+vbdev_kv_compress_dump_info_json(void *ctx, struct spdk_json_write_ctx *w)
+{
+	struct vbdev_kv_compress *comp = ctx;
+
+	spdk_json_write_name(w, "kv_compress");
+	spdk_json_write_object_begin(w);
+	vbdev_kv_compress_write_params_json(comp, w);
+	spdk_json_write_object_end(w);
+
+	return 0;
+}
+
+static int
+vbdev_kv_compress_config_json(struct spdk_json_write_ctx *w)
+{
+	struct vbdev_kv_compress *comp;
+
+	TAILQ_FOREACH(comp, &g_kv_compress_nodes, link) {
+		spdk_json_write_object_begin(w);
+		spdk_json_write_named_string(w, "method", "bdev_kv_compress_create");
+		spdk_json_write_named_object_begin(w, "params");
+		vbdev_kv_compress_write_params_json(comp, w);
+		spdk_json_write_object_end(w);
+		spdk_json_write_object_end(w);
+	}
+	return 0;
+}
+
+static void
+vbdev_kv_compress_write_config_json(struct spdk_bdev *bdev, struct spdk_json_write_ctx *w)
+{
+	/* No config per bdev needed */
+}
+
+static void
+kv_compress_free(struct vbdev_kv_compress *comp)
+{
+	spdk_kv_select_results_fini(&comp->selects);
+	pthread_spin_destroy(&comp->lock);
+	free(comp->bdev.name);
+	free(comp);
+}
+
+static void
+_device_unregister_cb(void *io_device)
+{
+	kv_compress_free(io_device);
+}
+
+static void
+_vbdev_kv_compress_destruct(void *ctx)
+{
+	struct spdk_bdev_desc *desc = ctx;
+
+	spdk_bdev_close(desc);
+}
+
+static int
+vbdev_kv_compress_destruct(void *ctx)
+{
+	struct vbdev_kv_compress *comp = ctx;
+
+	TAILQ_REMOVE(&g_kv_compress_nodes, comp, link);
+
+	spdk_bdev_module_release_bdev(comp->base_bdev);
+
+	/* Close the underlying bdev on its same opened thread. */
+	if (comp->thread && comp->thread != spdk_get_thread()) {
+		spdk_thread_send_msg(comp->thread, _vbdev_kv_compress_destruct, comp->base_desc);
+	} else {
+		spdk_bdev_close(comp->base_desc);
+	}
+
+	spdk_io_device_unregister(comp, _device_unregister_cb);
+
+	return 0;
+}
+
+static const struct spdk_bdev_fn_table vbdev_kv_compress_fn_table = {
+	.destruct		= vbdev_kv_compress_destruct,
+	.submit_request		= vbdev_kv_compress_submit_request,
+	.io_type_supported	= vbdev_kv_compress_io_type_supported,
+	.get_io_channel		= vbdev_kv_compress_get_io_channel,
+	.dump_info_json		= vbdev_kv_compress_dump_info_json,
+	.write_config_json	= vbdev_kv_compress_write_config_json,
+};
+
+static int
+kv_compress_ch_create_cb(void *io_device, void *ctx_buf)
+{
+	struct kv_compress_io_channel *comp_ch = ctx_buf;
+	struct vbdev_kv_compress *comp = io_device;
+
+	comp_ch->base_ch = spdk_bdev_get_io_channel(comp->base_desc);
+	if (comp_ch->base_ch == NULL) {
+		return -ENOMEM;
+	}
+
+	comp_ch->accel_ch = spdk_accel_get_io_channel();
+	if (comp_ch->accel_ch == NULL) {
+		spdk_put_io_channel(comp_ch->base_ch);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static void
+kv_compress_ch_destroy_cb(void *io_device, void *ctx_buf)
+{
+	struct kv_compress_io_channel *comp_ch = ctx_buf;
+
+	spdk_put_io_channel(comp_ch->accel_ch);
+	spdk_put_io_channel(comp_ch->base_ch);
+}
+
+static void
+vbdev_kv_compress_base_bdev_hotremove_cb(struct spdk_bdev *bdev_find)
+{
+	struct vbdev_kv_compress *comp, *tmp;
+
+	TAILQ_FOREACH_SAFE(comp, &g_kv_compress_nodes, link, tmp) {
+		if (bdev_find == comp->base_bdev) {
+			spdk_bdev_unregister(&comp->bdev, NULL, NULL);
+		}
+	}
+}
+
+static void
+vbdev_kv_compress_base_bdev_event_cb(enum spdk_bdev_event_type type, struct spdk_bdev *bdev,
+				     void *event_ctx)
+{
+	switch (type) {
+	case SPDK_BDEV_EVENT_REMOVE:
+		vbdev_kv_compress_base_bdev_hotremove_cb(bdev);
+		break;
+	default:
+		SPDK_NOTICELOG("Unsupported bdev event: type %d\n", type);
+		break;
+	}
+}
+
+static int
+vbdev_kv_compress_register(struct kv_compress_config *config)
+{
+	struct vbdev_kv_compress *comp;
+	struct spdk_bdev *bdev;
+	int rc;
+
+	comp = calloc(1, sizeof(*comp));
+	if (comp == NULL) {
+		return -ENOMEM;
+	}
+
+	spdk_kv_select_results_init(&comp->selects, KV_COMPRESS_MAX_SELECTS,
+				    KV_COMPRESS_SELECT_ID_HOST);
+	pthread_spin_init(&comp->lock, PTHREAD_PROCESS_PRIVATE);
+
+	comp->bdev.name = strdup(config->name);
+	if (comp->bdev.name == NULL) {
+		rc = -ENOMEM;
+		goto free_comp;
+	}
+	comp->bdev.product_name = "kv_compress";
+	comp->min_size = config->min_size;
+
+	rc = spdk_bdev_open_ext(config->base_bdev_name, true, vbdev_kv_compress_base_bdev_event_cb,
+				NULL, &comp->base_desc);
+	if (rc) {
+		if (rc != -ENODEV) {
+			SPDK_ERRLOG("could not open bdev %s\n", config->base_bdev_name);
+		}
+		goto free_comp;
+	}
+
+	bdev = spdk_bdev_desc_get_bdev(comp->base_desc);
+	if (!spdk_bdev_io_type_supported(bdev, SPDK_BDEV_IO_KV_RETRIEVE)) {
+		SPDK_ERRLOG("bdev %s does not support KV commands\n", config->base_bdev_name);
+		rc = -ENOTSUP;
+		goto close_base;
+	}
+	comp->base_bdev = bdev;
+
+	comp->bdev.write_cache = bdev->write_cache;
+	comp->bdev.required_alignment = bdev->required_alignment;
+	comp->bdev.blocklen = bdev->blocklen;
+	comp->bdev.blockcnt = bdev->blockcnt;
+
+	comp->bdev.ctxt = comp;
+	comp->bdev.fn_table = &vbdev_kv_compress_fn_table;
+	comp->bdev.module = &kv_compress_if;
+	comp->thread = spdk_get_thread();
+
+	spdk_io_device_register(comp, kv_compress_ch_create_cb, kv_compress_ch_destroy_cb,
+				sizeof(struct kv_compress_io_channel), config->name);
+
+	rc = spdk_bdev_module_claim_bdev(bdev, comp->base_desc, comp->bdev.module);
+	if (rc) {
+		SPDK_ERRLOG("could not claim bdev %s\n", config->base_bdev_name);
+		goto unregister_device;
+	}
+
+	rc = spdk_bdev_register(&comp->bdev);
+	if (rc) {
+		SPDK_ERRLOG("could not register kv_compress bdev %s\n", config->name);
+		spdk_bdev_module_release_bdev(bdev);
+		goto unregister_device;
+	}
+
+	TAILQ_INSERT_TAIL(&g_kv_compress_nodes, comp, link);
+	SPDK_NOTICELOG("created kv_compress bdev %s on %s\n", config->name, config->base_bdev_name);
+	return 0;
+
+unregister_device:
+	spdk_io_device_unregister(comp, NULL);
+close_base:
+	spdk_bdev_close(comp->base_desc);
+free_comp:
+	kv_compress_free(comp);
+	return rc;
+}
+
+static void
+kv_compress_config_free(struct kv_compress_config *config)
+{
+	free(config->name);
+	free(config->base_bdev_name);
+	free(config);
+}
+
+int
+bdev_kv_compress_create(const struct vbdev_kv_compress_opts *opts)
+{
+	struct kv_compress_config *config;
+	int rc;
+
+	if (opts->name == NULL || opts->base_bdev_name == NULL) {
+		return -EINVAL;
+	}
+
+	TAILQ_FOREACH(config, &g_kv_compress_configs, link) {
+		if (strcmp(config->name, opts->name) == 0) {
+			SPDK_ERRLOG("kv_compress bdev %s already exists\n", opts->name);
+			return -EEXIST;
+		}
+	}
+
+	config = calloc(1, sizeof(*config));
+	if (config == NULL) {
+		return -ENOMEM;
+	}
+
+	config->name = strdup(opts->name);
+	config->base_bdev_name = strdup(opts->base_bdev_name);
+	if (config->name == NULL || config->base_bdev_name == NULL) {
+		kv_compress_config_free(config);
+		return -ENOMEM;
+	}
+	config->min_size = opts->min_size ? opts->min_size : KV_COMPRESS_DEFAULT_MIN_SIZE;
+
+	rc = vbdev_kv_compress_register(config);
+	if (rc == -ENODEV) {
+		SPDK_NOTICELOG("kv_compress creation deferred pending base bdev arrival\n");
+		rc = 0;
+	} else if (rc != 0) {
+		kv_compress_config_free(config);
+		return rc;
+	}
+
+	TAILQ_INSERT_TAIL(&g_kv_compress_configs, config, link);
+	return 0;
+}
+
+void
+bdev_kv_compress_delete(const char *name, spdk_bdev_unregister_cb cb_fn, void *cb_arg)
+{
+	struct kv_compress_config *config;
+	int rc;
+
+	rc = spdk_bdev_unregister_by_name(name, &kv_compress_if, cb_fn, cb_arg);
+	if (rc != 0) {
+		cb_fn(cb_arg, rc);
+		return;
+	}
+
+	/* Forget the bdev so it is not re-created when its base bdev comes back. */
+	TAILQ_FOREACH(config, &g_kv_compress_configs, link) {
+		if (strcmp(config->name, name) == 0) {
+			TAILQ_REMOVE(&g_kv_compress_configs, config, link);
+			kv_compress_config_free(config);
+			break;
+		}
+	}
+}
+
+int
+bdev_kv_compress_get_stats(const char *name, struct vbdev_kv_compress_stats *stats)
+{
+	struct vbdev_kv_compress *comp;
+
+	TAILQ_FOREACH(comp, &g_kv_compress_nodes, link) {
+		if (strcmp(spdk_bdev_get_name(&comp->bdev), name) == 0) {
+			break;
+		}
+	}
+	if (comp == NULL) {
+		return -ENODEV;
+	}
+
+	stats->stores_compressed = __atomic_load_n(&comp->stats.stores_compressed, __ATOMIC_RELAXED);
+	stats->stores_raw = __atomic_load_n(&comp->stats.stores_raw, __ATOMIC_RELAXED);
+	stats->bytes_in = __atomic_load_n(&comp->stats.bytes_in, __ATOMIC_RELAXED);
+	stats->bytes_out = __atomic_load_n(&comp->stats.bytes_out, __ATOMIC_RELAXED);
+	stats->retrieves_decompressed = __atomic_load_n(&comp->stats.retrieves_decompressed,
+					__ATOMIC_RELAXED);
+	stats->host_selects = __atomic_load_n(&comp->stats.host_selects, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+static int
+vbdev_kv_compress_init(void)
+{
+	return 0;
+}
+
+static void
+vbdev_kv_compress_finish(void)
+{
+	struct kv_compress_config *config;
+
+	while ((config = TAILQ_FIRST(&g_kv_compress_configs))) {
+		TAILQ_REMOVE(&g_kv_compress_configs, config, link);
+		kv_compress_config_free(config);
+	}
+}
+
+static int
+vbdev_kv_compress_get_ctx_size(void)
+{
+	return sizeof(struct kv_compress_bdev_io);
+}
+
+static void
+vbdev_kv_compress_examine(struct spdk_bdev *bdev)
+{
+	struct kv_compress_config *config;
+
+	TAILQ_FOREACH(config, &g_kv_compress_configs, link) {
+		if (strcmp(config->base_bdev_name, bdev->name) == 0) {
+			vbdev_kv_compress_register(config);
+		}
+	}
+
+	spdk_bdev_module_examine_done(&kv_compress_if);
+}
+
+SPDK_LOG_REGISTER_COMPONENT(vbdev_kv_compress)
@@ -0,0 +1,61 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+#ifndef SPDK_VBDEV_KV_COMPRESS_H
+#define SPDK_VBDEV_KV_COMPRESS_H
+
+#include "spdk/stdinc.h"
+
+#include "spdk/bdev.h"
+#include "spdk/bdev_module.h"
+
+struct vbdev_kv_compress_opts {
+	const char *name;
+	const char *base_bdev_name;
+	/* Values shorter than this are stored as they are. 0 selects the default. */
+	uint32_t min_size;
+};
+
+struct vbdev_kv_compress_stats {
+	/* Values stored compressed, and stored as they are. */
+	uint64_t stores_compressed;
+	uint64_t stores_raw;
+	/* Bytes handed to STORE, and bytes written to the base bdev for them. */
+	uint64_t bytes_in;
+	uint64_t bytes_out;
+	uint64_t retrieves_decompressed;
+	/* SELECTs on compressed values, evaluated on the host. */
+	uint64_t host_selects;
+};
+
+/**
+ * Create a KV compression bdev on top of a KV capable bdev. If the base bdev
+ * does not exist yet, it is created once it shows up.
+ *
+ * \param opts Creation options.
+ *
+ * \return 0 on success, negated errno otherwise.
+ */
+int bdev_kv_compress_create(const struct vbdev_kv_compress_opts *opts);
+
+/**
+ * Delete a KV compression bdev.
+ *
+ * \param name Name of the compression bdev.
+ * \param cb_fn Function to call after deletion.
+ * \param cb_arg Argument to pass to cb_fn.
+ */
+void bdev_kv_compress_delete(const char *name, spdk_bdev_unregister_cb cb_fn, void *cb_arg);
+
+/**
+ * Get the counters of a KV compression bdev.
+ *
+ * \param name Name of the compression bdev.
+ * \param stats Filled in with the counters.
+ *
+ * \return 0 on success, -ENODEV if there is no such bdev.
+ */
+int bdev_kv_compress_get_stats(const char *name, struct vbdev_kv_compress_stats *stats);
+
+#endif /* SPDK_VBDEV_KV_COMPRESS_H */
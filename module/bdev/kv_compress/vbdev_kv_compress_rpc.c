@@ -0,0 +1,155 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+#include "spdk/rpc.h"
+#include "spdk/util.h"
+#include "spdk/string.h"
+#include "spdk/bdev_module.h"
+#include "spdk/log.h"
+
+#include "vbdev_kv_compress.h"
+
+struct rpc_bdev_kv_compress_create {
+	char *name;
+	char *base_bdev_name;
+	uint32_t min_size;
+};
+
+static void
+free_rpc_bdev_kv_compress_create(struct rpc_bdev_kv_compress_create *req)
+{
+	free(req->name);
+	free(req->base_bdev_name);
+}
+
+static const struct spdk_json_object_decoder rpc_bdev_kv_compress_create_decoders[] = {
+	{"name", offsetof(struct rpc_bdev_kv_compress_create, name), spdk_json_decode_string},
+	{"base_bdev_name", offsetof(struct rpc_bdev_kv_compress_create, base_bdev_name), spdk_json_decode_string},
+	{"min_size", offsetof(struct rpc_bdev_kv_compress_create, min_size), spdk_json_decode_uint32, true},
+};
+
+static void
+rpc_bdev_kv_compress_create(struct spdk_jsonrpc_request *request,
+			    const struct spdk_json_val *params)
+{
+	struct rpc_bdev_kv_compress_create req = {};
+	struct vbdev_kv_compress_opts opts = {};
+	struct spdk_json_write_ctx *w;
+	int rc;
+
+	if (spdk_json_decode_object(params, rpc_bdev_kv_compress_create_decoders,
+				    SPDK_COUNTOF(rpc_bdev_kv_compress_create_decoders),
+				    &req)) {
+		SPDK_DEBUGLOG(vbdev_kv_compress, "spdk_json_decode_object failed\n");
+		spdk_jsonrpc_send_error_response(request, SPDK_JSONRPC_ERROR_INTERNAL_ERROR,
+						 "spdk_json_decode_object failed");
+		goto cleanup;
+	}
+
+	opts.name = req.name;
+	opts.base_bdev_name = req.base_bdev_name;
+	opts.min_size = req.min_size;
+	rc = bdev_kv_compress_create(&opts);
+	if (rc != 0) {
+		spdk_jsonrpc_send_error_response(request, rc, spdk_strerror(-rc));
+		goto cleanup;
+	}
+
+	w = spdk_jsonrpc_begin_result(request);
+	spdk_json_write_string(w, req.name);
+	spdk_jsonrpc_end_result(request, w);
+
+cleanup:
+	free_rpc_bdev_kv_compress_create(&req);
+}
+SPDK_RPC_REGISTER("bdev_kv_compress_create", rpc_bdev_kv_compress_create, SPDK_RPC_RUNTIME)
+
+struct rpc_bdev_kv_compress_name {
+	char *name;
+};
+
+static void
+free_rpc_bdev_kv_compress_name(struct rpc_bdev_kv_compress_name *req)
+{
+	free(req->name);
+}
+
+static const struct spdk_json_object_decoder rpc_bdev_kv_compress_name_decoders[] = {
+	{"name", offsetof(struct rpc_bdev_kv_compress_name, name), spdk_json_decode_string},
+};
+
+static void
+rpc_bdev_kv_compress_delete_cb(void *cb_arg, int bdeverrno)
+{
+	struct spdk_jsonrpc_request *request = cb_arg;
+
+	if (bdeverrno == 0) {
+		spdk_jsonrpc_send_bool_response(request, true);
+	} else {
+		spdk_jsonrpc_send_error_response(request, bdeverrno, spdk_strerror(-bdeverrno));
+	}
+}
+
+static void
+rpc_bdev_kv_compress_delete(struct spdk_jsonrpc_request *request,
+			    const struct spdk_json_val *params)
+{
+	struct rpc_bdev_kv_compress_name req = {NULL};
+
+	if (spdk_json_decode_object(params, rpc_bdev_kv_compress_name_decoders,
+				    SPDK_COUNTOF(rpc_bdev_kv_compress_name_decoders),
+				    &req)) {
+		spdk_jsonrpc_send_error_response(request, SPDK_JSONRPC_ERROR_INTERNAL_ERROR,
+						 "spdk_json_decode_object failed");
+		goto cleanup;
+	}
+
+	bdev_kv_compress_delete(req.name, rpc_bdev_kv_compress_delete_cb, request);
+
+cleanup:
+	free_rpc_bdev_kv_compress_name(&req);
+}
+SPDK_RPC_REGISTER("bdev_kv_compress_delete", rpc_bdev_kv_compress_delete, SPDK_RPC_RUNTIME)
+
+static void
+rpc_bdev_kv_compress_get_stats(struct spdk_jsonrpc_request *request,
+			       const struct spdk_json_val *params)
+{
+	struct rpc_bdev_kv_compress_name req = {NULL};
+	struct vbdev_kv_compress_stats stats;
+	struct spdk_json_write_ctx *w;
+	int rc;
+
+	if (spdk_json_decode_object(params, rpc_bdev_kv_compress_name_decoders,
+				    SPDK_COUNTOF(rpc_bdev_kv_compress_name_decoders),
+				    &req)) {
+		spdk_jsonrpc_send_error_response(request, SPDK_JSONRPC_ERROR_INTERNAL_ERROR,
+						 "spdk_json_decode_object failed");
+		goto cleanup;
+	}
+
+	rc = bdev_kv_compress_get_stats(req.name, &stats);
+	if (rc != 0) {
+		spdk_jsonrpc_send_error_response(request, rc, spdk_strerror(-rc));
+		goto cleanup;
+	}
+
+	w = spdk_jsonrpc_begin_result(request);
+	spdk_json_write_object_begin(w);
+	spdk_json_write_named_string(w, "name", req.name);
+	spdk_json_write_named_uint64(w, "stores_compressed", stats.stores_compressed);
+	spdk_json_write_named_uint64(w, "stores_raw", stats.stores_raw);
+	spdk_json_write_named_uint64(w, "bytes_in", stats.bytes_in);
+	spdk_json_write_named_uint64(w, "bytes_out", stats.bytes_out);
+	spdk_json_write_named_double(w, "ratio",
+				     stats.bytes_out ? (double)stats.bytes_in / stats.bytes_out : 0.0);
+	spdk_json_write_named_uint64(w, "retrieves_decompressed", stats.retrieves_decompressed);
+	spdk_json_write_named_uint64(w, "host_selects", stats.host_selects);
+	spdk_json_write_object_end(w);
+	spdk_jsonrpc_end_result(request, w);
+
+cleanup:
+	free_rpc_bdev_kv_compress_name(&req);
+}
+SPDK_RPC_REGISTER("bdev_kv_compress_get_stats", rpc_bdev_kv_compress_get_stats, SPDK_RPC_RUNTIME)
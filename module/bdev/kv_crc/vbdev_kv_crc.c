@@ -0,0 +1,1049 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+/*
+ * KV value integrity. Sits on top of a KV capable bdev and protects every value
+ * with a CRC-32C kept in a 4 byte little endian trailer behind it. Protection
+ * information does not cover KV values, so without it corruption anywhere
+ * between the host buffer and the media goes unnoticed.
+ *
+ * STORE copies the value into a DMA buffer with ACCEL_OPC_COPY_CRC32C, so the
+ * checksum is computed by the same pass that builds the buffer, in hardware when
+ * an accel module offers it, and appends the trailer.
+ *
+ * RETRIEVE from offset 0 reads straight into the caller's buffers, with one more
+ * iovec for the trailer in case the value fills them, and checks the CRC over
+ * those buffers. Values that do not fit, and reads at other offsets, are read
+ * whole into a bounce buffer, checked there and the requested range copied out.
+ * A mismatch completes with the NVMe End-to-end Guard Check Error status. cdw0
+ * reports the length without the trailer.
+ *
+ * The device would take the trailer for part of the value, so SELECT is always
+ * evaluated on the host, on the checked value, with spdk_kv_select_eval().
+ * Host results are kept here under select ids with KV_CRC_SELECT_ID_HOST set.
+ *
+ * APPEND would leave the old trailer inside the value and is rejected. Batched
+ * commands are not supported, as they would bypass the trailer.
+ */
+
+#include "spdk/stdinc.h"
+
+#include "vbdev_kv_crc.h"
+#include "spdk/accel.h"
+#include "spdk/endian.h"
+#include "spdk/env.h"
+#include "spdk/likely.h"
+#include "spdk/string.h"
+#include "spdk/thread.h"
+#include "spdk/util.h"
+
+#include "spdk/log.h"
+
+#include "spdk_internal/kv_select.h"
+
+#define KV_CRC_TRAILER_SIZE		4
+/* Client iovecs a RETRIEVE may have to be read straight into them. */
+#define KV_CRC_MAX_IOVS			32
+/* First guess at the length of a value read for SELECT. */
+#define KV_CRC_SELECT_FETCH_SIZE	(64 * 1024)
+#define KV_CRC_MAX_SELECTS		64
+/* Marks the ids of SELECT results evaluated on the host. */
+#define KV_CRC_SELECT_ID_HOST		0x40000000U
+
+static int vbdev_kv_crc_init(void);
+static int vbdev_kv_crc_get_ctx_size(void);
+static void vbdev_kv_crc_examine(struct spdk_bdev *bdev);
+static void vbdev_kv_crc_finish(void);
+static int vbdev_kv_crc_config_json(struct spdk_json_write_ctx *w);
+
+static struct spdk_bdev_module kv_crc_if = {
+	.name = "kv_crc",
+	.module_init = vbdev_kv_crc_init,
+	.get_ctx_size = vbdev_kv_crc_get_ctx_size,
+	.examine_config = vbdev_kv_crc_examine,
+	.module_fini = vbdev_kv_crc_finish,
+	.config_json = vbdev_kv_crc_config_json
+};
+
+SPDK_BDEV_MODULE_REGISTER(kv_crc, &kv_crc_if)
+
+/* Bdevs requested over RPC, kept so they can be created when their base bdev appears. */
+struct kv_crc_config {
+	char				*name;
+	char				*base_bdev_name;
+	TAILQ_ENTRY(kv_crc_config)	link;
+};
+static TAILQ_HEAD(, kv_crc_config) g_kv_crc_configs = TAILQ_HEAD_INITIALIZER(g_kv_crc_configs);
+
+struct vbdev_kv_crc {
+	struct spdk_bdev		bdev;
+	struct spdk_bdev		*base_bdev;
+	struct spdk_bdev_desc		*base_desc;
+	struct spdk_thread		*thread;
+	pthread_spinlock_t		lock;
+	struct spdk_kv_select_results selects;
+	struct vbdev_kv_crc_stats	stats;
+	TAILQ_ENTRY(vbdev_kv_crc)	link;
+};
+static TAILQ_HEAD(, vbdev_kv_crc) g_kv_crc_nodes = TAILQ_HEAD_INITIALIZER(g_kv_crc_nodes);
+
+struct kv_crc_io_channel {
+	struct spdk_io_channel	*base_ch;
+	struct spdk_io_channel	*accel_ch;
+};
+
+typedef int (*kv_crc_submit_fn)(struct spdk_bdev_io *bdev_io);
+
+struct kv_crc_bdev_io {
+	struct spdk_io_channel		*ch;
+	/* Bounce buffer, NULL when reading straight into the caller's buffers. */
+	uint8_t				*buf;
+	uint32_t			buf_len;
+	uint32_t			value_len;
+	uint32_t			crc;
+	uint8_t				trailer[KV_CRC_TRAILER_SIZE];
+	struct iovec			iovs[KV_CRC_MAX_IOVS + 1];
+	int				iovcnt;
+	/* Child submission to retry once the base bdev has a bdev_io to spare. */
+	kv_crc_submit_fn		submit_fn;
+	struct spdk_bdev_io_wait_entry	bdev_io_wait;
+};
+
+#define KV_CRC_STAT_ADD(crc, field, val) \
+	__atomic_fetch_add(&(crc)->stats.field, (val), __ATOMIC_RELAXED)
+
+static inline struct vbdev_kv_crc *
+kv_crc_from_io(struct spdk_bdev_io *bdev_io)
+{
+	return SPDK_CONTAINEROF(bdev_io->bdev, struct vbdev_kv_crc, bdev);
+}
+
+static inline struct kv_crc_io_channel *
+kv_crc_io_ch(struct spdk_bdev_io *bdev_io)
+{
+	struct kv_crc_bdev_io *io_ctx = (struct kv_crc_bdev_io *)bdev_io->driver_ctx;
+
+	return spdk_io_channel_get_ctx(io_ctx->ch);
+}
+
+/* Copy len bytes at offset of an iovec array to buf. Returns the number of bytes copied. */
+static size_t
+kv_crc_iovs_read(struct iovec *iovs, int iovcnt, uint64_t offset, void *buf, size_t len)
+{
+	uint8_t *dst = buf;
+	size_t n, copied = 0;
+	int i;
+
+	for (i = 0; i < iovcnt && len > 0; i++) {
+		if (offset >= iovs[i].iov_len) {
+			offset -= iovs[i].iov_len;
+			continue;
+		}
+		n = spdk_min(len, iovs[i].iov_len - offset);
+		memcpy(dst, (uint8_t *)iovs[i].iov_base + offset, n);
+		dst += n;
+		len -= n;
+		copied += n;
+		offset = 0;
+	}
+	return copied;
+}
+
+/* Cut an iovec array down to its first len bytes. Returns the new count. */
+static int
+kv_crc_iovs_trim(struct iovec *iovs, int iovcnt, uint64_t len)
+{
+	int i;
+
+	for (i = 0; i < iovcnt && len > 0; i++) {
+		if (iovs[i].iov_len >= len) {
+			iovs[i].iov_len = len;
+			return i + 1;
+		}
+		len -= iovs[i].iov_len;
+	}
+	return i;
+}
+
+/* Completion */
+
+static void
+kv_crc_complete(struct spdk_bdev_io *bdev_io, enum spdk_bdev_io_status status)
+{
+	struct kv_crc_bdev_io *io_ctx = (struct kv_crc_bdev_io *)bdev_io->driver_ctx;
+
+	spdk_dma_free(io_ctx->buf);
+	io_ctx->buf = NULL;
+	spdk_bdev_io_complete(bdev_io, status);
+}
+
+static void
+kv_crc_complete_nvme(struct spdk_bdev_io *bdev_io, uint32_t cdw0, int sct, int sc)
+{
+	struct kv_crc_bdev_io *io_ctx = (struct kv_crc_bdev_io *)bdev_io->driver_ctx;
+
+	spdk_dma_free(io_ctx->buf);
+	io_ctx->buf = NULL;
+	spdk_bdev_io_complete_nvme_status(bdev_io, cdw0, sct, sc);
+}
+
+static void
+kv_crc_complete_from(struct spdk_bdev_io *orig_io, struct spdk_bdev_io *bdev_io)
+{
+	struct kv_crc_bdev_io *io_ctx = (struct kv_crc_bdev_io *)orig_io->driver_ctx;
+
+	spdk_dma_free(io_ctx->buf);
+	io_ctx->buf = NULL;
+	spdk_bdev_kv_io_complete_from(orig_io, bdev_io);
+	spdk_bdev_free_io(bdev_io);
+}
+
+static void
+kv_crc_complete_corrupt(struct spdk_bdev_io *bdev_io, const char *reason)
+{
+	struct vbdev_kv_crc *crc = kv_crc_from_io(bdev_io);
+
+	SPDK_ERRLOG("%s: value of key %.*s %s\n", crc->bdev.name,
+		    (int)bdev_io->u.bdev.nvme_kv.key_length, bdev_io->u.bdev.nvme_kv.key, reason);
+	KV_CRC_STAT_ADD(crc, crc_errors, 1);
+	kv_crc_complete_nvme(bdev_io, 0, SPDK_NVME_SCT_MEDIA_ERROR, SPDK_NVME_SC_GUARD_CHECK_ERROR);
+}
+
+static void kv_crc_submit(struct spdk_bdev_io *bdev_io, kv_crc_submit_fn fn);
+
+static void
+kv_crc_resubmit_io(void *arg)
+{
+	struct spdk_bdev_io *bdev_io = (struct spdk_bdev_io *)arg;
+	struct kv_crc_bdev_io *io_ctx = (struct kv_crc_bdev_io *)bdev_io->driver_ctx;
+
+	kv_crc_submit(bdev_io, io_ctx->submit_fn);
+}
+
+/* Submit a child I/O to the base bdev, waiting for a bdev_io if there is none. */
+static void
+kv_crc_submit(struct spdk_bdev_io *bdev_io, kv_crc_submit_fn fn)
+{
+	struct kv_crc_bdev_io *io_ctx = (struct kv_crc_bdev_io *)bdev_io->driver_ctx;
+	int rc;
+
+	rc = fn(bdev_io);
+	if (rc == 0) {
+		return;
+	}
+
+	if (rc == -ENOMEM) {
+		io_ctx->submit_fn = fn;
+		io_ctx->bdev_io_wait.bdev = bdev_io->bdev;
+		io_ctx->bdev_io_wait.cb_fn = kv_crc_resubmit_io;
+		io_ctx->bdev_io_wait.cb_arg = bdev_io;
+
+		rc = spdk_bdev_queue_io_wait(bdev_io->bdev, kv_crc_io_ch(bdev_io)->base_ch,
+					     &io_ctx->bdev_io_wait);
+		if (rc == 0) {
+			return;
+		}
+		SPDK_ERRLOG("Queue io failed in kv_crc_submit, rc=%d.\n", rc);
+	} else {
+		SPDK_ERRLOG("ERROR on bdev_io submission!\n");
+	}
+	kv_crc_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+}
+
+static void
+kv_crc_forward_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	kv_crc_complete_from(cb_arg, bdev_io);
+}
+
+static int
+kv_crc_forward(struct spdk_bdev_io *bdev_io)
+{
+	struct vbdev_kv_crc *crc = kv_crc_from_io(bdev_io);
+
+	return spdk_bdev_kv_io_forward(crc->base_desc, kv_crc_io_ch(bdev_io)->base_ch, bdev_io,
+				       kv_crc_forward_done, bdev_io);
+}
+
+/* STORE */
+
+static void
+kv_crc_store_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct spdk_bdev_io *orig_io = cb_arg;
+
+	if (success) {
+		KV_CRC_STAT_ADD(kv_crc_from_io(orig_io), stores, 1);
+	}
+	kv_crc_complete_from(orig_io, bdev_io);
+}
+
+static int
+kv_crc_store_buf(struct spdk_bdev_io *bdev_io)
+{
+	struct vbdev_kv_crc *crc = kv_crc_from_io(bdev_io);
+	struct kv_crc_bdev_io *io_ctx = (struct kv_crc_bdev_io *)bdev_io->driver_ctx;
+
+	return spdk_bdev_kv_store(crc->base_desc, kv_crc_io_ch(bdev_io)->base_ch,
+				  bdev_io->u.bdev.nvme_kv.key, bdev_io->u.bdev.nvme_kv.key_length,
+				  io_ctx->buf, io_ctx->buf_len, bdev_io->u.bdev.nvme_kv.options,
+				  kv_crc_store_done, bdev_io);
+}
+
+static void
+kv_crc_store_crc_done(void *cb_arg, int status)
+{
+	struct spdk_bdev_io *bdev_io = cb_arg;
+	struct kv_crc_bdev_io *io_ctx = (struct kv_crc_bdev_io *)bdev_io->driver_ctx;
+
+	if (status != 0) {
+		SPDK_ERRLOG("CRC-32C calculation failed (%d)\n", status);
+		kv_crc_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		return;
+	}
+
+	to_le32(io_ctx->buf + io_ctx->value_len, ~io_ctx->crc);
+	kv_crc_submit(bdev_io, kv_crc_store_buf);
+}
+
+static void
+kv_crc_store(struct spdk_bdev_io *bdev_io)
+{
+	struct vbdev_kv_crc *crc = kv_crc_from_io(bdev_io);
+	struct kv_crc_bdev_io *io_ctx = (struct kv_crc_bdev_io *)bdev_io->driver_ctx;
+	uint64_t len = bdev_io->u.bdev.nvme_kv.buffer_size;
+	int rc;
+
+	if (bdev_io->u.bdev.nvme_kv.options & NVME_KV_STORE_CMD_OPTION_APPEND) {
+		SPDK_ERRLOG("%s: APPEND is not supported on checksummed values\n", crc->bdev.name);
+		kv_crc_complete_nvme(bdev_io, 0, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_INVALID_FIELD);
+		return;
+	}
+
+	if (len > UINT32_MAX - KV_CRC_TRAILER_SIZE) {
+		kv_crc_complete_nvme(bdev_io, 0, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_INVALID_FIELD);
+		return;
+	}
+
+	io_ctx->value_len = len;
+	io_ctx->buf_len = len + KV_CRC_TRAILER_SIZE;
+	io_ctx->buf = spdk_dma_malloc(io_ctx->buf_len, 0, NULL);
+	if (io_ctx->buf == NULL) {
+		kv_crc_complete(bdev_io, SPDK_BDEV_IO_STATUS_NOMEM);
+		return;
+	}
+
+	if (len == 0) {
+		io_ctx->crc = ~0U;
+		kv_crc_store_crc_done(bdev_io, 0);
+		return;
+	}
+
+	/* Build the buffer and checksum it in one pass. */
+	rc = spdk_accel_submit_copy_crc32cv(kv_crc_io_ch(bdev_io)->accel_ch, io_ctx->buf,
+					    bdev_io->u.bdev.iovs, bdev_io->u.bdev.iovcnt,
+					    &io_ctx->crc, 0, 0, kv_crc_store_crc_done, bdev_io);
+	if (rc != 0) {
+		kv_crc_store_crc_done(bdev_io, rc);
+	}
+}
+
+/* RETRIEVE and SEND_SELECT */
+
+static void kv_crc_host_select(struct spdk_bdev_io *bdev_io);
+
+static void
+kv_crc_verify_done(void *cb_arg, int status)
+{
+	struct spdk_bdev_io *bdev_io = cb_arg;
+	struct vbdev_kv_crc *crc = kv_crc_from_io(bdev_io);
+	struct kv_crc_bdev_io *io_ctx = (struct kv_crc_bdev_io *)bdev_io->driver_ctx;
+	uint64_t offset = bdev_io->u.bdev.nvme_kv.offset;
+
+	if (status != 0) {
+		SPDK_ERRLOG("CRC-32C calculation failed (%d)\n", status);
+		kv_crc_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		return;
+	}
+
+	if (~io_ctx->crc != from_le32(io_ctx->trailer)) {
+		kv_crc_complete_corrupt(bdev_io, "failed the CRC-32C check");
+		return;
+	}
+	KV_CRC_STAT_ADD(crc, verified, 1);
+
+	if (bdev_io->type == SPDK_BDEV_IO_KV_SEND_SELECT) {
+		kv_crc_host_select(bdev_io);
+		return;
+	}
+
+	if (io_ctx->buf != NULL) {
+		if (offset > io_ctx->value_len) {
+			kv_crc_complete_nvme(bdev_io, 0, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_INVALID_FIELD);
+			return;
+		}
+		spdk_copy_buf_to_iovs(bdev_io->u.bdev.iovs, bdev_io->u.bdev.iovcnt, io_ctx->buf + offset,
+				      spdk_min(bdev_io->u.bdev.nvme_kv.buffer_size, io_ctx->value_len - offset));
+	}
+	kv_crc_complete_nvme(bdev_io, io_ctx->value_len, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_SUCCESS);
+}
+
+/* Checksum the value described by iovs, whose trailer is in io_ctx->trailer. */
+static void
+kv_crc_verify(struct spdk_bdev_io *bdev_io)
+{
+	struct kv_crc_bdev_io *io_ctx = (struct kv_crc_bdev_io *)bdev_io->driver_ctx;
+	int rc;
+
+	if (io_ctx->value_len == 0) {
+		io_ctx->crc = ~0U;
+		kv_crc_verify_done(bdev_io, 0);
+		return;
+	}
+
+	rc = spdk_accel_submit_crc32cv(kv_crc_io_ch(bdev_io)->accel_ch, &io_ctx->crc, io_ctx->iovs,
+				       io_ctx->iovcnt, 0, kv_crc_verify_done, bdev_io);
+	if (rc != 0) {
+		kv_crc_verify_done(bdev_io, rc);
+	}
+}
+
+static void kv_crc_fetch(struct spdk_bdev_io *bdev_io, uint64_t len);
+
+static void
+kv_crc_fetch_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct spdk_bdev_io *orig_io = cb_arg;
+	struct kv_crc_bdev_io *io_ctx = (struct kv_crc_bdev_io *)orig_io->driver_ctx;
+	uint32_t stored_len;
+	int sct, sc;
+
+	if (!success) {
+		kv_crc_complete_from(orig_io, bdev_io);
+		return;
+	}
+
+	spdk_bdev_io_get_nvme_status(bdev_io, &stored_len, &sct, &sc);
+	spdk_bdev_free_io(bdev_io);
+	if (stored_len < KV_CRC_TRAILER_SIZE) {
+		kv_crc_complete_corrupt(orig_io, "has no CRC-32C trailer");
+		return;
+	}
+	if (stored_len > io_ctx->buf_len) {
+		/* Longer than guessed, or grown since: read it again, whole. */
+		kv_crc_fetch(orig_io, stored_len);
+		return;
+	}
+
+	io_ctx->value_len = stored_len - KV_CRC_TRAILER_SIZE;
+	memcpy(io_ctx->trailer, io_ctx->buf + io_ctx->value_len, KV_CRC_TRAILER_SIZE);
+	io_ctx->iovs[0].iov_base = io_ctx->buf;
+	io_ctx->iovs[0].iov_len = io_ctx->value_len;
+	io_ctx->iovcnt = 1;
+	kv_crc_verify(orig_io);
+}
+
+static int
+kv_crc_read_value(struct spdk_bdev_io *bdev_io)
+{
+	struct vbdev_kv_crc *crc = kv_crc_from_io(bdev_io);
+	struct kv_crc_bdev_io *io_ctx = (struct kv_crc_bdev_io *)bdev_io->driver_ctx;
+
+	return spdk_bdev_kv_retrieve(crc->base_desc, kv_crc_io_ch(bdev_io)->base_ch,
+				     bdev_io->u.bdev.nvme_kv.key, bdev_io->u.bdev.nvme_kv.key_length,
+				     io_ctx->buf, 0, io_ctx->buf_len, kv_crc_fetch_done, bdev_io);
+}
+
+/* Read up to len bytes of the stored value into a bounce buffer. */
+static void
+kv_crc_fetch(struct spdk_bdev_io *bdev_io, uint64_t len)
+{
+	struct kv_crc_bdev_io *io_ctx = (struct kv_crc_bdev_io *)bdev_io->driver_ctx;
+
+	spdk_dma_free(io_ctx->buf);
+	io_ctx->buf_len = spdk_min(len, UINT32_MAX - 1);
+	/* One byte of room past the value for the SELECT evaluator. */
+	io_ctx->buf = spdk_dma_malloc((uint64_t)io_ctx->buf_len + 1, 0, NULL);
+	if (io_ctx->buf == NULL) {
+		kv_crc_complete(bdev_io, SPDK_BDEV_IO_STATUS_NOMEM);
+		return;
+	}
+
+	kv_crc_submit(bdev_io, kv_crc_read_value);
+}
+
+static void
+kv_crc_retrieve_direct_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct spdk_bdev_io *orig_io = cb_arg;
+	struct kv_crc_bdev_io *io_ctx = (struct kv_crc_bdev_io *)orig_io->driver_ctx;
+	uint8_t trailer[KV_CRC_TRAILER_SIZE];
+	uint32_t stored_len;
+	int sct, sc;
+
+	if (!success) {
+		kv_crc_complete_from(orig_io, bdev_io);
+		return;
+	}
+
+	spdk_bdev_io_get_nvme_status(bdev_io, &stored_len, &sct, &sc);
+	spdk_bdev_free_io(bdev_io);
+	if (stored_len < KV_CRC_TRAILER_SIZE) {
+		kv_crc_complete_corrupt(orig_io, "has no CRC-32C trailer");
+		return;
+	}
+	if (stored_len > orig_io->u.bdev.nvme_kv.buffer_size + KV_CRC_TRAILER_SIZE) {
+		/* Only part of the value was read; it can only be checked whole. */
+		kv_crc_fetch(orig_io, stored_len);
+		return;
+	}
+
+	/*
+	 * The trailer is right behind the value, in the caller's buffers or the extra
+	 * iovec. The latter is io_ctx->trailer itself, so gather it elsewhere first.
+	 */
+	io_ctx->value_len = stored_len - KV_CRC_TRAILER_SIZE;
+	if (kv_crc_iovs_read(io_ctx->iovs, io_ctx->iovcnt, io_ctx->value_len, trailer,
+			     sizeof(trailer)) != sizeof(trailer)) {
+		/* The caller's buffers are shorter than buffer_size. */
+		SPDK_ERRLOG("%s: CRC-32C trailer of key %.*s is outside the read buffers\n",
+			    kv_crc_from_io(orig_io)->bdev.name,
+			    (int)orig_io->u.bdev.nvme_kv.key_length, orig_io->u.bdev.nvme_kv.key);
+		kv_crc_complete(orig_io, SPDK_BDEV_IO_STATUS_FAILED);
+		return;
+	}
+	memcpy(io_ctx->trailer, trailer, sizeof(trailer));
+	io_ctx->iovcnt = kv_crc_iovs_trim(io_ctx->iovs, io_ctx->iovcnt, io_ctx->value_len);
+	kv_crc_verify(orig_io);
+}
+
+static int
+kv_crc_retrieve_direct(struct spdk_bdev_io *bdev_io)
+{
+	struct vbdev_kv_crc *crc = kv_crc_from_io(bdev_io);
+	struct kv_crc_bdev_io *io_ctx = (struct kv_crc_bdev_io *)bdev_io->driver_ctx;
+
+	return spdk_bdev_kv_retrievev(crc->base_desc, kv_crc_io_ch(bdev_io)->base_ch,
+				      bdev_io->u.bdev.nvme_kv.key, bdev_io->u.bdev.nvme_kv.key_length,
+				      io_ctx->iovs, io_ctx->iovcnt, 0,
+				      bdev_io->u.bdev.nvme_kv.buffer_size + KV_CRC_TRAILER_SIZE,
+				      kv_crc_retrieve_direct_done, bdev_io);
+}
+
+static void
+kv_crc_retrieve(struct spdk_bdev_io *bdev_io)
+{
+	struct kv_crc_bdev_io *io_ctx = (struct kv_crc_bdev_io *)bdev_io->driver_ctx;
+	int iovcnt = bdev_io->u.bdev.iovcnt;
+
+	if (bdev_io->u.bdev.nvme_kv.offset != 0 || iovcnt > KV_CRC_MAX_IOVS) {
+		kv_crc_fetch(bdev_io, bdev_io->u.bdev.nvme_kv.offset +
+			     bdev_io->u.bdev.nvme_kv.buffer_size + KV_CRC_TRAILER_SIZE);
+		return;
+	}
+
+	memcpy(io_ctx->iovs, bdev_io->u.bdev.iovs, iovcnt * sizeof(struct iovec));
+	io_ctx->iovs[iovcnt].iov_base = io_ctx->trailer;
+	io_ctx->iovs[iovcnt].iov_len = KV_CRC_TRAILER_SIZE;
+	io_ctx->iovcnt = iovcnt + 1;
+	kv_crc_submit(bdev_io, kv_crc_retrieve_direct);
+}
+
+/* Host SELECT */
+
+static void
+kv_crc_host_select(struct spdk_bdev_io *bdev_io)
+{
+	struct vbdev_kv_crc *crc = kv_crc_from_io(bdev_io);
+	struct kv_crc_bdev_io *io_ctx = (struct kv_crc_bdev_io *)bdev_io->driver_ctx;
+	char *query, *result;
+	size_t query_len = bdev_io->u.bdev.nvme_kv.buffer_size;
+	size_t result_len;
+	uint32_t id;
+	int rc;
+
+	query = malloc(query_len);
+	if (query == NULL) {
+		kv_crc_complete(bdev_io, SPDK_BDEV_IO_STATUS_NOMEM);
+		return;
+	}
+	spdk_copy_iovs_to_buf(query, query_len, bdev_io->u.bdev.iovs, bdev_io->u.bdev.iovcnt);
+	if (bdev_io->u.bdev.iovcnt == 1) {
+		/* The contiguous API takes a NUL terminated query. */
+		query_len = strnlen(query, query_len);
+	}
+
+	rc = spdk_kv_select_eval((char *)io_ctx->buf, io_ctx->value_len, query, query_len,
+				 bdev_io->u.bdev.nvme_kv.select_input_type,
+				 bdev_io->u.bdev.nvme_kv.select_output_type,
+				 bdev_io->u.bdev.nvme_kv.options, &result, &result_len);
+	free(query);
+	if (rc != 0) {
+		SPDK_DEBUGLOG(vbdev_kv_crc, "host select failed: %s\n", spdk_strerror(-rc));
+		kv_crc_complete_nvme(bdev_io, 0, SPDK_NVME_SCT_GENERIC,
+				     rc == -ENOMEM ? SPDK_NVME_SC_INTERNAL_DEVICE_ERROR : SPDK_NVME_SC_INVALID_FIELD);
+		return;
+	}
+
+	pthread_spin_lock(&crc->lock);
+	rc = spdk_kv_select_results_add(&crc->selects, result, result_len, &id);
+	pthread_spin_unlock(&crc->lock);
+	if (rc != 0) {
+		kv_crc_complete(bdev_io, SPDK_BDEV_IO_STATUS_NOMEM);
+		return;
+	}
+
+	KV_CRC_STAT_ADD(crc, host_selects, 1);
+	kv_crc_complete_nvme(bdev_io, id, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_SUCCESS);
+}
+
+static void
+kv_crc_host_retrieve_select(struct spdk_bdev_io *bdev_io)
+{
+	struct vbdev_kv_crc *crc = kv_crc_from_io(bdev_io);
+	uint32_t result_len;
+	int rc;
+
+	pthread_spin_lock(&crc->lock);
+	rc = spdk_kv_select_results_read(&crc->selects, bdev_io->u.bdev.nvme_kv.select_id,
+					 bdev_io->u.bdev.nvme_kv.offset,
+					 bdev_io->u.bdev.nvme_kv.options,
+					 bdev_io->u.bdev.iovs, bdev_io->u.bdev.iovcnt,
+					 bdev_io->u.bdev.nvme_kv.buffer_size, &result_len);
+	pthread_spin_unlock(&crc->lock);
+	if (rc != 0) {
+		kv_crc_complete_nvme(bdev_io, 0, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_INVALID_FIELD);
+		return;
+	}
+
+	kv_crc_complete_nvme(bdev_io, result_len, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_SUCCESS);
+}
+
+/* I/O path */
+
+static void
+vbdev_kv_crc_submit_request(struct spdk_io_channel *ch, struct spdk_bdev_io *bdev_io)
+{
+	struct kv_crc_bdev_io *io_ctx = (struct kv_crc_bdev_io *)bdev_io->driver_ctx;
+
+	io_ctx->ch = ch;
+	io_ctx->buf = NULL;
+
+	switch (bdev_io->type) {
+	case SPDK_BDEV_IO_KV_STORE:
+		kv_crc_store(bdev_io);
+		break;
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+		kv_crc_retrieve(bdev_io);
+		break;
+	case SPDK_BDEV_IO_KV_SEND_SELECT:
+		kv_crc_fetch(bdev_io, KV_CRC_SELECT_FETCH_SIZE);
+		break;
+	case SPDK_BDEV_IO_KV_RETRIEVE_SELECT:
+		if (bdev_io->u.bdev.nvme_kv.select_id & KV_CRC_SELECT_ID_HOST) {
+			kv_crc_host_retrieve_select(bdev_io);
+		} else {
+			kv_crc_submit(bdev_io, kv_crc_forward);
+		}
+		break;
+	case SPDK_BDEV_IO_KV_LIST:
+	case SPDK_BDEV_IO_KV_DELETE:
+	case SPDK_BDEV_IO_KV_EXIST:
+		kv_crc_submit(bdev_io, kv_crc_forward);
+		break;
+	default:
+		SPDK_ERRLOG("kv_crc: unsupported I/O type %d\n", bdev_io->type);
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		break;
+	}
+}
+
+static bool
+vbdev_kv_crc_io_type_supported(void *ctx, enum spdk_bdev_io_type io_type)
+{
+	struct vbdev_kv_crc *crc = ctx;
+
+	switch (io_type) {
+	case SPDK_BDEV_IO_KV_LIST:
+	case SPDK_BDEV_IO_KV_DELETE:
+	case SPDK_BDEV_IO_KV_EXIST:
+	case SPDK_BDEV_IO_KV_STORE:
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+		return spdk_bdev_io_type_supported(crc->base_bdev, io_type);
+	case SPDK_BDEV_IO_KV_SEND_SELECT:
+	case SPDK_BDEV_IO_KV_RETRIEVE_SELECT:
+		/* Evaluated on the host. */
+		return true;
+	default:
+		/* Block I/O and batches would bypass the trailer. */
+		return false;
+	}
+}
+
+static struct spdk_io_channel *
+vbdev_kv_crc_get_io_channel(void *ctx)
+{
+	return spdk_get_io_channel(ctx);
+}
+
+static void
+vbdev_kv_crc_write_params_json(struct vbdev_kv_crc *crc, struct spdk_json_write_ctx *w)
+{
+	spdk_json_write_named_string(w, "name", spdk_bdev_get_name(&crc->bdev));
+	spdk_json_write_named_string(w, "base_bdev_name", spdk_bdev_get_name(crc->base_bdev));
+}
+
+static int
+vbdev_kv_crc_dump_info_json(void *ctx, struct spdk_json_write_ctx *w)
+{
+	struct vbdev_kv_crc *crc = ctx;
+
+	spdk_json_write_name(w, "kv_crc");
+	spdk_json_write_object_begin(w);
+	vbdev_kv_crc_write_params_json(crc, w);
+	spdk_json_write_object_end(w);
+
+	return 0;
+}
+
+static int
+vbdev_kv_crc_config_json(struct spdk_json_write_ctx *w)
+{
+	struct vbdev_kv_crc *crc;
+
+	TAILQ_FOREACH(crc, &g_kv_crc_nodes, link) {
+		spdk_json_write_object_begin(w);
+		spdk_json_write_named_string(w, "method", "bdev_kv_crc_create");
+		spdk_json_write_named_object_begin(w, "params");
+		vbdev_kv_crc_write_params_json(crc, w);
+		spdk_json_write_object_end(w);
+		spdk_json_write_object_end(w);
+	}
+	return 0;
+}
+
+static void
+vbdev_kv_crc_write_config_json(struct spdk_bdev *bdev, struct spdk_json_write_ctx *w)
+{
+	/* No config per bdev needed */
+}
+
+static void
+kv_crc_free(struct vbdev_kv_crc *crc)
+{
+	spdk_kv_select_results_fini(&crc->selects);
+	pthread_spin_destroy(&crc->lock);
+	free(crc->bdev.name);
+	free(crc);
+}
+
+static void
+_device_unregister_cb(void *io_device)
+{
+	kv_crc_free(io_device);
+}
+
+static void
+_vbdev_kv_crc_destruct(void *ctx)
+{
+	struct spdk_bdev_desc *desc = ctx;
+
+	spdk_bdev_close(desc);
+}
+
+static int
+vbdev_kv_crc_destruct(void *ctx)
+{
+	struct vbdev_kv_crc *crc = ctx;
+
+	TAILQ_REMOVE(&g_kv_crc_nodes, crc, link);
+
+	spdk_bdev_module_release_bdev(crc->base_bdev);
+
+	/* Close the underlying bdev on its same opened thread. */
+	if (crc->thread && crc->thread != spdk_get_thread()) {
+		spdk_thread_send_msg(crc->thread, _vbdev_kv_crc_destruct, crc->base_desc);
+	} else {
+		spdk_bdev_close(crc->base_desc);
+	}
+
+	spdk_io_device_unregister(crc, _device_unregister_cb);
+
+	return 0;
+}
+
+static const struct spdk_bdev_fn_table vbdev_kv_crc_fn_table = {
+	.destruct		= vbdev_kv_crc_destruct,
+	.submit_request		= vbdev_kv_crc_submit_request,
+	.io_type_supported	= vbdev_kv_crc_io_type_supported,
+	.get_io_channel		= vbdev_kv_crc_get_io_channel,
+	.dump_info_json		= vbdev_kv_crc_dump_info_json,
+	.write_config_json	= vbdev_kv_crc_write_config_json,
+};
+
+static int
+kv_crc_ch_create_cb(void *io_device, void *ctx_buf)
+{
+	struct kv_crc_io_channel *crc_ch = ctx_buf;
+	struct vbdev_kv_crc *crc = io_device;
+
+	crc_ch->base_ch = spdk_bdev_get_io_channel(crc->base_desc);
+	if (crc_ch->base_ch == NULL) {
+		return -ENOMEM;
+	}
+
+	crc_ch->accel_ch = spdk_accel_get_io_channel();
+	if (crc_ch->accel_ch == NULL) {
+		spdk_put_io_channel(crc_ch->base_ch);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static void
+kv_crc_ch_destroy_cb(void *io_device, void *ctx_buf)
+{
+	struct kv_crc_io_channel *crc_ch = ctx_buf;
+
+	spdk_put_io_channel(crc_ch->accel_ch);
+	spdk_put_io_channel(crc_ch->base_ch);
+}
+
+static void
+vbdev_kv_crc_base_bdev_hotremove_cb(struct spdk_bdev *bdev_find)
+{
+	struct vbdev_kv_crc *crc, *tmp;
+
+	TAILQ_FOREACH_SAFE(crc, &g_kv_crc_nodes, link, tmp) {
+		if (bdev_find == crc->base_bdev) {
+			spdk_bdev_unregister(&crc->bdev, NULL, NULL);
+		}
+	}
+}
+
+static void
+vbdev_kv_crc_base_bdev_event_cb(enum spdk_bdev_event_type type, struct spdk_bdev *bdev,
+				void *event_ctx)
+{
+	switch (type) {
+	case SPDK_BDEV_EVENT_REMOVE:
+		vbdev_kv_crc_base_bdev_hotremove_cb(bdev);
+		break;
+	default:
+		SPDK_NOTICELOG("Unsupported bdev event: type %d\n", type);
+		break;
+	}
+}
+
+static int
+vbdev_kv_crc_register(struct kv_crc_config *config)
+{
+	struct vbdev_kv_crc *crc;
+	struct spdk_bdev *bdev;
+	int rc;
+
+	crc = calloc(1, sizeof(*crc));
+	if (crc == NULL) {
+		return -ENOMEM;
+	}
+
+	spdk_kv_select_results_init(&crc->selects, KV_CRC_MAX_SELECTS, KV_CRC_SELECT_ID_HOST);
+	pthread_spin_init(&crc->lock, PTHREAD_PROCESS_PRIVATE);
+
+	crc->bdev.name = strdup(config->name);
+	if (crc->bdev.name == NULL) {
+		rc = -ENOMEM;
+		goto free_crc;
+	}
+	crc->bdev.product_name = "kv_crc";
+
+	rc = spdk_bdev_open_ext(config->base_bdev_name, true, vbdev_kv_crc_base_bdev_event_cb,
+				NULL, &crc->base_desc);
+	if (rc) {
+		if (rc != -ENODEV) {
+			SPDK_ERRLOG("could not open bdev %s\n", config->base_bdev_name);
+		}
+		goto free_crc;
+	}
+
+	bdev = spdk_bdev_desc_get_bdev(crc->base_desc);
+	if (!spdk_bdev_io_type_supported(bdev, SPDK_BDEV_IO_KV_RETRIEVE)) {
+		SPDK_ERRLOG("bdev %s does not support KV commands\n", config->base_bdev_name);
+		rc = -ENOTSUP;
+		goto close_base;
+	}
+	crc->base_bdev = bdev;
+
+	crc->bdev.write_cache = bdev->write_cache;
+	crc->bdev.required_alignment = bdev->required_alignment;
+	crc->bdev.blocklen = bdev->blocklen;
+	crc->bdev.blockcnt = bdev->blockcnt;
+
+	crc->bdev.ctxt = crc;
+	crc->bdev.fn_table = &vbdev_kv_crc_fn_table;
+	crc->bdev.module = &kv_crc_if;
+	crc->thread = spdk_get_thread();
+
+	spdk_io_device_register(crc, kv_crc_ch_create_cb, kv_crc_ch_destroy_cb,
+				sizeof(struct kv_crc_io_channel), config->name);
+
+	rc = spdk_bdev_module_claim_bdev(bdev, crc->base_desc, crc->bdev.module);
+	if (rc) {
+		SPDK_ERRLOG("could not claim bdev %s\n", config->base_bdev_name);
+		goto unregister_device;
+	}
+
+	rc = spdk_bdev_register(&crc->bdev);
+	if (rc) {
+		SPDK_ERRLOG("could not register kv_crc bdev %s\n", config->name);
+		spdk_bdev_module_release_bdev(bdev);
+		goto unregister_device;
+	}
+
+	TAILQ_INSERT_TAIL(&g_kv_crc_nodes, crc, link);
+	SPDK_NOTICELOG("created kv_crc bdev %s on %s\n", config->name, config->base_bdev_name);
+	return 0;
+
+unregister_device:
+	spdk_io_device_unregister(crc, NULL);
+close_base:
+	spdk_bdev_close(crc->base_desc);
+free_crc:
+	kv_crc_free(crc);
+	return rc;
+}
+
+static void
+kv_crc_config_free(struct kv_crc_config *config)
+{
+	free(config->name);
+	free(config->base_bdev_name);
+	free(config);
+}
+
+int
+bdev_kv_crc_create(const char *name, const char *base_bdev_name)
+{
+	struct kv_crc_config *config;
+	int rc;
+
+	if (name == NULL || base_bdev_name == NULL) {
+		return -EINVAL;
+	}
+
+	TAILQ_FOREACH(config, &g_kv_crc_configs, link) {
+		if (strcmp(config->name, name) == 0) {
+			SPDK_ERRLOG("kv_crc bdev %s already exists\n", name);
+			return -EEXIST;
+		}
+	}
+
+	config = calloc(1, sizeof(*config));
+	if (config == NULL) {
+		return -ENOMEM;
+	}
+
+	config->name = strdup(name);
+	config->base_bdev_name = strdup(base_bdev_name);
+	if (config->name == NULL || config->base_bdev_name == NULL) {
+		kv_crc_config_free(config);
+		return -ENOMEM;
+	}
+
+	rc = vbdev_kv_crc_register(config);
+	if (rc == -ENODEV) {
+		SPDK_NOTICELOG("kv_crc creation deferred pending base bdev arrival\n");
+		rc = 0;
+	} else if (rc != 0) {
+		kv_crc_config_free(config);
+		return rc;
+	}
+
+	TAILQ_INSERT_TAIL(&g_kv_crc_configs, config, link);
+	return 0;
+}
+
+void
+bdev_kv_crc_delete(const char *name, spdk_bdev_unregister_cb cb_fn, void *cb_arg)
+{
+	struct kv_crc_config *config;
+	int rc;
+
+	rc = spdk_bdev_unregister_by_name(name, &kv_crc_if, cb_fn, cb_arg);
+	if (rc != 0) {
+		cb_fn(cb_arg, rc);
+		return;
+	}
+
+	/* Forget the bdev so it is not re-created when its base bdev comes back. */
+	TAILQ_FOREACH(config, &g_kv_crc_configs, link) {
+		if (strcmp(config->name, name) == 0) {
+			TAILQ_REMOVE(&g_kv_crc_configs, config, link);
+			kv_crc_config_free(config);
+			break;
+		}
+	}
+}
+
+int
+bdev_kv_crc_get_stats(const char *name, struct vbdev_kv_crc_stats *stats)
+{
+	struct vbdev_kv_crc *crc;
+
+	TAILQ_FOREACH(crc, &g_kv_crc_nodes, link) {
+		if (strcmp(spdk_bdev_get_name(&crc->bdev), name) == 0) {
+			break;
+		}
+	}
+	if (crc == NULL) {
+		return -ENODEV;
+	}
+
+	stats->stores = __atomic_load_n(&crc->stats.stores, __ATOMIC_RELAXED);
+	stats->verified = __atomic_load_n(&crc->stats.verified, __ATOMIC_RELAXED);
+	stats->crc_errors = __atomic_load_n(&crc->stats.crc_errors, __ATOMIC_RELAXED);
+	stats->host_selects = __atomic_load_n(&crc->stats.host_selects, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+static int
+vbdev_kv_crc_init(void)
+{
+	return 0;
+}
+
+static void
+vbdev_kv_crc_finish(void)
+{
+	struct kv_crc_config *config;
+
+	while ((config = TAILQ_FIRST(&g_kv_crc_configs))) {
+		TAILQ_REMOVE(&g_kv_crc_configs, config, link);
+		kv_crc_config_free(config);
+	}
+}
+
+static int
+vbdev_kv_crc_get_ctx_size(void)
+{
+	return sizeof(struct kv_crc_bdev_io);
+}
+
+static void
+vbdev_kv_crc_examine(struct spdk_bdev *bdev)
+{
+	struct kv_crc_config *config;
+
+	TAILQ_FOREACH(config, &g_kv_crc_configs, link) {
+		if (strcmp(config->base_bdev_name, bdev->name) == 0) {
+			vbdev_kv_crc_register(config);
+		}
+	}
+
+	spdk_bdev_module_examine_done(&kv_crc_if);
+}
+
+SPDK_LOG_REGISTER_COMPONENT(vbdev_kv_crc)
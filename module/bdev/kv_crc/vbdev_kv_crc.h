@@ -0,0 +1,53 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+#ifndef SPDK_VBDEV_KV_CRC_H
+#define SPDK_VBDEV_KV_CRC_H
+
+#include "spdk/stdinc.h"
+
+#include "spdk/bdev.h"
+#include "spdk/bdev_module.h"
+
+struct vbdev_kv_crc_stats {
+	uint64_t stores;
+	/* Values whose CRC-32C was checked and matched. */
+	uint64_t verified;
+	/* Values whose CRC did not match, or that had no trailer. */
+	uint64_t crc_errors;
+	/* SELECTs evaluated on the host. */
+	uint64_t host_selects;
+};
+
+/**
+ * Create a KV integrity bdev on top of a KV capable bdev. If the base bdev does
+ * not exist yet, it is created once it shows up.
+ *
+ * \param name Name of the integrity bdev.
+ * \param base_bdev_name Name of the base bdev.
+ *
+ * \return 0 on success, negated errno otherwise.
+ */
+int bdev_kv_crc_create(const char *name, const char *base_bdev_name);
+
+/**
+ * Delete a KV integrity bdev.
+ *
+ * \param name Name of the integrity bdev.
+ * \param cb_fn Function to call after deletion.
+ * \param cb_arg Argument to pass to cb_fn.
+ */
+void bdev_kv_crc_delete(const char *name, spdk_bdev_unregister_cb cb_fn, void *cb_arg);
+
+/**
+ * Get the counters of a KV integrity bdev.
+ *
+ * \param name Name of the integrity bdev.
+ * \param stats Filled in with the counters.
+ *
+ * \return 0 on success, -ENODEV if there is no such bdev.
+ */
+int bdev_kv_crc_get_stats(const char *name, struct vbdev_kv_crc_stats *stats);
+
+#endif /* SPDK_VBDEV_KV_CRC_H */
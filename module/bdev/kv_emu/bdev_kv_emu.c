@@ -0,0 +1,1122 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+/*
+ * KV emulation bdev.
+ *
+ * Implements the SPDK_BDEV_IO_KV_* I/O types in host memory so the KV data path
+ * can be run and profiled without a KV capable device. Keys live in an open
+ * addressing hash table with linear probing; each 32 byte slot holds the whole
+ * key, so a lookup normally touches a single cache line. SELECT results are kept
+ * until they are retrieved, like on the device.
+ */
+
+#include "spdk/stdinc.h"
+
+#include "spdk/bdev.h"
+#include "spdk/crc32.h"
+#include "spdk/env.h"
+#include "spdk/json.h"
+#include "spdk/likely.h"
+#include "spdk/nvme_spec.h"
+#include "spdk/string.h"
+#include "spdk/thread.h"
+#include "spdk/util.h"
+
+#include "spdk/bdev_module.h"
+#include "spdk/log.h"
+
+#include "spdk_internal/kv_select.h"
+
+#include "bdev_kv_emu.h"
+
+#define KV_EMU_BLOCK_SIZE		4096
+#define KV_EMU_INDEX_MIN_SLOTS		1024
+#define KV_EMU_MAX_SELECTS		1024
+#define KV_EMU_IMAGE_MAGIC		0x554d4556454b5053ULL /* "SPDKEVMU" */
+#define KV_EMU_IMAGE_VERSION		1
+
+struct kv_emu_value {
+	uint32_t	len;
+	uint32_t	cap;
+	uint8_t		data[];
+};
+
+struct kv_emu_slot {
+	uint8_t			key[NVME_KV_MAX_KEY_LENGTH];
+	/* 0 marks an empty slot. */
+	uint8_t			key_len;
+	uint8_t			reserved[3];
+	uint32_t		hash;
+	struct kv_emu_value	*value;
+};
+SPDK_STATIC_ASSERT(sizeof(struct kv_emu_slot) == 32, "Incorrect size");
+
+struct kv_emu_disk {
+	struct spdk_bdev			bdev;
+	struct spdk_spinlock			lock;
+
+	struct kv_emu_slot			*slots;
+	uint64_t				mask;
+	uint64_t				count;
+
+	uint64_t				capacity;
+	uint64_t				used;
+
+	struct spdk_kv_select_results	selects;
+
+	struct spdk_bdev_desc			*backing_desc;
+	bool					backing_removed;
+	spdk_kv_emu_create_cb			create_cb;
+	void					*create_cb_arg;
+
+	TAILQ_ENTRY(kv_emu_disk)		tailq;
+};
+
+/* On-disk image header, stored in the first block of the backing bdev. */
+struct kv_emu_image_header {
+	uint64_t	magic;
+	uint32_t	version;
+	uint32_t	crc;
+	uint64_t	num_entries;
+	uint64_t	data_len;
+};
+
+/* Followed by key_len key bytes and value_len value bytes. */
+struct kv_emu_image_entry {
+	uint8_t		key_len;
+	uint8_t		reserved[3];
+	uint32_t	value_len;
+};
+
+struct kv_emu_image_ctx {
+	struct kv_emu_disk	*disk;
+	struct spdk_io_channel	*ch;
+	void			*buf;
+	uint64_t		num_blocks;
+};
+
+static TAILQ_HEAD(, kv_emu_disk) g_kv_emu_disks = TAILQ_HEAD_INITIALIZER(g_kv_emu_disks);
+
+static int bdev_kv_emu_initialize(void);
+static void bdev_kv_emu_finish(void);
+
+static struct spdk_bdev_module kv_emu_if = {
+	.name = "kv_emu",
+	.module_init = bdev_kv_emu_initialize,
+	.module_fini = bdev_kv_emu_finish,
+};
+
+SPDK_BDEV_MODULE_REGISTER(kv_emu, &kv_emu_if)
+
+/* Index */
+
+static struct kv_emu_slot *
+kv_emu_lookup(struct kv_emu_disk *disk, const uint8_t *key, size_t key_len, uint32_t hash)
+{
+	struct kv_emu_slot *slot;
+	uint64_t i;
+
+	for (i = hash & disk->mask;; i = (i + 1) & disk->mask) {
+		slot = &disk->slots[i];
+		if (slot->key_len == 0) {
+			return slot;
+		}
+		if (slot->hash == hash && slot->key_len == key_len &&
+		    memcmp(slot->key, key, key_len) == 0) {
+			return slot;
+		}
+	}
+}
+
+static int
+kv_emu_index_grow(struct kv_emu_disk *disk)
+{
+	struct kv_emu_slot *old = disk->slots, *slot;
+	uint64_t old_num = disk->mask + 1, i;
+
+	disk->slots = calloc(old_num * 2, sizeof(*disk->slots));
+	if (disk->slots == NULL) {
+		disk->slots = old;
+		return -ENOMEM;
+	}
+	disk->mask = old_num * 2 - 1;
+
+	for (i = 0; i < old_num; i++) {
+		if (old[i].key_len == 0) {
+			continue;
+		}
+		slot = kv_emu_lookup(disk, old[i].key, old[i].key_len, old[i].hash);
+		*slot = old[i];
+	}
+	free(old);
+	return 0;
+}
+
+/* Backward shift deletion keeps probe sequences intact without tombstones. */
+static void
+kv_emu_index_remove(struct kv_emu_disk *disk, struct kv_emu_slot *slot)
+{
+	uint64_t i = slot - disk->slots, j = i, home;
+
+	for (;;) {
+		j = (j + 1) & disk->mask;
+		if (disk->slots[j].key_len == 0) {
+			break;
+		}
+		home = disk->slots[j].hash & disk->mask;
+		/* Move slot j into the hole at i unless its home lies cyclically in (i, j]. */
+		if ((j > i && (home <= i || home > j)) ||
+		    (j < i && (home <= i && home > j))) {
+			disk->slots[i] = disk->slots[j];
+			i = j;
+		}
+	}
+	memset(&disk->slots[i], 0, sizeof(disk->slots[i]));
+	disk->count--;
+}
+
+static inline uint64_t
+kv_emu_entry_size(uint32_t cap)
+{
+	return sizeof(struct kv_emu_slot) + sizeof(struct kv_emu_value) + cap;
+}
+
+/* KV operations. Called with disk->lock held; return an NVMe status code. */
+
+static uint64_t
+kv_emu_io_len(struct spdk_bdev_io *bdev_io)
+{
+	if (bdev_io->u.bdev.iovcnt == 1) {
+		return bdev_io->u.bdev.iovs[0].iov_len;
+	}
+	return bdev_io->u.bdev.nvme_kv.buffer_size;
+}
+
+static int
+kv_emu_store(struct kv_emu_disk *disk, const uint8_t *key, size_t key_len, uint8_t options,
+	     struct iovec *iovs, int iovcnt, uint64_t len)
+{
+	struct kv_emu_slot *slot;
+	struct kv_emu_value *value, *new_value;
+	uint64_t new_len, cap;
+	uint32_t hash;
+	bool append;
+
+	if (key_len == 0 || key_len > NVME_KV_MAX_KEY_LENGTH) {
+		return SPDK_NVME_SC_INVALID_KEY_SIZE;
+	}
+
+	hash = spdk_bdev_kv_key_hash(key, key_len);
+	slot = kv_emu_lookup(disk, key, key_len, hash);
+	value = slot->key_len ? slot->value : NULL;
+
+	if ((options & NVME_KV_STORE_CMD_OPTION_MUST_EXIST) && value == NULL) {
+		return SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST;
+	}
+	if ((options & NVME_KV_STORE_CMD_OPTION_MUST_NOT_EXIST) && value != NULL) {
+		return SPDK_NVME_SC_KEY_EXISTS;
+	}
+
+	append = (options & NVME_KV_STORE_CMD_OPTION_APPEND) && value != NULL;
+	new_len = append ? value->len + len : len;
+	if (new_len > UINT32_MAX) {
+		return SPDK_NVME_SC_INVALID_VALUE_SIZE;
+	}
+
+	if (value == NULL || new_len > value->cap || (!append && new_len < value->cap / 2)) {
+		/* Appends grow geometrically so a stream of small appends stays linear. */
+		cap = append ? spdk_max(new_len, (uint64_t)value->cap * 2) : new_len;
+		cap = spdk_min(cap, UINT32_MAX);
+		if (disk->used - (value ? kv_emu_entry_size(value->cap) : 0) +
+		    kv_emu_entry_size(cap) > disk->capacity) {
+			return SPDK_NVME_SC_CAPACITY_EXCEEDED;
+		}
+		if (value == NULL && (disk->count + 1) * 4 > (disk->mask + 1) * 3) {
+			if (kv_emu_index_grow(disk) != 0) {
+				return SPDK_NVME_SC_CAPACITY_EXCEEDED;
+			}
+			slot = kv_emu_lookup(disk, key, key_len, hash);
+		}
+
+		new_value = malloc(sizeof(*new_value) + cap);
+		if (new_value == NULL) {
+			return SPDK_NVME_SC_CAPACITY_EXCEEDED;
+		}
+		new_value->cap = cap;
+		new_value->len = 0;
+		if (append) {
+			memcpy(new_value->data, value->data, value->len);
+			new_value->len = value->len;
+		}
+		if (value != NULL) {
+			disk->used -= kv_emu_entry_size(value->cap);
+			free(value);
+		} else {
+			memcpy(slot->key, key, key_len);
+			slot->key_len = key_len;
+			slot->hash = hash;
+			disk->count++;
+		}
+		disk->used += kv_emu_entry_size(cap);
+		slot->value = value = new_value;
+	} else if (!append) {
+		value->len = 0;
+	}
+
+	spdk_copy_iovs_to_buf(value->data + value->len, len, iovs, iovcnt);
+	value->len = new_len;
+	return SPDK_NVME_SC_SUCCESS;
+}
+
+static int
+kv_emu_retrieve(struct kv_emu_disk *disk, const uint8_t *key, size_t key_len, uint64_t offset,
+		struct iovec *iovs, int iovcnt, uint64_t len, uint32_t *cdw0)
+{
+	struct kv_emu_slot *slot;
+
+	if (key_len == 0 || key_len > NVME_KV_MAX_KEY_LENGTH) {
+		return SPDK_NVME_SC_INVALID_KEY_SIZE;
+	}
+
+	slot = kv_emu_lookup(disk, key, key_len, spdk_bdev_kv_key_hash(key, key_len));
+	if (slot->key_len == 0) {
+		return SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST;
+	}
+	if (offset > slot->value->len) {
+		return SPDK_NVME_SC_INVALID_FIELD;
+	}
+
+	spdk_copy_buf_to_iovs(iovs, iovcnt, slot->value->data + offset,
+			      spdk_min(len, slot->value->len - offset));
+	*cdw0 = slot->value->len;
+	return SPDK_NVME_SC_SUCCESS;
+}
+
+static int
+kv_emu_exist(struct kv_emu_disk *disk, const uint8_t *key, size_t key_len)
+{
+	struct kv_emu_slot *slot;
+
+	if (key_len == 0 || key_len > NVME_KV_MAX_KEY_LENGTH) {
+		return SPDK_NVME_SC_INVALID_KEY_SIZE;
+	}
+
+	slot = kv_emu_lookup(disk, key, key_len, spdk_bdev_kv_key_hash(key, key_len));
+	return slot->key_len ? SPDK_NVME_SC_SUCCESS : SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST;
+}
+
+static int
+kv_emu_delete(struct kv_emu_disk *disk, const uint8_t *key, size_t key_len)
+{
+	struct kv_emu_slot *slot;
+
+	if (key_len == 0 || key_len > NVME_KV_MAX_KEY_LENGTH) {
+		return SPDK_NVME_SC_INVALID_KEY_SIZE;
+	}
+
+	slot = kv_emu_lookup(disk, key, key_len, spdk_bdev_kv_key_hash(key, key_len));
+	if (slot->key_len == 0) {
+		return SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST;
+	}
+
+	disk->used -= kv_emu_entry_size(slot->value->cap);
+	free(slot->value);
+	kv_emu_index_remove(disk, slot);
+	return SPDK_NVME_SC_SUCCESS;
+}
+
+static int
+kv_emu_key_cmp(const void *a, const void *b)
+{
+	const struct kv_emu_slot *sa = a;
+	const struct kv_emu_slot *sb = b;
+	int rc;
+
+	rc = memcmp(sa->key, sb->key, spdk_min(sa->key_len, sb->key_len));
+	return rc ? rc : (int)sa->key_len - (int)sb->key_len;
+}
+
+/*
+ * The list buffer holds a 32 bit key count followed by one entry per key: a
+ * 16 bit key length and the key, padded to a multiple of 4 bytes. Keys are
+ * returned in ascending order; as many as fit in the buffer.
+ *
+ * Only the copy of the matching keys is done under the disk lock. Allocating,
+ * sorting and encoding them would otherwise stall every other I/O to the disk
+ * for the length of a scan of the whole keyspace.
+ */
+static int
+kv_emu_list(struct kv_emu_disk *disk, const uint8_t *prefix, size_t prefix_len,
+	    struct iovec *iovs, int iovcnt, uint64_t len, uint32_t *cdw0)
+{
+	struct kv_emu_slot *keys = NULL, *tmp;
+	uint8_t *buf;
+	uint64_t i, n = 0, cap = 0, pos = 4;
+	uint32_t num = 0;
+	uint16_t key_len;
+
+	if (prefix_len > NVME_KV_MAX_KEY_LENGTH) {
+		return SPDK_NVME_SC_INVALID_KEY_SIZE;
+	}
+
+	buf = calloc(1, spdk_max(len, 4));
+	if (buf == NULL) {
+		return SPDK_NVME_SC_INTERNAL_DEVICE_ERROR;
+	}
+
+	spdk_spin_lock(&disk->lock);
+	while (cap < disk->count) {
+		cap = disk->count;
+		spdk_spin_unlock(&disk->lock);
+		tmp = realloc(keys, cap * sizeof(*keys));
+		if (tmp == NULL) {
+			free(keys);
+			free(buf);
+			return SPDK_NVME_SC_INTERNAL_DEVICE_ERROR;
+		}
+		keys = tmp;
+		spdk_spin_lock(&disk->lock);
+	}
+	for (i = 0; i <= disk->mask; i++) {
+		if (disk->slots[i].key_len >= prefix_len &&
+		    memcmp(disk->slots[i].key, prefix, prefix_len) == 0 &&
+		    disk->slots[i].key_len != 0) {
+			keys[n++] = disk->slots[i];
+		}
+	}
+	spdk_spin_unlock(&disk->lock);
+
+	if (n > 1) {
+		qsort(keys, n, sizeof(*keys), kv_emu_key_cmp);
+	}
+
+	for (i = 0; i < n; i++) {
+		key_len = keys[i].key_len;
+		if (pos + 2 + SPDK_ALIGN_CEIL(key_len, 4) > len) {
+			break;
+		}
+		memcpy(buf + pos, &key_len, sizeof(key_len));
+		memcpy(buf + pos + 2, keys[i].key, key_len);
+		pos += 2 + SPDK_ALIGN_CEIL(key_len, 4);
+		num++;
+	}
+	memcpy(buf, &num, sizeof(num));
+
+	spdk_copy_buf_to_iovs(iovs, iovcnt, buf, spdk_min(len, pos));
+	*cdw0 = num;
+	free(buf);
+	free(keys);
+	return SPDK_NVME_SC_SUCCESS;
+}
+
+static int
+kv_emu_send_select(struct kv_emu_disk *disk, struct spdk_bdev_io *bdev_io, uint32_t *cdw0)
+{
+	const uint8_t *key = bdev_io->u.bdev.nvme_kv.key;
+	size_t key_len = bdev_io->u.bdev.nvme_kv.key_length;
+	struct kv_emu_slot *slot;
+	char *query, *value, *result;
+	size_t query_len, value_len, result_len;
+	int rc;
+
+	if (key_len == 0 || key_len > NVME_KV_MAX_KEY_LENGTH) {
+		return SPDK_NVME_SC_INVALID_KEY_SIZE;
+	}
+
+	query_len = kv_emu_io_len(bdev_io);
+	query = malloc(query_len);
+	if (query == NULL) {
+		return SPDK_NVME_SC_INTERNAL_DEVICE_ERROR;
+	}
+	spdk_copy_iovs_to_buf(query, query_len, bdev_io->u.bdev.iovs, bdev_io->u.bdev.iovcnt);
+	if (bdev_io->u.bdev.iovcnt == 1) {
+		/* The contiguous API takes a NUL terminated query. */
+		query_len = strnlen(query, query_len);
+	}
+
+	/* Evaluate on a copy, without the lock, so a large scan does not stall other threads. */
+	spdk_spin_lock(&disk->lock);
+	slot = kv_emu_lookup(disk, key, key_len, spdk_bdev_kv_key_hash(key, key_len));
+	if (slot->key_len == 0) {
+		spdk_spin_unlock(&disk->lock);
+		free(query);
+		return SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST;
+	}
+	value_len = slot->value->len;
+	value = malloc(value_len + 1);
+	if (value != NULL) {
+		memcpy(value, slot->value->data, value_len);
+	}
+	spdk_spin_unlock(&disk->lock);
+
+	if (value == NULL) {
+		free(query);
+		return SPDK_NVME_SC_INTERNAL_DEVICE_ERROR;
+	}
+
+	rc = spdk_kv_select_eval(value, value_len, query, query_len,
+				 bdev_io->u.bdev.nvme_kv.select_input_type,
+				 bdev_io->u.bdev.nvme_kv.select_output_type,
+				 bdev_io->u.bdev.nvme_kv.options, &result, &result_len);
+	free(value);
+	free(query);
+	if (rc != 0) {
+		SPDK_DEBUGLOG(bdev_kv_emu, "select failed: %s\n", spdk_strerror(-rc));
+		return rc == -ENOMEM ? SPDK_NVME_SC_INTERNAL_DEVICE_ERROR : SPDK_NVME_SC_INVALID_FIELD;
+	}
+
+	spdk_spin_lock(&disk->lock);
+	rc = spdk_kv_select_results_add(&disk->selects, result, result_len, cdw0);
+	spdk_spin_unlock(&disk->lock);
+
+	return rc == 0 ? SPDK_NVME_SC_SUCCESS : SPDK_NVME_SC_INTERNAL_DEVICE_ERROR;
+}
+
+static int
+kv_emu_retrieve_select(struct kv_emu_disk *disk, uint32_t select_id, uint64_t offset,
+		       uint8_t options, struct iovec *iovs, int iovcnt, uint64_t len, uint32_t *cdw0)
+{
+	if (spdk_kv_select_results_read(&disk->selects, select_id, offset, options,
+					iovs, iovcnt, len, cdw0) != 0) {
+		return SPDK_NVME_SC_INVALID_FIELD;
+	}
+	return SPDK_NVME_SC_SUCCESS;
+}
+
+/*
+ * Every key is processed. As on a device, a missing key is an answer rather than
+ * a failure; the batch completes with the first other per-key error.
+ */
+static int
+kv_emu_batch(struct kv_emu_disk *disk, struct spdk_bdev_io *bdev_io)
+{
+	struct spdk_bdev_kv_batch_entry *entry;
+	uint32_t i;
+	int sc, status = SPDK_NVME_SC_SUCCESS;
+
+	for (i = 0; i < bdev_io->u.bdev.nvme_kv.batch_count; i++) {
+		entry = &bdev_io->u.bdev.nvme_kv.batch[i];
+		entry->cdw0 = 0;
+		switch (bdev_io->u.bdev.nvme_kv.batch_type) {
+		case SPDK_BDEV_IO_KV_RETRIEVE:
+			sc = kv_emu_retrieve(disk, entry->key, entry->key_length, entry->offset,
+					     entry->iovs, entry->iovcnt, entry->nbytes, &entry->cdw0);
+			break;
+		case SPDK_BDEV_IO_KV_STORE:
+			sc = kv_emu_store(disk, entry->key, entry->key_length, entry->options,
+					  entry->iovs, entry->iovcnt, entry->nbytes);
+			break;
+		case SPDK_BDEV_IO_KV_EXIST:
+			sc = kv_emu_exist(disk, entry->key, entry->key_length);
+			break;
+		default:
+			sc = SPDK_NVME_SC_INVALID_OPCODE;
+			break;
+		}
+		entry->sct = SPDK_NVME_SCT_GENERIC;
+		entry->sc = sc;
+		if (status == SPDK_NVME_SC_SUCCESS && sc != SPDK_NVME_SC_SUCCESS &&
+		    sc != SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST) {
+			status = sc;
+		}
+	}
+
+	return status;
+}
+
+static void
+bdev_kv_emu_submit_request(struct spdk_io_channel *ch, struct spdk_bdev_io *bdev_io)
+{
+	struct kv_emu_disk *disk = bdev_io->bdev->ctxt;
+	uint8_t *key = bdev_io->u.bdev.nvme_kv.key;
+	size_t key_len = bdev_io->u.bdev.nvme_kv.key_length;
+	uint32_t cdw0 = 0;
+	int sc;
+
+	if (bdev_io->type == SPDK_BDEV_IO_KV_SEND_SELECT) {
+		sc = kv_emu_send_select(disk, bdev_io, &cdw0);
+		spdk_bdev_io_complete_nvme_status(bdev_io, cdw0, SPDK_NVME_SCT_GENERIC, sc);
+		return;
+	}
+
+	if (bdev_io->type == SPDK_BDEV_IO_KV_LIST) {
+		sc = kv_emu_list(disk, key, key_len, bdev_io->u.bdev.iovs, bdev_io->u.bdev.iovcnt,
+				 kv_emu_io_len(bdev_io), &cdw0);
+		spdk_bdev_io_complete_nvme_status(bdev_io, cdw0, SPDK_NVME_SCT_GENERIC, sc);
+		return;
+	}
+
+	spdk_spin_lock(&disk->lock);
+	switch (bdev_io->type) {
+	case SPDK_BDEV_IO_KV_DELETE:
+		sc = kv_emu_delete(disk, key, key_len);
+		break;
+	case SPDK_BDEV_IO_KV_EXIST:
+		sc = kv_emu_exist(disk, key, key_len);
+		break;
+	case SPDK_BDEV_IO_KV_STORE:
+		sc = kv_emu_store(disk, key, key_len, bdev_io->u.bdev.nvme_kv.options,
+				  bdev_io->u.bdev.iovs, bdev_io->u.bdev.iovcnt, kv_emu_io_len(bdev_io));
+		break;
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+		sc = kv_emu_retrieve(disk, key, key_len, bdev_io->u.bdev.nvme_kv.offset,
+				     bdev_io->u.bdev.iovs, bdev_io->u.bdev.iovcnt,
+				     kv_emu_io_len(bdev_io), &cdw0);
+		break;
+	case SPDK_BDEV_IO_KV_RETRIEVE_SELECT:
+		sc = kv_emu_retrieve_select(disk, bdev_io->u.bdev.nvme_kv.select_id,
+					    bdev_io->u.bdev.nvme_kv.offset,
+					    bdev_io->u.bdev.nvme_kv.options, bdev_io->u.bdev.iovs,
+					    bdev_io->u.bdev.iovcnt, kv_emu_io_len(bdev_io), &cdw0);
+		break;
+	case SPDK_BDEV_IO_KV_BATCH:
+		sc = kv_emu_batch(disk, bdev_io);
+		break;
+	default:
+		sc = SPDK_NVME_SC_INVALID_OPCODE;
+		break;
+	}
+	spdk_spin_unlock(&disk->lock);
+
+	spdk_bdev_io_complete_nvme_status(bdev_io, cdw0, SPDK_NVME_SCT_GENERIC, sc);
+}
+
+static bool
+bdev_kv_emu_io_type_supported(void *ctx, enum spdk_bdev_io_type io_type)
+{
+	switch (io_type) {
+	case SPDK_BDEV_IO_KV_LIST:
+	case SPDK_BDEV_IO_KV_DELETE:
+	case SPDK_BDEV_IO_KV_EXIST:
+	case SPDK_BDEV_IO_KV_STORE:
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+	case SPDK_BDEV_IO_KV_SEND_SELECT:
+	case SPDK_BDEV_IO_KV_RETRIEVE_SELECT:
+	case SPDK_BDEV_IO_KV_BATCH:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static struct spdk_io_channel *
+bdev_kv_emu_get_io_channel(void *ctx)
+{
+	return spdk_get_io_channel(&g_kv_emu_disks);
+}
+
+static void
+bdev_kv_emu_write_config_json(struct spdk_bdev *bdev, struct spdk_json_write_ctx *w)
+{
+	struct kv_emu_disk *disk = bdev->ctxt;
+	char uuid_str[SPDK_UUID_STRING_LEN];
+
+	spdk_json_write_object_begin(w);
+
+	spdk_json_write_named_string(w, "method", "bdev_kv_emu_create");
+
+	spdk_json_write_named_object_begin(w, "params");
+	spdk_json_write_named_string(w, "name", bdev->name);
+	spdk_json_write_named_uint64(w, "capacity_mb", disk->capacity / (1024 * 1024));
+	if (disk->backing_desc != NULL) {
+		spdk_json_write_named_string(w, "backing_bdev",
+					     spdk_bdev_get_name(spdk_bdev_desc_get_bdev(disk->backing_desc)));
+	}
+	spdk_uuid_fmt_lower(uuid_str, sizeof(uuid_str), &bdev->uuid);
+	spdk_json_write_named_string(w, "uuid", uuid_str);
+	spdk_json_write_object_end(w);
+
+	spdk_json_write_object_end(w);
+}
+
+static void
+kv_emu_disk_free(struct kv_emu_disk *disk)
+{
+	uint64_t i;
+
+	spdk_kv_select_results_fini(&disk->selects);
+	if (disk->slots != NULL) {
+		for (i = 0; i <= disk->mask; i++) {
+			free(disk->slots[i].value);
+		}
+	}
+	free(disk->slots);
+	spdk_spin_destroy(&disk->lock);
+	free(disk->bdev.name);
+	free(disk);
+}
+
+/* Backing bdev image */
+
+static uint64_t
+kv_emu_image_size(struct kv_emu_disk *disk)
+{
+	uint64_t i, size = 0;
+
+	for (i = 0; i <= disk->mask; i++) {
+		if (disk->slots[i].key_len != 0) {
+			size += sizeof(struct kv_emu_image_entry) + disk->slots[i].key_len +
+				disk->slots[i].value->len;
+		}
+	}
+	return size;
+}
+
+static void
+kv_emu_image_ctx_free(struct kv_emu_image_ctx *ctx)
+{
+	if (ctx->ch != NULL) {
+		spdk_put_io_channel(ctx->ch);
+	}
+	spdk_dma_free(ctx->buf);
+	free(ctx);
+}
+
+static void
+kv_emu_close_backing(struct kv_emu_disk *disk)
+{
+	if (disk->backing_desc != NULL) {
+		spdk_bdev_module_release_bdev(spdk_bdev_desc_get_bdev(disk->backing_desc));
+		spdk_bdev_close(disk->backing_desc);
+		disk->backing_desc = NULL;
+	}
+}
+
+static void
+kv_emu_save_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct kv_emu_image_ctx *ctx = cb_arg;
+	struct kv_emu_disk *disk = ctx->disk;
+
+	spdk_bdev_free_io(bdev_io);
+	if (!success) {
+		SPDK_ERRLOG("Failed to save %s to its backing bdev\n", disk->bdev.name);
+	}
+	kv_emu_image_ctx_free(ctx);
+	kv_emu_close_backing(disk);
+	spdk_bdev_destruct_done(&disk->bdev, success ? 0 : -EIO);
+	kv_emu_disk_free(disk);
+}
+
+static int
+kv_emu_save(struct kv_emu_disk *disk)
+{
+	struct spdk_bdev *backing = spdk_bdev_desc_get_bdev(disk->backing_desc);
+	uint32_t block_size = spdk_bdev_get_block_size(backing);
+	struct kv_emu_image_header *hdr;
+	struct kv_emu_image_entry entry;
+	struct kv_emu_image_ctx *ctx;
+	struct kv_emu_slot *slot;
+	uint64_t data_len, i;
+	uint8_t *p;
+	int rc;
+
+	data_len = kv_emu_image_size(disk);
+	ctx = calloc(1, sizeof(*ctx));
+	if (ctx == NULL) {
+		return -ENOMEM;
+	}
+	ctx->disk = disk;
+	ctx->num_blocks = 1 + SPDK_CEIL_DIV(data_len, block_size);
+	if (ctx->num_blocks > spdk_bdev_get_num_blocks(backing)) {
+		SPDK_ERRLOG("%s does not fit on backing bdev %s\n", disk->bdev.name,
+			    spdk_bdev_get_name(backing));
+		free(ctx);
+		return -ENOSPC;
+	}
+
+	ctx->buf = spdk_dma_zmalloc(ctx->num_blocks * block_size, spdk_bdev_get_buf_align(backing),
+				    NULL);
+	ctx->ch = spdk_bdev_get_io_channel(disk->backing_desc);
+	if (ctx->buf == NULL || ctx->ch == NULL) {
+		kv_emu_image_ctx_free(ctx);
+		return -ENOMEM;
+	}
+
+	p = (uint8_t *)ctx->buf + block_size;
+	for (i = 0; i <= disk->mask; i++) {
+		slot = &disk->slots[i];
+		if (slot->key_len == 0) {
+			continue;
+		}
+		memset(&entry, 0, sizeof(entry));
+		entry.key_len = slot->key_len;
+		entry.value_len = slot->value->len;
+		memcpy(p, &entry, sizeof(entry));
+		p += sizeof(entry);
+		memcpy(p, slot->key, slot->key_len);
+		p += slot->key_len;
+		memcpy(p, slot->value->data, slot->value->len);
+		p += slot->value->len;
+	}
+
+	hdr = ctx->buf;
+	hdr->magic = KV_EMU_IMAGE_MAGIC;
+	hdr->version = KV_EMU_IMAGE_VERSION;
+	hdr->num_entries = disk->count;
+	hdr->data_len = data_len;
+	hdr->crc = spdk_crc32c_update((uint8_t *)ctx->buf + block_size, data_len, ~0u);
+
+	rc = spdk_bdev_write_blocks(disk->backing_desc, ctx->ch, ctx->buf, 0, ctx->num_blocks,
+				    kv_emu_save_done, ctx);
+	if (rc != 0) {
+		kv_emu_image_ctx_free(ctx);
+	}
+	return rc;
+}
+
+static int
+bdev_kv_emu_destruct(void *ctx)
+{
+	struct kv_emu_disk *disk = ctx;
+	int rc;
+
+	TAILQ_REMOVE(&g_kv_emu_disks, disk, tailq);
+
+	if (disk->backing_desc != NULL && !disk->backing_removed) {
+		rc = kv_emu_save(disk);
+		if (rc == 0) {
+			/* kv_emu_save_done() finishes the destruct. */
+			return 1;
+		}
+		SPDK_ERRLOG("Failed to save %s to its backing bdev: %s\n", disk->bdev.name,
+			    spdk_strerror(-rc));
+	}
+
+	kv_emu_close_backing(disk);
+	kv_emu_disk_free(disk);
+	return 0;
+}
+
+static const struct spdk_bdev_fn_table kv_emu_fn_table = {
+	.destruct		= bdev_kv_emu_destruct,
+	.submit_request		= bdev_kv_emu_submit_request,
+	.io_type_supported	= bdev_kv_emu_io_type_supported,
+	.get_io_channel		= bdev_kv_emu_get_io_channel,
+	.write_config_json	= bdev_kv_emu_write_config_json,
+};
+
+static void
+kv_emu_register(struct kv_emu_disk *disk)
+{
+	spdk_kv_emu_create_cb cb_fn = disk->create_cb;
+	void *cb_arg = disk->create_cb_arg;
+	int rc;
+
+	rc = spdk_bdev_register(&disk->bdev);
+	if (rc != 0) {
+		kv_emu_close_backing(disk);
+		kv_emu_disk_free(disk);
+		cb_fn(cb_arg, NULL, rc);
+		return;
+	}
+
+	TAILQ_INSERT_TAIL(&g_kv_emu_disks, disk, tailq);
+	cb_fn(cb_arg, &disk->bdev, 0);
+}
+
+static void
+kv_emu_create_failed(struct kv_emu_disk *disk, int rc)
+{
+	spdk_kv_emu_create_cb cb_fn = disk->create_cb;
+	void *cb_arg = disk->create_cb_arg;
+
+	kv_emu_close_backing(disk);
+	kv_emu_disk_free(disk);
+	cb_fn(cb_arg, NULL, rc);
+}
+
+static int
+kv_emu_load_image(struct kv_emu_disk *disk, const uint8_t *data, uint64_t data_len,
+		  uint64_t num_entries)
+{
+	struct kv_emu_image_entry entry;
+	struct iovec iov;
+	uint64_t pos = 0, i;
+	int sc;
+
+	for (i = 0; i < num_entries; i++) {
+		if (pos + sizeof(entry) > data_len) {
+			return -EILSEQ;
+		}
+		memcpy(&entry, data + pos, sizeof(entry));
+		pos += sizeof(entry);
+		if (entry.key_len == 0 || entry.key_len > NVME_KV_MAX_KEY_LENGTH ||
+		    pos + entry.key_len + entry.value_len > data_len) {
+			return -EILSEQ;
+		}
+		iov.iov_base = (void *)(data + pos + entry.key_len);
+		iov.iov_len = entry.value_len;
+		sc = kv_emu_store(disk, data + pos, entry.key_len, 0, &iov, 1, entry.value_len);
+		if (sc != SPDK_NVME_SC_SUCCESS) {
+			return sc == SPDK_NVME_SC_CAPACITY_EXCEEDED ? -ENOSPC : -EIO;
+		}
+		pos += entry.key_len + entry.value_len;
+	}
+	return 0;
+}
+
+static void
+kv_emu_load_data_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct kv_emu_image_ctx *ctx = cb_arg;
+	struct kv_emu_disk *disk = ctx->disk;
+	struct spdk_bdev *backing = spdk_bdev_desc_get_bdev(disk->backing_desc);
+	uint32_t block_size = spdk_bdev_get_block_size(backing);
+	struct kv_emu_image_header *hdr = ctx->buf;
+	uint8_t *data = (uint8_t *)ctx->buf + block_size;
+	int rc = 0;
+
+	spdk_bdev_free_io(bdev_io);
+
+	if (!success) {
+		rc = -EIO;
+	} else if (spdk_crc32c_update(data, hdr->data_len, ~0u) != hdr->crc) {
+		SPDK_ERRLOG("Image on %s is corrupted\n", spdk_bdev_get_name(backing));
+		rc = -EILSEQ;
+	} else {
+		spdk_spin_lock(&disk->lock);
+		rc = kv_emu_load_image(disk, data, hdr->data_len, hdr->num_entries);
+		spdk_spin_unlock(&disk->lock);
+	}
+
+	kv_emu_image_ctx_free(ctx);
+	if (rc != 0) {
+		kv_emu_create_failed(disk, rc);
+		return;
+	}
+
+	SPDK_NOTICELOG("Loaded %" PRIu64 " keys into %s from %s\n", disk->count, disk->bdev.name,
+		       spdk_bdev_get_name(backing));
+	kv_emu_register(disk);
+}
+
+static void
+kv_emu_load_header_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct kv_emu_image_ctx *ctx = cb_arg;
+	struct kv_emu_disk *disk = ctx->disk;
+	struct spdk_bdev *backing = spdk_bdev_desc_get_bdev(disk->backing_desc);
+	uint32_t block_size = spdk_bdev_get_block_size(backing);
+	struct kv_emu_image_header hdr;
+	void *buf;
+	int rc;
+
+	spdk_bdev_free_io(bdev_io);
+
+	if (!success) {
+		kv_emu_image_ctx_free(ctx);
+		kv_emu_create_failed(disk, -EIO);
+		return;
+	}
+
+	memcpy(&hdr, ctx->buf, sizeof(hdr));
+	if (hdr.magic != KV_EMU_IMAGE_MAGIC || hdr.version != KV_EMU_IMAGE_VERSION) {
+		/* Nothing saved yet - start empty. */
+		kv_emu_image_ctx_free(ctx);
+		kv_emu_register(disk);
+		return;
+	}
+
+	ctx->num_blocks = 1 + SPDK_CEIL_DIV(hdr.data_len, block_size);
+	if (ctx->num_blocks > spdk_bdev_get_num_blocks(backing)) {
+		kv_emu_image_ctx_free(ctx);
+		kv_emu_create_failed(disk, -EILSEQ);
+		return;
+	}
+
+	buf = spdk_dma_zmalloc(ctx->num_blocks * block_size, spdk_bdev_get_buf_align(backing), NULL);
+	if (buf == NULL) {
+		kv_emu_image_ctx_free(ctx);
+		kv_emu_create_failed(disk, -ENOMEM);
+		return;
+	}
+	spdk_dma_free(ctx->buf);
+	ctx->buf = buf;
+
+	rc = spdk_bdev_read_blocks(disk->backing_desc, ctx->ch, ctx->buf, 0, ctx->num_blocks,
+				   kv_emu_load_data_done, ctx);
+	if (rc != 0) {
+		kv_emu_image_ctx_free(ctx);
+		kv_emu_create_failed(disk, rc);
+	}
+}
+
+static int
+kv_emu_load(struct kv_emu_disk *disk)
+{
+	struct spdk_bdev *backing = spdk_bdev_desc_get_bdev(disk->backing_desc);
+	struct kv_emu_image_ctx *ctx;
+	int rc;
+
+	ctx = calloc(1, sizeof(*ctx));
+	if (ctx == NULL) {
+		return -ENOMEM;
+	}
+	ctx->disk = disk;
+	ctx->buf = spdk_dma_zmalloc(spdk_bdev_get_block_size(backing),
+				    spdk_bdev_get_buf_align(backing), NULL);
+	ctx->ch = spdk_bdev_get_io_channel(disk->backing_desc);
+	if (ctx->buf == NULL || ctx->ch == NULL) {
+		kv_emu_image_ctx_free(ctx);
+		return -ENOMEM;
+	}
+
+	rc = spdk_bdev_read_blocks(disk->backing_desc, ctx->ch, ctx->buf, 0, 1,
+				   kv_emu_load_header_done, ctx);
+	if (rc != 0) {
+		kv_emu_image_ctx_free(ctx);
+	}
+	return rc;
+}
+
+static void
+kv_emu_backing_event_cb(enum spdk_bdev_event_type type, struct spdk_bdev *bdev, void *event_ctx)
+{
+	struct kv_emu_disk *disk = event_ctx;
+
+	switch (type) {
+	case SPDK_BDEV_EVENT_REMOVE:
+		SPDK_NOTICELOG("Backing bdev %s of %s removed\n", spdk_bdev_get_name(bdev),
+			       disk->bdev.name);
+		disk->backing_removed = true;
+		spdk_bdev_unregister(&disk->bdev, NULL, NULL);
+		break;
+	default:
+		SPDK_NOTICELOG("Unsupported bdev event: type %d\n", type);
+		break;
+	}
+}
+
+int
+bdev_kv_emu_create(const struct spdk_kv_emu_bdev_opts *opts, spdk_kv_emu_create_cb cb_fn,
+		   void *cb_arg)
+{
+	struct kv_emu_disk *disk;
+	struct spdk_bdev *backing;
+	uint64_t max_capacity;
+	int rc;
+
+	if (opts == NULL || opts->name == NULL) {
+		SPDK_ERRLOG("No name provided for KV emulation bdev.\n");
+		return -EINVAL;
+	}
+
+	if (opts->capacity < KV_EMU_BLOCK_SIZE) {
+		SPDK_ERRLOG("Capacity must be at least %u bytes\n", KV_EMU_BLOCK_SIZE);
+		return -EINVAL;
+	}
+
+	disk = calloc(1, sizeof(*disk));
+	if (disk == NULL) {
+		SPDK_ERRLOG("could not allocate kv_emu disk\n");
+		return -ENOMEM;
+	}
+
+	disk->bdev.name = strdup(opts->name);
+	disk->slots = calloc(KV_EMU_INDEX_MIN_SLOTS, sizeof(*disk->slots));
+	if (disk->bdev.name == NULL || disk->slots == NULL) {
+		free(disk->slots);
+		free(disk->bdev.name);
+		free(disk);
+		return -ENOMEM;
+	}
+	disk->mask = KV_EMU_INDEX_MIN_SLOTS - 1;
+	disk->capacity = opts->capacity;
+	disk->create_cb = cb_fn;
+	disk->create_cb_arg = cb_arg;
+	spdk_kv_select_results_init(&disk->selects, KV_EMU_MAX_SELECTS, 0);
+	spdk_spin_init(&disk->lock);
+
+	disk->bdev.product_name = "KV emulation disk";
+	disk->bdev.write_cache = 0;
+	disk->bdev.blocklen = KV_EMU_BLOCK_SIZE;
+	disk->bdev.blockcnt = opts->capacity / KV_EMU_BLOCK_SIZE;
+	if (opts->uuid) {
+		disk->bdev.uuid = *opts->uuid;
+	} else {
+		spdk_uuid_generate(&disk->bdev.uuid);
+	}
+	disk->bdev.ctxt = disk;
+	disk->bdev.fn_table = &kv_emu_fn_table;
+	disk->bdev.module = &kv_emu_if;
+
+	if (opts->backing_bdev == NULL) {
+		kv_emu_register(disk);
+		return 0;
+	}
+
+	rc = spdk_bdev_open_ext(opts->backing_bdev, true, kv_emu_backing_event_cb, disk,
+				&disk->backing_desc);
+	if (rc != 0) {
+		SPDK_ERRLOG("Could not open backing bdev %s\n", opts->backing_bdev);
+		kv_emu_disk_free(disk);
+		return rc;
+	}
+
+	backing = spdk_bdev_desc_get_bdev(disk->backing_desc);
+	rc = spdk_bdev_module_claim_bdev(backing, disk->backing_desc, &kv_emu_if);
+	if (rc != 0) {
+		SPDK_ERRLOG("Could not claim backing bdev %s\n", opts->backing_bdev);
+		spdk_bdev_close(disk->backing_desc);
+		kv_emu_disk_free(disk);
+		return rc;
+	}
+
+	/* Everything in memory has to fit in the image on the backing bdev. */
+	max_capacity = (spdk_bdev_get_num_blocks(backing) - 1) * spdk_bdev_get_block_size(backing);
+	if (disk->capacity > max_capacity) {
+		SPDK_NOTICELOG("Limiting capacity of %s to the size of %s\n", opts->name,
+			       opts->backing_bdev);
+		disk->capacity = max_capacity;
+		disk->bdev.blockcnt = spdk_max(max_capacity / KV_EMU_BLOCK_SIZE, 1);
+	}
+
+	rc = kv_emu_load(disk);
+	if (rc != 0) {
+		kv_emu_close_backing(disk);
+		kv_emu_disk_free(disk);
+	}
+	return rc;
+}
+
+void
+bdev_kv_emu_delete(const char *bdev_name, spdk_kv_emu_delete_cb cb_fn, void *cb_arg)
+{
+	int rc;
+
+	rc = spdk_bdev_unregister_by_name(bdev_name, &kv_emu_if, cb_fn, cb_arg);
+	if (rc != 0) {
+		cb_fn(cb_arg, rc);
+	}
+}
+
+static int
+kv_emu_channel_create_cb(void *io_device, void *ctx_buf)
+{
+	return 0;
+}
+
+static void
+kv_emu_channel_destroy_cb(void *io_device, void *ctx_buf)
+{
+}
+
+static int
+bdev_kv_emu_initialize(void)
+{
+	/* All disks share a channel; the index is protected by a per-disk lock. */
+	spdk_io_device_register(&g_kv_emu_disks, kv_emu_channel_create_cb, kv_emu_channel_destroy_cb,
+				0, "bdev_kv_emu");
+	return 0;
+}
+
+static void
+bdev_kv_emu_finish(void)
+{
+	spdk_io_device_unregister(&g_kv_emu_disks, NULL);
+}
+
+SPDK_LOG_REGISTER_COMPONENT(bdev_kv_emu)
@@ -0,0 +1,52 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+#ifndef SPDK_BDEV_KV_EMU_H
+#define SPDK_BDEV_KV_EMU_H
+
+#include "spdk/stdinc.h"
+
+struct spdk_bdev;
+struct spdk_uuid;
+
+typedef void (*spdk_kv_emu_create_cb)(void *cb_arg, struct spdk_bdev *bdev, int bdeverrno);
+typedef void (*spdk_kv_emu_delete_cb)(void *cb_arg, int bdeverrno);
+
+struct spdk_kv_emu_bdev_opts {
+	const char *name;
+	const struct spdk_uuid *uuid;
+	/* Memory available for keys and values, in bytes. */
+	uint64_t capacity;
+	/*
+	 * Optional bdev the contents are loaded from at create time and saved
+	 * to when the emulated bdev is deleted. Not written to in between.
+	 */
+	const char *backing_bdev;
+};
+
+/**
+ * Create a KV emulation bdev.
+ *
+ * \param opts Creation options.
+ * \param cb_fn Called once the bdev is registered, or on failure. When a backing
+ * bdev is given, this happens after its contents have been loaded.
+ * \param cb_arg Argument to pass to cb_fn.
+ *
+ * \return 0 if creation started, in which case cb_fn will be called, or
+ * negated errno otherwise.
+ */
+int bdev_kv_emu_create(const struct spdk_kv_emu_bdev_opts *opts, spdk_kv_emu_create_cb cb_fn,
+		       void *cb_arg);
+
+/**
+ * Delete a KV emulation bdev. Its contents are saved to the backing bdev first,
+ * if it has one.
+ *
+ * \param bdev_name Name of the bdev.
+ * \param cb_fn Function to call after deletion.
+ * \param cb_arg Argument to pass to cb_fn.
+ */
+void bdev_kv_emu_delete(const char *bdev_name, spdk_kv_emu_delete_cb cb_fn, void *cb_arg);
+
+#endif /* SPDK_BDEV_KV_EMU_H */
@@ -0,0 +1,142 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+#include "spdk/rpc.h"
+#include "spdk/util.h"
+#include "spdk/string.h"
+#include "spdk/bdev_module.h"
+#include "spdk/log.h"
+
+#include "bdev_kv_emu.h"
+
+struct rpc_construct_kv_emu {
+	char *name;
+	char *uuid;
+	uint64_t capacity_mb;
+	char *backing_bdev;
+};
+
+static void
+free_rpc_construct_kv_emu(struct rpc_construct_kv_emu *req)
+{
+	free(req->name);
+	free(req->uuid);
+	free(req->backing_bdev);
+}
+
+static const struct spdk_json_object_decoder rpc_construct_kv_emu_decoders[] = {
+	{"name", offsetof(struct rpc_construct_kv_emu, name), spdk_json_decode_string},
+	{"uuid", offsetof(struct rpc_construct_kv_emu, uuid), spdk_json_decode_string, true},
+	{"capacity_mb", offsetof(struct rpc_construct_kv_emu, capacity_mb), spdk_json_decode_uint64},
+	{"backing_bdev", offsetof(struct rpc_construct_kv_emu, backing_bdev), spdk_json_decode_string, true},
+};
+
+static void
+rpc_bdev_kv_emu_create_cb(void *cb_arg, struct spdk_bdev *bdev, int bdeverrno)
+{
+	struct spdk_jsonrpc_request *request = cb_arg;
+	struct spdk_json_write_ctx *w;
+
+	if (bdeverrno != 0) {
+		spdk_jsonrpc_send_error_response(request, bdeverrno, spdk_strerror(-bdeverrno));
+		return;
+	}
+
+	w = spdk_jsonrpc_begin_result(request);
+	spdk_json_write_string(w, spdk_bdev_get_name(bdev));
+	spdk_jsonrpc_end_result(request, w);
+}
+
+static void
+rpc_bdev_kv_emu_create(struct spdk_jsonrpc_request *request,
+		       const struct spdk_json_val *params)
+{
+	struct rpc_construct_kv_emu req = {};
+	struct spdk_kv_emu_bdev_opts opts = {};
+	struct spdk_uuid decoded_uuid;
+	int rc;
+
+	if (spdk_json_decode_object(params, rpc_construct_kv_emu_decoders,
+				    SPDK_COUNTOF(rpc_construct_kv_emu_decoders),
+				    &req)) {
+		SPDK_DEBUGLOG(bdev_kv_emu, "spdk_json_decode_object failed\n");
+		spdk_jsonrpc_send_error_response(request, SPDK_JSONRPC_ERROR_INTERNAL_ERROR,
+						 "spdk_json_decode_object failed");
+		goto cleanup;
+	}
+
+	if (req.capacity_mb == 0) {
+		spdk_jsonrpc_send_error_response(request, -EINVAL,
+						 "Capacity must be greater than 0");
+		goto cleanup;
+	}
+
+	if (req.uuid) {
+		if (spdk_uuid_parse(&decoded_uuid, req.uuid)) {
+			spdk_jsonrpc_send_error_response(request, -EINVAL,
+							 "Failed to parse bdev UUID");
+			goto cleanup;
+		}
+		opts.uuid = &decoded_uuid;
+	}
+
+	opts.name = req.name;
+	opts.capacity = req.capacity_mb * 1024 * 1024;
+	opts.backing_bdev = req.backing_bdev;
+	rc = bdev_kv_emu_create(&opts, rpc_bdev_kv_emu_create_cb, request);
+	if (rc) {
+		spdk_jsonrpc_send_error_response(request, rc, spdk_strerror(-rc));
+	}
+
+cleanup:
+	free_rpc_construct_kv_emu(&req);
+}
+SPDK_RPC_REGISTER("bdev_kv_emu_create", rpc_bdev_kv_emu_create, SPDK_RPC_RUNTIME)
+
+struct rpc_delete_kv_emu {
+	char *name;
+};
+
+static void
+free_rpc_delete_kv_emu(struct rpc_delete_kv_emu *req)
+{
+	free(req->name);
+}
+
+static const struct spdk_json_object_decoder rpc_delete_kv_emu_decoders[] = {
+	{"name", offsetof(struct rpc_delete_kv_emu, name), spdk_json_decode_string},
+};
+
+static void
+rpc_bdev_kv_emu_delete_cb(void *cb_arg, int bdeverrno)
+{
+	struct spdk_jsonrpc_request *request = cb_arg;
+
+	if (bdeverrno == 0) {
+		spdk_jsonrpc_send_bool_response(request, true);
+	} else {
+		spdk_jsonrpc_send_error_response(request, bdeverrno, spdk_strerror(-bdeverrno));
+	}
+}
+
+static void
+rpc_bdev_kv_emu_delete(struct spdk_jsonrpc_request *request,
+		       const struct spdk_json_val *params)
+{
+	struct rpc_delete_kv_emu req = {NULL};
+
+	if (spdk_json_decode_object(params, rpc_delete_kv_emu_decoders,
+				    SPDK_COUNTOF(rpc_delete_kv_emu_decoders),
+				    &req)) {
+		spdk_jsonrpc_send_error_response(request, SPDK_JSONRPC_ERROR_INTERNAL_ERROR,
+						 "spdk_json_decode_object failed");
+		goto cleanup;
+	}
+
+	bdev_kv_emu_delete(req.name, rpc_bdev_kv_emu_delete_cb, request);
+
+cleanup:
+	free_rpc_delete_kv_emu(&req);
+}
+SPDK_RPC_REGISTER("bdev_kv_emu_delete", rpc_bdev_kv_emu_delete, SPDK_RPC_RUNTIME)
@@ -0,0 +1,1846 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+/*
+ * KV mirroring. Keeps the same keys on several KV capable base bdevs, called
+ * replicas.
+ *
+ * STORE, DELETE and batched stores go to every replica in service. They
+ * succeed if any replica took them; a replica that failed a write another one
+ * took no longer holds the same keys and is taken out of service.
+ *
+ * Commands that only read go to a single replica: the one with the fewest
+ * commands outstanding on the channel, as with the queue depth multipath
+ * selector of bdev_nvme. A read that fails with a device error is retried on
+ * another replica. The select id handed back by SEND SELECT carries the index of
+ * the replica in its low bits, so RETRIEVE SELECT is sent to the same one.
+ *
+ * While a replica is out of service, the keys written in the meantime are kept
+ * in a dirty key log. When the replica comes back, either because its bdev was
+ * registered again or through bdev_kv_mirror_resync, only those keys are copied
+ * to it from a replica in service before it serves reads again. A key written
+ * during its copy is copied again. The log is kept in memory and holds a limited
+ * number of keys; a replica that misses more writes than that stays out of
+ * service.
+ */
+
+#include "spdk/stdinc.h"
+
+#include "vbdev_kv_mirror.h"
+#include "spdk/env.h"
+#include "spdk/likely.h"
+#include "spdk/string.h"
+#include "spdk/thread.h"
+#include "spdk/util.h"
+
+#include "spdk/log.h"
+
+#define KV_MIRROR_DEFAULT_DIRTY_LOG_KEYS	(1024 * 1024)
+/* Keys copied at a time by a resync. */
+#define KV_MIRROR_RESYNC_DEPTH			8
+#define KV_MIRROR_RESYNC_BUF_SIZE		(64 * 1024)
+#define KV_MIRROR_SELECT_ID_SHIFT		3
+SPDK_STATIC_ASSERT(VBDEV_KV_MIRROR_MAX_BASE_BDEVS <= (1 << KV_MIRROR_SELECT_ID_SHIFT),
+		   "Replica index does not fit into the select id");
+
+static int vbdev_kv_mirror_init(void);
+static int vbdev_kv_mirror_get_ctx_size(void);
+static void vbdev_kv_mirror_examine(struct spdk_bdev *bdev);
+static void vbdev_kv_mirror_finish(void);
+static int vbdev_kv_mirror_config_json(struct spdk_json_write_ctx *w);
+
+static struct spdk_bdev_module kv_mirror_if = {
+	.name = "kv_mirror",
+	.module_init = vbdev_kv_mirror_init,
+	.get_ctx_size = vbdev_kv_mirror_get_ctx_size,
+	.examine_config = vbdev_kv_mirror_examine,
+	.module_fini = vbdev_kv_mirror_finish,
+	.config_json = vbdev_kv_mirror_config_json
+};
+
+SPDK_BDEV_MODULE_REGISTER(kv_mirror, &kv_mirror_if)
+
+/* Mirror bdevs requested over RPC, kept so they can be created when their base bdevs appear. */
+struct kv_mirror_config {
+	char				*name;
+	char				*base_bdev_names[VBDEV_KV_MIRROR_MAX_BASE_BDEVS];
+	uint32_t			num_base_bdevs;
+	uint64_t			dirty_log_keys;
+	bool				registered;
+	TAILQ_ENTRY(kv_mirror_config)	link;
+};
+static TAILQ_HEAD(, kv_mirror_config) g_kv_mirror_configs = TAILQ_HEAD_INITIALIZER(
+			g_kv_mirror_configs);
+
+enum kv_mirror_replica_state {
+	/* Serves reads and writes. */
+	KV_MIRROR_REPLICA_ONLINE,
+	/* Open and being brought up to date. */
+	KV_MIRROR_REPLICA_RESYNCING,
+	/* Open but out of service after an error. */
+	KV_MIRROR_REPLICA_FAILED,
+	/* The base bdev was removed. */
+	KV_MIRROR_REPLICA_MISSING,
+};
+
+static const char *g_kv_mirror_replica_states[] = {
+	[KV_MIRROR_REPLICA_ONLINE] = "online",
+	[KV_MIRROR_REPLICA_RESYNCING] = "resyncing",
+	[KV_MIRROR_REPLICA_FAILED] = "failed",
+	[KV_MIRROR_REPLICA_MISSING] = "missing",
+};
+
+struct kv_mirror_replica {
+	char				*name;
+	struct spdk_bdev		*bdev;
+	struct spdk_bdev_desc		*desc;
+	enum kv_mirror_replica_state	state;
+	bool				claimed;
+	/* Base channels are being released, so new channels must not take one. */
+	bool				detaching;
+	/* The replica missed writes that did not fit into the dirty key log. */
+	bool				stale;
+	/* Number of keys in the dirty key log the replica still needs. */
+	uint64_t			dirty_keys;
+};
+
+/* A key written while some replicas were out of service. */
+struct kv_mirror_dirty {
+	TAILQ_ENTRY(kv_mirror_dirty)	link;
+	struct kv_mirror_dirty		*next;
+	uint64_t			hash;
+	/* Bumped on every write of the key. */
+	uint64_t			seq;
+	/* Replicas that missed a write of the key. */
+	uint32_t			replicas;
+	/* Being copied by a resync. */
+	bool				busy;
+	uint8_t				key_len;
+	uint8_t				key[NVME_KV_MAX_KEY_LENGTH];
+};
+
+struct kv_mirror_resync;
+
+struct vbdev_kv_mirror {
+	struct spdk_bdev		bdev;
+	struct kv_mirror_config		*config;
+	struct spdk_thread		*thread;
+	uint32_t			num_replicas;
+	struct kv_mirror_replica	replicas[VBDEV_KV_MIRROR_MAX_BASE_BDEVS];
+
+	/* Protects the replica states and the dirty key log. */
+	pthread_spinlock_t		lock;
+	/* Replicas in the ONLINE state. Read without the lock on the I/O path. */
+	uint32_t			online_mask;
+	uint32_t			all_mask;
+
+	struct kv_mirror_dirty		**dirty_buckets;
+	uint32_t			dirty_mask;
+	TAILQ_HEAD(, kv_mirror_dirty)	dirty;
+	uint64_t			num_dirty;
+	uint64_t			max_dirty;
+
+	/* Resync in progress, NULL if none. */
+	struct kv_mirror_resync		*resync;
+	/* Next dirty key the resync looks at. */
+	struct kv_mirror_dirty		*resync_cursor;
+	/* Replica channel attach and detach operations in progress. */
+	uint32_t			channel_updates;
+	bool				destructing;
+	TAILQ_ENTRY(vbdev_kv_mirror)	link;
+};
+static TAILQ_HEAD(, vbdev_kv_mirror) g_kv_mirror_nodes = TAILQ_HEAD_INITIALIZER(
+			g_kv_mirror_nodes);
+
+struct kv_mirror_io_channel {
+	struct spdk_io_channel	*base_ch[VBDEV_KV_MIRROR_MAX_BASE_BDEVS];
+	/* Commands outstanding on each base channel. */
+	uint32_t		outstanding[VBDEV_KV_MIRROR_MAX_BASE_BDEVS];
+	/* Base channels to release once their outstanding commands are done. */
+	uint32_t		detach_mask;
+	/* Replica looked at first when picking one for a read, to spread ties. */
+	uint32_t		next_read;
+};
+
+struct kv_mirror_child {
+	struct spdk_bdev_io	*orig_io;
+	uint32_t		replica;
+};
+
+struct kv_mirror_bdev_io {
+	struct spdk_io_channel		*ch;
+	struct spdk_bdev_io_wait_entry	bdev_io_wait;
+
+	/* Writes: the replicas written to. Reads: the replicas tried. */
+	uint32_t			targets;
+	/* Writes: the next replica to send the command to. */
+	uint32_t			next;
+	uint32_t			outstanding;
+	uint32_t			succeeded;
+	/* Reads: the replica the command was sent to. */
+	uint32_t			replica;
+
+	/* Status of the first failure, or of the first success of a write. */
+	bool				have_error;
+	uint32_t			cdw0;
+	int				sct;
+	int				sc;
+
+	/* Batched stores: a copy of the entries for each replica. */
+	struct spdk_bdev_kv_batch_entry	*entries;
+	struct kv_mirror_child		children[VBDEV_KV_MIRROR_MAX_BASE_BDEVS];
+};
+
+static void vbdev_kv_mirror_submit_request(struct spdk_io_channel *ch, struct spdk_bdev_io *bdev_io);
+static void kv_mirror_write_submit(void *arg);
+static void kv_mirror_read_submit(void *arg);
+static void kv_mirror_resync_start(struct vbdev_kv_mirror *mirror);
+static void kv_mirror_replica_detach(struct vbdev_kv_mirror *mirror, uint32_t r);
+
+/* Dirty key log */
+
+static struct kv_mirror_dirty **
+kv_mirror_dirty_find(struct vbdev_kv_mirror *mirror, const uint8_t *key, size_t key_len,
+		     uint64_t hash)
+{
+	struct kv_mirror_dirty **pos = &mirror->dirty_buckets[hash & mirror->dirty_mask];
+
+	for (; *pos != NULL; pos = &(*pos)->next) {
+		if ((*pos)->hash == hash && (*pos)->key_len == key_len &&
+		    memcmp((*pos)->key, key, key_len) == 0) {
+			break;
+		}
+	}
+
+	return pos;
+}
+
+static void
+kv_mirror_dirty_remove(struct vbdev_kv_mirror *mirror, struct kv_mirror_dirty *entry)
+{
+	struct kv_mirror_dirty **pos;
+
+	pos = kv_mirror_dirty_find(mirror, entry->key, entry->key_len, entry->hash);
+	assert(*pos == entry);
+	*pos = entry->next;
+
+	if (mirror->resync_cursor == entry) {
+		mirror->resync_cursor = TAILQ_NEXT(entry, link);
+	}
+	TAILQ_REMOVE(&mirror->dirty, entry, link);
+	mirror->num_dirty--;
+	free(entry);
+}
+
+/* Forget the dirty keys of a replica that can no longer be resynced. Called with the lock held. */
+static void
+kv_mirror_mark_stale(struct vbdev_kv_mirror *mirror, uint32_t r)
+{
+	struct kv_mirror_replica *replica = &mirror->replicas[r];
+	struct kv_mirror_dirty *entry, *tmp;
+
+	if (replica->stale) {
+		return;
+	}
+
+	SPDK_ERRLOG("%s: dirty key log is full, replica %s can no longer be resynced\n",
+		    mirror->bdev.name, replica->name);
+	replica->stale = true;
+	replica->dirty_keys = 0;
+	if (replica->state == KV_MIRROR_REPLICA_RESYNCING) {
+		replica->state = KV_MIRROR_REPLICA_FAILED;
+	}
+
+	TAILQ_FOREACH_SAFE(entry, &mirror->dirty, link, tmp) {
+		entry->replicas &= ~(1u << r);
+		if (entry->replicas == 0 && !entry->busy) {
+			kv_mirror_dirty_remove(mirror, entry);
+		}
+	}
+}
+
+/* Remember that the replicas in the mask missed a write of the key. Called with the lock held. */
+static void
+kv_mirror_log_key(struct vbdev_kv_mirror *mirror, const uint8_t *key, size_t key_len,
+		  uint32_t replicas)
+{
+	uint64_t hash = spdk_bdev_kv_key_hash(key, key_len);
+	struct kv_mirror_dirty **pos, *entry;
+	uint32_t r, added;
+
+	for (r = 0; r < mirror->num_replicas; r++) {
+		if (mirror->replicas[r].stale) {
+			replicas &= ~(1u << r);
+		}
+	}
+
+	pos = kv_mirror_dirty_find(mirror, key, key_len, hash);
+	entry = *pos;
+	if (entry == NULL) {
+		if (replicas == 0) {
+			return;
+		}
+		if (mirror->num_dirty < mirror->max_dirty) {
+			entry = calloc(1, sizeof(*entry));
+		}
+		if (entry == NULL) {
+			for (r = 0; r < mirror->num_replicas; r++) {
+				if (replicas & (1u << r)) {
+					kv_mirror_mark_stale(mirror, r);
+				}
+			}
+			return;
+		}
+		entry->hash = hash;
+		entry->key_len = key_len;
+		memcpy(entry->key, key, key_len);
+		*pos = entry;
+		TAILQ_INSERT_TAIL(&mirror->dirty, entry, link);
+		mirror->num_dirty++;
+	}
+
+	added = replicas & ~entry->replicas;
+	for (r = 0; r < mirror->num_replicas; r++) {
+		if (added & (1u << r)) {
+			mirror->replicas[r].dirty_keys++;
+		}
+	}
+	entry->replicas |= replicas;
+	entry->seq++;
+}
+
+/* Replica states */
+
+/*
+ * Take a replica out of service. The last replica in service is kept, as there
+ * is nothing to resync it from. Called with the lock held.
+ */
+static bool
+kv_mirror_fail_replica(struct vbdev_kv_mirror *mirror, uint32_t r)
+{
+	struct kv_mirror_replica *replica = &mirror->replicas[r];
+
+	switch (replica->state) {
+	case KV_MIRROR_REPLICA_ONLINE:
+		if (mirror->online_mask == (1u << r)) {
+			SPDK_ERRLOG("%s: keeping last replica %s in service despite errors\n",
+				    mirror->bdev.name, replica->name);
+			return false;
+		}
+		mirror->online_mask &= ~(1u << r);
+		break;
+	case KV_MIRROR_REPLICA_RESYNCING:
+		break;
+	default:
+		return true;
+	}
+
+	SPDK_ERRLOG("%s: taking replica %s out of service\n", mirror->bdev.name, replica->name);
+	replica->state = KV_MIRROR_REPLICA_FAILED;
+	return true;
+}
+
+/* Errors that say something about the replica rather than the command. */
+static bool
+kv_mirror_is_replica_error(int sct, int sc)
+{
+	if (sct == SPDK_NVME_SCT_GENERIC) {
+		return sc == SPDK_NVME_SC_INTERNAL_DEVICE_ERROR || sc == SPDK_NVME_SC_DATA_TRANSFER_ERROR;
+	}
+
+	return sct == SPDK_NVME_SCT_MEDIA_ERROR || sct == SPDK_NVME_SCT_PATH;
+}
+
+static inline bool
+kv_mirror_status_success(int sct, int sc)
+{
+	return sct == SPDK_NVME_SCT_GENERIC && sc == SPDK_NVME_SC_SUCCESS;
+}
+
+static void
+kv_mirror_ch_put_outstanding(struct kv_mirror_io_channel *mirror_ch, uint32_t r)
+{
+	assert(mirror_ch->outstanding[r] > 0);
+	mirror_ch->outstanding[r]--;
+	if (mirror_ch->outstanding[r] == 0 && (mirror_ch->detach_mask & (1u << r))) {
+		spdk_put_io_channel(mirror_ch->base_ch[r]);
+		mirror_ch->base_ch[r] = NULL;
+		mirror_ch->detach_mask &= ~(1u << r);
+	}
+}
+
+static void
+kv_mirror_io_set_error(struct kv_mirror_bdev_io *io_ctx, uint32_t cdw0, int sct, int sc)
+{
+	if (!io_ctx->have_error) {
+		io_ctx->have_error = true;
+		io_ctx->cdw0 = cdw0;
+		io_ctx->sct = sct;
+		io_ctx->sc = sc;
+	}
+}
+
+/* Writes */
+
+/* A replica failed a write of a key that another replica took. Called with the lock held. */
+static void
+kv_mirror_replica_diverged(struct vbdev_kv_mirror *mirror, uint32_t r, const uint8_t *key,
+			   size_t key_len)
+{
+	if (kv_mirror_fail_replica(mirror, r)) {
+		kv_mirror_log_key(mirror, key, key_len, 1u << r);
+	}
+}
+
+static void
+kv_mirror_batch_finish(struct vbdev_kv_mirror *mirror, struct spdk_bdev_io *bdev_io)
+{
+	struct kv_mirror_bdev_io *io_ctx = (struct kv_mirror_bdev_io *)bdev_io->driver_ctx;
+	struct spdk_bdev_kv_batch_entry *entries = bdev_io->u.bdev.nvme_kv.batch;
+	uint32_t count = bdev_io->u.bdev.nvme_kv.batch_count;
+	struct spdk_bdev_kv_batch_entry *copy, *ok;
+	uint32_t i, r, first = spdk_u32log2(io_ctx->targets & -io_ctx->targets);
+
+	pthread_spin_lock(&mirror->lock);
+	for (i = 0; i < count; i++) {
+		ok = NULL;
+		for (r = 0; r < mirror->num_replicas && ok == NULL; r++) {
+			copy = &io_ctx->entries[r * count + i];
+			if ((io_ctx->succeeded & (1u << r)) && kv_mirror_status_success(copy->sct, copy->sc)) {
+				ok = copy;
+			}
+		}
+
+		if (ok == NULL) {
+			copy = &io_ctx->entries[first * count + i];
+			if (io_ctx->succeeded & (1u << first)) {
+				entries[i].cdw0 = copy->cdw0;
+				entries[i].sct = copy->sct;
+				entries[i].sc = copy->sc;
+			} else {
+				entries[i].cdw0 = io_ctx->cdw0;
+				entries[i].sct = io_ctx->sct;
+				entries[i].sc = io_ctx->sc;
+			}
+			continue;
+		}
+
+		entries[i].cdw0 = ok->cdw0;
+		entries[i].sct = ok->sct;
+		entries[i].sc = ok->sc;
+		for (r = 0; r < mirror->num_replicas; r++) {
+			copy = &io_ctx->entries[r * count + i];
+			if ((io_ctx->targets & (1u << r)) &&
+			    (!(io_ctx->succeeded & (1u << r)) || !kv_mirror_status_success(copy->sct, copy->sc))) {
+				kv_mirror_replica_diverged(mirror, r, entries[i].key, entries[i].key_length);
+			}
+		}
+	}
+	pthread_spin_unlock(&mirror->lock);
+}
+
+static void
+kv_mirror_write_finish(struct spdk_bdev_io *bdev_io)
+{
+	struct vbdev_kv_mirror *mirror = SPDK_CONTAINEROF(bdev_io->bdev, struct vbdev_kv_mirror, bdev);
+	struct kv_mirror_bdev_io *io_ctx = (struct kv_mirror_bdev_io *)bdev_io->driver_ctx;
+	struct spdk_bdev_kv_batch_entry *entries = io_ctx->entries;
+	uint32_t failed = io_ctx->targets & ~io_ctx->succeeded;
+	uint32_t r;
+
+	if (bdev_io->type == SPDK_BDEV_IO_KV_BATCH) {
+		kv_mirror_batch_finish(mirror, bdev_io);
+	} else if (io_ctx->succeeded != 0 && failed != 0) {
+		pthread_spin_lock(&mirror->lock);
+		for (r = 0; r < mirror->num_replicas; r++) {
+			if (failed & (1u << r)) {
+				kv_mirror_replica_diverged(mirror, r, bdev_io->u.bdev.nvme_kv.key,
+							   bdev_io->u.bdev.nvme_kv.key_length);
+			}
+		}
+		pthread_spin_unlock(&mirror->lock);
+	}
+
+	if (io_ctx->succeeded != 0) {
+		spdk_bdev_io_complete_nvme_status(bdev_io, 0, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_SUCCESS);
+	} else {
+		spdk_bdev_io_complete_nvme_status(bdev_io, io_ctx->cdw0, io_ctx->sct, io_ctx->sc);
+	}
+
+	free(entries);
+}
+
+static void
+kv_mirror_write_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct kv_mirror_child *child = cb_arg;
+	struct spdk_bdev_io *orig_io = child->orig_io;
+	struct vbdev_kv_mirror *mirror = SPDK_CONTAINEROF(orig_io->bdev, struct vbdev_kv_mirror, bdev);
+	struct kv_mirror_bdev_io *io_ctx = (struct kv_mirror_bdev_io *)orig_io->driver_ctx;
+	uint32_t cdw0;
+	int sct, sc;
+
+	spdk_bdev_io_get_nvme_status(bdev_io, &cdw0, &sct, &sc);
+	spdk_bdev_free_io(bdev_io);
+	kv_mirror_ch_put_outstanding(spdk_io_channel_get_ctx(io_ctx->ch), child->replica);
+
+	if (success) {
+		io_ctx->succeeded |= 1u << child->replica;
+	} else {
+		kv_mirror_io_set_error(io_ctx, cdw0, sct, sc);
+	}
+
+	io_ctx->outstanding--;
+	if (io_ctx->outstanding > 0 || io_ctx->next < mirror->num_replicas) {
+		return;
+	}
+
+	kv_mirror_write_finish(orig_io);
+}
+
+static int
+kv_mirror_write_submit_one(struct vbdev_kv_mirror *mirror, struct kv_mirror_io_channel *mirror_ch,
+			   struct spdk_bdev_io *bdev_io, uint32_t r)
+{
+	struct kv_mirror_bdev_io *io_ctx = (struct kv_mirror_bdev_io *)bdev_io->driver_ctx;
+	struct kv_mirror_child *child = &io_ctx->children[r];
+	uint32_t count = bdev_io->u.bdev.nvme_kv.batch_count;
+
+	if (mirror_ch->base_ch[r] == NULL) {
+		return -ENODEV;
+	}
+
+	child->orig_io = bdev_io;
+	child->replica = r;
+	if (bdev_io->type == SPDK_BDEV_IO_KV_BATCH) {
+		return spdk_bdev_kv_mput(mirror->replicas[r].desc, mirror_ch->base_ch[r],
+					 &io_ctx->entries[r * count], count, kv_mirror_write_done, child);
+	}
+
+	return spdk_bdev_kv_io_forward(mirror->replicas[r].desc, mirror_ch->base_ch[r], bdev_io,
+				       kv_mirror_write_done, child);
+}
+
+/* Send the write to the replicas it was not sent to yet. */
+static void
+kv_mirror_write_submit(void *arg)
+{
+	struct spdk_bdev_io *bdev_io = arg;
+	struct vbdev_kv_mirror *mirror = SPDK_CONTAINEROF(bdev_io->bdev, struct vbdev_kv_mirror, bdev);
+	struct kv_mirror_bdev_io *io_ctx = (struct kv_mirror_bdev_io *)bdev_io->driver_ctx;
+	struct kv_mirror_io_channel *mirror_ch = spdk_io_channel_get_ctx(io_ctx->ch);
+	uint32_t r;
+	int rc;
+
+	for (; io_ctx->next < mirror->num_replicas; io_ctx->next++) {
+		r = io_ctx->next;
+		if (!(io_ctx->targets & (1u << r))) {
+			continue;
+		}
+
+		rc = kv_mirror_write_submit_one(mirror, mirror_ch, bdev_io, r);
+		if (rc == -ENOMEM) {
+			io_ctx->bdev_io_wait.bdev = mirror->replicas[r].bdev;
+			io_ctx->bdev_io_wait.cb_fn = kv_mirror_write_submit;
+			io_ctx->bdev_io_wait.cb_arg = bdev_io;
+			rc = spdk_bdev_queue_io_wait(mirror->replicas[r].bdev, mirror_ch->base_ch[r],
+						     &io_ctx->bdev_io_wait);
+			if (rc == 0) {
+				return;
+			}
+		}
+		if (rc != 0) {
+			SPDK_ERRLOG("%s: could not submit to %s: %s\n", mirror->bdev.name,
+				    mirror->replicas[r].name, spdk_strerror(-rc));
+			kv_mirror_io_set_error(io_ctx, 0, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+			continue;
+		}
+		mirror_ch->outstanding[r]++;
+		io_ctx->outstanding++;
+	}
+
+	if (io_ctx->outstanding == 0) {
+		kv_mirror_write_finish(bdev_io);
+	}
+}
+
+static void
+kv_mirror_write_start(struct vbdev_kv_mirror *mirror, struct spdk_io_channel *ch,
+		      struct spdk_bdev_io *bdev_io)
+{
+	struct kv_mirror_bdev_io *io_ctx = (struct kv_mirror_bdev_io *)bdev_io->driver_ctx;
+	struct spdk_bdev_kv_batch_entry *entries = bdev_io->u.bdev.nvme_kv.batch;
+	uint32_t count = bdev_io->u.bdev.nvme_kv.batch_count;
+	uint32_t i, r, missing;
+
+	memset(io_ctx, 0, sizeof(*io_ctx));
+	io_ctx->ch = ch;
+
+	if (bdev_io->type == SPDK_BDEV_IO_KV_BATCH && count > 0) {
+		io_ctx->entries = calloc((size_t)mirror->num_replicas * count, sizeof(*io_ctx->entries));
+		if (io_ctx->entries == NULL) {
+			spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_NOMEM);
+			return;
+		}
+		for (r = 0; r < mirror->num_replicas; r++) {
+			memcpy(&io_ctx->entries[r * count], entries, count * sizeof(*entries));
+		}
+	}
+
+	io_ctx->targets = mirror->online_mask;
+	if (spdk_unlikely(io_ctx->targets != mirror->all_mask)) {
+		/* Some replicas are out of service. Pick the targets and log the keys in one go. */
+		pthread_spin_lock(&mirror->lock);
+		io_ctx->targets = mirror->online_mask;
+		missing = mirror->all_mask & ~io_ctx->targets;
+		if (bdev_io->type == SPDK_BDEV_IO_KV_BATCH) {
+			for (i = 0; i < count; i++) {
+				kv_mirror_log_key(mirror, entries[i].key, entries[i].key_length, missing);
+			}
+		} else {
+			kv_mirror_log_key(mirror, bdev_io->u.bdev.nvme_kv.key, bdev_io->u.bdev.nvme_kv.key_length,
+					  missing);
+		}
+		pthread_spin_unlock(&mirror->lock);
+	}
+
+	if (io_ctx->targets == 0) {
+		free(io_ctx->entries);
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		return;
+	}
+
+	kv_mirror_write_submit(bdev_io);
+}
+
+/* Reads */
+
+/* Pick the replica in service with the fewest commands outstanding on this channel. */
+static int
+kv_mirror_pick_replica(struct vbdev_kv_mirror *mirror, struct kv_mirror_io_channel *mirror_ch,
+		       uint32_t exclude)
+{
+	uint32_t online = mirror->online_mask & ~exclude & ~mirror_ch->detach_mask;
+	uint32_t i, r, min_qd = UINT32_MAX;
+	int best = -1;
+
+	for (i = 0; i < mirror->num_replicas; i++) {
+		r = (mirror_ch->next_read + i) % mirror->num_replicas;
+		if (!(online & (1u << r)) || mirror_ch->base_ch[r] == NULL) {
+			continue;
+		}
+		if (mirror_ch->outstanding[r] < min_qd) {
+			min_qd = mirror_ch->outstanding[r];
+			best = r;
+		}
+	}
+	mirror_ch->next_read++;
+
+	return best;
+}
+
+static void
+kv_mirror_read_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct spdk_bdev_io *orig_io = cb_arg;
+	struct vbdev_kv_mirror *mirror = SPDK_CONTAINEROF(orig_io->bdev, struct vbdev_kv_mirror, bdev);
+	struct kv_mirror_bdev_io *io_ctx = (struct kv_mirror_bdev_io *)orig_io->driver_ctx;
+	uint32_t r = io_ctx->replica;
+	uint32_t cdw0;
+	int sct, sc;
+
+	spdk_bdev_io_get_nvme_status(bdev_io, &cdw0, &sct, &sc);
+	spdk_bdev_free_io(bdev_io);
+	kv_mirror_ch_put_outstanding(spdk_io_channel_get_ctx(io_ctx->ch), r);
+
+	if (!success && kv_mirror_is_replica_error(sct, sc) &&
+	    orig_io->type != SPDK_BDEV_IO_KV_RETRIEVE_SELECT) {
+		pthread_spin_lock(&mirror->lock);
+		kv_mirror_fail_replica(mirror, r);
+		pthread_spin_unlock(&mirror->lock);
+
+		/* Try the other replicas. */
+		kv_mirror_io_set_error(io_ctx, cdw0, sct, sc);
+		io_ctx->targets |= 1u << r;
+		kv_mirror_read_submit(orig_io);
+		return;
+	}
+
+	if (success && orig_io->type == SPDK_BDEV_IO_KV_SEND_SELECT) {
+		if (cdw0 >> (32 - KV_MIRROR_SELECT_ID_SHIFT) != 0) {
+			SPDK_ERRLOG("%s: select id %u does not leave room for the replica index\n",
+				    mirror->bdev.name, cdw0);
+			spdk_bdev_io_complete_nvme_status(orig_io, 0, SPDK_NVME_SCT_GENERIC,
+							  SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+			return;
+		}
+		cdw0 = cdw0 << KV_MIRROR_SELECT_ID_SHIFT | r;
+	}
+
+	spdk_bdev_io_complete_nvme_status(orig_io, cdw0, sct, sc);
+}
+
+static void
+kv_mirror_read_submit(void *arg)
+{
+	struct spdk_bdev_io *bdev_io = arg;
+	struct vbdev_kv_mirror *mirror = SPDK_CONTAINEROF(bdev_io->bdev, struct vbdev_kv_mirror, bdev);
+	struct kv_mirror_bdev_io *io_ctx = (struct kv_mirror_bdev_io *)bdev_io->driver_ctx;
+	struct kv_mirror_io_channel *mirror_ch = spdk_io_channel_get_ctx(io_ctx->ch);
+	uint32_t select_id;
+	int r, rc;
+
+	if (bdev_io->type == SPDK_BDEV_IO_KV_RETRIEVE_SELECT) {
+		/* The select lives on the replica that ran SEND SELECT. */
+		select_id = bdev_io->u.bdev.nvme_kv.select_id;
+		r = select_id & ((1 << KV_MIRROR_SELECT_ID_SHIFT) - 1);
+		if ((uint32_t)r >= mirror->num_replicas || mirror_ch->base_ch[r] == NULL) {
+			spdk_bdev_io_complete_nvme_status(bdev_io, 0, SPDK_NVME_SCT_GENERIC,
+							  SPDK_NVME_SC_INVALID_FIELD);
+			return;
+		}
+		io_ctx->replica = r;
+		rc = spdk_bdev_kv_retrieve_selectv(mirror->replicas[r].desc, mirror_ch->base_ch[r],
+						   bdev_io->u.bdev.iovs, bdev_io->u.bdev.iovcnt,
+						   bdev_io->u.bdev.nvme_kv.offset,
+						   bdev_io->u.bdev.nvme_kv.buffer_size,
+						   select_id >> KV_MIRROR_SELECT_ID_SHIFT,
+						   bdev_io->u.bdev.nvme_kv.options, kv_mirror_read_done, bdev_io);
+	} else {
+		r = kv_mirror_pick_replica(mirror, mirror_ch, io_ctx->targets);
+		if (r < 0) {
+			if (io_ctx->have_error) {
+				spdk_bdev_io_complete_nvme_status(bdev_io, io_ctx->cdw0, io_ctx->sct, io_ctx->sc);
+			} else {
+				spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+			}
+			return;
+		}
+		io_ctx->replica = r;
+		rc = spdk_bdev_kv_io_forward(mirror->replicas[r].desc, mirror_ch->base_ch[r], bdev_io,
+					     kv_mirror_read_done, bdev_io);
+	}
+
+	if (rc == 0) {
+		mirror_ch->outstanding[r]++;
+		return;
+	}
+
+	if (rc == -ENOMEM) {
+		io_ctx->bdev_io_wait.bdev = mirror->replicas[r].bdev;
+		io_ctx->bdev_io_wait.cb_fn = kv_mirror_read_submit;
+		io_ctx->bdev_io_wait.cb_arg = bdev_io;
+		rc = spdk_bdev_queue_io_wait(mirror->replicas[r].bdev, mirror_ch->base_ch[r],
+					     &io_ctx->bdev_io_wait);
+		if (rc == 0) {
+			return;
+		}
+		SPDK_ERRLOG("Queue io failed in kv_mirror_read_submit, rc=%d.\n", rc);
+	} else {
+		SPDK_ERRLOG("ERROR on bdev_io submission!\n");
+	}
+	spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+}
+
+static void
+vbdev_kv_mirror_submit_request(struct spdk_io_channel *ch, struct spdk_bdev_io *bdev_io)
+{
+	struct vbdev_kv_mirror *mirror = SPDK_CONTAINEROF(bdev_io->bdev, struct vbdev_kv_mirror, bdev);
+	struct kv_mirror_bdev_io *io_ctx = (struct kv_mirror_bdev_io *)bdev_io->driver_ctx;
+
+	switch (bdev_io->type) {
+	case SPDK_BDEV_IO_KV_STORE:
+	case SPDK_BDEV_IO_KV_DELETE:
+		kv_mirror_write_start(mirror, ch, bdev_io);
+		return;
+	case SPDK_BDEV_IO_KV_BATCH:
+		if (bdev_io->u.bdev.nvme_kv.batch_type == SPDK_BDEV_IO_KV_STORE) {
+			kv_mirror_write_start(mirror, ch, bdev_io);
+			return;
+		}
+	/* fallthrough */
+	case SPDK_BDEV_IO_KV_LIST:
+	case SPDK_BDEV_IO_KV_EXIST:
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+	case SPDK_BDEV_IO_KV_SEND_SELECT:
+	case SPDK_BDEV_IO_KV_RETRIEVE_SELECT:
+		memset(io_ctx, 0, sizeof(*io_ctx));
+		io_ctx->ch = ch;
+		kv_mirror_read_submit(bdev_io);
+		return;
+	default:
+		SPDK_ERRLOG("kv_mirror: unsupported I/O type %d\n", bdev_io->type);
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		return;
+	}
+}
+
+static bool
+vbdev_kv_mirror_io_type_supported(void *ctx, enum spdk_bdev_io_type io_type)
+{
+	struct vbdev_kv_mirror *mirror = ctx;
+	uint32_t i;
+
+	switch (io_type) {
+	case SPDK_BDEV_IO_KV_LIST:
+	case SPDK_BDEV_IO_KV_DELETE:
+	case SPDK_BDEV_IO_KV_EXIST:
+	case SPDK_BDEV_IO_KV_STORE:
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+	case SPDK_BDEV_IO_KV_SEND_SELECT:
+	case SPDK_BDEV_IO_KV_RETRIEVE_SELECT:
+	case SPDK_BDEV_IO_KV_BATCH:
+		/* Support is checked when the bdev is created, as replicas come and go. */
+		for (i = 0; i < mirror->num_replicas; i++) {
+			if (mirror->replicas[i].bdev != NULL && mirror->replicas[i].state == KV_MIRROR_REPLICA_ONLINE &&
+			    !spdk_bdev_io_type_supported(mirror->replicas[i].bdev, io_type)) {
+				return false;
+			}
+		}
+		return true;
+	default:
+		return false;
+	}
+}
+
+static struct spdk_io_channel *
+vbdev_kv_mirror_get_io_channel(void *ctx)
+{
+	return spdk_get_io_channel(ctx);
+}
+
+/* Resync */
+
+enum kv_mirror_resync_step {
+	KV_MIRROR_RESYNC_RETRIEVE,
+	KV_MIRROR_RESYNC_STORE,
+	KV_MIRROR_RESYNC_DELETE,
+};
+
+struct kv_mirror_resync_worker {
+	struct kv_mirror_resync		*resync;
+	struct spdk_bdev_io_wait_entry	bdev_io_wait;
+	enum kv_mirror_resync_step	step;
+	struct kv_mirror_dirty		*entry;
+	uint64_t			seq;
+	uint8_t				key[NVME_KV_MAX_KEY_LENGTH];
+	uint8_t				key_len;
+	void				*buf;
+	uint32_t			buf_size;
+	uint32_t			value_len;
+};
+
+struct kv_mirror_resync {
+	struct vbdev_kv_mirror		*mirror;
+	struct spdk_io_channel		*ch;
+	uint32_t			target;
+	uint32_t			source;
+	uint32_t			active;
+	bool				stop;
+	uint64_t			keys_copied;
+	struct kv_mirror_resync_worker	workers[KV_MIRROR_RESYNC_DEPTH];
+};
+
+static void kv_mirror_resync_next(struct kv_mirror_resync_worker *worker);
+
+static void
+vbdev_kv_mirror_free(struct vbdev_kv_mirror *mirror)
+{
+	struct kv_mirror_dirty *entry;
+	uint32_t i;
+
+	while ((entry = TAILQ_FIRST(&mirror->dirty))) {
+		TAILQ_REMOVE(&mirror->dirty, entry, link);
+		free(entry);
+	}
+	free(mirror->dirty_buckets);
+	for (i = 0; i < mirror->num_replicas; i++) {
+		free(mirror->replicas[i].name);
+	}
+	pthread_spin_destroy(&mirror->lock);
+	free(mirror->bdev.name);
+	free(mirror);
+}
+
+static void
+_device_unregister_cb(void *io_device)
+{
+	vbdev_kv_mirror_free(io_device);
+}
+
+static void
+vbdev_kv_mirror_close_bases(struct vbdev_kv_mirror *mirror)
+{
+	uint32_t i;
+
+	for (i = 0; i < mirror->num_replicas; i++) {
+		if (mirror->replicas[i].claimed) {
+			spdk_bdev_module_release_bdev(mirror->replicas[i].bdev);
+			mirror->replicas[i].claimed = false;
+		}
+		if (mirror->replicas[i].desc != NULL) {
+			spdk_bdev_close(mirror->replicas[i].desc);
+			mirror->replicas[i].desc = NULL;
+		}
+	}
+}
+
+/* Finish the destruct once the resync and channel updates are done. */
+static void
+vbdev_kv_mirror_try_destruct_done(struct vbdev_kv_mirror *mirror)
+{
+	if (!mirror->destructing || mirror->resync != NULL || mirror->channel_updates > 0) {
+		return;
+	}
+
+	vbdev_kv_mirror_close_bases(mirror);
+	spdk_bdev_destruct_done(&mirror->bdev, 0);
+	spdk_io_device_unregister(mirror, _device_unregister_cb);
+}
+
+static void
+kv_mirror_resync_finish(struct kv_mirror_resync *resync)
+{
+	struct vbdev_kv_mirror *mirror = resync->mirror;
+	struct kv_mirror_replica *target = &mirror->replicas[resync->target];
+	uint32_t i;
+
+	pthread_spin_lock(&mirror->lock);
+	if (target->state == KV_MIRROR_REPLICA_RESYNCING && !resync->stop && target->dirty_keys == 0) {
+		target->state = KV_MIRROR_REPLICA_ONLINE;
+		mirror->online_mask |= 1u << resync->target;
+		SPDK_NOTICELOG("%s: replica %s is back in service after copying %" PRIu64 " keys\n",
+			       mirror->bdev.name, target->name, resync->keys_copied);
+	} else if (target->state == KV_MIRROR_REPLICA_RESYNCING) {
+		target->state = KV_MIRROR_REPLICA_FAILED;
+		SPDK_ERRLOG("%s: resync of replica %s stopped\n", mirror->bdev.name, target->name);
+	}
+	pthread_spin_unlock(&mirror->lock);
+
+	for (i = 0; i < KV_MIRROR_RESYNC_DEPTH; i++) {
+		spdk_dma_free(resync->workers[i].buf);
+	}
+	spdk_put_io_channel(resync->ch);
+	free(resync);
+	mirror->resync = NULL;
+
+	if (mirror->destructing) {
+		vbdev_kv_mirror_try_destruct_done(mirror);
+		return;
+	}
+
+	/* Other replicas may be waiting for their turn. */
+	kv_mirror_resync_start(mirror);
+}
+
+static void
+_kv_mirror_resync_pass(void *ctx)
+{
+	struct kv_mirror_resync *resync = ctx;
+	uint32_t i;
+
+	resync->active = KV_MIRROR_RESYNC_DEPTH;
+	for (i = 0; i < KV_MIRROR_RESYNC_DEPTH; i++) {
+		kv_mirror_resync_next(&resync->workers[i]);
+	}
+}
+
+/* A worker ran out of keys. The last one decides whether another pass is needed. */
+static void
+kv_mirror_resync_worker_idle(struct kv_mirror_resync_worker *worker)
+{
+	struct kv_mirror_resync *resync = worker->resync;
+	struct vbdev_kv_mirror *mirror = resync->mirror;
+	bool again;
+
+	if (--resync->active > 0) {
+		return;
+	}
+
+	pthread_spin_lock(&mirror->lock);
+	again = !resync->stop && mirror->replicas[resync->target].state == KV_MIRROR_REPLICA_RESYNCING &&
+		mirror->replicas[resync->target].dirty_keys > 0;
+	if (again) {
+		/* Keys written while they were copied are still in the log. */
+		mirror->resync_cursor = TAILQ_FIRST(&mirror->dirty);
+	}
+	pthread_spin_unlock(&mirror->lock);
+
+	if (again) {
+		spdk_thread_send_msg(spdk_get_thread(), _kv_mirror_resync_pass, resync);
+	} else {
+		kv_mirror_resync_finish(resync);
+	}
+}
+
+static void
+kv_mirror_resync_error(struct kv_mirror_resync_worker *worker, uint32_t r, int sct, int sc)
+{
+	struct kv_mirror_resync *resync = worker->resync;
+	struct vbdev_kv_mirror *mirror = resync->mirror;
+
+	SPDK_ERRLOG("%s: resync I/O on %s failed, sct %d sc %d\n", mirror->bdev.name,
+		    mirror->replicas[r].name, sct, sc);
+
+	pthread_spin_lock(&mirror->lock);
+	worker->entry->busy = false;
+	if (worker->entry->replicas == 0) {
+		kv_mirror_dirty_remove(mirror, worker->entry);
+	}
+	worker->entry = NULL;
+	if (r != resync->target && kv_mirror_is_replica_error(sct, sc)) {
+		kv_mirror_fail_replica(mirror, r);
+	}
+	pthread_spin_unlock(&mirror->lock);
+
+	resync->stop = true;
+	kv_mirror_resync_worker_idle(worker);
+}
+
+static void kv_mirror_resync_submit(void *arg);
+
+static void
+kv_mirror_resync_io_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct kv_mirror_resync_worker *worker = cb_arg;
+	struct kv_mirror_resync *resync = worker->resync;
+	struct vbdev_kv_mirror *mirror = resync->mirror;
+	struct kv_mirror_dirty *entry = worker->entry;
+	uint32_t r = worker->step == KV_MIRROR_RESYNC_RETRIEVE ? resync->source : resync->target;
+	uint32_t cdw0, size;
+	int sct, sc;
+	void *buf;
+
+	spdk_bdev_io_get_nvme_status(bdev_io, &cdw0, &sct, &sc);
+	spdk_bdev_free_io(bdev_io);
+	kv_mirror_ch_put_outstanding(spdk_io_channel_get_ctx(resync->ch), r);
+
+	switch (worker->step) {
+	case KV_MIRROR_RESYNC_RETRIEVE:
+		if (sct == SPDK_NVME_SCT_GENERIC && sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST) {
+			worker->step = KV_MIRROR_RESYNC_DELETE;
+			kv_mirror_resync_submit(worker);
+			return;
+		}
+		if (!success) {
+			kv_mirror_resync_error(worker, r, sct, sc);
+			return;
+		}
+		if (cdw0 > worker->buf_size) {
+			/* cdw0 holds the length of the whole value. Read it again into a larger buffer. */
+			size = SPDK_ALIGN_CEIL(cdw0, KV_MIRROR_RESYNC_BUF_SIZE);
+			buf = spdk_dma_realloc(worker->buf, size, spdk_bdev_get_buf_align(&mirror->bdev), NULL);
+			if (buf == NULL) {
+				kv_mirror_resync_error(worker, resync->target, SPDK_NVME_SCT_GENERIC,
+						       SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+				return;
+			}
+			worker->buf = buf;
+			worker->buf_size = size;
+			kv_mirror_resync_submit(worker);
+			return;
+		}
+		worker->value_len = cdw0;
+		worker->step = KV_MIRROR_RESYNC_STORE;
+		kv_mirror_resync_submit(worker);
+		return;
+	case KV_MIRROR_RESYNC_DELETE:
+		if (sct == SPDK_NVME_SCT_GENERIC && sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST) {
+			success = true;
+		}
+	/* fallthrough */
+	case KV_MIRROR_RESYNC_STORE:
+		if (!success) {
+			kv_mirror_resync_error(worker, r, sct, sc);
+			return;
+		}
+		break;
+	}
+
+	/* The key is up to date on the target unless it was written during the copy. */
+	pthread_spin_lock(&mirror->lock);
+	entry->busy = false;
+	if (entry->seq == worker->seq && (entry->replicas & (1u << resync->target))) {
+		entry->replicas &= ~(1u << resync->target);
+		mirror->replicas[resync->target].dirty_keys--;
+	}
+	if (entry->replicas == 0) {
+		kv_mirror_dirty_remove(mirror, entry);
+	}
+	pthread_spin_unlock(&mirror->lock);
+
+	worker->entry = NULL;
+	resync->keys_copied++;
+	kv_mirror_resync_next(worker);
+}
+
+static void
+kv_mirror_resync_submit(void *arg)
+{
+	struct kv_mirror_resync_worker *worker = arg;
+	struct kv_mirror_resync *resync = worker->resync;
+	struct vbdev_kv_mirror *mirror = resync->mirror;
+	struct kv_mirror_io_channel *mirror_ch = spdk_io_channel_get_ctx(resync->ch);
+	uint32_t r = worker->step == KV_MIRROR_RESYNC_RETRIEVE ? resync->source : resync->target;
+	struct spdk_bdev_desc *desc = mirror->replicas[r].desc;
+	struct spdk_io_channel *ch = mirror_ch->base_ch[r];
+	int rc;
+
+	if (ch == NULL) {
+		kv_mirror_resync_error(worker, r, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+		return;
+	}
+
+	switch (worker->step) {
+	case KV_MIRROR_RESYNC_RETRIEVE:
+		rc = spdk_bdev_kv_retrieve(desc, ch, worker->key, worker->key_len, worker->buf, 0,
+					   worker->buf_size, kv_mirror_resync_io_done, worker);
+		break;
+	case KV_MIRROR_RESYNC_STORE:
+		rc = spdk_bdev_kv_store(desc, ch, worker->key, worker->key_len, worker->buf,
+					worker->value_len, 0, kv_mirror_resync_io_done, worker);
+		break;
+	case KV_MIRROR_RESYNC_DELETE:
+	default:
+		rc = spdk_bdev_kv_delete(desc, ch, worker->key, worker->key_len,
+					 kv_mirror_resync_io_done, worker);
+		break;
+	}
+
+	if (rc == 0) {
+		mirror_ch->outstanding[r]++;
+		return;
+	}
+
+	if (rc == -ENOMEM) {
+		worker->bdev_io_wait.bdev = mirror->replicas[r].bdev;
+		worker->bdev_io_wait.cb_fn = kv_mirror_resync_submit;
+		worker->bdev_io_wait.cb_arg = worker;
+		rc = spdk_bdev_queue_io_wait(mirror->replicas[r].bdev, ch, &worker->bdev_io_wait);
+		if (rc == 0) {
+			return;
+		}
+	}
+
+	kv_mirror_resync_error(worker, r, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+}
+
+/* Take the next dirty key of the target and start copying it. */
+static void
+kv_mirror_resync_next(struct kv_mirror_resync_worker *worker)
+{
+	struct kv_mirror_resync *resync = worker->resync;
+	struct vbdev_kv_mirror *mirror = resync->mirror;
+	struct kv_mirror_dirty *entry = NULL;
+	uint32_t bit = 1u << resync->target;
+
+	pthread_spin_lock(&mirror->lock);
+	if (!resync->stop && mirror->replicas[resync->target].state == KV_MIRROR_REPLICA_RESYNCING &&
+	    (mirror->online_mask & (1u << resync->source))) {
+		for (entry = mirror->resync_cursor; entry != NULL; entry = TAILQ_NEXT(entry, link)) {
+			if ((entry->replicas & bit) && !entry->busy) {
+				break;
+			}
+		}
+		mirror->resync_cursor = entry ? TAILQ_NEXT(entry, link) : NULL;
+	} else {
+		resync->stop = true;
+	}
+	if (entry != NULL) {
+		entry->busy = true;
+		worker->entry = entry;
+		worker->seq = entry->seq;
+		worker->key_len = entry->key_len;
+		memcpy(worker->key, entry->key, entry->key_len);
+	}
+	pthread_spin_unlock(&mirror->lock);
+
+	if (entry == NULL) {
+		kv_mirror_resync_worker_idle(worker);
+		return;
+	}
+
+	worker->step = KV_MIRROR_RESYNC_RETRIEVE;
+	kv_mirror_resync_submit(worker);
+}
+
+/* Start resyncing the next replica waiting for it, if no resync is running. */
+static void
+kv_mirror_resync_start(struct vbdev_kv_mirror *mirror)
+{
+	struct kv_mirror_resync *resync;
+	uint32_t i, target = UINT32_MAX;
+
+	if (mirror->resync != NULL || mirror->destructing || mirror->online_mask == 0) {
+		return;
+	}
+
+	for (i = 0; i < mirror->num_replicas; i++) {
+		if (mirror->replicas[i].state == KV_MIRROR_REPLICA_RESYNCING) {
+			target = i;
+			break;
+		}
+	}
+	if (target == UINT32_MAX) {
+		return;
+	}
+
+	resync = calloc(1, sizeof(*resync));
+	if (resync == NULL) {
+		goto err;
+	}
+
+	resync->mirror = mirror;
+	resync->target = target;
+	resync->source = spdk_u32log2(mirror->online_mask & -mirror->online_mask);
+	resync->ch = spdk_get_io_channel(mirror);
+	if (resync->ch == NULL) {
+		free(resync);
+		goto err;
+	}
+
+	for (i = 0; i < KV_MIRROR_RESYNC_DEPTH; i++) {
+		resync->workers[i].resync = resync;
+		resync->workers[i].buf_size = KV_MIRROR_RESYNC_BUF_SIZE;
+		resync->workers[i].buf = spdk_dma_malloc(KV_MIRROR_RESYNC_BUF_SIZE,
+					 spdk_bdev_get_buf_align(&mirror->bdev), NULL);
+		if (resync->workers[i].buf == NULL) {
+			while (i-- > 0) {
+				spdk_dma_free(resync->workers[i].buf);
+			}
+			spdk_put_io_channel(resync->ch);
+			free(resync);
+			goto err;
+		}
+	}
+
+	SPDK_NOTICELOG("%s: resyncing %" PRIu64 " keys of replica %s from %s\n", mirror->bdev.name,
+		       mirror->replicas[target].dirty_keys, mirror->replicas[target].name,
+		       mirror->replicas[resync->source].name);
+
+	mirror->resync = resync;
+	pthread_spin_lock(&mirror->lock);
+	mirror->resync_cursor = TAILQ_FIRST(&mirror->dirty);
+	pthread_spin_unlock(&mirror->lock);
+
+	_kv_mirror_resync_pass(resync);
+	return;
+
+err:
+	SPDK_ERRLOG("%s: could not start resync of replica %s\n", mirror->bdev.name,
+		    mirror->replicas[target].name);
+	pthread_spin_lock(&mirror->lock);
+	mirror->replicas[target].state = KV_MIRROR_REPLICA_FAILED;
+	pthread_spin_unlock(&mirror->lock);
+}
+
+/* Replica removal and return */
+
+static void
+_kv_mirror_ch_detach(struct spdk_io_channel_iter *i)
+{
+	struct spdk_io_channel *ch = spdk_io_channel_iter_get_channel(i);
+	struct kv_mirror_io_channel *mirror_ch = spdk_io_channel_get_ctx(ch);
+	uint32_t r = (uintptr_t)spdk_io_channel_iter_get_ctx(i);
+
+	if (mirror_ch->base_ch[r] != NULL) {
+		if (mirror_ch->outstanding[r] == 0) {
+			spdk_put_io_channel(mirror_ch->base_ch[r]);
+			mirror_ch->base_ch[r] = NULL;
+		} else {
+			mirror_ch->detach_mask |= 1u << r;
+		}
+	}
+
+	spdk_for_each_channel_continue(i, 0);
+}
+
+static void
+kv_mirror_replica_detach_done(struct spdk_io_channel_iter *i, int status)
+{
+	struct vbdev_kv_mirror *mirror = spdk_io_channel_iter_get_io_device(i);
+	uint32_t r = (uintptr_t)spdk_io_channel_iter_get_ctx(i);
+	struct kv_mirror_replica *replica = &mirror->replicas[r];
+
+	mirror->channel_updates--;
+	if (replica->claimed) {
+		spdk_bdev_module_release_bdev(replica->bdev);
+		replica->claimed = false;
+	}
+	spdk_bdev_close(replica->desc);
+	replica->desc = NULL;
+	replica->detaching = false;
+
+	vbdev_kv_mirror_try_destruct_done(mirror);
+}
+
+/* Release the base channels of a replica on all threads, then close it. */
+static void
+kv_mirror_replica_detach(struct vbdev_kv_mirror *mirror, uint32_t r)
+{
+	mirror->replicas[r].detaching = true;
+	mirror->channel_updates++;
+	spdk_for_each_channel(mirror, _kv_mirror_ch_detach, (void *)(uintptr_t)r,
+			      kv_mirror_replica_detach_done);
+}
+
+static void
+_kv_mirror_ch_attach(struct spdk_io_channel_iter *i)
+{
+	struct vbdev_kv_mirror *mirror = spdk_io_channel_iter_get_io_device(i);
+	struct spdk_io_channel *ch = spdk_io_channel_iter_get_channel(i);
+	struct kv_mirror_io_channel *mirror_ch = spdk_io_channel_get_ctx(ch);
+	uint32_t r = (uintptr_t)spdk_io_channel_iter_get_ctx(i);
+
+	if (mirror_ch->detach_mask & (1u << r)) {
+		/* Commands to the previous instance of the bdev are still outstanding. */
+		spdk_for_each_channel_continue(i, -EBUSY);
+		return;
+	}
+
+	if (mirror_ch->base_ch[r] == NULL) {
+		mirror_ch->base_ch[r] = spdk_bdev_get_io_channel(mirror->replicas[r].desc);
+		if (mirror_ch->base_ch[r] == NULL) {
+			spdk_for_each_channel_continue(i, -ENOMEM);
+			return;
+		}
+	}
+
+	spdk_for_each_channel_continue(i, 0);
+}
+
+static void
+kv_mirror_replica_attach_done(struct spdk_io_channel_iter *i, int status)
+{
+	struct vbdev_kv_mirror *mirror = spdk_io_channel_iter_get_io_device(i);
+	uint32_t r = (uintptr_t)spdk_io_channel_iter_get_ctx(i);
+	struct kv_mirror_replica *replica = &mirror->replicas[r];
+
+	mirror->channel_updates--;
+	if (mirror->destructing) {
+		vbdev_kv_mirror_try_destruct_done(mirror);
+		return;
+	}
+
+	if (status != 0) {
+		SPDK_ERRLOG("%s: could not attach replica %s: %s\n", mirror->bdev.name, replica->name,
+			    spdk_strerror(-status));
+		kv_mirror_replica_detach(mirror, r);
+		return;
+	}
+
+	pthread_spin_lock(&mirror->lock);
+	replica->state = replica->stale ? KV_MIRROR_REPLICA_FAILED : KV_MIRROR_REPLICA_RESYNCING;
+	pthread_spin_unlock(&mirror->lock);
+
+	if (replica->stale) {
+		SPDK_ERRLOG("%s: replica %s missed too many writes to be resynced\n", mirror->bdev.name,
+			    replica->name);
+		return;
+	}
+
+	kv_mirror_resync_start(mirror);
+}
+
+static void
+vbdev_kv_mirror_replica_event_cb(enum spdk_bdev_event_type type, struct spdk_bdev *bdev,
+				 void *event_ctx)
+{
+	struct vbdev_kv_mirror *mirror = event_ctx;
+	uint32_t r, online;
+
+	if (type != SPDK_BDEV_EVENT_REMOVE) {
+		SPDK_NOTICELOG("Unsupported bdev event: type %d\n", type);
+		return;
+	}
+
+	for (r = 0; r < mirror->num_replicas; r++) {
+		if (mirror->replicas[r].bdev == bdev && mirror->replicas[r].desc != NULL) {
+			break;
+		}
+	}
+	if (r == mirror->num_replicas || mirror->destructing || mirror->replicas[r].detaching) {
+		return;
+	}
+
+	pthread_spin_lock(&mirror->lock);
+	mirror->replicas[r].state = KV_MIRROR_REPLICA_MISSING;
+	mirror->online_mask &= ~(1u << r);
+	online = mirror->online_mask;
+	pthread_spin_unlock(&mirror->lock);
+
+	if (online == 0) {
+		SPDK_ERRLOG("%s: no replica left in service\n", mirror->bdev.name);
+		spdk_bdev_unregister(&mirror->bdev, NULL, NULL);
+		return;
+	}
+
+	SPDK_NOTICELOG("%s: replica %s removed\n", mirror->bdev.name, mirror->replicas[r].name);
+	kv_mirror_replica_detach(mirror, r);
+}
+
+static int
+kv_mirror_replica_open(struct vbdev_kv_mirror *mirror, uint32_t r)
+{
+	struct kv_mirror_replica *replica = &mirror->replicas[r];
+	int rc;
+
+	rc = spdk_bdev_open_ext(replica->name, true, vbdev_kv_mirror_replica_event_cb, mirror,
+				&replica->desc);
+	if (rc) {
+		SPDK_ERRLOG("could not open bdev %s\n", replica->name);
+		return rc;
+	}
+	replica->bdev = spdk_bdev_desc_get_bdev(replica->desc);
+
+	if (!spdk_bdev_io_type_supported(replica->bdev, SPDK_BDEV_IO_KV_RETRIEVE)) {
+		SPDK_ERRLOG("bdev %s does not support KV commands\n", replica->name);
+		rc = -ENOTSUP;
+		goto close;
+	}
+
+	rc = spdk_bdev_module_claim_bdev(replica->bdev, replica->desc, &kv_mirror_if);
+	if (rc) {
+		SPDK_ERRLOG("could not claim bdev %s\n", replica->name);
+		goto close;
+	}
+	replica->claimed = true;
+
+	return 0;
+
+close:
+	spdk_bdev_close(replica->desc);
+	replica->desc = NULL;
+	return rc;
+}
+
+/* A removed replica is back. Open it and resync it. */
+static void
+kv_mirror_replica_reopen(struct vbdev_kv_mirror *mirror, uint32_t r)
+{
+	if (kv_mirror_replica_open(mirror, r) != 0) {
+		return;
+	}
+
+	SPDK_NOTICELOG("%s: replica %s is back\n", mirror->bdev.name, mirror->replicas[r].name);
+	mirror->channel_updates++;
+	spdk_for_each_channel(mirror, _kv_mirror_ch_attach, (void *)(uintptr_t)r,
+			      kv_mirror_replica_attach_done);
+}
+
+/* Bdev */
+
+static void
+vbdev_kv_mirror_write_params_json(struct vbdev_kv_mirror *mirror, struct spdk_json_write_ctx *w)
+{
+	uint32_t i;
+
+	spdk_json_write_named_string(w, "name", spdk_bdev_get_name(&mirror->bdev));
+	spdk_json_write_named_array_begin(w, "base_bdevs");
+	for (i = 0; i < mirror->num_replicas; i++) {
+		spdk_json_write_string(w, mirror->replicas[i].name);
+	}
+	spdk_json_write_array_end(w);
+	spdk_json_write_named_uint64(w, "dirty_log_keys", mirror->max_dirty);
+}
+
+static int
+vbdev_kv_mirror_dump_info_json(void *ctx, struct spdk_json_write_ctx *w)
+{
+	struct vbdev_kv_mirror *mirror = ctx;
+	struct kv_mirror_replica *replica;
+	uint32_t i;
+
+	spdk_json_write_name(w, "kv_mirror");
+	spdk_json_write_object_begin(w);
+	vbdev_kv_mirror_write_params_json(mirror, w);
+	spdk_json_write_named_array_begin(w, "replicas");
+	pthread_spin_lock(&mirror->lock);
+	for (i = 0; i < mirror->num_replicas; i++) {
+		replica = &mirror->replicas[i];
+		spdk_json_write_object_begin(w);
+		spdk_json_write_named_string(w, "name", replica->name);
+		spdk_json_write_named_string(w, "state", g_kv_mirror_replica_states[replica->state]);
+		spdk_json_write_named_uint64(w, "dirty_keys", replica->dirty_keys);
+		spdk_json_write_named_bool(w, "stale", replica->stale);
+		spdk_json_write_object_end(w);
+	}
+	pthread_spin_unlock(&mirror->lock);
+	spdk_json_write_array_end(w);
+	spdk_json_write_object_end(w);
+
+	return 0;
+}
+
+static int
+vbdev_kv_mirror_config_json(struct spdk_json_write_ctx *w)
+{
+	struct vbdev_kv_mirror *mirror;
+
+	TAILQ_FOREACH(mirror, &g_kv_mirror_nodes, link) {
+		spdk_json_write_object_begin(w);
+		spdk_json_write_named_string(w, "method", "bdev_kv_mirror_create");
+		spdk_json_write_named_object_begin(w, "params");
+		vbdev_kv_mirror_write_params_json(mirror, w);
+		spdk_json_write_object_end(w);
+		spdk_json_write_object_end(w);
+	}
+	return 0;
+}
+
+static void
+vbdev_kv_mirror_write_config_json(struct spdk_bdev *bdev, struct spdk_json_write_ctx *w)
+{
+	/* No config per bdev needed */
+}
+
+static void
+_vbdev_kv_mirror_destruct(void *ctx)
+{
+	struct vbdev_kv_mirror *mirror = ctx;
+
+	mirror->destructing = true;
+	if (mirror->resync != NULL) {
+		/* The resync finishes the destruct once its commands are done. */
+		mirror->resync->stop = true;
+		return;
+	}
+
+	vbdev_kv_mirror_try_destruct_done(mirror);
+}
+
+static int
+vbdev_kv_mirror_destruct(void *ctx)
+{
+	struct vbdev_kv_mirror *mirror = ctx;
+
+	TAILQ_REMOVE(&g_kv_mirror_nodes, mirror, link);
+	if (mirror->config != NULL) {
+		mirror->config->registered = false;
+	}
+
+	/* Close the underlying bdevs on their same opened thread. */
+	if (mirror->thread && mirror->thread != spdk_get_thread()) {
+		spdk_thread_send_msg(mirror->thread, _vbdev_kv_mirror_destruct, mirror);
+	} else {
+		_vbdev_kv_mirror_destruct(mirror);
+	}
+
+	return 1;
+}
+
+static const struct spdk_bdev_fn_table vbdev_kv_mirror_fn_table = {
+	.destruct		= vbdev_kv_mirror_destruct,
+	.submit_request		= vbdev_kv_mirror_submit_request,
+	.io_type_supported	= vbdev_kv_mirror_io_type_supported,
+	.get_io_channel		= vbdev_kv_mirror_get_io_channel,
+	.dump_info_json		= vbdev_kv_mirror_dump_info_json,
+	.write_config_json	= vbdev_kv_mirror_write_config_json,
+};
+
+static void
+kv_mirror_ch_destroy_cb(void *io_device, void *ctx_buf)
+{
+	struct kv_mirror_io_channel *mirror_ch = ctx_buf;
+	uint32_t i;
+
+	for (i = 0; i < VBDEV_KV_MIRROR_MAX_BASE_BDEVS; i++) {
+		if (mirror_ch->base_ch[i] != NULL) {
+			spdk_put_io_channel(mirror_ch->base_ch[i]);
+		}
+	}
+}
+
+static int
+kv_mirror_ch_create_cb(void *io_device, void *ctx_buf)
+{
+	struct kv_mirror_io_channel *mirror_ch = ctx_buf;
+	struct vbdev_kv_mirror *mirror = io_device;
+	uint32_t i;
+
+	for (i = 0; i < mirror->num_replicas; i++) {
+		if (mirror->replicas[i].desc == NULL || mirror->replicas[i].detaching) {
+			continue;
+		}
+		mirror_ch->base_ch[i] = spdk_bdev_get_io_channel(mirror->replicas[i].desc);
+		if (mirror_ch->base_ch[i] == NULL) {
+			kv_mirror_ch_destroy_cb(io_device, ctx_buf);
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+static int
+vbdev_kv_mirror_register(struct kv_mirror_config *config)
+{
+	struct vbdev_kv_mirror *mirror;
+	struct spdk_bdev *bdev;
+	uint32_t i;
+	int rc;
+
+	/* Only go ahead once all base bdevs are there. */
+	for (i = 0; i < config->num_base_bdevs; i++) {
+		if (spdk_bdev_get_by_name(config->base_bdev_names[i]) == NULL) {
+			return -ENODEV;
+		}
+	}
+
+	mirror = calloc(1, sizeof(*mirror));
+	if (mirror == NULL) {
+		return -ENOMEM;
+	}
+	pthread_spin_init(&mirror->lock, PTHREAD_PROCESS_PRIVATE);
+	TAILQ_INIT(&mirror->dirty);
+	mirror->num_replicas = config->num_base_bdevs;
+	mirror->max_dirty = config->dirty_log_keys;
+
+	mirror->bdev.name = strdup(config->name);
+	mirror->dirty_mask = spdk_align32pow2(spdk_max(mirror->max_dirty / 2, 1024)) - 1;
+	mirror->dirty_buckets = calloc(mirror->dirty_mask + 1, sizeof(*mirror->dirty_buckets));
+	for (i = 0; i < mirror->num_replicas; i++) {
+		mirror->replicas[i].name = strdup(config->base_bdev_names[i]);
+		if (mirror->replicas[i].name == NULL) {
+			break;
+		}
+	}
+	if (mirror->bdev.name == NULL || mirror->dirty_buckets == NULL || i < mirror->num_replicas) {
+		vbdev_kv_mirror_free(mirror);
+		return -ENOMEM;
+	}
+	mirror->bdev.product_name = "kv_mirror";
+
+	for (i = 0; i < mirror->num_replicas; i++) {
+		rc = kv_mirror_replica_open(mirror, i);
+		if (rc) {
+			goto close_bases;
+		}
+
+		bdev = mirror->replicas[i].bdev;
+		mirror->bdev.required_alignment = spdk_max(mirror->bdev.required_alignment,
+					  bdev->required_alignment);
+		if (i == 0 || bdev->blockcnt < mirror->bdev.blockcnt) {
+			mirror->bdev.blockcnt = bdev->blockcnt;
+		}
+		mirror->online_mask |= 1u << i;
+	}
+	mirror->all_mask = mirror->online_mask;
+	mirror->bdev.blocklen = mirror->replicas[0].bdev->blocklen;
+
+	mirror->bdev.ctxt = mirror;
+	mirror->bdev.fn_table = &vbdev_kv_mirror_fn_table;
+	mirror->bdev.module = &kv_mirror_if;
+	mirror->thread = spdk_get_thread();
+	mirror->config = config;
+
+	spdk_io_device_register(mirror, kv_mirror_ch_create_cb, kv_mirror_ch_destroy_cb,
+				sizeof(struct kv_mirror_io_channel), config->name);
+
+	rc = spdk_bdev_register(&mirror->bdev);
+	if (rc) {
+		SPDK_ERRLOG("could not register kv_mirror bdev %s\n", config->name);
+		spdk_io_device_unregister(mirror, NULL);
+		goto close_bases;
+	}
+
+	TAILQ_INSERT_TAIL(&g_kv_mirror_nodes, mirror, link);
+	config->registered = true;
+	SPDK_NOTICELOG("created kv_mirror bdev %s over %u bdevs\n", config->name, mirror->num_replicas);
+	return 0;
+
+close_bases:
+	vbdev_kv_mirror_close_bases(mirror);
+	vbdev_kv_mirror_free(mirror);
+	return rc;
+}
+
+static void
+kv_mirror_config_free(struct kv_mirror_config *config)
+{
+	uint32_t i;
+
+	for (i = 0; i < config->num_base_bdevs; i++) {
+		free(config->base_bdev_names[i]);
+	}
+	free(config->name);
+	free(config);
+}
+
+int
+bdev_kv_mirror_create(const struct vbdev_kv_mirror_opts *opts)
+{
+	struct kv_mirror_config *config;
+	uint32_t i, j;
+	int rc;
+
+	if (opts->name == NULL || opts->num_base_bdevs < 2 ||
+	    opts->num_base_bdevs > VBDEV_KV_MIRROR_MAX_BASE_BDEVS) {
+		return -EINVAL;
+	}
+
+	for (i = 0; i < opts->num_base_bdevs; i++) {
+		if (opts->base_bdev_names[i] == NULL) {
+			return -EINVAL;
+		}
+		for (j = 0; j < i; j++) {
+			if (strcmp(opts->base_bdev_names[i], opts->base_bdev_names[j]) == 0) {
+				SPDK_ERRLOG("base bdev %s given twice\n", opts->base_bdev_names[i]);
+				return -EINVAL;
+			}
+		}
+	}
+
+	TAILQ_FOREACH(config, &g_kv_mirror_configs, link) {
+		if (strcmp(config->name, opts->name) == 0) {
+			SPDK_ERRLOG("kv_mirror bdev %s already exists\n", opts->name);
+			return -EEXIST;
+		}
+	}
+
+	config = calloc(1, sizeof(*config));
+	if (config == NULL) {
+		return -ENOMEM;
+	}
+
+	config->name = strdup(opts->name);
+	if (config->name == NULL) {
+		kv_mirror_config_free(config);
+		return -ENOMEM;
+	}
+	for (i = 0; i < opts->num_base_bdevs; i++) {
+		config->base_bdev_names[i] = strdup(opts->base_bdev_names[i]);
+		if (config->base_bdev_names[i] == NULL) {
+			kv_mirror_config_free(config);
+			return -ENOMEM;
+		}
+		config->num_base_bdevs++;
+	}
+	config->dirty_log_keys = opts->dirty_log_keys ? opts->dirty_log_keys :
+				 KV_MIRROR_DEFAULT_DIRTY_LOG_KEYS;
+
+	rc = vbdev_kv_mirror_register(config);
+	if (rc == -ENODEV) {
+		SPDK_NOTICELOG("kv_mirror creation deferred pending base bdev arrival\n");
+		rc = 0;
+	} else if (rc != 0) {
+		kv_mirror_config_free(config);
+		return rc;
+	}
+
+	TAILQ_INSERT_TAIL(&g_kv_mirror_configs, config, link);
+	return 0;
+}
+
+void
+bdev_kv_mirror_delete(const char *name, spdk_bdev_unregister_cb cb_fn, void *cb_arg)
+{
+	struct kv_mirror_config *config;
+	struct vbdev_kv_mirror *mirror;
+	int rc;
+
+	rc = spdk_bdev_unregister_by_name(name, &kv_mirror_if, cb_fn, cb_arg);
+	if (rc != 0) {
+		cb_fn(cb_arg, rc);
+		return;
+	}
+
+	/* Forget the bdev so it is not re-created when its base bdevs come back. */
+	TAILQ_FOREACH(config, &g_kv_mirror_configs, link) {
+		if (strcmp(config->name, name) == 0) {
+			TAILQ_FOREACH(mirror, &g_kv_mirror_nodes, link) {
+				if (mirror->config == config) {
+					mirror->config = NULL;
+				}
+			}
+			TAILQ_REMOVE(&g_kv_mirror_configs, config, link);
+			kv_mirror_config_free(config);
+			break;
+		}
+	}
+}
+
+int
+bdev_kv_mirror_resync(const char *name)
+{
+	struct vbdev_kv_mirror *mirror;
+	uint32_t i;
+
+	TAILQ_FOREACH(mirror, &g_kv_mirror_nodes, link) {
+		if (strcmp(spdk_bdev_get_name(&mirror->bdev), name) == 0) {
+			break;
+		}
+	}
+	if (mirror == NULL) {
+		return -ENODEV;
+	}
+
+	pthread_spin_lock(&mirror->lock);
+	for (i = 0; i < mirror->num_replicas; i++) {
+		if (mirror->replicas[i].state == KV_MIRROR_REPLICA_FAILED && !mirror->replicas[i].stale) {
+			mirror->replicas[i].state = KV_MIRROR_REPLICA_RESYNCING;
+		}
+	}
+	pthread_spin_unlock(&mirror->lock);
+
+	kv_mirror_resync_start(mirror);
+	return 0;
+}
+
+static int
+vbdev_kv_mirror_init(void)
+{
+	return 0;
+}
+
+static void
+vbdev_kv_mirror_finish(void)
+{
+	struct kv_mirror_config *config;
+
+	while ((config = TAILQ_FIRST(&g_kv_mirror_configs))) {
+		TAILQ_REMOVE(&g_kv_mirror_configs, config, link);
+		kv_mirror_config_free(config);
+	}
+}
+
+static int
+vbdev_kv_mirror_get_ctx_size(void)
+{
+	return sizeof(struct kv_mirror_bdev_io);
+}
+
+static void
+vbdev_kv_mirror_examine(struct spdk_bdev *bdev)
+{
+	struct kv_mirror_config *config;
+	struct vbdev_kv_mirror *mirror;
+	uint32_t i;
+
+	TAILQ_FOREACH(config, &g_kv_mirror_configs, link) {
+		if (config->registered) {
+			continue;
+		}
+		for (i = 0; i < config->num_base_bdevs; i++) {
+			if (strcmp(config->base_bdev_names[i], bdev->name) == 0) {
+				vbdev_kv_mirror_register(config);
+				break;
+			}
+		}
+	}
+
+	TAILQ_FOREACH(mirror, &g_kv_mirror_nodes, link) {
+		for (i = 0; i < mirror->num_replicas; i++) {
+			if (mirror->replicas[i].state == KV_MIRROR_REPLICA_MISSING &&
+			    mirror->replicas[i].desc == NULL && !mirror->destructing &&
+			    strcmp(mirror->replicas[i].name, bdev->name) == 0) {
+				kv_mirror_replica_reopen(mirror, i);
+			}
+		}
+	}
+
+	spdk_bdev_module_examine_done(&kv_mirror_if);
+}
+
+SPDK_LOG_REGISTER_COMPONENT(vbdev_kv_mirror)
@@ -0,0 +1,58 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+#ifndef SPDK_VBDEV_KV_MIRROR_H
+#define SPDK_VBDEV_KV_MIRROR_H
+
+#include "spdk/stdinc.h"
+
+#include "spdk/bdev.h"
+#include "spdk/bdev_module.h"
+
+#define VBDEV_KV_MIRROR_MAX_BASE_BDEVS	8
+
+struct vbdev_kv_mirror_opts {
+	const char *name;
+	const char *const *base_bdev_names;
+	uint32_t num_base_bdevs;
+	/*
+	 * Number of keys remembered as changed while a replica is out of service.
+	 * A replica that misses more writes than that cannot be resynced. 0 selects
+	 * the default.
+	 */
+	uint64_t dirty_log_keys;
+};
+
+/**
+ * Create a KV bdev that keeps the same keys on several KV capable bdevs. The
+ * base bdevs must hold the same keys already; they are not copied. If some of
+ * the base bdevs do not exist yet, the bdev is created once all of them showed up.
+ *
+ * \param opts Creation options.
+ *
+ * \return 0 on success, negated errno otherwise.
+ */
+int bdev_kv_mirror_create(const struct vbdev_kv_mirror_opts *opts);
+
+/**
+ * Delete a KV mirror bdev. The base bdevs are left as they are.
+ *
+ * \param name Name of the mirror bdev.
+ * \param cb_fn Function to call after deletion.
+ * \param cb_arg Argument to pass to cb_fn.
+ */
+void bdev_kv_mirror_delete(const char *name, spdk_bdev_unregister_cb cb_fn, void *cb_arg);
+
+/**
+ * Bring the replicas of a KV mirror bdev that were taken out of service after
+ * an error back in. Each one is resynced first.
+ *
+ * \param name Name of the mirror bdev.
+ *
+ * \return 0 on success, negated errno otherwise.
+ *   * -ENODEV - there is no such mirror bdev
+ */
+int bdev_kv_mirror_resync(const char *name);
+
+#endif /* SPDK_VBDEV_KV_MIRROR_H */
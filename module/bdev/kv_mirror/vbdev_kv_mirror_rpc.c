@@ -0,0 +1,167 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+#include "spdk/rpc.h"
+#include "spdk/util.h"
+#include "spdk/string.h"
+#include "spdk/bdev_module.h"
+#include "spdk/log.h"
+
+#include "vbdev_kv_mirror.h"
+
+struct rpc_bdev_kv_mirror_base_bdevs {
+	size_t num_base_bdevs;
+	char *base_bdevs[VBDEV_KV_MIRROR_MAX_BASE_BDEVS];
+};
+
+struct rpc_bdev_kv_mirror_create {
+	char *name;
+	struct rpc_bdev_kv_mirror_base_bdevs base_bdevs;
+	uint64_t dirty_log_keys;
+};
+
+static void
+free_rpc_bdev_kv_mirror_create(struct rpc_bdev_kv_mirror_create *req)
+{
+	size_t i;
+
+	free(req->name);
+	for (i = 0; i < req->base_bdevs.num_base_bdevs; i++) {
+		free(req->base_bdevs.base_bdevs[i]);
+	}
+}
+
+static int
+decode_base_bdevs(const struct spdk_json_val *val, void *out)
+{
+	struct rpc_bdev_kv_mirror_base_bdevs *base_bdevs = out;
+
+	return spdk_json_decode_array(val, spdk_json_decode_string, base_bdevs->base_bdevs,
+				      VBDEV_KV_MIRROR_MAX_BASE_BDEVS, &base_bdevs->num_base_bdevs,
+				      sizeof(char *));
+}
+
+static const struct spdk_json_object_decoder rpc_bdev_kv_mirror_create_decoders[] = {
+	{"name", offsetof(struct rpc_bdev_kv_mirror_create, name), spdk_json_decode_string},
+	{"base_bdevs", offsetof(struct rpc_bdev_kv_mirror_create, base_bdevs), decode_base_bdevs},
+	{"dirty_log_keys", offsetof(struct rpc_bdev_kv_mirror_create, dirty_log_keys), spdk_json_decode_uint64, true},
+};
+
+static void
+rpc_bdev_kv_mirror_create(struct spdk_jsonrpc_request *request,
+			  const struct spdk_json_val *params)
+{
+	struct rpc_bdev_kv_mirror_create req = {};
+	struct vbdev_kv_mirror_opts opts = {};
+	struct spdk_json_write_ctx *w;
+	int rc;
+
+	if (spdk_json_decode_object(params, rpc_bdev_kv_mirror_create_decoders,
+				    SPDK_COUNTOF(rpc_bdev_kv_mirror_create_decoders),
+				    &req)) {
+		SPDK_DEBUGLOG(vbdev_kv_mirror, "spdk_json_decode_object failed\n");
+		spdk_jsonrpc_send_error_response(request, SPDK_JSONRPC_ERROR_INTERNAL_ERROR,
+						 "spdk_json_decode_object failed");
+		goto cleanup;
+	}
+
+	if (req.base_bdevs.num_base_bdevs < 2) {
+		spdk_jsonrpc_send_error_response(request, -EINVAL,
+						 "At least two base bdevs are required");
+		goto cleanup;
+	}
+
+	opts.name = req.name;
+	opts.base_bdev_names = (const char *const *)req.base_bdevs.base_bdevs;
+	opts.num_base_bdevs = req.base_bdevs.num_base_bdevs;
+	opts.dirty_log_keys = req.dirty_log_keys;
+	rc = bdev_kv_mirror_create(&opts);
+	if (rc != 0) {
+		spdk_jsonrpc_send_error_response(request, rc, spdk_strerror(-rc));
+		goto cleanup;
+	}
+
+	w = spdk_jsonrpc_begin_result(request);
+	spdk_json_write_string(w, req.name);
+	spdk_jsonrpc_end_result(request, w);
+
+cleanup:
+	free_rpc_bdev_kv_mirror_create(&req);
+}
+SPDK_RPC_REGISTER("bdev_kv_mirror_create", rpc_bdev_kv_mirror_create, SPDK_RPC_RUNTIME)
+
+struct rpc_bdev_kv_mirror_name {
+	char *name;
+};
+
+static void
+free_rpc_bdev_kv_mirror_name(struct rpc_bdev_kv_mirror_name *req)
+{
+	free(req->name);
+}
+
+static const struct spdk_json_object_decoder rpc_bdev_kv_mirror_name_decoders[] = {
+	{"name", offsetof(struct rpc_bdev_kv_mirror_name, name), spdk_json_decode_string},
+};
+
+static void
+rpc_bdev_kv_mirror_delete_cb(void *cb_arg, int bdeverrno)
+{
+	struct spdk_jsonrpc_request *request = cb_arg;
+
+	if (bdeverrno == 0) {
+		spdk_jsonrpc_send_bool_response(request, true);
+	} else {
+		spdk_jsonrpc_send_error_response(request, bdeverrno, spdk_strerror(-bdeverrno));
+	}
+}
+
+static void
+rpc_bdev_kv_mirror_delete(struct spdk_jsonrpc_request *request,
+			  const struct spdk_json_val *params)
+{
+	struct rpc_bdev_kv_mirror_name req = {NULL};
+
+	if (spdk_json_decode_object(params, rpc_bdev_kv_mirror_name_decoders,
+				    SPDK_COUNTOF(rpc_bdev_kv_mirror_name_decoders),
+				    &req)) {
+		spdk_jsonrpc_send_error_response(request, SPDK_JSONRPC_ERROR_INTERNAL_ERROR,
+						 "spdk_json_decode_object failed");
+		goto cleanup;
+	}
+
+	bdev_kv_mirror_delete(req.name, rpc_bdev_kv_mirror_delete_cb, request);
+
+cleanup:
+	free_rpc_bdev_kv_mirror_name(&req);
+}
+SPDK_RPC_REGISTER("bdev_kv_mirror_delete", rpc_bdev_kv_mirror_delete, SPDK_RPC_RUNTIME)
+
+static void
+rpc_bdev_kv_mirror_resync(struct spdk_jsonrpc_request *request,
+			  const struct spdk_json_val *params)
+{
+	struct rpc_bdev_kv_mirror_name req = {NULL};
+	int rc;
+
+	if (spdk_json_decode_object(params, rpc_bdev_kv_mirror_name_decoders,
+				    SPDK_COUNTOF(rpc_bdev_kv_mirror_name_decoders),
+				    &req)) {
+		spdk_jsonrpc_send_error_response(request, SPDK_JSONRPC_ERROR_INTERNAL_ERROR,
+						 "spdk_json_decode_object failed");
+		goto cleanup;
+	}
+
+	rc = bdev_kv_mirror_resync(req.name);
+	if (rc != 0) {
+		spdk_jsonrpc_send_error_response(request, rc, spdk_strerror(-rc));
+		goto cleanup;
+	}
+
+	spdk_jsonrpc_send_bool_response(request, true);
+
+cleanup:
+	free_rpc_bdev_kv_mirror_name(&req);
+}
+SPDK_RPC_REGISTER("bdev_kv_mirror_resync", rpc_bdev_kv_mirror_resync, SPDK_RPC_RUNTIME)
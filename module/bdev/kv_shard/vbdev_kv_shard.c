@@ -0,0 +1,1109 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+/*
+ * KV sharding. Spreads the keys of one logical KV store over several KV capable
+ * base bdevs. Every key lives on exactly one base bdev, picked by a hash of the
+ * key, so commands on a single key are passed to a single base bdev.
+ *
+ * LIST is sent to all base bdevs and their sorted key lists are merged. Each base
+ * bdev returns as many keys as fit in the buffer, so the merge stops at the last
+ * key of any list that filled up; keys past it might be missing from that list.
+ * Batched commands are split by base bdev and sent to all of them at once.
+ *
+ * SELECT queries the value of one key and goes to that key's base bdev. The
+ * select id handed back carries the index of the base bdev in its low bits, so
+ * RETRIEVE SELECT, which has no key, is sent to the same one.
+ *
+ * Keys are not moved when the set of base bdevs changes.
+ */
+
+#include "spdk/stdinc.h"
+
+#include "vbdev_kv_shard.h"
+#include "spdk/env.h"
+#include "spdk/likely.h"
+#include "spdk/string.h"
+#include "spdk/thread.h"
+#include "spdk/util.h"
+
+#include "spdk/log.h"
+
+/* Points per base bdev on the hash ring. */
+#define KV_SHARD_RING_POINTS		128
+#define KV_SHARD_SELECT_ID_SHIFT	5
+SPDK_STATIC_ASSERT(VBDEV_KV_SHARD_MAX_BASE_BDEVS <= (1 << KV_SHARD_SELECT_ID_SHIFT),
+		   "Base bdev index does not fit into the select id");
+
+static int vbdev_kv_shard_init(void);
+static int vbdev_kv_shard_get_ctx_size(void);
+static void vbdev_kv_shard_examine(struct spdk_bdev *bdev);
+static void vbdev_kv_shard_finish(void);
+static int vbdev_kv_shard_config_json(struct spdk_json_write_ctx *w);
+
+static struct spdk_bdev_module kv_shard_if = {
+	.name = "kv_shard",
+	.module_init = vbdev_kv_shard_init,
+	.get_ctx_size = vbdev_kv_shard_get_ctx_size,
+	.examine_config = vbdev_kv_shard_examine,
+	.module_fini = vbdev_kv_shard_finish,
+	.config_json = vbdev_kv_shard_config_json
+};
+
+SPDK_BDEV_MODULE_REGISTER(kv_shard, &kv_shard_if)
+
+/* Shard bdevs requested over RPC, kept so they can be created when their base bdevs appear. */
+struct kv_shard_config {
+	char				*name;
+	char				*base_bdev_names[VBDEV_KV_SHARD_MAX_BASE_BDEVS];
+	uint32_t			num_base_bdevs;
+	enum vbdev_kv_shard_hash	hash;
+	bool				registered;
+	TAILQ_ENTRY(kv_shard_config)	link;
+};
+static TAILQ_HEAD(, kv_shard_config) g_kv_shard_configs = TAILQ_HEAD_INITIALIZER(
+			g_kv_shard_configs);
+
+struct kv_shard_ring_point {
+	uint64_t	hash;
+	uint32_t	base;
+};
+
+struct kv_shard_base {
+	struct spdk_bdev	*bdev;
+	struct spdk_bdev_desc	*desc;
+	bool			claimed;
+};
+
+struct vbdev_kv_shard {
+	struct spdk_bdev		bdev;
+	struct kv_shard_config		*config;
+	struct spdk_thread		*thread;
+	enum vbdev_kv_shard_hash	hash;
+	struct kv_shard_ring_point	*ring;
+	uint32_t			ring_size;
+	uint32_t			num_bases;
+	struct kv_shard_base		bases[VBDEV_KV_SHARD_MAX_BASE_BDEVS];
+	TAILQ_ENTRY(vbdev_kv_shard)	link;
+};
+static TAILQ_HEAD(, vbdev_kv_shard) g_kv_shard_nodes = TAILQ_HEAD_INITIALIZER(g_kv_shard_nodes);
+
+struct kv_shard_io_channel {
+	struct spdk_io_channel	*base_ch[VBDEV_KV_SHARD_MAX_BASE_BDEVS];
+};
+
+struct kv_shard_bdev_io {
+	struct spdk_io_channel		*ch;
+	struct spdk_bdev_io_wait_entry	bdev_io_wait;
+
+	/* Commands sent to several base bdevs. */
+	uint32_t			next_base;
+	uint32_t			outstanding;
+	bool				failed;
+	uint32_t			cdw0;
+	int				sct;
+	int				sc;
+
+	/* LIST: one buffer per base bdev. */
+	uint8_t				*bufs;
+	uint32_t			buf_size;
+
+	/* BATCH: the entries sorted by base bdev and their index in the original batch. */
+	struct spdk_bdev_kv_batch_entry	*entries;
+	uint32_t			*orig_index;
+	uint32_t			batch_start[VBDEV_KV_SHARD_MAX_BASE_BDEVS + 1];
+};
+
+static void vbdev_kv_shard_submit_request(struct spdk_io_channel *ch, struct spdk_bdev_io *bdev_io);
+static void kv_shard_scatter(void *arg);
+
+/* Hashing */
+
+static inline uint64_t
+kv_shard_hash(const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	uint64_t h = 0xcbf29ce484222325ULL;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h = (h ^ p[i]) * 0x100000001b3ULL;
+	}
+
+	return spdk_bdev_kv_fmix64(h);
+}
+
+/* Jump consistent hash, Lamping and Veach. */
+static uint32_t
+kv_shard_jump(uint64_t key, uint32_t num_buckets)
+{
+	int64_t b = -1, j = 0;
+
+	while (j < num_buckets) {
+		b = j;
+		key = key * 2862933555777941757ULL + 1;
+		j = (b + 1) * ((double)(1LL << 31) / (double)((key >> 33) + 1));
+	}
+
+	return b;
+}
+
+static uint32_t
+kv_shard_ring_lookup(struct vbdev_kv_shard *shard, uint64_t hash)
+{
+	uint32_t lo = 0, hi = shard->ring_size, mid;
+
+	/* First point at or after the hash, wrapping around to the first one. */
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (shard->ring[mid].hash < hash) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return shard->ring[lo == shard->ring_size ? 0 : lo].base;
+}
+
+static uint32_t
+kv_shard_base_of(struct vbdev_kv_shard *shard, const uint8_t *key, size_t key_len)
+{
+	uint64_t hash = kv_shard_hash(key, key_len);
+
+	if (shard->hash == VBDEV_KV_SHARD_HASH_RING) {
+		return kv_shard_ring_lookup(shard, hash);
+	}
+
+	return kv_shard_jump(hash, shard->num_bases);
+}
+
+static int
+kv_shard_ring_point_cmp(const void *a, const void *b)
+{
+	const struct kv_shard_ring_point *pa = a, *pb = b;
+
+	if (pa->hash != pb->hash) {
+		return pa->hash < pb->hash ? -1 : 1;
+	}
+	return (int)pa->base - (int)pb->base;
+}
+
+static int
+kv_shard_ring_init(struct vbdev_kv_shard *shard)
+{
+	const char *name;
+	uint64_t point[2];
+	uint32_t i, j;
+
+	shard->ring_size = shard->num_bases * KV_SHARD_RING_POINTS;
+	shard->ring = calloc(shard->ring_size, sizeof(*shard->ring));
+	if (shard->ring == NULL) {
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < shard->num_bases; i++) {
+		name = spdk_bdev_get_name(shard->bases[i].bdev);
+		point[0] = kv_shard_hash(name, strlen(name));
+		for (j = 0; j < KV_SHARD_RING_POINTS; j++) {
+			point[1] = j;
+			shard->ring[i * KV_SHARD_RING_POINTS + j].hash = kv_shard_hash(point, sizeof(point));
+			shard->ring[i * KV_SHARD_RING_POINTS + j].base = i;
+		}
+	}
+	qsort(shard->ring, shard->ring_size, sizeof(*shard->ring), kv_shard_ring_point_cmp);
+
+	return 0;
+}
+
+/* I/O path */
+
+static void
+kv_shard_complete_io(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct spdk_bdev_io *orig_io = cb_arg;
+
+	spdk_bdev_kv_io_complete_from(orig_io, bdev_io);
+	spdk_bdev_free_io(bdev_io);
+}
+
+static void
+kv_shard_send_select_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct spdk_bdev_io *orig_io = cb_arg;
+	struct vbdev_kv_shard *shard = SPDK_CONTAINEROF(orig_io->bdev, struct vbdev_kv_shard, bdev);
+	uint32_t select_id;
+	int sct, sc;
+
+	spdk_bdev_io_get_nvme_status(bdev_io, &select_id, &sct, &sc);
+	spdk_bdev_free_io(bdev_io);
+
+	if (success) {
+		if (select_id >> (32 - KV_SHARD_SELECT_ID_SHIFT) != 0) {
+			SPDK_ERRLOG("%s: select id %u does not leave room for the base bdev index\n",
+				    shard->bdev.name, select_id);
+			spdk_bdev_io_complete_nvme_status(orig_io, 0, SPDK_NVME_SCT_GENERIC,
+							  SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+			return;
+		}
+		select_id = select_id << KV_SHARD_SELECT_ID_SHIFT |
+			    kv_shard_base_of(shard, orig_io->u.bdev.nvme_kv.key, orig_io->u.bdev.nvme_kv.key_length);
+	}
+
+	spdk_bdev_io_complete_nvme_status(orig_io, select_id, sct, sc);
+}
+
+/* Record the status of a failed part of a scattered command. The first failure wins. */
+static void
+kv_shard_scatter_fail(struct kv_shard_bdev_io *io_ctx, uint32_t cdw0, int sct, int sc)
+{
+	if (!io_ctx->failed) {
+		io_ctx->failed = true;
+		io_ctx->cdw0 = cdw0;
+		io_ctx->sct = sct;
+		io_ctx->sc = sc;
+	}
+}
+
+static int
+kv_shard_key_cmp(const uint8_t *a, uint16_t a_len, const uint8_t *b, uint16_t b_len)
+{
+	int rc;
+
+	rc = memcmp(a, b, spdk_min(a_len, b_len));
+	return rc ? rc : (int)a_len - (int)b_len;
+}
+
+/*
+ * Parse the key list of one base bdev. Returns the end of the listed keys, or 0
+ * if the list is malformed.
+ */
+static uint32_t
+kv_shard_list_parse(const uint8_t *buf, uint32_t buf_size)
+{
+	uint32_t num, i, pos = sizeof(num);
+	uint16_t key_len;
+
+	memcpy(&num, buf, sizeof(num));
+	for (i = 0; i < num; i++) {
+		if (pos + sizeof(key_len) > buf_size) {
+			return 0;
+		}
+		memcpy(&key_len, buf + pos, sizeof(key_len));
+		if (key_len > NVME_KV_MAX_KEY_LENGTH || pos + sizeof(key_len) + key_len > buf_size) {
+			return 0;
+		}
+		pos += sizeof(key_len) + SPDK_ALIGN_CEIL(key_len, 4);
+	}
+
+	return pos;
+}
+
+static void
+kv_shard_list_merge(struct vbdev_kv_shard *shard, struct spdk_bdev_io *bdev_io)
+{
+	struct kv_shard_bdev_io *io_ctx = (struct kv_shard_bdev_io *)bdev_io->driver_ctx;
+	uint32_t size = io_ctx->buf_size;
+	uint8_t *out = io_ctx->bufs + shard->num_bases * size;
+	uint32_t pos[VBDEV_KV_SHARD_MAX_BASE_BDEVS], end[VBDEV_KV_SHARD_MAX_BASE_BDEVS];
+	const uint8_t *bound = NULL, *key, *min_key;
+	uint32_t i, min, out_pos = sizeof(uint32_t), num = 0, p, last = 0;
+	uint16_t bound_len = 0, key_len, min_len = 0;
+
+	memset(out, 0, size);
+	for (i = 0; i < shard->num_bases; i++) {
+		pos[i] = sizeof(uint32_t);
+		end[i] = kv_shard_list_parse(io_ctx->bufs + i * size, size);
+		if (end[i] == 0) {
+			SPDK_ERRLOG("%s: malformed key list from %s\n", shard->bdev.name,
+				    spdk_bdev_get_name(shard->bases[i].bdev));
+			spdk_bdev_io_complete_nvme_status(bdev_io, 0, SPDK_NVME_SCT_GENERIC,
+							  SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+			return;
+		}
+
+		/* A list that might have been cut short bounds the merged one by its last key. */
+		if (end[i] + sizeof(key_len) + NVME_KV_MAX_KEY_LENGTH > size && end[i] > pos[i]) {
+			for (p = pos[i]; p < end[i]; p += sizeof(key_len) + SPDK_ALIGN_CEIL(key_len, 4)) {
+				memcpy(&key_len, io_ctx->bufs + i * size + p, sizeof(key_len));
+				last = p;
+			}
+			memcpy(&key_len, io_ctx->bufs + i * size + last, sizeof(key_len));
+			key = io_ctx->bufs + i * size + last + sizeof(key_len);
+			if (bound == NULL || kv_shard_key_cmp(key, key_len, bound, bound_len) < 0) {
+				bound = key;
+				bound_len = key_len;
+			}
+		}
+	}
+
+	for (;;) {
+		min = shard->num_bases;
+		min_key = NULL;
+		for (i = 0; i < shard->num_bases; i++) {
+			if (pos[i] == end[i]) {
+				continue;
+			}
+			memcpy(&key_len, io_ctx->bufs + i * size + pos[i], sizeof(key_len));
+			key = io_ctx->bufs + i * size + pos[i] + sizeof(key_len);
+			if (min_key == NULL || kv_shard_key_cmp(key, key_len, min_key, min_len) < 0) {
+				min = i;
+				min_key = key;
+				min_len = key_len;
+			}
+		}
+		if (min_key == NULL ||
+		    (bound != NULL && kv_shard_key_cmp(min_key, min_len, bound, bound_len) > 0) ||
+		    out_pos + sizeof(min_len) + SPDK_ALIGN_CEIL(min_len, 4) > size) {
+			break;
+		}
+
+		memcpy(out + out_pos, &min_len, sizeof(min_len));
+		memcpy(out + out_pos + sizeof(min_len), min_key, min_len);
+		out_pos += sizeof(min_len) + SPDK_ALIGN_CEIL(min_len, 4);
+		pos[min] += sizeof(min_len) + SPDK_ALIGN_CEIL(min_len, 4);
+		num++;
+	}
+	memcpy(out, &num, sizeof(num));
+
+	spdk_copy_buf_to_iovs(bdev_io->u.bdev.iovs, bdev_io->u.bdev.iovcnt, out, out_pos);
+	spdk_bdev_io_complete_nvme_status(bdev_io, num, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_SUCCESS);
+}
+
+static void
+kv_shard_scatter_done(struct spdk_bdev_io *orig_io)
+{
+	struct vbdev_kv_shard *shard = SPDK_CONTAINEROF(orig_io->bdev, struct vbdev_kv_shard, bdev);
+	struct kv_shard_bdev_io *io_ctx = (struct kv_shard_bdev_io *)orig_io->driver_ctx;
+	uint8_t *bufs = io_ctx->bufs;
+	struct spdk_bdev_kv_batch_entry *entries = io_ctx->entries;
+
+	if (io_ctx->failed) {
+		spdk_bdev_io_complete_nvme_status(orig_io, io_ctx->cdw0, io_ctx->sct, io_ctx->sc);
+	} else if (orig_io->type == SPDK_BDEV_IO_KV_LIST) {
+		kv_shard_list_merge(shard, orig_io);
+	} else {
+		spdk_bdev_io_complete(orig_io, SPDK_BDEV_IO_STATUS_SUCCESS);
+	}
+
+	spdk_dma_free(bufs);
+	free(entries);
+}
+
+static void
+kv_shard_scatter_part_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct spdk_bdev_io *orig_io = cb_arg;
+	struct kv_shard_bdev_io *io_ctx = (struct kv_shard_bdev_io *)orig_io->driver_ctx;
+	struct spdk_bdev_kv_batch_entry *entries = orig_io->u.bdev.nvme_kv.batch;
+	struct spdk_bdev_kv_batch_entry *entry;
+	uint32_t cdw0, i;
+	int sct, sc;
+
+	spdk_bdev_io_get_nvme_status(bdev_io, &cdw0, &sct, &sc);
+	spdk_bdev_free_io(bdev_io);
+
+	if (!success) {
+		kv_shard_scatter_fail(io_ctx, cdw0, sct, sc);
+	}
+
+	io_ctx->outstanding--;
+	if (io_ctx->outstanding > 0 || io_ctx->next_base < SPDK_CONTAINEROF(orig_io->bdev,
+			struct vbdev_kv_shard, bdev)->num_bases) {
+		return;
+	}
+
+	if (orig_io->type == SPDK_BDEV_IO_KV_BATCH) {
+		for (i = 0; i < orig_io->u.bdev.nvme_kv.batch_count; i++) {
+			entry = &io_ctx->entries[i];
+			entries[io_ctx->orig_index[i]].cdw0 = entry->cdw0;
+			entries[io_ctx->orig_index[i]].sct = entry->sct;
+			entries[io_ctx->orig_index[i]].sc = entry->sc;
+		}
+	}
+
+	kv_shard_scatter_done(orig_io);
+}
+
+static int
+kv_shard_batch_submit(struct vbdev_kv_shard *shard, struct kv_shard_io_channel *shard_ch,
+		      struct spdk_bdev_io *bdev_io, uint32_t base)
+{
+	struct kv_shard_bdev_io *io_ctx = (struct kv_shard_bdev_io *)bdev_io->driver_ctx;
+	struct spdk_bdev_kv_batch_entry *entries = &io_ctx->entries[io_ctx->batch_start[base]];
+	uint32_t count = io_ctx->batch_start[base + 1] - io_ctx->batch_start[base];
+	struct spdk_bdev_desc *desc = shard->bases[base].desc;
+	struct spdk_io_channel *ch = shard_ch->base_ch[base];
+
+	switch (bdev_io->u.bdev.nvme_kv.batch_type) {
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+		return spdk_bdev_kv_mget(desc, ch, entries, count, kv_shard_scatter_part_done, bdev_io);
+	case SPDK_BDEV_IO_KV_STORE:
+		return spdk_bdev_kv_mput(desc, ch, entries, count, kv_shard_scatter_part_done, bdev_io);
+	case SPDK_BDEV_IO_KV_EXIST:
+		return spdk_bdev_kv_mexist(desc, ch, entries, count, kv_shard_scatter_part_done, bdev_io);
+	default:
+		return -EINVAL;
+	}
+}
+
+/* Send the parts of a LIST or BATCH that were not sent yet. */
+static void
+kv_shard_scatter(void *arg)
+{
+	struct spdk_bdev_io *bdev_io = arg;
+	struct vbdev_kv_shard *shard = SPDK_CONTAINEROF(bdev_io->bdev, struct vbdev_kv_shard, bdev);
+	struct kv_shard_bdev_io *io_ctx = (struct kv_shard_bdev_io *)bdev_io->driver_ctx;
+	struct kv_shard_io_channel *shard_ch = spdk_io_channel_get_ctx(io_ctx->ch);
+	uint32_t base;
+	int rc;
+
+	for (; io_ctx->next_base < shard->num_bases; io_ctx->next_base++) {
+		base = io_ctx->next_base;
+		if (bdev_io->type == SPDK_BDEV_IO_KV_LIST) {
+			rc = spdk_bdev_kv_list(shard->bases[base].desc, shard_ch->base_ch[base],
+					       bdev_io->u.bdev.nvme_kv.key, bdev_io->u.bdev.nvme_kv.key_length,
+					       io_ctx->bufs + base * io_ctx->buf_size, io_ctx->buf_size,
+					       kv_shard_scatter_part_done, bdev_io);
+		} else if (io_ctx->batch_start[base + 1] > io_ctx->batch_start[base]) {
+			rc = kv_shard_batch_submit(shard, shard_ch, bdev_io, base);
+		} else {
+			continue;
+		}
+
+		if (rc == -ENOMEM) {
+			io_ctx->bdev_io_wait.bdev = shard->bases[base].bdev;
+			io_ctx->bdev_io_wait.cb_fn = kv_shard_scatter;
+			io_ctx->bdev_io_wait.cb_arg = bdev_io;
+			rc = spdk_bdev_queue_io_wait(shard->bases[base].bdev, shard_ch->base_ch[base],
+						     &io_ctx->bdev_io_wait);
+			if (rc == 0) {
+				return;
+			}
+		}
+		if (rc != 0) {
+			SPDK_ERRLOG("%s: could not submit to %s: %s\n", shard->bdev.name,
+				    spdk_bdev_get_name(shard->bases[base].bdev), spdk_strerror(-rc));
+			kv_shard_scatter_fail(io_ctx, 0, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+			io_ctx->next_base = shard->num_bases;
+			break;
+		}
+		io_ctx->outstanding++;
+	}
+
+	if (io_ctx->outstanding == 0) {
+		kv_shard_scatter_done(bdev_io);
+	}
+}
+
+static int
+kv_shard_scatter_start(struct vbdev_kv_shard *shard, struct spdk_io_channel *ch,
+		       struct spdk_bdev_io *bdev_io)
+{
+	struct kv_shard_bdev_io *io_ctx = (struct kv_shard_bdev_io *)bdev_io->driver_ctx;
+	struct spdk_bdev_kv_batch_entry *entries = bdev_io->u.bdev.nvme_kv.batch;
+	uint32_t count = bdev_io->u.bdev.nvme_kv.batch_count;
+	uint32_t i, base, *next;
+
+	memset(io_ctx, 0, sizeof(*io_ctx));
+	io_ctx->ch = ch;
+
+	if (bdev_io->type == SPDK_BDEV_IO_KV_LIST) {
+		io_ctx->buf_size = bdev_io->u.bdev.nvme_kv.buffer_size;
+		if (io_ctx->buf_size < sizeof(uint32_t)) {
+			return -EINVAL;
+		}
+		/* One buffer per base bdev and one for the merged list. */
+		io_ctx->bufs = spdk_dma_malloc((uint64_t)(shard->num_bases + 1) * io_ctx->buf_size,
+					       spdk_bdev_get_buf_align(&shard->bdev), NULL);
+		return io_ctx->bufs == NULL ? -ENOMEM : 0;
+	}
+
+	if (count == 0) {
+		return 0;
+	}
+
+	io_ctx->entries = calloc(count, sizeof(*io_ctx->entries) + sizeof(*io_ctx->orig_index));
+	if (io_ctx->entries == NULL) {
+		return -ENOMEM;
+	}
+	io_ctx->orig_index = (uint32_t *)&io_ctx->entries[count];
+
+	/* Count the keys of each base bdev, then place them at the start of their base's range. */
+	for (i = 0; i < count; i++) {
+		base = kv_shard_base_of(shard, entries[i].key, entries[i].key_length);
+		io_ctx->batch_start[base + 1]++;
+	}
+	for (base = 0; base < shard->num_bases; base++) {
+		io_ctx->batch_start[base + 1] += io_ctx->batch_start[base];
+	}
+
+	next = calloc(shard->num_bases, sizeof(*next));
+	if (next == NULL) {
+		free(io_ctx->entries);
+		io_ctx->entries = NULL;
+		return -ENOMEM;
+	}
+	memcpy(next, io_ctx->batch_start, shard->num_bases * sizeof(*next));
+	for (i = 0; i < count; i++) {
+		base = kv_shard_base_of(shard, entries[i].key, entries[i].key_length);
+		io_ctx->entries[next[base]] = entries[i];
+		io_ctx->orig_index[next[base]] = i;
+		next[base]++;
+	}
+	free(next);
+
+	return 0;
+}
+
+static void
+vbdev_kv_shard_resubmit_io(void *arg)
+{
+	struct spdk_bdev_io *bdev_io = (struct spdk_bdev_io *)arg;
+	struct kv_shard_bdev_io *io_ctx = (struct kv_shard_bdev_io *)bdev_io->driver_ctx;
+
+	vbdev_kv_shard_submit_request(io_ctx->ch, bdev_io);
+}
+
+static void
+vbdev_kv_shard_queue_io(struct spdk_bdev_io *bdev_io, uint32_t base)
+{
+	struct vbdev_kv_shard *shard = SPDK_CONTAINEROF(bdev_io->bdev, struct vbdev_kv_shard, bdev);
+	struct kv_shard_bdev_io *io_ctx = (struct kv_shard_bdev_io *)bdev_io->driver_ctx;
+	struct kv_shard_io_channel *shard_ch = spdk_io_channel_get_ctx(io_ctx->ch);
+	int rc;
+
+	io_ctx->bdev_io_wait.bdev = shard->bases[base].bdev;
+	io_ctx->bdev_io_wait.cb_fn = vbdev_kv_shard_resubmit_io;
+	io_ctx->bdev_io_wait.cb_arg = bdev_io;
+
+	rc = spdk_bdev_queue_io_wait(shard->bases[base].bdev, shard_ch->base_ch[base],
+				     &io_ctx->bdev_io_wait);
+	if (rc != 0) {
+		SPDK_ERRLOG("Queue io failed in vbdev_kv_shard_queue_io, rc=%d.\n", rc);
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+	}
+}
+
+static void
+vbdev_kv_shard_submit_request(struct spdk_io_channel *ch, struct spdk_bdev_io *bdev_io)
+{
+	struct vbdev_kv_shard *shard = SPDK_CONTAINEROF(bdev_io->bdev, struct vbdev_kv_shard, bdev);
+	struct kv_shard_io_channel *shard_ch = spdk_io_channel_get_ctx(ch);
+	struct kv_shard_bdev_io *io_ctx = (struct kv_shard_bdev_io *)bdev_io->driver_ctx;
+	spdk_bdev_io_completion_cb cb = kv_shard_complete_io;
+	uint32_t base, select_id;
+	int rc;
+
+	switch (bdev_io->type) {
+	case SPDK_BDEV_IO_KV_LIST:
+	case SPDK_BDEV_IO_KV_BATCH:
+		rc = kv_shard_scatter_start(shard, ch, bdev_io);
+		if (rc != 0) {
+			spdk_bdev_io_complete(bdev_io, rc == -ENOMEM ? SPDK_BDEV_IO_STATUS_NOMEM :
+					      SPDK_BDEV_IO_STATUS_FAILED);
+			return;
+		}
+		kv_shard_scatter(bdev_io);
+		return;
+	case SPDK_BDEV_IO_KV_RETRIEVE_SELECT:
+		select_id = bdev_io->u.bdev.nvme_kv.select_id;
+		base = select_id & ((1 << KV_SHARD_SELECT_ID_SHIFT) - 1);
+		if (base >= shard->num_bases) {
+			spdk_bdev_io_complete_nvme_status(bdev_io, 0, SPDK_NVME_SCT_GENERIC,
+							  SPDK_NVME_SC_INVALID_FIELD);
+			return;
+		}
+		rc = spdk_bdev_kv_retrieve_selectv(shard->bases[base].desc, shard_ch->base_ch[base],
+						   bdev_io->u.bdev.iovs, bdev_io->u.bdev.iovcnt,
+						   bdev_io->u.bdev.nvme_kv.offset,
+						   bdev_io->u.bdev.nvme_kv.buffer_size,
+						   select_id >> KV_SHARD_SELECT_ID_SHIFT,
+						   bdev_io->u.bdev.nvme_kv.options, kv_shard_complete_io, bdev_io);
+		break;
+	case SPDK_BDEV_IO_KV_SEND_SELECT:
+		cb = kv_shard_send_select_done;
+	/* fallthrough */
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+	case SPDK_BDEV_IO_KV_EXIST:
+	case SPDK_BDEV_IO_KV_STORE:
+	case SPDK_BDEV_IO_KV_DELETE:
+		base = kv_shard_base_of(shard, bdev_io->u.bdev.nvme_kv.key,
+					bdev_io->u.bdev.nvme_kv.key_length);
+		rc = spdk_bdev_kv_io_forward(shard->bases[base].desc, shard_ch->base_ch[base], bdev_io,
+					     cb, bdev_io);
+		break;
+	default:
+		SPDK_ERRLOG("kv_shard: unsupported I/O type %d\n", bdev_io->type);
+		spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		return;
+	}
+
+	if (rc != 0) {
+		if (rc == -ENOMEM) {
+			io_ctx->ch = ch;
+			vbdev_kv_shard_queue_io(bdev_io, base);
+		} else {
+			SPDK_ERRLOG("ERROR on bdev_io submission!\n");
+			spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_FAILED);
+		}
+	}
+}
+
+static bool
+vbdev_kv_shard_io_type_supported(void *ctx, enum spdk_bdev_io_type io_type)
+{
+	struct vbdev_kv_shard *shard = ctx;
+	uint32_t i;
+
+	switch (io_type) {
+	case SPDK_BDEV_IO_KV_LIST:
+	case SPDK_BDEV_IO_KV_DELETE:
+	case SPDK_BDEV_IO_KV_EXIST:
+	case SPDK_BDEV_IO_KV_STORE:
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+	case SPDK_BDEV_IO_KV_SEND_SELECT:
+	case SPDK_BDEV_IO_KV_RETRIEVE_SELECT:
+	case SPDK_BDEV_IO_KV_BATCH:
+		for (i = 0; i < shard->num_bases; i++) {
+			if (!spdk_bdev_io_type_supported(shard->bases[i].bdev, io_type)) {
+				return false;
+			}
+		}
+		return true;
+	default:
+		/* Block addresses have no meaning across the base bdevs. */
+		return false;
+	}
+}
+
+static struct spdk_io_channel *
+vbdev_kv_shard_get_io_channel(void *ctx)
+{
+	return spdk_get_io_channel(ctx);
+}
+
+static void
+vbdev_kv_shard_write_params_json(struct vbdev_kv_shard *shard, struct spdk_json_write_ctx *w)
+{
+	uint32_t i;
+
+	spdk_json_write_named_string(w, "name", spdk_bdev_get_name(&shard->bdev));
+	spdk_json_write_named_array_begin(w, "base_bdevs");
+	for (i = 0; i < shard->num_bases; i++) {
+		spdk_json_write_string(w, spdk_bdev_get_name(shard->bases[i].bdev));
+	}
+	spdk_json_write_array_end(w);
+	spdk_json_write_named_string(w, "hash", shard->hash == VBDEV_KV_SHARD_HASH_RING ? "ring" : "jump");
+}
+
+static int
+vbdev_kv_shard_dump_info_json(void *ctx, struct spdk_json_write_ctx *w)
+{
+	struct vbdev_kv_shard *shard = ctx;
+
+	spdk_json_write_name(w, "kv_shard");
+	spdk_json_write_object_begin(w);
+	vbdev_kv_shard_write_params_json(shard, w);
+	spdk_json_write_object_end(w);
+
+	return 0;
+}
+
+static int
+vbdev_kv_shard_config_json(struct spdk_json_write_ctx *w)
+{
+	struct vbdev_kv_shard *shard;
+
+	TAILQ_FOREACH(shard, &g_kv_shard_nodes, link) {
+		spdk_json_write_object_begin(w);
+		spdk_json_write_named_string(w, "method", "bdev_kv_shard_create");
+		spdk_json_write_named_object_begin(w, "params");
+		vbdev_kv_shard_write_params_json(shard, w);
+		spdk_json_write_object_end(w);
+		spdk_json_write_object_end(w);
+	}
+	return 0;
+}
+
+static void
+vbdev_kv_shard_write_config_json(struct spdk_bdev *bdev, struct spdk_json_write_ctx *w)
+{
+	/* No config per bdev needed */
+}
+
+static void
+vbdev_kv_shard_free(struct vbdev_kv_shard *shard)
+{
+	free(shard->ring);
+	free(shard->bdev.name);
+	free(shard);
+}
+
+static void
+_device_unregister_cb(void *io_device)
+{
+	vbdev_kv_shard_free(io_device);
+}
+
+static void
+vbdev_kv_shard_close_bases(struct vbdev_kv_shard *shard)
+{
+	uint32_t i;
+
+	for (i = 0; i < shard->num_bases; i++) {
+		if (shard->bases[i].claimed) {
+			spdk_bdev_module_release_bdev(shard->bases[i].bdev);
+			shard->bases[i].claimed = false;
+		}
+		if (shard->bases[i].desc != NULL) {
+			spdk_bdev_close(shard->bases[i].desc);
+			shard->bases[i].desc = NULL;
+		}
+	}
+}
+
+/* Second half of the destruct, on the thread the base bdevs were opened on. */
+static void
+_vbdev_kv_shard_destruct(void *ctx)
+{
+	struct vbdev_kv_shard *shard = ctx;
+
+	vbdev_kv_shard_close_bases(shard);
+	spdk_bdev_destruct_done(&shard->bdev, 0);
+	spdk_io_device_unregister(shard, _device_unregister_cb);
+}
+
+static int
+vbdev_kv_shard_destruct(void *ctx)
+{
+	struct vbdev_kv_shard *shard = ctx;
+
+	TAILQ_REMOVE(&g_kv_shard_nodes, shard, link);
+	if (shard->config != NULL) {
+		shard->config->registered = false;
+	}
+
+	if (shard->thread && shard->thread != spdk_get_thread()) {
+		spdk_thread_send_msg(shard->thread, _vbdev_kv_shard_destruct, shard);
+		return 1;
+	}
+
+	vbdev_kv_shard_close_bases(shard);
+	spdk_io_device_unregister(shard, _device_unregister_cb);
+
+	return 0;
+}
+
+static const struct spdk_bdev_fn_table vbdev_kv_shard_fn_table = {
+	.destruct		= vbdev_kv_shard_destruct,
+	.submit_request		= vbdev_kv_shard_submit_request,
+	.io_type_supported	= vbdev_kv_shard_io_type_supported,
+	.get_io_channel		= vbdev_kv_shard_get_io_channel,
+	.dump_info_json		= vbdev_kv_shard_dump_info_json,
+	.write_config_json	= vbdev_kv_shard_write_config_json,
+};
+
+static void
+kv_shard_ch_destroy_cb(void *io_device, void *ctx_buf)
+{
+	struct kv_shard_io_channel *shard_ch = ctx_buf;
+	uint32_t i;
+
+	for (i = 0; i < VBDEV_KV_SHARD_MAX_BASE_BDEVS; i++) {
+		if (shard_ch->base_ch[i] != NULL) {
+			spdk_put_io_channel(shard_ch->base_ch[i]);
+		}
+	}
+}
+
+static int
+kv_shard_ch_create_cb(void *io_device, void *ctx_buf)
+{
+	struct kv_shard_io_channel *shard_ch = ctx_buf;
+	struct vbdev_kv_shard *shard = io_device;
+	uint32_t i;
+
+	for (i = 0; i < shard->num_bases; i++) {
+		shard_ch->base_ch[i] = spdk_bdev_get_io_channel(shard->bases[i].desc);
+		if (shard_ch->base_ch[i] == NULL) {
+			kv_shard_ch_destroy_cb(io_device, ctx_buf);
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+static void
+vbdev_kv_shard_base_bdev_hotremove_cb(struct spdk_bdev *bdev_find)
+{
+	struct vbdev_kv_shard *shard, *tmp;
+	uint32_t i;
+
+	TAILQ_FOREACH_SAFE(shard, &g_kv_shard_nodes, link, tmp) {
+		for (i = 0; i < shard->num_bases; i++) {
+			if (bdev_find == shard->bases[i].bdev) {
+				spdk_bdev_unregister(&shard->bdev, NULL, NULL);
+				break;
+			}
+		}
+	}
+}
+
+static void
+vbdev_kv_shard_base_bdev_event_cb(enum spdk_bdev_event_type type, struct spdk_bdev *bdev,
+				  void *event_ctx)
+{
+	switch (type) {
+	case SPDK_BDEV_EVENT_REMOVE:
+		vbdev_kv_shard_base_bdev_hotremove_cb(bdev);
+		break;
+	default:
+		SPDK_NOTICELOG("Unsupported bdev event: type %d\n", type);
+		break;
+	}
+}
+
+static int
+vbdev_kv_shard_register(struct kv_shard_config *config)
+{
+	struct vbdev_kv_shard *shard;
+	struct spdk_bdev *bdev;
+	uint32_t i;
+	int rc;
+
+	/* Only go ahead once all base bdevs are there. */
+	for (i = 0; i < config->num_base_bdevs; i++) {
+		if (spdk_bdev_get_by_name(config->base_bdev_names[i]) == NULL) {
+			return -ENODEV;
+		}
+	}
+
+	shard = calloc(1, sizeof(*shard));
+	if (shard == NULL) {
+		return -ENOMEM;
+	}
+
+	shard->bdev.name = strdup(config->name);
+	if (shard->bdev.name == NULL) {
+		free(shard);
+		return -ENOMEM;
+	}
+	shard->bdev.product_name = "kv_shard";
+	shard->hash = config->hash;
+	shard->num_bases = config->num_base_bdevs;
+
+	for (i = 0; i < shard->num_bases; i++) {
+		rc = spdk_bdev_open_ext(config->base_bdev_names[i], true, vbdev_kv_shard_base_bdev_event_cb,
+					NULL, &shard->bases[i].desc);
+		if (rc) {
+			SPDK_ERRLOG("could not open bdev %s\n", config->base_bdev_names[i]);
+			goto close_bases;
+		}
+
+		bdev = spdk_bdev_desc_get_bdev(shard->bases[i].desc);
+		shard->bases[i].bdev = bdev;
+		if (!spdk_bdev_io_type_supported(bdev, SPDK_BDEV_IO_KV_RETRIEVE)) {
+			SPDK_ERRLOG("bdev %s does not support KV commands\n", config->base_bdev_names[i]);
+			rc = -ENOTSUP;
+			goto close_bases;
+		}
+
+		rc = spdk_bdev_module_claim_bdev(bdev, shard->bases[i].desc, &kv_shard_if);
+		if (rc) {
+			SPDK_ERRLOG("could not claim bdev %s\n", config->base_bdev_names[i]);
+			goto close_bases;
+		}
+		shard->bases[i].claimed = true;
+
+		shard->bdev.required_alignment = spdk_max(shard->bdev.required_alignment,
+						 bdev->required_alignment);
+		shard->bdev.blockcnt += bdev->blockcnt;
+	}
+	shard->bdev.blocklen = shard->bases[0].bdev->blocklen;
+
+	if (shard->hash == VBDEV_KV_SHARD_HASH_RING) {
+		rc = kv_shard_ring_init(shard);
+		if (rc) {
+			goto close_bases;
+		}
+	}
+
+	shard->bdev.ctxt = shard;
+	shard->bdev.fn_table = &vbdev_kv_shard_fn_table;
+	shard->bdev.module = &kv_shard_if;
+	shard->thread = spdk_get_thread();
+	shard->config = config;
+
+	spdk_io_device_register(shard, kv_shard_ch_create_cb, kv_shard_ch_destroy_cb,
+				sizeof(struct kv_shard_io_channel), config->name);
+
+	rc = spdk_bdev_register(&shard->bdev);
+	if (rc) {
+		SPDK_ERRLOG("could not register kv_shard bdev %s\n", config->name);
+		spdk_io_device_unregister(shard, NULL);
+		goto close_bases;
+	}
+
+	TAILQ_INSERT_TAIL(&g_kv_shard_nodes, shard, link);
+	config->registered = true;
+	SPDK_NOTICELOG("created kv_shard bdev %s over %u bdevs\n", config->name, shard->num_bases);
+	return 0;
+
+close_bases:
+	vbdev_kv_shard_close_bases(shard);
+	vbdev_kv_shard_free(shard);
+	return rc;
+}
+
+static void
+kv_shard_config_free(struct kv_shard_config *config)
+{
+	uint32_t i;
+
+	for (i = 0; i < config->num_base_bdevs; i++) {
+		free(config->base_bdev_names[i]);
+	}
+	free(config->name);
+	free(config);
+}
+
+int
+bdev_kv_shard_create(const struct vbdev_kv_shard_opts *opts)
+{
+	struct kv_shard_config *config;
+	uint32_t i, j;
+	int rc;
+
+	if (opts->name == NULL || opts->num_base_bdevs == 0 ||
+	    opts->num_base_bdevs > VBDEV_KV_SHARD_MAX_BASE_BDEVS) {
+		return -EINVAL;
+	}
+
+	for (i = 0; i < opts->num_base_bdevs; i++) {
+		if (opts->base_bdev_names[i] == NULL) {
+			return -EINVAL;
+		}
+		for (j = 0; j < i; j++) {
+			if (strcmp(opts->base_bdev_names[i], opts->base_bdev_names[j]) == 0) {
+				SPDK_ERRLOG("base bdev %s given twice\n", opts->base_bdev_names[i]);
+				return -EINVAL;
+			}
+		}
+	}
+
+	TAILQ_FOREACH(config, &g_kv_shard_configs, link) {
+		if (strcmp(config->name, opts->name) == 0) {
+			SPDK_ERRLOG("kv_shard bdev %s already exists\n", opts->name);
+			return -EEXIST;
+		}
+	}
+
+	config = calloc(1, sizeof(*config));
+	if (config == NULL) {
+		return -ENOMEM;
+	}
+
+	config->name = strdup(opts->name);
+	if (config->name == NULL) {
+		kv_shard_config_free(config);
+		return -ENOMEM;
+	}
+	for (i = 0; i < opts->num_base_bdevs; i++) {
+		config->base_bdev_names[i] = strdup(opts->base_bdev_names[i]);
+		if (config->base_bdev_names[i] == NULL) {
+			kv_shard_config_free(config);
+			return -ENOMEM;
+		}
+		config->num_base_bdevs++;
+	}
+	config->hash = opts->hash;
+
+	rc = vbdev_kv_shard_register(config);
+	if (rc == -ENODEV) {
+		SPDK_NOTICELOG("kv_shard creation deferred pending base bdev arrival\n");
+		rc = 0;
+	} else if (rc != 0) {
+		kv_shard_config_free(config);
+		return rc;
+	}
+
+	TAILQ_INSERT_TAIL(&g_kv_shard_configs, config, link);
+	return 0;
+}
+
+void
+bdev_kv_shard_delete(const char *name, spdk_bdev_unregister_cb cb_fn, void *cb_arg)
+{
+	struct kv_shard_config *config;
+	struct vbdev_kv_shard *shard;
+	int rc;
+
+	rc = spdk_bdev_unregister_by_name(name, &kv_shard_if, cb_fn, cb_arg);
+	if (rc != 0) {
+		cb_fn(cb_arg, rc);
+		return;
+	}
+
+	/* Forget the bdev so it is not re-created when its base bdevs come back. */
+	TAILQ_FOREACH(config, &g_kv_shard_configs, link) {
+		if (strcmp(config->name, name) == 0) {
+			TAILQ_FOREACH(shard, &g_kv_shard_nodes, link) {
+				if (shard->config == config) {
+					shard->config = NULL;
+				}
+			}
+			TAILQ_REMOVE(&g_kv_shard_configs, config, link);
+			kv_shard_config_free(config);
+			break;
+		}
+	}
+}
+
+static int
+vbdev_kv_shard_init(void)
+{
+	return 0;
+}
+
+static void
+vbdev_kv_shard_finish(void)
+{
+	struct kv_shard_config *config;
+
+	while ((config = TAILQ_FIRST(&g_kv_shard_configs))) {
+		TAILQ_REMOVE(&g_kv_shard_configs, config, link);
+		kv_shard_config_free(config);
+	}
+}
+
+static int
+vbdev_kv_shard_get_ctx_size(void)
+{
+	return sizeof(struct kv_shard_bdev_io);
+}
+
+static void
+vbdev_kv_shard_examine(struct spdk_bdev *bdev)
+{
+	struct kv_shard_config *config;
+	uint32_t i;
+
+	TAILQ_FOREACH(config, &g_kv_shard_configs, link) {
+		if (config->registered) {
+			continue;
+		}
+		for (i = 0; i < config->num_base_bdevs; i++) {
+			if (strcmp(config->base_bdev_names[i], bdev->name) == 0) {
+				vbdev_kv_shard_register(config);
+				break;
+			}
+		}
+	}
+
+	spdk_bdev_module_examine_done(&kv_shard_if);
+}
+
+SPDK_LOG_REGISTER_COMPONENT(vbdev_kv_shard)
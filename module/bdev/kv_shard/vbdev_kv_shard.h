@@ -0,0 +1,48 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+#ifndef SPDK_VBDEV_KV_SHARD_H
+#define SPDK_VBDEV_KV_SHARD_H
+
+#include "spdk/stdinc.h"
+
+#include "spdk/bdev.h"
+#include "spdk/bdev_module.h"
+
+#define VBDEV_KV_SHARD_MAX_BASE_BDEVS	32
+
+enum vbdev_kv_shard_hash {
+	/* Jump consistent hash over the list of base bdevs. Only appending keeps keys in place. */
+	VBDEV_KV_SHARD_HASH_JUMP,
+	/* Hash ring with points placed by base bdev name. The order of base bdevs does not matter. */
+	VBDEV_KV_SHARD_HASH_RING,
+};
+
+struct vbdev_kv_shard_opts {
+	const char *name;
+	const char *const *base_bdev_names;
+	uint32_t num_base_bdevs;
+	enum vbdev_kv_shard_hash hash;
+};
+
+/**
+ * Create a KV bdev that spreads keys over several KV capable bdevs. If some of
+ * the base bdevs do not exist yet, the bdev is created once all of them showed up.
+ *
+ * \param opts Creation options.
+ *
+ * \return 0 on success, negated errno otherwise.
+ */
+int bdev_kv_shard_create(const struct vbdev_kv_shard_opts *opts);
+
+/**
+ * Delete a KV shard bdev. The base bdevs are left as they are.
+ *
+ * \param name Name of the shard bdev.
+ * \param cb_fn Function to call after deletion.
+ * \param cb_arg Argument to pass to cb_fn.
+ */
+void bdev_kv_shard_delete(const char *name, spdk_bdev_unregister_cb cb_fn, void *cb_arg);
+
+#endif /* SPDK_VBDEV_KV_SHARD_H */
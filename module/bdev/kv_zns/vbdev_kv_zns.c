@@ -0,0 +1,2921 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+/*
+ * Log-structured KV engine on a zoned bdev.
+ *
+ * Implements the SPDK_BDEV_IO_KV_* I/O types on top of a zoned bdev, a ZNS
+ * namespace or a zone_block bdev, so KV applications run on commodity drives
+ * that only take sequential writes. Every STORE and DELETE appends one record,
+ * holding the key and the whole value, to an open zone with zone append, and
+ * an in-memory hash index maps each key to its latest record. A record never
+ * spans zones or exceeds what one zone append can carry; larger values are
+ * rejected. APPENDs read the old value and write it back with the new data.
+ *
+ * Zones 0 and 1 hold checkpoints of the index and are written in turn. A
+ * checkpoint waits for the appends in flight, snapshots the index with the
+ * write pointer of every data zone, and is written while new appends go on.
+ * The whole index has to fit in one zone. On create, the newer valid
+ * checkpoint is loaded and only the records past its write pointers are
+ * replayed. Records carry a sequence number, so replay keeps the latest record
+ * of every key, and the epoch their zone was opened in, so a zone written
+ * after the checkpoint can be told apart from one garbage collection was
+ * about to reset.
+ *
+ * Garbage collection starts when few free zones are left. It picks the full
+ * zone with the least live data, copies the live records, keeping their
+ * sequence numbers, to a zone of its own, and resets the victim only once a
+ * checkpoint taken after the copy has been written. Replay thus always finds
+ * the copy or the original, and deleted keys need no tombstones past the
+ * checkpoint. User writes always leave a free zone for it.
+ *
+ * All engine state is owned by the thread the bdev was created on; I/O from
+ * other threads is passed to it with a message and completed back on its own
+ * thread. STOREs and DELETEs of the same key are executed one at a time.
+ * SELECTs are evaluated on the host.
+ */
+
+#include "spdk/stdinc.h"
+
+#include "vbdev_kv_zns.h"
+#include "spdk/bdev_zone.h"
+#include "spdk/crc32.h"
+#include "spdk/env.h"
+#include "spdk/likely.h"
+#include "spdk/nvme_spec.h"
+#include "spdk/string.h"
+#include "spdk/thread.h"
+#include "spdk/util.h"
+
+#include "spdk/log.h"
+
+#include "spdk_internal/kv_select.h"
+
+#define KV_ZNS_RECORD_MAGIC		0x534e5a4bU /* "KZNS" */
+#define KV_ZNS_RECORD_HDR_SIZE		64
+#define KV_ZNS_RECORD_DELETE		0x1
+#define KV_ZNS_CKPT_MAGIC		0x54504b43534e5a4bULL /* "KZNSCKPT" */
+#define KV_ZNS_CKPT_VERSION		1
+#define KV_ZNS_NUM_CKPT_ZONES		2
+/* Largest record, so a record buffer stays a reasonable size. */
+#define KV_ZNS_MAX_RECORD_SIZE		(2 * 1024 * 1024)
+#define KV_ZNS_INDEX_MIN_SLOTS		1024
+#define KV_ZNS_NUM_BUCKETS		256
+#define KV_ZNS_MAX_SELECTS		1024
+/* Free zones user writes leave to garbage collection. */
+#define KV_ZNS_GC_RESERVE_ZONES		1
+#define KV_ZNS_GC_QUEUE_DEPTH		8
+#define KV_ZNS_ZONE_INFO_BATCH		64
+#define KV_ZNS_NO_ZONE			UINT32_MAX
+/* Write pointer a checkpoint records for a zone holding nothing to keep. */
+#define KV_ZNS_FREE_WP			UINT64_MAX
+
+/* Header of a record, followed by the value. Records are padded to whole blocks. */
+struct kv_zns_record {
+	uint32_t	magic;
+	/* CRC-32C of the header, with crc 0, and the value. */
+	uint32_t	crc;
+	uint64_t	seq;
+	uint32_t	epoch;
+	uint32_t	value_len;
+	uint8_t		key_len;
+	uint8_t		flags;
+	uint8_t		reserved[6];
+	uint8_t		key[NVME_KV_MAX_KEY_LENGTH];
+	uint8_t		reserved2[16];
+};
+SPDK_STATIC_ASSERT(sizeof(struct kv_zns_record) == KV_ZNS_RECORD_HDR_SIZE, "Incorrect size");
+
+/* First block of a checkpoint, followed by one kv_zns_ckpt_zone per zone and the keys. */
+struct kv_zns_ckpt_header {
+	uint64_t	magic;
+	uint32_t	version;
+	/* CRC-32C of the whole checkpoint, with crc 0. */
+	uint32_t	crc;
+	uint64_t	seq;
+	uint64_t	next_seq;
+	uint32_t	next_epoch;
+	uint32_t	num_zones;
+	uint64_t	num_keys;
+	/* Bytes past the first block. */
+	uint64_t	data_len;
+};
+
+struct kv_zns_ckpt_zone {
+	/* Everything below is in the index. KV_ZNS_FREE_WP if nothing in the zone is. */
+	uint64_t	wp;
+	uint32_t	epoch;
+	uint32_t	reserved;
+};
+
+struct kv_zns_ckpt_key {
+	uint8_t		key[NVME_KV_MAX_KEY_LENGTH];
+	uint8_t		key_len;
+	uint8_t		reserved[3];
+	uint32_t	value_len;
+	uint64_t	lba;
+	uint64_t	seq;
+};
+SPDK_STATIC_ASSERT(sizeof(struct kv_zns_ckpt_key) == 40, "Incorrect size");
+
+struct kv_zns_slot {
+	uint8_t		key[NVME_KV_MAX_KEY_LENGTH];
+	/* 0 marks an empty slot. */
+	uint8_t		key_len;
+	/* Only while replaying: the key was deleted by the record at seq. */
+	uint8_t		deleted;
+	uint8_t		reserved[2];
+	uint32_t	hash;
+	uint32_t	value_len;
+	uint32_t	reserved2;
+	/* First block of the record. */
+	uint64_t	lba;
+	uint64_t	seq;
+};
+
+enum kv_zns_zone_state {
+	KV_ZNS_ZONE_FREE,
+	KV_ZNS_ZONE_OPEN,
+	/* No room left, or no longer written to. */
+	KV_ZNS_ZONE_FULL,
+	/* Live records being copied out. */
+	KV_ZNS_ZONE_GC,
+	/* Copied out; reset after the next checkpoint. */
+	KV_ZNS_ZONE_RELOCATED,
+	/* Recorded as free by the checkpoint being written. */
+	KV_ZNS_ZONE_RESET_PENDING,
+	/* Checkpointed as free, reset once its reads are done. */
+	KV_ZNS_ZONE_RESET_WAIT,
+	KV_ZNS_ZONE_RESETTING,
+	/* Checkpoint zone, or a zone that cannot be written. */
+	KV_ZNS_ZONE_RESERVED,
+};
+
+struct vbdev_kv_zns;
+
+struct kv_zns_zone {
+	struct vbdev_kv_zns		*zns;
+	uint64_t			start;
+	uint64_t			capacity;
+	/* Blocks handed out to records, and blocks of records in the index. */
+	uint64_t			alloc;
+	uint64_t			valid;
+	uint32_t			epoch;
+	uint32_t			appends;
+	uint32_t			readers;
+	enum kv_zns_zone_state		state;
+};
+
+struct kv_zns_req;
+typedef int (*kv_zns_submit_fn)(struct kv_zns_req *req);
+
+/* A read or zone append of a record, done by the engine for a bdev_io or for GC. */
+struct kv_zns_req {
+	struct vbdev_kv_zns		*zns;
+	void				*buf;
+	uint64_t			lba;
+	uint32_t			num_blocks;
+	uint32_t			zone;
+	kv_zns_submit_fn		submit_fn;
+	spdk_bdev_io_completion_cb	cb_fn;
+	struct spdk_bdev_io_wait_entry	bdev_io_wait;
+};
+
+struct kv_zns_bdev_io {
+	struct kv_zns_req		req;
+	uint64_t			seq;
+	uint32_t			value_len;
+	/* Where the requested data starts in req.buf, and its length. */
+	uint32_t			buf_offset;
+	uint64_t			len;
+	char				*query;
+	size_t				query_len;
+	uint32_t			bucket;
+	/* Status to complete with, on the submitting thread. */
+	uint32_t			cdw0;
+	int				sc;
+	/* STOREs and DELETEs of the same key queued behind this one. */
+	TAILQ_HEAD(, kv_zns_bdev_io)	waiters;
+	/* On the engine's list of keys being written, or on another write's waiters. */
+	TAILQ_ENTRY(kv_zns_bdev_io)	busy_link;
+	/* Waiting for room to append. */
+	TAILQ_ENTRY(kv_zns_bdev_io)	wait_link;
+};
+TAILQ_HEAD(kv_zns_io_list, kv_zns_bdev_io);
+
+/* A live record of the zone being garbage collected. */
+struct kv_zns_gc_entry {
+	uint8_t		key[NVME_KV_MAX_KEY_LENGTH];
+	uint8_t		key_len;
+	uint32_t	value_len;
+	uint64_t	lba;
+	uint64_t	seq;
+};
+
+struct kv_zns_gc;
+
+struct kv_zns_gc_op {
+	struct kv_zns_req		req;
+	struct kv_zns_gc		*gc;
+	struct kv_zns_gc_entry		*entry;
+	TAILQ_ENTRY(kv_zns_gc_op)	link;
+};
+
+struct kv_zns_gc {
+	struct vbdev_kv_zns		*zns;
+	uint32_t			victim;
+	struct kv_zns_gc_entry		*entries;
+	uint64_t			num_entries;
+	uint64_t			next;
+	uint32_t			outstanding;
+	bool				failed;
+	bool				pumping;
+	TAILQ_HEAD(, kv_zns_gc_op)	free_ops;
+	/* Copies waiting for room to append. */
+	TAILQ_HEAD(, kv_zns_gc_op)	waiting;
+	struct kv_zns_gc_op		ops[KV_ZNS_GC_QUEUE_DEPTH];
+};
+
+struct kv_zns_ckpt {
+	struct vbdev_kv_zns		*zns;
+	void				*buf;
+	uint64_t			num_blocks;
+	uint64_t			written;
+	uint32_t			zone;
+	/* Records the checkpoint covers. */
+	uint64_t			dirty;
+};
+
+struct vbdev_kv_zns {
+	struct spdk_bdev			bdev;
+	struct spdk_bdev			*base_bdev;
+	struct spdk_bdev_desc			*base_desc;
+	/* Engine thread, and its channel to the base bdev. */
+	struct spdk_thread			*thread;
+	struct spdk_io_channel			*base_ch;
+
+	uint32_t				blocklen;
+	uint64_t				zone_size;
+	uint32_t				num_zones;
+	uint32_t				max_append_blocks;
+	uint32_t				max_record_blocks;
+	uint64_t				max_keys;
+	struct kv_zns_zone			*zones;
+	uint32_t				free_zones;
+	uint32_t				next_free;
+	uint32_t				user_zone;
+	uint32_t				gc_zone;
+
+	struct kv_zns_slot			*slots;
+	uint64_t				mask;
+	uint64_t				count;
+	uint64_t				next_seq;
+	uint32_t				next_epoch;
+
+	/* STOREs and DELETEs in flight, by key, and those waiting for room. */
+	struct kv_zns_io_list			busy[KV_ZNS_NUM_BUCKETS];
+	struct kv_zns_io_list			wait_space;
+	uint32_t				appends;
+	/* Resets, finishes and checkpoint I/O in flight. */
+	uint32_t				internal_ios;
+
+	uint32_t				checkpoint_ms;
+	struct spdk_poller			*ckpt_poller;
+	struct kv_zns_ckpt			*ckpt;
+	bool					ckpt_running;
+	bool					ckpt_again;
+	/* New appends wait while the appends in flight drain for a checkpoint. */
+	bool					quiescing;
+	uint64_t				ckpt_seq;
+	uint32_t				ckpt_zone;
+	/* Records written since the last checkpoint. */
+	uint64_t				dirty;
+
+	uint32_t				gc_free_zones;
+	struct kv_zns_gc			*gc;
+
+	struct spdk_kv_select_results	selects;
+
+	struct vbdev_kv_zns_stats		stats;
+	bool					registered;
+	bool					stopping;
+	bool					base_removed;
+	spdk_kv_zns_create_cb			create_cb;
+	void					*create_cb_arg;
+	TAILQ_ENTRY(vbdev_kv_zns)		link;
+};
+static TAILQ_HEAD(, vbdev_kv_zns) g_kv_zns_nodes = TAILQ_HEAD_INITIALIZER(g_kv_zns_nodes);
+
+static int vbdev_kv_zns_init(void);
+static void vbdev_kv_zns_finish(void);
+static int vbdev_kv_zns_get_ctx_size(void);
+
+static struct spdk_bdev_module kv_zns_if = {
+	.name = "kv_zns",
+	.module_init = vbdev_kv_zns_init,
+	.module_fini = vbdev_kv_zns_finish,
+	.get_ctx_size = vbdev_kv_zns_get_ctx_size,
+};
+
+SPDK_BDEV_MODULE_REGISTER(kv_zns, &kv_zns_if)
+
+#define KV_ZNS_STAT_ADD(zns, field, val) \
+	__atomic_fetch_add(&(zns)->stats.field, (val), __ATOMIC_RELAXED)
+
+static void kv_zns_resume(struct vbdev_kv_zns *zns);
+static void kv_zns_gc_kick(struct vbdev_kv_zns *zns);
+static void kv_zns_ckpt_start(struct vbdev_kv_zns *zns);
+static void kv_zns_ckpt_snapshot(struct vbdev_kv_zns *zns);
+static void kv_zns_stop_check(struct vbdev_kv_zns *zns);
+static void kv_zns_mutate(struct spdk_bdev_io *bdev_io);
+
+static inline uint32_t
+kv_zns_record_blocks(struct vbdev_kv_zns *zns, uint64_t value_len)
+{
+	return SPDK_CEIL_DIV(KV_ZNS_RECORD_HDR_SIZE + value_len, zns->blocklen);
+}
+
+static inline uint32_t
+kv_zns_zone_of(struct vbdev_kv_zns *zns, uint64_t lba)
+{
+	return lba / zns->zone_size;
+}
+
+static uint64_t
+kv_zns_io_len(struct spdk_bdev_io *bdev_io)
+{
+	if (bdev_io->u.bdev.iovcnt == 1) {
+		return bdev_io->u.bdev.iovs[0].iov_len;
+	}
+	return bdev_io->u.bdev.nvme_kv.buffer_size;
+}
+
+/* Index */
+
+static struct kv_zns_slot *
+kv_zns_lookup(struct vbdev_kv_zns *zns, const uint8_t *key, size_t key_len, uint32_t hash)
+{
+	struct kv_zns_slot *slot;
+	uint64_t i;
+
+	for (i = hash & zns->mask;; i = (i + 1) & zns->mask) {
+		slot = &zns->slots[i];
+		if (slot->key_len == 0) {
+			return slot;
+		}
+		if (slot->hash == hash && slot->key_len == key_len &&
+		    memcmp(slot->key, key, key_len) == 0) {
+			return slot;
+		}
+	}
+}
+
+static struct kv_zns_slot *
+kv_zns_find(struct vbdev_kv_zns *zns, const uint8_t *key, size_t key_len)
+{
+	struct kv_zns_slot *slot;
+
+	slot = kv_zns_lookup(zns, key, key_len, spdk_bdev_kv_key_hash(key, key_len));
+	return slot->key_len != 0 ? slot : NULL;
+}
+
+static int
+kv_zns_index_resize(struct vbdev_kv_zns *zns, uint64_t num_slots)
+{
+	struct kv_zns_slot *old = zns->slots, *slot;
+	uint64_t old_num = zns->mask + 1, i;
+
+	zns->slots = calloc(num_slots, sizeof(*zns->slots));
+	if (zns->slots == NULL) {
+		zns->slots = old;
+		return -ENOMEM;
+	}
+	zns->mask = num_slots - 1;
+	zns->count = 0;
+
+	for (i = 0; i < old_num; i++) {
+		if (old[i].key_len == 0) {
+			continue;
+		}
+		slot = kv_zns_lookup(zns, old[i].key, old[i].key_len, old[i].hash);
+		*slot = old[i];
+		zns->count++;
+	}
+	free(old);
+	return 0;
+}
+
+/* Make sure new keys can be added without growing the index later. */
+static int
+kv_zns_index_reserve(struct vbdev_kv_zns *zns, uint64_t num_new)
+{
+	if ((zns->count + num_new) * 4 <= (zns->mask + 1) * 3) {
+		return 0;
+	}
+	return kv_zns_index_resize(zns, (zns->mask + 1) * 2);
+}
+
+/* Backward shift deletion keeps probe sequences intact without tombstones. */
+static void
+kv_zns_index_remove(struct vbdev_kv_zns *zns, struct kv_zns_slot *slot)
+{
+	uint64_t i = slot - zns->slots, j = i, home;
+
+	for (;;) {
+		j = (j + 1) & zns->mask;
+		if (zns->slots[j].key_len == 0) {
+			break;
+		}
+		home = zns->slots[j].hash & zns->mask;
+		/* Move slot j into the hole at i unless its home lies cyclically in (i, j]. */
+		if ((j > i && (home <= i || home > j)) ||
+		    (j < i && (home <= i && home > j))) {
+			zns->slots[i] = zns->slots[j];
+			i = j;
+		}
+	}
+	memset(&zns->slots[i], 0, sizeof(zns->slots[i]));
+	zns->count--;
+}
+
+/* The record a slot points to is no longer live. */
+static void
+kv_zns_invalidate(struct vbdev_kv_zns *zns, struct kv_zns_slot *slot)
+{
+	struct kv_zns_zone *zone = &zns->zones[kv_zns_zone_of(zns, slot->lba)];
+
+	zone->valid -= kv_zns_record_blocks(zns, slot->value_len);
+}
+
+/* Point a key to a new record, unless a later record of the key is indexed already. */
+static void
+kv_zns_index_set(struct vbdev_kv_zns *zns, const uint8_t *key, size_t key_len, uint64_t lba,
+		 uint32_t value_len, uint64_t seq)
+{
+	uint32_t hash = spdk_bdev_kv_key_hash(key, key_len);
+	struct kv_zns_slot *slot;
+
+	slot = kv_zns_lookup(zns, key, key_len, hash);
+	if (slot->key_len != 0) {
+		if (slot->seq > seq) {
+			return;
+		}
+		kv_zns_invalidate(zns, slot);
+	} else {
+		memcpy(slot->key, key, key_len);
+		slot->key_len = key_len;
+		slot->hash = hash;
+		zns->count++;
+	}
+	slot->lba = lba;
+	slot->value_len = value_len;
+	slot->seq = seq;
+	zns->zones[kv_zns_zone_of(zns, lba)].valid += kv_zns_record_blocks(zns, value_len);
+}
+
+static void
+kv_zns_index_delete(struct vbdev_kv_zns *zns, const uint8_t *key, size_t key_len, uint64_t seq)
+{
+	struct kv_zns_slot *slot;
+
+	slot = kv_zns_find(zns, key, key_len);
+	if (slot != NULL && slot->seq < seq) {
+		kv_zns_invalidate(zns, slot);
+		kv_zns_index_remove(zns, slot);
+	}
+}
+
+/* Records */
+
+static void
+kv_zns_record_init(struct vbdev_kv_zns *zns, void *buf, const uint8_t *key, size_t key_len,
+		   uint32_t value_len, uint8_t flags)
+{
+	struct kv_zns_record *rec = buf;
+	uint64_t len = KV_ZNS_RECORD_HDR_SIZE + value_len;
+
+	memset(rec, 0, sizeof(*rec));
+	rec->magic = KV_ZNS_RECORD_MAGIC;
+	rec->seq = zns->next_seq++;
+	rec->value_len = value_len;
+	rec->key_len = key_len;
+	rec->flags = flags;
+	memcpy(rec->key, key, key_len);
+	/* Pad to the end of the last block. */
+	memset((uint8_t *)buf + len, 0, (uint64_t)kv_zns_record_blocks(zns, value_len) * zns->blocklen - len);
+}
+
+/* Stamp a record with the epoch of the zone it is appended to. */
+static void
+kv_zns_record_seal(struct vbdev_kv_zns *zns, void *buf, uint32_t zone)
+{
+	struct kv_zns_record *rec = buf;
+
+	rec->epoch = zns->zones[zone].epoch;
+	rec->crc = 0;
+	rec->crc = spdk_crc32c_update(buf, KV_ZNS_RECORD_HDR_SIZE + rec->value_len, ~0u);
+}
+
+/* Return the length in blocks of a plausible record header, 0 if it is not one. */
+static uint32_t
+kv_zns_record_parse(struct vbdev_kv_zns *zns, const void *buf)
+{
+	const struct kv_zns_record *rec = buf;
+
+	if (rec->magic != KV_ZNS_RECORD_MAGIC || rec->key_len == 0 ||
+	    rec->key_len > NVME_KV_MAX_KEY_LENGTH ||
+	    kv_zns_record_blocks(zns, rec->value_len) > zns->max_record_blocks) {
+		return 0;
+	}
+	return kv_zns_record_blocks(zns, rec->value_len);
+}
+
+static bool
+kv_zns_record_crc_ok(void *buf)
+{
+	struct kv_zns_record *rec = buf;
+	uint32_t crc = rec->crc;
+	bool ok;
+
+	rec->crc = 0;
+	ok = spdk_crc32c_update(buf, KV_ZNS_RECORD_HDR_SIZE + rec->value_len, ~0u) == crc;
+	rec->crc = crc;
+	return ok;
+}
+
+/* Check that a record read through the index is the one expected. */
+static bool
+kv_zns_record_matches(const void *buf, const uint8_t *key, size_t key_len, uint32_t value_len)
+{
+	const struct kv_zns_record *rec = buf;
+
+	return rec->magic == KV_ZNS_RECORD_MAGIC && rec->key_len == key_len &&
+	       memcmp(rec->key, key, key_len) == 0 && rec->value_len == value_len;
+}
+
+static void *
+kv_zns_buf_alloc(struct vbdev_kv_zns *zns, uint32_t num_blocks, size_t extra)
+{
+	return spdk_dma_malloc((uint64_t)num_blocks * zns->blocklen + extra,
+			       spdk_bdev_get_buf_align(zns->base_bdev), NULL);
+}
+
+/* Base bdev I/O */
+
+static void kv_zns_req_submit(struct kv_zns_req *req, kv_zns_submit_fn fn,
+			      spdk_bdev_io_completion_cb cb_fn);
+
+static void
+kv_zns_req_resubmit(void *arg)
+{
+	struct kv_zns_req *req = arg;
+
+	kv_zns_req_submit(req, req->submit_fn, req->cb_fn);
+}
+
+/* Submit a read or append, waiting for a bdev_io if there is none. */
+static void
+kv_zns_req_submit(struct kv_zns_req *req, kv_zns_submit_fn fn, spdk_bdev_io_completion_cb cb_fn)
+{
+	struct vbdev_kv_zns *zns = req->zns;
+	int rc;
+
+	req->submit_fn = fn;
+	req->cb_fn = cb_fn;
+
+	rc = fn(req);
+	if (rc == 0) {
+		return;
+	}
+
+	if (rc == -ENOMEM) {
+		req->bdev_io_wait.bdev = zns->base_bdev;
+		req->bdev_io_wait.cb_fn = kv_zns_req_resubmit;
+		req->bdev_io_wait.cb_arg = req;
+
+		rc = spdk_bdev_queue_io_wait(zns->base_bdev, zns->base_ch, &req->bdev_io_wait);
+		if (rc == 0) {
+			return;
+		}
+		SPDK_ERRLOG("Queue io failed in kv_zns_req_submit, rc=%d.\n", rc);
+	} else {
+		SPDK_ERRLOG("ERROR on bdev_io submission!\n");
+	}
+	cb_fn(NULL, false, req);
+}
+
+static int
+kv_zns_req_read(struct kv_zns_req *req)
+{
+	struct vbdev_kv_zns *zns = req->zns;
+
+	return spdk_bdev_read_blocks(zns->base_desc, zns->base_ch, req->buf, req->lba,
+				     req->num_blocks, req->cb_fn, req);
+}
+
+static int
+kv_zns_req_append(struct kv_zns_req *req)
+{
+	struct vbdev_kv_zns *zns = req->zns;
+
+	return spdk_bdev_zone_append(zns->base_desc, zns->base_ch, req->buf,
+				     zns->zones[req->zone].start, req->num_blocks, req->cb_fn, req);
+}
+
+/* Zones */
+
+static void
+kv_zns_zone_finish_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct kv_zns_zone *zone = cb_arg;
+	struct vbdev_kv_zns *zns = zone->zns;
+
+	spdk_bdev_free_io(bdev_io);
+	if (!success) {
+		SPDK_ERRLOG("Could not finish zone %" PRIu64 " of %s\n", zone->start,
+			    spdk_bdev_get_name(zns->base_bdev));
+	}
+	zns->internal_ios--;
+	kv_zns_stop_check(zns);
+}
+
+/* Give up the rest of a zone that is no longer written to, so it does not stay active. */
+static void
+kv_zns_zone_finish(struct vbdev_kv_zns *zns, struct kv_zns_zone *zone)
+{
+	int rc;
+
+	if (zone->alloc >= zone->capacity || zns->base_removed) {
+		return;
+	}
+
+	rc = spdk_bdev_zone_management(zns->base_desc, zns->base_ch, zone->start,
+				       SPDK_BDEV_ZONE_FINISH, kv_zns_zone_finish_done, zone);
+	if (rc == 0) {
+		zns->internal_ios++;
+	}
+}
+
+/* Stop appending to a zone. */
+static void
+kv_zns_zone_retire(struct vbdev_kv_zns *zns, uint32_t idx)
+{
+	struct kv_zns_zone *zone = &zns->zones[idx];
+
+	if (zns->user_zone == idx) {
+		zns->user_zone = KV_ZNS_NO_ZONE;
+	}
+	if (zns->gc_zone == idx) {
+		zns->gc_zone = KV_ZNS_NO_ZONE;
+	}
+	if (zone->state != KV_ZNS_ZONE_OPEN) {
+		return;
+	}
+	zone->state = KV_ZNS_ZONE_FULL;
+	if (zone->appends == 0) {
+		kv_zns_zone_finish(zns, zone);
+	}
+}
+
+static uint32_t
+kv_zns_zone_open(struct vbdev_kv_zns *zns)
+{
+	struct kv_zns_zone *zone;
+	uint32_t i, idx;
+
+	for (i = 0; i < zns->num_zones; i++) {
+		idx = (zns->next_free + i) % zns->num_zones;
+		zone = &zns->zones[idx];
+		if (zone->state == KV_ZNS_ZONE_FREE) {
+			zns->next_free = idx + 1;
+			zns->free_zones--;
+			zone->state = KV_ZNS_ZONE_OPEN;
+			zone->alloc = 0;
+			zone->valid = 0;
+			zone->epoch = zns->next_epoch++;
+			return idx;
+		}
+	}
+	return KV_ZNS_NO_ZONE;
+}
+
+/*
+ * Reserve room for a record in the user or GC zone, opening a new zone when
+ * needed. Returns -EAGAIN if the record has to wait for a checkpoint or for
+ * garbage collection to free a zone.
+ */
+static int
+kv_zns_alloc(struct vbdev_kv_zns *zns, bool gc, uint32_t num_blocks, uint32_t *zone_idx)
+{
+	uint32_t *cur = gc ? &zns->gc_zone : &zns->user_zone;
+	struct kv_zns_zone *zone;
+
+	if (zns->quiescing) {
+		return -EAGAIN;
+	}
+
+	if (*cur != KV_ZNS_NO_ZONE) {
+		zone = &zns->zones[*cur];
+		if (zone->alloc + num_blocks <= zone->capacity) {
+			goto found;
+		}
+		kv_zns_zone_retire(zns, *cur);
+	}
+
+	if (zns->free_zones <= (gc ? 0 : KV_ZNS_GC_RESERVE_ZONES)) {
+		return -EAGAIN;
+	}
+	*cur = kv_zns_zone_open(zns);
+	assert(*cur != KV_ZNS_NO_ZONE);
+	zone = &zns->zones[*cur];
+	if (zone->alloc + num_blocks > zone->capacity) {
+		/* Zones differ in capacity; try the next one. */
+		kv_zns_zone_retire(zns, *cur);
+		return kv_zns_alloc(zns, gc, num_blocks, zone_idx);
+	}
+
+found:
+	zone->alloc += num_blocks;
+	zone->appends++;
+	zns->appends++;
+	*zone_idx = *cur;
+	if (zns->free_zones <= zns->gc_free_zones) {
+		kv_zns_gc_kick(zns);
+	}
+	return 0;
+}
+
+/* An append reserved with kv_zns_alloc() is done. */
+static void
+kv_zns_alloc_put(struct vbdev_kv_zns *zns, uint32_t idx, bool success)
+{
+	struct kv_zns_zone *zone = &zns->zones[idx];
+
+	zone->appends--;
+	zns->appends--;
+	if (!success) {
+		/* Where the next append would land is unknown now. */
+		kv_zns_zone_retire(zns, idx);
+	} else if (zone->state == KV_ZNS_ZONE_FULL && zone->appends == 0) {
+		kv_zns_zone_finish(zns, zone);
+	}
+
+	if (zns->quiescing && zns->appends == 0) {
+		kv_zns_ckpt_snapshot(zns);
+	}
+}
+
+static void
+kv_zns_zone_reset_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct kv_zns_zone *zone = cb_arg;
+	struct vbdev_kv_zns *zns = zone->zns;
+
+	spdk_bdev_free_io(bdev_io);
+	zns->internal_ios--;
+
+	if (success) {
+		zone->state = KV_ZNS_ZONE_FREE;
+		zone->alloc = 0;
+		zone->valid = 0;
+		zns->free_zones++;
+		KV_ZNS_STAT_ADD(zns, gc_zones, 1);
+	} else {
+		SPDK_ERRLOG("Could not reset zone %" PRIu64 " of %s\n", zone->start,
+			    spdk_bdev_get_name(zns->base_bdev));
+		/* Retried after the next checkpoint. */
+		zone->state = KV_ZNS_ZONE_RELOCATED;
+	}
+
+	kv_zns_resume(zns);
+	kv_zns_gc_kick(zns);
+	kv_zns_stop_check(zns);
+}
+
+static void
+kv_zns_zone_reset(struct vbdev_kv_zns *zns, struct kv_zns_zone *zone)
+{
+	int rc;
+
+	if (zone->readers != 0) {
+		zone->state = KV_ZNS_ZONE_RESET_WAIT;
+		return;
+	}
+
+	rc = spdk_bdev_zone_management(zns->base_desc, zns->base_ch, zone->start,
+				       SPDK_BDEV_ZONE_RESET, kv_zns_zone_reset_done, zone);
+	if (rc != 0) {
+		zone->state = KV_ZNS_ZONE_RELOCATED;
+		return;
+	}
+	zone->state = KV_ZNS_ZONE_RESETTING;
+	zns->internal_ios++;
+}
+
+static void
+kv_zns_reader_get(struct vbdev_kv_zns *zns, uint64_t lba)
+{
+	zns->zones[kv_zns_zone_of(zns, lba)].readers++;
+}
+
+static void
+kv_zns_reader_put(struct vbdev_kv_zns *zns, uint64_t lba)
+{
+	struct kv_zns_zone *zone = &zns->zones[kv_zns_zone_of(zns, lba)];
+
+	zone->readers--;
+	if (zone->readers == 0 && zone->state == KV_ZNS_ZONE_RESET_WAIT) {
+		kv_zns_zone_reset(zns, zone);
+	}
+}
+
+/* Completion */
+
+static void
+_kv_zns_complete(void *ctx)
+{
+	struct spdk_bdev_io *bdev_io = ctx;
+	struct kv_zns_bdev_io *io_ctx = (struct kv_zns_bdev_io *)bdev_io->driver_ctx;
+
+	spdk_bdev_io_complete_nvme_status(bdev_io, io_ctx->cdw0, SPDK_NVME_SCT_GENERIC, io_ctx->sc);
+}
+
+/* Complete a bdev_io on the thread it was submitted on. */
+static void
+kv_zns_complete(struct spdk_bdev_io *bdev_io, uint32_t cdw0, int sc)
+{
+	struct kv_zns_bdev_io *io_ctx = (struct kv_zns_bdev_io *)bdev_io->driver_ctx;
+
+	io_ctx->cdw0 = cdw0;
+	io_ctx->sc = sc;
+	if (spdk_bdev_io_get_thread(bdev_io) != spdk_get_thread()) {
+		spdk_thread_send_msg(spdk_bdev_io_get_thread(bdev_io), _kv_zns_complete, bdev_io);
+	} else {
+		_kv_zns_complete(bdev_io);
+	}
+}
+
+/* STORE and DELETE */
+
+static bool
+kv_zns_key_lock(struct vbdev_kv_zns *zns, struct spdk_bdev_io *bdev_io)
+{
+	struct kv_zns_bdev_io *io_ctx = (struct kv_zns_bdev_io *)bdev_io->driver_ctx;
+	const uint8_t *key = bdev_io->u.bdev.nvme_kv.key;
+	size_t key_len = bdev_io->u.bdev.nvme_kv.key_length;
+	struct kv_zns_bdev_io *other;
+	struct spdk_bdev_io *other_io;
+
+	io_ctx->bucket = spdk_bdev_kv_key_hash(key, key_len) & (KV_ZNS_NUM_BUCKETS - 1);
+	TAILQ_FOREACH(other, &zns->busy[io_ctx->bucket], busy_link) {
+		other_io = spdk_bdev_io_from_ctx(other);
+		if (other_io->u.bdev.nvme_kv.key_length == key_len &&
+		    memcmp(other_io->u.bdev.nvme_kv.key, key, key_len) == 0) {
+			TAILQ_INSERT_TAIL(&other->waiters, io_ctx, busy_link);
+			return false;
+		}
+	}
+
+	TAILQ_INIT(&io_ctx->waiters);
+	TAILQ_INSERT_TAIL(&zns->busy[io_ctx->bucket], io_ctx, busy_link);
+	return true;
+}
+
+/* Hand the key to the next STORE or DELETE queued for it. */
+static void
+kv_zns_key_unlock(struct vbdev_kv_zns *zns, struct kv_zns_bdev_io *io_ctx)
+{
+	struct kv_zns_bdev_io *next;
+
+	TAILQ_REMOVE(&zns->busy[io_ctx->bucket], io_ctx, busy_link);
+	next = TAILQ_FIRST(&io_ctx->waiters);
+	if (next == NULL) {
+		return;
+	}
+
+	TAILQ_REMOVE(&io_ctx->waiters, next, busy_link);
+	TAILQ_INIT(&next->waiters);
+	TAILQ_CONCAT(&next->waiters, &io_ctx->waiters, busy_link);
+	next->bucket = io_ctx->bucket;
+	TAILQ_INSERT_TAIL(&zns->busy[next->bucket], next, busy_link);
+	kv_zns_mutate(spdk_bdev_io_from_ctx(next));
+}
+
+static void
+kv_zns_mutate_done(struct spdk_bdev_io *bdev_io, int sc)
+{
+	struct vbdev_kv_zns *zns = bdev_io->bdev->ctxt;
+	struct kv_zns_bdev_io *io_ctx = (struct kv_zns_bdev_io *)bdev_io->driver_ctx;
+
+	spdk_dma_free(io_ctx->req.buf);
+	io_ctx->req.buf = NULL;
+	kv_zns_key_unlock(zns, io_ctx);
+	kv_zns_complete(bdev_io, 0, sc);
+}
+
+static void
+kv_zns_write_done(struct spdk_bdev_io *child, bool success, void *cb_arg)
+{
+	struct kv_zns_req *req = cb_arg;
+	struct kv_zns_bdev_io *io_ctx = SPDK_CONTAINEROF(req, struct kv_zns_bdev_io, req);
+	struct spdk_bdev_io *bdev_io = spdk_bdev_io_from_ctx(io_ctx);
+	struct vbdev_kv_zns *zns = req->zns;
+	const uint8_t *key = bdev_io->u.bdev.nvme_kv.key;
+	size_t key_len = bdev_io->u.bdev.nvme_kv.key_length;
+	uint64_t lba = 0;
+
+	if (child != NULL) {
+		if (success) {
+			lba = spdk_bdev_io_get_append_location(child);
+		}
+		spdk_bdev_free_io(child);
+	}
+
+	if (success) {
+		if (bdev_io->type == SPDK_BDEV_IO_KV_DELETE) {
+			kv_zns_index_delete(zns, key, key_len, io_ctx->seq);
+		} else {
+			kv_zns_index_set(zns, key, key_len, lba, io_ctx->value_len, io_ctx->seq);
+		}
+		zns->dirty++;
+		KV_ZNS_STAT_ADD(zns, bytes_written, (uint64_t)req->num_blocks * zns->blocklen);
+	}
+	/* After the index update, so a checkpoint waiting for this append includes it. */
+	kv_zns_alloc_put(zns, req->zone, success);
+
+	kv_zns_mutate_done(bdev_io, success ? SPDK_NVME_SC_SUCCESS : SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+}
+
+static int
+kv_zns_write_try(struct spdk_bdev_io *bdev_io)
+{
+	struct vbdev_kv_zns *zns = bdev_io->bdev->ctxt;
+	struct kv_zns_bdev_io *io_ctx = (struct kv_zns_bdev_io *)bdev_io->driver_ctx;
+	int rc;
+
+	rc = kv_zns_alloc(zns, false, io_ctx->req.num_blocks, &io_ctx->req.zone);
+	if (rc != 0) {
+		return rc;
+	}
+
+	kv_zns_record_seal(zns, io_ctx->req.buf, io_ctx->req.zone);
+	kv_zns_req_submit(&io_ctx->req, kv_zns_req_append, kv_zns_write_done);
+	return 0;
+}
+
+/* Append the record built in the bdev_io's buffer. */
+static void
+kv_zns_write(struct spdk_bdev_io *bdev_io)
+{
+	struct vbdev_kv_zns *zns = bdev_io->bdev->ctxt;
+	struct kv_zns_bdev_io *io_ctx = (struct kv_zns_bdev_io *)bdev_io->driver_ctx;
+
+	if (!TAILQ_EMPTY(&zns->wait_space) || kv_zns_write_try(bdev_io) != 0) {
+		TAILQ_INSERT_TAIL(&zns->wait_space, io_ctx, wait_link);
+		kv_zns_gc_kick(zns);
+	}
+}
+
+static void
+kv_zns_append_read_done(struct spdk_bdev_io *child, bool success, void *cb_arg)
+{
+	struct kv_zns_req *req = cb_arg;
+	struct kv_zns_bdev_io *io_ctx = SPDK_CONTAINEROF(req, struct kv_zns_bdev_io, req);
+	struct spdk_bdev_io *bdev_io = spdk_bdev_io_from_ctx(io_ctx);
+	struct vbdev_kv_zns *zns = req->zns;
+	const uint8_t *key = bdev_io->u.bdev.nvme_kv.key;
+	size_t key_len = bdev_io->u.bdev.nvme_kv.key_length;
+	uint64_t len = kv_zns_io_len(bdev_io);
+	uint32_t old_len = io_ctx->value_len - len;
+
+	if (child != NULL) {
+		spdk_bdev_free_io(child);
+	}
+	kv_zns_reader_put(zns, req->lba);
+
+	if (!success || !kv_zns_record_matches(req->buf, key, key_len, old_len)) {
+		kv_zns_mutate_done(bdev_io, SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+		return;
+	}
+
+	/* The old value is in place; add the new data behind it. */
+	spdk_copy_iovs_to_buf((uint8_t *)req->buf + KV_ZNS_RECORD_HDR_SIZE + old_len, len,
+			      bdev_io->u.bdev.iovs, bdev_io->u.bdev.iovcnt);
+	kv_zns_record_init(zns, req->buf, key, key_len, io_ctx->value_len, 0);
+	io_ctx->seq = ((struct kv_zns_record *)req->buf)->seq;
+	req->num_blocks = kv_zns_record_blocks(zns, io_ctx->value_len);
+	kv_zns_write(bdev_io);
+}
+
+static void
+kv_zns_mutate(struct spdk_bdev_io *bdev_io)
+{
+	struct vbdev_kv_zns *zns = bdev_io->bdev->ctxt;
+	struct kv_zns_bdev_io *io_ctx = (struct kv_zns_bdev_io *)bdev_io->driver_ctx;
+	const uint8_t *key = bdev_io->u.bdev.nvme_kv.key;
+	size_t key_len = bdev_io->u.bdev.nvme_kv.key_length;
+	uint8_t options = bdev_io->u.bdev.nvme_kv.options;
+	struct kv_zns_slot *slot;
+	uint64_t len = 0, new_len;
+	uint32_t num_blocks;
+	bool append = false;
+
+	io_ctx->req.zns = zns;
+	io_ctx->req.buf = NULL;
+	slot = kv_zns_find(zns, key, key_len);
+
+	if (bdev_io->type == SPDK_BDEV_IO_KV_DELETE) {
+		if (slot == NULL) {
+			kv_zns_mutate_done(bdev_io, SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+			return;
+		}
+		new_len = 0;
+		KV_ZNS_STAT_ADD(zns, deletes, 1);
+	} else {
+		if ((options & NVME_KV_STORE_CMD_OPTION_MUST_EXIST) && slot == NULL) {
+			kv_zns_mutate_done(bdev_io, SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+			return;
+		}
+		if ((options & NVME_KV_STORE_CMD_OPTION_MUST_NOT_EXIST) && slot != NULL) {
+			kv_zns_mutate_done(bdev_io, SPDK_NVME_SC_KEY_EXISTS);
+			return;
+		}
+		len = kv_zns_io_len(bdev_io);
+		append = (options & NVME_KV_STORE_CMD_OPTION_APPEND) && slot != NULL;
+		new_len = append ? slot->value_len + len : len;
+		KV_ZNS_STAT_ADD(zns, stores, 1);
+	}
+
+	num_blocks = kv_zns_record_blocks(zns, spdk_min(new_len, UINT32_MAX));
+	if (new_len > UINT32_MAX || num_blocks > zns->max_record_blocks) {
+		kv_zns_mutate_done(bdev_io, SPDK_NVME_SC_INVALID_VALUE_SIZE);
+		return;
+	}
+	if (slot == NULL && (zns->count + zns->appends >= zns->max_keys ||
+			     kv_zns_index_reserve(zns, zns->appends + 1) != 0)) {
+		/* The index of every key has to fit in a checkpoint. */
+		kv_zns_mutate_done(bdev_io, SPDK_NVME_SC_CAPACITY_EXCEEDED);
+		return;
+	}
+
+	io_ctx->req.buf = kv_zns_buf_alloc(zns, num_blocks, 0);
+	if (io_ctx->req.buf == NULL) {
+		kv_zns_mutate_done(bdev_io, SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+		return;
+	}
+	io_ctx->req.num_blocks = num_blocks;
+	io_ctx->value_len = new_len;
+
+	if (append) {
+		/* Read the old record into the front of the new one. */
+		io_ctx->req.lba = slot->lba;
+		io_ctx->req.num_blocks = kv_zns_record_blocks(zns, slot->value_len);
+		kv_zns_reader_get(zns, slot->lba);
+		kv_zns_req_submit(&io_ctx->req, kv_zns_req_read, kv_zns_append_read_done);
+		return;
+	}
+
+	if (bdev_io->type == SPDK_BDEV_IO_KV_DELETE) {
+		kv_zns_record_init(zns, io_ctx->req.buf, key, key_len, 0, KV_ZNS_RECORD_DELETE);
+	} else {
+		spdk_copy_iovs_to_buf((uint8_t *)io_ctx->req.buf + KV_ZNS_RECORD_HDR_SIZE, len,
+				      bdev_io->u.bdev.iovs, bdev_io->u.bdev.iovcnt);
+		kv_zns_record_init(zns, io_ctx->req.buf, key, key_len, new_len, 0);
+	}
+	io_ctx->seq = ((struct kv_zns_record *)io_ctx->req.buf)->seq;
+	kv_zns_write(bdev_io);
+}
+
+static int kv_zns_gc_write_try(struct kv_zns_gc_op *op);
+
+/* Restart the appends that waited for a checkpoint or a free zone. */
+static void
+kv_zns_resume(struct vbdev_kv_zns *zns)
+{
+	struct kv_zns_bdev_io *io_ctx;
+	struct kv_zns_gc_op *op;
+
+	if (zns->quiescing) {
+		return;
+	}
+
+	/* Garbage collection first, it makes room for the rest. */
+	while (zns->gc != NULL && (op = TAILQ_FIRST(&zns->gc->waiting)) != NULL) {
+		if (kv_zns_gc_write_try(op) != 0) {
+			break;
+		}
+		TAILQ_REMOVE(&zns->gc->waiting, op, link);
+	}
+
+	while ((io_ctx = TAILQ_FIRST(&zns->wait_space)) != NULL) {
+		TAILQ_REMOVE(&zns->wait_space, io_ctx, wait_link);
+		if (kv_zns_write_try(spdk_bdev_io_from_ctx(io_ctx)) != 0) {
+			TAILQ_INSERT_HEAD(&zns->wait_space, io_ctx, wait_link);
+			break;
+		}
+	}
+}
+
+/*
+ * Called when garbage collection found nothing to collect. Writes waiting for
+ * room fail unless a checkpoint or a reset can still free a zone.
+ */
+static void
+kv_zns_space_check(struct vbdev_kv_zns *zns)
+{
+	struct kv_zns_bdev_io *io_ctx;
+	uint32_t i;
+
+	if (TAILQ_EMPTY(&zns->wait_space) || zns->gc != NULL || zns->quiescing) {
+		return;
+	}
+
+	for (i = 0; i < zns->num_zones; i++) {
+		switch (zns->zones[i].state) {
+		case KV_ZNS_ZONE_RELOCATED:
+			kv_zns_ckpt_start(zns);
+			return;
+		case KV_ZNS_ZONE_RESET_PENDING:
+		case KV_ZNS_ZONE_RESET_WAIT:
+		case KV_ZNS_ZONE_RESETTING:
+			return;
+		default:
+			break;
+		}
+	}
+	if (zns->free_zones > KV_ZNS_GC_RESERVE_ZONES) {
+		return;
+	}
+
+	while ((io_ctx = TAILQ_FIRST(&zns->wait_space)) != NULL) {
+		TAILQ_REMOVE(&zns->wait_space, io_ctx, wait_link);
+		kv_zns_mutate_done(spdk_bdev_io_from_ctx(io_ctx), SPDK_NVME_SC_CAPACITY_EXCEEDED);
+	}
+}
+
+/* RETRIEVE */
+
+static void
+kv_zns_retrieve_done(struct spdk_bdev_io *child, bool success, void *cb_arg)
+{
+	struct kv_zns_req *req = cb_arg;
+	struct kv_zns_bdev_io *io_ctx = SPDK_CONTAINEROF(req, struct kv_zns_bdev_io, req);
+	struct spdk_bdev_io *bdev_io = spdk_bdev_io_from_ctx(io_ctx);
+
+	if (child != NULL) {
+		spdk_bdev_free_io(child);
+	}
+	kv_zns_reader_put(req->zns, req->lba);
+
+	if (success) {
+		spdk_copy_buf_to_iovs(bdev_io->u.bdev.iovs, bdev_io->u.bdev.iovcnt,
+				      (uint8_t *)req->buf + io_ctx->buf_offset, io_ctx->len);
+	}
+	spdk_dma_free(req->buf);
+	kv_zns_complete(bdev_io, io_ctx->value_len,
+			success ? SPDK_NVME_SC_SUCCESS : SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+}
+
+static void
+kv_zns_retrieve(struct spdk_bdev_io *bdev_io)
+{
+	struct vbdev_kv_zns *zns = bdev_io->bdev->ctxt;
+	struct kv_zns_bdev_io *io_ctx = (struct kv_zns_bdev_io *)bdev_io->driver_ctx;
+	uint64_t offset = bdev_io->u.bdev.nvme_kv.offset, first, last;
+	struct kv_zns_slot *slot;
+
+	KV_ZNS_STAT_ADD(zns, retrieves, 1);
+
+	slot = kv_zns_find(zns, bdev_io->u.bdev.nvme_kv.key, bdev_io->u.bdev.nvme_kv.key_length);
+	if (slot == NULL) {
+		kv_zns_complete(bdev_io, 0, SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+		return;
+	}
+	if (offset > slot->value_len) {
+		kv_zns_complete(bdev_io, 0, SPDK_NVME_SC_INVALID_FIELD);
+		return;
+	}
+
+	io_ctx->value_len = slot->value_len;
+	io_ctx->len = spdk_min(kv_zns_io_len(bdev_io), slot->value_len - offset);
+	if (io_ctx->len == 0) {
+		kv_zns_complete(bdev_io, slot->value_len, SPDK_NVME_SC_SUCCESS);
+		return;
+	}
+
+	/* Only read the blocks holding the requested part of the value. */
+	first = (KV_ZNS_RECORD_HDR_SIZE + offset) / zns->blocklen;
+	last = SPDK_CEIL_DIV(KV_ZNS_RECORD_HDR_SIZE + offset + io_ctx->len, zns->blocklen);
+	io_ctx->buf_offset = KV_ZNS_RECORD_HDR_SIZE + offset - first * zns->blocklen;
+	io_ctx->req.zns = zns;
+	io_ctx->req.lba = slot->lba + first;
+	io_ctx->req.num_blocks = last - first;
+	io_ctx->req.buf = kv_zns_buf_alloc(zns, io_ctx->req.num_blocks, 0);
+	if (io_ctx->req.buf == NULL) {
+		kv_zns_complete(bdev_io, 0, SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+		return;
+	}
+
+	kv_zns_reader_get(zns, io_ctx->req.lba);
+	kv_zns_req_submit(&io_ctx->req, kv_zns_req_read, kv_zns_retrieve_done);
+}
+
+/*
+ * LIST
+ *
+ * The list buffer holds a 32 bit key count followed by one entry per key: a
+ * 16 bit key length and the key, padded to a multiple of 4 bytes. Keys are
+ * returned in ascending order; as many as fit in the buffer.
+ */
+
+static int
+kv_zns_key_cmp(const void *a, const void *b)
+{
+	const struct kv_zns_slot *sa = *(struct kv_zns_slot * const *)a;
+	const struct kv_zns_slot *sb = *(struct kv_zns_slot * const *)b;
+	int rc;
+
+	rc = memcmp(sa->key, sb->key, spdk_min(sa->key_len, sb->key_len));
+	return rc ? rc : (int)sa->key_len - (int)sb->key_len;
+}
+
+static int
+kv_zns_list(struct vbdev_kv_zns *zns, const uint8_t *prefix, size_t prefix_len,
+	    struct iovec *iovs, int iovcnt, uint64_t len, uint32_t *cdw0)
+{
+	struct kv_zns_slot **keys;
+	uint8_t *buf;
+	uint64_t i, n = 0, pos = 4;
+	uint32_t num = 0;
+	uint16_t key_len;
+
+	if (prefix_len > NVME_KV_MAX_KEY_LENGTH) {
+		return SPDK_NVME_SC_INVALID_KEY_SIZE;
+	}
+
+	keys = calloc(zns->count ? zns->count : 1, sizeof(*keys));
+	buf = calloc(1, spdk_max(len, 4));
+	if (keys == NULL || buf == NULL) {
+		free(keys);
+		free(buf);
+		return SPDK_NVME_SC_INTERNAL_DEVICE_ERROR;
+	}
+
+	for (i = 0; i <= zns->mask; i++) {
+		if (zns->slots[i].key_len != 0 && zns->slots[i].key_len >= prefix_len &&
+		    memcmp(zns->slots[i].key, prefix, prefix_len) == 0) {
+			keys[n++] = &zns->slots[i];
+		}
+	}
+	qsort(keys, n, sizeof(*keys), kv_zns_key_cmp);
+
+	for (i = 0; i < n; i++) {
+		key_len = keys[i]->key_len;
+		if (pos + 2 + SPDK_ALIGN_CEIL(key_len, 4) > len) {
+			break;
+		}
+		memcpy(buf + pos, &key_len, sizeof(key_len));
+		memcpy(buf + pos + 2, keys[i]->key, key_len);
+		pos += 2 + SPDK_ALIGN_CEIL(key_len, 4);
+		num++;
+	}
+	memcpy(buf, &num, sizeof(num));
+
+	spdk_copy_buf_to_iovs(iovs, iovcnt, buf, spdk_min(len, pos));
+	*cdw0 = num;
+	free(buf);
+	free(keys);
+	return SPDK_NVME_SC_SUCCESS;
+}
+
+/* SELECT */
+
+static int
+kv_zns_select_run(struct vbdev_kv_zns *zns, struct spdk_bdev_io *bdev_io, uint32_t *cdw0)
+{
+	struct kv_zns_bdev_io *io_ctx = (struct kv_zns_bdev_io *)bdev_io->driver_ctx;
+	char *result;
+	size_t result_len;
+	int rc;
+
+	rc = spdk_kv_select_eval((char *)io_ctx->req.buf + KV_ZNS_RECORD_HDR_SIZE,
+				 io_ctx->value_len, io_ctx->query, io_ctx->query_len,
+				 bdev_io->u.bdev.nvme_kv.select_input_type,
+				 bdev_io->u.bdev.nvme_kv.select_output_type,
+				 bdev_io->u.bdev.nvme_kv.options, &result, &result_len);
+	if (rc != 0) {
+		SPDK_DEBUGLOG(vbdev_kv_zns, "select failed: %s\n", spdk_strerror(-rc));
+		return rc == -ENOMEM ? SPDK_NVME_SC_INTERNAL_DEVICE_ERROR : SPDK_NVME_SC_INVALID_FIELD;
+	}
+
+	if (spdk_kv_select_results_add(&zns->selects, result, result_len, cdw0) != 0) {
+		return SPDK_NVME_SC_INTERNAL_DEVICE_ERROR;
+	}
+	return SPDK_NVME_SC_SUCCESS;
+}
+
+static void
+kv_zns_select_read_done(struct spdk_bdev_io *child, bool success, void *cb_arg)
+{
+	struct kv_zns_req *req = cb_arg;
+	struct kv_zns_bdev_io *io_ctx = SPDK_CONTAINEROF(req, struct kv_zns_bdev_io, req);
+	struct spdk_bdev_io *bdev_io = spdk_bdev_io_from_ctx(io_ctx);
+	struct vbdev_kv_zns *zns = req->zns;
+	uint32_t cdw0 = 0;
+	int sc;
+
+	if (child != NULL) {
+		spdk_bdev_free_io(child);
+	}
+	kv_zns_reader_put(zns, req->lba);
+
+	if (!success || !kv_zns_record_matches(req->buf, bdev_io->u.bdev.nvme_kv.key,
+					       bdev_io->u.bdev.nvme_kv.key_length, io_ctx->value_len)) {
+		sc = SPDK_NVME_SC_INTERNAL_DEVICE_ERROR;
+	} else {
+		KV_ZNS_STAT_ADD(zns, host_selects, 1);
+		sc = kv_zns_select_run(zns, bdev_io, &cdw0);
+	}
+
+	spdk_dma_free(req->buf);
+	free(io_ctx->query);
+	kv_zns_complete(bdev_io, cdw0, sc);
+}
+
+static void
+kv_zns_send_select(struct spdk_bdev_io *bdev_io)
+{
+	struct vbdev_kv_zns *zns = bdev_io->bdev->ctxt;
+	struct kv_zns_bdev_io *io_ctx = (struct kv_zns_bdev_io *)bdev_io->driver_ctx;
+	struct kv_zns_slot *slot;
+
+	slot = kv_zns_find(zns, bdev_io->u.bdev.nvme_kv.key, bdev_io->u.bdev.nvme_kv.key_length);
+	if (slot == NULL) {
+		kv_zns_complete(bdev_io, 0, SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+		return;
+	}
+
+	io_ctx->query_len = kv_zns_io_len(bdev_io);
+	io_ctx->query = malloc(io_ctx->query_len);
+	io_ctx->req.zns = zns;
+	io_ctx->req.lba = slot->lba;
+	io_ctx->req.num_blocks = kv_zns_record_blocks(zns, slot->value_len);
+	/* spdk_kv_select_eval() needs a byte past the value. */
+	io_ctx->req.buf = kv_zns_buf_alloc(zns, io_ctx->req.num_blocks, 1);
+	if (io_ctx->query == NULL || io_ctx->req.buf == NULL) {
+		free(io_ctx->query);
+		spdk_dma_free(io_ctx->req.buf);
+		kv_zns_complete(bdev_io, 0, SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+		return;
+	}
+	spdk_copy_iovs_to_buf(io_ctx->query, io_ctx->query_len, bdev_io->u.bdev.iovs,
+			      bdev_io->u.bdev.iovcnt);
+	if (bdev_io->u.bdev.iovcnt == 1) {
+		/* The contiguous API takes a NUL terminated query. */
+		io_ctx->query_len = strnlen(io_ctx->query, io_ctx->query_len);
+	}
+	io_ctx->value_len = slot->value_len;
+
+	kv_zns_reader_get(zns, slot->lba);
+	kv_zns_req_submit(&io_ctx->req, kv_zns_req_read, kv_zns_select_read_done);
+}
+
+static int
+kv_zns_retrieve_select(struct vbdev_kv_zns *zns, uint32_t select_id, uint64_t offset,
+		       uint8_t options, struct iovec *iovs, int iovcnt, uint64_t len, uint32_t *cdw0)
+{
+	if (spdk_kv_select_results_read(&zns->selects, select_id, offset, options,
+					iovs, iovcnt, len, cdw0) != 0) {
+		return SPDK_NVME_SC_INVALID_FIELD;
+	}
+	return SPDK_NVME_SC_SUCCESS;
+}
+
+/* I/O path */
+
+static void
+kv_zns_submit_request(void *arg)
+{
+	struct spdk_bdev_io *bdev_io = arg;
+	struct vbdev_kv_zns *zns = bdev_io->bdev->ctxt;
+	size_t key_len = bdev_io->u.bdev.nvme_kv.key_length;
+	uint32_t cdw0 = 0;
+	int sc;
+
+	switch (bdev_io->type) {
+	case SPDK_BDEV_IO_KV_STORE:
+	case SPDK_BDEV_IO_KV_DELETE:
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+	case SPDK_BDEV_IO_KV_EXIST:
+	case SPDK_BDEV_IO_KV_SEND_SELECT:
+		if (key_len == 0 || key_len > NVME_KV_MAX_KEY_LENGTH) {
+			kv_zns_complete(bdev_io, 0, SPDK_NVME_SC_INVALID_KEY_SIZE);
+			return;
+		}
+		break;
+	default:
+		break;
+	}
+
+	switch (bdev_io->type) {
+	case SPDK_BDEV_IO_KV_STORE:
+	case SPDK_BDEV_IO_KV_DELETE:
+		if (kv_zns_key_lock(zns, bdev_io)) {
+			kv_zns_mutate(bdev_io);
+		}
+		return;
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+		kv_zns_retrieve(bdev_io);
+		return;
+	case SPDK_BDEV_IO_KV_SEND_SELECT:
+		kv_zns_send_select(bdev_io);
+		return;
+	case SPDK_BDEV_IO_KV_EXIST:
+		sc = kv_zns_find(zns, bdev_io->u.bdev.nvme_kv.key, key_len) != NULL ?
+		     SPDK_NVME_SC_SUCCESS : SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST;
+		break;
+	case SPDK_BDEV_IO_KV_LIST:
+		sc = kv_zns_list(zns, bdev_io->u.bdev.nvme_kv.key, key_len, bdev_io->u.bdev.iovs,
+				 bdev_io->u.bdev.iovcnt, kv_zns_io_len(bdev_io), &cdw0);
+		break;
+	case SPDK_BDEV_IO_KV_RETRIEVE_SELECT:
+		sc = kv_zns_retrieve_select(zns, bdev_io->u.bdev.nvme_kv.select_id,
+					    bdev_io->u.bdev.nvme_kv.offset,
+					    bdev_io->u.bdev.nvme_kv.options, bdev_io->u.bdev.iovs,
+					    bdev_io->u.bdev.iovcnt, kv_zns_io_len(bdev_io), &cdw0);
+		break;
+	default:
+		sc = SPDK_NVME_SC_INVALID_OPCODE;
+		break;
+	}
+	kv_zns_complete(bdev_io, cdw0, sc);
+}
+
+static void
+vbdev_kv_zns_submit_request(struct spdk_io_channel *ch, struct spdk_bdev_io *bdev_io)
+{
+	struct vbdev_kv_zns *zns = bdev_io->bdev->ctxt;
+
+	if (zns->thread != spdk_get_thread()) {
+		spdk_thread_send_msg(zns->thread, kv_zns_submit_request, bdev_io);
+		return;
+	}
+	kv_zns_submit_request(bdev_io);
+}
+
+static bool
+vbdev_kv_zns_io_type_supported(void *ctx, enum spdk_bdev_io_type io_type)
+{
+	switch (io_type) {
+	case SPDK_BDEV_IO_KV_LIST:
+	case SPDK_BDEV_IO_KV_DELETE:
+	case SPDK_BDEV_IO_KV_EXIST:
+	case SPDK_BDEV_IO_KV_STORE:
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+	case SPDK_BDEV_IO_KV_SEND_SELECT:
+	case SPDK_BDEV_IO_KV_RETRIEVE_SELECT:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static struct spdk_io_channel *
+vbdev_kv_zns_get_io_channel(void *ctx)
+{
+	return spdk_get_io_channel(&g_kv_zns_nodes);
+}
+
+/* Checkpoints */
+
+static void
+kv_zns_ckpt_end(struct vbdev_kv_zns *zns, int rc)
+{
+	struct kv_zns_ckpt *ckpt = zns->ckpt;
+	struct kv_zns_zone *zone;
+	uint32_t i;
+
+	zns->ckpt = NULL;
+	if (zns->quiescing) {
+		zns->quiescing = false;
+		kv_zns_resume(zns);
+	}
+
+	if (rc == 0) {
+		zns->ckpt_zone = ckpt->zone;
+		zns->ckpt_seq++;
+		zns->dirty -= ckpt->dirty;
+		KV_ZNS_STAT_ADD(zns, checkpoints, 1);
+	} else {
+		SPDK_ERRLOG("Checkpoint of %s failed: %s\n", zns->bdev.name, spdk_strerror(-rc));
+	}
+
+	/* Zones the checkpoint recorded as free can be reused once it is on disk. */
+	for (i = 0; i < zns->num_zones; i++) {
+		zone = &zns->zones[i];
+		if (zone->state == KV_ZNS_ZONE_RESET_PENDING) {
+			if (rc == 0) {
+				kv_zns_zone_reset(zns, zone);
+			} else {
+				zone->state = KV_ZNS_ZONE_RELOCATED;
+			}
+		}
+	}
+
+	if (ckpt != NULL) {
+		spdk_dma_free(ckpt->buf);
+		free(ckpt);
+	}
+	zns->ckpt_running = false;
+	if (zns->ckpt_again && rc == 0) {
+		kv_zns_ckpt_start(zns);
+	}
+	kv_zns_gc_kick(zns);
+	kv_zns_stop_check(zns);
+}
+
+static void kv_zns_ckpt_write(struct kv_zns_ckpt *ckpt);
+
+static void
+kv_zns_ckpt_write_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct kv_zns_ckpt *ckpt = cb_arg;
+	struct vbdev_kv_zns *zns = ckpt->zns;
+	struct kv_zns_zone *zone = &zns->zones[ckpt->zone];
+
+	spdk_bdev_free_io(bdev_io);
+	zns->internal_ios--;
+
+	if (!success) {
+		kv_zns_ckpt_end(zns, -EIO);
+		return;
+	}
+
+	ckpt->written += spdk_min(ckpt->num_blocks - ckpt->written, zns->max_append_blocks);
+	if (ckpt->written < ckpt->num_blocks) {
+		kv_zns_ckpt_write(ckpt);
+		return;
+	}
+
+	zone->alloc = ckpt->num_blocks;
+	kv_zns_zone_finish(zns, zone);
+	kv_zns_ckpt_end(zns, 0);
+}
+
+/* Checkpoints are appended one piece after another, so they stay in order. */
+static void
+kv_zns_ckpt_write(struct kv_zns_ckpt *ckpt)
+{
+	struct vbdev_kv_zns *zns = ckpt->zns;
+	uint64_t num_blocks = spdk_min(ckpt->num_blocks - ckpt->written, zns->max_append_blocks);
+	int rc;
+
+	rc = spdk_bdev_zone_append(zns->base_desc, zns->base_ch,
+				   (uint8_t *)ckpt->buf + ckpt->written * zns->blocklen,
+				   zns->zones[ckpt->zone].start, num_blocks, kv_zns_ckpt_write_done, ckpt);
+	if (rc != 0) {
+		kv_zns_ckpt_end(zns, rc);
+		return;
+	}
+	zns->internal_ios++;
+}
+
+static void
+kv_zns_ckpt_reset_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct kv_zns_ckpt *ckpt = cb_arg;
+	struct vbdev_kv_zns *zns = ckpt->zns;
+
+	spdk_bdev_free_io(bdev_io);
+	zns->internal_ios--;
+
+	if (!success) {
+		kv_zns_ckpt_end(zns, -EIO);
+		return;
+	}
+	kv_zns_ckpt_write(ckpt);
+}
+
+/* Take the snapshot once the appends in flight are done, then let new ones go on. */
+static void
+kv_zns_ckpt_snapshot(struct vbdev_kv_zns *zns)
+{
+	struct kv_zns_ckpt_header *hdr;
+	struct kv_zns_ckpt_zone *czone;
+	struct kv_zns_ckpt_key *ckey;
+	struct kv_zns_zone *zone;
+	struct kv_zns_slot *slot;
+	struct kv_zns_ckpt *ckpt;
+	uint64_t data_len, i;
+	int rc;
+
+	assert(zns->appends == 0);
+
+	ckpt = calloc(1, sizeof(*ckpt));
+	if (ckpt == NULL) {
+		kv_zns_ckpt_end(zns, -ENOMEM);
+		return;
+	}
+	zns->ckpt = ckpt;
+	ckpt->zns = zns;
+	ckpt->zone = zns->ckpt_zone ^ 1;
+
+	data_len = (uint64_t)zns->num_zones * sizeof(*czone) + zns->count * sizeof(*ckey);
+	ckpt->num_blocks = 1 + SPDK_CEIL_DIV(data_len, zns->blocklen);
+	if (ckpt->num_blocks > zns->zones[ckpt->zone].capacity) {
+		kv_zns_ckpt_end(zns, -ENOSPC);
+		return;
+	}
+	ckpt->buf = kv_zns_buf_alloc(zns, ckpt->num_blocks, 0);
+	if (ckpt->buf == NULL) {
+		kv_zns_ckpt_end(zns, -ENOMEM);
+		return;
+	}
+	memset(ckpt->buf, 0, ckpt->num_blocks * zns->blocklen);
+
+	czone = (struct kv_zns_ckpt_zone *)((uint8_t *)ckpt->buf + zns->blocklen);
+	for (i = 0; i < zns->num_zones; i++) {
+		zone = &zns->zones[i];
+		czone[i].wp = KV_ZNS_FREE_WP;
+		czone[i].epoch = zone->epoch;
+		switch (zone->state) {
+		case KV_ZNS_ZONE_OPEN:
+		case KV_ZNS_ZONE_FULL:
+		case KV_ZNS_ZONE_GC:
+			czone[i].wp = zone->start + zone->alloc;
+			break;
+		case KV_ZNS_ZONE_RELOCATED:
+			zone->state = KV_ZNS_ZONE_RESET_PENDING;
+			break;
+		default:
+			break;
+		}
+	}
+
+	ckey = (struct kv_zns_ckpt_key *)&czone[zns->num_zones];
+	for (i = 0; i <= zns->mask; i++) {
+		slot = &zns->slots[i];
+		if (slot->key_len == 0) {
+			continue;
+		}
+		memcpy(ckey->key, slot->key, slot->key_len);
+		ckey->key_len = slot->key_len;
+		ckey->value_len = slot->value_len;
+		ckey->lba = slot->lba;
+		ckey->seq = slot->seq;
+		ckey++;
+	}
+
+	hdr = ckpt->buf;
+	hdr->magic = KV_ZNS_CKPT_MAGIC;
+	hdr->version = KV_ZNS_CKPT_VERSION;
+	hdr->seq = zns->ckpt_seq + 1;
+	hdr->next_seq = zns->next_seq;
+	hdr->next_epoch = zns->next_epoch;
+	hdr->num_zones = zns->num_zones;
+	hdr->num_keys = zns->count;
+	hdr->data_len = data_len;
+	hdr->crc = spdk_crc32c_update(ckpt->buf, zns->blocklen + data_len, ~0u);
+	ckpt->dirty = zns->dirty;
+
+	zns->quiescing = false;
+	kv_zns_resume(zns);
+
+	rc = spdk_bdev_zone_management(zns->base_desc, zns->base_ch, zns->zones[ckpt->zone].start,
+				       SPDK_BDEV_ZONE_RESET, kv_zns_ckpt_reset_done, ckpt);
+	if (rc != 0) {
+		kv_zns_ckpt_end(zns, rc);
+		return;
+	}
+	zns->internal_ios++;
+}
+
+static void
+kv_zns_ckpt_start(struct vbdev_kv_zns *zns)
+{
+	if (zns->ckpt_running) {
+		zns->ckpt_again = true;
+		return;
+	}
+	if (zns->base_removed) {
+		return;
+	}
+
+	zns->ckpt_running = true;
+	zns->ckpt_again = false;
+	zns->quiescing = true;
+	if (zns->appends == 0) {
+		kv_zns_ckpt_snapshot(zns);
+	}
+}
+
+static int
+kv_zns_ckpt_poll(void *arg)
+{
+	struct vbdev_kv_zns *zns = arg;
+
+	if (zns->dirty == 0 || zns->ckpt_running) {
+		return SPDK_POLLER_IDLE;
+	}
+	kv_zns_ckpt_start(zns);
+	return SPDK_POLLER_BUSY;
+}
+
+/* Garbage collection */
+
+static bool
+kv_zns_gc_live(struct vbdev_kv_zns *zns, const struct kv_zns_gc_entry *entry)
+{
+	struct kv_zns_slot *slot;
+
+	slot = kv_zns_find(zns, entry->key, entry->key_len);
+	return slot != NULL && slot->lba == entry->lba && slot->seq == entry->seq;
+}
+
+static void kv_zns_gc_pump(struct kv_zns_gc *gc);
+
+static void
+kv_zns_gc_op_end(struct kv_zns_gc_op *op, bool success)
+{
+	struct kv_zns_gc *gc = op->gc;
+
+	spdk_dma_free(op->req.buf);
+	op->req.buf = NULL;
+	if (!success) {
+		gc->failed = true;
+	}
+	gc->outstanding--;
+	TAILQ_INSERT_HEAD(&gc->free_ops, op, link);
+	kv_zns_gc_pump(gc);
+}
+
+static void
+kv_zns_gc_write_done(struct spdk_bdev_io *child, bool success, void *cb_arg)
+{
+	struct kv_zns_req *req = cb_arg;
+	struct kv_zns_gc_op *op = SPDK_CONTAINEROF(req, struct kv_zns_gc_op, req);
+	struct kv_zns_gc_entry *entry = op->entry;
+	struct vbdev_kv_zns *zns = req->zns;
+	struct kv_zns_slot *slot;
+	uint64_t lba;
+
+	if (child != NULL) {
+		if (success) {
+			lba = spdk_bdev_io_get_append_location(child);
+			/* Move the key over, unless it was written again meanwhile. */
+			if (kv_zns_gc_live(zns, entry)) {
+				slot = kv_zns_find(zns, entry->key, entry->key_len);
+				kv_zns_invalidate(zns, slot);
+				slot->lba = lba;
+				zns->zones[req->zone].valid += req->num_blocks;
+			}
+			KV_ZNS_STAT_ADD(zns, gc_bytes, (uint64_t)req->num_blocks * zns->blocklen);
+			KV_ZNS_STAT_ADD(zns, bytes_written, (uint64_t)req->num_blocks * zns->blocklen);
+		}
+		spdk_bdev_free_io(child);
+	}
+	kv_zns_alloc_put(zns, req->zone, success);
+	kv_zns_gc_op_end(op, success);
+}
+
+static int
+kv_zns_gc_write_try(struct kv_zns_gc_op *op)
+{
+	struct vbdev_kv_zns *zns = op->req.zns;
+	int rc;
+
+	rc = kv_zns_alloc(zns, true, op->req.num_blocks, &op->req.zone);
+	if (rc != 0) {
+		return rc;
+	}
+
+	/* The copy keeps its sequence number and gets the epoch of its new zone. */
+	kv_zns_record_seal(zns, op->req.buf, op->req.zone);
+	kv_zns_req_submit(&op->req, kv_zns_req_append, kv_zns_gc_write_done);
+	return 0;
+}
+
+static void
+kv_zns_gc_write(struct kv_zns_gc_op *op)
+{
+	struct kv_zns_gc *gc = op->gc;
+
+	if (!TAILQ_EMPTY(&gc->waiting) || kv_zns_gc_write_try(op) != 0) {
+		TAILQ_INSERT_TAIL(&gc->waiting, op, link);
+	}
+}
+
+static void
+kv_zns_gc_read_done(struct spdk_bdev_io *child, bool success, void *cb_arg)
+{
+	struct kv_zns_req *req = cb_arg;
+	struct kv_zns_gc_op *op = SPDK_CONTAINEROF(req, struct kv_zns_gc_op, req);
+	struct kv_zns_gc_entry *entry = op->entry;
+	struct vbdev_kv_zns *zns = req->zns;
+
+	if (child != NULL) {
+		spdk_bdev_free_io(child);
+	}
+	kv_zns_reader_put(zns, req->lba);
+
+	if (!success || !kv_zns_record_matches(req->buf, entry->key, entry->key_len,
+					       entry->value_len)) {
+		SPDK_ERRLOG("Could not read a record at %" PRIu64 " of %s\n", req->lba,
+			    spdk_bdev_get_name(zns->base_bdev));
+		kv_zns_gc_op_end(op, false);
+		return;
+	}
+	if (!kv_zns_gc_live(zns, entry)) {
+		kv_zns_gc_op_end(op, true);
+		return;
+	}
+	kv_zns_gc_write(op);
+}
+
+static void
+kv_zns_gc_done(struct kv_zns_gc *gc)
+{
+	struct vbdev_kv_zns *zns = gc->zns;
+	struct kv_zns_zone *victim = &zns->zones[gc->victim];
+
+	zns->gc = NULL;
+	if (!gc->failed && gc->next == gc->num_entries) {
+		SPDK_DEBUGLOG(vbdev_kv_zns, "zone %" PRIu64 " of %s relocated\n", victim->start,
+			      spdk_bdev_get_name(zns->base_bdev));
+		victim->state = KV_ZNS_ZONE_RELOCATED;
+		kv_zns_ckpt_start(zns);
+	} else {
+		victim->state = KV_ZNS_ZONE_FULL;
+	}
+	free(gc->entries);
+	free(gc);
+
+	if (!zns->stopping) {
+		kv_zns_gc_kick(zns);
+	}
+	kv_zns_stop_check(zns);
+}
+
+static void
+kv_zns_gc_pump(struct kv_zns_gc *gc)
+{
+	struct vbdev_kv_zns *zns = gc->zns;
+	struct kv_zns_gc_entry *entry;
+	struct kv_zns_gc_op *op;
+
+	if (gc->pumping) {
+		return;
+	}
+	gc->pumping = true;
+
+	while (!gc->failed && !zns->stopping && gc->next < gc->num_entries &&
+	       (op = TAILQ_FIRST(&gc->free_ops)) != NULL) {
+		entry = &gc->entries[gc->next++];
+		if (!kv_zns_gc_live(zns, entry)) {
+			continue;
+		}
+
+		op->entry = entry;
+		op->req.zns = zns;
+		op->req.lba = entry->lba;
+		op->req.num_blocks = kv_zns_record_blocks(zns, entry->value_len);
+		op->req.buf = kv_zns_buf_alloc(zns, op->req.num_blocks, 0);
+		if (op->req.buf == NULL) {
+			gc->failed = true;
+			break;
+		}
+		TAILQ_REMOVE(&gc->free_ops, op, link);
+		gc->outstanding++;
+		kv_zns_reader_get(zns, entry->lba);
+		kv_zns_req_submit(&op->req, kv_zns_req_read, kv_zns_gc_read_done);
+	}
+
+	gc->pumping = false;
+	if (gc->outstanding == 0 &&
+	    (gc->failed || zns->stopping || gc->next == gc->num_entries)) {
+		kv_zns_gc_done(gc);
+	}
+}
+
+/* Pick the full zone with the least live data, if its records fit where GC can put them. */
+static uint32_t
+kv_zns_gc_pick(struct vbdev_kv_zns *zns)
+{
+	struct kv_zns_zone *zone;
+	uint64_t room = 0, best_valid = UINT64_MAX;
+	uint32_t i, best = KV_ZNS_NO_ZONE;
+
+	if (zns->gc_zone != KV_ZNS_NO_ZONE) {
+		zone = &zns->zones[zns->gc_zone];
+		room = zone->capacity - zone->alloc;
+	}
+
+	for (i = 0; i < zns->num_zones; i++) {
+		zone = &zns->zones[i];
+		if (zone->state == KV_ZNS_ZONE_FREE) {
+			room += zone->capacity;
+			continue;
+		}
+		if (zone->state != KV_ZNS_ZONE_FULL || zone->appends != 0 || zone->valid >= zone->alloc) {
+			continue;
+		}
+		if (zone->valid < best_valid) {
+			best_valid = zone->valid;
+			best = i;
+		}
+	}
+
+	return best_valid <= room ? best : KV_ZNS_NO_ZONE;
+}
+
+static void
+kv_zns_gc_kick(struct vbdev_kv_zns *zns)
+{
+	struct kv_zns_gc_entry *entry;
+	struct kv_zns_slot *slot;
+	struct kv_zns_gc *gc;
+	uint32_t victim, i;
+	uint64_t n = 0;
+
+	if (zns->gc != NULL || zns->stopping || zns->free_zones > zns->gc_free_zones) {
+		return;
+	}
+
+	victim = kv_zns_gc_pick(zns);
+	if (victim == KV_ZNS_NO_ZONE) {
+		kv_zns_space_check(zns);
+		return;
+	}
+
+	gc = calloc(1, sizeof(*gc));
+	if (gc == NULL) {
+		return;
+	}
+	gc->entries = calloc(spdk_max(zns->zones[victim].valid, 1), sizeof(*gc->entries));
+	if (gc->entries == NULL) {
+		free(gc);
+		return;
+	}
+
+	/* Records hold at least one block each, so the live ones fit in valid entries. */
+	for (i = 0; i <= zns->mask; i++) {
+		slot = &zns->slots[i];
+		if (slot->key_len == 0 || kv_zns_zone_of(zns, slot->lba) != victim) {
+			continue;
+		}
+		entry = &gc->entries[n++];
+		memcpy(entry->key, slot->key, slot->key_len);
+		entry->key_len = slot->key_len;
+		entry->value_len = slot->value_len;
+		entry->lba = slot->lba;
+		entry->seq = slot->seq;
+	}
+
+	gc->zns = zns;
+	gc->victim = victim;
+	gc->num_entries = n;
+	TAILQ_INIT(&gc->free_ops);
+	TAILQ_INIT(&gc->waiting);
+	for (i = 0; i < KV_ZNS_GC_QUEUE_DEPTH; i++) {
+		gc->ops[i].gc = gc;
+		TAILQ_INSERT_TAIL(&gc->free_ops, &gc->ops[i], link);
+	}
+
+	SPDK_DEBUGLOG(vbdev_kv_zns, "collecting zone %" PRIu64 " of %s, %" PRIu64 " of %" PRIu64
+		      " blocks live\n", zns->zones[victim].start, spdk_bdev_get_name(zns->base_bdev),
+		      zns->zones[victim].valid, zns->zones[victim].alloc);
+	zns->zones[victim].state = KV_ZNS_ZONE_GC;
+	zns->gc = gc;
+	kv_zns_gc_pump(gc);
+}
+
+/* Teardown */
+
+static void
+kv_zns_free(struct vbdev_kv_zns *zns)
+{
+	spdk_kv_select_results_fini(&zns->selects);
+	free(zns->slots);
+	free(zns->zones);
+	free(zns->bdev.name);
+	free(zns);
+}
+
+static void
+kv_zns_close_base(struct vbdev_kv_zns *zns)
+{
+	if (zns->base_ch != NULL) {
+		spdk_put_io_channel(zns->base_ch);
+		zns->base_ch = NULL;
+	}
+	if (zns->base_desc != NULL) {
+		spdk_bdev_module_release_bdev(zns->base_bdev);
+		spdk_bdev_close(zns->base_desc);
+		zns->base_desc = NULL;
+	}
+}
+
+/* Finish the destruct once the last checkpoint and all engine I/O are done. */
+static void
+kv_zns_stop_check(struct vbdev_kv_zns *zns)
+{
+	if (!zns->stopping || zns->ckpt_running || zns->gc != NULL || zns->internal_ios != 0 ||
+	    zns->appends != 0) {
+		return;
+	}
+
+	kv_zns_close_base(zns);
+	spdk_bdev_destruct_done(&zns->bdev, 0);
+	kv_zns_free(zns);
+}
+
+static void
+_vbdev_kv_zns_destruct(void *ctx)
+{
+	struct vbdev_kv_zns *zns = ctx;
+	struct kv_zns_gc_op *op;
+
+	zns->stopping = true;
+	spdk_poller_unregister(&zns->ckpt_poller);
+
+	/* Copies waiting for a zone may never get one now. */
+	while (zns->gc != NULL && (op = TAILQ_FIRST(&zns->gc->waiting)) != NULL) {
+		TAILQ_REMOVE(&zns->gc->waiting, op, link);
+		kv_zns_gc_op_end(op, false);
+	}
+	if (zns->dirty != 0) {
+		kv_zns_ckpt_start(zns);
+	}
+	kv_zns_stop_check(zns);
+}
+
+static int
+vbdev_kv_zns_destruct(void *ctx)
+{
+	struct vbdev_kv_zns *zns = ctx;
+
+	TAILQ_REMOVE(&g_kv_zns_nodes, zns, link);
+
+	/* The engine state, pollers and base descriptor belong to the engine thread. */
+	if (zns->thread != spdk_get_thread()) {
+		spdk_thread_send_msg(zns->thread, _vbdev_kv_zns_destruct, zns);
+	} else {
+		_vbdev_kv_zns_destruct(zns);
+	}
+
+	/* kv_zns_stop_check() finishes the destruct. */
+	return 1;
+}
+
+static void
+vbdev_kv_zns_write_params_json(struct vbdev_kv_zns *zns, struct spdk_json_write_ctx *w)
+{
+	spdk_json_write_named_string(w, "name", spdk_bdev_get_name(&zns->bdev));
+	spdk_json_write_named_string(w, "base_bdev_name", spdk_bdev_get_name(zns->base_bdev));
+	spdk_json_write_named_uint32(w, "checkpoint_ms", zns->checkpoint_ms);
+	spdk_json_write_named_uint32(w, "gc_free_zones", zns->gc_free_zones);
+}
+
+static int
+vbdev_kv_zns_dump_info_json(void *ctx, struct spdk_json_write_ctx *w)
+{
+	struct vbdev_kv_zns *zns = ctx;
+
+	spdk_json_write_name(w, "kv_zns");
+	spdk_json_write_object_begin(w);
+	vbdev_kv_zns_write_params_json(zns, w);
+	spdk_json_write_named_uint32(w, "num_zones", zns->num_zones);
+	spdk_json_write_named_uint64(w, "max_value_size",
+				     (uint64_t)zns->max_record_blocks * zns->blocklen - KV_ZNS_RECORD_HDR_SIZE);
+	spdk_json_write_named_uint64(w, "max_keys", zns->max_keys);
+	spdk_json_write_object_end(w);
+
+	return 0;
+}
+
+static void
+vbdev_kv_zns_write_config_json(struct spdk_bdev *bdev, struct spdk_json_write_ctx *w)
+{
+	struct vbdev_kv_zns *zns = bdev->ctxt;
+
+	spdk_json_write_object_begin(w);
+	spdk_json_write_named_string(w, "method", "bdev_kv_zns_create");
+	spdk_json_write_named_object_begin(w, "params");
+	vbdev_kv_zns_write_params_json(zns, w);
+	spdk_json_write_object_end(w);
+	spdk_json_write_object_end(w);
+}
+
+static const struct spdk_bdev_fn_table vbdev_kv_zns_fn_table = {
+	.destruct		= vbdev_kv_zns_destruct,
+	.submit_request		= vbdev_kv_zns_submit_request,
+	.io_type_supported	= vbdev_kv_zns_io_type_supported,
+	.get_io_channel		= vbdev_kv_zns_get_io_channel,
+	.dump_info_json		= vbdev_kv_zns_dump_info_json,
+	.write_config_json	= vbdev_kv_zns_write_config_json,
+};
+
+/* Load */
+
+struct kv_zns_load_ctx {
+	struct vbdev_kv_zns		*zns;
+	struct spdk_bdev_zone_info	*info;
+	uint32_t			zone;
+	/* Newest valid checkpoint. */
+	void				*ckpt_buf;
+	struct kv_zns_ckpt_header	ckpt;
+	uint32_t			ckpt_zone;
+	/* Read buffer, large enough for any record or checkpoint header. */
+	void				*buf;
+	uint32_t			buf_blocks;
+	/* Zone being replayed, and the epoch its records carry; 0 until known. */
+	uint64_t			pos;
+	uint64_t			end;
+	uint32_t			epoch;
+	uint64_t			max_seq;
+	uint32_t			max_epoch;
+	uint64_t			replayed;
+};
+
+static void kv_zns_load_zone(struct kv_zns_load_ctx *ctx);
+static void kv_zns_load_ckpt(struct kv_zns_load_ctx *ctx);
+
+static void
+kv_zns_register(struct vbdev_kv_zns *zns)
+{
+	spdk_kv_zns_create_cb cb_fn = zns->create_cb;
+	void *cb_arg = zns->create_cb_arg;
+	int rc;
+
+	if (zns->checkpoint_ms != 0) {
+		zns->ckpt_poller = SPDK_POLLER_REGISTER(kv_zns_ckpt_poll, zns,
+							zns->checkpoint_ms * 1000ULL);
+	}
+
+	rc = spdk_bdev_register(&zns->bdev);
+	if (rc != 0) {
+		spdk_poller_unregister(&zns->ckpt_poller);
+		kv_zns_close_base(zns);
+		kv_zns_free(zns);
+		cb_fn(cb_arg, NULL, rc);
+		return;
+	}
+
+	zns->registered = true;
+	TAILQ_INSERT_TAIL(&g_kv_zns_nodes, zns, link);
+	SPDK_NOTICELOG("created kv_zns bdev %s on %s: %" PRIu64 " keys, %u of %u zones free\n",
+		       zns->bdev.name, spdk_bdev_get_name(zns->base_bdev), zns->count,
+		       zns->free_zones, zns->num_zones);
+	cb_fn(cb_arg, &zns->bdev, 0);
+}
+
+static void
+kv_zns_load_done(struct kv_zns_load_ctx *ctx, int rc)
+{
+	struct vbdev_kv_zns *zns = ctx->zns;
+	spdk_kv_zns_create_cb cb_fn = zns->create_cb;
+	void *cb_arg = zns->create_cb_arg;
+	struct kv_zns_zone *zone;
+	struct kv_zns_slot *slot;
+	uint64_t i;
+
+	spdk_dma_free(ctx->buf);
+	spdk_dma_free(ctx->ckpt_buf);
+	free(ctx->info);
+	free(ctx);
+
+	if (rc != 0) {
+		SPDK_ERRLOG("Could not load %s from %s: %s\n", zns->bdev.name,
+			    spdk_bdev_get_name(zns->base_bdev), spdk_strerror(-rc));
+		kv_zns_close_base(zns);
+		kv_zns_free(zns);
+		cb_fn(cb_arg, NULL, rc);
+		return;
+	}
+
+	/* Drop the keys deleted during replay and count the live blocks of every zone. */
+	for (i = 0; i <= zns->mask; i++) {
+		slot = &zns->slots[i];
+		while (slot->key_len != 0 && slot->deleted) {
+			/* Shifts the next key of the probe sequence into this slot. */
+			kv_zns_index_remove(zns, slot);
+		}
+		if (slot->key_len != 0) {
+			zns->zones[kv_zns_zone_of(zns, slot->lba)].valid +=
+				kv_zns_record_blocks(zns, slot->value_len);
+		}
+	}
+	for (i = 0; i < zns->num_zones; i++) {
+		zone = &zns->zones[i];
+		if (zone->state == KV_ZNS_ZONE_FULL) {
+			kv_zns_zone_finish(zns, zone);
+		}
+	}
+	if (zns->count > zns->max_keys) {
+		SPDK_WARNLOG("%s holds more keys than fit in a checkpoint\n", zns->bdev.name);
+	}
+
+	kv_zns_register(zns);
+}
+
+/* Apply a record found past the checkpoint, if it is newer than what the index has. */
+static int
+kv_zns_load_apply(struct vbdev_kv_zns *zns, const struct kv_zns_record *rec, uint64_t lba)
+{
+	uint32_t hash = spdk_bdev_kv_key_hash(rec->key, rec->key_len);
+	struct kv_zns_slot *slot;
+
+	slot = kv_zns_lookup(zns, rec->key, rec->key_len, hash);
+	if (slot->key_len != 0 && slot->seq >= rec->seq) {
+		return 0;
+	}
+	if (slot->key_len == 0) {
+		if (kv_zns_index_reserve(zns, 1) != 0) {
+			return -ENOMEM;
+		}
+		slot = kv_zns_lookup(zns, rec->key, rec->key_len, hash);
+		memcpy(slot->key, rec->key, rec->key_len);
+		slot->key_len = rec->key_len;
+		slot->hash = hash;
+		zns->count++;
+	}
+	slot->deleted = !!(rec->flags & KV_ZNS_RECORD_DELETE);
+	slot->lba = lba;
+	slot->value_len = rec->value_len;
+	slot->seq = rec->seq;
+	return 0;
+}
+
+static void kv_zns_load_replay(struct kv_zns_load_ctx *ctx);
+
+static void
+kv_zns_load_next_zone(struct kv_zns_load_ctx *ctx)
+{
+	ctx->zone++;
+	kv_zns_load_zone(ctx);
+}
+
+static void
+kv_zns_load_reset_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct kv_zns_load_ctx *ctx = cb_arg;
+	struct kv_zns_zone *zone = &ctx->zns->zones[ctx->zone];
+
+	spdk_bdev_free_io(bdev_io);
+	if (!success) {
+		kv_zns_load_done(ctx, -EIO);
+		return;
+	}
+
+	zone->state = KV_ZNS_ZONE_FREE;
+	zone->alloc = 0;
+	ctx->zns->free_zones++;
+	kv_zns_load_next_zone(ctx);
+}
+
+/* The zone holds records garbage collection had copied out already. */
+static void
+kv_zns_load_reset(struct kv_zns_load_ctx *ctx)
+{
+	struct vbdev_kv_zns *zns = ctx->zns;
+	int rc;
+
+	SPDK_DEBUGLOG(vbdev_kv_zns, "resetting stale zone %" PRIu64 "\n", zns->zones[ctx->zone].start);
+	rc = spdk_bdev_zone_management(zns->base_desc, zns->base_ch, zns->zones[ctx->zone].start,
+				       SPDK_BDEV_ZONE_RESET, kv_zns_load_reset_done, ctx);
+	if (rc != 0) {
+		kv_zns_load_done(ctx, rc);
+	}
+}
+
+static void
+kv_zns_load_replay_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct kv_zns_load_ctx *ctx = cb_arg;
+	struct vbdev_kv_zns *zns = ctx->zns;
+	uint64_t num_blocks = spdk_min(ctx->end - ctx->pos, ctx->buf_blocks), off = 0;
+	struct kv_zns_record *rec;
+	uint32_t rec_blocks;
+	int rc;
+
+	spdk_bdev_free_io(bdev_io);
+	if (!success) {
+		kv_zns_load_done(ctx, -EIO);
+		return;
+	}
+
+	/*
+	 * Appends complete out of order, so a record torn by a crash can sit in
+	 * front of complete ones. Skip anything that does not check out block by block.
+	 */
+	while (off < num_blocks) {
+		rec = (struct kv_zns_record *)((uint8_t *)ctx->buf + off * zns->blocklen);
+		rec_blocks = kv_zns_record_parse(zns, rec);
+		if (rec_blocks == 0 || (ctx->epoch != 0 && rec->epoch != ctx->epoch)) {
+			off++;
+			continue;
+		}
+		if (off + rec_blocks > num_blocks) {
+			if (ctx->pos + num_blocks < ctx->end) {
+				/* Read again from the start of the record. */
+				break;
+			}
+			off++;
+			continue;
+		}
+		if (!kv_zns_record_crc_ok(rec)) {
+			off++;
+			continue;
+		}
+		if (ctx->epoch == 0) {
+			/* First record of a zone the checkpoint had as free. */
+			if (rec->epoch < ctx->ckpt.next_epoch) {
+				kv_zns_load_reset(ctx);
+				return;
+			}
+			ctx->epoch = rec->epoch;
+			zns->zones[ctx->zone].epoch = rec->epoch;
+		}
+
+		rc = kv_zns_load_apply(zns, rec, ctx->pos + off);
+		if (rc != 0) {
+			kv_zns_load_done(ctx, rc);
+			return;
+		}
+		ctx->max_seq = spdk_max(ctx->max_seq, rec->seq);
+		ctx->max_epoch = spdk_max(ctx->max_epoch, rec->epoch);
+		ctx->replayed++;
+		off += rec_blocks;
+	}
+
+	ctx->pos += off;
+	if (ctx->epoch == 0 && ctx->pos >= ctx->end) {
+		/* Nothing valid in the whole zone. */
+		kv_zns_load_reset(ctx);
+		return;
+	}
+	kv_zns_load_replay(ctx);
+}
+
+static void
+kv_zns_load_replay(struct kv_zns_load_ctx *ctx)
+{
+	struct vbdev_kv_zns *zns = ctx->zns;
+	int rc;
+
+	if (ctx->pos >= ctx->end) {
+		kv_zns_load_next_zone(ctx);
+		return;
+	}
+
+	rc = spdk_bdev_read_blocks(zns->base_desc, zns->base_ch, ctx->buf, ctx->pos,
+				   spdk_min(ctx->end - ctx->pos, ctx->buf_blocks),
+				   kv_zns_load_replay_done, ctx);
+	if (rc != 0) {
+		kv_zns_load_done(ctx, rc);
+	}
+}
+
+/* Work out what to keep of one data zone. */
+static void
+kv_zns_load_zone(struct kv_zns_load_ctx *ctx)
+{
+	struct vbdev_kv_zns *zns = ctx->zns;
+	struct spdk_bdev_zone_info *info;
+	struct kv_zns_ckpt_zone *czone;
+	struct kv_zns_zone *zone;
+	uint64_t wp;
+
+	if (ctx->zone == zns->num_zones) {
+		zns->next_seq = spdk_max(zns->next_seq, ctx->max_seq + 1);
+		zns->next_epoch = spdk_max(zns->next_epoch, ctx->max_epoch + 1);
+		zns->dirty = ctx->replayed;
+		SPDK_DEBUGLOG(vbdev_kv_zns, "replayed %" PRIu64 " records\n", ctx->replayed);
+		kv_zns_load_done(ctx, 0);
+		return;
+	}
+
+	zone = &zns->zones[ctx->zone];
+	info = &ctx->info[ctx->zone];
+	if (zone->state == KV_ZNS_ZONE_RESERVED) {
+		kv_zns_load_next_zone(ctx);
+		return;
+	}
+
+	switch (info->state) {
+	case SPDK_BDEV_ZONE_STATE_EMPTY:
+		wp = zone->start;
+		break;
+	case SPDK_BDEV_ZONE_STATE_FULL:
+		wp = zone->start + zone->capacity;
+		break;
+	default:
+		wp = info->write_pointer;
+		break;
+	}
+
+	if (wp == zone->start) {
+		zone->state = KV_ZNS_ZONE_FREE;
+		zns->free_zones++;
+		kv_zns_load_next_zone(ctx);
+		return;
+	}
+
+	zone->state = KV_ZNS_ZONE_FULL;
+	zone->alloc = wp - zone->start;
+	ctx->end = wp;
+	czone = ctx->ckpt_buf ? (struct kv_zns_ckpt_zone *)((uint8_t *)ctx->ckpt_buf + zns->blocklen) +
+		ctx->zone : NULL;
+	if (czone != NULL && czone->wp != KV_ZNS_FREE_WP) {
+		/* In use at the checkpoint: replay what was written since. */
+		zone->epoch = czone->epoch;
+		ctx->epoch = czone->epoch;
+		ctx->pos = spdk_min(czone->wp, wp);
+	} else {
+		/* Written after the checkpoint if its records are from a later epoch. */
+		ctx->epoch = 0;
+		ctx->pos = zone->start;
+	}
+	kv_zns_load_replay(ctx);
+}
+
+static int
+kv_zns_load_ckpt_apply(struct kv_zns_load_ctx *ctx)
+{
+	struct vbdev_kv_zns *zns = ctx->zns;
+	struct kv_zns_ckpt_key *ckey;
+	struct kv_zns_slot *slot;
+	uint64_t i;
+	int rc;
+
+	zns->ckpt_seq = ctx->ckpt.seq;
+	zns->ckpt_zone = ctx->ckpt_zone;
+	zns->next_seq = ctx->ckpt.next_seq;
+	zns->next_epoch = ctx->ckpt.next_epoch;
+
+	while ((zns->mask + 1) * 3 < (ctx->ckpt.num_keys + 1) * 4) {
+		rc = kv_zns_index_resize(zns, (zns->mask + 1) * 2);
+		if (rc != 0) {
+			return rc;
+		}
+	}
+
+	ckey = (struct kv_zns_ckpt_key *)((uint8_t *)ctx->ckpt_buf + zns->blocklen +
+					  (uint64_t)zns->num_zones * sizeof(struct kv_zns_ckpt_zone));
+	for (i = 0; i < ctx->ckpt.num_keys; i++, ckey++) {
+		if (ckey->key_len == 0 || ckey->key_len > NVME_KV_MAX_KEY_LENGTH ||
+		    kv_zns_zone_of(zns, ckey->lba) >= zns->num_zones) {
+			return -EILSEQ;
+		}
+		slot = kv_zns_lookup(zns, ckey->key, ckey->key_len,
+				     spdk_bdev_kv_key_hash(ckey->key, ckey->key_len));
+		memcpy(slot->key, ckey->key, ckey->key_len);
+		slot->key_len = ckey->key_len;
+		slot->hash = spdk_bdev_kv_key_hash(ckey->key, ckey->key_len);
+		slot->value_len = ckey->value_len;
+		slot->lba = ckey->lba;
+		slot->seq = ckey->seq;
+		zns->count++;
+	}
+	return 0;
+}
+
+static void
+kv_zns_load_ckpt_data_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct kv_zns_load_ctx *ctx = cb_arg;
+	struct vbdev_kv_zns *zns = ctx->zns;
+	struct kv_zns_ckpt_header *hdr = ctx->buf;
+	uint32_t crc = hdr->crc;
+
+	spdk_bdev_free_io(bdev_io);
+
+	hdr->crc = 0;
+	if (success && spdk_crc32c_update(ctx->buf, zns->blocklen + hdr->data_len, ~0u) == crc &&
+	    (ctx->ckpt_buf == NULL || hdr->seq > ctx->ckpt.seq)) {
+		/* Keep it, and read the next one into a new buffer. */
+		spdk_dma_free(ctx->ckpt_buf);
+		ctx->ckpt_buf = ctx->buf;
+		ctx->ckpt = *hdr;
+		ctx->ckpt_zone = ctx->zone;
+		ctx->buf = kv_zns_buf_alloc(zns, ctx->buf_blocks, 0);
+		if (ctx->buf == NULL) {
+			kv_zns_load_done(ctx, -ENOMEM);
+			return;
+		}
+	} else if (!success) {
+		SPDK_WARNLOG("Could not read checkpoint zone %u of %s\n", ctx->zone,
+			     spdk_bdev_get_name(zns->base_bdev));
+	}
+
+	ctx->zone++;
+	kv_zns_load_ckpt(ctx);
+}
+
+static void
+kv_zns_load_ckpt_header_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct kv_zns_load_ctx *ctx = cb_arg;
+	struct vbdev_kv_zns *zns = ctx->zns;
+	struct kv_zns_ckpt_header hdr;
+	uint64_t num_blocks;
+	void *buf;
+	int rc;
+
+	spdk_bdev_free_io(bdev_io);
+
+	memcpy(&hdr, ctx->buf, sizeof(hdr));
+	num_blocks = 1 + SPDK_CEIL_DIV(hdr.data_len, zns->blocklen);
+	if (!success || hdr.magic != KV_ZNS_CKPT_MAGIC || hdr.version != KV_ZNS_CKPT_VERSION ||
+	    hdr.num_zones != zns->num_zones ||
+	    hdr.data_len != hdr.num_zones * sizeof(struct kv_zns_ckpt_zone) +
+	    hdr.num_keys * sizeof(struct kv_zns_ckpt_key) ||
+	    num_blocks > zns->zones[ctx->zone].capacity) {
+		ctx->zone++;
+		kv_zns_load_ckpt(ctx);
+		return;
+	}
+
+	if (num_blocks > ctx->buf_blocks) {
+		buf = kv_zns_buf_alloc(zns, num_blocks, 0);
+		if (buf == NULL) {
+			kv_zns_load_done(ctx, -ENOMEM);
+			return;
+		}
+		spdk_dma_free(ctx->buf);
+		ctx->buf = buf;
+		ctx->buf_blocks = num_blocks;
+	}
+
+	rc = spdk_bdev_read_blocks(zns->base_desc, zns->base_ch, ctx->buf, zns->zones[ctx->zone].start,
+				   num_blocks, kv_zns_load_ckpt_data_done, ctx);
+	if (rc != 0) {
+		kv_zns_load_done(ctx, rc);
+	}
+}
+
+/* Read both checkpoint zones and keep the newest valid checkpoint. */
+static void
+kv_zns_load_ckpt(struct kv_zns_load_ctx *ctx)
+{
+	struct vbdev_kv_zns *zns = ctx->zns;
+	int rc;
+
+	while (ctx->zone < KV_ZNS_NUM_CKPT_ZONES &&
+	       ctx->info[ctx->zone].state == SPDK_BDEV_ZONE_STATE_EMPTY) {
+		ctx->zone++;
+	}
+
+	if (ctx->zone == KV_ZNS_NUM_CKPT_ZONES) {
+		if (ctx->ckpt_buf != NULL) {
+			rc = kv_zns_load_ckpt_apply(ctx);
+			if (rc != 0) {
+				kv_zns_load_done(ctx, rc);
+				return;
+			}
+			SPDK_DEBUGLOG(vbdev_kv_zns, "loaded checkpoint %" PRIu64 " with %" PRIu64 " keys\n",
+				      ctx->ckpt.seq, zns->count);
+		} else {
+			/* Start empty; zones written before the first checkpoint are replayed. */
+			zns->ckpt_zone = 1;
+			zns->next_seq = 1;
+			zns->next_epoch = 1;
+			ctx->ckpt.next_epoch = 1;
+		}
+		kv_zns_load_zone(ctx);
+		return;
+	}
+
+	rc = spdk_bdev_read_blocks(zns->base_desc, zns->base_ch, ctx->buf, zns->zones[ctx->zone].start,
+				   1, kv_zns_load_ckpt_header_done, ctx);
+	if (rc != 0) {
+		kv_zns_load_done(ctx, rc);
+	}
+}
+
+static int
+kv_zns_load_geometry(struct kv_zns_load_ctx *ctx)
+{
+	struct vbdev_kv_zns *zns = ctx->zns;
+	uint32_t max_append = spdk_bdev_get_max_zone_append_size(zns->base_bdev);
+	struct spdk_bdev_zone_info *info;
+	struct kv_zns_zone *zone;
+	uint64_t min_capacity = UINT64_MAX, table_len;
+	uint32_t i;
+
+	for (i = 0; i < zns->num_zones; i++) {
+		info = &ctx->info[i];
+		zone = &zns->zones[i];
+		zone->zns = zns;
+		zone->start = info->zone_id;
+		zone->capacity = info->capacity;
+		zone->state = KV_ZNS_ZONE_RESERVED;
+		if (i < KV_ZNS_NUM_CKPT_ZONES) {
+			if (info->type == SPDK_BDEV_ZONE_TYPE_CNV || info->state == SPDK_BDEV_ZONE_STATE_OFFLINE ||
+			    info->state == SPDK_BDEV_ZONE_STATE_READ_ONLY) {
+				SPDK_ERRLOG("Checkpoint zone %u of %s cannot be written\n", i,
+					    spdk_bdev_get_name(zns->base_bdev));
+				return -EINVAL;
+			}
+			continue;
+		}
+		if (info->type == SPDK_BDEV_ZONE_TYPE_CNV || info->state == SPDK_BDEV_ZONE_STATE_OFFLINE ||
+		    info->state == SPDK_BDEV_ZONE_STATE_READ_ONLY || info->capacity == 0) {
+			continue;
+		}
+		/* Sorted out by kv_zns_load_zone(). */
+		zone->state = KV_ZNS_ZONE_FULL;
+		min_capacity = spdk_min(min_capacity, info->capacity);
+	}
+	if (min_capacity == UINT64_MAX) {
+		SPDK_ERRLOG("%s has no writable data zones\n", spdk_bdev_get_name(zns->base_bdev));
+		return -EINVAL;
+	}
+
+	zns->max_append_blocks = max_append != 0 ? max_append : min_capacity;
+	zns->max_record_blocks = spdk_min(zns->max_append_blocks, min_capacity);
+	zns->max_record_blocks = spdk_min(zns->max_record_blocks,
+					  KV_ZNS_MAX_RECORD_SIZE / zns->blocklen);
+	if (zns->max_record_blocks < kv_zns_record_blocks(zns, 0)) {
+		return -EINVAL;
+	}
+
+	table_len = (uint64_t)zns->num_zones * sizeof(struct kv_zns_ckpt_zone);
+	min_capacity = spdk_min(zns->zones[0].capacity, zns->zones[1].capacity);
+	if ((min_capacity - 1) * zns->blocklen < table_len) {
+		SPDK_ERRLOG("Checkpoint zones of %s are too small\n", spdk_bdev_get_name(zns->base_bdev));
+		return -EINVAL;
+	}
+	zns->max_keys = ((min_capacity - 1) * zns->blocklen - table_len) / sizeof(struct kv_zns_ckpt_key);
+
+	ctx->buf_blocks = zns->max_record_blocks;
+	ctx->buf = kv_zns_buf_alloc(zns, ctx->buf_blocks, 0);
+	return ctx->buf != NULL ? 0 : -ENOMEM;
+}
+
+static void kv_zns_load_info(struct kv_zns_load_ctx *ctx);
+
+static void
+kv_zns_load_info_done(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct kv_zns_load_ctx *ctx = cb_arg;
+	int rc;
+
+	spdk_bdev_free_io(bdev_io);
+	if (!success) {
+		kv_zns_load_done(ctx, -EIO);
+		return;
+	}
+
+	ctx->zone += spdk_min(ctx->zns->num_zones - ctx->zone, KV_ZNS_ZONE_INFO_BATCH);
+	if (ctx->zone < ctx->zns->num_zones) {
+		kv_zns_load_info(ctx);
+		return;
+	}
+
+	rc = kv_zns_load_geometry(ctx);
+	if (rc != 0) {
+		kv_zns_load_done(ctx, rc);
+		return;
+	}
+	ctx->zone = 0;
+	kv_zns_load_ckpt(ctx);
+}
+
+static void
+kv_zns_load_info(struct kv_zns_load_ctx *ctx)
+{
+	struct vbdev_kv_zns *zns = ctx->zns;
+	int rc;
+
+	rc = spdk_bdev_get_zone_info(zns->base_desc, zns->base_ch, ctx->zone * zns->zone_size,
+				     spdk_min(zns->num_zones - ctx->zone, KV_ZNS_ZONE_INFO_BATCH),
+				     &ctx->info[ctx->zone], kv_zns_load_info_done, ctx);
+	if (rc != 0) {
+		kv_zns_load_done(ctx, rc);
+	}
+}
+
+static int
+kv_zns_load(struct vbdev_kv_zns *zns)
+{
+	struct kv_zns_load_ctx *ctx;
+
+	ctx = calloc(1, sizeof(*ctx));
+	if (ctx == NULL) {
+		return -ENOMEM;
+	}
+	ctx->zns = zns;
+	ctx->info = calloc(zns->num_zones, sizeof(*ctx->info));
+	if (ctx->info == NULL) {
+		free(ctx);
+		return -ENOMEM;
+	}
+
+	kv_zns_load_info(ctx);
+	return 0;
+}
+
+/* Create and delete */
+
+static void
+vbdev_kv_zns_base_bdev_event_cb(enum spdk_bdev_event_type type, struct spdk_bdev *bdev,
+				void *event_ctx)
+{
+	struct vbdev_kv_zns *zns = event_ctx;
+
+	switch (type) {
+	case SPDK_BDEV_EVENT_REMOVE:
+		zns->base_removed = true;
+		if (zns->registered) {
+			spdk_bdev_unregister(&zns->bdev, NULL, NULL);
+		}
+		break;
+	default:
+		SPDK_NOTICELOG("Unsupported bdev event: type %d\n", type);
+		break;
+	}
+}
+
+int
+bdev_kv_zns_create(const struct vbdev_kv_zns_opts *opts, spdk_kv_zns_create_cb cb_fn,
+		   void *cb_arg)
+{
+	struct vbdev_kv_zns *zns;
+	struct spdk_bdev *bdev;
+	uint32_t i;
+	int rc;
+
+	if (opts->name == NULL || opts->base_bdev_name == NULL) {
+		return -EINVAL;
+	}
+	if (opts->gc_free_zones < KV_ZNS_GC_RESERVE_ZONES) {
+		SPDK_ERRLOG("gc_free_zones must be at least %u\n", KV_ZNS_GC_RESERVE_ZONES);
+		return -EINVAL;
+	}
+
+	zns = calloc(1, sizeof(*zns));
+	if (zns == NULL) {
+		return -ENOMEM;
+	}
+
+	zns->bdev.name = strdup(opts->name);
+	zns->slots = calloc(KV_ZNS_INDEX_MIN_SLOTS, sizeof(*zns->slots));
+	if (zns->bdev.name == NULL || zns->slots == NULL) {
+		kv_zns_free(zns);
+		return -ENOMEM;
+	}
+	zns->mask = KV_ZNS_INDEX_MIN_SLOTS - 1;
+	zns->checkpoint_ms = opts->checkpoint_ms;
+	zns->gc_free_zones = opts->gc_free_zones;
+	zns->user_zone = KV_ZNS_NO_ZONE;
+	zns->gc_zone = KV_ZNS_NO_ZONE;
+	zns->next_free = KV_ZNS_NUM_CKPT_ZONES;
+	zns->create_cb = cb_fn;
+	zns->create_cb_arg = cb_arg;
+	for (i = 0; i < KV_ZNS_NUM_BUCKETS; i++) {
+		TAILQ_INIT(&zns->busy[i]);
+	}
+	TAILQ_INIT(&zns->wait_space);
+	spdk_kv_select_results_init(&zns->selects, KV_ZNS_MAX_SELECTS, 0);
+
+	rc = spdk_bdev_open_ext(opts->base_bdev_name, true, vbdev_kv_zns_base_bdev_event_cb, zns,
+				&zns->base_desc);
+	if (rc != 0) {
+		SPDK_ERRLOG("could not open bdev %s\n", opts->base_bdev_name);
+		kv_zns_free(zns);
+		return rc;
+	}
+	bdev = spdk_bdev_desc_get_bdev(zns->base_desc);
+	zns->base_bdev = bdev;
+
+	if (!spdk_bdev_is_zoned(bdev) ||
+	    !spdk_bdev_io_type_supported(bdev, SPDK_BDEV_IO_TYPE_ZONE_APPEND) ||
+	    !spdk_bdev_io_type_supported(bdev, SPDK_BDEV_IO_TYPE_GET_ZONE_INFO) ||
+	    !spdk_bdev_io_type_supported(bdev, SPDK_BDEV_IO_TYPE_ZONE_MANAGEMENT)) {
+		SPDK_ERRLOG("bdev %s is not a zoned bdev supporting zone append\n", opts->base_bdev_name);
+		spdk_bdev_close(zns->base_desc);
+		kv_zns_free(zns);
+		return -ENOTSUP;
+	}
+
+	rc = spdk_bdev_module_claim_bdev(bdev, zns->base_desc, &kv_zns_if);
+	if (rc != 0) {
+		SPDK_ERRLOG("could not claim bdev %s\n", opts->base_bdev_name);
+		spdk_bdev_close(zns->base_desc);
+		kv_zns_free(zns);
+		return rc;
+	}
+
+	zns->thread = spdk_get_thread();
+	zns->base_ch = spdk_bdev_get_io_channel(zns->base_desc);
+	zns->blocklen = spdk_bdev_get_block_size(bdev);
+	zns->zone_size = spdk_bdev_get_zone_size(bdev);
+	zns->num_zones = spdk_bdev_get_num_zones(bdev);
+	zns->zones = calloc(zns->num_zones, sizeof(*zns->zones));
+	if (zns->base_ch == NULL || zns->zones == NULL) {
+		rc = -ENOMEM;
+		goto error;
+	}
+	if (zns->num_zones < KV_ZNS_NUM_CKPT_ZONES + KV_ZNS_GC_RESERVE_ZONES + 1 ||
+	    zns->blocklen < KV_ZNS_RECORD_HDR_SIZE) {
+		SPDK_ERRLOG("bdev %s has too few zones\n", opts->base_bdev_name);
+		rc = -EINVAL;
+		goto error;
+	}
+
+	zns->bdev.product_name = "kv_zns";
+	zns->bdev.write_cache = bdev->write_cache;
+	zns->bdev.required_alignment = bdev->required_alignment;
+	zns->bdev.blocklen = bdev->blocklen;
+	zns->bdev.blockcnt = bdev->blockcnt;
+	zns->bdev.ctxt = zns;
+	zns->bdev.fn_table = &vbdev_kv_zns_fn_table;
+	zns->bdev.module = &kv_zns_if;
+
+	rc = kv_zns_load(zns);
+	if (rc != 0) {
+		goto error;
+	}
+	return 0;
+
+error:
+	kv_zns_close_base(zns);
+	kv_zns_free(zns);
+	return rc;
+}
+
+void
+bdev_kv_zns_delete(const char *name, spdk_bdev_unregister_cb cb_fn, void *cb_arg)
+{
+	int rc;
+
+	rc = spdk_bdev_unregister_by_name(name, &kv_zns_if, cb_fn, cb_arg);
+	if (rc != 0) {
+		cb_fn(cb_arg, rc);
+	}
+}
+
+int
+bdev_kv_zns_get_stats(const char *name, struct vbdev_kv_zns_stats *stats)
+{
+	struct vbdev_kv_zns *zns;
+
+	TAILQ_FOREACH(zns, &g_kv_zns_nodes, link) {
+		if (strcmp(spdk_bdev_get_name(&zns->bdev), name) == 0) {
+			break;
+		}
+	}
+	if (zns == NULL) {
+		return -ENODEV;
+	}
+
+	/* Read without the engine thread; good enough for counters. */
+	stats->keys = __atomic_load_n(&zns->count, __ATOMIC_RELAXED);
+	stats->free_zones = __atomic_load_n(&zns->free_zones, __ATOMIC_RELAXED);
+	stats->stores = __atomic_load_n(&zns->stats.stores, __ATOMIC_RELAXED);
+	stats->retrieves = __atomic_load_n(&zns->stats.retrieves, __ATOMIC_RELAXED);
+	stats->deletes = __atomic_load_n(&zns->stats.deletes, __ATOMIC_RELAXED);
+	stats->bytes_written = __atomic_load_n(&zns->stats.bytes_written, __ATOMIC_RELAXED);
+	stats->gc_bytes = __atomic_load_n(&zns->stats.gc_bytes, __ATOMIC_RELAXED);
+	stats->gc_zones = __atomic_load_n(&zns->stats.gc_zones, __ATOMIC_RELAXED);
+	stats->checkpoints = __atomic_load_n(&zns->stats.checkpoints, __ATOMIC_RELAXED);
+	stats->host_selects = __atomic_load_n(&zns->stats.host_selects, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+static int
+kv_zns_channel_create_cb(void *io_device, void *ctx_buf)
+{
+	return 0;
+}
+
+static void
+kv_zns_channel_destroy_cb(void *io_device, void *ctx_buf)
+{
+}
+
+static int
+vbdev_kv_zns_init(void)
+{
+	/* All bdevs share a channel; their I/O goes to the engine thread anyway. */
+	spdk_io_device_register(&g_kv_zns_nodes, kv_zns_channel_create_cb, kv_zns_channel_destroy_cb,
+				0, "vbdev_kv_zns");
+	return 0;
+}
+
+static void
+vbdev_kv_zns_finish(void)
+{
+	spdk_io_device_unregister(&g_kv_zns_nodes, NULL);
+}
+
+static int
+vbdev_kv_zns_get_ctx_size(void)
+{
+	return sizeof(struct kv_zns_bdev_io);
+}
+
+SPDK_LOG_REGISTER_COMPONENT(vbdev_kv_zns)
@@ -0,0 +1,80 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+#ifndef SPDK_VBDEV_KV_ZNS_H
+#define SPDK_VBDEV_KV_ZNS_H
+
+#include "spdk/stdinc.h"
+
+#include "spdk/bdev.h"
+#include "spdk/bdev_module.h"
+
+/* Used when no value is given over RPC. */
+#define VBDEV_KV_ZNS_DEFAULT_CHECKPOINT_MS	1000
+#define VBDEV_KV_ZNS_DEFAULT_GC_FREE_ZONES	2
+
+typedef void (*spdk_kv_zns_create_cb)(void *cb_arg, struct spdk_bdev *bdev, int bdeverrno);
+
+struct vbdev_kv_zns_opts {
+	const char *name;
+	/* Zoned bdev the records are appended to. */
+	const char *base_bdev_name;
+	/* Milliseconds between checkpoints of the index, when anything changed. */
+	uint32_t checkpoint_ms;
+	/* Free data zones left when garbage collection starts. At least 1. */
+	uint32_t gc_free_zones;
+};
+
+struct vbdev_kv_zns_stats {
+	uint64_t keys;
+	uint64_t free_zones;
+	uint64_t stores;
+	uint64_t retrieves;
+	uint64_t deletes;
+	/* Bytes appended for STOREs and DELETEs, and by garbage collection. */
+	uint64_t bytes_written;
+	uint64_t gc_bytes;
+	/* Zones garbage collection reset. */
+	uint64_t gc_zones;
+	uint64_t checkpoints;
+	/* SELECTs evaluated on the host. */
+	uint64_t host_selects;
+};
+
+/**
+ * Create a KV engine bdev on top of a zoned bdev. The index is loaded from the
+ * last checkpoint on the zoned bdev and the zones written since are replayed
+ * before the bdev is registered. An empty zoned bdev is formatted.
+ *
+ * \param opts Creation options.
+ * \param cb_fn Called once the bdev is registered, or on failure.
+ * \param cb_arg Argument to pass to cb_fn.
+ *
+ * \return 0 if creation started, in which case cb_fn will be called, or
+ * negated errno otherwise.
+ */
+int bdev_kv_zns_create(const struct vbdev_kv_zns_opts *opts, spdk_kv_zns_create_cb cb_fn,
+		       void *cb_arg);
+
+/**
+ * Delete a KV engine bdev. A last checkpoint is written first, so the next
+ * create does not have to replay any zones.
+ *
+ * \param name Name of the KV engine bdev.
+ * \param cb_fn Function to call after deletion.
+ * \param cb_arg Argument to pass to cb_fn.
+ */
+void bdev_kv_zns_delete(const char *name, spdk_bdev_unregister_cb cb_fn, void *cb_arg);
+
+/**
+ * Get the counters of a KV engine bdev.
+ *
+ * \param name Name of the KV engine bdev.
+ * \param stats Filled in with the counters.
+ *
+ * \return 0 on success, -ENODEV if there is no such bdev.
+ */
+int bdev_kv_zns_get_stats(const char *name, struct vbdev_kv_zns_stats *stats);
+
+#endif /* SPDK_VBDEV_KV_ZNS_H */
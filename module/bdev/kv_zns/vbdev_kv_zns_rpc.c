@@ -0,0 +1,177 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+#include "spdk/rpc.h"
+#include "spdk/util.h"
+#include "spdk/string.h"
+#include "spdk/bdev_module.h"
+#include "spdk/log.h"
+
+#include "vbdev_kv_zns.h"
+
+struct rpc_bdev_kv_zns_create {
+	char *name;
+	char *base_bdev_name;
+	uint32_t checkpoint_ms;
+	uint32_t gc_free_zones;
+};
+
+static void
+free_rpc_bdev_kv_zns_create(struct rpc_bdev_kv_zns_create *req)
+{
+	free(req->name);
+	free(req->base_bdev_name);
+}
+
+static const struct spdk_json_object_decoder rpc_bdev_kv_zns_create_decoders[] = {
+	{"name", offsetof(struct rpc_bdev_kv_zns_create, name), spdk_json_decode_string},
+	{"base_bdev_name", offsetof(struct rpc_bdev_kv_zns_create, base_bdev_name), spdk_json_decode_string},
+	{"checkpoint_ms", offsetof(struct rpc_bdev_kv_zns_create, checkpoint_ms), spdk_json_decode_uint32, true},
+	{"gc_free_zones", offsetof(struct rpc_bdev_kv_zns_create, gc_free_zones), spdk_json_decode_uint32, true},
+};
+
+static void
+rpc_bdev_kv_zns_create_cb(void *cb_arg, struct spdk_bdev *bdev, int bdeverrno)
+{
+	struct spdk_jsonrpc_request *request = cb_arg;
+	struct spdk_json_write_ctx *w;
+
+	if (bdeverrno != 0) {
+		spdk_jsonrpc_send_error_response(request, bdeverrno, spdk_strerror(-bdeverrno));
+		return;
+	}
+
+	w = spdk_jsonrpc_begin_result(request);
+	spdk_json_write_string(w, spdk_bdev_get_name(bdev));
+	spdk_jsonrpc_end_result(request, w);
+}
+
+static void
+rpc_bdev_kv_zns_create(struct spdk_jsonrpc_request *request,
+		       const struct spdk_json_val *params)
+{
+	struct rpc_bdev_kv_zns_create req = {
+		.checkpoint_ms = VBDEV_KV_ZNS_DEFAULT_CHECKPOINT_MS,
+		.gc_free_zones = VBDEV_KV_ZNS_DEFAULT_GC_FREE_ZONES,
+	};
+	struct vbdev_kv_zns_opts opts = {};
+	int rc;
+
+	if (spdk_json_decode_object(params, rpc_bdev_kv_zns_create_decoders,
+				    SPDK_COUNTOF(rpc_bdev_kv_zns_create_decoders),
+				    &req)) {
+		SPDK_DEBUGLOG(vbdev_kv_zns, "spdk_json_decode_object failed\n");
+		spdk_jsonrpc_send_error_response(request, SPDK_JSONRPC_ERROR_INTERNAL_ERROR,
+						 "spdk_json_decode_object failed");
+		goto cleanup;
+	}
+
+	opts.name = req.name;
+	opts.base_bdev_name = req.base_bdev_name;
+	opts.checkpoint_ms = req.checkpoint_ms;
+	opts.gc_free_zones = req.gc_free_zones;
+	rc = bdev_kv_zns_create(&opts, rpc_bdev_kv_zns_create_cb, request);
+	if (rc != 0) {
+		spdk_jsonrpc_send_error_response(request, rc, spdk_strerror(-rc));
+	}
+
+cleanup:
+	free_rpc_bdev_kv_zns_create(&req);
+}
+SPDK_RPC_REGISTER("bdev_kv_zns_create", rpc_bdev_kv_zns_create, SPDK_RPC_RUNTIME)
+
+struct rpc_bdev_kv_zns_name {
+	char *name;
+};
+
+static void
+free_rpc_bdev_kv_zns_name(struct rpc_bdev_kv_zns_name *req)
+{
+	free(req->name);
+}
+
+static const struct spdk_json_object_decoder rpc_bdev_kv_zns_name_decoders[] = {
+	{"name", offsetof(struct rpc_bdev_kv_zns_name, name), spdk_json_decode_string},
+};
+
+static void
+rpc_bdev_kv_zns_delete_cb(void *cb_arg, int bdeverrno)
+{
+	struct spdk_jsonrpc_request *request = cb_arg;
+
+	if (bdeverrno == 0) {
+		spdk_jsonrpc_send_bool_response(request, true);
+	} else {
+		spdk_jsonrpc_send_error_response(request, bdeverrno, spdk_strerror(-bdeverrno));
+	}
+}
+
+static void
+rpc_bdev_kv_zns_delete(struct spdk_jsonrpc_request *request,
+		       const struct spdk_json_val *params)
+{
+	struct rpc_bdev_kv_zns_name req = {NULL};
+
+	if (spdk_json_decode_object(params, rpc_bdev_kv_zns_name_decoders,
+				    SPDK_COUNTOF(rpc_bdev_kv_zns_name_decoders),
+				    &req)) {
+		spdk_jsonrpc_send_error_response(request, SPDK_JSONRPC_ERROR_INTERNAL_ERROR,
+						 "spdk_json_decode_object failed");
+		goto cleanup;
+	}
+
+	bdev_kv_zns_delete(req.name, rpc_bdev_kv_zns_delete_cb, request);
+
+cleanup:
+	free_rpc_bdev_kv_zns_name(&req);
+}
+SPDK_RPC_REGISTER("bdev_kv_zns_delete", rpc_bdev_kv_zns_delete, SPDK_RPC_RUNTIME)
+
+static void
+rpc_bdev_kv_zns_get_stats(struct spdk_jsonrpc_request *request,
+			  const struct spdk_json_val *params)
+{
+	struct rpc_bdev_kv_zns_name req = {NULL};
+	struct vbdev_kv_zns_stats stats;
+	struct spdk_json_write_ctx *w;
+	uint64_t user_bytes;
+	int rc;
+
+	if (spdk_json_decode_object(params, rpc_bdev_kv_zns_name_decoders,
+				    SPDK_COUNTOF(rpc_bdev_kv_zns_name_decoders),
+				    &req)) {
+		spdk_jsonrpc_send_error_response(request, SPDK_JSONRPC_ERROR_INTERNAL_ERROR,
+						 "spdk_json_decode_object failed");
+		goto cleanup;
+	}
+
+	rc = bdev_kv_zns_get_stats(req.name, &stats);
+	if (rc != 0) {
+		spdk_jsonrpc_send_error_response(request, rc, spdk_strerror(-rc));
+		goto cleanup;
+	}
+
+	user_bytes = stats.bytes_written - stats.gc_bytes;
+	w = spdk_jsonrpc_begin_result(request);
+	spdk_json_write_object_begin(w);
+	spdk_json_write_named_string(w, "name", req.name);
+	spdk_json_write_named_uint64(w, "keys", stats.keys);
+	spdk_json_write_named_uint64(w, "free_zones", stats.free_zones);
+	spdk_json_write_named_uint64(w, "stores", stats.stores);
+	spdk_json_write_named_uint64(w, "retrieves", stats.retrieves);
+	spdk_json_write_named_uint64(w, "deletes", stats.deletes);
+	spdk_json_write_named_uint64(w, "bytes_written", stats.bytes_written);
+	spdk_json_write_named_uint64(w, "gc_bytes", stats.gc_bytes);
+	spdk_json_write_named_double(w, "write_amplification",
+				     user_bytes ? (double)stats.bytes_written / user_bytes : 0.0);
+	spdk_json_write_named_uint64(w, "gc_zones", stats.gc_zones);
+	spdk_json_write_named_uint64(w, "checkpoints", stats.checkpoints);
+	spdk_json_write_named_uint64(w, "host_selects", stats.host_selects);
+	spdk_json_write_object_end(w);
+	spdk_jsonrpc_end_result(request, w);
+
+cleanup:
+	free_rpc_bdev_kv_zns_name(&req);
+}
+SPDK_RPC_REGISTER("bdev_kv_zns_get_stats", rpc_bdev_kv_zns_get_stats, SPDK_RPC_RUNTIME)
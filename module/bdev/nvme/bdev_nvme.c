@@ -98,6 +98,15 @@ struct nvme_bdev_io {
 
 	/* Current tsc at submit time. */
 	uint64_t submit_tsc;
+
+	/* Number of keys of a KV batch request still outstanding. */
+	uint32_t kv_batch_outstanding;
+
+	/* Next key of a KV batch request to submit. */
+	uint32_t kv_batch_next;
+
+	/* Submission of the rest of a KV batch request is scheduled. */
+	bool kv_batch_resume_pending;
 };
 
 struct nvme_probe_skip_entry {
@@ -196,6 +205,7 @@ static struct nvme_ns *nvme_ns_alloc(void);
 static void nvme_ns_free(struct nvme_ns *ns);
 
 static void bdev_nvme_kv_done(void *ref, const struct spdk_nvme_cpl *cpl);
+static int bdev_nvme_kv_batch(struct nvme_bdev_io *bio);
 
 static int
 nvme_ns_cmp(struct nvme_ns *ns1, struct nvme_ns *ns2)
@@ -2320,6 +2330,20 @@ bdev_nvme_queued_reset_sgl(void *ref, uint32_t sgl_offset);
 static int
 bdev_nvme_queued_next_sge(void *ref, void **address, uint32_t *length);
 
+/* Map the bdev extended options of a KV request to NVMe format. KV commands carry no metadata. */
+static inline struct spdk_nvme_ns_cmd_ext_io_opts *
+bdev_nvme_kv_ext_opts(struct nvme_bdev_io *bio, struct spdk_bdev_ext_io_opts *ext_opts,
+		      uint32_t flags)
+{
+	bio->ext_opts.size = sizeof(struct spdk_nvme_ns_cmd_ext_io_opts);
+	bio->ext_opts.memory_domain = ext_opts->memory_domain;
+	bio->ext_opts.memory_domain_ctx = ext_opts->memory_domain_ctx;
+	bio->ext_opts.io_flags = flags;
+	bio->ext_opts.metadata = NULL;
+
+	return &bio->ext_opts;
+}
+
 static inline void
 _bdev_nvme_submit_request(struct nvme_bdev_channel *nbdev_ch, struct spdk_bdev_io *bdev_io)
 {
@@ -2452,7 +2476,15 @@ _bdev_nvme_submit_request(struct nvme_bdev_channel *nbdev_ch, struct spdk_bdev_i
 		nbdev_io->iovcnt = bdev_io->u.bdev.iovcnt;
 		nbdev_io->iovpos = 0;
 		nbdev_io->iov_offset = 0;
-		if (bdev_io->u.bdev.iovcnt == 1) {
+		if (bdev_io->u.bdev.ext_opts) {
+			rc = spdk_nvme_ns_cmd_kvlistv_ext(nbdev_io->io_path->nvme_ns->ns,
+				nbdev_io->io_path->qpair->qpair, bdev_io->u.bdev.nvme_kv.key,
+				bdev_io->u.bdev.nvme_kv.key_length,
+				bdev_io->u.bdev.nvme_kv.buffer_size, bdev_nvme_kv_done,
+				nbdev_io, bdev_nvme_queued_reset_sgl, bdev_nvme_queued_next_sge,
+				bdev_nvme_kv_ext_opts(nbdev_io, bdev_io->u.bdev.ext_opts,
+						      bdev->dif_check_flags));
+		} else if (bdev_io->u.bdev.iovcnt == 1) {
 			rc = spdk_nvme_ns_cmd_kvlist(nbdev_io->io_path->nvme_ns->ns,
 				nbdev_io->io_path->qpair->qpair, bdev_io->u.bdev.nvme_kv.key,
 				bdev_io->u.bdev.nvme_kv.key_length, bdev_io->u.bdev.iovs[0].iov_base,
@@ -2492,7 +2524,15 @@ _bdev_nvme_submit_request(struct nvme_bdev_channel *nbdev_ch, struct spdk_bdev_i
 		nbdev_io->iovcnt = bdev_io->u.bdev.iovcnt;
 		nbdev_io->iovpos = 0;
 		nbdev_io->iov_offset = 0;
-		if (bdev_io->u.bdev.iovcnt == 1) {
+		if (bdev_io->u.bdev.ext_opts) {
+			rc = spdk_nvme_ns_cmd_kvstorev_ext(nbdev_io->io_path->nvme_ns->ns,
+				nbdev_io->io_path->qpair->qpair, bdev_io->u.bdev.nvme_kv.key,
+				bdev_io->u.bdev.nvme_kv.key_length, bdev_io->u.bdev.nvme_kv.buffer_size, bdev_nvme_kv_done,
+				nbdev_io, bdev_io->u.bdev.nvme_kv.options,
+				bdev_nvme_queued_reset_sgl, bdev_nvme_queued_next_sge,
+				bdev_nvme_kv_ext_opts(nbdev_io, bdev_io->u.bdev.ext_opts,
+						      bdev->dif_check_flags));
+		} else if (bdev_io->u.bdev.iovcnt == 1) {
 			rc = spdk_nvme_ns_cmd_kvstore(nbdev_io->io_path->nvme_ns->ns,
 							nbdev_io->io_path->qpair->qpair, bdev_io->u.bdev.nvme_kv.key,
 							bdev_io->u.bdev.nvme_kv.key_length, bdev_io->u.bdev.iovs[0].iov_base,
@@ -2511,7 +2551,16 @@ _bdev_nvme_submit_request(struct nvme_bdev_channel *nbdev_ch, struct spdk_bdev_i
 		nbdev_io->iovcnt = bdev_io->u.bdev.iovcnt;
 		nbdev_io->iovpos = 0;
 		nbdev_io->iov_offset = 0;
-		if (bdev_io->u.bdev.iovcnt == 1) {
+		if (bdev_io->u.bdev.ext_opts) {
+			rc = spdk_nvme_ns_cmd_kvretrievev_ext(nbdev_io->io_path->nvme_ns->ns,
+				nbdev_io->io_path->qpair->qpair, bdev_io->u.bdev.nvme_kv.key,
+				bdev_io->u.bdev.nvme_kv.key_length,
+				bdev_io->u.bdev.nvme_kv.buffer_size, bdev_nvme_kv_done,
+				nbdev_io, bdev_io->u.bdev.nvme_kv.offset,
+				bdev_nvme_queued_reset_sgl, bdev_nvme_queued_next_sge,
+				bdev_nvme_kv_ext_opts(nbdev_io, bdev_io->u.bdev.ext_opts,
+						      bdev->dif_check_flags));
+		} else if (bdev_io->u.bdev.iovcnt == 1) {
 			rc = spdk_nvme_ns_cmd_kvretrieve(nbdev_io->io_path->nvme_ns->ns,
 							nbdev_io->io_path->qpair->qpair, bdev_io->u.bdev.nvme_kv.key,
 							bdev_io->u.bdev.nvme_kv.key_length, bdev_io->u.bdev.iovs[0].iov_base,
@@ -2531,7 +2580,16 @@ _bdev_nvme_submit_request(struct nvme_bdev_channel *nbdev_ch, struct spdk_bdev_i
 		nbdev_io->iovcnt = bdev_io->u.bdev.iovcnt;
 		nbdev_io->iovpos = 0;
 		nbdev_io->iov_offset = 0;
-		if (bdev_io->u.bdev.iovcnt == 1) {
+		if (bdev_io->u.bdev.ext_opts) {
+			rc = spdk_nvme_ns_cmd_kvselect_sendv_ext(nbdev_io->io_path->nvme_ns->ns,
+							nbdev_io->io_path->qpair->qpair, bdev_io->u.bdev.nvme_kv.key,
+							bdev_io->u.bdev.nvme_kv.key_length, bdev_io->u.bdev.nvme_kv.buffer_size,
+							bdev_io->u.bdev.nvme_kv.select_input_type, bdev_io->u.bdev.nvme_kv.select_output_type,
+							bdev_io->u.bdev.nvme_kv.options, bdev_nvme_kv_done, nbdev_io,
+							bdev_nvme_queued_reset_sgl, bdev_nvme_queued_next_sge,
+							bdev_nvme_kv_ext_opts(nbdev_io, bdev_io->u.bdev.ext_opts,
+									bdev->dif_check_flags));
+		} else if (bdev_io->u.bdev.iovcnt == 1) {
 			rc = spdk_nvme_ns_cmd_kvselect_send(nbdev_io->io_path->nvme_ns->ns,
 							nbdev_io->io_path->qpair->qpair, bdev_io->u.bdev.nvme_kv.key,
 							bdev_io->u.bdev.nvme_kv.key_length, bdev_io->u.bdev.iovs[0].iov_base,
@@ -2551,7 +2609,16 @@ _bdev_nvme_submit_request(struct nvme_bdev_channel *nbdev_ch, struct spdk_bdev_i
 		nbdev_io->iovcnt = bdev_io->u.bdev.iovcnt;
 		nbdev_io->iovpos = 0;
 		nbdev_io->iov_offset = 0;
-		if (bdev_io->u.bdev.iovcnt == 1) {
+		if (bdev_io->u.bdev.ext_opts) {
+			rc = spdk_nvme_ns_cmd_kvselect_retrievev_ext(nbdev_io->io_path->nvme_ns->ns,
+							nbdev_io->io_path->qpair->qpair,
+							bdev_io->u.bdev.nvme_kv.select_id, bdev_io->u.bdev.nvme_kv.offset,
+							bdev_io->u.bdev.nvme_kv.buffer_size,
+							bdev_io->u.bdev.nvme_kv.options, bdev_nvme_kv_done, nbdev_io,
+							bdev_nvme_queued_reset_sgl, bdev_nvme_queued_next_sge,
+							bdev_nvme_kv_ext_opts(nbdev_io, bdev_io->u.bdev.ext_opts,
+									bdev->dif_check_flags));
+		} else if (bdev_io->u.bdev.iovcnt == 1) {
 			rc = spdk_nvme_ns_cmd_kvselect_retrieve(nbdev_io->io_path->nvme_ns->ns,
 							nbdev_io->io_path->qpair->qpair,
 							bdev_io->u.bdev.nvme_kv.select_id, bdev_io->u.bdev.nvme_kv.offset,
@@ -2568,6 +2635,9 @@ _bdev_nvme_submit_request(struct nvme_bdev_channel *nbdev_ch, struct spdk_bdev_i
 							bdev_nvme_queued_next_sge);
 		}
 		break;
+	case SPDK_BDEV_IO_KV_BATCH:
+		rc = bdev_nvme_kv_batch(nbdev_io);
+		break;
 	default:
 		rc = -EINVAL;
 		break;
@@ -2666,6 +2736,21 @@ bdev_nvme_io_type_supported(void *ctx, enum spdk_bdev_io_type io_type)
 		cdata = spdk_nvme_ctrlr_get_data(ctrlr);
 		return cdata->oncs.copy;
 
+	case SPDK_BDEV_IO_KV_LIST:
+	case SPDK_BDEV_IO_KV_DELETE:
+	case SPDK_BDEV_IO_KV_EXIST:
+	case SPDK_BDEV_IO_KV_STORE:
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+	case SPDK_BDEV_IO_KV_SEND_SELECT:
+	case SPDK_BDEV_IO_KV_RETRIEVE_SELECT:
+	case SPDK_BDEV_IO_KV_BATCH:
+		/*
+		 * Computational storage drives expose the vendor KV opcodes on an
+		 * NVM command set namespace, so this cannot be keyed on the CSI.
+		 * A namespace without them fails the commands.
+		 */
+		return true;
+
 	default:
 		return false;
 	}
@@ -3509,6 +3594,9 @@ nvme_disk_create(struct spdk_bdev *disk, const char *base_name,
 		disk->max_open_zones = spdk_nvme_zns_ns_get_max_open_zones(ns);
 		disk->max_active_zones = spdk_nvme_zns_ns_get_max_active_zones(ns);
 		break;
+	case SPDK_NVME_CSI_KV:
+		disk->product_name = "NVMe KV disk";
+		break;
 	default:
 		SPDK_ERRLOG("unsupported CSI: %u\n", csi);
 		return -ENOTSUP;
@@ -6425,6 +6513,266 @@ bdev_nvme_kv_done(void *ref, const struct spdk_nvme_cpl *cpl)
 	bdev_nvme_io_complete_nvme_status(bio, cpl);
 }
 
+static void
+bdev_nvme_kv_batch_reset_sgl(void *ref, uint32_t sgl_offset)
+{
+	struct spdk_bdev_kv_batch_entry *entry = ref;
+	struct iovec *iov;
+
+	entry->internal.iov_offset = sgl_offset;
+	for (entry->internal.iovpos = 0; entry->internal.iovpos < entry->iovcnt;
+	     entry->internal.iovpos++) {
+		iov = &entry->iovs[entry->internal.iovpos];
+		if (entry->internal.iov_offset < iov->iov_len) {
+			break;
+		}
+
+		entry->internal.iov_offset -= iov->iov_len;
+	}
+}
+
+static int
+bdev_nvme_kv_batch_next_sge(void *ref, void **address, uint32_t *length)
+{
+	struct spdk_bdev_kv_batch_entry *entry = ref;
+	struct iovec *iov;
+
+	assert(entry->internal.iovpos < entry->iovcnt);
+
+	iov = &entry->iovs[entry->internal.iovpos];
+
+	*address = iov->iov_base;
+	*length = iov->iov_len;
+
+	if (entry->internal.iov_offset) {
+		assert(entry->internal.iov_offset <= iov->iov_len);
+		*address += entry->internal.iov_offset;
+		*length -= entry->internal.iov_offset;
+	}
+
+	entry->internal.iov_offset += *length;
+	if (entry->internal.iov_offset == iov->iov_len) {
+		entry->internal.iovpos++;
+		entry->internal.iov_offset = 0;
+	}
+
+	return 0;
+}
+
+static inline bool
+bdev_nvme_kv_batch_status_is_error(int sct, int sc)
+{
+	/* A missing key is an answer for MGET/MEXIST, not a failure of the batch. */
+	if (sct == SPDK_NVME_SCT_GENERIC &&
+	    (sc == SPDK_NVME_SC_SUCCESS || sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST)) {
+		return false;
+	}
+
+	return true;
+}
+
+static void
+bdev_nvme_kv_batch_put(struct nvme_bdev_io *bio)
+{
+	assert(bio->kv_batch_outstanding > 0);
+
+	if (--bio->kv_batch_outstanding == 0) {
+		bdev_nvme_io_complete_nvme_status(bio, &bio->cpl);
+	}
+}
+
+/* Fail the keys of a batch that could not be submitted. */
+static void
+bdev_nvme_kv_batch_fail_rest(struct nvme_bdev_io *bio)
+{
+	struct spdk_bdev_io *bdev_io = spdk_bdev_io_from_ctx(bio);
+	struct spdk_bdev_kv_batch_entry *entries = bdev_io->u.bdev.nvme_kv.batch;
+
+	for (; bio->kv_batch_next < bdev_io->u.bdev.nvme_kv.batch_count; bio->kv_batch_next++) {
+		entries[bio->kv_batch_next].cdw0 = 0;
+		entries[bio->kv_batch_next].sct = SPDK_NVME_SCT_GENERIC;
+		entries[bio->kv_batch_next].sc = SPDK_NVME_SC_INTERNAL_DEVICE_ERROR;
+	}
+
+	if (!spdk_nvme_cpl_is_error(&bio->cpl)) {
+		bio->cpl.status.sct = SPDK_NVME_SCT_GENERIC;
+		bio->cpl.status.sc = SPDK_NVME_SC_INTERNAL_DEVICE_ERROR;
+	}
+}
+
+static void bdev_nvme_kv_batch_resume(void *ctx);
+
+/*
+ * Schedule submission of the keys that did not get a request. The request of
+ * a completing key is only freed after its callback returns, so retry from a
+ * message rather than right away.
+ */
+static void
+bdev_nvme_kv_batch_schedule_resume(struct nvme_bdev_io *bio)
+{
+	if (bio->kv_batch_resume_pending) {
+		return;
+	}
+
+	bio->kv_batch_outstanding++;
+	bio->kv_batch_resume_pending = true;
+	if (spdk_unlikely(spdk_thread_send_msg(spdk_get_thread(), bdev_nvme_kv_batch_resume,
+					       bio) != 0)) {
+		bio->kv_batch_outstanding--;
+		bio->kv_batch_resume_pending = false;
+		bdev_nvme_kv_batch_fail_rest(bio);
+	}
+}
+
+static void
+bdev_nvme_kv_batch_done(void *ref, const struct spdk_nvme_cpl *cpl)
+{
+	struct spdk_bdev_kv_batch_entry *entry = ref;
+	struct nvme_bdev_io *bio = entry->internal.ctx;
+	struct spdk_bdev_io *bdev_io = spdk_bdev_io_from_ctx(bio);
+
+	entry->cdw0 = cpl->cdw0;
+	entry->sct = cpl->status.sct;
+	entry->sc = cpl->status.sc;
+
+	if (bdev_nvme_kv_batch_status_is_error(entry->sct, entry->sc) &&
+	    !spdk_nvme_cpl_is_error(&bio->cpl)) {
+		bio->cpl = *cpl;
+	}
+
+	if (bio->kv_batch_next < bdev_io->u.bdev.nvme_kv.batch_count) {
+		bdev_nvme_kv_batch_schedule_resume(bio);
+	}
+
+	bdev_nvme_kv_batch_put(bio);
+}
+
+static int
+bdev_nvme_kv_batch_submit_entry(struct nvme_bdev_io *bio, struct spdk_bdev_kv_batch_entry *entry,
+				uint8_t batch_type)
+{
+	struct spdk_nvme_ns *ns = bio->io_path->nvme_ns->ns;
+	struct spdk_nvme_qpair *qpair = bio->io_path->qpair->qpair;
+
+	entry->internal.ctx = bio;
+	entry->internal.iovpos = 0;
+	entry->internal.iov_offset = 0;
+
+	switch (batch_type) {
+	case SPDK_BDEV_IO_KV_EXIST:
+		return spdk_nvme_ns_cmd_kvexist(ns, qpair, entry->key, entry->key_length,
+						bdev_nvme_kv_batch_done, entry, 0);
+	case SPDK_BDEV_IO_KV_STORE:
+		if (entry->iovcnt == 1) {
+			return spdk_nvme_ns_cmd_kvstore(ns, qpair, entry->key, entry->key_length,
+							entry->iovs[0].iov_base, entry->nbytes,
+							bdev_nvme_kv_batch_done, entry, entry->options, 0);
+		}
+		return spdk_nvme_ns_cmd_kvstorev(ns, qpair, entry->key, entry->key_length,
+						 entry->nbytes, bdev_nvme_kv_batch_done, entry,
+						 entry->options, 0, bdev_nvme_kv_batch_reset_sgl,
+						 bdev_nvme_kv_batch_next_sge);
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+		if (entry->iovcnt == 1) {
+			return spdk_nvme_ns_cmd_kvretrieve(ns, qpair, entry->key, entry->key_length,
+							   entry->iovs[0].iov_base, entry->nbytes,
+							   bdev_nvme_kv_batch_done, entry, entry->offset, 0);
+		}
+		return spdk_nvme_ns_cmd_kvretrievev(ns, qpair, entry->key, entry->key_length,
+						    entry->nbytes, bdev_nvme_kv_batch_done, entry,
+						    entry->offset, 0, bdev_nvme_kv_batch_reset_sgl,
+						    bdev_nvme_kv_batch_next_sge);
+	default:
+		return -EINVAL;
+	}
+}
+
+/*
+ * Fan the keys of the batch from bio->kv_batch_next on out onto the qpair, as
+ * far as it has free requests. With delayed command submission the PCIe
+ * transport then rings the doorbell once for all of them on the next
+ * completion poll.
+ */
+static int
+bdev_nvme_kv_batch_submit(struct nvme_bdev_io *bio)
+{
+	struct spdk_bdev_io *bdev_io = spdk_bdev_io_from_ctx(bio);
+	struct spdk_bdev_kv_batch_entry *entries = bdev_io->u.bdev.nvme_kv.batch;
+	int rc;
+
+	while (bio->kv_batch_next < bdev_io->u.bdev.nvme_kv.batch_count) {
+		bio->kv_batch_outstanding++;
+		rc = bdev_nvme_kv_batch_submit_entry(bio, &entries[bio->kv_batch_next],
+						     bdev_io->u.bdev.nvme_kv.batch_type);
+		if (spdk_unlikely(rc != 0)) {
+			bio->kv_batch_outstanding--;
+			return rc;
+		}
+		bio->kv_batch_next++;
+	}
+
+	return 0;
+}
+
+/*
+ * Submission ran out of requests. Keys still outstanding schedule the rest as
+ * they complete; if there are none, try again later. Any other error fails
+ * the rest of the batch.
+ */
+static void
+bdev_nvme_kv_batch_submit_failed(struct nvme_bdev_io *bio, int rc)
+{
+	/* Only the reference of the caller is left. */
+	if (rc == -ENOMEM && bio->kv_batch_outstanding == 1) {
+		bdev_nvme_kv_batch_schedule_resume(bio);
+	} else if (rc != -ENOMEM) {
+		bdev_nvme_kv_batch_fail_rest(bio);
+	}
+}
+
+static void
+bdev_nvme_kv_batch_resume(void *ctx)
+{
+	struct nvme_bdev_io *bio = ctx;
+	int rc;
+
+	bio->kv_batch_resume_pending = false;
+
+	rc = bdev_nvme_kv_batch_submit(bio);
+	if (spdk_unlikely(rc != 0)) {
+		bdev_nvme_kv_batch_submit_failed(bio, rc);
+	}
+
+	bdev_nvme_kv_batch_put(bio);
+}
+
+static int
+bdev_nvme_kv_batch(struct nvme_bdev_io *bio)
+{
+	int rc;
+
+	memset(&bio->cpl, 0, sizeof(bio->cpl));
+	bio->kv_batch_next = 0;
+	bio->kv_batch_resume_pending = false;
+
+	/* Hold a reference so that the batch cannot complete while still submitting. */
+	bio->kv_batch_outstanding = 1;
+
+	rc = bdev_nvme_kv_batch_submit(bio);
+	if (spdk_unlikely(rc != 0)) {
+		if (bio->kv_batch_next == 0) {
+			/* Nothing was submitted, let the caller retry or fail the whole batch. */
+			bio->kv_batch_outstanding = 0;
+			return rc;
+		}
+
+		bdev_nvme_kv_batch_submit_failed(bio, rc);
+	}
+
+	bdev_nvme_kv_batch_put(bio);
+	return 0;
+}
+
 static int
 fill_zone_from_report(struct spdk_bdev_zone_info *info, struct spdk_nvme_zns_zone_desc *desc)
 {
@@ -418,6 +418,304 @@ def bdev_raid_delete(client, name):
     return client.call('bdev_raid_delete', params)
 
 
+def bdev_kv_append_create(client, base_bdev_name, name, max_bytes=None, flush_us=None):
+    """Construct a KV bdev merging small appends to the same key into one command on a KV capable bdev.
+
+    Args:
+        base_bdev_name: name of the KV bdev to store the values on
+        name: name of the append coalescing bdev
+        max_bytes: bytes of appends to one key merged into one command (optional)
+        flush_us: longest time in microseconds an append waits to be merged, 0 to only merge
+            appends arriving while the previous one is in flight (optional)
+
+    Returns:
+        Name of created block device.
+    """
+    params = {'base_bdev_name': base_bdev_name, 'name': name}
+    if max_bytes is not None:
+        params['max_bytes'] = max_bytes
+    if flush_us is not None:
+        params['flush_us'] = flush_us
+    return client.call('bdev_kv_append_create', params)
+
+
+def bdev_kv_append_delete(client, name):
+    """Remove a KV append coalescing bdev from the system.
+
+    Args:
+        name: name of the KV append coalescing bdev to delete
+    """
+    params = {'name': name}
+    return client.call('bdev_kv_append_delete', params)
+
+
+def bdev_kv_append_get_stats(client, name):
+    """Get the coalescing counters of a KV append coalescing bdev.
+
+    Args:
+        name: name of the KV append coalescing bdev
+    """
+    params = {'name': name}
+    return client.call('bdev_kv_append_get_stats', params)
+
+
+def bdev_kv_cache_create(client, base_bdev_name, name, capacity_mb, max_value_size=None, write_policy=None,
+                         filter_keys=None, select_capacity_mb=None, max_select_result_size=None):
+    """Construct a KV read cache on top of a KV capable bdev.
+
+    Args:
+        base_bdev_name: name of the KV bdev to cache
+        name: name of the cache bdev
+        capacity_mb: memory for cached keys and values, in MiB
+        max_value_size: values larger than this many bytes are not cached (optional)
+        write_policy: write_through or write_around (optional)
+        filter_keys: expected number of keys, enables the negative lookup filter (optional)
+        select_capacity_mb: memory for cached SELECT results, in MiB; enables the SELECT cache (optional)
+        max_select_result_size: SELECT results larger than this many bytes are not cached (optional)
+
+    Returns:
+        Name of created block device.
+    """
+    params = {'base_bdev_name': base_bdev_name, 'name': name, 'capacity_mb': capacity_mb}
+    if max_value_size is not None:
+        params['max_value_size'] = max_value_size
+    if write_policy:
+        params['write_policy'] = write_policy
+    if filter_keys:
+        params['filter_keys'] = filter_keys
+    if select_capacity_mb:
+        params['select_capacity_mb'] = select_capacity_mb
+    if max_select_result_size is not None:
+        params['max_select_result_size'] = max_select_result_size
+    return client.call('bdev_kv_cache_create', params)
+
+
+def bdev_kv_cache_delete(client, name):
+    """Remove a KV cache bdev from the system.
+
+    Args:
+        name: name of the KV cache bdev to delete
+    """
+    params = {'name': name}
+    return client.call('bdev_kv_cache_delete', params)
+
+
+def bdev_kv_cache_get_stats(client, name):
+    """Get the hit, miss and eviction counters of a KV cache bdev.
+
+    Args:
+        name: name of the KV cache bdev
+    """
+    params = {'name': name}
+    return client.call('bdev_kv_cache_get_stats', params)
+
+
+def bdev_kv_compress_create(client, base_bdev_name, name, min_size=None):
+    """Construct a KV bdev compressing values on the host before storing them on a KV capable bdev.
+
+    Args:
+        base_bdev_name: name of the KV bdev to store the values on
+        name: name of the compression bdev
+        min_size: values shorter than this many bytes are stored uncompressed (optional)
+
+    Returns:
+        Name of created block device.
+    """
+    params = {'base_bdev_name': base_bdev_name, 'name': name}
+    if min_size is not None:
+        params['min_size'] = min_size
+    return client.call('bdev_kv_compress_create', params)
+
+
+def bdev_kv_compress_delete(client, name):
+    """Remove a KV compression bdev from the system.
+
+    Args:
+        name: name of the KV compression bdev to delete
+    """
+    params = {'name': name}
+    return client.call('bdev_kv_compress_delete', params)
+
+
+def bdev_kv_compress_get_stats(client, name):
+    """Get the compression counters of a KV compression bdev.
+
+    Args:
+        name: name of the KV compression bdev
+    """
+    params = {'name': name}
+    return client.call('bdev_kv_compress_get_stats', params)
+
+
+def bdev_kv_crc_create(client, base_bdev_name, name):
+    """Construct a KV bdev protecting the values stored on a KV capable bdev with a CRC-32C.
+
+    Args:
+        base_bdev_name: name of the KV bdev to store the values on
+        name: name of the integrity bdev
+
+    Returns:
+        Name of created block device.
+    """
+    params = {'base_bdev_name': base_bdev_name, 'name': name}
+    return client.call('bdev_kv_crc_create', params)
+
+
+def bdev_kv_crc_delete(client, name):
+    """Remove a KV integrity bdev from the system.
+
+    Args:
+        name: name of the KV integrity bdev to delete
+    """
+    params = {'name': name}
+    return client.call('bdev_kv_crc_delete', params)
+
+
+def bdev_kv_crc_get_stats(client, name):
+    """Get the integrity counters of a KV integrity bdev.
+
+    Args:
+        name: name of the KV integrity bdev
+    """
+    params = {'name': name}
+    return client.call('bdev_kv_crc_get_stats', params)
+
+
+def bdev_kv_mirror_create(client, name, base_bdevs, dirty_log_keys=None):
+    """Create a KV bdev keeping the same keys on several KV bdevs.
+
+    Args:
+        name: name of the mirror bdev
+        base_bdevs: list of KV bdev names to mirror over
+        dirty_log_keys: number of keys remembered for resync while a replica is out of service (optional)
+
+    Returns:
+        Name of created bdev.
+    """
+    params = {'name': name, 'base_bdevs': base_bdevs}
+    if dirty_log_keys:
+        params['dirty_log_keys'] = dirty_log_keys
+    return client.call('bdev_kv_mirror_create', params)
+
+
+def bdev_kv_mirror_delete(client, name):
+    """Remove a KV mirror bdev from the system.
+
+    Args:
+        name: name of the KV mirror bdev to delete
+    """
+    params = {'name': name}
+    return client.call('bdev_kv_mirror_delete', params)
+
+
+def bdev_kv_mirror_resync(client, name):
+    """Resync the replicas of a KV mirror bdev taken out of service after errors.
+
+    Args:
+        name: name of the KV mirror bdev
+    """
+    params = {'name': name}
+    return client.call('bdev_kv_mirror_resync', params)
+
+
+def bdev_kv_shard_create(client, name, base_bdevs, hash=None):
+    """Create a KV bdev spreading its keys over several KV bdevs.
+
+    Args:
+        name: name of the shard bdev
+        base_bdevs: list of KV bdev names to spread the keys over
+        hash: jump (default) or ring
+
+    Returns:
+        Name of created bdev.
+    """
+    params = {'name': name, 'base_bdevs': base_bdevs}
+    if hash:
+        params['hash'] = hash
+    return client.call('bdev_kv_shard_create', params)
+
+
+def bdev_kv_shard_delete(client, name):
+    """Remove a KV shard bdev from the system.
+
+    Args:
+        name: name of the KV shard bdev to delete
+    """
+    params = {'name': name}
+    return client.call('bdev_kv_shard_delete', params)
+
+
+def bdev_kv_zns_create(client, base_bdev_name, name, checkpoint_ms=None, gc_free_zones=None):
+    """Construct a log-structured KV engine bdev on top of a zoned bdev.
+
+    Args:
+        base_bdev_name: name of the zoned bdev to append the records to
+        name: name of the KV engine bdev
+        checkpoint_ms: milliseconds between checkpoints of the index, 0 to only checkpoint
+            when needed (optional)
+        gc_free_zones: free zones left when garbage collection starts (optional)
+
+    Returns:
+        Name of created block device.
+    """
+    params = {'base_bdev_name': base_bdev_name, 'name': name}
+    if checkpoint_ms is not None:
+        params['checkpoint_ms'] = checkpoint_ms
+    if gc_free_zones is not None:
+        params['gc_free_zones'] = gc_free_zones
+    return client.call('bdev_kv_zns_create', params)
+
+
+def bdev_kv_zns_delete(client, name):
+    """Remove a KV engine bdev from the system.
+
+    Args:
+        name: name of the KV engine bdev to delete
+    """
+    params = {'name': name}
+    return client.call('bdev_kv_zns_delete', params)
+
+
+def bdev_kv_zns_get_stats(client, name):
+    """Get the counters of a KV engine bdev.
+
+    Args:
+        name: name of the KV engine bdev
+    """
+    params = {'name': name}
+    return client.call('bdev_kv_zns_get_stats', params)
+
+
+def bdev_kv_emu_create(client, name, capacity_mb, uuid=None, backing_bdev=None):
+    """Construct a KV emulation block device.
+
+    Args:
+        name: name of block device
+        capacity_mb: memory available for keys and values, in MiB
+        uuid: UUID of block device (optional)
+        backing_bdev: bdev the contents are loaded from and saved to on delete (optional)
+
+    Returns:
+        Name of created block device.
+    """
+    params = {'name': name, 'capacity_mb': capacity_mb}
+    if uuid:
+        params['uuid'] = uuid
+    if backing_bdev:
+        params['backing_bdev'] = backing_bdev
+    return client.call('bdev_kv_emu_create', params)
+
+
+def bdev_kv_emu_delete(client, name):
+    """Remove KV emulation bdev from the system.
+
+    Args:
+        name: name of KV emulation bdev to delete
+    """
+    params = {'name': name}
+    return client.call('bdev_kv_emu_delete', params)
+
+
 def bdev_aio_create(client, filename, name, block_size=None, readonly=False):
     """Construct a Linux AIO block device.
 
@@ -1610,7 +1908,9 @@ def bdev_error_inject_error(client, name, io_type, error_type, num,
 
     Args:
         name: name of error bdev
-        io_type: one of "clear", "read", "write", "unmap", "flush", or "all"
+        io_type: one of "clear", "read", "write", "unmap", "flush", "all", or a KV
+            command: "kv_list", "kv_delete", "kv_exist", "kv_store", "kv_retrieve",
+            "kv_send_select", "kv_retrieve_select", "kv_batch"
         error_type: one of "failure", "pending", or "corrupt_data"
         num: number of commands to fail
         corrupt_offset: offset in bytes to xor with corrupt_value
@@ -1652,7 +1952,10 @@ def bdev_set_qos_limit(
         rw_ios_per_sec=None,
         rw_mbytes_per_sec=None,
         r_mbytes_per_sec=None,
-        w_mbytes_per_sec=None):
+        w_mbytes_per_sec=None,
+        kv_ops_per_sec=None,
+        kv_mbytes_per_sec=None,
+        kv_max_selects=None):
     """Set QoS rate limit on a block device.
 
     Args:
@@ -1661,6 +1964,9 @@ def bdev_set_qos_limit(
         rw_mbytes_per_sec: R/W megabytes per second limit (>=10, example: 100). 0 means unlimited.
         r_mbytes_per_sec: Read megabytes per second limit (>=10, example: 100). 0 means unlimited.
         w_mbytes_per_sec: Write megabytes per second limit (>=10, example: 100). 0 means unlimited.
+        kv_ops_per_sec: KV operations per second limit (>=1000, example: 20000). 0 means unlimited.
+        kv_mbytes_per_sec: KV megabytes per second limit (>=10, example: 100). 0 means unlimited.
+        kv_max_selects: Maximum number of KV SELECTs in flight (example: 4). 0 means unlimited.
     """
     params = {}
     params['name'] = name
@@ -1672,6 +1978,12 @@ def bdev_set_qos_limit(
         params['r_mbytes_per_sec'] = r_mbytes_per_sec
     if w_mbytes_per_sec is not None:
         params['w_mbytes_per_sec'] = w_mbytes_per_sec
+    if kv_ops_per_sec is not None:
+        params['kv_ops_per_sec'] = kv_ops_per_sec
+    if kv_mbytes_per_sec is not None:
+        params['kv_mbytes_per_sec'] = kv_mbytes_per_sec
+    if kv_max_selects is not None:
+        params['kv_max_selects'] = kv_max_selects
     return client.call('bdev_set_qos_limit', params)
 
 
@@ -461,6 +461,243 @@ if __name__ == "__main__":
     p.add_argument('new_size', help='new bdev size for resize operation. The unit is MiB')
     p.set_defaults(func=bdev_null_resize)
 
+    def bdev_kv_append_create(args):
+        print_json(rpc.bdev.bdev_kv_append_create(args.client,
+                                                  base_bdev_name=args.base_bdev_name,
+                                                  name=args.name,
+                                                  max_bytes=args.max_bytes,
+                                                  flush_us=args.flush_us))
+
+    p = subparsers.add_parser('bdev_kv_append_create', help='Merge small appends to the same key on top of a KV bdev')
+    p.add_argument('base_bdev_name', help='Name of the KV bdev to store the values on')
+    p.add_argument('name', help='Name of the append coalescing bdev')
+    p.add_argument('-m', '--max-bytes', help='Bytes of appends to one key merged into one command', type=int)
+    p.add_argument('-f', '--flush-us', help="""Longest time in microseconds an append waits to be merged.
+    0 only merges the appends that arrive while the previous one is in flight""", type=int)
+    p.set_defaults(func=bdev_kv_append_create)
+
+    def bdev_kv_append_delete(args):
+        rpc.bdev.bdev_kv_append_delete(args.client,
+                                       name=args.name)
+
+    p = subparsers.add_parser('bdev_kv_append_delete', help='Delete a KV append coalescing bdev')
+    p.add_argument('name', help='KV append coalescing bdev name')
+    p.set_defaults(func=bdev_kv_append_delete)
+
+    def bdev_kv_append_get_stats(args):
+        print_json(rpc.bdev.bdev_kv_append_get_stats(args.client,
+                                                     name=args.name))
+
+    p = subparsers.add_parser('bdev_kv_append_get_stats', help='Display KV append coalescing counters')
+    p.add_argument('name', help='KV append coalescing bdev name')
+    p.set_defaults(func=bdev_kv_append_get_stats)
+
+    def bdev_kv_cache_create(args):
+        print_json(rpc.bdev.bdev_kv_cache_create(args.client,
+                                                 base_bdev_name=args.base_bdev_name,
+                                                 name=args.name,
+                                                 capacity_mb=args.capacity_mb,
+                                                 max_value_size=args.max_value_size,
+                                                 write_policy=args.write_policy,
+                                                 filter_keys=args.filter_keys,
+                                                 select_capacity_mb=args.select_capacity_mb,
+                                                 max_select_result_size=args.max_select_result_size))
+
+    p = subparsers.add_parser('bdev_kv_cache_create', help='Add a KV read cache on top of a KV bdev')
+    p.add_argument('base_bdev_name', help='Name of the KV bdev to cache')
+    p.add_argument('name', help='Name of the cache bdev')
+    p.add_argument('capacity_mb', help='Memory for cached keys and values in MB (int > 0)', type=int)
+    p.add_argument('-m', '--max-value-size', help='Do not cache values larger than this many bytes', type=int)
+    p.add_argument('-w', '--write-policy', help='write_through (default) or write_around',
+                   choices=['write_through', 'write_around'])
+    p.add_argument('-f', '--filter-keys', help='Expected number of keys; enables a filter answering lookups of missing keys',
+                   type=int)
+    p.add_argument('-s', '--select-capacity-mb', help='Memory for cached SELECT results in MB; enables the SELECT cache',
+                   type=int)
+    p.add_argument('-r', '--max-select-result-size', help='Do not cache SELECT results larger than this many bytes',
+                   type=int)
+    p.set_defaults(func=bdev_kv_cache_create)
+
+    def bdev_kv_cache_delete(args):
+        rpc.bdev.bdev_kv_cache_delete(args.client,
+                                      name=args.name)
+
+    p = subparsers.add_parser('bdev_kv_cache_delete', help='Delete a KV cache bdev')
+    p.add_argument('name', help='KV cache bdev name')
+    p.set_defaults(func=bdev_kv_cache_delete)
+
+    def bdev_kv_cache_get_stats(args):
+        print_json(rpc.bdev.bdev_kv_cache_get_stats(args.client,
+                                                    name=args.name))
+
+    p = subparsers.add_parser('bdev_kv_cache_get_stats', help='Display KV cache hit, miss and eviction counters')
+    p.add_argument('name', help='KV cache bdev name')
+    p.set_defaults(func=bdev_kv_cache_get_stats)
+
+    def bdev_kv_compress_create(args):
+        print_json(rpc.bdev.bdev_kv_compress_create(args.client,
+                                                    base_bdev_name=args.base_bdev_name,
+                                                    name=args.name,
+                                                    min_size=args.min_size))
+
+    p = subparsers.add_parser('bdev_kv_compress_create', help='Add host-side value compression on top of a KV bdev')
+    p.add_argument('base_bdev_name', help='Name of the KV bdev to store the values on')
+    p.add_argument('name', help='Name of the compression bdev')
+    p.add_argument('-m', '--min-size', help='Store values shorter than this many bytes uncompressed', type=int)
+    p.set_defaults(func=bdev_kv_compress_create)
+
+    def bdev_kv_compress_delete(args):
+        rpc.bdev.bdev_kv_compress_delete(args.client,
+                                         name=args.name)
+
+    p = subparsers.add_parser('bdev_kv_compress_delete', help='Delete a KV compression bdev')
+    p.add_argument('name', help='KV compression bdev name')
+    p.set_defaults(func=bdev_kv_compress_delete)
+
+    def bdev_kv_compress_get_stats(args):
+        print_json(rpc.bdev.bdev_kv_compress_get_stats(args.client,
+                                                       name=args.name))
+
+    p = subparsers.add_parser('bdev_kv_compress_get_stats', help='Display KV compression counters')
+    p.add_argument('name', help='KV compression bdev name')
+    p.set_defaults(func=bdev_kv_compress_get_stats)
+
+    def bdev_kv_crc_create(args):
+        print_json(rpc.bdev.bdev_kv_crc_create(args.client,
+                                               base_bdev_name=args.base_bdev_name,
+                                               name=args.name))
+
+    p = subparsers.add_parser('bdev_kv_crc_create', help='Add CRC-32C value integrity on top of a KV bdev')
+    p.add_argument('base_bdev_name', help='Name of the KV bdev to store the values on')
+    p.add_argument('name', help='Name of the integrity bdev')
+    p.set_defaults(func=bdev_kv_crc_create)
+
+    def bdev_kv_crc_delete(args):
+        rpc.bdev.bdev_kv_crc_delete(args.client,
+                                    name=args.name)
+
+    p = subparsers.add_parser('bdev_kv_crc_delete', help='Delete a KV integrity bdev')
+    p.add_argument('name', help='KV integrity bdev name')
+    p.set_defaults(func=bdev_kv_crc_delete)
+
+    def bdev_kv_crc_get_stats(args):
+        print_json(rpc.bdev.bdev_kv_crc_get_stats(args.client,
+                                                  name=args.name))
+
+    p = subparsers.add_parser('bdev_kv_crc_get_stats', help='Display KV integrity counters')
+    p.add_argument('name', help='KV integrity bdev name')
+    p.set_defaults(func=bdev_kv_crc_get_stats)
+
+    def bdev_kv_mirror_create(args):
+        base_bdevs = []
+        for u in args.base_bdevs.strip().split(" "):
+            base_bdevs.append(u)
+
+        print_json(rpc.bdev.bdev_kv_mirror_create(args.client,
+                                                  name=args.name,
+                                                  base_bdevs=base_bdevs,
+                                                  dirty_log_keys=args.dirty_log_keys))
+
+    p = subparsers.add_parser('bdev_kv_mirror_create', help='Add a KV bdev keeping the same keys on several KV bdevs')
+    p.add_argument('-n', '--name', help='Name of the mirror bdev', required=True)
+    p.add_argument('-b', '--base-bdevs', help='KV bdev names, whitespace separated list in quotes', required=True)
+    p.add_argument('-d', '--dirty-log-keys', help='Keys remembered for resync while a replica is out of service',
+                   type=int)
+    p.set_defaults(func=bdev_kv_mirror_create)
+
+    def bdev_kv_mirror_delete(args):
+        rpc.bdev.bdev_kv_mirror_delete(args.client,
+                                       name=args.name)
+
+    p = subparsers.add_parser('bdev_kv_mirror_delete', help='Delete a KV mirror bdev')
+    p.add_argument('name', help='KV mirror bdev name')
+    p.set_defaults(func=bdev_kv_mirror_delete)
+
+    def bdev_kv_mirror_resync(args):
+        print_json(rpc.bdev.bdev_kv_mirror_resync(args.client,
+                                                  name=args.name))
+
+    p = subparsers.add_parser('bdev_kv_mirror_resync', help='Resync KV mirror replicas taken out of service after errors')
+    p.add_argument('name', help='KV mirror bdev name')
+    p.set_defaults(func=bdev_kv_mirror_resync)
+
+    def bdev_kv_shard_create(args):
+        base_bdevs = []
+        for u in args.base_bdevs.strip().split(" "):
+            base_bdevs.append(u)
+
+        print_json(rpc.bdev.bdev_kv_shard_create(args.client,
+                                                 name=args.name,
+                                                 base_bdevs=base_bdevs,
+                                                 hash=args.hash))
+
+    p = subparsers.add_parser('bdev_kv_shard_create', help='Add a KV bdev spreading its keys over several KV bdevs')
+    p.add_argument('-n', '--name', help='Name of the shard bdev', required=True)
+    p.add_argument('-b', '--base-bdevs', help='KV bdev names, whitespace separated list in quotes', required=True)
+    p.add_argument('-H', '--hash', help='jump (default) or ring', choices=['jump', 'ring'])
+    p.set_defaults(func=bdev_kv_shard_create)
+
+    def bdev_kv_shard_delete(args):
+        rpc.bdev.bdev_kv_shard_delete(args.client,
+                                      name=args.name)
+
+    p = subparsers.add_parser('bdev_kv_shard_delete', help='Delete a KV shard bdev')
+    p.add_argument('name', help='KV shard bdev name')
+    p.set_defaults(func=bdev_kv_shard_delete)
+
+    def bdev_kv_zns_create(args):
+        print_json(rpc.bdev.bdev_kv_zns_create(args.client,
+                                               base_bdev_name=args.base_bdev_name,
+                                               name=args.name,
+                                               checkpoint_ms=args.checkpoint_ms,
+                                               gc_free_zones=args.gc_free_zones))
+
+    p = subparsers.add_parser('bdev_kv_zns_create', help='Add a log-structured KV engine bdev on top of a zoned bdev')
+    p.add_argument('base_bdev_name', help='Name of the zoned bdev to append the records to')
+    p.add_argument('name', help='Name of the KV engine bdev')
+    p.add_argument('-c', '--checkpoint-ms', help="""Milliseconds between checkpoints of the index.
+    0 only checkpoints when garbage collection or deletion needs it""", type=int)
+    p.add_argument('-g', '--gc-free-zones', help='Free zones left when garbage collection starts', type=int)
+    p.set_defaults(func=bdev_kv_zns_create)
+
+    def bdev_kv_zns_delete(args):
+        rpc.bdev.bdev_kv_zns_delete(args.client,
+                                    name=args.name)
+
+    p = subparsers.add_parser('bdev_kv_zns_delete', help='Delete a KV engine bdev')
+    p.add_argument('name', help='KV engine bdev name')
+    p.set_defaults(func=bdev_kv_zns_delete)
+
+    def bdev_kv_zns_get_stats(args):
+        print_json(rpc.bdev.bdev_kv_zns_get_stats(args.client,
+                                                  name=args.name))
+
+    p = subparsers.add_parser('bdev_kv_zns_get_stats', help='Display KV engine counters')
+    p.add_argument('name', help='KV engine bdev name')
+    p.set_defaults(func=bdev_kv_zns_get_stats)
+
+    def bdev_kv_emu_create(args):
+        print_json(rpc.bdev.bdev_kv_emu_create(args.client,
+                                               name=args.name,
+                                               capacity_mb=args.capacity_mb,
+                                               uuid=args.uuid,
+                                               backing_bdev=args.backing_bdev))
+
+    p = subparsers.add_parser('bdev_kv_emu_create', help='Add a bdev emulating a KV command set in memory')
+    p.add_argument('name', help='Block device name')
+    p.add_argument('capacity_mb', help='Memory for keys and values in MB (int > 0)', type=int)
+    p.add_argument('-u', '--uuid', help='UUID of the bdev')
+    p.add_argument('-b', '--backing-bdev', help='Bdev to load contents from and save them to on delete')
+    p.set_defaults(func=bdev_kv_emu_create)
+
+    def bdev_kv_emu_delete(args):
+        rpc.bdev.bdev_kv_emu_delete(args.client,
+                                    name=args.name)
+
+    p = subparsers.add_parser('bdev_kv_emu_delete', help='Delete a KV emulation bdev')
+    p.add_argument('name', help='KV emulation bdev name')
+    p.set_defaults(func=bdev_kv_emu_delete)
+
     def bdev_aio_create(args):
         print_json(rpc.bdev.bdev_aio_create(args.client,
                                             filename=args.filename,
@@ -1213,7 +1450,10 @@ if __name__ == "__main__":
                                     rw_ios_per_sec=args.rw_ios_per_sec,
                                     rw_mbytes_per_sec=args.rw_mbytes_per_sec,
                                     r_mbytes_per_sec=args.r_mbytes_per_sec,
-                                    w_mbytes_per_sec=args.w_mbytes_per_sec)
+                                    w_mbytes_per_sec=args.w_mbytes_per_sec,
+                                    kv_ops_per_sec=args.kv_ops_per_sec,
+                                    kv_mbytes_per_sec=args.kv_mbytes_per_sec,
+                                    kv_max_selects=args.kv_max_selects)
 
     p = subparsers.add_parser('bdev_set_qos_limit',
                               help='Set QoS rate limit on a blockdev')
@@ -1230,6 +1470,15 @@ if __name__ == "__main__":
     p.add_argument('--w-mbytes-per-sec',
                    help="Write megabytes per second limit (>=10, example: 100). 0 means unlimited.",
                    type=int, required=False)
+    p.add_argument('--kv-ops-per-sec',
+                   help='KV operations per second limit (>=1000, example: 20000). 0 means unlimited.',
+                   type=int, required=False)
+    p.add_argument('--kv-mbytes-per-sec',
+                   help="KV megabytes per second limit (>=10, example: 100). 0 means unlimited.",
+                   type=int, required=False)
+    p.add_argument('--kv-max-selects',
+                   help="Maximum number of KV SELECTs in flight (example: 4). 0 means unlimited.",
+                   type=int, required=False)
     p.set_defaults(func=bdev_set_qos_limit)
 
     def bdev_error_inject_error(args):
@@ -1243,7 +1492,9 @@ if __name__ == "__main__":
 
     p = subparsers.add_parser('bdev_error_inject_error', help='bdev inject error')
     p.add_argument('name', help="""the name of the error injection bdev""")
-    p.add_argument('io_type', help="""io_type: 'clear' 'read' 'write' 'unmap' 'flush' 'all'""")
+    p.add_argument('io_type', help="""io_type: 'clear' 'read' 'write' 'unmap' 'flush' 'all'
+    'kv_list' 'kv_delete' 'kv_exist' 'kv_store' 'kv_retrieve' 'kv_send_select'
+    'kv_retrieve_select' 'kv_batch'""")
     p.add_argument('error_type', help="""error_type: 'failure' 'pending' 'corrupt_data'""")
     p.add_argument(
         '-n', '--num', help='the number of commands you want to fail', type=int)
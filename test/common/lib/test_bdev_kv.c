@@ -0,0 +1,1043 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+/*
+ * Bdev layer for the unit tests of KV virtual bdevs. Base bdevs keep their keys
+ * and values in memory. Commands sent to them are queued until ut_kv_poll(), so
+ * tests can look at what a vbdev sent before it completes, fail the submission
+ * with base->submit_rc, or fail the commands themselves with base->fail_sc.
+ * SELECT on a base bdev returns the value of the key, whatever the query.
+ * Suites emulating block or zoned commands queue them with ut_kv_io_get() and
+ * run them from io->exec_fn.
+ */
+
+#include "spdk/stdinc.h"
+
+#include "spdk/bdev_module.h"
+#include "spdk/thread.h"
+#include "spdk_internal/mock.h"
+
+#define UT_KV_BASE_MAX_KEYS	128
+#define UT_KV_BASE_MAX_SELECTS	16
+
+struct ut_kv_value {
+	uint8_t		key[NVME_KV_MAX_KEY_LENGTH];
+	size_t		key_len;
+	uint8_t		*value;
+	uint32_t	len;
+};
+
+struct ut_kv_select {
+	uint32_t	id;
+	uint8_t		*data;
+	uint32_t	len;
+};
+
+struct ut_kv_base {
+	struct spdk_bdev		bdev;
+	spdk_bdev_event_cb_t		event_cb;
+	void				*event_ctx;
+	uint32_t			open_count;
+	bool				kv_supported;
+	struct ut_kv_value		values[UT_KV_BASE_MAX_KEYS];
+	uint32_t			num_values;
+	struct ut_kv_select		selects[UT_KV_BASE_MAX_SELECTS];
+	uint32_t			next_select_id;
+	/* Returned by the next submissions while not 0. */
+	int				submit_rc;
+	/* Status code the next commands fail with while not 0. */
+	int				fail_sc;
+	/* Number of commands submitted, by type. */
+	uint32_t			num_ios[SPDK_BDEV_NUM_IO_TYPES];
+	/* Status the key listing of spdk_bdev_kv_list_iter_open() finishes with. */
+	int				iter_rc;
+};
+
+/* Key listing opened with spdk_bdev_kv_list_iter_open(), run by ut_kv_poll(). */
+struct spdk_bdev_kv_list_iter {
+	struct ut_kv_base		*base;
+	spdk_bdev_kv_list_key_cb	key_cb;
+	spdk_bdev_kv_list_done_cb	done_cb;
+	void				*cb_arg;
+	bool				closed;
+	TAILQ_ENTRY(spdk_bdev_kv_list_iter) link;
+};
+
+/* A command sent to a base bdev. */
+struct ut_kv_io {
+	struct spdk_bdev_io			bdev_io;
+	struct ut_kv_base			*base;
+	enum spdk_bdev_io_type			type;
+	uint8_t					key[NVME_KV_MAX_KEY_LENGTH];
+	size_t					key_len;
+	struct iovec				iov;
+	struct iovec				*iovs;
+	int					iovcnt;
+	uint64_t				nbytes;
+	uint64_t				offset;
+	uint8_t					options;
+	uint32_t				select_id;
+	enum spdk_bdev_io_type			batch_type;
+	struct spdk_bdev_kv_batch_entry		*batch;
+	uint32_t				batch_count;
+	spdk_bdev_io_completion_cb		cb;
+	void					*cb_arg;
+	/* Runs a command that is not a KV command, returning its status code. */
+	int					(*exec_fn)(struct ut_kv_io *io);
+	TAILQ_ENTRY(ut_kv_io)			link;
+};
+
+static TAILQ_HEAD(, spdk_bdev) g_ut_kv_bdevs = TAILQ_HEAD_INITIALIZER(g_ut_kv_bdevs);
+static TAILQ_HEAD(, ut_kv_io) g_ut_kv_ios = TAILQ_HEAD_INITIALIZER(g_ut_kv_ios);
+static TAILQ_HEAD(, spdk_bdev_kv_list_iter) g_ut_kv_iters = TAILQ_HEAD_INITIALIZER(g_ut_kv_iters);
+static TAILQ_HEAD(, spdk_bdev_io_wait_entry) g_ut_kv_io_wait = TAILQ_HEAD_INITIALIZER(
+			g_ut_kv_io_wait);
+/* Completions of vbdev I/O, and how many unregister callbacks ran. */
+static uint32_t g_ut_kv_completions;
+static uint32_t g_ut_kv_unregistered;
+
+struct ut_kv_base *ut_kv_base_create(const char *name);
+void ut_kv_base_destroy(struct ut_kv_base *base);
+void ut_kv_base_remove(struct ut_kv_base *base);
+const uint8_t *ut_kv_base_get(struct ut_kv_base *base, const char *key, uint32_t *len);
+void ut_kv_base_put(struct ut_kv_base *base, const void *key, size_t key_len, const void *buf,
+		    uint32_t len, bool append);
+void ut_kv_poll(void);
+bool ut_kv_poll_one(void);
+uint32_t ut_kv_num_outstanding(void);
+struct spdk_bdev_io *ut_kv_vbdev_io(struct spdk_bdev *bdev, size_t ctx_size,
+				    enum spdk_bdev_io_type type, const char *key, void *buf,
+				    uint64_t len);
+int ut_kv_vbdev_submit(struct spdk_io_channel *ch, struct spdk_bdev_io *bdev_io);
+
+DEFINE_STUB_V(spdk_bdev_module_list_add, (struct spdk_bdev_module *bdev_module));
+DEFINE_STUB_V(spdk_bdev_module_examine_done, (struct spdk_bdev_module *module));
+
+static int
+ut_kv_io_channel_create(void *io_device, void *ctx_buf)
+{
+	return 0;
+}
+
+static void
+ut_kv_io_channel_destroy(void *io_device, void *ctx_buf)
+{
+}
+
+struct ut_kv_base *
+ut_kv_base_create(const char *name)
+{
+	struct ut_kv_base *base;
+
+	base = calloc(1, sizeof(*base));
+	SPDK_CU_ASSERT_FATAL(base != NULL);
+	base->bdev.name = strdup(name);
+	SPDK_CU_ASSERT_FATAL(base->bdev.name != NULL);
+	base->bdev.blocklen = 512;
+	base->bdev.blockcnt = 1024;
+	/* The posix_memalign() behind spdk_dma_malloc() needs at least pointer alignment. */
+	base->bdev.required_alignment = spdk_u32log2(sizeof(void *));
+	base->kv_supported = true;
+	base->next_select_id = 1;
+	spdk_io_device_register(base, ut_kv_io_channel_create, ut_kv_io_channel_destroy, 0, name);
+	TAILQ_INSERT_TAIL(&g_ut_kv_bdevs, &base->bdev, internal.link);
+
+	return base;
+}
+
+static void
+ut_kv_base_free(struct ut_kv_base *base)
+{
+	uint32_t i;
+
+	for (i = 0; i < base->num_values; i++) {
+		free(base->values[i].value);
+	}
+	for (i = 0; i < UT_KV_BASE_MAX_SELECTS; i++) {
+		free(base->selects[i].data);
+	}
+	spdk_io_device_unregister(base, NULL);
+	free(base->bdev.name);
+	free(base);
+}
+
+/* Remove a base bdev that is no longer in use by any vbdev. */
+void
+ut_kv_base_destroy(struct ut_kv_base *base)
+{
+	CU_ASSERT(base->open_count == 0);
+	CU_ASSERT(base->bdev.internal.claim_type == SPDK_BDEV_CLAIM_NONE);
+	TAILQ_REMOVE(&g_ut_kv_bdevs, &base->bdev, internal.link);
+	ut_kv_base_free(base);
+}
+
+/* Hot remove a base bdev. The vbdevs on it are expected to close it. */
+void
+ut_kv_base_remove(struct ut_kv_base *base)
+{
+	SPDK_CU_ASSERT_FATAL(base->event_cb != NULL);
+	base->event_cb(SPDK_BDEV_EVENT_REMOVE, &base->bdev, base->event_ctx);
+}
+
+static struct ut_kv_value *
+ut_kv_base_find(struct ut_kv_base *base, const uint8_t *key, size_t key_len)
+{
+	uint32_t i;
+
+	for (i = 0; i < base->num_values; i++) {
+		if (base->values[i].key_len == key_len &&
+		    memcmp(base->values[i].key, key, key_len) == 0) {
+			return &base->values[i];
+		}
+	}
+
+	return NULL;
+}
+
+const uint8_t *
+ut_kv_base_get(struct ut_kv_base *base, const char *key, uint32_t *len)
+{
+	struct ut_kv_value *value = ut_kv_base_find(base, (const uint8_t *)key, strlen(key));
+
+	if (value == NULL) {
+		return NULL;
+	}
+	*len = value->len;
+	return value->value;
+}
+
+/* Store a value directly, without going through a vbdev. */
+void
+ut_kv_base_put(struct ut_kv_base *base, const void *key, size_t key_len, const void *buf,
+	       uint32_t len, bool append)
+{
+	struct ut_kv_value *value = ut_kv_base_find(base, key, key_len);
+	uint8_t *data;
+	uint32_t off = 0;
+
+	if (value == NULL) {
+		SPDK_CU_ASSERT_FATAL(base->num_values < UT_KV_BASE_MAX_KEYS);
+		value = &base->values[base->num_values++];
+		memcpy(value->key, key, key_len);
+		value->key_len = key_len;
+	} else if (append) {
+		off = value->len;
+	}
+
+	data = calloc(1, off + len + 1);
+	SPDK_CU_ASSERT_FATAL(data != NULL);
+	if (off != 0) {
+		memcpy(data, value->value, off);
+	}
+	memcpy(data + off, buf, len);
+	free(value->value);
+	value->value = data;
+	value->len = off + len;
+}
+
+static bool
+ut_kv_base_del(struct ut_kv_base *base, const void *key, size_t key_len)
+{
+	struct ut_kv_value *value = ut_kv_base_find(base, key, key_len);
+
+	if (value == NULL) {
+		return false;
+	}
+
+	free(value->value);
+	*value = base->values[--base->num_values];
+	memset(&base->values[base->num_values], 0, sizeof(*value));
+	return true;
+}
+
+static int
+ut_kv_value_cmp(const void *a, const void *b)
+{
+	const struct ut_kv_value *va = *(struct ut_kv_value *const *)a;
+	const struct ut_kv_value *vb = *(struct ut_kv_value *const *)b;
+	int rc;
+
+	rc = memcmp(va->key, vb->key, spdk_min(va->key_len, vb->key_len));
+	return rc ? rc : (int)va->key_len - (int)vb->key_len;
+}
+
+/* Fill a LIST buffer with the keys from io->key on, sorted. Returns the number of keys. */
+static uint32_t
+ut_kv_base_list(struct ut_kv_base *base, struct ut_kv_io *io)
+{
+	struct ut_kv_value *sorted[UT_KV_BASE_MAX_KEYS];
+	struct ut_kv_value start = {};
+	uint8_t *buf;
+	uint32_t i, num = 0, pos = sizeof(num), len;
+	uint16_t key_len;
+
+	buf = calloc(1, io->nbytes);
+	SPDK_CU_ASSERT_FATAL(buf != NULL);
+	memcpy(start.key, io->key, io->key_len);
+	start.key_len = io->key_len;
+
+	for (i = 0; i < base->num_values; i++) {
+		sorted[i] = &base->values[i];
+	}
+	qsort(sorted, base->num_values, sizeof(sorted[0]), ut_kv_value_cmp);
+
+	for (i = 0; i < base->num_values; i++) {
+		const struct ut_kv_value *p = &start;
+
+		if (ut_kv_value_cmp(&sorted[i], &p) < 0) {
+			continue;
+		}
+		key_len = sorted[i]->key_len;
+		len = sizeof(key_len) + SPDK_ALIGN_CEIL(key_len, 4);
+		if (pos + len > io->nbytes) {
+			break;
+		}
+		memcpy(buf + pos, &key_len, sizeof(key_len));
+		memcpy(buf + pos + sizeof(key_len), sorted[i]->key, key_len);
+		pos += len;
+		num++;
+	}
+	memcpy(buf, &num, sizeof(num));
+	spdk_copy_buf_to_iovs(io->iovs, io->iovcnt, buf, pos);
+	free(buf);
+
+	return num;
+}
+
+static struct ut_kv_select *
+ut_kv_base_select_find(struct ut_kv_base *base, uint32_t id)
+{
+	uint32_t i;
+
+	for (i = 0; i < UT_KV_BASE_MAX_SELECTS; i++) {
+		if (base->selects[i].id == id && id != 0) {
+			return &base->selects[i];
+		}
+	}
+
+	return NULL;
+}
+
+/* Apply one KV command to the keys of a base bdev. */
+static void
+ut_kv_base_exec(struct ut_kv_base *base, enum spdk_bdev_io_type type, uint8_t *key,
+		size_t key_len, struct iovec *iovs, int iovcnt, uint64_t nbytes, uint64_t offset,
+		uint8_t options, uint32_t select_id, uint32_t *cdw0, int *sc)
+{
+	struct ut_kv_value *value = ut_kv_base_find(base, key, key_len);
+	struct ut_kv_select *select;
+	uint8_t *buf;
+
+	*cdw0 = 0;
+	*sc = SPDK_NVME_SC_SUCCESS;
+
+	switch (type) {
+	case SPDK_BDEV_IO_KV_STORE:
+		if ((options & NVME_KV_STORE_CMD_OPTION_MUST_EXIST) && value == NULL) {
+			*sc = SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST;
+		} else if ((options & NVME_KV_STORE_CMD_OPTION_MUST_NOT_EXIST) && value != NULL) {
+			*sc = SPDK_NVME_SC_KEY_EXISTS;
+		} else {
+			buf = calloc(1, nbytes + 1);
+			SPDK_CU_ASSERT_FATAL(buf != NULL);
+			spdk_copy_iovs_to_buf(buf, nbytes, iovs, iovcnt);
+			ut_kv_base_put(base, key, key_len, buf, nbytes,
+				       options & NVME_KV_STORE_CMD_OPTION_APPEND);
+			free(buf);
+		}
+		break;
+	case SPDK_BDEV_IO_KV_RETRIEVE:
+		if (value == NULL) {
+			*sc = SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST;
+		} else if (offset > value->len) {
+			*sc = SPDK_NVME_SC_INVALID_FIELD;
+		} else {
+			spdk_copy_buf_to_iovs(iovs, iovcnt, value->value + offset,
+					      spdk_min(value->len - offset, nbytes));
+			*cdw0 = value->len;
+		}
+		break;
+	case SPDK_BDEV_IO_KV_EXIST:
+		if (value == NULL) {
+			*sc = SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST;
+		}
+		break;
+	case SPDK_BDEV_IO_KV_DELETE:
+		if (!ut_kv_base_del(base, key, key_len)) {
+			*sc = SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST;
+		}
+		break;
+	case SPDK_BDEV_IO_KV_SEND_SELECT:
+		if (value == NULL) {
+			*sc = SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST;
+			break;
+		}
+		for (select = &base->selects[0]; select->id != 0; select++) {
+			SPDK_CU_ASSERT_FATAL(select < &base->selects[UT_KV_BASE_MAX_SELECTS - 1]);
+		}
+		select->id = base->next_select_id++;
+		select->len = value->len;
+		select->data = calloc(1, value->len + 1);
+		SPDK_CU_ASSERT_FATAL(select->data != NULL);
+		memcpy(select->data, value->value, value->len);
+		*cdw0 = select->id;
+		break;
+	case SPDK_BDEV_IO_KV_RETRIEVE_SELECT:
+		select = ut_kv_base_select_find(base, select_id);
+		if (select == NULL || offset > select->len) {
+			*sc = SPDK_NVME_SC_INVALID_FIELD;
+			break;
+		}
+		spdk_copy_buf_to_iovs(iovs, iovcnt, select->data + offset,
+				      spdk_min(select->len - offset, nbytes));
+		*cdw0 = select->len;
+		if (options == 0 ||
+		    ((options & NVME_KV_SELECT_CMD_OPTION_DO_NOT_FREE_IF_NOT_ALL_DATA_FETCHED) &&
+		     offset + nbytes >= select->len)) {
+			free(select->data);
+			memset(select, 0, sizeof(*select));
+		}
+		break;
+	case SPDK_BDEV_IO_TYPE_FLUSH:
+		break;
+	default:
+		*sc = SPDK_NVME_SC_INVALID_OPCODE;
+		break;
+	}
+}
+
+/* Run a command sent to a base bdev. Returns whether it succeeded. */
+static bool
+ut_kv_io_exec(struct ut_kv_io *io)
+{
+	struct ut_kv_base *base = io->base;
+	struct spdk_bdev_kv_batch_entry *entry;
+	uint32_t cdw0 = 0, i;
+	int sc = SPDK_NVME_SC_SUCCESS;
+
+	if (base->fail_sc != 0) {
+		sc = base->fail_sc;
+	} else if (io->exec_fn != NULL) {
+		sc = io->exec_fn(io);
+	} else if (io->type == SPDK_BDEV_IO_KV_LIST) {
+		cdw0 = ut_kv_base_list(base, io);
+	} else if (io->type == SPDK_BDEV_IO_KV_BATCH) {
+		for (i = 0; i < io->batch_count; i++) {
+			entry = &io->batch[i];
+			ut_kv_base_exec(base, io->batch_type, entry->key, entry->key_length,
+					entry->iovs, entry->iovcnt, entry->nbytes, entry->offset,
+					entry->options, 0, &entry->cdw0, &entry->sc);
+			entry->sct = SPDK_NVME_SCT_GENERIC;
+		}
+	} else {
+		ut_kv_base_exec(base, io->type, io->key, io->key_len, io->iovs, io->iovcnt,
+				io->nbytes, io->offset, io->options, io->select_id, &cdw0, &sc);
+	}
+
+	io->bdev_io.internal.error.nvme.cdw0 = cdw0;
+	io->bdev_io.internal.error.nvme.sct = SPDK_NVME_SCT_GENERIC;
+	io->bdev_io.internal.error.nvme.sc = sc;
+	io->bdev_io.internal.status = sc == SPDK_NVME_SC_SUCCESS ? SPDK_BDEV_IO_STATUS_SUCCESS :
+				      SPDK_BDEV_IO_STATUS_NVME_ERROR;
+
+	return sc == SPDK_NVME_SC_SUCCESS;
+}
+
+/*
+ * Complete the commands sent to the base bdevs, run the key listings and what
+ * the vbdevs queued to wait for resources, and poll the thread, until nothing
+ * is left to do. Clear submit_rc first, or queued I/O will keep waiting.
+ */
+void
+ut_kv_poll(void)
+{
+	struct spdk_bdev_io_wait_entry *entry;
+	struct spdk_bdev_kv_list_iter *iter;
+	struct ut_kv_io *io;
+	uint32_t i;
+	bool busy;
+
+	do {
+		busy = false;
+		while ((io = TAILQ_FIRST(&g_ut_kv_ios)) != NULL) {
+			TAILQ_REMOVE(&g_ut_kv_ios, io, link);
+			io->cb(&io->bdev_io, ut_kv_io_exec(io), io->cb_arg);
+			busy = true;
+		}
+
+		while ((iter = TAILQ_FIRST(&g_ut_kv_iters)) != NULL) {
+			TAILQ_REMOVE(&g_ut_kv_iters, iter, link);
+			if (iter->closed) {
+				iter->done_cb(iter->cb_arg, -ECANCELED, 0);
+			} else if (iter->base->iter_rc != 0) {
+				iter->done_cb(iter->cb_arg, iter->base->iter_rc, 0);
+			} else {
+				for (i = 0; i < iter->base->num_values; i++) {
+					iter->key_cb(iter->cb_arg, iter->base->values[i].key,
+						     iter->base->values[i].key_len);
+				}
+				iter->done_cb(iter->cb_arg, 0, iter->base->num_values);
+			}
+			free(iter);
+			busy = true;
+		}
+
+		entry = TAILQ_FIRST(&g_ut_kv_io_wait);
+		if (entry != NULL) {
+			TAILQ_REMOVE(&g_ut_kv_io_wait, entry, link);
+			entry->cb_fn(entry->cb_arg);
+			busy = true;
+		}
+
+		while (spdk_thread_poll(spdk_get_thread(), 0, 0) > 0) {
+			busy = true;
+		}
+	} while (busy);
+}
+
+/* Complete the oldest command sent to a base bdev. Returns false if there was none. */
+bool
+ut_kv_poll_one(void)
+{
+	struct ut_kv_io *io = TAILQ_FIRST(&g_ut_kv_ios);
+
+	if (io == NULL) {
+		return false;
+	}
+
+	TAILQ_REMOVE(&g_ut_kv_ios, io, link);
+	io->cb(&io->bdev_io, ut_kv_io_exec(io), io->cb_arg);
+	return true;
+}
+
+/* Number of commands sent to base bdevs and not completed yet. */
+uint32_t
+ut_kv_num_outstanding(void)
+{
+	struct ut_kv_io *io;
+	uint32_t num = 0;
+
+	TAILQ_FOREACH(io, &g_ut_kv_ios, link) {
+		num++;
+	}
+
+	return num;
+}
+
+/* vbdev I/O */
+
+/* Allocate an I/O for a vbdev, with a single iov of len bytes at buf. */
+struct spdk_bdev_io *
+ut_kv_vbdev_io(struct spdk_bdev *bdev, size_t ctx_size, enum spdk_bdev_io_type type,
+	       const char *key, void *buf, uint64_t len)
+{
+	struct spdk_bdev_io *bdev_io;
+
+	bdev_io = calloc(1, sizeof(*bdev_io) + ctx_size);
+	SPDK_CU_ASSERT_FATAL(bdev_io != NULL);
+	bdev_io->bdev = bdev;
+	bdev_io->type = type;
+	if (key != NULL) {
+		bdev_io->u.bdev.nvme_kv.key_length = strlen(key);
+		memcpy(bdev_io->u.bdev.nvme_kv.key, key, strlen(key));
+	}
+	bdev_io->iov.iov_base = buf;
+	bdev_io->iov.iov_len = len;
+	bdev_io->u.bdev.iovs = &bdev_io->iov;
+	bdev_io->u.bdev.iovcnt = 1;
+	bdev_io->u.bdev.nvme_kv.buffer_size = len;
+	bdev_io->internal.status = SPDK_BDEV_IO_STATUS_PENDING;
+
+	return bdev_io;
+}
+
+/*
+ * Submit an I/O to a vbdev and run it to completion. Returns its NVMe status
+ * code, or -1 if it failed without one.
+ */
+int
+ut_kv_vbdev_submit(struct spdk_io_channel *ch, struct spdk_bdev_io *bdev_io)
+{
+	bdev_io->internal.status = SPDK_BDEV_IO_STATUS_PENDING;
+	bdev_io->bdev->fn_table->submit_request(ch, bdev_io);
+	ut_kv_poll();
+
+	switch (bdev_io->internal.status) {
+	case SPDK_BDEV_IO_STATUS_SUCCESS:
+		return SPDK_NVME_SC_SUCCESS;
+	case SPDK_BDEV_IO_STATUS_NVME_ERROR:
+		return bdev_io->internal.error.nvme.sc;
+	default:
+		return -1;
+	}
+}
+
+void
+spdk_bdev_io_complete(struct spdk_bdev_io *bdev_io, enum spdk_bdev_io_status status)
+{
+	CU_ASSERT(bdev_io->internal.status == SPDK_BDEV_IO_STATUS_PENDING);
+	bdev_io->internal.status = status;
+	bdev_io->internal.error.nvme.cdw0 = 0;
+	g_ut_kv_completions++;
+}
+
+void
+spdk_bdev_io_complete_nvme_status(struct spdk_bdev_io *bdev_io, uint32_t cdw0, int sct, int sc)
+{
+	CU_ASSERT(bdev_io->internal.status == SPDK_BDEV_IO_STATUS_PENDING);
+	bdev_io->internal.error.nvme.cdw0 = cdw0;
+	bdev_io->internal.error.nvme.sct = sct;
+	bdev_io->internal.error.nvme.sc = sc;
+	bdev_io->internal.status = sct == SPDK_NVME_SCT_GENERIC && sc == SPDK_NVME_SC_SUCCESS ?
+				   SPDK_BDEV_IO_STATUS_SUCCESS : SPDK_BDEV_IO_STATUS_NVME_ERROR;
+	g_ut_kv_completions++;
+}
+
+void
+spdk_bdev_io_get_nvme_status(const struct spdk_bdev_io *bdev_io, uint32_t *cdw0, int *sct, int *sc)
+{
+	*cdw0 = bdev_io->internal.error.nvme.cdw0;
+	if (bdev_io->internal.status == SPDK_BDEV_IO_STATUS_NVME_ERROR) {
+		*sct = bdev_io->internal.error.nvme.sct;
+		*sc = bdev_io->internal.error.nvme.sc;
+	} else if (bdev_io->internal.status == SPDK_BDEV_IO_STATUS_SUCCESS) {
+		*sct = SPDK_NVME_SCT_GENERIC;
+		*sc = SPDK_NVME_SC_SUCCESS;
+	} else {
+		*sct = SPDK_NVME_SCT_GENERIC;
+		*sc = SPDK_NVME_SC_INTERNAL_DEVICE_ERROR;
+	}
+}
+
+void
+spdk_bdev_kv_io_complete_from(struct spdk_bdev_io *bdev_io, const struct spdk_bdev_io *child)
+{
+	uint32_t cdw0;
+	int sct, sc;
+
+	spdk_bdev_io_get_nvme_status(child, &cdw0, &sct, &sc);
+	spdk_bdev_io_complete_nvme_status(bdev_io, cdw0, sct, sc);
+}
+
+/* Bdevs */
+
+struct spdk_bdev *
+spdk_bdev_get_by_name(const char *bdev_name)
+{
+	struct spdk_bdev *bdev;
+
+	TAILQ_FOREACH(bdev, &g_ut_kv_bdevs, internal.link) {
+		if (strcmp(bdev_name, bdev->name) == 0) {
+			return bdev;
+		}
+	}
+
+	return NULL;
+}
+
+const char *
+spdk_bdev_get_name(const struct spdk_bdev *bdev)
+{
+	return bdev->name;
+}
+
+size_t
+spdk_bdev_get_buf_align(const struct spdk_bdev *bdev)
+{
+	return 1 << bdev->required_alignment;
+}
+
+bool
+spdk_bdev_io_type_supported(struct spdk_bdev *bdev, enum spdk_bdev_io_type io_type)
+{
+	if (bdev->fn_table != NULL) {
+		return bdev->fn_table->io_type_supported(bdev->ctxt, io_type);
+	}
+
+	return SPDK_CONTAINEROF(bdev, struct ut_kv_base, bdev)->kv_supported;
+}
+
+int
+spdk_bdev_register(struct spdk_bdev *bdev)
+{
+	CU_ASSERT(spdk_bdev_get_by_name(bdev->name) == NULL);
+	TAILQ_INSERT_TAIL(&g_ut_kv_bdevs, bdev, internal.link);
+
+	return 0;
+}
+
+void
+spdk_bdev_destruct_done(struct spdk_bdev *bdev, int bdeverrno)
+{
+	g_ut_kv_unregistered++;
+	if (bdev->internal.unregister_cb != NULL) {
+		bdev->internal.unregister_cb(bdev->internal.unregister_ctx, bdeverrno);
+	}
+}
+
+void
+spdk_bdev_unregister(struct spdk_bdev *bdev, spdk_bdev_unregister_cb cb_fn, void *cb_arg)
+{
+	int rc;
+
+	CU_ASSERT(spdk_bdev_get_by_name(bdev->name) == bdev);
+	TAILQ_REMOVE(&g_ut_kv_bdevs, bdev, internal.link);
+
+	bdev->internal.unregister_cb = cb_fn;
+	bdev->internal.unregister_ctx = cb_arg;
+	rc = bdev->fn_table->destruct(bdev->ctxt);
+	if (rc == 0) {
+		/* The bdev may be gone already. */
+		g_ut_kv_unregistered++;
+		if (cb_fn != NULL) {
+			cb_fn(cb_arg, 0);
+		}
+	}
+}
+
+int
+spdk_bdev_unregister_by_name(const char *bdev_name, struct spdk_bdev_module *module,
+			     spdk_bdev_unregister_cb cb_fn, void *cb_arg)
+{
+	struct spdk_bdev *bdev = spdk_bdev_get_by_name(bdev_name);
+
+	if (bdev == NULL) {
+		return -ENODEV;
+	}
+	if (bdev->module != module) {
+		return -ENODEV;
+	}
+
+	spdk_bdev_unregister(bdev, cb_fn, cb_arg);
+	return 0;
+}
+
+int
+spdk_bdev_open_ext(const char *bdev_name, bool write, spdk_bdev_event_cb_t event_cb,
+		   void *event_ctx, struct spdk_bdev_desc **desc)
+{
+	struct spdk_bdev *bdev = spdk_bdev_get_by_name(bdev_name);
+	struct ut_kv_base *base;
+
+	if (bdev == NULL || bdev->fn_table != NULL) {
+		return -ENODEV;
+	}
+
+	base = SPDK_CONTAINEROF(bdev, struct ut_kv_base, bdev);
+	base->event_cb = event_cb;
+	base->event_ctx = event_ctx;
+	base->open_count++;
+	*desc = (struct spdk_bdev_desc *)base;
+
+	return 0;
+}
+
+void
+spdk_bdev_close(struct spdk_bdev_desc *desc)
+{
+	struct ut_kv_base *base = (struct ut_kv_base *)desc;
+
+	CU_ASSERT(base->open_count > 0);
+	base->open_count--;
+}
+
+struct spdk_bdev *
+spdk_bdev_desc_get_bdev(struct spdk_bdev_desc *desc)
+{
+	return &((struct ut_kv_base *)desc)->bdev;
+}
+
+int
+spdk_bdev_module_claim_bdev(struct spdk_bdev *bdev, struct spdk_bdev_desc *desc,
+			    struct spdk_bdev_module *module)
+{
+	if (bdev->internal.claim_type != SPDK_BDEV_CLAIM_NONE) {
+		return -EPERM;
+	}
+	bdev->internal.claim_type = SPDK_BDEV_CLAIM_EXCL_WRITE;
+	bdev->internal.claim.v1.module = module;
+	return 0;
+}
+
+void
+spdk_bdev_module_release_bdev(struct spdk_bdev *bdev)
+{
+	CU_ASSERT(bdev->internal.claim_type == SPDK_BDEV_CLAIM_EXCL_WRITE);
+	bdev->internal.claim_type = SPDK_BDEV_CLAIM_NONE;
+	bdev->internal.claim.v1.module = NULL;
+}
+
+struct spdk_io_channel *
+spdk_bdev_get_io_channel(struct spdk_bdev_desc *desc)
+{
+	return spdk_get_io_channel(desc);
+}
+
+int
+spdk_bdev_queue_io_wait(struct spdk_bdev *bdev, struct spdk_io_channel *ch,
+			struct spdk_bdev_io_wait_entry *entry)
+{
+	TAILQ_INSERT_TAIL(&g_ut_kv_io_wait, entry, link);
+	return 0;
+}
+
+void
+spdk_bdev_free_io(struct spdk_bdev_io *bdev_io)
+{
+	free(SPDK_CONTAINEROF(bdev_io, struct ut_kv_io, bdev_io));
+}
+
+/* KV commands on base bdevs */
+
+static struct ut_kv_io *
+ut_kv_io_get(struct spdk_bdev_desc *desc, enum spdk_bdev_io_type type, const void *key,
+	     size_t key_len, spdk_bdev_io_completion_cb cb, void *cb_arg)
+{
+	struct ut_kv_base *base = (struct ut_kv_base *)desc;
+	struct ut_kv_io *io;
+
+	if (base->submit_rc != 0) {
+		return NULL;
+	}
+
+	io = calloc(1, sizeof(*io));
+	SPDK_CU_ASSERT_FATAL(io != NULL);
+	SPDK_CU_ASSERT_FATAL(key_len <= NVME_KV_MAX_KEY_LENGTH);
+	io->base = base;
+	io->type = type;
+	io->bdev_io.type = type;
+	io->bdev_io.bdev = &base->bdev;
+	if (key != NULL) {
+		memcpy(io->key, key, key_len);
+		io->key_len = key_len;
+	}
+	io->cb = cb;
+	io->cb_arg = cb_arg;
+	base->num_ios[type]++;
+	TAILQ_INSERT_TAIL(&g_ut_kv_ios, io, link);
+
+	return io;
+}
+
+static int
+ut_kv_io_submit(struct spdk_bdev_desc *desc, enum spdk_bdev_io_type type, const void *key,
+		size_t key_len, struct iovec *iovs, int iovcnt, uint64_t offset, uint64_t nbytes,
+		uint8_t options, uint32_t select_id, spdk_bdev_io_completion_cb cb, void *cb_arg)
+{
+	struct ut_kv_io *io = ut_kv_io_get(desc, type, key, key_len, cb, cb_arg);
+
+	if (io == NULL) {
+		return ((struct ut_kv_base *)desc)->submit_rc;
+	}
+	io->iovs = iovs;
+	io->iovcnt = iovcnt;
+	io->offset = offset;
+	io->nbytes = nbytes;
+	io->options = options;
+	io->select_id = select_id;
+
+	return 0;
+}
+
+static int
+ut_kv_io_submit_buf(struct spdk_bdev_desc *desc, enum spdk_bdev_io_type type, const void *key,
+		    size_t key_len, void *buf, uint64_t offset, uint64_t nbytes, uint8_t options,
+		    uint32_t select_id, spdk_bdev_io_completion_cb cb, void *cb_arg)
+{
+	struct ut_kv_io *io = ut_kv_io_get(desc, type, key, key_len, cb, cb_arg);
+
+	if (io == NULL) {
+		return ((struct ut_kv_base *)desc)->submit_rc;
+	}
+	io->iov.iov_base = buf;
+	io->iov.iov_len = nbytes;
+	io->iovs = &io->iov;
+	io->iovcnt = 1;
+	io->offset = offset;
+	io->nbytes = nbytes;
+	io->options = options;
+	io->select_id = select_id;
+
+	return 0;
+}
+
+static int
+ut_kv_io_submit_batch(struct spdk_bdev_desc *desc, enum spdk_bdev_io_type batch_type,
+		      struct spdk_bdev_kv_batch_entry *entries, uint32_t num_entries,
+		      spdk_bdev_io_completion_cb cb, void *cb_arg)
+{
+	struct ut_kv_io *io = ut_kv_io_get(desc, SPDK_BDEV_IO_KV_BATCH, NULL, 0, cb, cb_arg);
+
+	if (io == NULL) {
+		return ((struct ut_kv_base *)desc)->submit_rc;
+	}
+	io->batch_type = batch_type;
+	io->batch = entries;
+	io->batch_count = num_entries;
+
+	return 0;
+}
+
+int
+spdk_bdev_kv_io_forward(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+			struct spdk_bdev_io *bdev_io, spdk_bdev_io_completion_cb cb, void *cb_arg)
+{
+	if (bdev_io->type == SPDK_BDEV_IO_KV_BATCH) {
+		return ut_kv_io_submit_batch(desc, bdev_io->u.bdev.nvme_kv.batch_type,
+					     bdev_io->u.bdev.nvme_kv.batch,
+					     bdev_io->u.bdev.nvme_kv.batch_count, cb, cb_arg);
+	}
+
+	return ut_kv_io_submit(desc, bdev_io->type, bdev_io->u.bdev.nvme_kv.key,
+			       bdev_io->u.bdev.nvme_kv.key_length, bdev_io->u.bdev.iovs,
+			       bdev_io->u.bdev.iovcnt, bdev_io->u.bdev.nvme_kv.offset,
+			       bdev_io->u.bdev.nvme_kv.buffer_size, bdev_io->u.bdev.nvme_kv.options,
+			       bdev_io->u.bdev.nvme_kv.select_id, cb, cb_arg);
+}
+
+int
+spdk_bdev_kv_store(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+		   unsigned char *key, size_t key_length, void *buf, uint64_t nbytes,
+		   uint8_t options, spdk_bdev_io_completion_cb cb, void *cb_arg)
+{
+	return ut_kv_io_submit_buf(desc, SPDK_BDEV_IO_KV_STORE, key, key_length, buf, 0, nbytes,
+				   options, 0, cb, cb_arg);
+}
+
+int
+spdk_bdev_kv_storev(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+		    unsigned char *key, size_t key_length, struct iovec *iov, int iovcnt,
+		    uint64_t nbytes, uint8_t options, spdk_bdev_io_completion_cb cb, void *cb_arg)
+{
+	return ut_kv_io_submit(desc, SPDK_BDEV_IO_KV_STORE, key, key_length, iov, iovcnt, 0, nbytes,
+			       options, 0, cb, cb_arg);
+}
+
+int
+spdk_bdev_kv_retrieve(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+		      unsigned char *key, size_t key_length, void *buf, uint64_t offset,
+		      uint64_t nbytes, spdk_bdev_io_completion_cb cb, void *cb_arg)
+{
+	return ut_kv_io_submit_buf(desc, SPDK_BDEV_IO_KV_RETRIEVE, key, key_length, buf, offset,
+				   nbytes, 0, 0, cb, cb_arg);
+}
+
+int
+spdk_bdev_kv_retrievev(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+		       unsigned char *key, size_t key_length, struct iovec *iov, int iovcnt,
+		       uint64_t offset, uint64_t nbytes, spdk_bdev_io_completion_cb cb,
+		       void *cb_arg)
+{
+	return ut_kv_io_submit(desc, SPDK_BDEV_IO_KV_RETRIEVE, key, key_length, iov, iovcnt, offset,
+			       nbytes, 0, 0, cb, cb_arg);
+}
+
+int
+spdk_bdev_kv_delete(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+		    unsigned char *key, size_t key_length,
+		    spdk_bdev_io_completion_cb cb, void *cb_arg)
+{
+	return ut_kv_io_submit(desc, SPDK_BDEV_IO_KV_DELETE, key, key_length, NULL, 0, 0, 0, 0, 0,
+			       cb, cb_arg);
+}
+
+int
+spdk_bdev_kv_list(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+		  unsigned char *key, size_t key_length, void *buf, uint64_t nbytes,
+		  spdk_bdev_io_completion_cb cb, void *cb_arg)
+{
+	return ut_kv_io_submit_buf(desc, SPDK_BDEV_IO_KV_LIST, key, key_length, buf, 0, nbytes, 0,
+				   0, cb, cb_arg);
+}
+
+int
+spdk_bdev_kv_retrieve_select(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+			     void *buf, uint64_t offset, uint64_t nbytes, uint32_t select_id,
+			     uint8_t options, spdk_bdev_io_completion_cb cb, void *cb_arg)
+{
+	return ut_kv_io_submit_buf(desc, SPDK_BDEV_IO_KV_RETRIEVE_SELECT, NULL, 0, buf, offset,
+				   nbytes, options, select_id, cb, cb_arg);
+}
+
+int
+spdk_bdev_kv_retrieve_selectv(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+			      struct iovec *iov, int iovcnt, uint64_t offset, uint64_t nbytes,
+			      uint32_t select_id, uint8_t options,
+			      spdk_bdev_io_completion_cb cb, void *cb_arg)
+{
+	return ut_kv_io_submit(desc, SPDK_BDEV_IO_KV_RETRIEVE_SELECT, NULL, 0, iov, iovcnt, offset,
+			       nbytes, options, select_id, cb, cb_arg);
+}
+
+int
+spdk_bdev_kv_mget(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+		  struct spdk_bdev_kv_batch_entry *entries, uint32_t num_entries,
+		  spdk_bdev_io_completion_cb cb, void *cb_arg)
+{
+	return ut_kv_io_submit_batch(desc, SPDK_BDEV_IO_KV_RETRIEVE, entries, num_entries, cb,
+				     cb_arg);
+}
+
+int
+spdk_bdev_kv_mput(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+		  struct spdk_bdev_kv_batch_entry *entries, uint32_t num_entries,
+		  spdk_bdev_io_completion_cb cb, void *cb_arg)
+{
+	return ut_kv_io_submit_batch(desc, SPDK_BDEV_IO_KV_STORE, entries, num_entries, cb, cb_arg);
+}
+
+int
+spdk_bdev_kv_mexist(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+		    struct spdk_bdev_kv_batch_entry *entries, uint32_t num_entries,
+		    spdk_bdev_io_completion_cb cb, void *cb_arg)
+{
+	return ut_kv_io_submit_batch(desc, SPDK_BDEV_IO_KV_EXIST, entries, num_entries, cb, cb_arg);
+}
+
+int
+spdk_bdev_kv_list_iter_open(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+			    const unsigned char *prefix, size_t prefix_length,
+			    uint32_t num_shards, uint32_t first_shard, uint32_t shard_count,
+			    uint32_t queue_depth, spdk_bdev_kv_list_key_cb key_cb,
+			    spdk_bdev_kv_list_done_cb done_cb, void *cb_arg,
+			    struct spdk_bdev_kv_list_iter **_iter)
+{
+	struct ut_kv_base *base = (struct ut_kv_base *)desc;
+	struct spdk_bdev_kv_list_iter *iter;
+
+	if (base->submit_rc != 0) {
+		return base->submit_rc;
+	}
+
+	iter = calloc(1, sizeof(*iter));
+	SPDK_CU_ASSERT_FATAL(iter != NULL);
+	iter->base = base;
+	iter->key_cb = key_cb;
+	iter->done_cb = done_cb;
+	iter->cb_arg = cb_arg;
+	TAILQ_INSERT_TAIL(&g_ut_kv_iters, iter, link);
+	*_iter = iter;
+
+	return 0;
+}
+
+void
+spdk_bdev_kv_list_iter_close(struct spdk_bdev_kv_list_iter *iter)
+{
+	iter->closed = true;
+}
+
+int
+spdk_bdev_flush_blocks(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+		       uint64_t offset_blocks, uint64_t num_blocks, spdk_bdev_io_completion_cb cb,
+		       void *cb_arg)
+{
+	struct ut_kv_io *io = ut_kv_io_get(desc, SPDK_BDEV_IO_TYPE_FLUSH, NULL, 0, cb, cb_arg);
+
+	if (io == NULL) {
+		return ((struct ut_kv_base *)desc)->submit_rc;
+	}
+
+	return 0;
+}
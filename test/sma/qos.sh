@@ -97,7 +97,10 @@ diff <(rpc_cmd bdev_get_bdevs -b null0 | jq --sort-keys '.[].assigned_rate_limit
 		  "rw_ios_per_sec": 1000,
 		  "rw_mbytes_per_sec": 0,
 		  "r_mbytes_per_sec": 0,
-		  "w_mbytes_per_sec": 0
+		  "w_mbytes_per_sec": 0,
+		  "kv_ops_per_sec": 0,
+		  "kv_mbytes_per_sec": 0,
+		  "kv_max_selects": 0
 		}
 	EOF
 )
@@ -122,7 +125,10 @@ diff <(rpc_cmd bdev_get_bdevs -b null0 | jq --sort-keys '.[].assigned_rate_limit
 		  "rw_ios_per_sec": 2000,
 		  "rw_mbytes_per_sec": 0,
 		  "r_mbytes_per_sec": 8,
-		  "w_mbytes_per_sec": 0
+		  "w_mbytes_per_sec": 0,
+		  "kv_ops_per_sec": 0,
+		  "kv_mbytes_per_sec": 0,
+		  "kv_max_selects": 0
 		}
 	EOF
 )
@@ -148,7 +154,10 @@ diff <(rpc_cmd bdev_get_bdevs -b null0 | jq --sort-keys '.[].assigned_rate_limit
 		  "rw_ios_per_sec": 2000,
 		  "rw_mbytes_per_sec": 6,
 		  "r_mbytes_per_sec": 8,
-		  "w_mbytes_per_sec": 0
+		  "w_mbytes_per_sec": 0,
+		  "kv_ops_per_sec": 0,
+		  "kv_mbytes_per_sec": 0,
+		  "kv_max_selects": 0
 		}
 	EOF
 )
@@ -233,7 +242,10 @@ diff <(rpc_cmd bdev_get_bdevs -b null0 | jq --sort-keys '.[].assigned_rate_limit
 		  "rw_ios_per_sec": 2000,
 		  "rw_mbytes_per_sec": 6,
 		  "r_mbytes_per_sec": 8,
-		  "w_mbytes_per_sec": 0
+		  "w_mbytes_per_sec": 0,
+		  "kv_ops_per_sec": 0,
+		  "kv_mbytes_per_sec": 0,
+		  "kv_max_selects": 0
 		}
 	EOF
 )
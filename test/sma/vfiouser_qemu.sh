@@ -362,7 +362,10 @@ diff <(rpc_cmd bdev_get_bdevs -b null0 | jq --sort-keys '.[].assigned_rate_limit
 		  "rw_ios_per_sec": 3000,
 		  "rw_mbytes_per_sec": 6,
 		  "r_mbytes_per_sec": 4,
-		  "w_mbytes_per_sec": 5
+		  "w_mbytes_per_sec": 5,
+		  "kv_ops_per_sec": 0,
+		  "kv_mbytes_per_sec": 0,
+		  "kv_max_selects": 0
 		}
 	EOF
 )
@@ -257,7 +257,10 @@ diff <(rpc_cmd bdev_get_bdevs -b null32 | jq --sort-keys '.[].assigned_rate_limi
 		  "rw_ios_per_sec": 3000,
 		  "rw_mbytes_per_sec": 6,
 		  "r_mbytes_per_sec": 4,
-		  "w_mbytes_per_sec": 5
+		  "w_mbytes_per_sec": 5,
+		  "kv_ops_per_sec": 0,
+		  "kv_mbytes_per_sec": 0,
+		  "kv_max_selects": 0
 		}
 	EOF
 )
@@ -288,7 +291,10 @@ diff <(rpc_cmd bdev_get_bdevs -b null32 | jq --sort-keys '.[].assigned_rate_limi
 		  "rw_ios_per_sec": 4000,
 		  "rw_mbytes_per_sec": 7,
 		  "r_mbytes_per_sec": 5,
-		  "w_mbytes_per_sec": 6
+		  "w_mbytes_per_sec": 6,
+		  "kv_ops_per_sec": 0,
+		  "kv_mbytes_per_sec": 0,
+		  "kv_max_selects": 0
 		}
 	EOF
 )
@@ -338,7 +344,10 @@ diff <(rpc_cmd bdev_get_bdevs -b null32 | jq --sort-keys '.[].assigned_rate_limi
 		  "rw_ios_per_sec": 4000,
 		  "rw_mbytes_per_sec": 7,
 		  "r_mbytes_per_sec": 5,
-		  "w_mbytes_per_sec": 6
+		  "w_mbytes_per_sec": 6,
+		  "kv_ops_per_sec": 0,
+		  "kv_mbytes_per_sec": 0,
+		  "kv_max_selects": 0
 		}
 	EOF
 )
@@ -14,6 +14,7 @@
 #undef SPDK_CONFIG_VTUNE
 
 #include "bdev/bdev.c"
+#include "bdev/bdev_kv.c"
 
 DEFINE_STUB(spdk_notify_send, uint64_t, (const char *type, const char *ctx), 0);
 DEFINE_STUB(spdk_notify_type_register, struct spdk_notify_type *, (const char *type), NULL);
@@ -683,6 +684,181 @@ get_device_stat_test(void)
 	free_bdev(bdev);
 }
 
+static void
+bdev_kv_io_stat(void)
+{
+	struct spdk_bdev bdev = {};
+	struct spdk_bdev_channel ch = {};
+	struct spdk_bdev_io bdev_io = {};
+	struct spdk_bdev_kv_batch_entry entries[3] = {};
+	struct spdk_bdev_io_stat *stat, *total;
+	struct spdk_bdev_kv_op_stat *op;
+
+	stat = bdev_alloc_io_stat(false);
+	total = bdev_alloc_io_stat(false);
+	SPDK_CU_ASSERT_FATAL(stat != NULL);
+	SPDK_CU_ASSERT_FATAL(total != NULL);
+
+	ch.stat = stat;
+	bdev_io.bdev = &bdev;
+	bdev_io.internal.ch = &ch;
+	bdev_io.internal.status = SPDK_BDEV_IO_STATUS_SUCCESS;
+
+	bdev_io.type = SPDK_BDEV_IO_KV_STORE;
+	bdev_io.u.bdev.nvme_kv.buffer_size = 4096;
+	bdev_io_update_io_stat(&bdev_io, 100);
+	CU_ASSERT(stat->bytes_kv_stored == 4096);
+
+	/* 3000 byte value read from offset 1000 into a 4096 byte buffer */
+	bdev_io.type = SPDK_BDEV_IO_KV_RETRIEVE;
+	bdev_io.u.bdev.nvme_kv.offset = 1000;
+	bdev_io.internal.error.nvme.cdw0 = 3000;
+	bdev_io_update_io_stat(&bdev_io, 300);
+	CU_ASSERT(stat->bytes_kv_retrieved == 2000);
+
+	/* Offset past the end of the value returns nothing */
+	bdev_io.u.bdev.nvme_kv.offset = 4000;
+	bdev_io_update_io_stat(&bdev_io, 200);
+	CU_ASSERT(stat->bytes_kv_retrieved == 2000);
+	op = &stat->kv_ops[SPDK_BDEV_KV_STAT_RETRIEVE];
+	CU_ASSERT(op->num_ops == 2);
+	CU_ASSERT(op->latency_ticks == 500);
+	CU_ASSERT(op->max_latency_ticks == 300);
+	CU_ASSERT(op->min_latency_ticks == 200);
+
+	bdev_io.type = SPDK_BDEV_IO_KV_RETRIEVE_SELECT;
+	bdev_io.u.bdev.nvme_kv.offset = 0;
+	bdev_io.u.bdev.nvme_kv.buffer_size = 512;
+	bdev_io_update_io_stat(&bdev_io, 10);
+	CU_ASSERT(stat->bytes_select_returned == 512);
+	CU_ASSERT(stat->kv_ops[SPDK_BDEV_KV_STAT_RETRIEVE_SELECT].num_ops == 1);
+
+	/* Only the keys of a batch that succeeded are counted */
+	entries[0].nbytes = 100;
+	entries[1].nbytes = 200;
+	entries[1].sc = SPDK_NVME_SC_KEY_EXISTS;
+	entries[2].nbytes = 300;
+	bdev_io.type = SPDK_BDEV_IO_KV_BATCH;
+	bdev_io.u.bdev.nvme_kv.batch_type = SPDK_BDEV_IO_KV_STORE;
+	bdev_io.u.bdev.nvme_kv.batch = entries;
+	bdev_io.u.bdev.nvme_kv.batch_count = 3;
+	bdev_io_update_io_stat(&bdev_io, 50);
+	op = &stat->kv_ops[SPDK_BDEV_KV_STAT_STORE];
+	CU_ASSERT(stat->bytes_kv_stored == 4096 + 400);
+	CU_ASSERT(op->num_ops == 3);
+	CU_ASSERT(op->min_latency_ticks == 50);
+	CU_ASSERT(op->max_latency_ticks == 100);
+
+	/* KV I/O does not show up in the block counters */
+	CU_ASSERT(stat->num_read_ops == 0);
+	CU_ASSERT(stat->num_write_ops == 0);
+
+	spdk_bdev_add_io_stat(total, stat);
+	CU_ASSERT(total->bytes_kv_stored == 4496);
+	CU_ASSERT(total->bytes_kv_retrieved == 2000);
+	CU_ASSERT(total->bytes_select_returned == 512);
+	CU_ASSERT(total->kv_ops[SPDK_BDEV_KV_STAT_STORE].num_ops == 3);
+	CU_ASSERT(total->kv_ops[SPDK_BDEV_KV_STAT_RETRIEVE].min_latency_ticks == 200);
+	CU_ASSERT(total->kv_ops[SPDK_BDEV_KV_STAT_EXIST].min_latency_ticks == UINT64_MAX);
+
+	spdk_bdev_reset_io_stat(stat, SPDK_BDEV_RESET_STAT_MAXMIN);
+	CU_ASSERT(stat->kv_ops[SPDK_BDEV_KV_STAT_STORE].num_ops == 3);
+	CU_ASSERT(stat->kv_ops[SPDK_BDEV_KV_STAT_STORE].max_latency_ticks == 0);
+	CU_ASSERT(stat->kv_ops[SPDK_BDEV_KV_STAT_STORE].min_latency_ticks == UINT64_MAX);
+
+	spdk_bdev_reset_io_stat(stat, SPDK_BDEV_RESET_STAT_ALL);
+	CU_ASSERT(stat->bytes_kv_stored == 0);
+	CU_ASSERT(stat->kv_ops[SPDK_BDEV_KV_STAT_STORE].num_ops == 0);
+	CU_ASSERT(stat->kv_ops[SPDK_BDEV_KV_STAT_STORE].latency_ticks == 0);
+
+	bdev_free_io_stat(stat);
+	bdev_free_io_stat(total);
+}
+
+static void
+bdev_kv_qos(void)
+{
+	struct spdk_bdev bdev = {};
+	struct spdk_bdev_qos qos = {};
+	struct spdk_bdev_io bdev_io = {}, select_io = {};
+	struct spdk_bdev_kv_batch_entry entries[3] = {};
+	struct spdk_bdev_qos_limit *kv_ops, *kv_bps, *rw_ios;
+	int i;
+
+	for (i = 0; i < SPDK_BDEV_QOS_NUM_RATE_LIMIT_TYPES; i++) {
+		qos.rate_limits[i].limit = SPDK_BDEV_QOS_LIMIT_NOT_DEFINED;
+		qos.rate_limits[i].min_per_timeslice = bdev_qos_is_iops_rate_limit(i) ?
+						       SPDK_BDEV_QOS_MIN_IO_PER_TIMESLICE :
+						       SPDK_BDEV_QOS_MIN_BYTE_PER_TIMESLICE;
+	}
+	rw_ios = &qos.rate_limits[SPDK_BDEV_QOS_RW_IOPS_RATE_LIMIT];
+	kv_ops = &qos.rate_limits[SPDK_BDEV_QOS_KV_OPS_RATE_LIMIT];
+	kv_bps = &qos.rate_limits[SPDK_BDEV_QOS_KV_BPS_RATE_LIMIT];
+	rw_ios->limit = 1000;
+	kv_ops->limit = 10000;
+	kv_bps->limit = 1024 * 1024;
+	qos.rate_limits[SPDK_BDEV_QOS_KV_SELECTS_LIMIT].limit = 1;
+	bdev_qos_update_max_quota_per_timeslice(&qos);
+	CU_ASSERT(rw_ios->remaining_this_timeslice == 1);
+	CU_ASSERT(kv_ops->remaining_this_timeslice == 10);
+	CU_ASSERT(kv_bps->remaining_this_timeslice == 1048);
+	CU_ASSERT(qos.rate_limits[SPDK_BDEV_QOS_KV_SELECTS_LIMIT].max_per_timeslice == 0);
+
+	bdev_io.bdev = &bdev;
+	select_io.bdev = &bdev;
+
+	/* KV commands count against the KV limits only */
+	bdev_io.type = SPDK_BDEV_IO_KV_STORE;
+	bdev_io.u.bdev.nvme_kv.buffer_size = 1000;
+	CU_ASSERT(bdev_qos_queue_io(&qos, &bdev_io) == false);
+	CU_ASSERT(bdev_qos_queue_io(&qos, &bdev_io) == false);
+	CU_ASSERT(kv_ops->remaining_this_timeslice == 8);
+	CU_ASSERT(kv_bps->remaining_this_timeslice == 1048 - 2000);
+	CU_ASSERT(rw_ios->remaining_this_timeslice == 1);
+
+	/* Out of KV bytes, but block I/O still goes through */
+	bdev_io.type = SPDK_BDEV_IO_KV_EXIST;
+	CU_ASSERT(bdev_qos_queue_io(&qos, &bdev_io) == true);
+	bdev_io.type = SPDK_BDEV_IO_TYPE_READ;
+	CU_ASSERT(bdev_qos_queue_io(&qos, &bdev_io) == false);
+	CU_ASSERT(rw_ios->remaining_this_timeslice == 0);
+	CU_ASSERT(kv_ops->remaining_this_timeslice == 8);
+
+	/* Each key of a batch is one operation */
+	kv_bps->remaining_this_timeslice = 1048;
+	entries[0].nbytes = 100;
+	entries[1].nbytes = 200;
+	entries[2].nbytes = 300;
+	bdev_io.type = SPDK_BDEV_IO_KV_BATCH;
+	bdev_io.u.bdev.nvme_kv.batch_type = SPDK_BDEV_IO_KV_STORE;
+	bdev_io.u.bdev.nvme_kv.batch = entries;
+	bdev_io.u.bdev.nvme_kv.batch_count = 3;
+	CU_ASSERT(bdev_qos_queue_io(&qos, &bdev_io) == false);
+	CU_ASSERT(kv_ops->remaining_this_timeslice == 5);
+	CU_ASSERT(kv_bps->remaining_this_timeslice == 1048 - 600);
+
+	/* Only one SELECT in flight */
+	select_io.type = SPDK_BDEV_IO_KV_SEND_SELECT;
+	select_io.u.bdev.nvme_kv.buffer_size = 16;
+	bdev_io.type = SPDK_BDEV_IO_KV_SEND_SELECT;
+	bdev_io.u.bdev.nvme_kv.buffer_size = 16;
+	CU_ASSERT(bdev_qos_queue_io(&qos, &select_io) == false);
+	CU_ASSERT(select_io.internal.qos_kv_select == true);
+	CU_ASSERT(bdev.internal.qos_kv_selects_outstanding == 1);
+	CU_ASSERT(bdev_qos_queue_io(&qos, &bdev_io) == true);
+
+	/* Other KV commands are not held back by the SELECT in flight */
+	bdev_io.type = SPDK_BDEV_IO_KV_RETRIEVE;
+	CU_ASSERT(bdev_qos_queue_io(&qos, &bdev_io) == false);
+
+	bdev_qos_kv_select_done(&select_io);
+	CU_ASSERT(select_io.internal.qos_kv_select == false);
+	CU_ASSERT(bdev.internal.qos_kv_selects_outstanding == 0);
+	bdev_io.type = SPDK_BDEV_IO_KV_SEND_SELECT;
+	CU_ASSERT(bdev_qos_queue_io(&qos, &bdev_io) == false);
+	CU_ASSERT(bdev.internal.qos_kv_selects_outstanding == 1);
+}
+
 static void
 open_write_test(void)
 {
@@ -6060,6 +6236,991 @@ bdev_seek_test(void)
 	ut_fini_bdev();
 }
 
+static void
+bdev_kv_retrieve_cb(struct spdk_bdev_io *bdev_io, bool success, void *cb_arg)
+{
+	struct spdk_bdev_io **done_io = cb_arg;
+
+	g_io_done = true;
+	g_io_status = bdev_io->internal.status;
+	*done_io = bdev_io;
+}
+
+/* Complete the outstanding KV RETRIEVE from value, the way a KV device would. */
+static void
+ut_kv_complete_retrieve(const char *value, uint32_t value_len, uint32_t exp_offset,
+			uint32_t exp_len)
+{
+	struct bdev_ut_channel *ch = g_bdev_ut_channel;
+	struct spdk_bdev_io *bdev_io;
+	uint32_t offset;
+
+	bdev_io = TAILQ_FIRST(&ch->outstanding_io);
+	SPDK_CU_ASSERT_FATAL(bdev_io != NULL);
+	TAILQ_REMOVE(&ch->outstanding_io, bdev_io, module_link);
+	ch->outstanding_io_count--;
+
+	CU_ASSERT(bdev_io->type == SPDK_BDEV_IO_KV_RETRIEVE);
+	CU_ASSERT(bdev_io->u.bdev.iovcnt == 1);
+	CU_ASSERT(bdev_io->u.bdev.iovs[0].iov_base != NULL);
+	CU_ASSERT(bdev_io->u.bdev.iovs[0].iov_len == exp_len);
+	CU_ASSERT(bdev_io->u.bdev.nvme_kv.buffer_size == exp_len);
+	offset = bdev_io->u.bdev.nvme_kv.offset;
+	CU_ASSERT(offset == exp_offset);
+
+	if (value == NULL) {
+		spdk_bdev_io_complete_nvme_status(bdev_io, 0, SPDK_NVME_SCT_COMMAND_SPECIFIC,
+						  SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+		return;
+	}
+	if (offset < value_len) {
+		spdk_copy_buf_to_iovs(bdev_io->u.bdev.iovs, 1, (void *)(value + offset),
+				      spdk_min(value_len - offset, exp_len));
+	}
+	spdk_bdev_io_complete_nvme_status(bdev_io, value_len, SPDK_NVME_SCT_GENERIC,
+					  SPDK_NVME_SC_SUCCESS);
+}
+
+static void
+bdev_kv_retrieve_alloc_buf(void)
+{
+	struct spdk_bdev *bdev;
+	struct spdk_bdev_desc *desc = NULL;
+	struct spdk_io_channel *io_ch;
+	struct spdk_bdev_io *bdev_io = NULL;
+	struct spdk_iobuf_opts iobuf_opts;
+	unsigned char key[] = "key0";
+	uint32_t value_len, max_len, cdw0, i;
+	char *value;
+	int sct, sc, rc;
+
+	ut_init_bdev(NULL);
+	poll_threads();
+
+	bdev = allocate_bdev("bdev0");
+
+	rc = spdk_bdev_open_ext("bdev0", true, bdev_ut_event_cb, NULL, &desc);
+	CU_ASSERT(rc == 0);
+	SPDK_CU_ASSERT_FATAL(desc != NULL);
+	io_ch = spdk_bdev_get_io_channel(desc);
+	CU_ASSERT(io_ch != NULL);
+
+	spdk_iobuf_get_opts(&iobuf_opts);
+	max_len = iobuf_opts.large_bufsize;
+	value = malloc(2 * max_len);
+	SPDK_CU_ASSERT_FATAL(value != NULL);
+	for (i = 0; i < 2 * max_len; i++) {
+		value[i] = (char)i;
+	}
+
+	/* A value within the default size needs one read */
+	g_io_done = false;
+	rc = spdk_bdev_kv_retrieve(desc, io_ch, key, sizeof(key), NULL, 0, 0, bdev_kv_retrieve_cb,
+				   &bdev_io);
+	CU_ASSERT(rc == 0);
+	CU_ASSERT(g_bdev_ut_channel->outstanding_io_count == 1);
+	ut_kv_complete_retrieve(value, 100, 0, SPDK_BDEV_KV_RETRIEVE_DEFAULT_SIZE);
+	CU_ASSERT(g_io_done == true);
+	CU_ASSERT(g_io_status == SPDK_BDEV_IO_STATUS_SUCCESS);
+	spdk_bdev_io_get_nvme_status(bdev_io, &cdw0, &sct, &sc);
+	CU_ASSERT(cdw0 == 100);
+	CU_ASSERT(memcmp(bdev_io->u.bdev.iovs[0].iov_base, value, 100) == 0);
+	CU_ASSERT(bdev_io->internal.buf != NULL);
+	spdk_bdev_free_io(bdev_io);
+
+	/* A longer value is read again, whole, into a buffer of its size */
+	value_len = 3 * SPDK_BDEV_KV_RETRIEVE_DEFAULT_SIZE;
+	g_io_done = false;
+	rc = spdk_bdev_kv_retrieve(desc, io_ch, key, sizeof(key), NULL, 0, 0, bdev_kv_retrieve_cb,
+				   &bdev_io);
+	CU_ASSERT(rc == 0);
+	ut_kv_complete_retrieve(value, value_len, 0, SPDK_BDEV_KV_RETRIEVE_DEFAULT_SIZE);
+	CU_ASSERT(g_io_done == false);
+	CU_ASSERT(g_bdev_ut_channel->outstanding_io_count == 1);
+	ut_kv_complete_retrieve(value, value_len, 0, value_len);
+	CU_ASSERT(g_io_done == true);
+	CU_ASSERT(g_io_status == SPDK_BDEV_IO_STATUS_SUCCESS);
+	spdk_bdev_io_get_nvme_status(bdev_io, &cdw0, &sct, &sc);
+	CU_ASSERT(cdw0 == value_len);
+	CU_ASSERT(bdev_io->u.bdev.iovs[0].iov_len == value_len);
+	CU_ASSERT(memcmp(bdev_io->u.bdev.iovs[0].iov_base, value, value_len) == 0);
+	spdk_bdev_free_io(bdev_io);
+
+	/* The size hint and the offset are honored, through the vectored call as well */
+	g_io_done = false;
+	rc = spdk_bdev_kv_retrievev(desc, io_ch, key, sizeof(key), NULL, 0, 1000, 2000,
+				    bdev_kv_retrieve_cb, &bdev_io);
+	CU_ASSERT(rc == 0);
+	ut_kv_complete_retrieve(value, value_len, 1000, 2000);
+	ut_kv_complete_retrieve(value, value_len, 1000, value_len - 1000);
+	CU_ASSERT(g_io_done == true);
+	CU_ASSERT(memcmp(bdev_io->u.bdev.iovs[0].iov_base, value + 1000, value_len - 1000) == 0);
+	spdk_bdev_free_io(bdev_io);
+
+	/* A value larger than an iobuf buffer is truncated, with its full length reported */
+	value_len = 2 * max_len;
+	g_io_done = false;
+	rc = spdk_bdev_kv_retrieve(desc, io_ch, key, sizeof(key), NULL, 0, 0, bdev_kv_retrieve_cb,
+				   &bdev_io);
+	CU_ASSERT(rc == 0);
+	ut_kv_complete_retrieve(value, value_len, 0, SPDK_BDEV_KV_RETRIEVE_DEFAULT_SIZE);
+	ut_kv_complete_retrieve(value, value_len, 0, max_len);
+	CU_ASSERT(g_io_done == true);
+	CU_ASSERT(g_bdev_ut_channel->outstanding_io_count == 0);
+	spdk_bdev_io_get_nvme_status(bdev_io, &cdw0, &sct, &sc);
+	CU_ASSERT(cdw0 == value_len);
+	CU_ASSERT(memcmp(bdev_io->u.bdev.iovs[0].iov_base, value, max_len) == 0);
+	spdk_bdev_free_io(bdev_io);
+
+	/* A failed read completes with its NVMe status */
+	g_io_done = false;
+	rc = spdk_bdev_kv_retrieve(desc, io_ch, key, sizeof(key), NULL, 0, 0, bdev_kv_retrieve_cb,
+				   &bdev_io);
+	CU_ASSERT(rc == 0);
+	ut_kv_complete_retrieve(NULL, 0, 0, SPDK_BDEV_KV_RETRIEVE_DEFAULT_SIZE);
+	CU_ASSERT(g_io_done == true);
+	CU_ASSERT(g_io_status == SPDK_BDEV_IO_STATUS_NVME_ERROR);
+	spdk_bdev_io_get_nvme_status(bdev_io, &cdw0, &sct, &sc);
+	CU_ASSERT(sct == SPDK_NVME_SCT_COMMAND_SPECIFIC);
+	CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+	spdk_bdev_free_io(bdev_io);
+
+	free(value);
+	spdk_put_io_channel(io_ch);
+	spdk_bdev_close(desc);
+	free_bdev(bdev);
+	ut_fini_bdev();
+}
+
+static void
+bdev_kv_ext_bounce_buffer(void)
+{
+	struct spdk_bdev *bdev;
+	struct spdk_bdev_desc *desc = NULL;
+	struct spdk_io_channel *io_ch;
+	char io_buf[3000];
+	struct iovec iov = { .iov_base = io_buf, .iov_len = sizeof(io_buf) };
+	struct ut_expected_io *expected_io;
+	struct spdk_bdev_ext_io_opts ext_io_opts = {
+		.memory_domain = (struct spdk_memory_domain *)0xdeadbeef,
+		.size = sizeof(ext_io_opts)
+	};
+	unsigned char key[] = "key0";
+	int rc;
+
+	ut_init_bdev(NULL);
+
+	bdev = allocate_bdev("bdev0");
+
+	rc = spdk_bdev_open_ext("bdev0", true, bdev_ut_event_cb, NULL, &desc);
+	CU_ASSERT(rc == 0);
+	SPDK_CU_ASSERT_FATAL(desc != NULL);
+	io_ch = spdk_bdev_get_io_channel(desc);
+	CU_ASSERT(io_ch != NULL);
+
+	/* bdev doesn't support memory domains, so the value goes through a bounce buffer
+	 * sized by the KV buffer size rather than by blocks */
+	g_memory_domain_pull_data_called = false;
+	g_io_done = false;
+	expected_io = ut_alloc_expected_io(SPDK_BDEV_IO_KV_STORE, 0, 0, 0);
+	expected_io->ext_io_opts = &ext_io_opts;
+	expected_io->copy_opts = true;
+	TAILQ_INSERT_TAIL(&g_bdev_ut_channel->expected_io, expected_io, link);
+
+	rc = spdk_bdev_kv_storev_ext(desc, io_ch, key, sizeof(key), &iov, 1, sizeof(io_buf), 0,
+				     io_done, NULL, &ext_io_opts);
+	CU_ASSERT(rc == 0);
+	CU_ASSERT(g_memory_domain_pull_data_called == true);
+	CU_ASSERT(g_bdev_ut_channel->outstanding_io_count == 1);
+	CU_ASSERT(g_bdev_io->u.bdev.iovcnt == 1);
+	CU_ASSERT(g_bdev_io->u.bdev.iovs[0].iov_base != io_buf);
+	CU_ASSERT(g_bdev_io->u.bdev.iovs[0].iov_len == sizeof(io_buf));
+	stub_complete_io(1);
+	CU_ASSERT(g_io_done == true);
+
+	g_memory_domain_push_data_called = false;
+	g_io_done = false;
+	expected_io = ut_alloc_expected_io(SPDK_BDEV_IO_KV_RETRIEVE, 0, 0, 0);
+	expected_io->ext_io_opts = &ext_io_opts;
+	expected_io->copy_opts = true;
+	TAILQ_INSERT_TAIL(&g_bdev_ut_channel->expected_io, expected_io, link);
+
+	rc = spdk_bdev_kv_retrievev_ext(desc, io_ch, key, sizeof(key), &iov, 1, 0, sizeof(io_buf),
+					io_done, NULL, &ext_io_opts);
+	CU_ASSERT(rc == 0);
+	CU_ASSERT(g_memory_domain_push_data_called == false);
+	CU_ASSERT(g_bdev_io->u.bdev.iovs[0].iov_len == sizeof(io_buf));
+	stub_complete_io(1);
+	CU_ASSERT(g_memory_domain_push_data_called == true);
+	CU_ASSERT(g_io_done == true);
+
+	/* KV commands carry no metadata */
+	ext_io_opts.metadata = (void *)0xFF000000;
+	rc = spdk_bdev_kv_storev_ext(desc, io_ch, key, sizeof(key), &iov, 1, sizeof(io_buf), 0,
+				     io_done, NULL, &ext_io_opts);
+	CU_ASSERT(rc == -EINVAL);
+
+	spdk_put_io_channel(io_ch);
+	spdk_bdev_close(desc);
+	free_bdev(bdev);
+	ut_fini_bdev();
+}
+
+static void
+bdev_kv_batch(void)
+{
+	struct spdk_bdev *bdev;
+	struct spdk_bdev_desc *desc = NULL, *ro_desc = NULL;
+	struct spdk_io_channel *io_ch;
+	struct spdk_bdev_kv_batch_entry entries[3] = {};
+	struct spdk_bdev_io *bdev_io;
+	uint32_t i;
+	int rc;
+
+	ut_init_bdev(NULL);
+	poll_threads();
+
+	bdev = allocate_bdev("bdev0");
+
+	rc = spdk_bdev_open_ext("bdev0", true, bdev_ut_event_cb, NULL, &desc);
+	CU_ASSERT(rc == 0);
+	SPDK_CU_ASSERT_FATAL(desc != NULL);
+	rc = spdk_bdev_open_ext("bdev0", false, bdev_ut_event_cb, NULL, &ro_desc);
+	CU_ASSERT(rc == 0);
+	SPDK_CU_ASSERT_FATAL(ro_desc != NULL);
+	io_ch = spdk_bdev_get_io_channel(desc);
+	CU_ASSERT(io_ch != NULL);
+
+	for (i = 0; i < SPDK_COUNTOF(entries); i++) {
+		snprintf((char *)entries[i].key, sizeof(entries[i].key), "key%u", i);
+		entries[i].key_length = 4;
+	}
+
+	/* Empty batches and bad keys are rejected */
+	rc = spdk_bdev_kv_mget(desc, io_ch, entries, 0, io_done, NULL);
+	CU_ASSERT(rc == -EINVAL);
+	rc = spdk_bdev_kv_mget(desc, io_ch, NULL, 1, io_done, NULL);
+	CU_ASSERT(rc == -EINVAL);
+	entries[1].key_length = 0;
+	rc = spdk_bdev_kv_mexist(desc, io_ch, entries, 3, io_done, NULL);
+	CU_ASSERT(rc == -EINVAL);
+	entries[1].key_length = NVME_KV_MAX_KEY_LENGTH + 1;
+	rc = spdk_bdev_kv_mexist(desc, io_ch, entries, 3, io_done, NULL);
+	CU_ASSERT(rc == -EINVAL);
+	entries[1].key_length = 4;
+
+	/* Stores need a descriptor open for writing */
+	ut_enable_io_type(SPDK_BDEV_IO_KV_BATCH, true);
+	rc = spdk_bdev_kv_mput(ro_desc, io_ch, entries, 3, io_done, NULL);
+	CU_ASSERT(rc == -EBADF);
+
+	/* A bdev that cannot batch refuses the request */
+	ut_enable_io_type(SPDK_BDEV_IO_KV_BATCH, false);
+	rc = spdk_bdev_kv_mget(desc, io_ch, entries, 3, io_done, NULL);
+	CU_ASSERT(rc == -ENOTSUP);
+	CU_ASSERT(g_bdev_ut_channel->outstanding_io_count == 0);
+	ut_enable_io_type(SPDK_BDEV_IO_KV_BATCH, true);
+
+	/* Each call submits a single bdev_io carrying the whole batch */
+	g_io_done = false;
+	rc = spdk_bdev_kv_mget(desc, io_ch, entries, 3, io_done, NULL);
+	CU_ASSERT(rc == 0);
+	CU_ASSERT(g_bdev_ut_channel->outstanding_io_count == 1);
+	bdev_io = TAILQ_FIRST(&g_bdev_ut_channel->outstanding_io);
+	SPDK_CU_ASSERT_FATAL(bdev_io != NULL);
+	CU_ASSERT(bdev_io->type == SPDK_BDEV_IO_KV_BATCH);
+	CU_ASSERT(bdev_io->u.bdev.nvme_kv.batch == entries);
+	CU_ASSERT(bdev_io->u.bdev.nvme_kv.batch_count == 3);
+	CU_ASSERT(bdev_io->u.bdev.nvme_kv.batch_type == SPDK_BDEV_IO_KV_RETRIEVE);
+	stub_complete_io(1);
+	CU_ASSERT(g_io_done == true);
+	CU_ASSERT(g_io_status == SPDK_BDEV_IO_STATUS_SUCCESS);
+
+	g_io_done = false;
+	rc = spdk_bdev_kv_mput(desc, io_ch, entries, 2, io_done, NULL);
+	CU_ASSERT(rc == 0);
+	bdev_io = TAILQ_FIRST(&g_bdev_ut_channel->outstanding_io);
+	SPDK_CU_ASSERT_FATAL(bdev_io != NULL);
+	CU_ASSERT(bdev_io->type == SPDK_BDEV_IO_KV_BATCH);
+	CU_ASSERT(bdev_io->u.bdev.nvme_kv.batch_count == 2);
+	CU_ASSERT(bdev_io->u.bdev.nvme_kv.batch_type == SPDK_BDEV_IO_KV_STORE);
+	stub_complete_io(1);
+	CU_ASSERT(g_io_done == true);
+
+	/* A failed batch is completed with the status the module reported */
+	g_io_done = false;
+	g_io_exp_status = SPDK_BDEV_IO_STATUS_FAILED;
+	rc = spdk_bdev_kv_mexist(ro_desc, io_ch, entries, 3, io_done, NULL);
+	CU_ASSERT(rc == 0);
+	bdev_io = TAILQ_FIRST(&g_bdev_ut_channel->outstanding_io);
+	SPDK_CU_ASSERT_FATAL(bdev_io != NULL);
+	CU_ASSERT(bdev_io->u.bdev.nvme_kv.batch_type == SPDK_BDEV_IO_KV_EXIST);
+	stub_complete_io(1);
+	CU_ASSERT(g_io_done == true);
+	CU_ASSERT(g_io_status == SPDK_BDEV_IO_STATUS_FAILED);
+	g_io_exp_status = SPDK_BDEV_IO_STATUS_SUCCESS;
+
+	ut_enable_io_type(SPDK_BDEV_IO_KV_BATCH, false);
+	spdk_put_io_channel(io_ch);
+	spdk_bdev_close(ro_desc);
+	spdk_bdev_close(desc);
+	free_bdev(bdev);
+	ut_fini_bdev();
+}
+
+struct ut_kv_cursor_ctx {
+	uint64_t offsets[16];
+	uint32_t lens[16];
+	uint32_t num_chunks;
+	bool data_ok;
+	bool done;
+	int status;
+	uint64_t total_len;
+};
+
+static int
+ut_kv_cursor_chunk(void *cb_arg, const void *buf, uint32_t len, uint64_t offset)
+{
+	struct ut_kv_cursor_ctx *ctx = cb_arg;
+	const uint8_t *data = buf;
+	uint32_t i;
+
+	SPDK_CU_ASSERT_FATAL(ctx->num_chunks < SPDK_COUNTOF(ctx->offsets));
+	ctx->offsets[ctx->num_chunks] = offset;
+	ctx->lens[ctx->num_chunks] = len;
+	ctx->num_chunks++;
+	for (i = 0; i < len; i++) {
+		if (data[i] != (uint8_t)(offset + i)) {
+			ctx->data_ok = false;
+		}
+	}
+	return 0;
+}
+
+static void
+ut_kv_cursor_done(void *cb_arg, int status, uint64_t total_len)
+{
+	struct ut_kv_cursor_ctx *ctx = cb_arg;
+
+	CU_ASSERT(ctx->done == false);
+	ctx->done = true;
+	ctx->status = status;
+	ctx->total_len = total_len;
+}
+
+/* Complete the outstanding retrieve select at offset with a result set of total bytes. */
+static void
+ut_kv_complete_select_chunk(uint64_t offset, uint8_t exp_options, uint32_t total)
+{
+	struct bdev_ut_channel *ch = g_bdev_ut_channel;
+	struct spdk_bdev_io *bdev_io;
+	uint8_t *buf;
+	uint64_t i;
+
+	TAILQ_FOREACH(bdev_io, &ch->outstanding_io, module_link) {
+		if (bdev_io->type == SPDK_BDEV_IO_KV_RETRIEVE_SELECT &&
+		    bdev_io->u.bdev.nvme_kv.offset == offset) {
+			break;
+		}
+	}
+	SPDK_CU_ASSERT_FATAL(bdev_io != NULL);
+	TAILQ_REMOVE(&ch->outstanding_io, bdev_io, module_link);
+	ch->outstanding_io_count--;
+
+	CU_ASSERT(bdev_io->u.bdev.nvme_kv.select_id == 7);
+	CU_ASSERT(bdev_io->u.bdev.nvme_kv.options == exp_options);
+	buf = bdev_io->u.bdev.iovs[0].iov_base;
+	for (i = offset; i < total && i < offset + bdev_io->u.bdev.iovs[0].iov_len; i++) {
+		buf[i - offset] = (uint8_t)i;
+	}
+	spdk_bdev_io_complete_nvme_status(bdev_io, total, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_SUCCESS);
+}
+
+static void
+ut_kv_complete_send_select(const char *query)
+{
+	struct bdev_ut_channel *ch = g_bdev_ut_channel;
+	struct spdk_bdev_io *bdev_io;
+
+	bdev_io = TAILQ_FIRST(&ch->outstanding_io);
+	SPDK_CU_ASSERT_FATAL(bdev_io != NULL);
+	TAILQ_REMOVE(&ch->outstanding_io, bdev_io, module_link);
+	ch->outstanding_io_count--;
+
+	CU_ASSERT(bdev_io->type == SPDK_BDEV_IO_KV_SEND_SELECT);
+	CU_ASSERT(bdev_io->u.bdev.iovs[0].iov_len == strlen(query));
+	CU_ASSERT(memcmp(bdev_io->u.bdev.iovs[0].iov_base, query, strlen(query)) == 0);
+	spdk_bdev_io_complete_nvme_status(bdev_io, 7, SPDK_NVME_SCT_GENERIC, SPDK_NVME_SC_SUCCESS);
+}
+
+static void
+bdev_kv_select_cursor(void)
+{
+	struct spdk_bdev *bdev;
+	struct spdk_bdev_desc *desc = NULL;
+	struct spdk_io_channel *io_ch;
+	struct spdk_bdev_kv_select_cursor *cursor = NULL;
+	struct ut_kv_cursor_ctx ctx;
+	unsigned char key[] = "key0";
+	const char *query = "SELECT * FROM s3object";
+	int rc;
+
+	ut_init_bdev(NULL);
+	poll_threads();
+
+	bdev = allocate_bdev("bdev0");
+
+	rc = spdk_bdev_open_ext("bdev0", true, bdev_ut_event_cb, NULL, &desc);
+	CU_ASSERT(rc == 0);
+	SPDK_CU_ASSERT_FATAL(desc != NULL);
+	io_ch = spdk_bdev_get_io_channel(desc);
+	CU_ASSERT(io_ch != NULL);
+
+	/* Invalid lengths and queue depths are rejected */
+	rc = spdk_bdev_kv_select_cursor_open(desc, io_ch, key, sizeof(key), query, 0, 0, 0, 0,
+					     100, 3, ut_kv_cursor_chunk, ut_kv_cursor_done, &ctx, &cursor);
+	CU_ASSERT(rc == -EINVAL);
+	rc = spdk_bdev_kv_select_cursor_open(desc, io_ch, key, sizeof(key), query, strlen(query), 0, 0, 0,
+					     10, 3, ut_kv_cursor_chunk, ut_kv_cursor_done, &ctx, &cursor);
+	CU_ASSERT(rc == -EINVAL);
+	rc = spdk_bdev_kv_select_cursor_open(desc, io_ch, key, sizeof(key), query, strlen(query), 0, 0, 0,
+					     100, 33, ut_kv_cursor_chunk, ut_kv_cursor_done, &ctx, &cursor);
+	CU_ASSERT(rc == -EINVAL);
+	CU_ASSERT(g_bdev_ut_channel->outstanding_io_count == 0);
+
+	/* Results that fit in the first chunk are freed by that read */
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.data_ok = true;
+	rc = spdk_bdev_kv_select_cursor_open(desc, io_ch, key, sizeof(key), query, strlen(query), 0, 0, 0,
+					     100, 3, ut_kv_cursor_chunk, ut_kv_cursor_done, &ctx, &cursor);
+	CU_ASSERT(rc == 0);
+	CU_ASSERT(g_bdev_ut_channel->outstanding_io_count == 1);
+	ut_kv_complete_send_select(query);
+	CU_ASSERT(g_bdev_ut_channel->outstanding_io_count == 1);
+	ut_kv_complete_select_chunk(0, NVME_KV_SELECT_CMD_OPTION_DO_NOT_FREE_IF_NOT_ALL_DATA_FETCHED, 50);
+	CU_ASSERT(g_bdev_ut_channel->outstanding_io_count == 0);
+	CU_ASSERT(ctx.num_chunks == 1);
+	CU_ASSERT(ctx.lens[0] == 50);
+	CU_ASSERT(ctx.data_ok == true);
+	CU_ASSERT(ctx.done == true);
+	CU_ASSERT(ctx.status == 0);
+	CU_ASSERT(ctx.total_len == 50);
+
+	/*
+	 * Once the first chunk gives the length, queue_depth reads are kept in flight.
+	 * Chunks completing out of order are delivered in offset order, and the read
+	 * reaching the end of the results frees the select after all others are done.
+	 */
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.data_ok = true;
+	rc = spdk_bdev_kv_select_cursor_open(desc, io_ch, key, sizeof(key), query, strlen(query), 0, 0, 0,
+					     100, 3, ut_kv_cursor_chunk, ut_kv_cursor_done, &ctx, &cursor);
+	CU_ASSERT(rc == 0);
+	ut_kv_complete_send_select(query);
+	ut_kv_complete_select_chunk(0, NVME_KV_SELECT_CMD_OPTION_DO_NOT_FREE_IF_NOT_ALL_DATA_FETCHED, 450);
+	CU_ASSERT(ctx.num_chunks == 1);
+	CU_ASSERT(g_bdev_ut_channel->outstanding_io_count == 3);
+	ut_kv_complete_select_chunk(300, NVME_KV_SELECT_CMD_OPTION_DO_NOT_FREE, 450);
+	ut_kv_complete_select_chunk(200, NVME_KV_SELECT_CMD_OPTION_DO_NOT_FREE, 450);
+	CU_ASSERT(ctx.num_chunks == 1);
+	CU_ASSERT(g_bdev_ut_channel->outstanding_io_count == 1);
+	ut_kv_complete_select_chunk(100, NVME_KV_SELECT_CMD_OPTION_DO_NOT_FREE, 450);
+	CU_ASSERT(ctx.num_chunks == 4);
+	CU_ASSERT(ctx.offsets[1] == 100);
+	CU_ASSERT(ctx.offsets[2] == 200);
+	CU_ASSERT(ctx.offsets[3] == 300);
+	CU_ASSERT(g_bdev_ut_channel->outstanding_io_count == 1);
+	CU_ASSERT(ctx.done == false);
+	ut_kv_complete_select_chunk(400, 0, 450);
+	CU_ASSERT(ctx.num_chunks == 5);
+	CU_ASSERT(ctx.offsets[4] == 400);
+	CU_ASSERT(ctx.lens[4] == 50);
+	CU_ASSERT(ctx.data_ok == true);
+	CU_ASSERT(ctx.done == true);
+	CU_ASSERT(ctx.status == 0);
+	CU_ASSERT(ctx.total_len == 450);
+	CU_ASSERT(g_bdev_ut_channel->outstanding_io_count == 0);
+
+	/*
+	 * Closing with reads in flight delivers nothing more, waits for those reads
+	 * and then releases the select before calling done.
+	 */
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.data_ok = true;
+	rc = spdk_bdev_kv_select_cursor_open(desc, io_ch, key, sizeof(key), query, strlen(query), 0, 0, 0,
+					     100, 2, ut_kv_cursor_chunk, ut_kv_cursor_done, &ctx, &cursor);
+	CU_ASSERT(rc == 0);
+	ut_kv_complete_send_select(query);
+	ut_kv_complete_select_chunk(0, NVME_KV_SELECT_CMD_OPTION_DO_NOT_FREE_IF_NOT_ALL_DATA_FETCHED, 1000);
+	CU_ASSERT(g_bdev_ut_channel->outstanding_io_count == 2);
+	spdk_bdev_kv_select_cursor_close(cursor);
+	CU_ASSERT(ctx.done == false);
+	ut_kv_complete_select_chunk(200, NVME_KV_SELECT_CMD_OPTION_DO_NOT_FREE, 1000);
+	CU_ASSERT(ctx.done == false);
+	ut_kv_complete_select_chunk(100, NVME_KV_SELECT_CMD_OPTION_DO_NOT_FREE, 1000);
+	CU_ASSERT(ctx.num_chunks == 1);
+	CU_ASSERT(ctx.done == false);
+	CU_ASSERT(g_bdev_ut_channel->outstanding_io_count == 1);
+	ut_kv_complete_select_chunk(0, 0, 1000);
+	CU_ASSERT(ctx.done == true);
+	CU_ASSERT(ctx.status == -ECANCELED);
+	CU_ASSERT(ctx.total_len == 1000);
+	CU_ASSERT(g_bdev_ut_channel->outstanding_io_count == 0);
+
+	spdk_put_io_channel(io_ch);
+	spdk_bdev_close(desc);
+	free_bdev(bdev);
+	ut_fini_bdev();
+}
+
+struct ut_kv_list_ctx {
+	char keys[8][NVME_KV_MAX_KEY_LENGTH + 1];
+	uint32_t num_keys;
+	uint32_t stop_after;
+	bool done;
+	int status;
+	uint64_t total;
+};
+
+static int
+ut_kv_list_key(void *cb_arg, const unsigned char *key, size_t key_length)
+{
+	struct ut_kv_list_ctx *ctx = cb_arg;
+
+	CU_ASSERT(ctx->done == false);
+	if (ctx->num_keys < SPDK_COUNTOF(ctx->keys)) {
+		memcpy(ctx->keys[ctx->num_keys], key, key_length);
+		ctx->keys[ctx->num_keys][key_length] = '\0';
+	}
+	ctx->num_keys++;
+	return ctx->num_keys == ctx->stop_after ? -ECANCELED : 0;
+}
+
+static void
+ut_kv_list_done(void *cb_arg, int status, uint64_t num_keys)
+{
+	struct ut_kv_list_ctx *ctx = cb_arg;
+
+	CU_ASSERT(ctx->done == false);
+	ctx->done = true;
+	ctx->status = status;
+	ctx->total = num_keys;
+}
+
+/* Find the outstanding KV I/O of a type for a key, or the first one if key is NULL. */
+static struct spdk_bdev_io *
+ut_kv_find_io(enum spdk_bdev_io_type type, const void *key, size_t key_length)
+{
+	struct spdk_bdev_io *bdev_io;
+
+	TAILQ_FOREACH(bdev_io, &g_bdev_ut_channel->outstanding_io, module_link) {
+		if (bdev_io->type == type &&
+		    (key == NULL || (bdev_io->u.bdev.nvme_kv.key_length == key_length &&
+				     memcmp(bdev_io->u.bdev.nvme_kv.key, key, key_length) == 0))) {
+			return bdev_io;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Complete a KV list with the given keys. A full listing is padded with
+ * maximum length keys until another one would not fit into the buffer.
+ */
+static void
+ut_kv_complete_list(struct spdk_bdev_io *bdev_io, const char **keys, uint32_t num_keys, bool full)
+{
+	struct bdev_ut_channel *ch = g_bdev_ut_channel;
+	uint8_t *buf = bdev_io->u.bdev.iovs[0].iov_base;
+	uint32_t size = bdev_io->u.bdev.iovs[0].iov_len;
+	uint32_t num = 0, pos = sizeof(num), i;
+	uint16_t key_len;
+
+	TAILQ_REMOVE(&ch->outstanding_io, bdev_io, module_link);
+	ch->outstanding_io_count--;
+
+	CU_ASSERT(bdev_io->type == SPDK_BDEV_IO_KV_LIST);
+	for (i = 0; i < num_keys; i++, num++) {
+		key_len = strlen(keys[i]);
+		memcpy(buf + pos, &key_len, sizeof(key_len));
+		memcpy(buf + pos + sizeof(key_len), keys[i], key_len);
+		pos += sizeof(key_len) + SPDK_ALIGN_CEIL(key_len, 4);
+	}
+	while (full && pos + sizeof(key_len) + NVME_KV_MAX_KEY_LENGTH <= size) {
+		key_len = NVME_KV_MAX_KEY_LENGTH;
+		memcpy(buf + pos, &key_len, sizeof(key_len));
+		memcpy(buf + pos + sizeof(key_len), bdev_io->u.bdev.nvme_kv.key,
+		       bdev_io->u.bdev.nvme_kv.key_length);
+		memset(buf + pos + sizeof(key_len) + bdev_io->u.bdev.nvme_kv.key_length, 'z',
+		       key_len - bdev_io->u.bdev.nvme_kv.key_length);
+		pos += sizeof(key_len) + key_len;
+		num++;
+	}
+	memcpy(buf, &num, sizeof(num));
+	spdk_bdev_io_complete(bdev_io, SPDK_BDEV_IO_STATUS_SUCCESS);
+}
+
+static void
+bdev_kv_list_iter(void)
+{
+	struct spdk_bdev *bdev;
+	struct spdk_bdev_desc *desc = NULL;
+	struct spdk_io_channel *io_ch;
+	struct spdk_bdev_kv_list_iter *iter = NULL;
+	struct spdk_bdev_io *bdev_io;
+	struct ut_kv_list_ctx ctx;
+	const char *keys[3];
+	unsigned char prefix[2];
+	uint32_t num_lists;
+	int rc;
+
+	ut_init_bdev(NULL);
+	poll_threads();
+
+	bdev = allocate_bdev("bdev0");
+
+	rc = spdk_bdev_open_ext("bdev0", true, bdev_ut_event_cb, NULL, &desc);
+	CU_ASSERT(rc == 0);
+	SPDK_CU_ASSERT_FATAL(desc != NULL);
+	io_ch = spdk_bdev_get_io_channel(desc);
+	CU_ASSERT(io_ch != NULL);
+
+	/* Invalid shards and queue depths are rejected */
+	rc = spdk_bdev_kv_list_iter_open(desc, io_ch, "k", 1, 257, 0, 0, 0, ut_kv_list_key,
+					 ut_kv_list_done, &ctx, &iter);
+	CU_ASSERT(rc == -EINVAL);
+	rc = spdk_bdev_kv_list_iter_open(desc, io_ch, "k", 1, 4, 4, 0, 0, ut_kv_list_key,
+					 ut_kv_list_done, &ctx, &iter);
+	CU_ASSERT(rc == -EINVAL);
+	rc = spdk_bdev_kv_list_iter_open(desc, io_ch, "k", 1, 4, 2, 3, 0, ut_kv_list_key,
+					 ut_kv_list_done, &ctx, &iter);
+	CU_ASSERT(rc == -EINVAL);
+	rc = spdk_bdev_kv_list_iter_open(desc, io_ch, "k", 1, 256, 0, 0, 33, ut_kv_list_key,
+					 ut_kv_list_done, &ctx, &iter);
+	CU_ASSERT(rc == -EINVAL);
+	CU_ASSERT(g_bdev_ut_channel->outstanding_io_count == 0);
+
+	/*
+	 * A listing that fills its buffer might have missed keys, so only the key
+	 * equal to the prefix is delivered from it. The walk then continues under
+	 * each of the 256 one byte longer prefixes in turn.
+	 */
+	memset(&ctx, 0, sizeof(ctx));
+	rc = spdk_bdev_kv_list_iter_open(desc, io_ch, "ab", 2, 1, 0, 0, 0, ut_kv_list_key,
+					 ut_kv_list_done, &ctx, &iter);
+	CU_ASSERT(rc == 0);
+	CU_ASSERT(g_bdev_ut_channel->outstanding_io_count == 1);
+	bdev_io = ut_kv_find_io(SPDK_BDEV_IO_KV_LIST, "ab", 2);
+	SPDK_CU_ASSERT_FATAL(bdev_io != NULL);
+	keys[0] = "ab";
+	keys[1] = "abc";
+	ut_kv_complete_list(bdev_io, keys, 2, true);
+	CU_ASSERT(ctx.num_keys == 1);
+	CU_ASSERT(strcmp(ctx.keys[0], "ab") == 0);
+
+	memcpy(prefix, "ab", 2);
+	for (num_lists = 0; num_lists < 256; num_lists++) {
+		CU_ASSERT(ctx.done == false);
+		CU_ASSERT(g_bdev_ut_channel->outstanding_io_count == 1);
+		bdev_io = ut_kv_find_io(SPDK_BDEV_IO_KV_LIST, NULL, 0);
+		SPDK_CU_ASSERT_FATAL(bdev_io != NULL);
+		SPDK_CU_ASSERT_FATAL(bdev_io->u.bdev.nvme_kv.key_length == 3);
+		CU_ASSERT(memcmp(bdev_io->u.bdev.nvme_kv.key, prefix, 2) == 0);
+		CU_ASSERT(bdev_io->u.bdev.nvme_kv.key[2] == num_lists);
+		keys[0] = "abc";
+		ut_kv_complete_list(bdev_io, keys, bdev_io->u.bdev.nvme_kv.key[2] == 'c', false);
+	}
+	CU_ASSERT(ctx.done == true);
+	CU_ASSERT(ctx.status == 0);
+	CU_ASSERT(ctx.total == 2);
+	CU_ASSERT(strcmp(ctx.keys[1], "abc") == 0);
+	CU_ASSERT(g_bdev_ut_channel->outstanding_io_count == 0);
+
+	/*
+	 * Sharding splits the key space on the next key byte. All shards are
+	 * walked concurrently up to the queue depth, and the key equal to the
+	 * prefix is checked for on its own.
+	 */
+	memset(&ctx, 0, sizeof(ctx));
+	rc = spdk_bdev_kv_list_iter_open(desc, io_ch, "k", 1, 4, 0, 0, 0, ut_kv_list_key,
+					 ut_kv_list_done, &ctx, &iter);
+	CU_ASSERT(rc == 0);
+	CU_ASSERT(g_bdev_ut_channel->outstanding_io_count == 5);
+	bdev_io = ut_kv_find_io(SPDK_BDEV_IO_KV_EXIST, "k", 1);
+	SPDK_CU_ASSERT_FATAL(bdev_io != NULL);
+	TAILQ_REMOVE(&g_bdev_ut_channel->outstanding_io, bdev_io, module_link);
+	g_bdev_ut_channel->outstanding_io_count--;
+	spdk_bdev_io_complete_nvme_status(bdev_io, 0, SPDK_NVME_SCT_GENERIC,
+					  SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+	prefix[0] = 'k';
+	for (num_lists = 0; num_lists < 4; num_lists++) {
+		prefix[1] = num_lists * 64;
+		CU_ASSERT(ut_kv_find_io(SPDK_BDEV_IO_KV_LIST, prefix, 2) != NULL);
+	}
+
+	num_lists = 0;
+	while ((bdev_io = ut_kv_find_io(SPDK_BDEV_IO_KV_LIST, NULL, 0)) != NULL) {
+		keys[0] = bdev_io->u.bdev.nvme_kv.key[1] == 'A' ? "kA" : "ka1";
+		ut_kv_complete_list(bdev_io, keys, bdev_io->u.bdev.nvme_kv.key[1] == 'A' ||
+				    bdev_io->u.bdev.nvme_kv.key[1] == 'a', false);
+		num_lists++;
+	}
+	CU_ASSERT(num_lists == 256);
+	CU_ASSERT(ctx.done == true);
+	CU_ASSERT(ctx.status == 0);
+	CU_ASSERT(ctx.total == 2);
+	CU_ASSERT(strcmp(ctx.keys[0], "kA") == 0);
+	CU_ASSERT(strcmp(ctx.keys[1], "ka1") == 0);
+
+	/* A range of shards only walks those, without checking the prefix itself */
+	memset(&ctx, 0, sizeof(ctx));
+	rc = spdk_bdev_kv_list_iter_open(desc, io_ch, "k", 1, 4, 1, 2, 0, ut_kv_list_key,
+					 ut_kv_list_done, &ctx, &iter);
+	CU_ASSERT(rc == 0);
+	CU_ASSERT(g_bdev_ut_channel->outstanding_io_count == 2);
+	prefix[1] = 0x40;
+	CU_ASSERT(ut_kv_find_io(SPDK_BDEV_IO_KV_LIST, prefix, 2) != NULL);
+	prefix[1] = 0x80;
+	CU_ASSERT(ut_kv_find_io(SPDK_BDEV_IO_KV_LIST, prefix, 2) != NULL);
+	spdk_bdev_kv_list_iter_close(iter);
+	CU_ASSERT(ctx.done == false);
+	while ((bdev_io = ut_kv_find_io(SPDK_BDEV_IO_KV_LIST, NULL, 0)) != NULL) {
+		ut_kv_complete_list(bdev_io, keys, 0, false);
+	}
+	CU_ASSERT(ctx.done == true);
+	CU_ASSERT(ctx.status == -ECANCELED);
+	CU_ASSERT(ctx.total == 0);
+
+	/* A non-zero return from the key callback stops delivery and the walk */
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.stop_after = 2;
+	rc = spdk_bdev_kv_list_iter_open(desc, io_ch, "ab", 2, 1, 0, 0, 0, ut_kv_list_key,
+					 ut_kv_list_done, &ctx, &iter);
+	CU_ASSERT(rc == 0);
+	bdev_io = ut_kv_find_io(SPDK_BDEV_IO_KV_LIST, "ab", 2);
+	SPDK_CU_ASSERT_FATAL(bdev_io != NULL);
+	keys[0] = "ab";
+	keys[1] = "abc";
+	keys[2] = "abd";
+	ut_kv_complete_list(bdev_io, keys, 3, false);
+	CU_ASSERT(ctx.done == true);
+	CU_ASSERT(ctx.status == -ECANCELED);
+	CU_ASSERT(ctx.num_keys == 2);
+	CU_ASSERT(ctx.total == 2);
+	CU_ASSERT(g_bdev_ut_channel->outstanding_io_count == 0);
+
+	spdk_put_io_channel(io_ch);
+	spdk_bdev_close(desc);
+	free_bdev(bdev);
+	ut_fini_bdev();
+}
+
+struct ut_kv_multi_select_ctx {
+	char out[256];
+	size_t out_len;
+	uint32_t num_calls;
+	bool last_key_null;
+	bool done;
+	int status;
+	uint64_t num_keys;
+};
+
+static int
+ut_kv_multi_select_data(void *cb_arg, const unsigned char *key, size_t key_length,
+			const void *buf, size_t len)
+{
+	struct ut_kv_multi_select_ctx *ctx = cb_arg;
+
+	SPDK_CU_ASSERT_FATAL(ctx->out_len + len < sizeof(ctx->out));
+	memcpy(ctx->out + ctx->out_len, buf, len);
+	ctx->out_len += len;
+	ctx->out[ctx->out_len] = '\0';
+	ctx->last_key_null = key == NULL;
+	ctx->num_calls++;
+	return 0;
+}
+
+static void
+ut_kv_multi_select_done(void *cb_arg, int status, uint64_t num_keys)
+{
+	struct ut_kv_multi_select_ctx *ctx = cb_arg;
+
+	CU_ASSERT(ctx->done == false);
+	ctx->done = true;
+	ctx->status = status;
+	ctx->num_keys = num_keys;
+}
+
+/* Run the select of a key to the end with a result that fits into the first chunk. */
+static void
+ut_kv_complete_select(const char *key, uint32_t select_id, const char *result)
+{
+	struct bdev_ut_channel *ch = g_bdev_ut_channel;
+	struct spdk_bdev_io *bdev_io;
+
+	bdev_io = ut_kv_find_io(SPDK_BDEV_IO_KV_SEND_SELECT, key, strlen(key));
+	SPDK_CU_ASSERT_FATAL(bdev_io != NULL);
+	TAILQ_REMOVE(&ch->outstanding_io, bdev_io, module_link);
+	ch->outstanding_io_count--;
+	spdk_bdev_io_complete_nvme_status(bdev_io, select_id, SPDK_NVME_SCT_GENERIC,
+					  SPDK_NVME_SC_SUCCESS);
+
+	TAILQ_FOREACH(bdev_io, &ch->outstanding_io, module_link) {
+		if (bdev_io->type == SPDK_BDEV_IO_KV_RETRIEVE_SELECT &&
+		    bdev_io->u.bdev.nvme_kv.select_id == select_id) {
+			break;
+		}
+	}
+	SPDK_CU_ASSERT_FATAL(bdev_io != NULL);
+	TAILQ_REMOVE(&ch->outstanding_io, bdev_io, module_link);
+	ch->outstanding_io_count--;
+	SPDK_CU_ASSERT_FATAL(bdev_io->u.bdev.iovs[0].iov_len >= strlen(result));
+	memcpy(bdev_io->u.bdev.iovs[0].iov_base, result, strlen(result));
+	spdk_bdev_io_complete_nvme_status(bdev_io, strlen(result), SPDK_NVME_SCT_GENERIC,
+					  SPDK_NVME_SC_SUCCESS);
+}
+
+static void
+bdev_kv_multi_select(void)
+{
+	struct spdk_bdev *bdev;
+	struct spdk_bdev_desc *desc = NULL;
+	struct spdk_io_channel *io_ch;
+	struct spdk_bdev_kv_multi_select *ms = NULL;
+	struct spdk_bdev_kv_multi_select_opts opts;
+	struct ut_kv_multi_select_ctx ctx;
+	const unsigned char *keys[] = { "key1", "key2", "key3" };
+	const size_t key_lengths[] = { 4, 4, 4 };
+	enum spdk_bdev_kv_select_agg aggs[] = {
+		SPDK_BDEV_KV_SELECT_AGG_COUNT, SPDK_BDEV_KV_SELECT_AGG_SUM,
+		SPDK_BDEV_KV_SELECT_AGG_MIN, SPDK_BDEV_KV_SELECT_AGG_MAX,
+	};
+	const char *query = "SELECT * FROM s3object";
+	const char *agg_query = "SELECT COUNT(*) AS n, SUM(qty) AS total, MIN(qty) AS lo, "
+				"MAX(qty) AS hi FROM s3object";
+	int rc;
+
+	ut_init_bdev(NULL);
+	poll_threads();
+
+	bdev = allocate_bdev("bdev0");
+
+	rc = spdk_bdev_open_ext("bdev0", true, bdev_ut_event_cb, NULL, &desc);
+	CU_ASSERT(rc == 0);
+	SPDK_CU_ASSERT_FATAL(desc != NULL);
+	io_ch = spdk_bdev_get_io_channel(desc);
+	CU_ASSERT(io_ch != NULL);
+
+	/* Rows are concatenated, and only the first key keeps its CSV header line */
+	memset(&opts, 0, sizeof(opts));
+	opts.keys = keys;
+	opts.key_lengths = key_lengths;
+	opts.num_keys = 2;
+	opts.query = query;
+	opts.query_len = strlen(query);
+	opts.options = NVME_KV_SELECT_CMD_OUTPUT_TYPE_USE_CSV_HEADERS_OUTPUT;
+	opts.input_type = NVME_KV_SELECT_TYPE_CSV;
+	opts.output_type = NVME_KV_SELECT_TYPE_CSV;
+	memset(&ctx, 0, sizeof(ctx));
+	rc = spdk_bdev_kv_multi_select_open(desc, io_ch, &opts, ut_kv_multi_select_data,
+					    ut_kv_multi_select_done, &ctx, &ms);
+	CU_ASSERT(rc == 0);
+	poll_threads();
+	CU_ASSERT(g_bdev_ut_channel->outstanding_io_count == 2);
+	ut_kv_complete_select("key1", 1, "name,qty\nfoo,1\n");
+	ut_kv_complete_select("key2", 2, "name,qty\nbar,2");
+	CU_ASSERT(ctx.done == true);
+	CU_ASSERT(ctx.status == 0);
+	CU_ASSERT(ctx.num_keys == 2);
+	CU_ASSERT(ctx.num_calls == 2);
+	CU_ASSERT(strcmp(ctx.out, "name,qty\nfoo,1\nbar,2\n") == 0);
+	CU_ASSERT(g_bdev_ut_channel->outstanding_io_count == 0);
+
+	/*
+	 * Aggregates are folded into a single row named after the first key's
+	 * header. Empty fields are partials that saw no values.
+	 */
+	opts.num_keys = 3;
+	opts.query = agg_query;
+	opts.query_len = strlen(agg_query);
+	opts.aggs = aggs;
+	opts.num_aggs = SPDK_COUNTOF(aggs);
+	memset(&ctx, 0, sizeof(ctx));
+	rc = spdk_bdev_kv_multi_select_open(desc, io_ch, &opts, ut_kv_multi_select_data,
+					    ut_kv_multi_select_done, &ctx, &ms);
+	CU_ASSERT(rc == 0);
+	poll_threads();
+	ut_kv_complete_select("key1", 1, "n,total,lo,hi\n3,10,1,5\n");
+	ut_kv_complete_select("key2", 2, "n,total,lo,hi\n0,,,\n");
+	CU_ASSERT(ctx.num_calls == 0);
+	ut_kv_complete_select("key3", 3, "n,total,lo,hi\n2,7.5,-1,4\n");
+	CU_ASSERT(ctx.done == true);
+	CU_ASSERT(ctx.status == 0);
+	CU_ASSERT(ctx.num_keys == 3);
+	CU_ASSERT(ctx.num_calls == 1);
+	CU_ASSERT(ctx.last_key_null == true);
+	CU_ASSERT(strcmp(ctx.out, "n,total,lo,hi\n5,17.5,-1,5\n") == 0);
+
+	/* Only empty partials leave MIN and MAX empty, while COUNT stays a number */
+	opts.num_keys = 1;
+	memset(&ctx, 0, sizeof(ctx));
+	rc = spdk_bdev_kv_multi_select_open(desc, io_ch, &opts, ut_kv_multi_select_data,
+					    ut_kv_multi_select_done, &ctx, &ms);
+	CU_ASSERT(rc == 0);
+	poll_threads();
+	ut_kv_complete_select("key1", 1, "n,total,lo,hi\n0,,,\n");
+	CU_ASSERT(ctx.done == true);
+	CU_ASSERT(ctx.status == 0);
+	CU_ASSERT(strcmp(ctx.out, "n,total,lo,hi\n0,,,\n") == 0);
+
+	/* JSON rows are merged member by member, keeping the member names */
+	opts.num_keys = 2;
+	opts.options = 0;
+	opts.output_type = NVME_KV_SELECT_TYPE_JSON;
+	opts.aggs = &aggs[1];
+	opts.num_aggs = 3;
+	memset(&ctx, 0, sizeof(ctx));
+	rc = spdk_bdev_kv_multi_select_open(desc, io_ch, &opts, ut_kv_multi_select_data,
+					    ut_kv_multi_select_done, &ctx, &ms);
+	CU_ASSERT(rc == 0);
+	poll_threads();
+	ut_kv_complete_select("key2", 2, "{\"total\":null,\"lo\":null,\"hi\":null}\n");
+	ut_kv_complete_select("key1", 1, "{\"total\":4, \"lo\":-2, \"hi\":3.25}\n");
+	CU_ASSERT(ctx.done == true);
+	CU_ASSERT(ctx.status == 0);
+	CU_ASSERT(ctx.num_keys == 2);
+	CU_ASSERT(strcmp(ctx.out, "{\"total\":4,\"lo\":-2,\"hi\":3.25}\n") == 0);
+
+	/* A row that does not have one field per aggregate fails the select */
+	opts.num_keys = 1;
+	opts.output_type = NVME_KV_SELECT_TYPE_CSV;
+	memset(&ctx, 0, sizeof(ctx));
+	rc = spdk_bdev_kv_multi_select_open(desc, io_ch, &opts, ut_kv_multi_select_data,
+					    ut_kv_multi_select_done, &ctx, &ms);
+	CU_ASSERT(rc == 0);
+	poll_threads();
+	ut_kv_complete_select("key1", 1, "4,-2,3,1\n");
+	CU_ASSERT(ctx.done == true);
+	CU_ASSERT(ctx.status == -EBADMSG);
+	CU_ASSERT(ctx.num_calls == 0);
+
+	memset(&ctx, 0, sizeof(ctx));
+	rc = spdk_bdev_kv_multi_select_open(desc, io_ch, &opts, ut_kv_multi_select_data,
+					    ut_kv_multi_select_done, &ctx, &ms);
+	CU_ASSERT(rc == 0);
+	poll_threads();
+	ut_kv_complete_select("key1", 1, "4,-2\n");
+	CU_ASSERT(ctx.done == true);
+	CU_ASSERT(ctx.status == -EBADMSG);
+	CU_ASSERT(ctx.num_calls == 0);
+	CU_ASSERT(g_bdev_ut_channel->outstanding_io_count == 0);
+
+	spdk_put_io_channel(io_ch);
+	spdk_bdev_close(desc);
+	free_bdev(bdev);
+	ut_fini_bdev();
+}
+
 static void
 bdev_copy(void)
 {
@@ -6280,6 +7441,14 @@ main(int argc, char **argv)
 	CU_ADD_TEST(suite, claim_test);
 	CU_ADD_TEST(suite, alias_add_del_test);
 	CU_ADD_TEST(suite, get_device_stat_test);
+	CU_ADD_TEST(suite, bdev_kv_io_stat);
+	CU_ADD_TEST(suite, bdev_kv_qos);
+	CU_ADD_TEST(suite, bdev_kv_retrieve_alloc_buf);
+	CU_ADD_TEST(suite, bdev_kv_ext_bounce_buffer);
+	CU_ADD_TEST(suite, bdev_kv_batch);
+	CU_ADD_TEST(suite, bdev_kv_select_cursor);
+	CU_ADD_TEST(suite, bdev_kv_list_iter);
+	CU_ADD_TEST(suite, bdev_kv_multi_select);
 	CU_ADD_TEST(suite, bdev_io_types_test);
 	CU_ADD_TEST(suite, bdev_io_wait_test);
 	CU_ADD_TEST(suite, bdev_io_spans_split_test);
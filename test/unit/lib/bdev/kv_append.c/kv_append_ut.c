@@ -0,0 +1,511 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+#include "spdk/stdinc.h"
+#include "spdk_cunit.h"
+#include "spdk/env.h"
+#include "spdk_internal/mock.h"
+#include "thread/thread_internal.h"
+#include "common/lib/test_env.c"
+#include "bdev/kv_append/vbdev_kv_append.c"
+#include "common/lib/test_bdev_kv.c"
+
+static struct spdk_thread *g_thread;
+static int g_delete_rc;
+static bool g_delete_done;
+
+static void
+ut_delete_done(void *cb_arg, int rc)
+{
+	g_delete_rc = rc;
+	g_delete_done = true;
+}
+
+static struct vbdev_kv_append *
+ut_append_create(uint32_t max_bytes, uint32_t flush_us)
+{
+	struct vbdev_kv_append_opts opts = {
+		.name = "append0",
+		.base_bdev_name = "base0",
+		.max_bytes = max_bytes,
+		.flush_us = flush_us,
+	};
+	struct spdk_bdev *bdev;
+	int rc;
+
+	rc = bdev_kv_append_create(&opts);
+	CU_ASSERT(rc == 0);
+	bdev = spdk_bdev_get_by_name("append0");
+	SPDK_CU_ASSERT_FATAL(bdev != NULL);
+
+	return bdev->ctxt;
+}
+
+static void
+ut_append_delete(struct vbdev_kv_append *append)
+{
+	g_delete_done = false;
+	bdev_kv_append_delete(append->bdev.name, ut_delete_done, NULL);
+	ut_kv_poll();
+	CU_ASSERT(g_delete_done == true);
+	CU_ASSERT(g_delete_rc == 0);
+}
+
+/* Submit a KV I/O to the vbdev without running it. The caller frees the I/O. */
+static struct spdk_bdev_io *
+ut_start(struct vbdev_kv_append *append, struct spdk_io_channel *ch,
+	 enum spdk_bdev_io_type type, const char *key, const char *value, uint8_t options)
+{
+	struct spdk_bdev_io *bdev_io;
+
+	bdev_io = ut_kv_vbdev_io(&append->bdev, sizeof(struct kv_append_bdev_io), type, key,
+				 (void *)value, strlen(value));
+	bdev_io->u.bdev.nvme_kv.options = options;
+	vbdev_kv_append_submit_request(ch, bdev_io);
+
+	return bdev_io;
+}
+
+static struct spdk_bdev_io *
+ut_append_start(struct vbdev_kv_append *append, struct spdk_io_channel *ch, const char *key,
+		const char *value)
+{
+	return ut_start(append, ch, SPDK_BDEV_IO_KV_STORE, key, value,
+			NVME_KV_STORE_CMD_OPTION_APPEND);
+}
+
+/* Submit a single-iov KV I/O to the vbdev, run it and return its NVMe status code. */
+static int
+ut_submit(struct vbdev_kv_append *append, struct spdk_io_channel *ch,
+	  enum spdk_bdev_io_type type, const char *key, void *buf, uint64_t len, uint32_t *cdw0)
+{
+	struct spdk_bdev_io *bdev_io;
+	int sc;
+
+	bdev_io = ut_kv_vbdev_io(&append->bdev, sizeof(struct kv_append_bdev_io), type, key, buf,
+				 len);
+	sc = ut_kv_vbdev_submit(ch, bdev_io);
+	if (cdw0 != NULL) {
+		*cdw0 = bdev_io->internal.error.nvme.cdw0;
+	}
+	free(bdev_io);
+
+	return sc;
+}
+
+/* Check the base bdev holds value under key. */
+static void
+ut_check_value(struct ut_kv_base *base, const char *key, const char *value)
+{
+	const uint8_t *buf;
+	uint32_t len;
+
+	buf = ut_kv_base_get(base, key, &len);
+	SPDK_CU_ASSERT_FATAL(buf != NULL);
+	CU_ASSERT(len == strlen(value));
+	CU_ASSERT(memcmp(buf, value, len) == 0);
+}
+
+/* Check an I/O completed with status, and free it. */
+static void
+ut_check_done(struct spdk_bdev_io *bdev_io, enum spdk_bdev_io_status status)
+{
+	CU_ASSERT(bdev_io->internal.status == status);
+	free(bdev_io);
+}
+
+static void
+test_create_delete(void)
+{
+	struct vbdev_kv_append_opts opts = {
+		.name = "append0",
+		.base_bdev_name = "base0",
+	};
+	struct vbdev_kv_append *append;
+	struct ut_kv_base *base;
+	int rc;
+
+	opts.name = NULL;
+	rc = bdev_kv_append_create(&opts);
+	CU_ASSERT(rc == -EINVAL);
+	opts.name = "append0";
+
+	/* Creation waits for the base bdev */
+	rc = bdev_kv_append_create(&opts);
+	CU_ASSERT(rc == 0);
+	CU_ASSERT(spdk_bdev_get_by_name("append0") == NULL);
+	rc = bdev_kv_append_create(&opts);
+	CU_ASSERT(rc == -EEXIST);
+	base = ut_kv_base_create("base0");
+	vbdev_kv_append_examine(&base->bdev);
+	SPDK_CU_ASSERT_FATAL(spdk_bdev_get_by_name("append0") != NULL);
+	append = spdk_bdev_get_by_name("append0")->ctxt;
+	CU_ASSERT(append->max_bytes == KV_APPEND_DEFAULT_MAX_BYTES);
+	CU_ASSERT(append->flush_us == 0);
+	CU_ASSERT(base->open_count == 1);
+	CU_ASSERT(base->bdev.internal.claim.v1.module == &kv_append_if);
+	CU_ASSERT(vbdev_kv_append_io_type_supported(append, SPDK_BDEV_IO_KV_STORE) == true);
+	CU_ASSERT(vbdev_kv_append_io_type_supported(append, SPDK_BDEV_IO_KV_BATCH) == true);
+	CU_ASSERT(vbdev_kv_append_io_type_supported(append, SPDK_BDEV_IO_TYPE_FLUSH) == true);
+	CU_ASSERT(vbdev_kv_append_io_type_supported(append, SPDK_BDEV_IO_TYPE_READ) == false);
+
+	/* Deleted bdevs are not created again when their base bdev comes back */
+	ut_append_delete(append);
+	CU_ASSERT(spdk_bdev_get_by_name("append0") == NULL);
+	CU_ASSERT(base->open_count == 0);
+	CU_ASSERT(base->bdev.internal.claim_type == SPDK_BDEV_CLAIM_NONE);
+	vbdev_kv_append_examine(&base->bdev);
+	CU_ASSERT(spdk_bdev_get_by_name("append0") == NULL);
+
+	g_delete_done = false;
+	bdev_kv_append_delete("append0", ut_delete_done, NULL);
+	CU_ASSERT(g_delete_done == true);
+	CU_ASSERT(g_delete_rc == -ENODEV);
+
+	/* The base bdev needs to support KV commands */
+	base->kv_supported = false;
+	rc = bdev_kv_append_create(&opts);
+	CU_ASSERT(rc == -ENOTSUP);
+	CU_ASSERT(base->open_count == 0);
+	CU_ASSERT(base->bdev.internal.claim_type == SPDK_BDEV_CLAIM_NONE);
+	ut_kv_base_destroy(base);
+}
+
+static void
+test_merge(void)
+{
+	struct ut_kv_base *base = ut_kv_base_create("base0");
+	struct spdk_bdev_io *ios[4], *bdev_io;
+	struct vbdev_kv_append_stats stats;
+	struct vbdev_kv_append *append;
+	struct spdk_io_channel *ch;
+	char big[32];
+	uint32_t len;
+	int i, sc;
+
+	append = ut_append_create(16, 0);
+	ch = spdk_get_io_channel(append);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+
+	/* Appends arriving while one is in flight are merged into the next command */
+	ios[0] = ut_append_start(append, ch, "log", "abc");
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_STORE] == 1);
+	ios[1] = ut_append_start(append, ch, "log", "def");
+	ios[2] = ut_append_start(append, ch, "log", "ghi");
+	ios[3] = ut_append_start(append, ch, "log2", "xyz");
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_STORE] == 2);
+	ut_kv_poll();
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_STORE] == 3);
+	ut_check_value(base, "log", "abcdefghi");
+	ut_check_value(base, "log2", "xyz");
+	for (i = 0; i < 4; i++) {
+		ut_check_done(ios[i], SPDK_BDEV_IO_STATUS_SUCCESS);
+	}
+	CU_ASSERT(bdev_kv_append_get_stats("append0", &stats) == 0);
+	CU_ASSERT(stats.appends == 4);
+	CU_ASSERT(stats.merged_commands == 3);
+	CU_ASSERT(stats.bytes == 12);
+	CU_ASSERT(stats.passthrough == 0);
+
+	/* A merged command carries at most max_bytes */
+	ios[0] = ut_append_start(append, ch, "log", "0123456789");
+	ios[1] = ut_append_start(append, ch, "log", "0123456789");
+	ios[2] = ut_append_start(append, ch, "log", "0123456789");
+	ut_kv_poll();
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_STORE] == 6);
+	for (i = 0; i < 3; i++) {
+		ut_check_done(ios[i], SPDK_BDEV_IO_STATUS_SUCCESS);
+	}
+
+	/* Large appends, appends with other options and plain stores are passed on */
+	memset(big, 'b', sizeof(big) - 1);
+	big[sizeof(big) - 1] = '\0';
+	ios[0] = ut_append_start(append, ch, "log2", big);
+	ios[1] = ut_start(append, ch, SPDK_BDEV_IO_KV_STORE, "log2", "!",
+			  NVME_KV_STORE_CMD_OPTION_APPEND | NVME_KV_STORE_CMD_OPTION_MUST_EXIST);
+	ios[2] = ut_start(append, ch, SPDK_BDEV_IO_KV_STORE, "key", "value", 0);
+	ut_kv_poll();
+	for (i = 0; i < 3; i++) {
+		ut_check_done(ios[i], SPDK_BDEV_IO_STATUS_SUCCESS);
+	}
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_STORE] == 9);
+	CU_ASSERT(bdev_kv_append_get_stats("append0", &stats) == 0);
+	CU_ASSERT(stats.appends == 7);
+	CU_ASSERT(stats.passthrough == 2);
+	ut_check_value(base, "key", "value");
+	CU_ASSERT(ut_kv_base_get(base, "log2", &len) != NULL);
+	CU_ASSERT(len == 3 + 31 + 1);
+
+	/* Other commands go to the base bdev */
+	sc = ut_submit(append, ch, SPDK_BDEV_IO_KV_EXIST, "key", NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	sc = ut_submit(append, ch, SPDK_BDEV_IO_KV_DELETE, "key", NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	sc = ut_submit(append, ch, SPDK_BDEV_IO_KV_EXIST, "key", NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+
+	/* Block I/O is not supported */
+	bdev_io = ut_kv_vbdev_io(&append->bdev, sizeof(struct kv_append_bdev_io),
+				 SPDK_BDEV_IO_TYPE_READ, NULL, big, sizeof(big));
+	sc = ut_kv_vbdev_submit(ch, bdev_io);
+	CU_ASSERT(sc == -1);
+	free(bdev_io);
+
+	spdk_put_io_channel(ch);
+	ut_append_delete(append);
+	ut_kv_base_destroy(base);
+}
+
+static void
+test_flush_timer(void)
+{
+	struct ut_kv_base *base = ut_kv_base_create("base0");
+	struct spdk_bdev_io *ios[3];
+	struct vbdev_kv_append *append;
+	struct spdk_io_channel *ch;
+	char buf[32];
+	uint32_t cdw0;
+	int i, sc;
+
+	append = ut_append_create(16, 100);
+	ch = spdk_get_io_channel(append);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+
+	/* Appends wait for the poller */
+	ios[0] = ut_append_start(append, ch, "log", "aa");
+	ios[1] = ut_append_start(append, ch, "log", "bb");
+	ut_kv_poll();
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_STORE] == 0);
+	CU_ASSERT(ios[0]->internal.status == SPDK_BDEV_IO_STATUS_PENDING);
+	spdk_delay_us(100);
+	ut_kv_poll();
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_STORE] == 1);
+	ut_check_value(base, "log", "aabb");
+	ut_check_done(ios[0], SPDK_BDEV_IO_STATUS_SUCCESS);
+	ut_check_done(ios[1], SPDK_BDEV_IO_STATUS_SUCCESS);
+
+	/* Or for max_bytes to be staged */
+	ios[0] = ut_append_start(append, ch, "log", "0123456789");
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_STORE] == 1);
+	ios[1] = ut_append_start(append, ch, "log", "012345");
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_STORE] == 2);
+	ut_kv_poll();
+	ut_check_done(ios[0], SPDK_BDEV_IO_STATUS_SUCCESS);
+	ut_check_done(ios[1], SPDK_BDEV_IO_STATUS_SUCCESS);
+
+	/* Other commands on the key do not overtake its staged appends */
+	ios[0] = ut_append_start(append, ch, "log", "cc");
+	memset(buf, 0, sizeof(buf));
+	sc = ut_submit(append, ch, SPDK_BDEV_IO_KV_RETRIEVE, "log", buf, sizeof(buf), &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == 22);
+	CU_ASSERT(strcmp(buf, "aabb0123456789012345cc") == 0);
+	ut_check_done(ios[0], SPDK_BDEV_IO_STATUS_SUCCESS);
+
+	/* Appends staged while the key has a command in flight follow it once it is done */
+	ios[0] = ut_append_start(append, ch, "log", "dd");
+	ios[1] = ut_start(append, ch, SPDK_BDEV_IO_KV_EXIST, "log", "", 0);
+	ios[2] = ut_append_start(append, ch, "log", "ee");
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_STORE] == 4);
+	spdk_delay_us(100);
+	while (spdk_thread_poll(g_thread, 0, 0) > 0) {
+	}
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_STORE] == 4);
+	ut_kv_poll();
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_STORE] == 5);
+	for (i = 0; i < 3; i++) {
+		ut_check_done(ios[i], SPDK_BDEV_IO_STATUS_SUCCESS);
+	}
+	ut_check_value(base, "log", "aabb0123456789012345ccddee");
+
+	spdk_put_io_channel(ch);
+	ut_append_delete(append);
+	ut_kv_base_destroy(base);
+}
+
+static void
+test_flush(void)
+{
+	struct ut_kv_base *base = ut_kv_base_create("base0");
+	struct spdk_bdev_io *ios[3], *flush_io;
+	struct vbdev_kv_append_stats stats;
+	struct vbdev_kv_append *append;
+	struct spdk_io_channel *ch;
+
+	append = ut_append_create(0, 1000);
+	ch = spdk_get_io_channel(append);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+
+	/* A FLUSH sends the staged appends and waits for them */
+	ios[0] = ut_append_start(append, ch, "log", "aa");
+	ios[1] = ut_append_start(append, ch, "log2", "bb");
+	flush_io = ut_kv_vbdev_io(&append->bdev, sizeof(struct kv_append_bdev_io),
+				  SPDK_BDEV_IO_TYPE_FLUSH, NULL, NULL, 0);
+	vbdev_kv_append_submit_request(ch, flush_io);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_STORE] == 2);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_TYPE_FLUSH] == 0);
+
+	/* Appends submitted after it are not waited for */
+	ios[2] = ut_append_start(append, ch, "log3", "cc");
+	CU_ASSERT(ut_kv_poll_one() == true);
+	CU_ASSERT(flush_io->internal.status == SPDK_BDEV_IO_STATUS_PENDING);
+	CU_ASSERT(ut_kv_poll_one() == true);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_TYPE_FLUSH] == 1);
+	CU_ASSERT(ut_kv_poll_one() == true);
+	CU_ASSERT(flush_io->internal.status == SPDK_BDEV_IO_STATUS_SUCCESS);
+	CU_ASSERT(ios[2]->internal.status == SPDK_BDEV_IO_STATUS_PENDING);
+	free(flush_io);
+	ut_check_done(ios[0], SPDK_BDEV_IO_STATUS_SUCCESS);
+	ut_check_done(ios[1], SPDK_BDEV_IO_STATUS_SUCCESS);
+
+	/* Without the base bdev supporting FLUSH, it completes with the appends */
+	base->kv_supported = false;
+	flush_io = ut_kv_vbdev_io(&append->bdev, sizeof(struct kv_append_bdev_io),
+				  SPDK_BDEV_IO_TYPE_FLUSH, NULL, NULL, 0);
+	vbdev_kv_append_submit_request(ch, flush_io);
+	CU_ASSERT(flush_io->internal.status == SPDK_BDEV_IO_STATUS_PENDING);
+	ut_kv_poll();
+	CU_ASSERT(flush_io->internal.status == SPDK_BDEV_IO_STATUS_SUCCESS);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_TYPE_FLUSH] == 1);
+	ut_check_done(ios[2], SPDK_BDEV_IO_STATUS_SUCCESS);
+	flush_io->internal.status = SPDK_BDEV_IO_STATUS_PENDING;
+	vbdev_kv_append_submit_request(ch, flush_io);
+	CU_ASSERT(flush_io->internal.status == SPDK_BDEV_IO_STATUS_SUCCESS);
+	base->kv_supported = true;
+
+	/* Failed base FLUSHes fail it */
+	base->fail_sc = SPDK_NVME_SC_INTERNAL_DEVICE_ERROR;
+	flush_io->internal.status = SPDK_BDEV_IO_STATUS_PENDING;
+	vbdev_kv_append_submit_request(ch, flush_io);
+	ut_kv_poll();
+	CU_ASSERT(flush_io->internal.status == SPDK_BDEV_IO_STATUS_FAILED);
+	base->fail_sc = 0;
+	free(flush_io);
+	CU_ASSERT(bdev_kv_append_get_stats("append0", &stats) == 0);
+	CU_ASSERT(stats.flushes == 4);
+	ut_check_value(base, "log", "aa");
+	ut_check_value(base, "log2", "bb");
+	ut_check_value(base, "log3", "cc");
+
+	spdk_put_io_channel(ch);
+	ut_append_delete(append);
+	ut_kv_base_destroy(base);
+}
+
+static void
+test_errors(void)
+{
+	struct ut_kv_base *base = ut_kv_base_create("base0");
+	struct spdk_bdev_io *ios[3];
+	struct vbdev_kv_append *append;
+	struct spdk_io_channel *ch;
+	uint32_t len;
+	int i;
+
+	append = ut_append_create(0, 0);
+	ch = spdk_get_io_channel(append);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+
+	/* Every merged caller completes with the status of the command */
+	ios[0] = ut_append_start(append, ch, "log", "aa");
+	ios[1] = ut_append_start(append, ch, "log", "bb");
+	ios[2] = ut_append_start(append, ch, "log", "cc");
+	CU_ASSERT(ut_kv_poll_one() == true);
+	base->fail_sc = SPDK_NVME_SC_CAPACITY_EXCEEDED;
+	ut_kv_poll();
+	base->fail_sc = 0;
+	ut_check_done(ios[0], SPDK_BDEV_IO_STATUS_SUCCESS);
+	for (i = 1; i < 3; i++) {
+		CU_ASSERT(ios[i]->internal.status == SPDK_BDEV_IO_STATUS_NVME_ERROR);
+		CU_ASSERT(ios[i]->internal.error.nvme.sc == SPDK_NVME_SC_CAPACITY_EXCEEDED);
+		free(ios[i]);
+	}
+	ut_check_value(base, "log", "aa");
+
+	/* Failed submissions fail the callers */
+	base->submit_rc = -EIO;
+	ios[0] = ut_append_start(append, ch, "log", "dd");
+	CU_ASSERT(ios[0]->internal.status == SPDK_BDEV_IO_STATUS_PENDING);
+	ut_kv_poll();
+	ut_check_done(ios[0], SPDK_BDEV_IO_STATUS_FAILED);
+	ios[0] = ut_start(append, ch, SPDK_BDEV_IO_KV_STORE, "key", "value", 0);
+	ut_check_done(ios[0], SPDK_BDEV_IO_STATUS_FAILED);
+	base->submit_rc = 0;
+
+	/* Submissions wait for a bdev_io when the base bdev has none */
+	base->submit_rc = -ENOMEM;
+	ios[0] = ut_append_start(append, ch, "log", "ee");
+	ios[1] = ut_start(append, ch, SPDK_BDEV_IO_KV_STORE, "key", "value", 0);
+	CU_ASSERT(!TAILQ_EMPTY(&g_ut_kv_io_wait));
+	base->submit_rc = 0;
+	ut_kv_poll();
+	ut_check_done(ios[0], SPDK_BDEV_IO_STATUS_SUCCESS);
+	ut_check_done(ios[1], SPDK_BDEV_IO_STATUS_SUCCESS);
+	ut_check_value(base, "log", "aaee");
+	CU_ASSERT(ut_kv_base_get(base, "key", &len) != NULL);
+
+	spdk_put_io_channel(ch);
+	ut_append_delete(append);
+	ut_kv_base_destroy(base);
+}
+
+static void
+test_hotremove(void)
+{
+	struct ut_kv_base *base = ut_kv_base_create("base0");
+	uint32_t unregistered = g_ut_kv_unregistered;
+
+	ut_append_create(0, 0);
+	ut_kv_base_remove(base);
+	ut_kv_poll();
+	CU_ASSERT(spdk_bdev_get_by_name("append0") == NULL);
+	CU_ASSERT(g_ut_kv_unregistered == unregistered + 1);
+	CU_ASSERT(base->open_count == 0);
+	CU_ASSERT(base->bdev.internal.claim_type == SPDK_BDEV_CLAIM_NONE);
+	ut_kv_base_destroy(base);
+
+	/* The bdev is re-created when its base bdev comes back */
+	base = ut_kv_base_create("base0");
+	vbdev_kv_append_examine(&base->bdev);
+	SPDK_CU_ASSERT_FATAL(spdk_bdev_get_by_name("append0") != NULL);
+	ut_append_delete(spdk_bdev_get_by_name("append0")->ctxt);
+	ut_kv_base_destroy(base);
+}
+
+int
+main(int argc, char **argv)
+{
+	CU_pSuite	suite = NULL;
+	unsigned int	num_failures;
+
+	CU_set_error_action(CUEA_ABORT);
+	CU_initialize_registry();
+
+	suite = CU_add_suite("kv_append", NULL, NULL);
+
+	CU_ADD_TEST(suite, test_create_delete);
+	CU_ADD_TEST(suite, test_merge);
+	CU_ADD_TEST(suite, test_flush_timer);
+	CU_ADD_TEST(suite, test_flush);
+	CU_ADD_TEST(suite, test_errors);
+	CU_ADD_TEST(suite, test_hotremove);
+
+	g_thread = spdk_thread_create("test", NULL);
+	spdk_set_thread(g_thread);
+
+	CU_basic_set_mode(CU_BRM_VERBOSE);
+	CU_basic_run_tests();
+	num_failures = CU_get_number_of_failures();
+
+	vbdev_kv_append_finish();
+	spdk_thread_exit(g_thread);
+	while (!spdk_thread_is_exited(g_thread)) {
+		spdk_thread_poll(g_thread, 0, 0);
+	}
+	spdk_thread_destroy(g_thread);
+
+	CU_cleanup_registry();
+
+	return num_failures;
+}
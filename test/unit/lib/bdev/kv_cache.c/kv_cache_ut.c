@@ -0,0 +1,794 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+#include "spdk/stdinc.h"
+#include "spdk_cunit.h"
+#include "spdk/env.h"
+#include "spdk_internal/mock.h"
+#include "thread/thread_internal.h"
+#include "common/lib/test_env.c"
+#include "bdev/kv_cache/vbdev_kv_cache.c"
+#include "common/lib/test_bdev_kv.c"
+
+static struct spdk_thread *g_thread;
+static int g_delete_rc;
+static bool g_delete_done;
+
+static void
+ut_delete_done(void *cb_arg, int rc)
+{
+	g_delete_rc = rc;
+	g_delete_done = true;
+}
+
+static struct vbdev_kv_cache *
+ut_cache_create(struct vbdev_kv_cache_opts *opts)
+{
+	struct spdk_bdev *bdev;
+	int rc;
+
+	rc = bdev_kv_cache_create(opts);
+	CU_ASSERT(rc == 0);
+	ut_kv_poll();
+	bdev = spdk_bdev_get_by_name(opts->name);
+	SPDK_CU_ASSERT_FATAL(bdev != NULL);
+
+	return bdev->ctxt;
+}
+
+static void
+ut_cache_delete(struct vbdev_kv_cache *cache)
+{
+	g_delete_done = false;
+	bdev_kv_cache_delete(cache->bdev.name, ut_delete_done, NULL);
+	ut_kv_poll();
+	CU_ASSERT(g_delete_done == true);
+	CU_ASSERT(g_delete_rc == 0);
+}
+
+/* Submit a single-iov KV I/O to the cache and return its NVMe status code. */
+static int
+ut_submit(struct vbdev_kv_cache *cache, struct spdk_io_channel *ch, enum spdk_bdev_io_type type,
+	  const char *key, void *buf, uint64_t len, uint32_t *cdw0)
+{
+	struct spdk_bdev_io *bdev_io;
+	int sc;
+
+	bdev_io = ut_kv_vbdev_io(&cache->bdev, sizeof(struct kv_cache_bdev_io), type, key, buf,
+				 len);
+	sc = ut_kv_vbdev_submit(ch, bdev_io);
+	if (cdw0 != NULL) {
+		*cdw0 = bdev_io->internal.error.nvme.cdw0;
+	}
+	free(bdev_io);
+
+	return sc;
+}
+
+/* Send a SELECT query on a key. Returns its NVMe status code and the select id in id. */
+static int
+ut_send_select(struct vbdev_kv_cache *cache, struct spdk_io_channel *ch, const char *key,
+	       const char *query, uint32_t *id)
+{
+	return ut_submit(cache, ch, SPDK_BDEV_IO_KV_SEND_SELECT, key, (void *)query, strlen(query),
+			 id);
+}
+
+static int
+ut_retrieve_select(struct vbdev_kv_cache *cache, struct spdk_io_channel *ch, uint32_t id,
+		   void *buf, uint64_t len, uint64_t offset, uint8_t options, uint32_t *cdw0)
+{
+	struct spdk_bdev_io *bdev_io;
+	int sc;
+
+	bdev_io = ut_kv_vbdev_io(&cache->bdev, sizeof(struct kv_cache_bdev_io),
+				 SPDK_BDEV_IO_KV_RETRIEVE_SELECT, NULL, buf, len);
+	bdev_io->u.bdev.nvme_kv.select_id = id;
+	bdev_io->u.bdev.nvme_kv.offset = offset;
+	bdev_io->u.bdev.nvme_kv.options = options;
+	sc = ut_kv_vbdev_submit(ch, bdev_io);
+	if (cdw0 != NULL) {
+		*cdw0 = bdev_io->internal.error.nvme.cdw0;
+	}
+	free(bdev_io);
+
+	return sc;
+}
+
+static void
+ut_stats(struct vbdev_kv_cache *cache, struct vbdev_kv_cache_stats *stats)
+{
+	int rc;
+
+	rc = bdev_kv_cache_get_stats(cache->bdev.name, stats);
+	CU_ASSERT(rc == 0);
+}
+
+static void
+test_create_delete(void)
+{
+	struct vbdev_kv_cache_opts opts = {
+		.name = "cache0",
+		.base_bdev_name = "base0",
+		.capacity = 1024 * 1024,
+	};
+	struct vbdev_kv_cache *cache;
+	struct ut_kv_base *base;
+	int rc;
+
+	/* Too small to hold an entry in each shard */
+	opts.capacity = 16;
+	rc = bdev_kv_cache_create(&opts);
+	CU_ASSERT(rc == -EINVAL);
+	opts.capacity = 1024 * 1024;
+
+	/* The base bdev does not exist yet, so the cache is created once it appears */
+	rc = bdev_kv_cache_create(&opts);
+	CU_ASSERT(rc == 0);
+	CU_ASSERT(spdk_bdev_get_by_name("cache0") == NULL);
+	rc = bdev_kv_cache_create(&opts);
+	CU_ASSERT(rc == -EEXIST);
+
+	base = ut_kv_base_create("base0");
+	vbdev_kv_cache_examine(&base->bdev);
+	SPDK_CU_ASSERT_FATAL(spdk_bdev_get_by_name("cache0") != NULL);
+	cache = spdk_bdev_get_by_name("cache0")->ctxt;
+	CU_ASSERT(cache->base_bdev == &base->bdev);
+	CU_ASSERT(base->open_count == 1);
+	CU_ASSERT(base->bdev.internal.claim.v1.module == &kv_cache_if);
+	CU_ASSERT(vbdev_kv_cache_io_type_supported(cache, SPDK_BDEV_IO_KV_RETRIEVE) == true);
+	CU_ASSERT(vbdev_kv_cache_io_type_supported(cache, SPDK_BDEV_IO_TYPE_READ) == false);
+
+	ut_cache_delete(cache);
+	CU_ASSERT(spdk_bdev_get_by_name("cache0") == NULL);
+	CU_ASSERT(base->open_count == 0);
+	CU_ASSERT(base->bdev.internal.claim_type == SPDK_BDEV_CLAIM_NONE);
+
+	/* Deleted caches are not re-created by examine */
+	vbdev_kv_cache_examine(&base->bdev);
+	CU_ASSERT(spdk_bdev_get_by_name("cache0") == NULL);
+
+	/* A base bdev without KV support is refused */
+	base->kv_supported = false;
+	rc = bdev_kv_cache_create(&opts);
+	CU_ASSERT(rc == -ENOTSUP);
+	CU_ASSERT(base->open_count == 0);
+	base->kv_supported = true;
+
+	ut_kv_base_destroy(base);
+}
+
+static void
+test_retrieve(void)
+{
+	struct vbdev_kv_cache_opts opts = {
+		.name = "cache0",
+		.base_bdev_name = "base0",
+		.capacity = 1024 * 1024,
+		.max_value_size = 64,
+		.write_policy = VBDEV_KV_CACHE_WRITE_AROUND,
+	};
+	struct ut_kv_base *base = ut_kv_base_create("base0");
+	struct vbdev_kv_cache_stats stats;
+	struct vbdev_kv_cache *cache;
+	struct spdk_io_channel *ch;
+	char value[128], buf[128];
+	uint32_t cdw0;
+	int sc;
+
+	cache = ut_cache_create(&opts);
+	ch = spdk_get_io_channel(cache);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+
+	memset(value, 'a', sizeof(value));
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_STORE, "key0", value, 10, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_STORE] == 1);
+
+	/* The first retrieve misses and fills the cache, the second one hits */
+	memset(buf, 0, sizeof(buf));
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, sizeof(buf), &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == 10);
+	CU_ASSERT(memcmp(buf, value, 10) == 0);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_RETRIEVE] == 1);
+
+	memset(buf, 0, sizeof(buf));
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, sizeof(buf), &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == 10);
+	CU_ASSERT(memcmp(buf, value, 10) == 0);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_RETRIEVE] == 1);
+
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_EXIST, "key0", NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_EXIST] == 0);
+
+	ut_stats(cache, &stats);
+	CU_ASSERT(stats.retrieve_hits == 1);
+	CU_ASSERT(stats.retrieve_misses == 1);
+	CU_ASSERT(stats.exist_hits == 1);
+	CU_ASSERT(stats.insertions == 1);
+	CU_ASSERT(stats.num_entries == 1);
+
+	/* A retrieve that did not get the whole value does not fill the cache */
+	ut_kv_base_put(base, "key1", 4, value, 20, false);
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key1", buf, 8, &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == 20);
+	ut_stats(cache, &stats);
+	CU_ASSERT(stats.num_entries == 1);
+
+	/* Nor does a value larger than max_value_size */
+	ut_kv_base_put(base, "key2", 4, value, 100, false);
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key2", buf, sizeof(buf), &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == 100);
+	ut_stats(cache, &stats);
+	CU_ASSERT(stats.num_entries == 1);
+
+	/* Write around: a store drops the cached value and the next retrieve reads the new one */
+	memset(value, 'b', sizeof(value));
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_STORE, "key0", value, 12, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	ut_stats(cache, &stats);
+	CU_ASSERT(stats.num_entries == 0);
+	CU_ASSERT(stats.invalidations == 1);
+
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, sizeof(buf), &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == 12);
+	CU_ASSERT(memcmp(buf, value, 12) == 0);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_RETRIEVE] == 4);
+
+	/* A delete drops the key too */
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_DELETE, "key0", NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+
+	spdk_put_io_channel(ch);
+	ut_cache_delete(cache);
+	ut_kv_base_destroy(base);
+}
+
+static void
+test_write_through(void)
+{
+	struct vbdev_kv_cache_opts opts = {
+		.name = "cache0",
+		.base_bdev_name = "base0",
+		.capacity = 1024 * 1024,
+		.write_policy = VBDEV_KV_CACHE_WRITE_THROUGH,
+	};
+	struct ut_kv_base *base = ut_kv_base_create("base0");
+	struct spdk_bdev_io *retrieve_io, *store_io;
+	struct vbdev_kv_cache *cache;
+	struct spdk_io_channel *ch;
+	char value[16], buf[16];
+	int sc;
+
+	cache = ut_cache_create(&opts);
+	ch = spdk_get_io_channel(cache);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+
+	/* A store caches the stored value */
+	memset(value, 'a', sizeof(value));
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_STORE, "key0", value, sizeof(value), NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(memcmp(buf, value, sizeof(value)) == 0);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_RETRIEVE] == 0);
+
+	/* An append only drops it, as the cache does not know the whole value */
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_DELETE, "key0", NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	ut_kv_base_put(base, "key1", 4, value, 8, false);
+	store_io = ut_kv_vbdev_io(&cache->bdev, sizeof(struct kv_cache_bdev_io),
+				  SPDK_BDEV_IO_KV_STORE, "key1", value, 8);
+	store_io->u.bdev.nvme_kv.options = NVME_KV_STORE_CMD_OPTION_APPEND;
+	sc = ut_kv_vbdev_submit(ch, store_io);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	free(store_io);
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key1", buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_RETRIEVE] == 1);
+
+	/*
+	 * A retrieve that misses while a store of the same key is outstanding must
+	 * not cache the old value once it completes after the store was submitted.
+	 */
+	ut_kv_base_put(base, "key2", 4, "old", 3, false);
+	retrieve_io = ut_kv_vbdev_io(&cache->bdev, sizeof(struct kv_cache_bdev_io),
+				     SPDK_BDEV_IO_KV_RETRIEVE, "key2", buf, sizeof(buf));
+	store_io = ut_kv_vbdev_io(&cache->bdev, sizeof(struct kv_cache_bdev_io),
+				  SPDK_BDEV_IO_KV_STORE, "key2", "new", 3);
+	vbdev_kv_cache_submit_request(ch, retrieve_io);
+	vbdev_kv_cache_submit_request(ch, store_io);
+	CU_ASSERT(ut_kv_num_outstanding() == 2);
+	ut_kv_poll();
+	CU_ASSERT(retrieve_io->internal.status == SPDK_BDEV_IO_STATUS_SUCCESS);
+	CU_ASSERT(store_io->internal.status == SPDK_BDEV_IO_STATUS_SUCCESS);
+	CU_ASSERT(memcmp(buf, "old", 3) == 0);
+	free(retrieve_io);
+	free(store_io);
+
+	/* Only the stored value made it into the cache */
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key2", buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(memcmp(buf, "new", 3) == 0);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_RETRIEVE] == 2);
+
+	spdk_put_io_channel(ch);
+	ut_cache_delete(cache);
+	ut_kv_base_destroy(base);
+}
+
+static void
+test_errors(void)
+{
+	struct vbdev_kv_cache_opts opts = {
+		.name = "cache0",
+		.base_bdev_name = "base0",
+		.capacity = 1024 * 1024,
+	};
+	struct ut_kv_base *base = ut_kv_base_create("base0");
+	struct vbdev_kv_cache_stats stats;
+	struct spdk_bdev_io *bdev_io;
+	struct vbdev_kv_cache *cache;
+	struct spdk_io_channel *ch;
+	char value[16], buf[16];
+	int sc;
+
+	cache = ut_cache_create(&opts);
+	ch = spdk_get_io_channel(cache);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+	memset(value, 'a', sizeof(value));
+	ut_kv_base_put(base, "key0", 4, value, sizeof(value), false);
+
+	/* A failed retrieve passes the status on and caches nothing */
+	base->fail_sc = SPDK_NVME_SC_DATA_TRANSFER_ERROR;
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_DATA_TRANSFER_ERROR);
+	base->fail_sc = 0;
+	ut_stats(cache, &stats);
+	CU_ASSERT(stats.num_entries == 0);
+
+	/* Keys that do not exist are not cached either */
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key1", buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_EXIST, "key1", NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+	ut_stats(cache, &stats);
+	CU_ASSERT(stats.num_entries == 0);
+
+	/* A submission failure fails the I/O */
+	base->submit_rc = -EIO;
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == -1);
+	base->submit_rc = 0;
+
+	/* Out of resources, the I/O waits and is submitted again */
+	base->submit_rc = -ENOMEM;
+	bdev_io = ut_kv_vbdev_io(&cache->bdev, sizeof(struct kv_cache_bdev_io),
+				 SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, sizeof(buf));
+	vbdev_kv_cache_submit_request(ch, bdev_io);
+	CU_ASSERT(bdev_io->internal.status == SPDK_BDEV_IO_STATUS_PENDING);
+	CU_ASSERT(!TAILQ_EMPTY(&g_ut_kv_io_wait));
+	base->submit_rc = 0;
+	ut_kv_poll();
+	CU_ASSERT(bdev_io->internal.status == SPDK_BDEV_IO_STATUS_SUCCESS);
+	CU_ASSERT(memcmp(buf, value, sizeof(value)) == 0);
+	free(bdev_io);
+
+	/* Block I/O is not supported */
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_TYPE_READ, NULL, buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == -1);
+
+	spdk_put_io_channel(ch);
+	ut_cache_delete(cache);
+	ut_kv_base_destroy(base);
+}
+
+static void
+test_hotremove(void)
+{
+	struct vbdev_kv_cache_opts opts = {
+		.name = "cache0",
+		.base_bdev_name = "base0",
+		.capacity = 1024 * 1024,
+	};
+	struct ut_kv_base *base = ut_kv_base_create("base0");
+	uint32_t unregistered = g_ut_kv_unregistered;
+
+	ut_cache_create(&opts);
+	ut_kv_base_remove(base);
+	ut_kv_poll();
+	CU_ASSERT(spdk_bdev_get_by_name("cache0") == NULL);
+	CU_ASSERT(g_ut_kv_unregistered == unregistered + 1);
+	CU_ASSERT(base->open_count == 0);
+	CU_ASSERT(base->bdev.internal.claim_type == SPDK_BDEV_CLAIM_NONE);
+	ut_kv_base_destroy(base);
+
+	/* The cache is re-created when its base bdev comes back */
+	base = ut_kv_base_create("base0");
+	vbdev_kv_cache_examine(&base->bdev);
+	CU_ASSERT(spdk_bdev_get_by_name("cache0") != NULL);
+	ut_cache_delete(spdk_bdev_get_by_name("cache0")->ctxt);
+	ut_kv_base_destroy(base);
+}
+
+static void
+test_filter(void)
+{
+	struct vbdev_kv_cache_opts opts = {
+		.name = "cache0",
+		.base_bdev_name = "base0",
+		.capacity = 1024 * 1024,
+		.write_policy = VBDEV_KV_CACHE_WRITE_AROUND,
+		.filter_keys = 1024,
+	};
+	struct ut_kv_base *base = ut_kv_base_create("base0");
+	struct vbdev_kv_cache_stats stats;
+	struct vbdev_kv_cache *cache;
+	struct spdk_io_channel *ch;
+	char key[16], buf[16];
+	int i, rc, sc;
+
+	for (i = 0; i < 10; i++) {
+		snprintf(key, sizeof(key), "key%d", i);
+		ut_kv_base_put(base, key, strlen(key), "value", 5, false);
+	}
+
+	/* The filter is only used once the key listing is done */
+	rc = bdev_kv_cache_create(&opts);
+	CU_ASSERT(rc == 0);
+	SPDK_CU_ASSERT_FATAL(spdk_bdev_get_by_name("cache0") != NULL);
+	cache = spdk_bdev_get_by_name("cache0")->ctxt;
+	ch = spdk_get_io_channel(cache);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+	ut_stats(cache, &stats);
+	CU_ASSERT(stats.filter_ready == false);
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_EXIST, "absent", NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_EXIST] == 1);
+	ut_stats(cache, &stats);
+	CU_ASSERT(stats.filter_ready == true);
+
+	/* Keys the filter does not know are answered without asking the base bdev */
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_RETRIEVE, "absent", buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_EXIST, "absent", NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_RETRIEVE] == 0);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_EXIST] == 1);
+	ut_stats(cache, &stats);
+	CU_ASSERT(stats.filter_negatives == 2);
+
+	/* Listed keys go to the base bdev */
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_EXIST, "key3", NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_EXIST] == 2);
+
+	/* So do stored ones, and deleted ones are forgotten */
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_STORE, "new0", "value", 5, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_EXIST, "new0", NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_EXIST] == 3);
+
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_DELETE, "new0", NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_EXIST, "new0", NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_EXIST] == 3);
+
+	/* A failed delete leaves the key counted */
+	base->fail_sc = SPDK_NVME_SC_DATA_TRANSFER_ERROR;
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_DELETE, "key3", NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_DATA_TRANSFER_ERROR);
+	base->fail_sc = 0;
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_EXIST, "key3", NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_EXIST] == 4);
+
+	/* Keys the filter let through in vain are counted */
+	kv_cache_filter_add(cache, "ghost", 5);
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_RETRIEVE, "ghost", buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_RETRIEVE] == 1);
+	ut_stats(cache, &stats);
+	CU_ASSERT(stats.filter_false_positives == 1);
+
+	spdk_put_io_channel(ch);
+	ut_cache_delete(cache);
+
+	/* If the key listing fails, every lookup goes to the base bdev */
+	base->iter_rc = -EIO;
+	cache = ut_cache_create(&opts);
+	ch = spdk_get_io_channel(cache);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+	ut_stats(cache, &stats);
+	CU_ASSERT(stats.filter_ready == false);
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_EXIST, "absent", NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_EXIST] == 5);
+	base->iter_rc = 0;
+
+	spdk_put_io_channel(ch);
+	ut_cache_delete(cache);
+	ut_kv_base_destroy(base);
+}
+
+static void
+test_filter_hotremove(void)
+{
+	struct vbdev_kv_cache_opts opts = {
+		.name = "cache0",
+		.base_bdev_name = "base0",
+		.capacity = 1024 * 1024,
+		.filter_keys = 1024,
+	};
+	struct ut_kv_base *base = ut_kv_base_create("base0");
+	uint32_t unregistered = g_ut_kv_unregistered;
+	int rc;
+
+	/* Removed while the key listing is running, the listing is cancelled first */
+	rc = bdev_kv_cache_create(&opts);
+	CU_ASSERT(rc == 0);
+	CU_ASSERT(!TAILQ_EMPTY(&g_ut_kv_iters));
+	ut_kv_base_remove(base);
+	CU_ASSERT(g_ut_kv_unregistered == unregistered);
+	CU_ASSERT(base->open_count == 1);
+	ut_kv_poll();
+	CU_ASSERT(spdk_bdev_get_by_name("cache0") == NULL);
+	CU_ASSERT(g_ut_kv_unregistered == unregistered + 1);
+	CU_ASSERT(base->open_count == 0);
+	CU_ASSERT(base->bdev.internal.claim_type == SPDK_BDEV_CLAIM_NONE);
+
+	/* And removed after it finished */
+	vbdev_kv_cache_examine(&base->bdev);
+	ut_kv_poll();
+	CU_ASSERT(spdk_bdev_get_by_name("cache0") != NULL);
+	ut_kv_base_remove(base);
+	ut_kv_poll();
+	CU_ASSERT(spdk_bdev_get_by_name("cache0") == NULL);
+	CU_ASSERT(g_ut_kv_unregistered == unregistered + 2);
+	CU_ASSERT(base->open_count == 0);
+
+	vbdev_kv_cache_finish();
+	ut_kv_base_destroy(base);
+}
+
+static void
+test_select_cache(void)
+{
+	struct vbdev_kv_cache_opts opts = {
+		.name = "cache0",
+		.base_bdev_name = "base0",
+		.capacity = 1024 * 1024,
+		.select_capacity = 1024 * 1024,
+		.max_select_result_size = 16,
+	};
+	struct ut_kv_base *base = ut_kv_base_create("base0");
+	struct vbdev_kv_cache_stats stats;
+	struct spdk_bdev_io *bdev_io;
+	struct vbdev_kv_cache *cache;
+	struct spdk_io_channel *ch;
+	uint8_t keep = NVME_KV_SELECT_CMD_OPTION_DO_NOT_FREE_IF_NOT_ALL_DATA_FETCHED;
+	uint32_t id, id2, cdw0;
+	char buf[32];
+	int sc;
+
+	ut_kv_base_put(base, "key0", 4, "a,b,c", 5, false);
+	cache = ut_cache_create(&opts);
+	ch = spdk_get_io_channel(cache);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+
+	/* A miss sends the query and fetches the whole result */
+	sc = ut_send_select(cache, ch, "key0", "SELECT * FROM s3object", &id);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(id != 0);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_SEND_SELECT] == 1);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_RETRIEVE_SELECT] == 1);
+	CU_ASSERT(ut_kv_base_select_find(base, 1) == NULL);
+	ut_stats(cache, &stats);
+	CU_ASSERT(stats.select_misses == 1);
+	CU_ASSERT(stats.select_insertions == 1);
+	CU_ASSERT(stats.select_entries == 1);
+
+	/* The result is read from the cache, in parts if asked to, and the id freed at the end */
+	memset(buf, 0, sizeof(buf));
+	sc = ut_retrieve_select(cache, ch, id, buf, 2, 0, keep, &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == 5);
+	CU_ASSERT(memcmp(buf, "a,", 2) == 0);
+	sc = ut_retrieve_select(cache, ch, id, buf + 2, sizeof(buf) - 2, 2, keep, &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(memcmp(buf, "a,b,c", 5) == 0);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_RETRIEVE_SELECT] == 1);
+	sc = ut_retrieve_select(cache, ch, id, buf, sizeof(buf), 0, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_INVALID_FIELD);
+
+	/* The same query, spaced differently, hits */
+	sc = ut_send_select(cache, ch, "key0", "  SELECT *\tFROM   s3object ", &id);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_SEND_SELECT] == 1);
+	sc = ut_send_select(cache, ch, "key0", "SELECT * FROM s3object", &id2);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(id2 != id);
+	ut_stats(cache, &stats);
+	CU_ASSERT(stats.select_hits == 2);
+
+	/* Reads past the end of the result are refused */
+	sc = ut_retrieve_select(cache, ch, id2, buf, sizeof(buf), 6, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_INVALID_FIELD);
+
+	/* A store drops the results of its key; open ids still read the old one */
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_STORE, "key0", "d,e", 3, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	ut_stats(cache, &stats);
+	CU_ASSERT(stats.select_invalidations == 1);
+	CU_ASSERT(stats.select_entries == 0);
+	memset(buf, 0, sizeof(buf));
+	sc = ut_retrieve_select(cache, ch, id, buf, sizeof(buf), 0, 0, &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == 5);
+	CU_ASSERT(memcmp(buf, "a,b,c", 5) == 0);
+
+	sc = ut_send_select(cache, ch, "key0", "SELECT * FROM s3object", &id);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_SEND_SELECT] == 2);
+	memset(buf, 0, sizeof(buf));
+	sc = ut_retrieve_select(cache, ch, id, buf, sizeof(buf), 0, 0, &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == 3);
+	CU_ASSERT(memcmp(buf, "d,e", 3) == 0);
+
+	/* A result fetched while its key was written is not cached */
+	bdev_io = ut_kv_vbdev_io(&cache->bdev, sizeof(struct kv_cache_bdev_io),
+				 SPDK_BDEV_IO_KV_SEND_SELECT, "key0", "SELECT _1", 9);
+	vbdev_kv_cache_submit_request(ch, bdev_io);
+	sc = ut_submit(cache, ch, SPDK_BDEV_IO_KV_DELETE, "key0", NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(bdev_io->internal.status == SPDK_BDEV_IO_STATUS_SUCCESS);
+	id = bdev_io->internal.error.nvme.cdw0;
+	sc = ut_retrieve_select(cache, ch, id, buf, sizeof(buf), 0, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	free(bdev_io);
+	ut_stats(cache, &stats);
+	CU_ASSERT(stats.select_entries == 0);
+
+	spdk_put_io_channel(ch);
+	ut_cache_delete(cache);
+	ut_kv_base_destroy(base);
+}
+
+static void
+test_select_cache_errors(void)
+{
+	struct vbdev_kv_cache_opts opts = {
+		.name = "cache0",
+		.base_bdev_name = "base0",
+		.capacity = 1024 * 1024,
+		.select_capacity = 1024 * 1024,
+		.max_select_result_size = 16,
+	};
+	struct ut_kv_base *base = ut_kv_base_create("base0");
+	struct vbdev_kv_cache_stats stats;
+	struct spdk_bdev_io *bdev_io;
+	struct vbdev_kv_cache *cache;
+	struct spdk_io_channel *ch;
+	uint32_t id, id2, cdw0;
+	char buf[32];
+	int sc;
+
+	ut_kv_base_put(base, "key0", 4, "a,b,c", 5, false);
+	ut_kv_base_put(base, "big", 3, "0123456789012345678901234", 25, false);
+	cache = ut_cache_create(&opts);
+	ch = spdk_get_io_channel(cache);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+
+	/* A failed query completes with its status and opens no id */
+	base->fail_sc = SPDK_NVME_SC_INVALID_FIELD;
+	sc = ut_send_select(cache, ch, "key0", "SELECT * FROM s3object", &id);
+	CU_ASSERT(sc == SPDK_NVME_SC_INVALID_FIELD);
+	base->fail_sc = 0;
+	CU_ASSERT(cache->selects.num_ids == 0);
+	sc = ut_send_select(cache, ch, "nokey", "SELECT * FROM s3object", &id);
+	CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+	CU_ASSERT(cache->selects.num_ids == 0);
+
+	/* Results larger than max_select_result_size are read from the base bdev */
+	sc = ut_send_select(cache, ch, "big", "SELECT * FROM s3object", &id);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	ut_stats(cache, &stats);
+	CU_ASSERT(stats.select_entries == 0);
+	memset(buf, 0, sizeof(buf));
+	sc = ut_retrieve_select(cache, ch, id, buf, sizeof(buf), 0, 0, &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == 25);
+	CU_ASSERT(memcmp(buf, "0123456789012345678901234", 25) == 0);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_RETRIEVE_SELECT] == 2);
+	CU_ASSERT(cache->selects.num_ids == 0);
+
+	/* So are results whose fetch failed */
+	bdev_io = ut_kv_vbdev_io(&cache->bdev, sizeof(struct kv_cache_bdev_io),
+				 SPDK_BDEV_IO_KV_SEND_SELECT, "key0", "SELECT * FROM s3object", 22);
+	vbdev_kv_cache_submit_request(ch, bdev_io);
+	CU_ASSERT(ut_kv_poll_one() == true);
+	base->fail_sc = SPDK_NVME_SC_DATA_TRANSFER_ERROR;
+	CU_ASSERT(ut_kv_poll_one() == true);
+	base->fail_sc = 0;
+	ut_kv_poll();
+	CU_ASSERT(bdev_io->internal.status == SPDK_BDEV_IO_STATUS_SUCCESS);
+	id = bdev_io->internal.error.nvme.cdw0;
+	free(bdev_io);
+	ut_stats(cache, &stats);
+	CU_ASSERT(stats.select_entries == 0);
+	memset(buf, 0, sizeof(buf));
+	sc = ut_retrieve_select(cache, ch, id, buf, sizeof(buf), 0, 0, &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(memcmp(buf, "a,b,c", 5) == 0);
+
+	/* Ids that were never handed out are refused */
+	sc = ut_retrieve_select(cache, ch, 1000, buf, sizeof(buf), 0, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_INVALID_FIELD);
+
+	/* A hot removal frees the open ids, cached or not */
+	sc = ut_send_select(cache, ch, "key0", "SELECT * FROM s3object", &id);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	sc = ut_send_select(cache, ch, "big", "SELECT * FROM s3object", &id2);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cache->selects.num_ids == 2);
+	spdk_put_io_channel(ch);
+	ut_kv_base_remove(base);
+	ut_kv_poll();
+	CU_ASSERT(spdk_bdev_get_by_name("cache0") == NULL);
+	CU_ASSERT(base->open_count == 0);
+
+	vbdev_kv_cache_finish();
+	ut_kv_base_destroy(base);
+}
+
+int
+main(int argc, char **argv)
+{
+	CU_pSuite	suite = NULL;
+	unsigned int	num_failures;
+
+	CU_set_error_action(CUEA_ABORT);
+	CU_initialize_registry();
+
+	suite = CU_add_suite("kv_cache", NULL, NULL);
+
+	CU_ADD_TEST(suite, test_create_delete);
+	CU_ADD_TEST(suite, test_retrieve);
+	CU_ADD_TEST(suite, test_write_through);
+	CU_ADD_TEST(suite, test_errors);
+	CU_ADD_TEST(suite, test_hotremove);
+	CU_ADD_TEST(suite, test_filter);
+	CU_ADD_TEST(suite, test_filter_hotremove);
+	CU_ADD_TEST(suite, test_select_cache);
+	CU_ADD_TEST(suite, test_select_cache_errors);
+
+	g_thread = spdk_thread_create("test", NULL);
+	spdk_set_thread(g_thread);
+
+	CU_basic_set_mode(CU_BRM_VERBOSE);
+	CU_basic_run_tests();
+	num_failures = CU_get_number_of_failures();
+
+	vbdev_kv_cache_finish();
+	spdk_thread_exit(g_thread);
+	while (!spdk_thread_is_exited(g_thread)) {
+		spdk_thread_poll(g_thread, 0, 0);
+	}
+	spdk_thread_destroy(g_thread);
+
+	CU_cleanup_registry();
+
+	return num_failures;
+}
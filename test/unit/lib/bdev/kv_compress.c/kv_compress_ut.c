@@ -0,0 +1,702 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+#include "spdk/stdinc.h"
+#include "spdk_cunit.h"
+#include "spdk/env.h"
+#include "spdk_internal/mock.h"
+#include "thread/thread_internal.h"
+#include "common/lib/test_env.c"
+#include "kv_select/kv_select.c"
+#include "bdev/kv_compress/vbdev_kv_compress.c"
+#include "common/lib/test_bdev_kv.c"
+
+static struct spdk_thread *g_thread;
+static int g_delete_rc;
+static bool g_delete_done;
+
+/*
+ * Accel compression, emulated with a run-length code of (count, byte) pairs.
+ * Operations complete from a thread message, as they would from an accel module.
+ */
+static int g_ut_accel_io_device;
+/* Returned by the next submissions while not 0. */
+static int g_ut_accel_submit_rc;
+/* Status the next operations complete with while not 0. */
+static int g_ut_accel_status;
+
+struct ut_accel_task {
+	spdk_accel_completion_cb	cb_fn;
+	void				*cb_arg;
+	int				status;
+};
+
+static int
+ut_accel_create_cb(void *io_device, void *ctx_buf)
+{
+	return 0;
+}
+
+static void
+ut_accel_destroy_cb(void *io_device, void *ctx_buf)
+{
+}
+
+struct spdk_io_channel *
+spdk_accel_get_io_channel(void)
+{
+	return spdk_get_io_channel(&g_ut_accel_io_device);
+}
+
+static void
+ut_accel_task_done(void *ctx)
+{
+	struct ut_accel_task *task = ctx;
+
+	task->cb_fn(task->cb_arg, task->status);
+	free(task);
+}
+
+static void
+ut_accel_complete(spdk_accel_completion_cb cb_fn, void *cb_arg, int status)
+{
+	struct ut_accel_task *task;
+
+	task = calloc(1, sizeof(*task));
+	SPDK_CU_ASSERT_FATAL(task != NULL);
+	task->cb_fn = cb_fn;
+	task->cb_arg = cb_arg;
+	task->status = g_ut_accel_status != 0 ? g_ut_accel_status : status;
+	spdk_thread_send_msg(spdk_get_thread(), ut_accel_task_done, task);
+}
+
+int
+spdk_accel_submit_compress(struct spdk_io_channel *ch, void *dst, uint64_t nbytes,
+			   struct iovec *src_iovs, size_t src_iovcnt, uint32_t *output_size,
+			   int flags, spdk_accel_completion_cb cb_fn, void *cb_arg)
+{
+	uint8_t *src, *out = dst;
+	uint64_t src_len = 0, i, run, len = 0;
+	size_t v;
+	int status = 0;
+
+	if (g_ut_accel_submit_rc != 0) {
+		return g_ut_accel_submit_rc;
+	}
+
+	for (v = 0; v < src_iovcnt; v++) {
+		src_len += src_iovs[v].iov_len;
+	}
+	src = malloc(src_len);
+	SPDK_CU_ASSERT_FATAL(src != NULL);
+	spdk_copy_iovs_to_buf(src, src_len, src_iovs, src_iovcnt);
+
+	for (i = 0; i < src_len; i += run) {
+		run = 1;
+		while (i + run < src_len && run < UINT8_MAX && src[i + run] == src[i]) {
+			run++;
+		}
+		if (len + 2 > nbytes) {
+			status = -ENOSPC;
+			break;
+		}
+		out[len++] = run;
+		out[len++] = src[i];
+	}
+	free(src);
+
+	*output_size = len;
+	ut_accel_complete(cb_fn, cb_arg, status);
+	return 0;
+}
+
+int
+spdk_accel_submit_decompress(struct spdk_io_channel *ch, struct iovec *dst_iovs,
+			     size_t dst_iovcnt, struct iovec *src_iovs, size_t src_iovcnt,
+			     uint32_t *output_size, int flags, spdk_accel_completion_cb cb_fn,
+			     void *cb_arg)
+{
+	uint8_t *src = src_iovs[0].iov_base, *dst = dst_iovs[0].iov_base;
+	uint64_t i, len = 0;
+	int status = 0;
+
+	CU_ASSERT(src_iovcnt == 1);
+	CU_ASSERT(dst_iovcnt == 1);
+	if (g_ut_accel_submit_rc != 0) {
+		return g_ut_accel_submit_rc;
+	}
+
+	for (i = 0; i + 1 < src_iovs[0].iov_len; i += 2) {
+		if (len + src[i] > dst_iovs[0].iov_len) {
+			status = -ENOSPC;
+			break;
+		}
+		memset(dst + len, src[i + 1], src[i]);
+		len += src[i];
+	}
+
+	*output_size = len;
+	ut_accel_complete(cb_fn, cb_arg, status);
+	return 0;
+}
+
+static void
+ut_delete_done(void *cb_arg, int rc)
+{
+	g_delete_rc = rc;
+	g_delete_done = true;
+}
+
+static struct vbdev_kv_compress *
+ut_compress_create(uint32_t min_size)
+{
+	struct vbdev_kv_compress_opts opts = {
+		.name = "comp0",
+		.base_bdev_name = "base0",
+		.min_size = min_size,
+	};
+	struct spdk_bdev *bdev;
+	int rc;
+
+	rc = bdev_kv_compress_create(&opts);
+	CU_ASSERT(rc == 0);
+	bdev = spdk_bdev_get_by_name("comp0");
+	SPDK_CU_ASSERT_FATAL(bdev != NULL);
+
+	return bdev->ctxt;
+}
+
+static void
+ut_compress_delete(struct vbdev_kv_compress *comp)
+{
+	g_delete_done = false;
+	bdev_kv_compress_delete(comp->bdev.name, ut_delete_done, NULL);
+	ut_kv_poll();
+	CU_ASSERT(g_delete_done == true);
+	CU_ASSERT(g_delete_rc == 0);
+}
+
+/*
+ * Submit a single-iov KV I/O to the vbdev and return its NVMe status code.
+ * select_id is only used by retrieve select.
+ */
+static int
+ut_submit_ext(struct vbdev_kv_compress *comp, struct spdk_io_channel *ch,
+	      enum spdk_bdev_io_type type, const char *key, void *buf, uint64_t len,
+	      uint64_t offset, uint8_t options, uint32_t select_id, uint32_t *cdw0)
+{
+	struct spdk_bdev_io *bdev_io;
+	int sc;
+
+	bdev_io = ut_kv_vbdev_io(&comp->bdev, sizeof(struct kv_compress_bdev_io), type, key, buf,
+				 len);
+	bdev_io->u.bdev.nvme_kv.offset = offset;
+	bdev_io->u.bdev.nvme_kv.options = options;
+	bdev_io->u.bdev.nvme_kv.select_id = select_id;
+	sc = ut_kv_vbdev_submit(ch, bdev_io);
+	if (cdw0 != NULL) {
+		*cdw0 = bdev_io->internal.error.nvme.cdw0;
+	}
+	free(bdev_io);
+
+	return sc;
+}
+
+static int
+ut_submit(struct vbdev_kv_compress *comp, struct spdk_io_channel *ch,
+	  enum spdk_bdev_io_type type, const char *key, void *buf, uint64_t len, uint32_t *cdw0)
+{
+	return ut_submit_ext(comp, ch, type, key, buf, len, 0, 0, 0, cdw0);
+}
+
+static int
+ut_store(struct vbdev_kv_compress *comp, struct spdk_io_channel *ch, const char *key,
+	 const void *value, uint64_t len)
+{
+	return ut_submit(comp, ch, SPDK_BDEV_IO_KV_STORE, key, (void *)value, len, NULL);
+}
+
+/* Header of the value stored on the base bdev under key, or NULL if it has none. */
+static const struct kv_compress_hdr *
+ut_stored_hdr(struct ut_kv_base *base, const char *key, uint32_t *len)
+{
+	const uint8_t *buf;
+
+	buf = ut_kv_base_get(base, key, len);
+	SPDK_CU_ASSERT_FATAL(buf != NULL);
+	if (*len < KV_COMPRESS_HDR_SIZE || memcmp(buf, KV_COMPRESS_MAGIC, KV_COMPRESS_MAGIC_LEN)) {
+		return NULL;
+	}
+
+	return (const struct kv_compress_hdr *)buf;
+}
+
+static void
+test_create_delete(void)
+{
+	struct vbdev_kv_compress_opts opts = {
+		.name = "comp0",
+		.base_bdev_name = "base0",
+	};
+	struct vbdev_kv_compress *comp;
+	struct ut_kv_base *base;
+	int rc;
+
+	opts.base_bdev_name = NULL;
+	rc = bdev_kv_compress_create(&opts);
+	CU_ASSERT(rc == -EINVAL);
+	opts.base_bdev_name = "base0";
+
+	/* Creation waits for the base bdev */
+	rc = bdev_kv_compress_create(&opts);
+	CU_ASSERT(rc == 0);
+	CU_ASSERT(spdk_bdev_get_by_name("comp0") == NULL);
+	rc = bdev_kv_compress_create(&opts);
+	CU_ASSERT(rc == -EEXIST);
+	base = ut_kv_base_create("base0");
+	vbdev_kv_compress_examine(&base->bdev);
+	SPDK_CU_ASSERT_FATAL(spdk_bdev_get_by_name("comp0") != NULL);
+	comp = spdk_bdev_get_by_name("comp0")->ctxt;
+	CU_ASSERT(comp->min_size == KV_COMPRESS_DEFAULT_MIN_SIZE);
+	CU_ASSERT(comp->bdev.required_alignment == base->bdev.required_alignment);
+	CU_ASSERT(base->open_count == 1);
+	CU_ASSERT(base->bdev.internal.claim.v1.module == &kv_compress_if);
+	CU_ASSERT(vbdev_kv_compress_io_type_supported(comp, SPDK_BDEV_IO_KV_STORE) == true);
+	CU_ASSERT(vbdev_kv_compress_io_type_supported(comp, SPDK_BDEV_IO_KV_SEND_SELECT) == true);
+	CU_ASSERT(vbdev_kv_compress_io_type_supported(comp, SPDK_BDEV_IO_KV_BATCH) == false);
+	CU_ASSERT(vbdev_kv_compress_io_type_supported(comp, SPDK_BDEV_IO_TYPE_READ) == false);
+
+	/* Deleted bdevs are not created again when their base bdev comes back */
+	ut_compress_delete(comp);
+	CU_ASSERT(spdk_bdev_get_by_name("comp0") == NULL);
+	CU_ASSERT(base->open_count == 0);
+	CU_ASSERT(base->bdev.internal.claim_type == SPDK_BDEV_CLAIM_NONE);
+	vbdev_kv_compress_examine(&base->bdev);
+	CU_ASSERT(spdk_bdev_get_by_name("comp0") == NULL);
+
+	g_delete_done = false;
+	bdev_kv_compress_delete("comp0", ut_delete_done, NULL);
+	CU_ASSERT(g_delete_done == true);
+	CU_ASSERT(g_delete_rc == -ENODEV);
+
+	/* The base bdev needs to support KV commands */
+	base->kv_supported = false;
+	rc = bdev_kv_compress_create(&opts);
+	CU_ASSERT(rc == -ENOTSUP);
+	CU_ASSERT(base->open_count == 0);
+	CU_ASSERT(base->bdev.internal.claim_type == SPDK_BDEV_CLAIM_NONE);
+	ut_kv_base_destroy(base);
+}
+
+static void
+test_store_retrieve(void)
+{
+	struct ut_kv_base *base = ut_kv_base_create("base0");
+	const struct kv_compress_hdr *hdr;
+	struct vbdev_kv_compress_stats stats;
+	struct vbdev_kv_compress *comp;
+	struct spdk_io_channel *ch;
+	uint8_t value[512], raw[300], buf[1024];
+	uint8_t magic[] = { '\0', 'K', 'V', 'Z', 'a', 'b', 'c' };
+	uint32_t cdw0, len;
+	size_t i;
+	int sc;
+
+	comp = ut_compress_create(0);
+	ch = spdk_get_io_channel(comp);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+
+	/* Short values are stored as they are */
+	sc = ut_store(comp, ch, "short", "hello", 5);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(ut_stored_hdr(base, "short", &len) == NULL);
+	CU_ASSERT(len == 5);
+	sc = ut_submit(comp, ch, SPDK_BDEV_IO_KV_RETRIEVE, "short", buf, sizeof(buf), &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == 5);
+	CU_ASSERT(memcmp(buf, "hello", 5) == 0);
+
+	/* Values that shrink are stored compressed, behind a header */
+	memset(value, 'a', 200);
+	memset(value + 200, 'b', sizeof(value) - 200);
+	sc = ut_store(comp, ch, "big", value, sizeof(value));
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	hdr = ut_stored_hdr(base, "big", &len);
+	SPDK_CU_ASSERT_FATAL(hdr != NULL);
+	CU_ASSERT(hdr->version == KV_COMPRESS_VERSION);
+	CU_ASSERT(hdr->codec == KV_COMPRESS_CODEC_DEFLATE);
+	CU_ASSERT(hdr->orig_len == sizeof(value));
+	CU_ASSERT(len == KV_COMPRESS_HDR_SIZE + 6);
+	CU_ASSERT(bdev_kv_compress_get_stats("comp0", &stats) == 0);
+	CU_ASSERT(stats.stores_compressed == 1);
+	CU_ASSERT(stats.stores_raw == 1);
+	CU_ASSERT(stats.bytes_in == 5 + sizeof(value));
+	CU_ASSERT(stats.bytes_out == 5 + len);
+
+	/* Reads return the original value and length */
+	memset(buf, 0, sizeof(buf));
+	sc = ut_submit(comp, ch, SPDK_BDEV_IO_KV_RETRIEVE, "big", buf, sizeof(buf), &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == sizeof(value));
+	CU_ASSERT(memcmp(buf, value, sizeof(value)) == 0);
+
+	/* A buffer too small for the stored value has it fetched whole */
+	memset(buf, 0, sizeof(buf));
+	sc = ut_submit(comp, ch, SPDK_BDEV_IO_KV_RETRIEVE, "big", buf, 16, &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == sizeof(value));
+	CU_ASSERT(memcmp(buf, value, 16) == 0);
+	CU_ASSERT(buf[16] == 0);
+
+	/* Reads at an offset read the header first */
+	memset(buf, 0, sizeof(buf));
+	base->num_ios[SPDK_BDEV_IO_KV_RETRIEVE] = 0;
+	sc = ut_submit_ext(comp, ch, SPDK_BDEV_IO_KV_RETRIEVE, "big", buf, 64, 500, 0, 0, &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == sizeof(value));
+	CU_ASSERT(memcmp(buf, value + 500, 12) == 0);
+	CU_ASSERT(buf[12] == 0);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_RETRIEVE] == 2);
+	sc = ut_submit_ext(comp, ch, SPDK_BDEV_IO_KV_RETRIEVE, "big", buf, 64, 600, 0, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_INVALID_FIELD);
+	CU_ASSERT(bdev_kv_compress_get_stats("comp0", &stats) == 0);
+	CU_ASSERT(stats.retrieves_decompressed == 4);
+
+	/* Values that do not shrink are stored as they are */
+	for (i = 0; i < sizeof(raw); i++) {
+		raw[i] = 'a' + i % 26;
+	}
+	sc = ut_store(comp, ch, "raw", raw, sizeof(raw));
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(ut_stored_hdr(base, "raw", &len) == NULL);
+	CU_ASSERT(len == sizeof(raw));
+	memset(buf, 0, sizeof(buf));
+	sc = ut_submit_ext(comp, ch, SPDK_BDEV_IO_KV_RETRIEVE, "raw", buf, 10, 290, 0, 0, &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == sizeof(raw));
+	CU_ASSERT(memcmp(buf, raw + 290, 10) == 0);
+
+	/* Raw values that start with the magic are wrapped in a header */
+	sc = ut_store(comp, ch, "magic", magic, sizeof(magic));
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	hdr = ut_stored_hdr(base, "magic", &len);
+	SPDK_CU_ASSERT_FATAL(hdr != NULL);
+	CU_ASSERT(hdr->codec == KV_COMPRESS_CODEC_NONE);
+	CU_ASSERT(len == KV_COMPRESS_HDR_SIZE + sizeof(magic));
+	memset(buf, 0, sizeof(buf));
+	sc = ut_submit(comp, ch, SPDK_BDEV_IO_KV_RETRIEVE, "magic", buf, sizeof(buf), &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == sizeof(magic));
+	CU_ASSERT(memcmp(buf, magic, sizeof(magic)) == 0);
+	sc = ut_submit_ext(comp, ch, SPDK_BDEV_IO_KV_RETRIEVE, "magic", buf, 4, 4, 0, 0, &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == sizeof(magic));
+	CU_ASSERT(memcmp(buf, "abc", 3) == 0);
+
+	/* Values below min_size are not compressed */
+	comp->min_size = 1024;
+	sc = ut_store(comp, ch, "big2", value, sizeof(value));
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(ut_stored_hdr(base, "big2", &len) == NULL);
+	comp->min_size = KV_COMPRESS_DEFAULT_MIN_SIZE;
+
+	/* APPEND cannot extend a compressed value */
+	sc = ut_submit_ext(comp, ch, SPDK_BDEV_IO_KV_STORE, "big", value, sizeof(value), 0,
+			   NVME_KV_STORE_CMD_OPTION_APPEND, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_INVALID_FIELD);
+	CU_ASSERT(ut_stored_hdr(base, "big", &len) != NULL);
+
+	/* Other commands go to the base bdev */
+	sc = ut_submit(comp, ch, SPDK_BDEV_IO_KV_EXIST, "big", NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	sc = ut_submit(comp, ch, SPDK_BDEV_IO_KV_DELETE, "big", NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	sc = ut_submit(comp, ch, SPDK_BDEV_IO_KV_EXIST, "big", NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+	sc = ut_submit(comp, ch, SPDK_BDEV_IO_KV_RETRIEVE, "big", buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+
+	spdk_put_io_channel(ch);
+	ut_compress_delete(comp);
+	ut_kv_base_destroy(base);
+}
+
+static void
+test_select(void)
+{
+	struct ut_kv_base *base = ut_kv_base_create("base0");
+	char raw[] = "name,qty\napple,3\npear,7\nplum,12\n";
+	char query[] = "SELECT qty FROM s3object WHERE qty > 5";
+	uint8_t options = NVME_KV_SELECT_CMD_OUTPUT_TYPE_USE_CSV_HEADERS_INPUT;
+	uint8_t keep;
+	struct vbdev_kv_compress_stats stats;
+	struct vbdev_kv_compress *comp;
+	struct spdk_io_channel *ch;
+	char value[512], buf[512];
+	uint32_t cdw0, id, len;
+	int sc, n = 0;
+
+	comp = ut_compress_create(0);
+	ch = spdk_get_io_channel(comp);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+
+	/* Raw values are selected on the device */
+	sc = ut_store(comp, ch, "raw", raw, strlen(raw));
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	sc = ut_submit_ext(comp, ch, SPDK_BDEV_IO_KV_SEND_SELECT, "raw", query, strlen(query), 0,
+			   options, 0, &id);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT((id & KV_COMPRESS_SELECT_ID_HOST) == 0);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_SEND_SELECT] == 1);
+	CU_ASSERT(ut_kv_base_select_find(base, id) != NULL);
+	memset(buf, 0, sizeof(buf));
+	sc = ut_submit_ext(comp, ch, SPDK_BDEV_IO_KV_RETRIEVE_SELECT, NULL, buf, sizeof(buf), 0, 0,
+			   id, &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == strlen(raw));
+	CU_ASSERT(ut_kv_base_select_find(base, id) == NULL);
+
+	/* Compressed values are selected on the host */
+	n += snprintf(value + n, sizeof(value) - n, "name,qty\n");
+	n += snprintf(value + n, sizeof(value) - n, "%0100d,3\n", 0);
+	n += snprintf(value + n, sizeof(value) - n, "%0100d,7\n", 0);
+	n += snprintf(value + n, sizeof(value) - n, "%0100d,12\n", 0);
+	sc = ut_store(comp, ch, "csv", value, n);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(ut_stored_hdr(base, "csv", &len) != NULL);
+	sc = ut_submit_ext(comp, ch, SPDK_BDEV_IO_KV_SEND_SELECT, "csv", query, strlen(query), 0,
+			   options, 0, &id);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(id & KV_COMPRESS_SELECT_ID_HOST);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_SEND_SELECT] == 1);
+	CU_ASSERT(bdev_kv_compress_get_stats("comp0", &stats) == 0);
+	CU_ASSERT(stats.host_selects == 1);
+
+	memset(buf, 0, sizeof(buf));
+	keep = NVME_KV_SELECT_CMD_OPTION_DO_NOT_FREE_IF_NOT_ALL_DATA_FETCHED;
+	sc = ut_submit_ext(comp, ch, SPDK_BDEV_IO_KV_RETRIEVE_SELECT, NULL, buf, 2, 0, keep, id,
+			   &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == strlen("7\n12\n"));
+	CU_ASSERT(memcmp(buf, "7\n", 2) == 0);
+	sc = ut_submit_ext(comp, ch, SPDK_BDEV_IO_KV_RETRIEVE_SELECT, NULL, buf, sizeof(buf), 0, 0,
+			   id, &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(strcmp(buf, "7\n12\n") == 0);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_RETRIEVE_SELECT] == 1);
+
+	/* Results are freed once read, and unknown host ids are rejected */
+	sc = ut_submit_ext(comp, ch, SPDK_BDEV_IO_KV_RETRIEVE_SELECT, NULL, buf, sizeof(buf), 0, 0,
+			   id, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_INVALID_FIELD);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_RETRIEVE_SELECT] == 1);
+
+	/* Malformed queries and missing keys fail */
+	sc = ut_submit(comp, ch, SPDK_BDEV_IO_KV_SEND_SELECT, "csv", "SELECT", 6, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_INVALID_FIELD);
+	sc = ut_submit(comp, ch, SPDK_BDEV_IO_KV_SEND_SELECT, "nokey", query, strlen(query),
+		       NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+	CU_ASSERT(bdev_kv_compress_get_stats("comp0", &stats) == 0);
+	CU_ASSERT(stats.host_selects == 1);
+
+	spdk_put_io_channel(ch);
+	ut_compress_delete(comp);
+	ut_kv_base_destroy(base);
+}
+
+static void
+test_errors(void)
+{
+	struct ut_kv_base *base = ut_kv_base_create("base0");
+	struct spdk_bdev_io *bdev_io;
+	struct kv_compress_hdr hdr;
+	struct vbdev_kv_compress *comp;
+	struct spdk_io_channel *ch;
+	uint8_t value[512], value2[512], buf[1024], *stored;
+	const uint8_t *data;
+	uint32_t cdw0, len, len2;
+	int sc;
+
+	comp = ut_compress_create(0);
+	ch = spdk_get_io_channel(comp);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+	memset(value, 'a', sizeof(value));
+	memset(value2, 'b', sizeof(value2));
+
+	/* Errors of the base bdev are passed through */
+	base->fail_sc = SPDK_NVME_SC_DATA_TRANSFER_ERROR;
+	sc = ut_store(comp, ch, "key0", value, sizeof(value));
+	CU_ASSERT(sc == SPDK_NVME_SC_DATA_TRANSFER_ERROR);
+	sc = ut_submit_ext(comp, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, 8, 8, 0, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_DATA_TRANSFER_ERROR);
+	base->fail_sc = 0;
+	base->submit_rc = -EIO;
+	sc = ut_store(comp, ch, "key0", value, sizeof(value));
+	CU_ASSERT(sc == -1);
+	base->submit_rc = 0;
+
+	/* Submissions wait for a bdev_io when the base bdev has none */
+	base->submit_rc = -ENOMEM;
+	bdev_io = ut_kv_vbdev_io(&comp->bdev, sizeof(struct kv_compress_bdev_io),
+				 SPDK_BDEV_IO_KV_STORE, "key0", value, sizeof(value));
+	vbdev_kv_compress_submit_request(ch, bdev_io);
+	while (spdk_thread_poll(g_thread, 0, 0) > 0) {
+	}
+	CU_ASSERT(!TAILQ_EMPTY(&g_ut_kv_io_wait));
+	CU_ASSERT(bdev_io->internal.status == SPDK_BDEV_IO_STATUS_PENDING);
+	base->submit_rc = 0;
+	ut_kv_poll();
+	CU_ASSERT(bdev_io->internal.status == SPDK_BDEV_IO_STATUS_SUCCESS);
+	free(bdev_io);
+	CU_ASSERT(ut_stored_hdr(base, "key0", &len) != NULL);
+
+	/* Values that fail to compress are stored as they are */
+	g_ut_accel_submit_rc = -ENOMEM;
+	sc = ut_store(comp, ch, "key1", value, sizeof(value));
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	g_ut_accel_submit_rc = 0;
+	CU_ASSERT(ut_stored_hdr(base, "key1", &len) == NULL);
+	g_ut_accel_status = -EIO;
+	sc = ut_store(comp, ch, "key1", value, sizeof(value));
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	g_ut_accel_status = 0;
+	CU_ASSERT(ut_stored_hdr(base, "key1", &len) == NULL);
+
+	/* Values that fail to decompress are errors of the device */
+	g_ut_accel_status = -EIO;
+	sc = ut_submit(comp, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+	g_ut_accel_status = 0;
+	g_ut_accel_submit_rc = -ENOMEM;
+	sc = ut_submit(comp, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+	g_ut_accel_submit_rc = 0;
+
+	/* So are malformed headers */
+	data = ut_kv_base_get(base, "key0", &len);
+	SPDK_CU_ASSERT_FATAL(data != NULL);
+	stored = malloc(len);
+	SPDK_CU_ASSERT_FATAL(stored != NULL);
+	memcpy(stored, data, len);
+	memcpy(&hdr, stored, sizeof(hdr));
+
+	hdr.orig_len = sizeof(value) + 1;
+	memcpy(stored, &hdr, sizeof(hdr));
+	ut_kv_base_put(base, "key0", 4, stored, len, false);
+	sc = ut_submit(comp, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+	hdr.orig_len = sizeof(value);
+	hdr.version = KV_COMPRESS_VERSION + 1;
+	memcpy(stored, &hdr, sizeof(hdr));
+	ut_kv_base_put(base, "key0", 4, stored, len, false);
+	sc = ut_submit(comp, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+	hdr.version = KV_COMPRESS_VERSION;
+	hdr.codec = 7;
+	memcpy(stored, &hdr, sizeof(hdr));
+	ut_kv_base_put(base, "key0", 4, stored, len, false);
+	sc = ut_submit(comp, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+	hdr.codec = KV_COMPRESS_CODEC_NONE;
+	memcpy(stored, &hdr, sizeof(hdr));
+	ut_kv_base_put(base, "key0", 4, stored, len, false);
+	sc = ut_submit(comp, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+	hdr.codec = KV_COMPRESS_CODEC_DEFLATE;
+	memcpy(stored, &hdr, sizeof(hdr));
+	ut_kv_base_put(base, "key0", 4, stored, len, false);
+
+	/* A value overwritten after its header was read is read again */
+	sc = ut_store(comp, ch, "key1", value2, 300);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	data = ut_kv_base_get(base, "key1", &len2);
+	SPDK_CU_ASSERT_FATAL(data != NULL);
+	CU_ASSERT(len2 != len);
+	bdev_io = ut_kv_vbdev_io(&comp->bdev, sizeof(struct kv_compress_bdev_io),
+				 SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, 8);
+	bdev_io->u.bdev.nvme_kv.offset = 8;
+	base->num_ios[SPDK_BDEV_IO_KV_RETRIEVE] = 0;
+	vbdev_kv_compress_submit_request(ch, bdev_io);
+	CU_ASSERT(ut_kv_poll_one() == true);
+	ut_kv_base_put(base, "key0", 4, data, len2, false);
+	ut_kv_poll();
+	CU_ASSERT(bdev_io->internal.status == SPDK_BDEV_IO_STATUS_SUCCESS);
+	CU_ASSERT(bdev_io->internal.error.nvme.cdw0 == 300);
+	CU_ASSERT(memcmp(buf, value2, 8) == 0);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_RETRIEVE] == 4);
+	free(bdev_io);
+
+	sc = ut_submit(comp, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, sizeof(buf), &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == 300);
+	CU_ASSERT(memcmp(buf, value2, 300) == 0);
+
+	free(stored);
+	spdk_put_io_channel(ch);
+	ut_compress_delete(comp);
+	ut_kv_base_destroy(base);
+}
+
+static void
+test_hotremove(void)
+{
+	struct ut_kv_base *base = ut_kv_base_create("base0");
+	uint32_t unregistered = g_ut_kv_unregistered;
+
+	ut_compress_create(0);
+	ut_kv_base_remove(base);
+	ut_kv_poll();
+	CU_ASSERT(spdk_bdev_get_by_name("comp0") == NULL);
+	CU_ASSERT(g_ut_kv_unregistered == unregistered + 1);
+	CU_ASSERT(base->open_count == 0);
+	CU_ASSERT(base->bdev.internal.claim_type == SPDK_BDEV_CLAIM_NONE);
+	ut_kv_base_destroy(base);
+
+	/* The bdev is re-created when its base bdev comes back */
+	base = ut_kv_base_create("base0");
+	vbdev_kv_compress_examine(&base->bdev);
+	SPDK_CU_ASSERT_FATAL(spdk_bdev_get_by_name("comp0") != NULL);
+	ut_compress_delete(spdk_bdev_get_by_name("comp0")->ctxt);
+	ut_kv_base_destroy(base);
+}
+
+int
+main(int argc, char **argv)
+{
+	CU_pSuite	suite = NULL;
+	unsigned int	num_failures;
+
+	CU_set_error_action(CUEA_ABORT);
+	CU_initialize_registry();
+
+	suite = CU_add_suite("kv_compress", NULL, NULL);
+
+	CU_ADD_TEST(suite, test_create_delete);
+	CU_ADD_TEST(suite, test_store_retrieve);
+	CU_ADD_TEST(suite, test_select);
+	CU_ADD_TEST(suite, test_errors);
+	CU_ADD_TEST(suite, test_hotremove);
+
+	g_thread = spdk_thread_create("test", NULL);
+	spdk_set_thread(g_thread);
+	spdk_io_device_register(&g_ut_accel_io_device, ut_accel_create_cb, ut_accel_destroy_cb, 0,
+				"accel");
+
+	CU_basic_set_mode(CU_BRM_VERBOSE);
+	CU_basic_run_tests();
+	num_failures = CU_get_number_of_failures();
+
+	vbdev_kv_compress_finish();
+	spdk_io_device_unregister(&g_ut_accel_io_device, NULL);
+	spdk_thread_exit(g_thread);
+	while (!spdk_thread_is_exited(g_thread)) {
+		spdk_thread_poll(g_thread, 0, 0);
+	}
+	spdk_thread_destroy(g_thread);
+
+	CU_cleanup_registry();
+
+	return num_failures;
+}
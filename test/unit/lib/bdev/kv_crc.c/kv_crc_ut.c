@@ -0,0 +1,632 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+#include "spdk/stdinc.h"
+#include "spdk_cunit.h"
+#include "spdk/crc32.h"
+#include "spdk/env.h"
+#include "spdk_internal/mock.h"
+#include "thread/thread_internal.h"
+#include "common/lib/test_env.c"
+#include "kv_select/kv_select.c"
+#include "bdev/kv_crc/vbdev_kv_crc.c"
+#include "common/lib/test_bdev_kv.c"
+
+static struct spdk_thread *g_thread;
+static int g_delete_rc;
+static bool g_delete_done;
+
+/*
+ * Accel CRC-32C, computed as the software module does. Operations complete from
+ * a thread message, as they would from an accel module.
+ */
+static int g_ut_accel_io_device;
+/* Returned by the next submissions while not 0. */
+static int g_ut_accel_submit_rc;
+/* Status the next operations complete with while not 0. */
+static int g_ut_accel_status;
+
+struct ut_accel_task {
+	spdk_accel_completion_cb	cb_fn;
+	void				*cb_arg;
+};
+
+static int
+ut_accel_create_cb(void *io_device, void *ctx_buf)
+{
+	return 0;
+}
+
+static void
+ut_accel_destroy_cb(void *io_device, void *ctx_buf)
+{
+}
+
+struct spdk_io_channel *
+spdk_accel_get_io_channel(void)
+{
+	return spdk_get_io_channel(&g_ut_accel_io_device);
+}
+
+static void
+ut_accel_task_done(void *ctx)
+{
+	struct ut_accel_task *task = ctx;
+
+	task->cb_fn(task->cb_arg, g_ut_accel_status);
+	free(task);
+}
+
+static void
+ut_accel_complete(spdk_accel_completion_cb cb_fn, void *cb_arg)
+{
+	struct ut_accel_task *task;
+
+	task = calloc(1, sizeof(*task));
+	SPDK_CU_ASSERT_FATAL(task != NULL);
+	task->cb_fn = cb_fn;
+	task->cb_arg = cb_arg;
+	spdk_thread_send_msg(spdk_get_thread(), ut_accel_task_done, task);
+}
+
+int
+spdk_accel_submit_crc32cv(struct spdk_io_channel *ch, uint32_t *crc_dst, struct iovec *iovs,
+			  uint32_t iovcnt, uint32_t seed, spdk_accel_completion_cb cb_fn,
+			  void *cb_arg)
+{
+	if (g_ut_accel_submit_rc != 0) {
+		return g_ut_accel_submit_rc;
+	}
+
+	*crc_dst = spdk_crc32c_iov_update(iovs, iovcnt, ~seed);
+	ut_accel_complete(cb_fn, cb_arg);
+	return 0;
+}
+
+int
+spdk_accel_submit_copy_crc32cv(struct spdk_io_channel *ch, void *dst, struct iovec *src_iovs,
+			       uint32_t iovcnt, uint32_t *crc_dst, uint32_t seed, int flags,
+			       spdk_accel_completion_cb cb_fn, void *cb_arg)
+{
+	uint64_t len = 0;
+	uint32_t i;
+
+	if (g_ut_accel_submit_rc != 0) {
+		return g_ut_accel_submit_rc;
+	}
+
+	for (i = 0; i < iovcnt; i++) {
+		len += src_iovs[i].iov_len;
+	}
+	spdk_copy_iovs_to_buf(dst, len, src_iovs, iovcnt);
+	*crc_dst = spdk_crc32c_iov_update(src_iovs, iovcnt, ~seed);
+	ut_accel_complete(cb_fn, cb_arg);
+	return 0;
+}
+
+static void
+ut_delete_done(void *cb_arg, int rc)
+{
+	g_delete_rc = rc;
+	g_delete_done = true;
+}
+
+static struct vbdev_kv_crc *
+ut_crc_create(void)
+{
+	struct spdk_bdev *bdev;
+	int rc;
+
+	rc = bdev_kv_crc_create("crc0", "base0");
+	CU_ASSERT(rc == 0);
+	bdev = spdk_bdev_get_by_name("crc0");
+	SPDK_CU_ASSERT_FATAL(bdev != NULL);
+
+	return bdev->ctxt;
+}
+
+static void
+ut_crc_delete(struct vbdev_kv_crc *crc)
+{
+	g_delete_done = false;
+	bdev_kv_crc_delete(crc->bdev.name, ut_delete_done, NULL);
+	ut_kv_poll();
+	CU_ASSERT(g_delete_done == true);
+	CU_ASSERT(g_delete_rc == 0);
+}
+
+/*
+ * Submit a single-iov KV I/O to the vbdev and return its NVMe status code.
+ * select_id is only used by retrieve select.
+ */
+static int
+ut_submit_ext(struct vbdev_kv_crc *crc, struct spdk_io_channel *ch, enum spdk_bdev_io_type type,
+	      const char *key, void *buf, uint64_t len, uint64_t offset, uint8_t options,
+	      uint32_t select_id, uint32_t *cdw0)
+{
+	struct spdk_bdev_io *bdev_io;
+	int sc;
+
+	bdev_io = ut_kv_vbdev_io(&crc->bdev, sizeof(struct kv_crc_bdev_io), type, key, buf, len);
+	bdev_io->u.bdev.nvme_kv.offset = offset;
+	bdev_io->u.bdev.nvme_kv.options = options;
+	bdev_io->u.bdev.nvme_kv.select_id = select_id;
+	sc = ut_kv_vbdev_submit(ch, bdev_io);
+	if (cdw0 != NULL) {
+		*cdw0 = bdev_io->internal.error.nvme.cdw0;
+	}
+	free(bdev_io);
+
+	return sc;
+}
+
+static int
+ut_submit(struct vbdev_kv_crc *crc, struct spdk_io_channel *ch, enum spdk_bdev_io_type type,
+	  const char *key, void *buf, uint64_t len, uint32_t *cdw0)
+{
+	return ut_submit_ext(crc, ch, type, key, buf, len, 0, 0, 0, cdw0);
+}
+
+static int
+ut_store(struct vbdev_kv_crc *crc, struct spdk_io_channel *ch, const char *key,
+	 const char *value)
+{
+	return ut_submit(crc, ch, SPDK_BDEV_IO_KV_STORE, key, (void *)value, strlen(value), NULL);
+}
+
+/* Check the base bdev holds value under key, followed by its CRC-32C trailer. */
+static void
+ut_check_stored(struct ut_kv_base *base, const char *key, const char *value)
+{
+	size_t len = strlen(value);
+	const uint8_t *buf;
+	uint32_t stored_len;
+
+	buf = ut_kv_base_get(base, key, &stored_len);
+	SPDK_CU_ASSERT_FATAL(buf != NULL);
+	CU_ASSERT(stored_len == len + KV_CRC_TRAILER_SIZE);
+	CU_ASSERT(memcmp(buf, value, len) == 0);
+	CU_ASSERT(from_le32(buf + len) == ~spdk_crc32c_update(value, len, ~0U));
+}
+
+static void
+test_create_delete(void)
+{
+	struct vbdev_kv_crc *crc;
+	struct ut_kv_base *base;
+	int rc;
+
+	rc = bdev_kv_crc_create("crc0", NULL);
+	CU_ASSERT(rc == -EINVAL);
+
+	/* Creation waits for the base bdev */
+	rc = bdev_kv_crc_create("crc0", "base0");
+	CU_ASSERT(rc == 0);
+	CU_ASSERT(spdk_bdev_get_by_name("crc0") == NULL);
+	rc = bdev_kv_crc_create("crc0", "base0");
+	CU_ASSERT(rc == -EEXIST);
+	base = ut_kv_base_create("base0");
+	vbdev_kv_crc_examine(&base->bdev);
+	SPDK_CU_ASSERT_FATAL(spdk_bdev_get_by_name("crc0") != NULL);
+	crc = spdk_bdev_get_by_name("crc0")->ctxt;
+	CU_ASSERT(crc->bdev.required_alignment == base->bdev.required_alignment);
+	CU_ASSERT(base->open_count == 1);
+	CU_ASSERT(base->bdev.internal.claim.v1.module == &kv_crc_if);
+	CU_ASSERT(vbdev_kv_crc_io_type_supported(crc, SPDK_BDEV_IO_KV_STORE) == true);
+	CU_ASSERT(vbdev_kv_crc_io_type_supported(crc, SPDK_BDEV_IO_KV_SEND_SELECT) == true);
+	CU_ASSERT(vbdev_kv_crc_io_type_supported(crc, SPDK_BDEV_IO_KV_BATCH) == false);
+	CU_ASSERT(vbdev_kv_crc_io_type_supported(crc, SPDK_BDEV_IO_TYPE_READ) == false);
+
+	/* Deleted bdevs are not created again when their base bdev comes back */
+	ut_crc_delete(crc);
+	CU_ASSERT(spdk_bdev_get_by_name("crc0") == NULL);
+	CU_ASSERT(base->open_count == 0);
+	CU_ASSERT(base->bdev.internal.claim_type == SPDK_BDEV_CLAIM_NONE);
+	vbdev_kv_crc_examine(&base->bdev);
+	CU_ASSERT(spdk_bdev_get_by_name("crc0") == NULL);
+
+	g_delete_done = false;
+	bdev_kv_crc_delete("crc0", ut_delete_done, NULL);
+	CU_ASSERT(g_delete_done == true);
+	CU_ASSERT(g_delete_rc == -ENODEV);
+
+	/* The base bdev needs to support KV commands */
+	base->kv_supported = false;
+	rc = bdev_kv_crc_create("crc0", "base0");
+	CU_ASSERT(rc == -ENOTSUP);
+	CU_ASSERT(base->open_count == 0);
+	CU_ASSERT(base->bdev.internal.claim_type == SPDK_BDEV_CLAIM_NONE);
+	ut_kv_base_destroy(base);
+}
+
+static void
+test_store_retrieve(void)
+{
+	struct ut_kv_base *base = ut_kv_base_create("base0");
+	struct vbdev_kv_crc_stats stats;
+	struct spdk_bdev_io *bdev_io;
+	struct vbdev_kv_crc *crc;
+	struct spdk_io_channel *ch;
+	struct iovec iovs[2];
+	char buf[64], buf2[64];
+	uint32_t cdw0, len;
+	int sc;
+
+	crc = ut_crc_create();
+	ch = spdk_get_io_channel(crc);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+
+	/* Values are stored with their CRC-32C behind them */
+	sc = ut_store(crc, ch, "key0", "hello world");
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	ut_check_stored(base, "key0", "hello world");
+	sc = ut_store(crc, ch, "empty", "");
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	ut_check_stored(base, "empty", "");
+
+	/* Reads check the CRC and report the length without it */
+	sc = ut_submit(crc, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, sizeof(buf), &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == 11);
+	CU_ASSERT(memcmp(buf, "hello world", 11) == 0);
+	memset(buf, 0, sizeof(buf));
+	sc = ut_submit(crc, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, 11, &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == 11);
+	CU_ASSERT(strcmp(buf, "hello world") == 0);
+	sc = ut_submit(crc, ch, SPDK_BDEV_IO_KV_RETRIEVE, "empty", buf, sizeof(buf), &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == 0);
+
+	/* The trailer may straddle the caller's buffers */
+	memset(buf, 0, sizeof(buf));
+	memset(buf2, 0, sizeof(buf2));
+	bdev_io = ut_kv_vbdev_io(&crc->bdev, sizeof(struct kv_crc_bdev_io),
+				 SPDK_BDEV_IO_KV_RETRIEVE, "key0", NULL, 0);
+	iovs[0].iov_base = buf;
+	iovs[0].iov_len = 8;
+	iovs[1].iov_base = buf2;
+	iovs[1].iov_len = 6;
+	bdev_io->u.bdev.iovs = iovs;
+	bdev_io->u.bdev.iovcnt = 2;
+	bdev_io->u.bdev.nvme_kv.buffer_size = 14;
+	sc = ut_kv_vbdev_submit(ch, bdev_io);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(bdev_io->internal.error.nvme.cdw0 == 11);
+	CU_ASSERT(memcmp(buf, "hello wo", 8) == 0);
+	CU_ASSERT(memcmp(buf2, "rld", 3) == 0);
+	free(bdev_io);
+
+	/* Values that do not fit are read whole and checked in a bounce buffer */
+	memset(buf, 0, sizeof(buf));
+	base->num_ios[SPDK_BDEV_IO_KV_RETRIEVE] = 0;
+	sc = ut_submit(crc, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, 4, &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == 11);
+	CU_ASSERT(strcmp(buf, "hell") == 0);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_RETRIEVE] == 2);
+
+	/* So are reads at an offset, again if the first guess was short */
+	memset(buf, 0, sizeof(buf));
+	base->num_ios[SPDK_BDEV_IO_KV_RETRIEVE] = 0;
+	sc = ut_submit_ext(crc, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, 5, 6, 0, 0, &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == 11);
+	CU_ASSERT(strcmp(buf, "world") == 0);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_RETRIEVE] == 1);
+	memset(buf, 0, sizeof(buf));
+	sc = ut_submit_ext(crc, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, 2, 6, 0, 0, &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == 11);
+	CU_ASSERT(strcmp(buf, "wo") == 0);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_RETRIEVE] == 3);
+	sc = ut_submit_ext(crc, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, 2, 20, 0, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_INVALID_FIELD);
+	CU_ASSERT(bdev_kv_crc_get_stats("crc0", &stats) == 0);
+	CU_ASSERT(stats.stores == 2);
+	CU_ASSERT(stats.verified == 8);
+	CU_ASSERT(stats.crc_errors == 0);
+
+	/* APPEND would bury the old trailer in the value */
+	sc = ut_submit_ext(crc, ch, SPDK_BDEV_IO_KV_STORE, "key0", "!", 1, 0,
+			   NVME_KV_STORE_CMD_OPTION_APPEND, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_INVALID_FIELD);
+	ut_check_stored(base, "key0", "hello world");
+
+	/* Other commands go to the base bdev */
+	sc = ut_submit(crc, ch, SPDK_BDEV_IO_KV_EXIST, "key0", NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	sc = ut_submit(crc, ch, SPDK_BDEV_IO_KV_DELETE, "key0", NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(ut_kv_base_get(base, "key0", &len) == NULL);
+	sc = ut_submit(crc, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+	sc = ut_submit_ext(crc, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, 2, 2, 0, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+
+	spdk_put_io_channel(ch);
+	ut_crc_delete(crc);
+	ut_kv_base_destroy(base);
+}
+
+static void
+test_corruption(void)
+{
+	struct ut_kv_base *base = ut_kv_base_create("base0");
+	struct vbdev_kv_crc_stats stats;
+	struct spdk_bdev_io *bdev_io;
+	struct vbdev_kv_crc *crc;
+	struct spdk_io_channel *ch;
+	const uint8_t *data;
+	uint8_t stored[15];
+	char buf[64];
+	uint32_t len;
+	int sc;
+
+	crc = ut_crc_create();
+	ch = spdk_get_io_channel(crc);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+
+	sc = ut_store(crc, ch, "key0", "hello world");
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	data = ut_kv_base_get(base, "key0", &len);
+	SPDK_CU_ASSERT_FATAL(data != NULL && len == sizeof(stored));
+	memcpy(stored, data, sizeof(stored));
+
+	/* A flipped bit fails the guard check, however the value is read */
+	stored[3] ^= 0x10;
+	ut_kv_base_put(base, "key0", 4, stored, sizeof(stored), false);
+	bdev_io = ut_kv_vbdev_io(&crc->bdev, sizeof(struct kv_crc_bdev_io),
+				 SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, sizeof(buf));
+	sc = ut_kv_vbdev_submit(ch, bdev_io);
+	CU_ASSERT(sc == SPDK_NVME_SC_GUARD_CHECK_ERROR);
+	CU_ASSERT(bdev_io->internal.error.nvme.sct == SPDK_NVME_SCT_MEDIA_ERROR);
+	free(bdev_io);
+	sc = ut_submit(crc, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, 2, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_GUARD_CHECK_ERROR);
+	sc = ut_submit_ext(crc, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, 2, 2, 0, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_GUARD_CHECK_ERROR);
+	sc = ut_submit(crc, ch, SPDK_BDEV_IO_KV_SEND_SELECT, "key0", "SELECT * FROM s3object",
+		       22, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_GUARD_CHECK_ERROR);
+
+	/* So does a value stored behind the back of the vbdev, without a trailer */
+	ut_kv_base_put(base, "key1", 4, "abc", 3, false);
+	sc = ut_submit(crc, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key1", buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_GUARD_CHECK_ERROR);
+	sc = ut_submit_ext(crc, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key1", buf, 2, 1, 0, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_GUARD_CHECK_ERROR);
+	CU_ASSERT(bdev_kv_crc_get_stats("crc0", &stats) == 0);
+	CU_ASSERT(stats.crc_errors == 6);
+	CU_ASSERT(stats.verified == 0);
+
+	/* Buffers shorter than buffer_size cannot hold the trailer */
+	stored[3] ^= 0x10;
+	ut_kv_base_put(base, "key0", 4, stored, sizeof(stored), false);
+	bdev_io = ut_kv_vbdev_io(&crc->bdev, sizeof(struct kv_crc_bdev_io),
+				 SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, 4);
+	bdev_io->u.bdev.nvme_kv.buffer_size = sizeof(buf);
+	sc = ut_kv_vbdev_submit(ch, bdev_io);
+	CU_ASSERT(sc == -1);
+	free(bdev_io);
+
+	spdk_put_io_channel(ch);
+	ut_crc_delete(crc);
+	ut_kv_base_destroy(base);
+}
+
+static void
+test_select(void)
+{
+	struct ut_kv_base *base = ut_kv_base_create("base0");
+	char value[] = "name,qty\napple,3\npear,7\nplum,12\n";
+	char query[] = "SELECT name FROM s3object WHERE qty > 5";
+	uint8_t options = NVME_KV_SELECT_CMD_OUTPUT_TYPE_USE_CSV_HEADERS_INPUT;
+	struct vbdev_kv_crc_stats stats;
+	struct vbdev_kv_crc *crc;
+	struct spdk_io_channel *ch;
+	char buf[64], *big;
+	uint32_t cdw0, id;
+	size_t n = 0;
+	uint8_t keep;
+	int sc;
+
+	crc = ut_crc_create();
+	ch = spdk_get_io_channel(crc);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+
+	/* SELECT runs on the host, on the checked value */
+	sc = ut_store(crc, ch, "fruit", value);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	sc = ut_submit_ext(crc, ch, SPDK_BDEV_IO_KV_SEND_SELECT, "fruit", query, strlen(query), 0,
+			   options, 0, &id);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(id & KV_CRC_SELECT_ID_HOST);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_SEND_SELECT] == 0);
+	CU_ASSERT(bdev_kv_crc_get_stats("crc0", &stats) == 0);
+	CU_ASSERT(stats.host_selects == 1);
+	CU_ASSERT(stats.verified == 1);
+
+	memset(buf, 0, sizeof(buf));
+	keep = NVME_KV_SELECT_CMD_OPTION_DO_NOT_FREE_IF_NOT_ALL_DATA_FETCHED;
+	sc = ut_submit_ext(crc, ch, SPDK_BDEV_IO_KV_RETRIEVE_SELECT, NULL, buf, 4, 0, keep, id,
+			   &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == strlen("pear\nplum\n"));
+	CU_ASSERT(memcmp(buf, "pear", 4) == 0);
+	sc = ut_submit_ext(crc, ch, SPDK_BDEV_IO_KV_RETRIEVE_SELECT, NULL, buf, sizeof(buf), 0, 0,
+			   id, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(strcmp(buf, "pear\nplum\n") == 0);
+	sc = ut_submit_ext(crc, ch, SPDK_BDEV_IO_KV_RETRIEVE_SELECT, NULL, buf, sizeof(buf), 0, 0,
+			   id, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_INVALID_FIELD);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_RETRIEVE_SELECT] == 0);
+
+	/* Other ids go to the base bdev */
+	sc = ut_submit_ext(crc, ch, SPDK_BDEV_IO_KV_RETRIEVE_SELECT, NULL, buf, sizeof(buf), 0, 0,
+			   1, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_INVALID_FIELD);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_RETRIEVE_SELECT] == 1);
+
+	/* Values longer than the first guess are read again, whole */
+	big = calloc(1, KV_CRC_SELECT_FETCH_SIZE + 64);
+	SPDK_CU_ASSERT_FATAL(big != NULL);
+	n += snprintf(big + n, KV_CRC_SELECT_FETCH_SIZE + 64 - n, "name,qty\n");
+	while (n < KV_CRC_SELECT_FETCH_SIZE) {
+		n += snprintf(big + n, KV_CRC_SELECT_FETCH_SIZE + 64 - n, "x,1\n");
+	}
+	n += snprintf(big + n, KV_CRC_SELECT_FETCH_SIZE + 64 - n, "big,9\n");
+	sc = ut_store(crc, ch, "big", big);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	base->num_ios[SPDK_BDEV_IO_KV_RETRIEVE] = 0;
+	sc = ut_submit_ext(crc, ch, SPDK_BDEV_IO_KV_SEND_SELECT, "big", query, strlen(query), 0,
+			   options, 0, &id);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_KV_RETRIEVE] == 2);
+	memset(buf, 0, sizeof(buf));
+	sc = ut_submit_ext(crc, ch, SPDK_BDEV_IO_KV_RETRIEVE_SELECT, NULL, buf, sizeof(buf), 0, 0,
+			   id, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(strcmp(buf, "big\n") == 0);
+	free(big);
+
+	/* Malformed queries and missing keys fail */
+	sc = ut_submit(crc, ch, SPDK_BDEV_IO_KV_SEND_SELECT, "fruit", "SELECT", 6, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_INVALID_FIELD);
+	sc = ut_submit(crc, ch, SPDK_BDEV_IO_KV_SEND_SELECT, "nokey", query, strlen(query), NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+	CU_ASSERT(bdev_kv_crc_get_stats("crc0", &stats) == 0);
+	CU_ASSERT(stats.host_selects == 2);
+
+	spdk_put_io_channel(ch);
+	ut_crc_delete(crc);
+	ut_kv_base_destroy(base);
+}
+
+static void
+test_errors(void)
+{
+	struct ut_kv_base *base = ut_kv_base_create("base0");
+	struct spdk_bdev_io *bdev_io;
+	struct vbdev_kv_crc *crc;
+	struct spdk_io_channel *ch;
+	char buf[64];
+	uint32_t len;
+	int sc;
+
+	crc = ut_crc_create();
+	ch = spdk_get_io_channel(crc);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+
+	/* Errors of the base bdev are passed through */
+	base->fail_sc = SPDK_NVME_SC_DATA_TRANSFER_ERROR;
+	sc = ut_store(crc, ch, "key0", "value0");
+	CU_ASSERT(sc == SPDK_NVME_SC_DATA_TRANSFER_ERROR);
+	sc = ut_submit(crc, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_DATA_TRANSFER_ERROR);
+	base->fail_sc = 0;
+	base->submit_rc = -EIO;
+	sc = ut_store(crc, ch, "key0", "value0");
+	CU_ASSERT(sc == -1);
+	base->submit_rc = 0;
+	CU_ASSERT(ut_kv_base_get(base, "key0", &len) == NULL);
+
+	/* Submissions wait for a bdev_io when the base bdev has none */
+	base->submit_rc = -ENOMEM;
+	bdev_io = ut_kv_vbdev_io(&crc->bdev, sizeof(struct kv_crc_bdev_io),
+				 SPDK_BDEV_IO_KV_STORE, "key0", "value0", 6);
+	vbdev_kv_crc_submit_request(ch, bdev_io);
+	while (spdk_thread_poll(g_thread, 0, 0) > 0) {
+	}
+	CU_ASSERT(!TAILQ_EMPTY(&g_ut_kv_io_wait));
+	CU_ASSERT(bdev_io->internal.status == SPDK_BDEV_IO_STATUS_PENDING);
+	base->submit_rc = 0;
+	ut_kv_poll();
+	CU_ASSERT(bdev_io->internal.status == SPDK_BDEV_IO_STATUS_SUCCESS);
+	free(bdev_io);
+	ut_check_stored(base, "key0", "value0");
+
+	/* Failed CRC calculations fail the command */
+	g_ut_accel_submit_rc = -ENOMEM;
+	sc = ut_store(crc, ch, "key1", "value1");
+	CU_ASSERT(sc == -1);
+	sc = ut_submit(crc, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == -1);
+	g_ut_accel_submit_rc = 0;
+	g_ut_accel_status = -EIO;
+	sc = ut_store(crc, ch, "key1", "value1");
+	CU_ASSERT(sc == -1);
+	sc = ut_submit(crc, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == -1);
+	g_ut_accel_status = 0;
+	CU_ASSERT(ut_kv_base_get(base, "key1", &len) == NULL);
+
+	spdk_put_io_channel(ch);
+	ut_crc_delete(crc);
+	ut_kv_base_destroy(base);
+}
+
+static void
+test_hotremove(void)
+{
+	struct ut_kv_base *base = ut_kv_base_create("base0");
+	uint32_t unregistered = g_ut_kv_unregistered;
+
+	ut_crc_create();
+	ut_kv_base_remove(base);
+	ut_kv_poll();
+	CU_ASSERT(spdk_bdev_get_by_name("crc0") == NULL);
+	CU_ASSERT(g_ut_kv_unregistered == unregistered + 1);
+	CU_ASSERT(base->open_count == 0);
+	CU_ASSERT(base->bdev.internal.claim_type == SPDK_BDEV_CLAIM_NONE);
+	ut_kv_base_destroy(base);
+
+	/* The bdev is re-created when its base bdev comes back */
+	base = ut_kv_base_create("base0");
+	vbdev_kv_crc_examine(&base->bdev);
+	SPDK_CU_ASSERT_FATAL(spdk_bdev_get_by_name("crc0") != NULL);
+	ut_crc_delete(spdk_bdev_get_by_name("crc0")->ctxt);
+	ut_kv_base_destroy(base);
+}
+
+int
+main(int argc, char **argv)
+{
+	CU_pSuite	suite = NULL;
+	unsigned int	num_failures;
+
+	CU_set_error_action(CUEA_ABORT);
+	CU_initialize_registry();
+
+	suite = CU_add_suite("kv_crc", NULL, NULL);
+
+	CU_ADD_TEST(suite, test_create_delete);
+	CU_ADD_TEST(suite, test_store_retrieve);
+	CU_ADD_TEST(suite, test_corruption);
+	CU_ADD_TEST(suite, test_select);
+	CU_ADD_TEST(suite, test_errors);
+	CU_ADD_TEST(suite, test_hotremove);
+
+	g_thread = spdk_thread_create("test", NULL);
+	spdk_set_thread(g_thread);
+	spdk_io_device_register(&g_ut_accel_io_device, ut_accel_create_cb, ut_accel_destroy_cb, 0,
+				"accel");
+
+	CU_basic_set_mode(CU_BRM_VERBOSE);
+	CU_basic_run_tests();
+	num_failures = CU_get_number_of_failures();
+
+	vbdev_kv_crc_finish();
+	spdk_io_device_unregister(&g_ut_accel_io_device, NULL);
+	spdk_thread_exit(g_thread);
+	while (!spdk_thread_is_exited(g_thread)) {
+		spdk_thread_poll(g_thread, 0, 0);
+	}
+	spdk_thread_destroy(g_thread);
+
+	CU_cleanup_registry();
+
+	return num_failures;
+}
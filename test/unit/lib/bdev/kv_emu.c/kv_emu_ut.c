@@ -0,0 +1,503 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+#include "spdk/stdinc.h"
+#include "spdk_cunit.h"
+#include "spdk/env.h"
+#include "spdk_internal/mock.h"
+#include "thread/thread_internal.h"
+#include "common/lib/test_env.c"
+#include "bdev/kv_emu/bdev_kv_emu.c"
+#include "kv_select/kv_select.c"
+
+static struct spdk_thread *g_thread;
+static uint32_t g_cdw0;
+static int g_sct;
+static int g_sc;
+static bool g_io_done;
+
+DEFINE_STUB_V(spdk_bdev_module_list_add, (struct spdk_bdev_module *bdev_module));
+DEFINE_STUB(spdk_bdev_register, int, (struct spdk_bdev *bdev), 0);
+DEFINE_STUB_V(spdk_bdev_destruct_done, (struct spdk_bdev *bdev, int bdeverrno));
+DEFINE_STUB(spdk_bdev_open_ext, int, (const char *bdev_name, bool write,
+				      spdk_bdev_event_cb_t event_cb, void *event_ctx,
+				      struct spdk_bdev_desc **desc), -ENODEV);
+DEFINE_STUB_V(spdk_bdev_close, (struct spdk_bdev_desc *desc));
+DEFINE_STUB(spdk_bdev_desc_get_bdev, struct spdk_bdev *, (struct spdk_bdev_desc *desc), NULL);
+DEFINE_STUB(spdk_bdev_module_claim_bdev, int, (struct spdk_bdev *bdev,
+		struct spdk_bdev_desc *desc, struct spdk_bdev_module *module), 0);
+DEFINE_STUB_V(spdk_bdev_module_release_bdev, (struct spdk_bdev *bdev));
+DEFINE_STUB(spdk_bdev_get_io_channel, struct spdk_io_channel *, (struct spdk_bdev_desc *desc),
+	    NULL);
+DEFINE_STUB(spdk_bdev_get_name, const char *, (const struct spdk_bdev *bdev), "kv_emu0");
+DEFINE_STUB(spdk_bdev_get_buf_align, size_t, (const struct spdk_bdev *bdev), 1);
+DEFINE_STUB(spdk_bdev_get_num_blocks, uint64_t, (const struct spdk_bdev *bdev), 0);
+DEFINE_STUB(spdk_bdev_get_block_size, uint32_t, (const struct spdk_bdev *bdev), 512);
+DEFINE_STUB(spdk_bdev_read_blocks, int, (struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+		void *buf, uint64_t offset_blocks, uint64_t num_blocks,
+		spdk_bdev_io_completion_cb cb, void *cb_arg), 0);
+DEFINE_STUB(spdk_bdev_write_blocks, int, (struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+		void *buf, uint64_t offset_blocks, uint64_t num_blocks,
+		spdk_bdev_io_completion_cb cb, void *cb_arg), 0);
+DEFINE_STUB_V(spdk_bdev_free_io, (struct spdk_bdev_io *bdev_io));
+DEFINE_STUB(spdk_bdev_unregister_by_name, int, (const char *bdev_name,
+		struct spdk_bdev_module *module, spdk_bdev_unregister_cb cb_fn, void *cb_arg), 0);
+
+void
+spdk_bdev_io_complete_nvme_status(struct spdk_bdev_io *bdev_io, uint32_t cdw0, int sct, int sc)
+{
+	g_io_done = true;
+	g_cdw0 = cdw0;
+	g_sct = sct;
+	g_sc = sc;
+}
+
+static struct kv_emu_disk *
+ut_disk_create(uint64_t capacity)
+{
+	struct kv_emu_disk *disk;
+
+	disk = calloc(1, sizeof(*disk));
+	SPDK_CU_ASSERT_FATAL(disk != NULL);
+	disk->slots = calloc(KV_EMU_INDEX_MIN_SLOTS, sizeof(*disk->slots));
+	SPDK_CU_ASSERT_FATAL(disk->slots != NULL);
+	disk->mask = KV_EMU_INDEX_MIN_SLOTS - 1;
+	disk->capacity = capacity;
+	spdk_kv_select_results_init(&disk->selects, KV_EMU_MAX_SELECTS, 0);
+	spdk_spin_init(&disk->lock);
+	disk->bdev.ctxt = disk;
+	return disk;
+}
+
+static void
+ut_key(uint8_t *key, size_t *key_len, uint32_t i)
+{
+	*key_len = snprintf((char *)key, NVME_KV_MAX_KEY_LENGTH, "key%u", i);
+}
+
+/*
+ * Submit a single-iov KV I/O to the disk and return its NVMe status. select_id
+ * is only used by retrieve select.
+ */
+static int
+ut_submit_select(struct kv_emu_disk *disk, enum spdk_bdev_io_type type, const char *key,
+		 void *buf, uint64_t len, uint64_t offset, uint8_t options, uint32_t select_id)
+{
+	struct spdk_bdev_io *bdev_io;
+
+	bdev_io = calloc(1, sizeof(*bdev_io));
+	SPDK_CU_ASSERT_FATAL(bdev_io != NULL);
+	bdev_io->bdev = &disk->bdev;
+	bdev_io->type = type;
+	if (key != NULL) {
+		bdev_io->u.bdev.nvme_kv.key_length = strlen(key);
+		memcpy(bdev_io->u.bdev.nvme_kv.key, key, strlen(key));
+	}
+	bdev_io->iov.iov_base = buf;
+	bdev_io->iov.iov_len = len;
+	bdev_io->u.bdev.iovs = &bdev_io->iov;
+	bdev_io->u.bdev.iovcnt = 1;
+	bdev_io->u.bdev.nvme_kv.buffer_size = len;
+	bdev_io->u.bdev.nvme_kv.offset = offset;
+	bdev_io->u.bdev.nvme_kv.select_id = select_id;
+	bdev_io->u.bdev.nvme_kv.options = options;
+
+	g_io_done = false;
+	bdev_kv_emu_submit_request(NULL, bdev_io);
+	CU_ASSERT(g_io_done == true);
+	CU_ASSERT(g_sct == SPDK_NVME_SCT_GENERIC);
+	free(bdev_io);
+	return g_sc;
+}
+
+static int
+ut_submit(struct kv_emu_disk *disk, enum spdk_bdev_io_type type, const char *key, void *buf,
+	  uint64_t len, uint64_t offset, uint8_t options)
+{
+	return ut_submit_select(disk, type, key, buf, len, offset, options, 0);
+}
+
+static void
+test_store_retrieve(void)
+{
+	struct kv_emu_disk *disk = ut_disk_create(1024 * 1024);
+	char value[64], buf[64];
+	int sc;
+
+	memset(value, 'a', sizeof(value));
+	sc = ut_submit(disk, SPDK_BDEV_IO_KV_STORE, "key0", value, 10, 0, 0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+
+	memset(buf, 0, sizeof(buf));
+	sc = ut_submit(disk, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, sizeof(buf), 0, 0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(g_cdw0 == 10);
+	CU_ASSERT(memcmp(buf, value, 10) == 0);
+
+	/* A retrieve at an offset reports the whole value length */
+	memset(buf, 0, sizeof(buf));
+	sc = ut_submit(disk, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, sizeof(buf), 4, 0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(g_cdw0 == 10);
+	CU_ASSERT(memcmp(buf, value, 6) == 0);
+	CU_ASSERT(buf[6] == 0);
+	sc = ut_submit(disk, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, sizeof(buf), 11, 0);
+	CU_ASSERT(sc == SPDK_NVME_SC_INVALID_FIELD);
+
+	/* Append grows the value; the store options are honored */
+	memset(value, 'b', sizeof(value));
+	sc = ut_submit(disk, SPDK_BDEV_IO_KV_STORE, "key0", value, 5, 0,
+		       NVME_KV_STORE_CMD_OPTION_APPEND);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	sc = ut_submit(disk, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, sizeof(buf), 0, 0);
+	CU_ASSERT(g_cdw0 == 15);
+	CU_ASSERT(buf[9] == 'a' && buf[10] == 'b' && buf[14] == 'b');
+	sc = ut_submit(disk, SPDK_BDEV_IO_KV_STORE, "key0", value, 5, 0,
+		       NVME_KV_STORE_CMD_OPTION_MUST_NOT_EXIST);
+	CU_ASSERT(sc == SPDK_NVME_SC_KEY_EXISTS);
+	sc = ut_submit(disk, SPDK_BDEV_IO_KV_STORE, "key1", value, 5, 0,
+		       NVME_KV_STORE_CMD_OPTION_MUST_EXIST);
+	CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+
+	/* Exist and delete */
+	sc = ut_submit(disk, SPDK_BDEV_IO_KV_EXIST, "key0", NULL, 0, 0, 0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	sc = ut_submit(disk, SPDK_BDEV_IO_KV_EXIST, "key1", NULL, 0, 0, 0);
+	CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+	sc = ut_submit(disk, SPDK_BDEV_IO_KV_DELETE, "key0", NULL, 0, 0, 0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(disk->count == 0);
+	CU_ASSERT(disk->used == 0);
+	sc = ut_submit(disk, SPDK_BDEV_IO_KV_DELETE, "key0", NULL, 0, 0, 0);
+	CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+	sc = ut_submit(disk, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, sizeof(buf), 0, 0);
+	CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+
+	/* Stores beyond the capacity are refused */
+	disk->capacity = kv_emu_entry_size(sizeof(value)) + kv_emu_entry_size(0);
+	sc = ut_submit(disk, SPDK_BDEV_IO_KV_STORE, "key0", value, sizeof(value), 0, 0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	sc = ut_submit(disk, SPDK_BDEV_IO_KV_STORE, "key1", value, 1, 0, 0);
+	CU_ASSERT(sc == SPDK_NVME_SC_CAPACITY_EXCEEDED);
+	sc = ut_submit(disk, SPDK_BDEV_IO_KV_STORE, "key1", value, 0, 0, 0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+
+	kv_emu_disk_free(disk);
+}
+
+static void
+test_index(void)
+{
+	struct kv_emu_disk *disk = ut_disk_create(64 * 1024 * 1024);
+	uint8_t key[NVME_KV_MAX_KEY_LENGTH];
+	size_t key_len;
+	uint32_t i, value, cdw0, num = 4 * KV_EMU_INDEX_MIN_SLOTS;
+	struct iovec iov;
+	int sc;
+
+	/* The index grows past its initial size and every key stays reachable */
+	for (i = 0; i < num; i++) {
+		ut_key(key, &key_len, i);
+		iov.iov_base = &i;
+		iov.iov_len = sizeof(i);
+		sc = kv_emu_store(disk, key, key_len, 0, &iov, 1, sizeof(i));
+		CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	}
+	CU_ASSERT(disk->count == num);
+	CU_ASSERT(disk->mask + 1 > num);
+
+	/* Removing every other key keeps the probe sequences of the rest intact */
+	for (i = 0; i < num; i += 2) {
+		ut_key(key, &key_len, i);
+		sc = kv_emu_delete(disk, key, key_len);
+		CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	}
+	CU_ASSERT(disk->count == num / 2);
+	for (i = 0; i < num; i++) {
+		ut_key(key, &key_len, i);
+		iov.iov_base = &value;
+		iov.iov_len = sizeof(value);
+		value = UINT32_MAX;
+		sc = kv_emu_retrieve(disk, key, key_len, 0, &iov, 1, sizeof(value), &cdw0);
+		if (i % 2 == 0) {
+			CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+		} else {
+			CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+			CU_ASSERT(value == i);
+		}
+	}
+
+	kv_emu_disk_free(disk);
+}
+
+static void
+test_list(void)
+{
+	struct kv_emu_disk *disk = ut_disk_create(1024 * 1024);
+	const char *keys[] = { "b2", "a", "b10", "c", "b", "b1" };
+	uint8_t buf[128];
+	uint32_t num;
+	uint16_t key_len;
+	uint64_t i;
+	int sc;
+
+	for (i = 0; i < SPDK_COUNTOF(keys); i++) {
+		sc = ut_submit(disk, SPDK_BDEV_IO_KV_STORE, keys[i], buf, 1, 0, 0);
+		CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	}
+
+	/* Keys come back in ascending order, filtered by the prefix */
+	memset(buf, 0xff, sizeof(buf));
+	sc = ut_submit(disk, SPDK_BDEV_IO_KV_LIST, "b", buf, sizeof(buf), 0, 0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(g_cdw0 == 4);
+	memcpy(&num, buf, sizeof(num));
+	CU_ASSERT(num == 4);
+	memcpy(&key_len, buf + 4, sizeof(key_len));
+	CU_ASSERT(key_len == 1 && memcmp(buf + 6, "b", 1) == 0);
+	memcpy(&key_len, buf + 10, sizeof(key_len));
+	CU_ASSERT(key_len == 2 && memcmp(buf + 12, "b1", 2) == 0);
+	memcpy(&key_len, buf + 16, sizeof(key_len));
+	CU_ASSERT(key_len == 3 && memcmp(buf + 18, "b10", 3) == 0);
+	memcpy(&key_len, buf + 22, sizeof(key_len));
+	CU_ASSERT(key_len == 2 && memcmp(buf + 24, "b2", 2) == 0);
+
+	/* An empty prefix lists everything */
+	sc = ut_submit(disk, SPDK_BDEV_IO_KV_LIST, NULL, buf, sizeof(buf), 0, 0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(g_cdw0 == SPDK_COUNTOF(keys));
+	memcpy(&key_len, buf + 4, sizeof(key_len));
+	CU_ASSERT(key_len == 1 && memcmp(buf + 6, "a", 1) == 0);
+
+	/* Only the keys that fit in the buffer are returned */
+	sc = ut_submit(disk, SPDK_BDEV_IO_KV_LIST, "b", buf, 16, 0, 0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(g_cdw0 == 2);
+	memcpy(&num, buf, sizeof(num));
+	CU_ASSERT(num == 2);
+
+	sc = ut_submit(disk, SPDK_BDEV_IO_KV_LIST, "d", buf, sizeof(buf), 0, 0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(g_cdw0 == 0);
+
+	kv_emu_disk_free(disk);
+}
+
+static void
+test_batch(void)
+{
+	struct kv_emu_disk *disk = ut_disk_create(1024 * 1024);
+	struct spdk_bdev_kv_batch_entry entries[3] = {};
+	struct spdk_bdev_io *bdev_io;
+	struct iovec iovs[3];
+	char values[3][8];
+	uint32_t i;
+
+	bdev_io = calloc(1, sizeof(*bdev_io));
+	SPDK_CU_ASSERT_FATAL(bdev_io != NULL);
+	bdev_io->bdev = &disk->bdev;
+	bdev_io->type = SPDK_BDEV_IO_KV_BATCH;
+	bdev_io->u.bdev.nvme_kv.batch = entries;
+	bdev_io->u.bdev.nvme_kv.batch_count = 3;
+
+	for (i = 0; i < 3; i++) {
+		ut_key(entries[i].key, &entries[i].key_length, i);
+		memset(values[i], 'a' + i, sizeof(values[i]));
+		iovs[i].iov_base = values[i];
+		iovs[i].iov_len = sizeof(values[i]);
+		entries[i].iovs = &iovs[i];
+		entries[i].iovcnt = 1;
+		entries[i].nbytes = sizeof(values[i]);
+	}
+
+	/* Store two of the three keys */
+	bdev_io->u.bdev.nvme_kv.batch_count = 2;
+	bdev_io->u.bdev.nvme_kv.batch_type = SPDK_BDEV_IO_KV_STORE;
+	bdev_kv_emu_submit_request(NULL, bdev_io);
+	CU_ASSERT(g_sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(entries[0].sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(entries[1].sc == SPDK_NVME_SC_SUCCESS);
+	bdev_io->u.bdev.nvme_kv.batch_count = 3;
+
+	/* A missing key does not fail the batch */
+	bdev_io->u.bdev.nvme_kv.batch_type = SPDK_BDEV_IO_KV_EXIST;
+	bdev_kv_emu_submit_request(NULL, bdev_io);
+	CU_ASSERT(g_sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(entries[0].sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(entries[1].sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(entries[2].sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+
+	memset(values, 0, sizeof(values));
+	bdev_io->u.bdev.nvme_kv.batch_type = SPDK_BDEV_IO_KV_RETRIEVE;
+	bdev_kv_emu_submit_request(NULL, bdev_io);
+	CU_ASSERT(g_sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(entries[0].cdw0 == sizeof(values[0]));
+	CU_ASSERT(values[0][0] == 'a' && values[1][7] == 'b');
+	CU_ASSERT(entries[2].sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+
+	/*
+	 * Any other per-key error completes the batch with the first one, after
+	 * every key has been processed.
+	 */
+	entries[0].options = NVME_KV_STORE_CMD_OPTION_MUST_NOT_EXIST;
+	entries[1].key_length = 0;
+	entries[2].options = NVME_KV_STORE_CMD_OPTION_MUST_NOT_EXIST;
+	bdev_io->u.bdev.nvme_kv.batch_type = SPDK_BDEV_IO_KV_STORE;
+	bdev_kv_emu_submit_request(NULL, bdev_io);
+	CU_ASSERT(g_sc == SPDK_NVME_SC_KEY_EXISTS);
+	CU_ASSERT(entries[0].sc == SPDK_NVME_SC_KEY_EXISTS);
+	CU_ASSERT(entries[1].sc == SPDK_NVME_SC_INVALID_KEY_SIZE);
+	CU_ASSERT(entries[2].sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(disk->count == 3);
+
+	free(bdev_io);
+	kv_emu_disk_free(disk);
+}
+
+static void
+test_select(void)
+{
+	struct kv_emu_disk *disk = ut_disk_create(1024 * 1024);
+	char value[] = "name,qty\napple,3\npear,7\nplum,12\n";
+	char query[] = "SELECT name FROM s3object WHERE qty > 5";
+	char buf[64];
+	uint32_t id;
+	int sc;
+
+	sc = ut_submit(disk, SPDK_BDEV_IO_KV_STORE, "fruit", value, strlen(value), 0, 0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+
+	sc = ut_submit(disk, SPDK_BDEV_IO_KV_SEND_SELECT, "fruit", query, sizeof(query), 0,
+		       NVME_KV_SELECT_CMD_OUTPUT_TYPE_USE_CSV_HEADERS_INPUT);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	id = g_cdw0;
+	CU_ASSERT(id != 0);
+	CU_ASSERT(disk->selects.num_results == 1);
+
+	/* Partial reads keep the result until it has been fetched */
+	memset(buf, 0, sizeof(buf));
+	sc = ut_submit_select(disk, SPDK_BDEV_IO_KV_RETRIEVE_SELECT, NULL, buf, 4, 0,
+			      NVME_KV_SELECT_CMD_OPTION_DO_NOT_FREE_IF_NOT_ALL_DATA_FETCHED, id);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(g_cdw0 == strlen("pear\nplum\n"));
+	CU_ASSERT(memcmp(buf, "pear", 4) == 0);
+	CU_ASSERT(disk->selects.num_results == 1);
+
+	memset(buf, 0, sizeof(buf));
+	sc = ut_submit_select(disk, SPDK_BDEV_IO_KV_RETRIEVE_SELECT, NULL, buf, sizeof(buf), 0,
+			      NVME_KV_SELECT_CMD_OPTION_DO_NOT_FREE_IF_NOT_ALL_DATA_FETCHED, id);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(strcmp(buf, "pear\nplum\n") == 0);
+	CU_ASSERT(disk->selects.num_results == 0);
+	sc = ut_submit_select(disk, SPDK_BDEV_IO_KV_RETRIEVE_SELECT, NULL, buf, sizeof(buf), 0, 0,
+			      id);
+	CU_ASSERT(sc == SPDK_NVME_SC_INVALID_FIELD);
+
+	/* Queries on missing keys and malformed queries fail */
+	sc = ut_submit(disk, SPDK_BDEV_IO_KV_SEND_SELECT, "nokey", query, sizeof(query), 0, 0);
+	CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+	sc = ut_submit(disk, SPDK_BDEV_IO_KV_SEND_SELECT, "fruit", "SELECT", 7, 0, 0);
+	CU_ASSERT(sc == SPDK_NVME_SC_INVALID_FIELD);
+
+	/* Results that are never retrieved are evicted oldest first */
+	sc = ut_submit(disk, SPDK_BDEV_IO_KV_SEND_SELECT, "fruit", query, sizeof(query), 0,
+		       NVME_KV_SELECT_CMD_OUTPUT_TYPE_USE_CSV_HEADERS_INPUT);
+	id = g_cdw0;
+	for (sc = 0; sc < KV_EMU_MAX_SELECTS; sc++) {
+		ut_submit(disk, SPDK_BDEV_IO_KV_SEND_SELECT, "fruit", query, sizeof(query), 0,
+			  NVME_KV_SELECT_CMD_OUTPUT_TYPE_USE_CSV_HEADERS_INPUT);
+	}
+	CU_ASSERT(disk->selects.num_results == KV_EMU_MAX_SELECTS);
+	sc = ut_submit_select(disk, SPDK_BDEV_IO_KV_RETRIEVE_SELECT, NULL, buf, sizeof(buf), 0, 0,
+			      id);
+	CU_ASSERT(sc == SPDK_NVME_SC_INVALID_FIELD);
+
+	kv_emu_disk_free(disk);
+}
+
+static void
+test_select_results(void)
+{
+	struct spdk_kv_select_results results;
+	struct iovec iov;
+	char buf[8];
+	uint32_t id, id2, len;
+	uint8_t options;
+	int rc;
+
+	/* Ids of a flagged table keep the flag and skip zero when they wrap */
+	spdk_kv_select_results_init(&results, 2, 0x40000000U);
+	results.next_id = 0x3ffffffeU;
+	rc = spdk_kv_select_results_add(&results, strdup("abc"), 3, &id);
+	CU_ASSERT(rc == 0);
+	CU_ASSERT(id == 0x7fffffffU);
+	rc = spdk_kv_select_results_add(&results, strdup("de"), 2, &id2);
+	CU_ASSERT(rc == 0);
+	CU_ASSERT(id2 == 0x40000001U);
+
+	/* A partial read keeps the result until its end is read */
+	options = NVME_KV_SELECT_CMD_OPTION_DO_NOT_FREE_IF_NOT_ALL_DATA_FETCHED;
+	iov.iov_base = buf;
+	iov.iov_len = 2;
+	rc = spdk_kv_select_results_read(&results, id, 0, options, &iov, 1, 2, &len);
+	CU_ASSERT(rc == 0);
+	CU_ASSERT(len == 3);
+	CU_ASSERT(memcmp(buf, "ab", 2) == 0);
+	rc = spdk_kv_select_results_read(&results, id, 2, options, &iov, 1, 2, &len);
+	CU_ASSERT(rc == 0);
+	CU_ASSERT(buf[0] == 'c');
+	CU_ASSERT(results.num_results == 1);
+	rc = spdk_kv_select_results_read(&results, id, 0, 0, &iov, 1, 2, &len);
+	CU_ASSERT(rc == -ENOENT);
+
+	/* Reads past the end fail and the oldest result is evicted at the limit */
+	rc = spdk_kv_select_results_read(&results, id2, 3, 1, &iov, 1, 2, &len);
+	CU_ASSERT(rc == -EINVAL);
+	rc = spdk_kv_select_results_add(&results, strdup("f"), 1, &id);
+	CU_ASSERT(rc == 0);
+	rc = spdk_kv_select_results_add(&results, strdup("g"), 1, &id);
+	CU_ASSERT(rc == 0);
+	CU_ASSERT(results.num_results == 2);
+	rc = spdk_kv_select_results_read(&results, id2, 0, 0, &iov, 1, 2, &len);
+	CU_ASSERT(rc == -ENOENT);
+
+	spdk_kv_select_results_fini(&results);
+	CU_ASSERT(results.num_results == 0);
+}
+
+int
+main(int argc, char **argv)
+{
+	CU_pSuite	suite = NULL;
+	unsigned int	num_failures;
+
+	CU_set_error_action(CUEA_ABORT);
+	CU_initialize_registry();
+
+	suite = CU_add_suite("kv_emu", NULL, NULL);
+
+	CU_ADD_TEST(suite, test_store_retrieve);
+	CU_ADD_TEST(suite, test_index);
+	CU_ADD_TEST(suite, test_list);
+	CU_ADD_TEST(suite, test_batch);
+	CU_ADD_TEST(suite, test_select);
+	CU_ADD_TEST(suite, test_select_results);
+
+	g_thread = spdk_thread_create("test", NULL);
+	spdk_set_thread(g_thread);
+
+	CU_basic_set_mode(CU_BRM_VERBOSE);
+	CU_basic_run_tests();
+	num_failures = CU_get_number_of_failures();
+
+	spdk_thread_exit(g_thread);
+	while (!spdk_thread_is_exited(g_thread)) {
+		spdk_thread_poll(g_thread, 0, 0);
+	}
+	spdk_thread_destroy(g_thread);
+
+	CU_cleanup_registry();
+
+	return num_failures;
+}
@@ -0,0 +1,646 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+#include "spdk/stdinc.h"
+#include "spdk_cunit.h"
+#include "spdk/env.h"
+#include "spdk_internal/mock.h"
+#include "thread/thread_internal.h"
+#include "common/lib/test_env.c"
+#include "bdev/kv_mirror/vbdev_kv_mirror.c"
+#include "common/lib/test_bdev_kv.c"
+
+#define UT_NUM_REPLICAS	2
+
+static struct spdk_thread *g_thread;
+static const char *g_base_names[] = { "base0", "base1" };
+static struct ut_kv_base *g_bases[UT_NUM_REPLICAS];
+static int g_delete_rc;
+static bool g_delete_done;
+
+static void
+ut_delete_done(void *cb_arg, int rc)
+{
+	g_delete_rc = rc;
+	g_delete_done = true;
+}
+
+static struct vbdev_kv_mirror *
+ut_mirror_create(uint64_t dirty_log_keys)
+{
+	struct vbdev_kv_mirror_opts opts = {
+		.name = "mirror0",
+		.base_bdev_names = g_base_names,
+		.num_base_bdevs = UT_NUM_REPLICAS,
+		.dirty_log_keys = dirty_log_keys,
+	};
+	struct spdk_bdev *bdev;
+	uint32_t i;
+	int rc;
+
+	for (i = 0; i < UT_NUM_REPLICAS; i++) {
+		g_bases[i] = ut_kv_base_create(g_base_names[i]);
+	}
+	rc = bdev_kv_mirror_create(&opts);
+	CU_ASSERT(rc == 0);
+	ut_kv_poll();
+	bdev = spdk_bdev_get_by_name("mirror0");
+	SPDK_CU_ASSERT_FATAL(bdev != NULL);
+
+	return bdev->ctxt;
+}
+
+static void
+ut_mirror_delete(struct vbdev_kv_mirror *mirror)
+{
+	uint32_t i;
+
+	g_delete_done = false;
+	bdev_kv_mirror_delete(mirror->bdev.name, ut_delete_done, NULL);
+	ut_kv_poll();
+	CU_ASSERT(g_delete_done == true);
+	CU_ASSERT(g_delete_rc == 0);
+
+	for (i = 0; i < UT_NUM_REPLICAS; i++) {
+		ut_kv_base_destroy(g_bases[i]);
+		g_bases[i] = NULL;
+	}
+}
+
+/* Submit a single-iov KV I/O to the mirror and return its NVMe status code. */
+static int
+ut_submit(struct vbdev_kv_mirror *mirror, struct spdk_io_channel *ch, enum spdk_bdev_io_type type,
+	  const char *key, void *buf, uint64_t len, uint32_t *cdw0)
+{
+	struct spdk_bdev_io *bdev_io;
+	int sc;
+
+	bdev_io = ut_kv_vbdev_io(&mirror->bdev, sizeof(struct kv_mirror_bdev_io), type, key, buf,
+				 len);
+	sc = ut_kv_vbdev_submit(ch, bdev_io);
+	if (cdw0 != NULL) {
+		*cdw0 = bdev_io->internal.error.nvme.cdw0;
+	}
+	free(bdev_io);
+
+	return sc;
+}
+
+static int
+ut_store(struct vbdev_kv_mirror *mirror, struct spdk_io_channel *ch, const char *key,
+	 const char *value)
+{
+	return ut_submit(mirror, ch, SPDK_BDEV_IO_KV_STORE, key, (void *)value, strlen(value),
+			 NULL);
+}
+
+/* Check a replica holds value under key, or does not have the key if value is NULL. */
+static void
+ut_check_value(uint32_t r, const char *key, const char *value)
+{
+	const uint8_t *buf;
+	uint32_t len;
+
+	buf = ut_kv_base_get(g_bases[r], key, &len);
+	if (value == NULL) {
+		CU_ASSERT(buf == NULL);
+		return;
+	}
+	SPDK_CU_ASSERT_FATAL(buf != NULL);
+	CU_ASSERT(len == strlen(value));
+	CU_ASSERT(memcmp(buf, value, len) == 0);
+}
+
+static uint32_t
+ut_num_reads(uint32_t r)
+{
+	return g_bases[r]->num_ios[SPDK_BDEV_IO_KV_RETRIEVE];
+}
+
+static void
+test_create_delete(void)
+{
+	struct vbdev_kv_mirror_opts opts = {
+		.name = "mirror0",
+		.base_bdev_names = g_base_names,
+		.num_base_bdevs = UT_NUM_REPLICAS,
+	};
+	const char *dup_names[] = { "base0", "base0" };
+	struct vbdev_kv_mirror *mirror;
+	uint32_t i;
+	int rc;
+
+	/* A mirror needs at least two distinct replicas */
+	opts.num_base_bdevs = 1;
+	rc = bdev_kv_mirror_create(&opts);
+	CU_ASSERT(rc == -EINVAL);
+	opts.num_base_bdevs = UT_NUM_REPLICAS;
+	opts.base_bdev_names = dup_names;
+	rc = bdev_kv_mirror_create(&opts);
+	CU_ASSERT(rc == -EINVAL);
+	opts.base_bdev_names = g_base_names;
+
+	/* It is created once all replicas are there */
+	rc = bdev_kv_mirror_create(&opts);
+	CU_ASSERT(rc == 0);
+	rc = bdev_kv_mirror_create(&opts);
+	CU_ASSERT(rc == -EEXIST);
+	g_bases[0] = ut_kv_base_create("base0");
+	vbdev_kv_mirror_examine(&g_bases[0]->bdev);
+	CU_ASSERT(spdk_bdev_get_by_name("mirror0") == NULL);
+	g_bases[1] = ut_kv_base_create("base1");
+	g_bases[1]->bdev.blockcnt = 512;
+	vbdev_kv_mirror_examine(&g_bases[1]->bdev);
+	SPDK_CU_ASSERT_FATAL(spdk_bdev_get_by_name("mirror0") != NULL);
+	mirror = spdk_bdev_get_by_name("mirror0")->ctxt;
+	CU_ASSERT(mirror->online_mask == 0x3);
+	CU_ASSERT(mirror->max_dirty == KV_MIRROR_DEFAULT_DIRTY_LOG_KEYS);
+	CU_ASSERT(mirror->bdev.blockcnt == 512);
+	for (i = 0; i < UT_NUM_REPLICAS; i++) {
+		CU_ASSERT(mirror->replicas[i].state == KV_MIRROR_REPLICA_ONLINE);
+		CU_ASSERT(g_bases[i]->open_count == 1);
+		CU_ASSERT(g_bases[i]->bdev.internal.claim.v1.module == &kv_mirror_if);
+	}
+	CU_ASSERT(vbdev_kv_mirror_io_type_supported(mirror, SPDK_BDEV_IO_KV_STORE) == true);
+	CU_ASSERT(vbdev_kv_mirror_io_type_supported(mirror, SPDK_BDEV_IO_TYPE_READ) == false);
+
+	/* Deleted mirrors are not created again when their replicas come back */
+	g_delete_done = false;
+	bdev_kv_mirror_delete("mirror0", ut_delete_done, NULL);
+	ut_kv_poll();
+	CU_ASSERT(g_delete_done == true);
+	CU_ASSERT(spdk_bdev_get_by_name("mirror0") == NULL);
+	for (i = 0; i < UT_NUM_REPLICAS; i++) {
+		CU_ASSERT(g_bases[i]->open_count == 0);
+		CU_ASSERT(g_bases[i]->bdev.internal.claim_type == SPDK_BDEV_CLAIM_NONE);
+		vbdev_kv_mirror_examine(&g_bases[i]->bdev);
+	}
+	CU_ASSERT(spdk_bdev_get_by_name("mirror0") == NULL);
+
+	g_delete_done = false;
+	bdev_kv_mirror_delete("mirror0", ut_delete_done, NULL);
+	CU_ASSERT(g_delete_done == true);
+	CU_ASSERT(g_delete_rc == -ENODEV);
+
+	/* All replicas need to support KV commands */
+	g_bases[1]->kv_supported = false;
+	rc = bdev_kv_mirror_create(&opts);
+	CU_ASSERT(rc == -ENOTSUP);
+	CU_ASSERT(g_bases[0]->open_count == 0);
+	CU_ASSERT(g_bases[0]->bdev.internal.claim_type == SPDK_BDEV_CLAIM_NONE);
+
+	for (i = 0; i < UT_NUM_REPLICAS; i++) {
+		ut_kv_base_destroy(g_bases[i]);
+		g_bases[i] = NULL;
+	}
+}
+
+static void
+test_io(void)
+{
+	struct spdk_bdev_kv_batch_entry entries[2] = {};
+	struct vbdev_kv_mirror *mirror;
+	struct spdk_bdev_io *bdev_io;
+	struct spdk_io_channel *ch;
+	struct iovec iovs[2];
+	uint32_t i, r, cdw0, id;
+	char buf[16], vals[2][16];
+	int sc;
+
+	mirror = ut_mirror_create(0);
+	ch = spdk_get_io_channel(mirror);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+
+	/* Writes go to all replicas */
+	sc = ut_store(mirror, ch, "key0", "value0");
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	ut_check_value(0, "key0", "value0");
+	ut_check_value(1, "key0", "value0");
+
+	/* Reads go to one replica at a time, spread over all */
+	for (i = 0; i < 4; i++) {
+		memset(buf, 0, sizeof(buf));
+		sc = ut_submit(mirror, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, sizeof(buf),
+			       &cdw0);
+		CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+		CU_ASSERT(cdw0 == 6);
+		CU_ASSERT(strcmp(buf, "value0") == 0);
+	}
+	CU_ASSERT(ut_num_reads(0) == 2);
+	CU_ASSERT(ut_num_reads(1) == 2);
+	sc = ut_submit(mirror, ch, SPDK_BDEV_IO_KV_EXIST, "key0", NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(g_bases[0]->num_ios[SPDK_BDEV_IO_KV_EXIST] +
+		  g_bases[1]->num_ios[SPDK_BDEV_IO_KV_EXIST] == 1);
+
+	/* Batched stores go to all replicas, other batches to one */
+	for (i = 0; i < 2; i++) {
+		snprintf((char *)entries[i].key, sizeof(entries[i].key), "bkey%u", i);
+		entries[i].key_length = 5;
+		snprintf(vals[i], sizeof(vals[i]), "bval%u", i);
+		iovs[i].iov_base = vals[i];
+		iovs[i].iov_len = 5;
+		entries[i].iovs = &iovs[i];
+		entries[i].iovcnt = 1;
+		entries[i].nbytes = 5;
+	}
+	bdev_io = ut_kv_vbdev_io(&mirror->bdev, sizeof(struct kv_mirror_bdev_io),
+				 SPDK_BDEV_IO_KV_BATCH, NULL, NULL, 0);
+	bdev_io->u.bdev.nvme_kv.batch_type = SPDK_BDEV_IO_KV_STORE;
+	bdev_io->u.bdev.nvme_kv.batch = entries;
+	bdev_io->u.bdev.nvme_kv.batch_count = 2;
+	sc = ut_kv_vbdev_submit(ch, bdev_io);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(entries[0].sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(entries[1].sc == SPDK_NVME_SC_SUCCESS);
+	for (r = 0; r < UT_NUM_REPLICAS; r++) {
+		ut_check_value(r, "bkey0", "bval0");
+		ut_check_value(r, "bkey1", "bval1");
+	}
+
+	memset(vals, 0, sizeof(vals));
+	iovs[0].iov_len = iovs[1].iov_len = entries[0].nbytes = entries[1].nbytes = 16;
+	bdev_io->u.bdev.nvme_kv.batch_type = SPDK_BDEV_IO_KV_RETRIEVE;
+	sc = ut_kv_vbdev_submit(ch, bdev_io);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(strcmp(vals[0], "bval0") == 0);
+	CU_ASSERT(strcmp(vals[1], "bval1") == 0);
+	CU_ASSERT(g_bases[0]->num_ios[SPDK_BDEV_IO_KV_BATCH] +
+		  g_bases[1]->num_ios[SPDK_BDEV_IO_KV_BATCH] == 3);
+	free(bdev_io);
+
+	/* The select id carries the replica that ran the query */
+	sc = ut_submit(mirror, ch, SPDK_BDEV_IO_KV_SEND_SELECT, "key0", "SELECT *", 8, &id);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	r = id & ((1 << KV_MIRROR_SELECT_ID_SHIFT) - 1);
+	SPDK_CU_ASSERT_FATAL(r < UT_NUM_REPLICAS);
+	CU_ASSERT(ut_kv_base_select_find(g_bases[r], id >> KV_MIRROR_SELECT_ID_SHIFT) != NULL);
+	bdev_io = ut_kv_vbdev_io(&mirror->bdev, sizeof(struct kv_mirror_bdev_io),
+				 SPDK_BDEV_IO_KV_RETRIEVE_SELECT, NULL, buf, sizeof(buf));
+	bdev_io->u.bdev.nvme_kv.select_id = id;
+	memset(buf, 0, sizeof(buf));
+	sc = ut_kv_vbdev_submit(ch, bdev_io);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(strcmp(buf, "value0") == 0);
+	CU_ASSERT(g_bases[r]->num_ios[SPDK_BDEV_IO_KV_RETRIEVE_SELECT] == 1);
+	bdev_io->u.bdev.nvme_kv.select_id = 1 << KV_MIRROR_SELECT_ID_SHIFT | UT_NUM_REPLICAS;
+	sc = ut_kv_vbdev_submit(ch, bdev_io);
+	CU_ASSERT(sc == SPDK_NVME_SC_INVALID_FIELD);
+	free(bdev_io);
+
+	sc = ut_submit(mirror, ch, SPDK_BDEV_IO_KV_DELETE, "key0", NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	ut_check_value(0, "key0", NULL);
+	ut_check_value(1, "key0", NULL);
+
+	CU_ASSERT(mirror->online_mask == 0x3);
+	CU_ASSERT(mirror->num_dirty == 0);
+
+	spdk_put_io_channel(ch);
+	ut_mirror_delete(mirror);
+}
+
+static void
+test_read_errors(void)
+{
+	struct vbdev_kv_mirror *mirror;
+	struct spdk_io_channel *ch;
+	uint32_t i, reads;
+	char buf[16];
+	int sc;
+
+	mirror = ut_mirror_create(0);
+	ch = spdk_get_io_channel(mirror);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+	sc = ut_store(mirror, ch, "key0", "value0");
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+
+	/* Errors about the command itself are not retried */
+	sc = ut_submit(mirror, ch, SPDK_BDEV_IO_KV_RETRIEVE, "nokey", buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+	CU_ASSERT(ut_num_reads(0) + ut_num_reads(1) == 1);
+	CU_ASSERT(mirror->online_mask == 0x3);
+
+	/* Device errors take the replica out of service and the read goes to another one */
+	g_bases[0]->fail_sc = SPDK_NVME_SC_DATA_TRANSFER_ERROR;
+	for (i = 0; i < 2; i++) {
+		memset(buf, 0, sizeof(buf));
+		sc = ut_submit(mirror, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, sizeof(buf),
+			       NULL);
+		CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+		CU_ASSERT(strcmp(buf, "value0") == 0);
+	}
+	CU_ASSERT(mirror->replicas[0].state == KV_MIRROR_REPLICA_FAILED);
+	CU_ASSERT(mirror->online_mask == 0x2);
+	reads = ut_num_reads(0);
+	sc = ut_submit(mirror, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(ut_num_reads(0) == reads);
+
+	/* The last replica stays in service and its errors are passed through */
+	g_bases[1]->fail_sc = SPDK_NVME_SC_INTERNAL_DEVICE_ERROR;
+	sc = ut_submit(mirror, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+	CU_ASSERT(mirror->online_mask == 0x2);
+	g_bases[0]->fail_sc = 0;
+	g_bases[1]->fail_sc = 0;
+
+	/* Failed submissions */
+	g_bases[1]->submit_rc = -EIO;
+	sc = ut_submit(mirror, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key0", buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == -1);
+	g_bases[1]->submit_rc = 0;
+	sc = ut_submit(mirror, ch, SPDK_BDEV_IO_TYPE_READ, NULL, buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == -1);
+
+	spdk_put_io_channel(ch);
+	ut_mirror_delete(mirror);
+}
+
+static void
+test_write_errors(void)
+{
+	struct spdk_bdev_kv_batch_entry entries[2] = {};
+	struct vbdev_kv_mirror *mirror;
+	struct spdk_bdev_io *bdev_io;
+	struct spdk_io_channel *ch;
+	struct iovec iov = { .iov_base = "bval", .iov_len = 4 };
+	uint32_t i;
+	int sc;
+
+	mirror = ut_mirror_create(0);
+	ch = spdk_get_io_channel(mirror);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+	sc = ut_store(mirror, ch, "key0", "value0");
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+
+	/* A write no replica took fails and leaves the replicas in service */
+	g_bases[0]->fail_sc = SPDK_NVME_SC_INVALID_FIELD;
+	g_bases[1]->fail_sc = SPDK_NVME_SC_INVALID_FIELD;
+	sc = ut_store(mirror, ch, "key1", "value1");
+	CU_ASSERT(sc == SPDK_NVME_SC_INVALID_FIELD);
+	CU_ASSERT(mirror->online_mask == 0x3);
+	CU_ASSERT(mirror->num_dirty == 0);
+	g_bases[0]->fail_sc = 0;
+
+	/* A replica that fails a write another one took is taken out of service */
+	sc = ut_store(mirror, ch, "key1", "value1");
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(mirror->replicas[1].state == KV_MIRROR_REPLICA_FAILED);
+	CU_ASSERT(mirror->online_mask == 0x1);
+	CU_ASSERT(mirror->replicas[1].dirty_keys == 1);
+	g_bases[1]->fail_sc = 0;
+
+	/* Writes while it is out of service are only logged for it */
+	sc = ut_store(mirror, ch, "key0", "value0b");
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	sc = ut_submit(mirror, ch, SPDK_BDEV_IO_KV_DELETE, "key0", NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	for (i = 0; i < 2; i++) {
+		snprintf((char *)entries[i].key, sizeof(entries[i].key), "bkey%u", i);
+		entries[i].key_length = 5;
+		entries[i].iovs = &iov;
+		entries[i].iovcnt = 1;
+		entries[i].nbytes = 4;
+	}
+	bdev_io = ut_kv_vbdev_io(&mirror->bdev, sizeof(struct kv_mirror_bdev_io),
+				 SPDK_BDEV_IO_KV_BATCH, NULL, NULL, 0);
+	bdev_io->u.bdev.nvme_kv.batch_type = SPDK_BDEV_IO_KV_STORE;
+	bdev_io->u.bdev.nvme_kv.batch = entries;
+	bdev_io->u.bdev.nvme_kv.batch_count = 2;
+	sc = ut_kv_vbdev_submit(ch, bdev_io);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	free(bdev_io);
+	CU_ASSERT(g_bases[1]->num_ios[SPDK_BDEV_IO_KV_BATCH] == 0);
+	CU_ASSERT(mirror->replicas[1].dirty_keys == 4);
+	CU_ASSERT(mirror->num_dirty == 4);
+	ut_check_value(1, "key0", "value0");
+	ut_check_value(1, "key1", NULL);
+
+	/* A resync copies the dirty keys, and deletes the ones that are gone */
+	CU_ASSERT(bdev_kv_mirror_resync("nomirror") == -ENODEV);
+	CU_ASSERT(bdev_kv_mirror_resync("mirror0") == 0);
+	ut_kv_poll();
+	CU_ASSERT(mirror->replicas[1].state == KV_MIRROR_REPLICA_ONLINE);
+	CU_ASSERT(mirror->online_mask == 0x3);
+	CU_ASSERT(mirror->replicas[1].dirty_keys == 0);
+	CU_ASSERT(mirror->num_dirty == 0);
+	CU_ASSERT(mirror->resync == NULL);
+	ut_check_value(1, "key0", NULL);
+	ut_check_value(1, "key1", "value1");
+	ut_check_value(1, "bkey0", "bval");
+	ut_check_value(1, "bkey1", "bval");
+
+	/* Failed submissions count as failures of the replica */
+	g_bases[0]->submit_rc = -EIO;
+	sc = ut_store(mirror, ch, "key2", "value2");
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(mirror->replicas[0].state == KV_MIRROR_REPLICA_FAILED);
+	CU_ASSERT(mirror->replicas[0].dirty_keys == 1);
+	g_bases[0]->submit_rc = 0;
+
+	/* A resync that fails on the target leaves it out of service */
+	g_bases[0]->fail_sc = SPDK_NVME_SC_DATA_TRANSFER_ERROR;
+	CU_ASSERT(bdev_kv_mirror_resync("mirror0") == 0);
+	ut_kv_poll();
+	CU_ASSERT(mirror->replicas[0].state == KV_MIRROR_REPLICA_FAILED);
+	CU_ASSERT(mirror->replicas[0].dirty_keys == 1);
+	CU_ASSERT(mirror->online_mask == 0x2);
+	g_bases[0]->fail_sc = 0;
+	CU_ASSERT(bdev_kv_mirror_resync("mirror0") == 0);
+	ut_kv_poll();
+	CU_ASSERT(mirror->online_mask == 0x3);
+	ut_check_value(0, "key2", "value2");
+
+	spdk_put_io_channel(ch);
+	ut_mirror_delete(mirror);
+}
+
+static void
+test_resync(void)
+{
+	struct vbdev_kv_mirror *mirror;
+	struct spdk_bdev_io *bdev_io;
+	struct spdk_io_channel *ch;
+	char value[KV_MIRROR_RESYNC_BUF_SIZE + 16];
+	int sc;
+
+	mirror = ut_mirror_create(2);
+	ch = spdk_get_io_channel(mirror);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+
+	g_bases[1]->fail_sc = SPDK_NVME_SC_DATA_TRANSFER_ERROR;
+	sc = ut_store(mirror, ch, "key0", "value0");
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	g_bases[1]->fail_sc = 0;
+	CU_ASSERT(mirror->replicas[1].state == KV_MIRROR_REPLICA_FAILED);
+
+	/* A key written while it is copied is copied again */
+	CU_ASSERT(bdev_kv_mirror_resync("mirror0") == 0);
+	CU_ASSERT(mirror->replicas[1].state == KV_MIRROR_REPLICA_RESYNCING);
+	CU_ASSERT(mirror->resync != NULL);
+	CU_ASSERT(ut_kv_poll_one() == true);
+	CU_ASSERT(g_bases[1]->num_ios[SPDK_BDEV_IO_KV_STORE] == 2);
+	bdev_io = ut_kv_vbdev_io(&mirror->bdev, sizeof(struct kv_mirror_bdev_io),
+				 SPDK_BDEV_IO_KV_STORE, "key0", "value0b", 7);
+	vbdev_kv_mirror_submit_request(ch, bdev_io);
+	ut_kv_poll();
+	CU_ASSERT(bdev_io->internal.status == SPDK_BDEV_IO_STATUS_SUCCESS);
+	free(bdev_io);
+	CU_ASSERT(mirror->replicas[1].state == KV_MIRROR_REPLICA_ONLINE);
+	CU_ASSERT(g_bases[1]->num_ios[SPDK_BDEV_IO_KV_STORE] == 3);
+	ut_check_value(1, "key0", "value0b");
+	CU_ASSERT(mirror->num_dirty == 0);
+
+	/* Values larger than the copy buffer are read again into a larger one */
+	memset(value, 'v', sizeof(value) - 1);
+	value[sizeof(value) - 1] = '\0';
+	g_bases[1]->fail_sc = SPDK_NVME_SC_DATA_TRANSFER_ERROR;
+	sc = ut_store(mirror, ch, "big", value);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	g_bases[1]->fail_sc = 0;
+	CU_ASSERT(bdev_kv_mirror_resync("mirror0") == 0);
+	ut_kv_poll();
+	CU_ASSERT(mirror->replicas[1].state == KV_MIRROR_REPLICA_ONLINE);
+	ut_check_value(1, "big", value);
+
+	/* A replica that misses more writes than the log holds can no longer be resynced */
+	g_bases[1]->fail_sc = SPDK_NVME_SC_DATA_TRANSFER_ERROR;
+	sc = ut_store(mirror, ch, "key1", "value1");
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	g_bases[1]->fail_sc = 0;
+	sc = ut_store(mirror, ch, "key2", "value2");
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(mirror->replicas[1].stale == false);
+	sc = ut_store(mirror, ch, "key3", "value3");
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(mirror->replicas[1].stale == true);
+	CU_ASSERT(mirror->num_dirty == 0);
+	CU_ASSERT(bdev_kv_mirror_resync("mirror0") == 0);
+	ut_kv_poll();
+	CU_ASSERT(mirror->replicas[1].state == KV_MIRROR_REPLICA_FAILED);
+	CU_ASSERT(mirror->online_mask == 0x1);
+
+	spdk_put_io_channel(ch);
+	ut_mirror_delete(mirror);
+}
+
+static void
+test_hotremove(void)
+{
+	struct vbdev_kv_mirror_opts opts = {
+		.name = "mirror0",
+		.base_bdev_names = g_base_names,
+		.num_base_bdevs = UT_NUM_REPLICAS,
+	};
+	struct vbdev_kv_mirror *mirror;
+	struct spdk_io_channel *ch;
+	char buf[16];
+	int rc, sc;
+
+	mirror = ut_mirror_create(0);
+	ch = spdk_get_io_channel(mirror);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+	sc = ut_store(mirror, ch, "key0", "value0");
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+
+	/* A removed replica is closed, and the mirror goes on without it */
+	ut_kv_base_remove(g_bases[1]);
+	ut_kv_poll();
+	CU_ASSERT(mirror->replicas[1].state == KV_MIRROR_REPLICA_MISSING);
+	CU_ASSERT(mirror->online_mask == 0x1);
+	CU_ASSERT(g_bases[1]->open_count == 0);
+	CU_ASSERT(g_bases[1]->bdev.internal.claim_type == SPDK_BDEV_CLAIM_NONE);
+	sc = ut_store(mirror, ch, "key0", "value0b");
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	sc = ut_store(mirror, ch, "key1", "value1");
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	sc = ut_submit(mirror, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key1", buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(mirror->replicas[1].dirty_keys == 2);
+
+	/* When it comes back, it is reopened and resynced */
+	vbdev_kv_mirror_examine(&g_bases[1]->bdev);
+	ut_kv_poll();
+	CU_ASSERT(g_bases[1]->open_count == 1);
+	CU_ASSERT(mirror->replicas[1].state == KV_MIRROR_REPLICA_ONLINE);
+	CU_ASSERT(mirror->online_mask == 0x3);
+	ut_check_value(1, "key0", "value0b");
+	ut_check_value(1, "key1", "value1");
+
+	/* Deleting the mirror waits for a resync in progress */
+	ut_kv_base_remove(g_bases[1]);
+	ut_kv_poll();
+	sc = ut_store(mirror, ch, "key2", "value2");
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	vbdev_kv_mirror_examine(&g_bases[1]->bdev);
+	while (mirror->resync == NULL) {
+		CU_ASSERT(spdk_thread_poll(g_thread, 0, 0) > 0);
+	}
+	CU_ASSERT(ut_kv_num_outstanding() == 1);
+	spdk_put_io_channel(ch);
+	g_delete_done = false;
+	bdev_kv_mirror_delete("mirror0", ut_delete_done, NULL);
+	CU_ASSERT(g_delete_done == false);
+	ut_kv_poll();
+	CU_ASSERT(g_delete_done == true);
+	CU_ASSERT(g_bases[0]->open_count == 0);
+	CU_ASSERT(g_bases[1]->open_count == 0);
+
+	/* Losing the last replica takes the mirror down */
+	rc = bdev_kv_mirror_create(&opts);
+	CU_ASSERT(rc == 0);
+	ut_kv_poll();
+	SPDK_CU_ASSERT_FATAL(spdk_bdev_get_by_name("mirror0") != NULL);
+	ut_kv_base_remove(g_bases[0]);
+	ut_kv_poll();
+	CU_ASSERT(spdk_bdev_get_by_name("mirror0") != NULL);
+	CU_ASSERT(g_bases[0]->open_count == 0);
+	ut_kv_base_remove(g_bases[1]);
+	ut_kv_poll();
+	CU_ASSERT(spdk_bdev_get_by_name("mirror0") == NULL);
+	CU_ASSERT(g_bases[1]->open_count == 0);
+	CU_ASSERT(g_bases[1]->bdev.internal.claim_type == SPDK_BDEV_CLAIM_NONE);
+
+	vbdev_kv_mirror_finish();
+	ut_kv_base_destroy(g_bases[0]);
+	ut_kv_base_destroy(g_bases[1]);
+}
+
+int
+main(int argc, char **argv)
+{
+	CU_pSuite	suite = NULL;
+	unsigned int	num_failures;
+
+	CU_set_error_action(CUEA_ABORT);
+	CU_initialize_registry();
+
+	suite = CU_add_suite("kv_mirror", NULL, NULL);
+
+	CU_ADD_TEST(suite, test_create_delete);
+	CU_ADD_TEST(suite, test_io);
+	CU_ADD_TEST(suite, test_read_errors);
+	CU_ADD_TEST(suite, test_write_errors);
+	CU_ADD_TEST(suite, test_resync);
+	CU_ADD_TEST(suite, test_hotremove);
+
+	g_thread = spdk_thread_create("test", NULL);
+	spdk_set_thread(g_thread);
+
+	CU_basic_set_mode(CU_BRM_VERBOSE);
+	CU_basic_run_tests();
+	num_failures = CU_get_number_of_failures();
+
+	vbdev_kv_mirror_finish();
+	spdk_thread_exit(g_thread);
+	while (!spdk_thread_is_exited(g_thread)) {
+		spdk_thread_poll(g_thread, 0, 0);
+	}
+	spdk_thread_destroy(g_thread);
+
+	CU_cleanup_registry();
+
+	return num_failures;
+}
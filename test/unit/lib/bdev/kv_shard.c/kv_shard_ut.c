@@ -0,0 +1,637 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+#include "spdk/stdinc.h"
+#include "spdk_cunit.h"
+#include "spdk/env.h"
+#include "spdk_internal/mock.h"
+#include "thread/thread_internal.h"
+#include "common/lib/test_env.c"
+#include "bdev/kv_shard/vbdev_kv_shard.c"
+#include "common/lib/test_bdev_kv.c"
+
+#define UT_NUM_BASES	3
+#define UT_NUM_KEYS	24
+
+static struct spdk_thread *g_thread;
+static const char *g_base_names[] = { "base0", "base1", "base2" };
+static struct ut_kv_base *g_bases[UT_NUM_BASES];
+static int g_delete_rc;
+static bool g_delete_done;
+
+static void
+ut_delete_done(void *cb_arg, int rc)
+{
+	g_delete_rc = rc;
+	g_delete_done = true;
+}
+
+static void
+ut_bases_create(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < UT_NUM_BASES; i++) {
+		g_bases[i] = ut_kv_base_create(g_base_names[i]);
+	}
+}
+
+static void
+ut_bases_destroy(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < UT_NUM_BASES; i++) {
+		ut_kv_base_destroy(g_bases[i]);
+		g_bases[i] = NULL;
+	}
+}
+
+static struct vbdev_kv_shard *
+ut_shard_create(const char *const *names, enum vbdev_kv_shard_hash hash)
+{
+	struct vbdev_kv_shard_opts opts = {
+		.name = "shard0",
+		.base_bdev_names = names,
+		.num_base_bdevs = UT_NUM_BASES,
+		.hash = hash,
+	};
+	struct spdk_bdev *bdev;
+	int rc;
+
+	rc = bdev_kv_shard_create(&opts);
+	CU_ASSERT(rc == 0);
+	ut_kv_poll();
+	bdev = spdk_bdev_get_by_name("shard0");
+	SPDK_CU_ASSERT_FATAL(bdev != NULL);
+
+	return bdev->ctxt;
+}
+
+static void
+ut_shard_delete(struct vbdev_kv_shard *shard)
+{
+	g_delete_done = false;
+	bdev_kv_shard_delete(shard->bdev.name, ut_delete_done, NULL);
+	ut_kv_poll();
+	CU_ASSERT(g_delete_done == true);
+	CU_ASSERT(g_delete_rc == 0);
+}
+
+/* Submit a single-iov KV I/O to the shard and return its NVMe status code. */
+static int
+ut_submit(struct vbdev_kv_shard *shard, struct spdk_io_channel *ch, enum spdk_bdev_io_type type,
+	  const char *key, void *buf, uint64_t len, uint32_t *cdw0)
+{
+	struct spdk_bdev_io *bdev_io;
+	int sc;
+
+	bdev_io = ut_kv_vbdev_io(&shard->bdev, sizeof(struct kv_shard_bdev_io), type, key, buf,
+				 len);
+	sc = ut_kv_vbdev_submit(ch, bdev_io);
+	if (cdw0 != NULL) {
+		*cdw0 = bdev_io->internal.error.nvme.cdw0;
+	}
+	free(bdev_io);
+
+	return sc;
+}
+
+static int
+ut_batch(struct vbdev_kv_shard *shard, struct spdk_io_channel *ch, enum spdk_bdev_io_type type,
+	 struct spdk_bdev_kv_batch_entry *entries, uint32_t count)
+{
+	struct spdk_bdev_io *bdev_io;
+	int sc;
+
+	bdev_io = ut_kv_vbdev_io(&shard->bdev, sizeof(struct kv_shard_bdev_io),
+				 SPDK_BDEV_IO_KV_BATCH, NULL, NULL, 0);
+	bdev_io->u.bdev.nvme_kv.batch_type = type;
+	bdev_io->u.bdev.nvme_kv.batch = entries;
+	bdev_io->u.bdev.nvme_kv.batch_count = count;
+	sc = ut_kv_vbdev_submit(ch, bdev_io);
+	free(bdev_io);
+
+	return sc;
+}
+
+static void
+ut_key(char *key, uint32_t i)
+{
+	snprintf(key, 8, "key%02u", i);
+}
+
+static uint32_t
+ut_base_of(struct vbdev_kv_shard *shard, const char *key)
+{
+	return kv_shard_base_of(shard, (const uint8_t *)key, strlen(key));
+}
+
+/* Check a LIST buffer holds num keys, in order, starting with key number first. */
+static void
+ut_check_list(const uint8_t *buf, uint32_t num, uint32_t first)
+{
+	uint32_t i, n, pos = sizeof(n);
+	uint16_t key_len;
+	char key[8];
+
+	memcpy(&n, buf, sizeof(n));
+	CU_ASSERT(n == num);
+	for (i = 0; i < n; i++) {
+		ut_key(key, first + i);
+		memcpy(&key_len, buf + pos, sizeof(key_len));
+		CU_ASSERT(key_len == strlen(key));
+		CU_ASSERT(memcmp(buf + pos + sizeof(key_len), key, key_len) == 0);
+		pos += sizeof(key_len) + SPDK_ALIGN_CEIL(key_len, 4);
+	}
+}
+
+static void
+test_create_delete(void)
+{
+	struct vbdev_kv_shard_opts opts = {
+		.name = "shard0",
+		.base_bdev_names = g_base_names,
+		.num_base_bdevs = UT_NUM_BASES,
+	};
+	const char *dup_names[] = { "base0", "base1", "base0" };
+	struct vbdev_kv_shard *shard;
+	uint32_t i;
+	int rc;
+
+	opts.num_base_bdevs = 0;
+	rc = bdev_kv_shard_create(&opts);
+	CU_ASSERT(rc == -EINVAL);
+	opts.num_base_bdevs = VBDEV_KV_SHARD_MAX_BASE_BDEVS + 1;
+	rc = bdev_kv_shard_create(&opts);
+	CU_ASSERT(rc == -EINVAL);
+	opts.num_base_bdevs = UT_NUM_BASES;
+	opts.base_bdev_names = dup_names;
+	rc = bdev_kv_shard_create(&opts);
+	CU_ASSERT(rc == -EINVAL);
+	opts.base_bdev_names = g_base_names;
+
+	/* The shard is only created once all of its base bdevs are there */
+	rc = bdev_kv_shard_create(&opts);
+	CU_ASSERT(rc == 0);
+	rc = bdev_kv_shard_create(&opts);
+	CU_ASSERT(rc == -EEXIST);
+	g_bases[0] = ut_kv_base_create("base0");
+	vbdev_kv_shard_examine(&g_bases[0]->bdev);
+	g_bases[1] = ut_kv_base_create("base1");
+	vbdev_kv_shard_examine(&g_bases[1]->bdev);
+	CU_ASSERT(spdk_bdev_get_by_name("shard0") == NULL);
+	g_bases[2] = ut_kv_base_create("base2");
+	vbdev_kv_shard_examine(&g_bases[2]->bdev);
+	SPDK_CU_ASSERT_FATAL(spdk_bdev_get_by_name("shard0") != NULL);
+	shard = spdk_bdev_get_by_name("shard0")->ctxt;
+	CU_ASSERT(shard->num_bases == UT_NUM_BASES);
+	for (i = 0; i < UT_NUM_BASES; i++) {
+		CU_ASSERT(shard->bases[i].bdev == &g_bases[i]->bdev);
+		CU_ASSERT(g_bases[i]->open_count == 1);
+		CU_ASSERT(g_bases[i]->bdev.internal.claim.v1.module == &kv_shard_if);
+	}
+	CU_ASSERT(shard->bdev.blockcnt == UT_NUM_BASES * g_bases[0]->bdev.blockcnt);
+	CU_ASSERT(vbdev_kv_shard_io_type_supported(shard, SPDK_BDEV_IO_KV_BATCH) == true);
+	CU_ASSERT(vbdev_kv_shard_io_type_supported(shard, SPDK_BDEV_IO_TYPE_READ) == false);
+	g_bases[2]->kv_supported = false;
+	CU_ASSERT(vbdev_kv_shard_io_type_supported(shard, SPDK_BDEV_IO_KV_LIST) == false);
+	g_bases[2]->kv_supported = true;
+
+	/* Deleted shards are not created again when their base bdevs come back */
+	ut_shard_delete(shard);
+	CU_ASSERT(spdk_bdev_get_by_name("shard0") == NULL);
+	for (i = 0; i < UT_NUM_BASES; i++) {
+		CU_ASSERT(g_bases[i]->open_count == 0);
+		CU_ASSERT(g_bases[i]->bdev.internal.claim_type == SPDK_BDEV_CLAIM_NONE);
+		vbdev_kv_shard_examine(&g_bases[i]->bdev);
+	}
+	CU_ASSERT(spdk_bdev_get_by_name("shard0") == NULL);
+
+	/* All base bdevs need to support KV commands */
+	g_bases[1]->kv_supported = false;
+	rc = bdev_kv_shard_create(&opts);
+	CU_ASSERT(rc == -ENOTSUP);
+	CU_ASSERT(spdk_bdev_get_by_name("shard0") == NULL);
+	for (i = 0; i < UT_NUM_BASES; i++) {
+		CU_ASSERT(g_bases[i]->open_count == 0);
+	}
+	g_bases[1]->kv_supported = true;
+
+	ut_bases_destroy();
+}
+
+static void
+test_keys(void)
+{
+	const char *names[] = { "base2", "base0", "base1" };
+	struct vbdev_kv_shard *shard;
+	struct spdk_io_channel *ch;
+	uint32_t placed[UT_NUM_KEYS];
+	uint32_t i, j, cdw0, len;
+	char key[8], buf[16];
+	int sc;
+
+	ut_bases_create();
+	shard = ut_shard_create(g_base_names, VBDEV_KV_SHARD_HASH_JUMP);
+	ch = spdk_get_io_channel(shard);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+
+	/* Each key is stored on the one base bdev it hashes to, and keys spread over all */
+	for (i = 0; i < UT_NUM_KEYS; i++) {
+		ut_key(key, i);
+		sc = ut_submit(shard, ch, SPDK_BDEV_IO_KV_STORE, key, key, strlen(key), NULL);
+		CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+		for (j = 0; j < UT_NUM_BASES; j++) {
+			CU_ASSERT((ut_kv_base_get(g_bases[j], key, &len) != NULL) ==
+				  (j == ut_base_of(shard, key)));
+		}
+	}
+	for (j = 0; j < UT_NUM_BASES; j++) {
+		CU_ASSERT(g_bases[j]->num_values > 0);
+	}
+
+	for (i = 0; i < UT_NUM_KEYS; i++) {
+		ut_key(key, i);
+		memset(buf, 0, sizeof(buf));
+		sc = ut_submit(shard, ch, SPDK_BDEV_IO_KV_RETRIEVE, key, buf, sizeof(buf), &cdw0);
+		CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+		CU_ASSERT(cdw0 == strlen(key));
+		CU_ASSERT(strcmp(buf, key) == 0);
+		sc = ut_submit(shard, ch, SPDK_BDEV_IO_KV_EXIST, key, NULL, 0, NULL);
+		CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	}
+
+	ut_key(key, 0);
+	sc = ut_submit(shard, ch, SPDK_BDEV_IO_KV_DELETE, key, NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	sc = ut_submit(shard, ch, SPDK_BDEV_IO_KV_EXIST, key, NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+	sc = ut_submit(shard, ch, SPDK_BDEV_IO_KV_DELETE, key, NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+
+	spdk_put_io_channel(ch);
+	ut_shard_delete(shard);
+
+	/* On the hash ring, keys follow the names of the base bdevs, not their order */
+	shard = ut_shard_create(g_base_names, VBDEV_KV_SHARD_HASH_RING);
+	for (i = 0; i < UT_NUM_KEYS; i++) {
+		ut_key(key, i);
+		placed[i] = ut_base_of(shard, key);
+	}
+	ut_shard_delete(shard);
+	shard = ut_shard_create(names, VBDEV_KV_SHARD_HASH_RING);
+	for (i = 0; i < UT_NUM_KEYS; i++) {
+		ut_key(key, i);
+		CU_ASSERT(strcmp(names[ut_base_of(shard, key)], g_base_names[placed[i]]) == 0);
+	}
+	ut_shard_delete(shard);
+
+	ut_bases_destroy();
+}
+
+static void
+test_list(void)
+{
+	struct vbdev_kv_shard *shard;
+	struct spdk_io_channel *ch;
+	uint8_t buf[512];
+	uint32_t i, num, cdw0;
+	char key[8];
+	int sc;
+
+	ut_bases_create();
+	shard = ut_shard_create(g_base_names, VBDEV_KV_SHARD_HASH_JUMP);
+	ch = spdk_get_io_channel(shard);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+
+	for (i = 0; i < UT_NUM_KEYS; i++) {
+		ut_key(key, i);
+		ut_kv_base_put(g_bases[ut_base_of(shard, key)], key, strlen(key), key, strlen(key),
+			       false);
+	}
+
+	/* The lists of all base bdevs are merged in key order */
+	sc = ut_submit(shard, ch, SPDK_BDEV_IO_KV_LIST, "", buf, sizeof(buf), &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == UT_NUM_KEYS);
+	ut_check_list(buf, UT_NUM_KEYS, 0);
+	for (i = 0; i < UT_NUM_BASES; i++) {
+		CU_ASSERT(g_bases[i]->num_ios[SPDK_BDEV_IO_KV_LIST] == 1);
+	}
+
+	ut_key(key, 10);
+	sc = ut_submit(shard, ch, SPDK_BDEV_IO_KV_LIST, key, buf, sizeof(buf), &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == UT_NUM_KEYS - 10);
+	ut_check_list(buf, UT_NUM_KEYS - 10, 10);
+
+	/*
+	 * A buffer that is too small for all keys gets the first ones, with none
+	 * missing in between, whichever base bdev they are on.
+	 */
+	sc = ut_submit(shard, ch, SPDK_BDEV_IO_KV_LIST, "", buf, 64, &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	num = cdw0;
+	CU_ASSERT(num > 0 && num < UT_NUM_KEYS);
+	ut_check_list(buf, num, 0);
+
+	/* The buffer must at least hold the number of keys */
+	sc = ut_submit(shard, ch, SPDK_BDEV_IO_KV_LIST, "", buf, 2, NULL);
+	CU_ASSERT(sc == -1);
+
+	spdk_put_io_channel(ch);
+	ut_shard_delete(shard);
+	ut_bases_destroy();
+}
+
+static void
+test_batch(void)
+{
+	struct spdk_bdev_kv_batch_entry entries[UT_NUM_KEYS + 1] = {};
+	struct iovec iovs[UT_NUM_KEYS + 1];
+	char values[UT_NUM_KEYS + 1][16];
+	struct vbdev_kv_shard *shard;
+	struct spdk_io_channel *ch;
+	uint32_t i, j, len;
+	char key[8];
+	int sc;
+
+	ut_bases_create();
+	shard = ut_shard_create(g_base_names, VBDEV_KV_SHARD_HASH_JUMP);
+	ch = spdk_get_io_channel(shard);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+
+	for (i = 0; i < UT_NUM_KEYS; i++) {
+		ut_key(key, i);
+		memcpy(entries[i].key, key, strlen(key));
+		entries[i].key_length = strlen(key);
+		snprintf(values[i], sizeof(values[i]), "value%u", i);
+		iovs[i].iov_base = values[i];
+		iovs[i].iov_len = strlen(values[i]);
+		entries[i].iovs = &iovs[i];
+		entries[i].iovcnt = 1;
+		entries[i].nbytes = iovs[i].iov_len;
+	}
+
+	/* A batch is split into one batch per base bdev */
+	sc = ut_batch(shard, ch, SPDK_BDEV_IO_KV_STORE, entries, UT_NUM_KEYS);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	for (j = 0; j < UT_NUM_BASES; j++) {
+		CU_ASSERT(g_bases[j]->num_ios[SPDK_BDEV_IO_KV_BATCH] == 1);
+	}
+	for (i = 0; i < UT_NUM_KEYS; i++) {
+		ut_key(key, i);
+		CU_ASSERT(ut_kv_base_get(g_bases[ut_base_of(shard, key)], key, &len) != NULL);
+		CU_ASSERT(len == strlen(values[i]));
+		CU_ASSERT(entries[i].sc == SPDK_NVME_SC_SUCCESS);
+	}
+
+	/* The status of each key is reported at its place in the original batch */
+	memcpy(entries[UT_NUM_KEYS].key, "nokey", 5);
+	entries[UT_NUM_KEYS].key_length = 5;
+	iovs[UT_NUM_KEYS].iov_base = values[UT_NUM_KEYS];
+	iovs[UT_NUM_KEYS].iov_len = sizeof(values[UT_NUM_KEYS]);
+	entries[UT_NUM_KEYS].iovs = &iovs[UT_NUM_KEYS];
+	entries[UT_NUM_KEYS].iovcnt = 1;
+	entries[UT_NUM_KEYS].nbytes = sizeof(values[UT_NUM_KEYS]);
+	for (i = 0; i < UT_NUM_KEYS; i++) {
+		memset(values[i], 0, sizeof(values[i]));
+		iovs[i].iov_len = sizeof(values[i]);
+		entries[i].nbytes = sizeof(values[i]);
+	}
+	sc = ut_batch(shard, ch, SPDK_BDEV_IO_KV_RETRIEVE, entries, UT_NUM_KEYS + 1);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	for (i = 0; i < UT_NUM_KEYS; i++) {
+		snprintf(key, sizeof(key), "value%u", i);
+		CU_ASSERT(entries[i].sc == SPDK_NVME_SC_SUCCESS);
+		CU_ASSERT(entries[i].cdw0 == strlen(key));
+		CU_ASSERT(memcmp(values[i], key, strlen(key)) == 0);
+	}
+	CU_ASSERT(entries[UT_NUM_KEYS].sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+
+	sc = ut_batch(shard, ch, SPDK_BDEV_IO_KV_EXIST, &entries[UT_NUM_KEYS - 1], 2);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(entries[UT_NUM_KEYS - 1].sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(entries[UT_NUM_KEYS].sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+
+	/* An empty batch completes without going to the base bdevs */
+	sc = ut_batch(shard, ch, SPDK_BDEV_IO_KV_EXIST, entries, 0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(ut_kv_num_outstanding() == 0);
+
+	spdk_put_io_channel(ch);
+	ut_shard_delete(shard);
+	ut_bases_destroy();
+}
+
+static void
+test_select(void)
+{
+	struct vbdev_kv_shard *shard;
+	struct spdk_bdev_io *bdev_io;
+	struct spdk_io_channel *ch;
+	uint32_t i, base, id;
+	char key[8], buf[16];
+	int sc;
+
+	ut_bases_create();
+	shard = ut_shard_create(g_base_names, VBDEV_KV_SHARD_HASH_JUMP);
+	ch = spdk_get_io_channel(shard);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+
+	/* The select id carries the base bdev that ran the query */
+	for (i = 0; i < UT_NUM_KEYS; i++) {
+		ut_key(key, i);
+		base = ut_base_of(shard, key);
+		ut_kv_base_put(g_bases[base], key, strlen(key), key, strlen(key), false);
+		sc = ut_submit(shard, ch, SPDK_BDEV_IO_KV_SEND_SELECT, key, "SELECT *", 8, &id);
+		CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+		CU_ASSERT((id & ((1 << KV_SHARD_SELECT_ID_SHIFT) - 1)) == base);
+		CU_ASSERT(ut_kv_base_select_find(g_bases[base],
+						 id >> KV_SHARD_SELECT_ID_SHIFT) != NULL);
+
+		memset(buf, 0, sizeof(buf));
+		bdev_io = ut_kv_vbdev_io(&shard->bdev, sizeof(struct kv_shard_bdev_io),
+					 SPDK_BDEV_IO_KV_RETRIEVE_SELECT, NULL, buf, sizeof(buf));
+		bdev_io->u.bdev.nvme_kv.select_id = id;
+		sc = ut_kv_vbdev_submit(ch, bdev_io);
+		CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+		CU_ASSERT(bdev_io->internal.error.nvme.cdw0 == strlen(key));
+		CU_ASSERT(strcmp(buf, key) == 0);
+		free(bdev_io);
+		CU_ASSERT(ut_kv_base_select_find(g_bases[base],
+						 id >> KV_SHARD_SELECT_ID_SHIFT) == NULL);
+	}
+
+	/* Ids naming a base bdev the shard does not have are refused */
+	bdev_io = ut_kv_vbdev_io(&shard->bdev, sizeof(struct kv_shard_bdev_io),
+				 SPDK_BDEV_IO_KV_RETRIEVE_SELECT, NULL, buf, sizeof(buf));
+	bdev_io->u.bdev.nvme_kv.select_id = 1 << KV_SHARD_SELECT_ID_SHIFT | UT_NUM_BASES;
+	sc = ut_kv_vbdev_submit(ch, bdev_io);
+	CU_ASSERT(sc == SPDK_NVME_SC_INVALID_FIELD);
+	free(bdev_io);
+
+	/* So are base ids that leave no room for the base bdev */
+	ut_key(key, 0);
+	base = ut_base_of(shard, key);
+	g_bases[base]->next_select_id = 1U << (32 - KV_SHARD_SELECT_ID_SHIFT);
+	sc = ut_submit(shard, ch, SPDK_BDEV_IO_KV_SEND_SELECT, key, "SELECT *", 8, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+
+	spdk_put_io_channel(ch);
+	ut_shard_delete(shard);
+	ut_bases_destroy();
+}
+
+static void
+test_errors(void)
+{
+	struct spdk_bdev_kv_batch_entry entries[UT_NUM_KEYS] = {};
+	struct vbdev_kv_shard *shard;
+	struct spdk_bdev_io *bdev_io;
+	struct spdk_io_channel *ch;
+	uint32_t i, base;
+	char key[8], buf[64];
+	int sc;
+
+	ut_bases_create();
+	shard = ut_shard_create(g_base_names, VBDEV_KV_SHARD_HASH_JUMP);
+	ch = spdk_get_io_channel(shard);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+
+	for (i = 0; i < UT_NUM_KEYS; i++) {
+		ut_key(key, i);
+		ut_kv_base_put(g_bases[ut_base_of(shard, key)], key, strlen(key), key, strlen(key),
+			       false);
+		memcpy(entries[i].key, key, strlen(key));
+		entries[i].key_length = strlen(key);
+	}
+	ut_key(key, 0);
+	base = ut_base_of(shard, key);
+
+	/* Errors of a base bdev are passed through */
+	g_bases[base]->fail_sc = SPDK_NVME_SC_DATA_TRANSFER_ERROR;
+	sc = ut_submit(shard, ch, SPDK_BDEV_IO_KV_RETRIEVE, key, buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_DATA_TRANSFER_ERROR);
+
+	/* One failed part fails the whole of a LIST or BATCH */
+	sc = ut_submit(shard, ch, SPDK_BDEV_IO_KV_LIST, "", buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_DATA_TRANSFER_ERROR);
+	sc = ut_batch(shard, ch, SPDK_BDEV_IO_KV_EXIST, entries, UT_NUM_KEYS);
+	CU_ASSERT(sc == SPDK_NVME_SC_DATA_TRANSFER_ERROR);
+	g_bases[base]->fail_sc = 0;
+
+	g_bases[base]->submit_rc = -EIO;
+	sc = ut_submit(shard, ch, SPDK_BDEV_IO_KV_RETRIEVE, key, buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == -1);
+	sc = ut_batch(shard, ch, SPDK_BDEV_IO_KV_EXIST, entries, UT_NUM_KEYS);
+	CU_ASSERT(sc == SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+	CU_ASSERT(ut_kv_num_outstanding() == 0);
+	g_bases[base]->submit_rc = 0;
+
+	/* Out of resources on a base bdev, commands wait and are sent again */
+	g_bases[base]->submit_rc = -ENOMEM;
+	bdev_io = ut_kv_vbdev_io(&shard->bdev, sizeof(struct kv_shard_bdev_io),
+				 SPDK_BDEV_IO_KV_RETRIEVE, key, buf, sizeof(buf));
+	vbdev_kv_shard_submit_request(ch, bdev_io);
+	CU_ASSERT(bdev_io->internal.status == SPDK_BDEV_IO_STATUS_PENDING);
+	CU_ASSERT(!TAILQ_EMPTY(&g_ut_kv_io_wait));
+	g_bases[base]->submit_rc = 0;
+	ut_kv_poll();
+	CU_ASSERT(bdev_io->internal.status == SPDK_BDEV_IO_STATUS_SUCCESS);
+	free(bdev_io);
+
+	g_bases[base]->submit_rc = -ENOMEM;
+	memset(buf, 0, sizeof(buf));
+	bdev_io = ut_kv_vbdev_io(&shard->bdev, sizeof(struct kv_shard_bdev_io),
+				 SPDK_BDEV_IO_KV_LIST, "", buf, sizeof(buf));
+	vbdev_kv_shard_submit_request(ch, bdev_io);
+	CU_ASSERT(!TAILQ_EMPTY(&g_ut_kv_io_wait));
+	g_bases[base]->submit_rc = 0;
+	ut_kv_poll();
+	CU_ASSERT(bdev_io->internal.status == SPDK_BDEV_IO_STATUS_SUCCESS);
+	CU_ASSERT(g_bases[base]->num_ios[SPDK_BDEV_IO_KV_LIST] == 2);
+	ut_check_list((uint8_t *)buf, bdev_io->internal.error.nvme.cdw0, 0);
+	free(bdev_io);
+
+	/* Block I/O has no meaning on a shard */
+	sc = ut_submit(shard, ch, SPDK_BDEV_IO_TYPE_READ, NULL, buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == -1);
+
+	spdk_put_io_channel(ch);
+	ut_shard_delete(shard);
+	ut_bases_destroy();
+}
+
+static void
+test_hotremove(void)
+{
+	struct vbdev_kv_shard *shard;
+	uint32_t i;
+
+	ut_bases_create();
+	shard = ut_shard_create(g_base_names, VBDEV_KV_SHARD_HASH_RING);
+	CU_ASSERT(shard->ring != NULL);
+
+	/* Losing any base bdev takes the shard down and lets go of the others */
+	ut_kv_base_remove(g_bases[1]);
+	ut_kv_poll();
+	CU_ASSERT(spdk_bdev_get_by_name("shard0") == NULL);
+	for (i = 0; i < UT_NUM_BASES; i++) {
+		CU_ASSERT(g_bases[i]->open_count == 0);
+		CU_ASSERT(g_bases[i]->bdev.internal.claim_type == SPDK_BDEV_CLAIM_NONE);
+	}
+
+	/* It comes back once the base bdev does */
+	vbdev_kv_shard_examine(&g_bases[1]->bdev);
+	SPDK_CU_ASSERT_FATAL(spdk_bdev_get_by_name("shard0") != NULL);
+	shard = spdk_bdev_get_by_name("shard0")->ctxt;
+	CU_ASSERT(shard->hash == VBDEV_KV_SHARD_HASH_RING);
+
+	ut_kv_base_remove(g_bases[0]);
+	ut_kv_poll();
+	CU_ASSERT(spdk_bdev_get_by_name("shard0") == NULL);
+
+	vbdev_kv_shard_finish();
+	ut_bases_destroy();
+}
+
+int
+main(int argc, char **argv)
+{
+	CU_pSuite	suite = NULL;
+	unsigned int	num_failures;
+
+	CU_set_error_action(CUEA_ABORT);
+	CU_initialize_registry();
+
+	suite = CU_add_suite("kv_shard", NULL, NULL);
+
+	CU_ADD_TEST(suite, test_create_delete);
+	CU_ADD_TEST(suite, test_keys);
+	CU_ADD_TEST(suite, test_list);
+	CU_ADD_TEST(suite, test_batch);
+	CU_ADD_TEST(suite, test_select);
+	CU_ADD_TEST(suite, test_errors);
+	CU_ADD_TEST(suite, test_hotremove);
+
+	g_thread = spdk_thread_create("test", NULL);
+	spdk_set_thread(g_thread);
+
+	CU_basic_set_mode(CU_BRM_VERBOSE);
+	CU_basic_run_tests();
+	num_failures = CU_get_number_of_failures();
+
+	vbdev_kv_shard_finish();
+	spdk_thread_exit(g_thread);
+	while (!spdk_thread_is_exited(g_thread)) {
+		spdk_thread_poll(g_thread, 0, 0);
+	}
+	spdk_thread_destroy(g_thread);
+
+	CU_cleanup_registry();
+
+	return num_failures;
+}
@@ -0,0 +1,988 @@
+/*   SPDX-License-Identifier: BSD-3-Clause
+ *   Copyright (C) 2023 AirMettle, Inc. All rights reserved.
+ */
+
+#include "spdk/stdinc.h"
+#include "spdk_cunit.h"
+#include "spdk/env.h"
+#include "spdk_internal/mock.h"
+#include "thread/thread_internal.h"
+#include "common/lib/test_env.c"
+#include "kv_select/kv_select.c"
+#include "bdev/kv_zns/vbdev_kv_zns.c"
+#include "common/lib/test_bdev_kv.c"
+
+#define UT_BLOCK_SIZE	512
+#define UT_ZONE_SIZE	16
+#define UT_NUM_ZONES	8
+#define UT_NUM_BLOCKS	(UT_ZONE_SIZE * UT_NUM_ZONES)
+/* Small enough for checkpoints to take more than one append. */
+#define UT_MAX_APPEND	4
+#define UT_MAX_VALUE	(UT_MAX_APPEND * UT_BLOCK_SIZE - KV_ZNS_RECORD_HDR_SIZE)
+
+static struct spdk_thread *g_thread;
+static int g_delete_rc;
+static bool g_delete_done;
+static struct spdk_bdev *g_create_bdev;
+static int g_create_rc;
+static bool g_create_done;
+
+/*
+ * Zoned namespace behind the base bdev. It outlives the base bdevs, so a new
+ * one can be created on what an earlier one left.
+ */
+struct ut_zone {
+	uint64_t			wp;
+	enum spdk_bdev_zone_state	state;
+};
+
+static uint8_t g_ut_media[UT_NUM_BLOCKS * UT_BLOCK_SIZE];
+static struct ut_zone g_ut_zones[UT_NUM_ZONES];
+
+static void
+ut_zoned_format(void)
+{
+	uint32_t i;
+
+	memset(g_ut_media, 0, sizeof(g_ut_media));
+	for (i = 0; i < UT_NUM_ZONES; i++) {
+		g_ut_zones[i].wp = i * UT_ZONE_SIZE;
+		g_ut_zones[i].state = SPDK_BDEV_ZONE_STATE_EMPTY;
+	}
+}
+
+static struct ut_kv_base *
+ut_zoned_base_create(void)
+{
+	struct ut_kv_base *base = ut_kv_base_create("base0");
+
+	base->bdev.zoned = true;
+	base->bdev.blocklen = UT_BLOCK_SIZE;
+	base->bdev.blockcnt = UT_NUM_BLOCKS;
+	base->bdev.zone_size = UT_ZONE_SIZE;
+	base->bdev.max_zone_append_size = UT_MAX_APPEND;
+
+	return base;
+}
+
+static int
+ut_zoned_read(struct ut_kv_io *io)
+{
+	if (io->offset + io->nbytes > UT_NUM_BLOCKS) {
+		return SPDK_NVME_SC_LBA_OUT_OF_RANGE;
+	}
+
+	memcpy(io->iov.iov_base, &g_ut_media[io->offset * UT_BLOCK_SIZE],
+	       io->nbytes * UT_BLOCK_SIZE);
+	return SPDK_NVME_SC_SUCCESS;
+}
+
+static int
+ut_zoned_append(struct ut_kv_io *io)
+{
+	struct ut_zone *zone = &g_ut_zones[io->offset / UT_ZONE_SIZE];
+	uint64_t end = io->offset + UT_ZONE_SIZE;
+
+	CU_ASSERT(io->offset % UT_ZONE_SIZE == 0);
+	CU_ASSERT(io->nbytes <= UT_MAX_APPEND);
+	if (zone->state == SPDK_BDEV_ZONE_STATE_FULL || zone->wp + io->nbytes > end) {
+		return SPDK_NVME_SC_ZONE_IS_FULL;
+	}
+
+	memcpy(&g_ut_media[zone->wp * UT_BLOCK_SIZE], io->iov.iov_base, io->nbytes * UT_BLOCK_SIZE);
+	io->bdev_io.u.bdev.offset_blocks = zone->wp;
+	zone->wp += io->nbytes;
+	zone->state = zone->wp == end ? SPDK_BDEV_ZONE_STATE_FULL : SPDK_BDEV_ZONE_STATE_IMP_OPEN;
+	return SPDK_NVME_SC_SUCCESS;
+}
+
+static int
+ut_zoned_management(struct ut_kv_io *io)
+{
+	struct ut_zone *zone = &g_ut_zones[io->offset / UT_ZONE_SIZE];
+
+	switch (io->options) {
+	case SPDK_BDEV_ZONE_RESET:
+		memset(&g_ut_media[io->offset * UT_BLOCK_SIZE], 0, UT_ZONE_SIZE * UT_BLOCK_SIZE);
+		zone->wp = io->offset;
+		zone->state = SPDK_BDEV_ZONE_STATE_EMPTY;
+		return SPDK_NVME_SC_SUCCESS;
+	case SPDK_BDEV_ZONE_FINISH:
+		zone->wp = io->offset + UT_ZONE_SIZE;
+		zone->state = SPDK_BDEV_ZONE_STATE_FULL;
+		return SPDK_NVME_SC_SUCCESS;
+	default:
+		return SPDK_NVME_SC_INVALID_FIELD;
+	}
+}
+
+static int
+ut_zoned_info(struct ut_kv_io *io)
+{
+	struct spdk_bdev_zone_info *info = io->iov.iov_base;
+	uint64_t i, idx;
+
+	for (i = 0; i < io->nbytes; i++) {
+		idx = io->offset / UT_ZONE_SIZE + i;
+		info[i].zone_id = idx * UT_ZONE_SIZE;
+		info[i].write_pointer = g_ut_zones[idx].wp;
+		info[i].capacity = UT_ZONE_SIZE;
+		info[i].state = g_ut_zones[idx].state;
+		info[i].type = SPDK_BDEV_ZONE_TYPE_SEQWR;
+	}
+	return SPDK_NVME_SC_SUCCESS;
+}
+
+/* Queue a zoned command; offset and len are in blocks or zones, as the command takes them. */
+static int
+ut_zoned_submit(struct spdk_bdev_desc *desc, enum spdk_bdev_io_type type, void *buf,
+		uint64_t offset, uint64_t len, uint8_t options, int (*exec_fn)(struct ut_kv_io *io),
+		spdk_bdev_io_completion_cb cb, void *cb_arg)
+{
+	struct ut_kv_io *io = ut_kv_io_get(desc, type, NULL, 0, cb, cb_arg);
+
+	if (io == NULL) {
+		return ((struct ut_kv_base *)desc)->submit_rc;
+	}
+	io->iov.iov_base = buf;
+	io->offset = offset;
+	io->nbytes = len;
+	io->options = options;
+	io->exec_fn = exec_fn;
+
+	return 0;
+}
+
+int
+spdk_bdev_read_blocks(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch, void *buf,
+		      uint64_t offset_blocks, uint64_t num_blocks, spdk_bdev_io_completion_cb cb,
+		      void *cb_arg)
+{
+	return ut_zoned_submit(desc, SPDK_BDEV_IO_TYPE_READ, buf, offset_blocks, num_blocks, 0,
+			       ut_zoned_read, cb, cb_arg);
+}
+
+int
+spdk_bdev_zone_append(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch, void *buf,
+		      uint64_t zone_id, uint64_t num_blocks, spdk_bdev_io_completion_cb cb,
+		      void *cb_arg)
+{
+	return ut_zoned_submit(desc, SPDK_BDEV_IO_TYPE_ZONE_APPEND, buf, zone_id, num_blocks, 0,
+			       ut_zoned_append, cb, cb_arg);
+}
+
+int
+spdk_bdev_zone_management(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+			  uint64_t zone_id, enum spdk_bdev_zone_action action,
+			  spdk_bdev_io_completion_cb cb, void *cb_arg)
+{
+	return ut_zoned_submit(desc, SPDK_BDEV_IO_TYPE_ZONE_MANAGEMENT, NULL, zone_id, 0, action,
+			       ut_zoned_management, cb, cb_arg);
+}
+
+int
+spdk_bdev_get_zone_info(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+			uint64_t zone_id, size_t num_zones, struct spdk_bdev_zone_info *info,
+			spdk_bdev_io_completion_cb cb, void *cb_arg)
+{
+	return ut_zoned_submit(desc, SPDK_BDEV_IO_TYPE_GET_ZONE_INFO, info, zone_id, num_zones, 0,
+			       ut_zoned_info, cb, cb_arg);
+}
+
+uint64_t
+spdk_bdev_io_get_append_location(struct spdk_bdev_io *bdev_io)
+{
+	return bdev_io->u.bdev.offset_blocks;
+}
+
+/* All vbdev I/O in these tests is submitted on the engine thread. */
+struct spdk_thread *
+spdk_bdev_io_get_thread(struct spdk_bdev_io *bdev_io)
+{
+	return spdk_get_thread();
+}
+
+bool
+spdk_bdev_is_zoned(const struct spdk_bdev *bdev)
+{
+	return bdev->zoned;
+}
+
+uint32_t
+spdk_bdev_get_block_size(const struct spdk_bdev *bdev)
+{
+	return bdev->blocklen;
+}
+
+uint64_t
+spdk_bdev_get_zone_size(const struct spdk_bdev *bdev)
+{
+	return bdev->zone_size;
+}
+
+uint64_t
+spdk_bdev_get_num_zones(const struct spdk_bdev *bdev)
+{
+	return bdev->zone_size ? bdev->blockcnt / bdev->zone_size : 0;
+}
+
+uint32_t
+spdk_bdev_get_max_zone_append_size(const struct spdk_bdev *bdev)
+{
+	return bdev->max_zone_append_size;
+}
+
+static void
+ut_create_done(void *cb_arg, struct spdk_bdev *bdev, int bdeverrno)
+{
+	g_create_bdev = bdev;
+	g_create_rc = bdeverrno;
+	g_create_done = true;
+}
+
+static void
+ut_delete_done(void *cb_arg, int rc)
+{
+	g_delete_rc = rc;
+	g_delete_done = true;
+}
+
+/* Create the KV engine on base0 and load it. Returns the status create finished with. */
+static int
+ut_zns_create_rc(uint32_t checkpoint_ms, uint32_t gc_free_zones)
+{
+	struct vbdev_kv_zns_opts opts = {
+		.name = "zns0",
+		.base_bdev_name = "base0",
+		.checkpoint_ms = checkpoint_ms,
+		.gc_free_zones = gc_free_zones,
+	};
+	int rc;
+
+	g_create_done = false;
+	g_create_bdev = NULL;
+	rc = bdev_kv_zns_create(&opts, ut_create_done, NULL);
+	if (rc != 0) {
+		return rc;
+	}
+	ut_kv_poll();
+	CU_ASSERT(g_create_done == true);
+
+	return g_create_rc;
+}
+
+static struct vbdev_kv_zns *
+ut_zns_create(uint32_t checkpoint_ms, uint32_t gc_free_zones)
+{
+	int rc;
+
+	rc = ut_zns_create_rc(checkpoint_ms, gc_free_zones);
+	CU_ASSERT(rc == 0);
+	SPDK_CU_ASSERT_FATAL(g_create_bdev != NULL);
+	CU_ASSERT(spdk_bdev_get_by_name("zns0") == g_create_bdev);
+
+	return g_create_bdev->ctxt;
+}
+
+static void
+ut_zns_delete(struct vbdev_kv_zns *zns)
+{
+	g_delete_done = false;
+	bdev_kv_zns_delete(zns->bdev.name, ut_delete_done, NULL);
+	ut_kv_poll();
+	CU_ASSERT(g_delete_done == true);
+	CU_ASSERT(g_delete_rc == 0);
+}
+
+/*
+ * Submit a single-iov KV I/O to the vbdev and return its NVMe status code.
+ * select_id is only used by retrieve select.
+ */
+static int
+ut_submit_ext(struct vbdev_kv_zns *zns, struct spdk_io_channel *ch, enum spdk_bdev_io_type type,
+	      const char *key, void *buf, uint64_t len, uint64_t offset, uint8_t options,
+	      uint32_t select_id, uint32_t *cdw0)
+{
+	struct spdk_bdev_io *bdev_io;
+	int sc;
+
+	bdev_io = ut_kv_vbdev_io(&zns->bdev, sizeof(struct kv_zns_bdev_io), type, key, buf, len);
+	bdev_io->u.bdev.nvme_kv.offset = offset;
+	bdev_io->u.bdev.nvme_kv.options = options;
+	bdev_io->u.bdev.nvme_kv.select_id = select_id;
+	sc = ut_kv_vbdev_submit(ch, bdev_io);
+	if (cdw0 != NULL) {
+		*cdw0 = bdev_io->internal.error.nvme.cdw0;
+	}
+	free(bdev_io);
+
+	return sc;
+}
+
+static int
+ut_submit(struct vbdev_kv_zns *zns, struct spdk_io_channel *ch, enum spdk_bdev_io_type type,
+	  const char *key, void *buf, uint64_t len, uint32_t *cdw0)
+{
+	return ut_submit_ext(zns, ch, type, key, buf, len, 0, 0, 0, cdw0);
+}
+
+static int
+ut_store(struct vbdev_kv_zns *zns, struct spdk_io_channel *ch, const char *key,
+	 const char *value)
+{
+	return ut_submit(zns, ch, SPDK_BDEV_IO_KV_STORE, key, (void *)value, strlen(value), NULL);
+}
+
+/* Check the vbdev returns value for key. */
+static void
+ut_check_value(struct vbdev_kv_zns *zns, struct spdk_io_channel *ch, const char *key,
+	       const char *value)
+{
+	char buf[UT_MAX_VALUE + 1];
+	uint32_t cdw0;
+	int sc;
+
+	memset(buf, 0, sizeof(buf));
+	sc = ut_submit(zns, ch, SPDK_BDEV_IO_KV_RETRIEVE, key, buf, sizeof(buf) - 1, &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == strlen(value));
+	CU_ASSERT(strcmp(buf, value) == 0);
+}
+
+static void
+test_create_delete(void)
+{
+	struct vbdev_kv_zns_opts opts = {
+		.name = "zns0",
+		.base_bdev_name = "base0",
+		.gc_free_zones = 1,
+	};
+	struct vbdev_kv_zns_stats stats;
+	struct vbdev_kv_zns *zns;
+	struct ut_kv_base *base;
+	int rc;
+
+	ut_zoned_format();
+	opts.name = NULL;
+	rc = bdev_kv_zns_create(&opts, ut_create_done, NULL);
+	CU_ASSERT(rc == -EINVAL);
+	opts.name = "zns0";
+	opts.gc_free_zones = 0;
+	rc = bdev_kv_zns_create(&opts, ut_create_done, NULL);
+	CU_ASSERT(rc == -EINVAL);
+	opts.gc_free_zones = 1;
+
+	/* The base bdev has to exist and be zoned */
+	rc = bdev_kv_zns_create(&opts, ut_create_done, NULL);
+	CU_ASSERT(rc == -ENODEV);
+	base = ut_kv_base_create("base0");
+	rc = bdev_kv_zns_create(&opts, ut_create_done, NULL);
+	CU_ASSERT(rc == -ENOTSUP);
+	CU_ASSERT(base->open_count == 0);
+	ut_kv_base_destroy(base);
+	base = ut_zoned_base_create();
+	base->kv_supported = false;
+	rc = bdev_kv_zns_create(&opts, ut_create_done, NULL);
+	CU_ASSERT(rc == -ENOTSUP);
+	CU_ASSERT(base->open_count == 0);
+	base->kv_supported = true;
+
+	/* An empty zoned bdev is formatted */
+	zns = ut_zns_create(0, 2);
+	CU_ASSERT(base->open_count == 1);
+	CU_ASSERT(base->bdev.internal.claim.v1.module == &kv_zns_if);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_TYPE_GET_ZONE_INFO] == 1);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_TYPE_READ] == 0);
+	CU_ASSERT(zns->num_zones == UT_NUM_ZONES);
+	CU_ASSERT(zns->max_record_blocks == UT_MAX_APPEND);
+	CU_ASSERT(zns->zones[0].state == KV_ZNS_ZONE_RESERVED);
+	CU_ASSERT(zns->zones[1].state == KV_ZNS_ZONE_RESERVED);
+	CU_ASSERT(bdev_kv_zns_get_stats("zns0", &stats) == 0);
+	CU_ASSERT(stats.keys == 0);
+	CU_ASSERT(stats.free_zones == UT_NUM_ZONES - KV_ZNS_NUM_CKPT_ZONES);
+	CU_ASSERT(vbdev_kv_zns_io_type_supported(zns, SPDK_BDEV_IO_KV_STORE) == true);
+	CU_ASSERT(vbdev_kv_zns_io_type_supported(zns, SPDK_BDEV_IO_KV_RETRIEVE_SELECT) == true);
+	CU_ASSERT(vbdev_kv_zns_io_type_supported(zns, SPDK_BDEV_IO_KV_BATCH) == false);
+	CU_ASSERT(vbdev_kv_zns_io_type_supported(zns, SPDK_BDEV_IO_TYPE_READ) == false);
+
+	/* Nothing was written, so no checkpoint either */
+	ut_zns_delete(zns);
+	CU_ASSERT(spdk_bdev_get_by_name("zns0") == NULL);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_TYPE_ZONE_APPEND] == 0);
+	CU_ASSERT(base->open_count == 0);
+	CU_ASSERT(base->bdev.internal.claim_type == SPDK_BDEV_CLAIM_NONE);
+	CU_ASSERT(bdev_kv_zns_get_stats("zns0", &stats) == -ENODEV);
+
+	g_delete_done = false;
+	bdev_kv_zns_delete("zns0", ut_delete_done, NULL);
+	CU_ASSERT(g_delete_done == true);
+	CU_ASSERT(g_delete_rc == -ENODEV);
+
+	/* Failing to load fails the create */
+	base->fail_sc = SPDK_NVME_SC_INTERNAL_DEVICE_ERROR;
+	rc = ut_zns_create_rc(0, 2);
+	CU_ASSERT(rc == -EIO);
+	CU_ASSERT(g_create_bdev == NULL);
+	CU_ASSERT(spdk_bdev_get_by_name("zns0") == NULL);
+	CU_ASSERT(base->open_count == 0);
+	CU_ASSERT(base->bdev.internal.claim_type == SPDK_BDEV_CLAIM_NONE);
+	base->fail_sc = 0;
+	ut_kv_base_destroy(base);
+}
+
+static void
+test_store_retrieve(void)
+{
+	struct ut_kv_base *base = ut_zoned_base_create();
+	struct spdk_bdev_io *ios[2];
+	struct vbdev_kv_zns_stats stats;
+	struct vbdev_kv_zns *zns;
+	struct spdk_io_channel *ch;
+	char buf[64], big[1001];
+	uint32_t cdw0, i;
+	int sc;
+
+	ut_zoned_format();
+	zns = ut_zns_create(0, 2);
+	ch = spdk_get_io_channel(&g_kv_zns_nodes);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+
+	/* Every STORE appends a record to the open zone */
+	sc = ut_store(zns, ch, "key0", "hello");
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_TYPE_ZONE_APPEND] == 1);
+	CU_ASSERT(g_ut_zones[KV_ZNS_NUM_CKPT_ZONES].wp == KV_ZNS_NUM_CKPT_ZONES * UT_ZONE_SIZE + 1);
+	ut_check_value(zns, ch, "key0", "hello");
+	sc = ut_submit(zns, ch, SPDK_BDEV_IO_KV_EXIST, "key0", NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+
+	/* Overwrites and appends */
+	sc = ut_store(zns, ch, "key0", "hi");
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	ut_check_value(zns, ch, "key0", "hi");
+	sc = ut_submit_ext(zns, ch, SPDK_BDEV_IO_KV_STORE, "key0", " there", 6, 0,
+			   NVME_KV_STORE_CMD_OPTION_APPEND, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	ut_check_value(zns, ch, "key0", "hi there");
+	sc = ut_submit_ext(zns, ch, SPDK_BDEV_IO_KV_STORE, "key1", "new", 3, 0,
+			   NVME_KV_STORE_CMD_OPTION_APPEND, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	ut_check_value(zns, ch, "key1", "new");
+
+	/* Only the blocks holding the requested part of a value are read */
+	for (i = 0; i < sizeof(big) - 1; i++) {
+		big[i] = 'a' + i % 26;
+	}
+	big[sizeof(big) - 1] = '\0';
+	sc = ut_store(zns, ch, "big", big);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	memset(buf, 0, sizeof(buf));
+	base->num_ios[SPDK_BDEV_IO_TYPE_READ] = 0;
+	sc = ut_submit_ext(zns, ch, SPDK_BDEV_IO_KV_RETRIEVE, "big", buf, 10, 600, 0, 0, &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == sizeof(big) - 1);
+	CU_ASSERT(memcmp(buf, &big[600], 10) == 0);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_TYPE_READ] == 1);
+	ut_check_value(zns, ch, "big", big);
+
+	/* STOREs of a key are run one at a time, in order */
+	ios[0] = ut_kv_vbdev_io(&zns->bdev, sizeof(struct kv_zns_bdev_io), SPDK_BDEV_IO_KV_STORE,
+				"key2", "first", 5);
+	ios[1] = ut_kv_vbdev_io(&zns->bdev, sizeof(struct kv_zns_bdev_io), SPDK_BDEV_IO_KV_STORE,
+				"key2", "second", 6);
+	vbdev_kv_zns_submit_request(ch, ios[0]);
+	vbdev_kv_zns_submit_request(ch, ios[1]);
+	CU_ASSERT(ut_kv_num_outstanding() == 1);
+	ut_kv_poll();
+	for (i = 0; i < 2; i++) {
+		CU_ASSERT(ios[i]->internal.status == SPDK_BDEV_IO_STATUS_SUCCESS);
+		free(ios[i]);
+	}
+	ut_check_value(zns, ch, "key2", "second");
+
+	/* Deletes */
+	sc = ut_submit(zns, ch, SPDK_BDEV_IO_KV_DELETE, "key1", NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	sc = ut_submit(zns, ch, SPDK_BDEV_IO_KV_EXIST, "key1", NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+	sc = ut_submit(zns, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key1", buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+
+	CU_ASSERT(bdev_kv_zns_get_stats("zns0", &stats) == 0);
+	CU_ASSERT(stats.keys == 3);
+	CU_ASSERT(stats.stores == 7);
+	CU_ASSERT(stats.deletes == 1);
+	CU_ASSERT(stats.bytes_written == base->num_ios[SPDK_BDEV_IO_TYPE_ZONE_APPEND] *
+		  UT_BLOCK_SIZE + 2 * UT_BLOCK_SIZE);
+
+	spdk_put_io_channel(ch);
+	ut_zns_delete(zns);
+	ut_kv_base_destroy(base);
+}
+
+static void
+test_list_select(void)
+{
+	struct ut_kv_base *base = ut_zoned_base_create();
+	char value[] = "name,qty\napple,3\npear,7\nplum,12\n";
+	char query[] = "SELECT name FROM s3object WHERE qty > 5";
+	uint8_t options = NVME_KV_SELECT_CMD_OUTPUT_TYPE_USE_CSV_HEADERS_INPUT;
+	struct vbdev_kv_zns_stats stats;
+	struct vbdev_kv_zns *zns;
+	struct spdk_io_channel *ch;
+	uint32_t cdw0, id, num;
+	uint16_t key_len;
+	uint8_t buf[64];
+	int sc;
+
+	ut_zoned_format();
+	zns = ut_zns_create(0, 2);
+	ch = spdk_get_io_channel(&g_kv_zns_nodes);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+
+	CU_ASSERT(ut_store(zns, ch, "b1", "x") == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(ut_store(zns, ch, "a2", "x") == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(ut_store(zns, ch, "a1", "x") == SPDK_NVME_SC_SUCCESS);
+
+	/* Keys with the prefix, in order */
+	memset(buf, 0xff, sizeof(buf));
+	sc = ut_submit(zns, ch, SPDK_BDEV_IO_KV_LIST, "a", buf, sizeof(buf), &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == 2);
+	memcpy(&num, buf, sizeof(num));
+	CU_ASSERT(num == 2);
+	memcpy(&key_len, &buf[4], sizeof(key_len));
+	CU_ASSERT(key_len == 2);
+	CU_ASSERT(memcmp(&buf[6], "a1", 2) == 0);
+	CU_ASSERT(memcmp(&buf[12], "a2", 2) == 0);
+
+	/* As many as fit */
+	sc = ut_submit(zns, ch, SPDK_BDEV_IO_KV_LIST, "", buf, 16, &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == 2);
+
+	/* SELECT runs on the host */
+	CU_ASSERT(ut_store(zns, ch, "fruit", value) == SPDK_NVME_SC_SUCCESS);
+	sc = ut_submit_ext(zns, ch, SPDK_BDEV_IO_KV_SEND_SELECT, "fruit", query, strlen(query), 0,
+			   options, 0, &id);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	memset(buf, 0, sizeof(buf));
+	sc = ut_submit_ext(zns, ch, SPDK_BDEV_IO_KV_RETRIEVE_SELECT, NULL, buf, sizeof(buf), 0, 0,
+			   id, &cdw0);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(cdw0 == strlen("pear\nplum\n"));
+	CU_ASSERT(strcmp((char *)buf, "pear\nplum\n") == 0);
+	sc = ut_submit_ext(zns, ch, SPDK_BDEV_IO_KV_RETRIEVE_SELECT, NULL, buf, sizeof(buf), 0, 0,
+			   id, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_INVALID_FIELD);
+	sc = ut_submit(zns, ch, SPDK_BDEV_IO_KV_SEND_SELECT, "fruit", "SELECT", 6, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_INVALID_FIELD);
+	sc = ut_submit(zns, ch, SPDK_BDEV_IO_KV_SEND_SELECT, "nokey", query, strlen(query), NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+	CU_ASSERT(bdev_kv_zns_get_stats("zns0", &stats) == 0);
+	CU_ASSERT(stats.host_selects == 2);
+
+	spdk_put_io_channel(ch);
+	ut_zns_delete(zns);
+	ut_kv_base_destroy(base);
+}
+
+static void
+test_checkpoint(void)
+{
+	struct ut_kv_base *base = ut_zoned_base_create();
+	struct vbdev_kv_zns_stats stats;
+	struct vbdev_kv_zns *zns;
+	struct spdk_io_channel *ch;
+	char key[16];
+	uint64_t lba;
+	uint32_t i;
+
+	ut_zoned_format();
+	/* Keep GC, and the checkpoints it takes, out of the way */
+	zns = ut_zns_create(1, 1);
+	ch = spdk_get_io_channel(&g_kv_zns_nodes);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+
+	/* The poller checkpoints the index once anything changed */
+	for (i = 0; i < 60; i++) {
+		snprintf(key, sizeof(key), "key%u", i);
+		CU_ASSERT(ut_store(zns, ch, key, key) == SPDK_NVME_SC_SUCCESS);
+	}
+	CU_ASSERT(g_ut_zones[0].state == SPDK_BDEV_ZONE_STATE_EMPTY);
+	spdk_delay_us(1000);
+	ut_kv_poll();
+	CU_ASSERT(bdev_kv_zns_get_stats("zns0", &stats) == 0);
+	CU_ASSERT(stats.checkpoints == 1);
+	CU_ASSERT(zns->dirty == 0);
+	/* 60 keys take more than one append */
+	CU_ASSERT(zns->zones[0].alloc > UT_MAX_APPEND);
+	CU_ASSERT(g_ut_zones[0].state == SPDK_BDEV_ZONE_STATE_FULL);
+	spdk_delay_us(1000);
+	ut_kv_poll();
+	CU_ASSERT(bdev_kv_zns_get_stats("zns0", &stats) == 0);
+	CU_ASSERT(stats.checkpoints == 1);
+
+	/* Checkpoints go to the two checkpoint zones in turn */
+	CU_ASSERT(ut_store(zns, ch, "key0", "changed") == SPDK_NVME_SC_SUCCESS);
+	spdk_delay_us(1000);
+	ut_kv_poll();
+	CU_ASSERT(bdev_kv_zns_get_stats("zns0", &stats) == 0);
+	CU_ASSERT(stats.checkpoints == 2);
+	CU_ASSERT(g_ut_zones[1].state == SPDK_BDEV_ZONE_STATE_FULL);
+	CU_ASSERT(ut_store(zns, ch, "key1", "changed") == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(ut_submit(zns, ch, SPDK_BDEV_IO_KV_DELETE, "key2", NULL, 0, NULL) ==
+		  SPDK_NVME_SC_SUCCESS);
+	spdk_put_io_channel(ch);
+
+	/* The bdev is loaded from the newest checkpoint, and what was written since */
+	base->fail_sc = SPDK_NVME_SC_INTERNAL_DEVICE_ERROR;
+	ut_kv_base_remove(base);
+	ut_kv_poll();
+	base->fail_sc = 0;
+	CU_ASSERT(base->open_count == 0);
+	ut_kv_base_destroy(base);
+	base = ut_zoned_base_create();
+	zns = ut_zns_create(0, 1);
+	ch = spdk_get_io_channel(&g_kv_zns_nodes);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+	CU_ASSERT(zns->ckpt_seq == 2);
+	CU_ASSERT(zns->ckpt_zone == 1);
+	CU_ASSERT(zns->dirty == 2);
+	CU_ASSERT(zns->count == 59);
+	ut_check_value(zns, ch, "key0", "changed");
+	ut_check_value(zns, ch, "key1", "changed");
+	ut_check_value(zns, ch, "key59", "key59");
+	CU_ASSERT(ut_submit(zns, ch, SPDK_BDEV_IO_KV_EXIST, "key2", NULL, 0, NULL) ==
+		  SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+
+	/* Deleting the bdev writes a last checkpoint */
+	spdk_put_io_channel(ch);
+	ut_zns_delete(zns);
+	ut_kv_base_destroy(base);
+	base = ut_zoned_base_create();
+	zns = ut_zns_create(0, 1);
+	ch = spdk_get_io_channel(&g_kv_zns_nodes);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+	CU_ASSERT(zns->ckpt_seq == 3);
+	CU_ASSERT(zns->ckpt_zone == 0);
+	CU_ASSERT(zns->dirty == 0);
+	CU_ASSERT(zns->count == 59);
+	spdk_put_io_channel(ch);
+	ut_zns_delete(zns);
+	ut_kv_base_destroy(base);
+
+	/* A corrupted checkpoint is passed over for the older one */
+	lba = 1 * UT_ZONE_SIZE + 1;
+	g_ut_media[lba * UT_BLOCK_SIZE] ^= 0xff;
+	g_ut_zones[0].state = SPDK_BDEV_ZONE_STATE_FULL;
+	base = ut_zoned_base_create();
+	zns = ut_zns_create(0, 1);
+	ch = spdk_get_io_channel(&g_kv_zns_nodes);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+	CU_ASSERT(zns->ckpt_seq == 3);
+	CU_ASSERT(zns->count == 59);
+	ut_check_value(zns, ch, "key1", "changed");
+	spdk_put_io_channel(ch);
+	ut_zns_delete(zns);
+	ut_kv_base_destroy(base);
+}
+
+static void
+test_replay(void)
+{
+	struct ut_kv_base *base = ut_zoned_base_create();
+	struct vbdev_kv_zns *zns;
+	struct spdk_io_channel *ch;
+	struct kv_zns_slot *slot;
+	uint64_t lba;
+
+	ut_zoned_format();
+	zns = ut_zns_create(0, 2);
+	ch = spdk_get_io_channel(&g_kv_zns_nodes);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+
+	CU_ASSERT(ut_store(zns, ch, "a", "1") == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(ut_store(zns, ch, "b", "2") == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(ut_submit(zns, ch, SPDK_BDEV_IO_KV_DELETE, "a", NULL, 0, NULL) ==
+		  SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(ut_store(zns, ch, "b", "3") == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(ut_store(zns, ch, "c", "4") == SPDK_NVME_SC_SUCCESS);
+	slot = kv_zns_find(zns, (const uint8_t *)"c", 1);
+	SPDK_CU_ASSERT_FATAL(slot != NULL);
+	lba = slot->lba;
+	spdk_put_io_channel(ch);
+
+	/* Without a checkpoint, every record is replayed; the latest of a key wins */
+	base->fail_sc = SPDK_NVME_SC_INTERNAL_DEVICE_ERROR;
+	ut_kv_base_remove(base);
+	ut_kv_poll();
+	base->fail_sc = 0;
+	ut_kv_base_destroy(base);
+	CU_ASSERT(g_ut_zones[0].state == SPDK_BDEV_ZONE_STATE_EMPTY);
+
+	/* Records that do not check out are skipped */
+	g_ut_media[lba * UT_BLOCK_SIZE + KV_ZNS_RECORD_HDR_SIZE] ^= 0xff;
+	base = ut_zoned_base_create();
+	zns = ut_zns_create(0, 2);
+	ch = spdk_get_io_channel(&g_kv_zns_nodes);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+	CU_ASSERT(zns->count == 1);
+	CU_ASSERT(zns->dirty == 4);
+	ut_check_value(zns, ch, "b", "3");
+	CU_ASSERT(ut_submit(zns, ch, SPDK_BDEV_IO_KV_EXIST, "a", NULL, 0, NULL) ==
+		  SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+	CU_ASSERT(ut_submit(zns, ch, SPDK_BDEV_IO_KV_EXIST, "c", NULL, 0, NULL) ==
+		  SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+	/* Sequence numbers go on from the last good record */
+	CU_ASSERT(zns->next_seq == 5);
+
+	/* New records go past the replayed ones */
+	CU_ASSERT(ut_store(zns, ch, "d", "5") == SPDK_NVME_SC_SUCCESS);
+	slot = kv_zns_find(zns, (const uint8_t *)"d", 1);
+	SPDK_CU_ASSERT_FATAL(slot != NULL);
+	CU_ASSERT(slot->lba != lba);
+	spdk_put_io_channel(ch);
+	ut_zns_delete(zns);
+	ut_kv_base_destroy(base);
+}
+
+static void
+test_gc(void)
+{
+	struct ut_kv_base *base = ut_zoned_base_create();
+	struct vbdev_kv_zns_stats stats;
+	struct vbdev_kv_zns *zns;
+	struct spdk_io_channel *ch;
+	char key[16], value[32];
+	uint32_t i;
+	int sc;
+
+	ut_zoned_format();
+	zns = ut_zns_create(0, 2);
+	ch = spdk_get_io_channel(&g_kv_zns_nodes);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+
+	/* Overwriting a few keys fills the zones; GC copies what is live and resets them */
+	CU_ASSERT(ut_store(zns, ch, "live", "still here") == SPDK_NVME_SC_SUCCESS);
+	for (i = 0; i < 200; i++) {
+		snprintf(key, sizeof(key), "key%u", i % 4);
+		snprintf(value, sizeof(value), "value%u", i);
+		sc = ut_store(zns, ch, key, value);
+		CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	}
+	CU_ASSERT(bdev_kv_zns_get_stats("zns0", &stats) == 0);
+	CU_ASSERT(stats.gc_zones > 0);
+	CU_ASSERT(stats.gc_bytes >= UT_BLOCK_SIZE);
+	CU_ASSERT(stats.checkpoints > 0);
+	CU_ASSERT(zns->gc == NULL);
+	ut_check_value(zns, ch, "live", "still here");
+	for (i = 196; i < 200; i++) {
+		snprintf(key, sizeof(key), "key%u", i % 4);
+		snprintf(value, sizeof(value), "value%u", i);
+		ut_check_value(zns, ch, key, value);
+	}
+
+	/* Relocated records are found after a reload */
+	spdk_put_io_channel(ch);
+	ut_zns_delete(zns);
+	ut_kv_base_destroy(base);
+	base = ut_zoned_base_create();
+	zns = ut_zns_create(0, 2);
+	ch = spdk_get_io_channel(&g_kv_zns_nodes);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+	CU_ASSERT(zns->count == 5);
+	ut_check_value(zns, ch, "live", "still here");
+	ut_check_value(zns, ch, "key3", "value199");
+
+	/* Once everything is live and no zone can be freed, writes fail */
+	for (i = 0; i < UT_NUM_BLOCKS; i++) {
+		snprintf(key, sizeof(key), "fill%u", i);
+		sc = ut_store(zns, ch, key, key);
+		if (sc != SPDK_NVME_SC_SUCCESS) {
+			break;
+		}
+	}
+	CU_ASSERT(sc == SPDK_NVME_SC_CAPACITY_EXCEEDED);
+	CU_ASSERT(i < UT_NUM_BLOCKS);
+	CU_ASSERT(TAILQ_EMPTY(&zns->wait_space));
+	/* Deletes need room for their record too */
+	sc = ut_submit(zns, ch, SPDK_BDEV_IO_KV_DELETE, "fill0", NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_CAPACITY_EXCEEDED);
+	ut_check_value(zns, ch, "fill0", "fill0");
+
+	spdk_put_io_channel(ch);
+	ut_zns_delete(zns);
+	ut_kv_base_destroy(base);
+}
+
+static void
+test_errors(void)
+{
+	struct ut_kv_base *base = ut_zoned_base_create();
+	struct spdk_bdev_io *bdev_io;
+	struct vbdev_kv_zns *zns;
+	struct spdk_io_channel *ch;
+	char buf[UT_MAX_VALUE + 2];
+	uint32_t zone;
+	int sc;
+
+	ut_zoned_format();
+	zns = ut_zns_create(0, 2);
+	ch = spdk_get_io_channel(&g_kv_zns_nodes);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+
+	/* Invalid commands */
+	sc = ut_store(zns, ch, "", "value");
+	CU_ASSERT(sc == SPDK_NVME_SC_INVALID_KEY_SIZE);
+	memset(buf, 'v', sizeof(buf));
+	sc = ut_submit(zns, ch, SPDK_BDEV_IO_KV_STORE, "key", buf, UT_MAX_VALUE + 1, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_INVALID_VALUE_SIZE);
+	sc = ut_submit(zns, ch, SPDK_BDEV_IO_KV_STORE, "key", buf, UT_MAX_VALUE, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_SUCCESS);
+	sc = ut_submit_ext(zns, ch, SPDK_BDEV_IO_KV_STORE, "key", buf, 1, 0,
+			   NVME_KV_STORE_CMD_OPTION_APPEND, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_INVALID_VALUE_SIZE);
+	sc = ut_submit_ext(zns, ch, SPDK_BDEV_IO_KV_STORE, "key", buf, 1, 0,
+			   NVME_KV_STORE_CMD_OPTION_MUST_NOT_EXIST, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_KEY_EXISTS);
+	sc = ut_submit_ext(zns, ch, SPDK_BDEV_IO_KV_STORE, "nokey", buf, 1, 0,
+			   NVME_KV_STORE_CMD_OPTION_MUST_EXIST, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+	sc = ut_submit(zns, ch, SPDK_BDEV_IO_KV_DELETE, "nokey", NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_KV_KEY_DOES_NOT_EXIST);
+	sc = ut_submit_ext(zns, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key", buf, 1, UT_MAX_VALUE + 1, 0, 0,
+			   NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_INVALID_FIELD);
+	sc = ut_submit(zns, ch, SPDK_BDEV_IO_KV_BATCH, NULL, NULL, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_INVALID_OPCODE);
+
+	/* Failed appends fail the STORE and leave the zone */
+	CU_ASSERT(ut_store(zns, ch, "key", "old") == SPDK_NVME_SC_SUCCESS);
+	zone = zns->user_zone;
+	base->fail_sc = SPDK_NVME_SC_ZONE_IS_FULL;
+	sc = ut_store(zns, ch, "key", "new");
+	CU_ASSERT(sc == SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+	base->fail_sc = 0;
+	CU_ASSERT(zns->user_zone == KV_ZNS_NO_ZONE);
+	ut_check_value(zns, ch, "key", "old");
+	CU_ASSERT(ut_store(zns, ch, "key", "new") == SPDK_NVME_SC_SUCCESS);
+	CU_ASSERT(zns->user_zone != zone);
+	ut_check_value(zns, ch, "key", "new");
+	base->submit_rc = -EIO;
+	sc = ut_store(zns, ch, "key", "newer");
+	CU_ASSERT(sc == SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+	base->submit_rc = 0;
+	ut_check_value(zns, ch, "key", "new");
+
+	/* Failed reads */
+	base->fail_sc = SPDK_NVME_SC_INTERNAL_DEVICE_ERROR;
+	sc = ut_submit(zns, ch, SPDK_BDEV_IO_KV_RETRIEVE, "key", buf, sizeof(buf), NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+	sc = ut_submit_ext(zns, ch, SPDK_BDEV_IO_KV_STORE, "key", "!", 1, 0,
+			   NVME_KV_STORE_CMD_OPTION_APPEND, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+	base->fail_sc = 0;
+	ut_check_value(zns, ch, "key", "new");
+
+	/* A record that is not the one the index points to fails an APPEND */
+	memset(&g_ut_media[kv_zns_find(zns, (const uint8_t *)"key", 3)->lba * UT_BLOCK_SIZE], 0,
+	       UT_BLOCK_SIZE);
+	sc = ut_submit_ext(zns, ch, SPDK_BDEV_IO_KV_STORE, "key", "!", 1, 0,
+			   NVME_KV_STORE_CMD_OPTION_APPEND, 0, NULL);
+	CU_ASSERT(sc == SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+
+	/* Submissions wait for a bdev_io when the base bdev has none */
+	base->submit_rc = -ENOMEM;
+	bdev_io = ut_kv_vbdev_io(&zns->bdev, sizeof(struct kv_zns_bdev_io), SPDK_BDEV_IO_KV_STORE,
+				 "key", "again", 5);
+	vbdev_kv_zns_submit_request(ch, bdev_io);
+	CU_ASSERT(!TAILQ_EMPTY(&g_ut_kv_io_wait));
+	base->submit_rc = 0;
+	ut_kv_poll();
+	CU_ASSERT(bdev_io->internal.status == SPDK_BDEV_IO_STATUS_SUCCESS);
+	free(bdev_io);
+	ut_check_value(zns, ch, "key", "again");
+
+	spdk_put_io_channel(ch);
+	ut_zns_delete(zns);
+	ut_kv_base_destroy(base);
+}
+
+static void
+test_hotremove(void)
+{
+	struct ut_kv_base *base = ut_zoned_base_create();
+	uint32_t unregistered = g_ut_kv_unregistered;
+	struct vbdev_kv_zns *zns;
+	struct spdk_io_channel *ch;
+	uint32_t appends;
+
+	ut_zoned_format();
+	zns = ut_zns_create(0, 2);
+	ch = spdk_get_io_channel(&g_kv_zns_nodes);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+	CU_ASSERT(ut_store(zns, ch, "key", "value") == SPDK_NVME_SC_SUCCESS);
+	spdk_put_io_channel(ch);
+
+	/* No checkpoint is written to a removed bdev */
+	appends = base->num_ios[SPDK_BDEV_IO_TYPE_ZONE_APPEND];
+	ut_kv_base_remove(base);
+	ut_kv_poll();
+	CU_ASSERT(spdk_bdev_get_by_name("zns0") == NULL);
+	CU_ASSERT(g_ut_kv_unregistered == unregistered + 1);
+	CU_ASSERT(base->num_ios[SPDK_BDEV_IO_TYPE_ZONE_APPEND] == appends);
+	CU_ASSERT(base->open_count == 0);
+	CU_ASSERT(base->bdev.internal.claim_type == SPDK_BDEV_CLAIM_NONE);
+	ut_kv_base_destroy(base);
+
+	/* The keys come back with the bdev */
+	base = ut_zoned_base_create();
+	zns = ut_zns_create(0, 2);
+	ch = spdk_get_io_channel(&g_kv_zns_nodes);
+	SPDK_CU_ASSERT_FATAL(ch != NULL);
+	ut_check_value(zns, ch, "key", "value");
+	spdk_put_io_channel(ch);
+	ut_zns_delete(zns);
+	ut_kv_base_destroy(base);
+}
+
+int
+main(int argc, char **argv)
+{
+	CU_pSuite	suite = NULL;
+	unsigned int	num_failures;
+
+	CU_set_error_action(CUEA_ABORT);
+	CU_initialize_registry();
+
+	suite = CU_add_suite("kv_zns", NULL, NULL);
+
+	CU_ADD_TEST(suite, test_create_delete);
+	CU_ADD_TEST(suite, test_store_retrieve);
+	CU_ADD_TEST(suite, test_list_select);
+	CU_ADD_TEST(suite, test_checkpoint);
+	CU_ADD_TEST(suite, test_replay);
+	CU_ADD_TEST(suite, test_gc);
+	CU_ADD_TEST(suite, test_errors);
+	CU_ADD_TEST(suite, test_hotremove);
+
+	g_thread = spdk_thread_create("test", NULL);
+	spdk_set_thread(g_thread);
+	vbdev_kv_zns_init();
+
+	CU_basic_set_mode(CU_BRM_VERBOSE);
+	CU_basic_run_tests();
+	num_failures = CU_get_number_of_failures();
+
+	vbdev_kv_zns_finish();
+	spdk_thread_exit(g_thread);
+	while (!spdk_thread_is_exited(g_thread)) {
+		spdk_thread_poll(g_thread, 0, 0);
+	}
+	spdk_thread_destroy(g_thread);
+
+	CU_cleanup_registry();
+
+	return num_failures;
+}
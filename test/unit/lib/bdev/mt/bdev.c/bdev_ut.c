@@ -25,6 +25,11 @@ DEFINE_STUB(spdk_memory_domain_get_dma_device_id, const char *, (struct spdk_mem
 	    "test_domain");
 DEFINE_STUB(spdk_memory_domain_get_dma_device_type, enum spdk_dma_device_type,
 	    (struct spdk_memory_domain *domain), 0);
+DEFINE_STUB(spdk_bdev_kv_retrievev, int,
+	    (struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+	     unsigned char *key, size_t key_length, struct iovec *iov, int iovcnt,
+	     uint64_t offset, uint64_t nbytes, spdk_bdev_io_completion_cb cb, void *cb_arg),
+	    0);
 
 DEFINE_RETURN_MOCK(spdk_memory_domain_pull_data, int);
 int
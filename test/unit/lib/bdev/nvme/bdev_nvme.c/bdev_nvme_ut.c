@@ -1203,6 +1203,34 @@ int spdk_nvme_ns_cmd_kvselect_retrievev(struct spdk_nvme_ns *ns, struct spdk_nvm
 	return 0;
 }
 
+DEFINE_STUB(spdk_nvme_ns_cmd_kvlistv_ext, int, (struct spdk_nvme_ns *ns,
+		struct spdk_nvme_qpair *qpair, unsigned char *prefix, size_t prefix_len,
+		uint64_t buffer_size, spdk_nvme_cmd_cb cb_fn, void *cb_arg,
+		spdk_nvme_req_reset_sgl_cb reset_sgl_fn, spdk_nvme_req_next_sge_cb next_sge_fn,
+		struct spdk_nvme_ns_cmd_ext_io_opts *opts), 0);
+DEFINE_STUB(spdk_nvme_ns_cmd_kvstorev_ext, int, (struct spdk_nvme_ns *ns,
+		struct spdk_nvme_qpair *qpair, unsigned char *key, size_t key_len,
+		uint64_t payload_size, spdk_nvme_cmd_cb cb_fn, void *cb_arg, uint8_t store_flags,
+		spdk_nvme_req_reset_sgl_cb reset_sgl_fn, spdk_nvme_req_next_sge_cb next_sge_fn,
+		struct spdk_nvme_ns_cmd_ext_io_opts *opts), 0);
+DEFINE_STUB(spdk_nvme_ns_cmd_kvretrievev_ext, int, (struct spdk_nvme_ns *ns,
+		struct spdk_nvme_qpair *qpair, unsigned char *key, size_t key_len,
+		uint64_t buffer_size, spdk_nvme_cmd_cb cb_fn, void *cb_arg, uint64_t offset,
+		spdk_nvme_req_reset_sgl_cb reset_sgl_fn, spdk_nvme_req_next_sge_cb next_sge_fn,
+		struct spdk_nvme_ns_cmd_ext_io_opts *opts), 0);
+DEFINE_STUB(spdk_nvme_ns_cmd_kvselect_sendv_ext, int, (struct spdk_nvme_ns *ns,
+		struct spdk_nvme_qpair *qpair, unsigned char *key, size_t key_len, uint64_t query_len,
+		spdk_nvme_kv_datatype input_type, spdk_nvme_kv_datatype output_type,
+		uint8_t header_opts, spdk_nvme_cmd_cb cb_fn, void *cb_arg,
+		spdk_nvme_req_reset_sgl_cb reset_sgl_fn, spdk_nvme_req_next_sge_cb next_sge_fn,
+		struct spdk_nvme_ns_cmd_ext_io_opts *opts), 0);
+DEFINE_STUB(spdk_nvme_ns_cmd_kvselect_retrievev_ext, int, (struct spdk_nvme_ns *ns,
+		struct spdk_nvme_qpair *qpair, uint32_t select_id, uint32_t offset,
+		uint32_t buffer_size, spdk_nvme_kv_select_opts select_opts,
+		spdk_nvme_cmd_cb cb_fn, void *cb_arg,
+		spdk_nvme_req_reset_sgl_cb reset_sgl_fn, spdk_nvme_req_next_sge_cb next_sge_fn,
+		struct spdk_nvme_ns_cmd_ext_io_opts *opts), 0);
+
 struct spdk_nvme_poll_group *
 spdk_nvme_poll_group_create(void *ctx, struct spdk_nvme_accel_fn_table *table)
 {
@@ -6569,6 +6597,29 @@ test_retry_io_to_same_path(void)
 	g_opts.bdev_retry_count = 0;
 }
 
+static void
+test_kv_io_type_supported(void)
+{
+	struct spdk_nvme_ns ns = {};
+	struct nvme_ns nvme_ns = { .ns = &ns };
+	struct nvme_bdev nbdev = {};
+	enum spdk_bdev_io_type io_type;
+
+	TAILQ_INIT(&nbdev.nvme_ns_list);
+	TAILQ_INSERT_TAIL(&nbdev.nvme_ns_list, &nvme_ns, tailq);
+
+	/* KV commands are vendor opcodes on an NVM command set namespace. */
+	ns.csi = SPDK_NVME_CSI_NVM;
+	for (io_type = SPDK_BDEV_IO_KV_LIST; io_type <= SPDK_BDEV_IO_KV_BATCH; io_type++) {
+		CU_ASSERT(bdev_nvme_io_type_supported(&nbdev, io_type) == true);
+	}
+
+	ns.csi = SPDK_NVME_CSI_KV;
+	for (io_type = SPDK_BDEV_IO_KV_LIST; io_type <= SPDK_BDEV_IO_KV_BATCH; io_type++) {
+		CU_ASSERT(bdev_nvme_io_type_supported(&nbdev, io_type) == true);
+	}
+}
+
 int
 main(int argc, const char **argv)
 {
@@ -6622,6 +6673,7 @@ main(int argc, const char **argv)
 	CU_ADD_TEST(suite, test_set_multipath_policy);
 	CU_ADD_TEST(suite, test_uuid_generation);
 	CU_ADD_TEST(suite, test_retry_io_to_same_path);
+	CU_ADD_TEST(suite, test_kv_io_type_supported);
 
 	CU_basic_set_mode(CU_BRM_VERBOSE);
 
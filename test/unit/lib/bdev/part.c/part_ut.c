@@ -33,6 +33,16 @@ DEFINE_STUB(spdk_memory_domain_get_dma_device_id, const char *, (struct spdk_mem
 	    "test_domain");
 DEFINE_STUB(spdk_memory_domain_get_dma_device_type, enum spdk_dma_device_type,
 	    (struct spdk_memory_domain *domain), 0);
+DEFINE_STUB(spdk_bdev_kv_retrievev, int,
+	    (struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+	     unsigned char *key, size_t key_length, struct iovec *iov, int iovcnt,
+	     uint64_t offset, uint64_t nbytes, spdk_bdev_io_completion_cb cb, void *cb_arg),
+	    0);
+DEFINE_STUB(spdk_bdev_kv_io_forward, int,
+	    (struct spdk_bdev_desc *desc, struct spdk_io_channel *ch, struct spdk_bdev_io *bdev_io,
+	     spdk_bdev_io_completion_cb cb, void *cb_arg), 0);
+DEFINE_STUB_V(spdk_bdev_kv_io_complete_from,
+	      (struct spdk_bdev_io *bdev_io, const struct spdk_bdev_io *child));
 
 DEFINE_RETURN_MOCK(spdk_memory_domain_pull_data, int);
 int
@@ -179,6 +179,20 @@ test_add_key(void) {
 	CU_ASSERT_NSTRING_EQUAL(test_key3, key, strlen(test_key3));
 	CU_ASSERT(key_len == strlen(test_key3));
 
+	/* only key_len bytes are read, the rest of the key is zero */
+	unsigned char *short_key = malloc(3);
+	SPDK_CU_ASSERT_FATAL(short_key != NULL);
+	memcpy(short_key, "foo", 3);
+	memset(&cmd, 0xff, sizeof(struct spdk_nvme_cmd));
+	cmd.opc = SPDK_NVME_OPC_KV_EXIST;
+	rc = _nvme_cmd_kv_add_key(&cmd, short_key, 3, 0);
+	CU_ASSERT(rc == 0);
+	CU_ASSERT(cmd.cdw15 == 0x666f6f00);
+	CU_ASSERT(cmd.cdw14 == 0);
+	CU_ASSERT(cmd.rsvd3 == 0);
+	CU_ASSERT(cmd.rsvd2 == 0);
+	free(short_key);
+
 
 	/* add key with storage option */
 	memset(&cmd, 0, sizeof(struct spdk_nvme_cmd));
@@ -470,6 +484,327 @@ test_spdk_nvme_ns_cmd_kvretrieve(void) {
 	free(buffer);
 }
 
+static struct spdk_nvme_cpl g_split_cpl;
+static int g_split_cb_count;
+
+static void
+split_test_cb(void *arg, const struct spdk_nvme_cpl *cpl) {
+	g_split_cpl = *cpl;
+	g_split_cb_count++;
+}
+
+static void
+complete_request(struct nvme_request *req, uint16_t sc, uint32_t cdw0) {
+	struct spdk_nvme_cpl	cpl = {};
+	spdk_nvme_cmd_cb	cb_fn = req->cb_fn;
+	void			*cb_arg = req->cb_arg;
+
+	cpl.cdw0 = cdw0;
+	cpl.status.sc = sc;
+	cb_fn(cb_arg, &cpl);
+	nvme_free_request(req);
+}
+
+static void
+test_spdk_nvme_ns_cmd_kvstore_split(void) {
+	struct spdk_nvme_ns	ns;
+	struct spdk_nvme_ctrlr	ctrlr;
+	struct spdk_nvme_qpair	qpair;
+	struct nvme_request	*req;
+	int			rc = 0;
+	char			*buffer = NULL;
+	char			*test_key;
+	uint32_t		buffer_size;
+	uint8_t			flags;
+	STAILQ_HEAD(, nvme_request) free_reqs;
+	int			i;
+
+	buffer_size = 10000;
+	buffer = malloc(buffer_size);
+	SPDK_CU_ASSERT_FATAL(buffer != NULL);
+
+	test_key = "STORE_SPLIT";
+	prepare_for_test(&ns, &ctrlr, &qpair);
+	ctrlr.max_xfer_size = 4096;
+	g_split_cb_count = 0;
+
+	rc = spdk_nvme_ns_cmd_kvstore(&ns, &qpair, test_key, strlen(test_key), buffer, buffer_size,
+				      split_test_cb, NULL, SPDK_NVME_KV_STORE_FLAG_MUST_NOT_EXIST, 0);
+	CU_ASSERT(rc == 0);
+
+	/* first chunk carries the caller's flags and is not a split parent */
+	req = g_request;
+	SPDK_CU_ASSERT_FATAL(req != NULL);
+	CU_ASSERT(req->num_children == 0);
+	CU_ASSERT(req->cmd.opc == SPDK_NVME_OPC_KV_STORE);
+	CU_ASSERT(req->cmd.cdw10 == 4096);
+	CU_ASSERT(req->payload.contig_or_cb_arg == buffer);
+	flags = (from_le32(&req->cmd.cdw11) >> 8) & 0xff;
+	CU_ASSERT(flags == SPDK_NVME_KV_STORE_FLAG_MUST_NOT_EXIST);
+
+	/* following chunks are appended only after the previous one completes */
+	g_request = NULL;
+	complete_request(req, SPDK_NVME_SC_SUCCESS, 0);
+	req = g_request;
+	SPDK_CU_ASSERT_FATAL(req != NULL);
+	CU_ASSERT(req->cmd.cdw10 == 4096);
+	CU_ASSERT(req->payload.contig_or_cb_arg == buffer + 4096);
+	flags = (from_le32(&req->cmd.cdw11) >> 8) & 0xff;
+	CU_ASSERT(flags == SPDK_NVME_KV_STORE_FLAG_APPEND);
+
+	g_request = NULL;
+	complete_request(req, SPDK_NVME_SC_SUCCESS, 0);
+	req = g_request;
+	SPDK_CU_ASSERT_FATAL(req != NULL);
+	CU_ASSERT(req->cmd.cdw10 == buffer_size - 8192);
+	CU_ASSERT(req->payload.contig_or_cb_arg == buffer + 8192);
+	CU_ASSERT(g_split_cb_count == 0);
+
+	g_request = NULL;
+	complete_request(req, SPDK_NVME_SC_SUCCESS, 0);
+	CU_ASSERT(g_request == NULL);
+	CU_ASSERT(g_split_cb_count == 1);
+	CU_ASSERT(!spdk_nvme_cpl_is_error(&g_split_cpl));
+
+	/* an error stops the chain and is reported to the caller */
+	g_split_cb_count = 0;
+	rc = spdk_nvme_ns_cmd_kvstore(&ns, &qpair, test_key, strlen(test_key), buffer, buffer_size,
+				      split_test_cb, NULL, 0, 0);
+	CU_ASSERT(rc == 0);
+	req = g_request;
+	SPDK_CU_ASSERT_FATAL(req != NULL);
+	g_request = NULL;
+	complete_request(req, SPDK_NVME_SC_INTERNAL_DEVICE_ERROR, 0);
+	CU_ASSERT(g_request == NULL);
+	CU_ASSERT(g_split_cb_count == 1);
+	CU_ASSERT(g_split_cpl.status.sc == SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+	CU_ASSERT(qpair.num_outstanding_reqs == 0);
+
+	/* running out of requests fails the store before any chunk is written */
+	ctrlr.opts.io_queue_requests = 32;
+	STAILQ_INIT(&free_reqs);
+	for (i = 0; i < 30; i++) {
+		req = STAILQ_FIRST(&qpair.free_req);
+		STAILQ_REMOVE_HEAD(&qpair.free_req, stailq);
+		STAILQ_INSERT_TAIL(&free_reqs, req, stailq);
+	}
+	rc = spdk_nvme_ns_cmd_kvstore(&ns, &qpair, test_key, strlen(test_key), buffer, buffer_size,
+				      split_test_cb, NULL, 0, 0);
+	CU_ASSERT(rc == -ENOMEM);
+	CU_ASSERT(g_request == NULL);
+	CU_ASSERT(qpair.num_outstanding_reqs == 0);
+
+	/* unless the queue can never hold all of the chunks */
+	ctrlr.opts.io_queue_requests = 2;
+	rc = spdk_nvme_ns_cmd_kvstore(&ns, &qpair, test_key, strlen(test_key), buffer, buffer_size,
+				      split_test_cb, NULL, 0, 0);
+	CU_ASSERT(rc == -EINVAL);
+	CU_ASSERT(g_request == NULL);
+	STAILQ_CONCAT(&qpair.free_req, &free_reqs);
+
+	cleanup_after_test(&qpair);
+	free(buffer);
+}
+
+static void
+test_spdk_nvme_ns_cmd_kvretrieve_split(void) {
+	struct spdk_nvme_ns	ns;
+	struct spdk_nvme_ctrlr	ctrlr;
+	struct spdk_nvme_qpair	qpair;
+	struct nvme_request	*parent, *child[3];
+	int			rc = 0;
+	char			*buffer = NULL;
+	char			*test_key;
+	uint32_t		buffer_size;
+	int			i;
+
+	buffer_size = 10000;
+	buffer = malloc(buffer_size);
+	SPDK_CU_ASSERT_FATAL(buffer != NULL);
+
+	test_key = "RETRIEVE_SPLIT";
+	prepare_for_test(&ns, &ctrlr, &qpair);
+	ctrlr.max_xfer_size = 4096;
+
+	rc = spdk_nvme_ns_cmd_kvretrieve(&ns, &qpair, test_key, strlen(test_key), buffer, buffer_size,
+					 split_test_cb, NULL, 100, 0);
+	CU_ASSERT(rc == 0);
+	parent = g_request;
+	SPDK_CU_ASSERT_FATAL(parent != NULL);
+	CU_ASSERT(parent->num_children == 3);
+
+	child[0] = TAILQ_FIRST(&parent->children);
+	child[1] = TAILQ_NEXT(child[0], child_tailq);
+	child[2] = TAILQ_NEXT(child[1], child_tailq);
+	for (i = 0; i < 3; i++) {
+		CU_ASSERT(child[i]->cmd.opc == SPDK_NVME_OPC_KV_RETRIEVE);
+		CU_ASSERT(child[i]->cmd.cdw12 == 100u + i * 4096u);
+		CU_ASSERT(child[i]->payload.contig_or_cb_arg == buffer + i * 4096);
+	}
+	CU_ASSERT(child[0]->cmd.cdw10 == 4096);
+	CU_ASSERT(child[1]->cmd.cdw10 == 4096);
+	CU_ASSERT(child[2]->cmd.cdw10 == buffer_size - 8192);
+
+	/* the last chunk lies beyond the value, so its failure is ignored */
+	g_split_cb_count = 0;
+	complete_request(child[2], SPDK_NVME_SC_INTERNAL_DEVICE_ERROR, 0);
+	complete_request(child[0], SPDK_NVME_SC_SUCCESS, 5000);
+	CU_ASSERT(g_split_cb_count == 0);
+	complete_request(child[1], SPDK_NVME_SC_SUCCESS, 5000);
+	CU_ASSERT(g_split_cb_count == 1);
+	CU_ASSERT(!spdk_nvme_cpl_is_error(&g_split_cpl));
+	CU_ASSERT(g_split_cpl.cdw0 == 5000);
+
+	/* a failed chunk within the value fails the whole retrieve */
+	rc = spdk_nvme_ns_cmd_kvretrieve(&ns, &qpair, test_key, strlen(test_key), buffer, buffer_size,
+					 split_test_cb, NULL, 0, 0);
+	CU_ASSERT(rc == 0);
+	parent = g_request;
+	SPDK_CU_ASSERT_FATAL(parent != NULL);
+	child[0] = TAILQ_FIRST(&parent->children);
+	child[1] = TAILQ_NEXT(child[0], child_tailq);
+	child[2] = TAILQ_NEXT(child[1], child_tailq);
+	g_split_cb_count = 0;
+	complete_request(child[0], SPDK_NVME_SC_SUCCESS, 20000);
+	complete_request(child[1], SPDK_NVME_SC_INTERNAL_DEVICE_ERROR, 0);
+	complete_request(child[2], SPDK_NVME_SC_SUCCESS, 20000);
+	CU_ASSERT(g_split_cb_count == 1);
+	CU_ASSERT(g_split_cpl.status.sc == SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+	CU_ASSERT(qpair.num_outstanding_reqs == 0);
+
+	/*
+	 * a chunk that could not be submitted fails the retrieve even if all
+	 * submitted chunks succeed; mimic what nvme_qpair_submit_request() does
+	 */
+	rc = spdk_nvme_ns_cmd_kvretrieve(&ns, &qpair, test_key, strlen(test_key), buffer, buffer_size,
+					 split_test_cb, NULL, 0, 0);
+	CU_ASSERT(rc == 0);
+	parent = g_request;
+	SPDK_CU_ASSERT_FATAL(parent != NULL);
+	child[0] = TAILQ_FIRST(&parent->children);
+	child[1] = TAILQ_NEXT(child[0], child_tailq);
+	child[2] = TAILQ_NEXT(child[1], child_tailq);
+	nvme_request_remove_child(parent, child[2]);
+	nvme_free_request(child[2]);
+	parent->cpl.status.sct = SPDK_NVME_SCT_GENERIC;
+	parent->cpl.status.sc = SPDK_NVME_SC_INTERNAL_DEVICE_ERROR;
+	g_split_cb_count = 0;
+	complete_request(child[0], SPDK_NVME_SC_SUCCESS, 20000);
+	complete_request(child[1], SPDK_NVME_SC_SUCCESS, 20000);
+	CU_ASSERT(g_split_cb_count == 1);
+	CU_ASSERT(g_split_cpl.status.sc == SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+	CU_ASSERT(qpair.num_outstanding_reqs == 0);
+
+	/* offsets are carried in cdw12 and cannot go beyond 4 GiB */
+	rc = spdk_nvme_ns_cmd_kvretrieve(&ns, &qpair, test_key, strlen(test_key), buffer, buffer_size,
+					 split_test_cb, NULL, UINT32_MAX, 0);
+	CU_ASSERT(rc == -EINVAL);
+
+	cleanup_after_test(&qpair);
+	free(buffer);
+}
+
+static void
+ext_test_reset_sgl(void *cb_arg, uint32_t offset) {
+}
+
+static int
+ext_test_next_sge(void *cb_arg, void **address, uint32_t *length) {
+	return 0;
+}
+
+static void
+test_spdk_nvme_ns_cmd_kv_ext(void) {
+	struct spdk_nvme_ns			ns;
+	struct spdk_nvme_ctrlr			ctrlr;
+	struct spdk_nvme_qpair			qpair;
+	struct spdk_nvme_ns_cmd_ext_io_opts	opts = {
+		.size = sizeof(opts),
+		.memory_domain = (struct spdk_memory_domain *)0xdeadbeef,
+		.memory_domain_ctx = (void *)0xfeedbeef,
+	};
+	struct nvme_request			*parent, *child;
+	char					*test_key = "EXT_TEST";
+	int					cb_arg;
+	int					rc;
+
+	prepare_for_test(&ns, &ctrlr, &qpair);
+
+	/* the options go with the payload, so the transport sees the memory domain */
+	rc = spdk_nvme_ns_cmd_kvstorev_ext(&ns, &qpair, test_key, strlen(test_key), 1024,
+					   dummy_test_cb, &cb_arg, 0, ext_test_reset_sgl,
+					   ext_test_next_sge, &opts);
+	CU_ASSERT(rc == 0);
+	SPDK_CU_ASSERT_FATAL(g_request != NULL);
+	CU_ASSERT(g_request->cmd.opc == SPDK_NVME_OPC_KV_STORE);
+	CU_ASSERT(g_request->cmd.cdw10 == 1024);
+	CU_ASSERT(g_request->payload.opts == &opts);
+	CU_ASSERT(g_request->payload.contig_or_cb_arg == &cb_arg);
+	CU_ASSERT(g_request->payload.md == NULL);
+	nvme_free_request(g_request);
+
+	rc = spdk_nvme_ns_cmd_kvlistv_ext(&ns, &qpair, test_key, strlen(test_key), 1024,
+					  dummy_test_cb, &cb_arg, ext_test_reset_sgl,
+					  ext_test_next_sge, &opts);
+	CU_ASSERT(rc == 0);
+	SPDK_CU_ASSERT_FATAL(g_request != NULL);
+	CU_ASSERT(g_request->cmd.opc == SPDK_NVME_OPC_KV_LIST);
+	CU_ASSERT(g_request->payload.opts == &opts);
+	nvme_free_request(g_request);
+
+	rc = spdk_nvme_ns_cmd_kvselect_retrievev_ext(&ns, &qpair, 7, 0, 1024,
+			SPDK_NVME_KV_SELECT_FREE_ALL, dummy_test_cb, &cb_arg,
+			ext_test_reset_sgl, ext_test_next_sge, &opts);
+	CU_ASSERT(rc == 0);
+	SPDK_CU_ASSERT_FATAL(g_request != NULL);
+	CU_ASSERT(g_request->cmd.opc == SPDK_NVME_OPC_KV_RETRIEVE_SELECT);
+	CU_ASSERT(g_request->payload.opts == &opts);
+	nvme_free_request(g_request);
+
+	/* every chunk of a split retrieve keeps the options */
+	ctrlr.max_xfer_size = 4096;
+	rc = spdk_nvme_ns_cmd_kvretrievev_ext(&ns, &qpair, test_key, strlen(test_key), 10000,
+					      split_test_cb, NULL, 0, ext_test_reset_sgl,
+					      ext_test_next_sge, &opts);
+	CU_ASSERT(rc == 0);
+	parent = g_request;
+	SPDK_CU_ASSERT_FATAL(parent != NULL);
+	CU_ASSERT(parent->num_children == 3);
+	TAILQ_FOREACH(child, &parent->children, child_tailq) {
+		CU_ASSERT(child->payload.opts == &opts);
+	}
+	g_split_cb_count = 0;
+	while ((child = TAILQ_FIRST(&parent->children)) != NULL) {
+		complete_request(child, SPDK_NVME_SC_SUCCESS, 10000);
+	}
+	CU_ASSERT(g_split_cb_count == 1);
+	CU_ASSERT(qpair.num_outstanding_reqs == 0);
+
+	/* no options is the same as the plain vectored call */
+	rc = spdk_nvme_ns_cmd_kvstorev_ext(&ns, &qpair, test_key, strlen(test_key), 1024,
+					   dummy_test_cb, &cb_arg, 0, ext_test_reset_sgl,
+					   ext_test_next_sge, NULL);
+	CU_ASSERT(rc == 0);
+	SPDK_CU_ASSERT_FATAL(g_request != NULL);
+	CU_ASSERT(g_request->payload.opts == NULL);
+	nvme_free_request(g_request);
+
+	/* KV commands carry no metadata */
+	opts.metadata = (void *)0xdeadbeef;
+	rc = spdk_nvme_ns_cmd_kvretrievev_ext(&ns, &qpair, test_key, strlen(test_key), 1024,
+					      dummy_test_cb, &cb_arg, 0, ext_test_reset_sgl,
+					      ext_test_next_sge, &opts);
+	CU_ASSERT(rc == -EINVAL);
+	opts.metadata = NULL;
+
+	/* the payload must be scattered */
+	rc = spdk_nvme_ns_cmd_kvstorev_ext(&ns, &qpair, test_key, strlen(test_key), 1024,
+					   dummy_test_cb, &cb_arg, 0, NULL, NULL, &opts);
+	CU_ASSERT(rc == -EINVAL);
+
+	cleanup_after_test(&qpair);
+}
+
 static void
 test_spdk_nvme_ns_cmd_kvselect_send(void) {
 	struct spdk_nvme_ns	ns;
@@ -591,6 +926,9 @@ main(int argc, char **argv)
 	CU_ADD_TEST(suite, test_spdk_nvme_ns_cmd_kvdelete);
 	CU_ADD_TEST(suite, test_spdk_nvme_ns_cmd_kvstore);
 	CU_ADD_TEST(suite, test_spdk_nvme_ns_cmd_kvretrieve);
+	CU_ADD_TEST(suite, test_spdk_nvme_ns_cmd_kvstore_split);
+	CU_ADD_TEST(suite, test_spdk_nvme_ns_cmd_kvretrieve_split);
+	CU_ADD_TEST(suite, test_spdk_nvme_ns_cmd_kv_ext);
 	CU_ADD_TEST(suite, test_spdk_nvme_ns_cmd_kvselect_send);
 	CU_ADD_TEST(suite, test_spdk_nvme_ns_cmd_kvselect_retrieve);
 
@@ -214,6 +214,65 @@ DEFINE_STUB(spdk_bdev_copy_blocks, int,
 
 DEFINE_STUB(spdk_bdev_get_max_copy, uint32_t, (const struct spdk_bdev *bdev), 0);
 
+DEFINE_STUB(spdk_bdev_kv_listv, int,
+	    (struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+	     unsigned char *key, size_t key_length, struct iovec *iov, int iovcnt, uint64_t nbytes,
+	     spdk_bdev_io_completion_cb cb, void *cb_arg),
+	    0);
+
+DEFINE_STUB(spdk_bdev_kv_exist, int,
+	    (struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+	     unsigned char *key, size_t key_length,
+	     spdk_bdev_io_completion_cb cb, void *cb_arg),
+	    0);
+
+DEFINE_STUB(spdk_bdev_kv_delete, int,
+	    (struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+	     unsigned char *key, size_t key_length,
+	     spdk_bdev_io_completion_cb cb, void *cb_arg),
+	    0);
+
+DEFINE_STUB(spdk_bdev_kv_retrievev, int,
+	    (struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+	     unsigned char *key, size_t key_length, struct iovec *iov, int iovcnt,
+	     uint64_t offset, uint64_t nbytes, spdk_bdev_io_completion_cb cb, void *cb_arg),
+	    0);
+
+DEFINE_STUB(spdk_bdev_kv_send_selectv, int,
+	    (struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+	     unsigned char *key, size_t key_length, struct iovec *iov, int iovcnt,
+	     uint64_t nbytes, uint8_t options, uint8_t input_type, uint8_t output_type,
+	     spdk_bdev_io_completion_cb cb, void *cb_arg),
+	    0);
+
+DEFINE_STUB(spdk_bdev_kv_retrieve_selectv, int,
+	    (struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+	     struct iovec *iov, int iovcnt, uint64_t offset, uint64_t nbytes,
+	     uint32_t select_id, uint8_t options,
+	     spdk_bdev_io_completion_cb cb, void *cb_arg),
+	    0);
+
+static unsigned char g_kv_key[NVME_KV_MAX_KEY_LENGTH];
+static size_t g_kv_key_length;
+static uint64_t g_kv_nbytes;
+static uint8_t g_kv_options;
+
+DEFINE_RETURN_MOCK(spdk_bdev_kv_storev, int);
+int
+spdk_bdev_kv_storev(struct spdk_bdev_desc *desc, struct spdk_io_channel *ch,
+		    unsigned char *key, size_t key_length,
+		    struct iovec *iov, int iovcnt, uint64_t nbytes, uint8_t options,
+		    spdk_bdev_io_completion_cb cb, void *cb_arg)
+{
+	HANDLE_RETURN_MOCK(spdk_bdev_kv_storev);
+
+	memcpy(g_kv_key, key, key_length);
+	g_kv_key_length = key_length;
+	g_kv_nbytes = nbytes;
+	g_kv_options = options;
+	return 0;
+}
+
 struct spdk_nvmf_ns *
 spdk_nvmf_subsystem_get_ns(struct spdk_nvmf_subsystem *subsystem, uint32_t nsid)
 {
@@ -920,6 +979,140 @@ test_nvmf_bdev_ctrlr_nvme_passthru(void)
 	MOCK_SET(spdk_bdev_nvme_admin_passthru, 0);
 }
 
+static void
+test_nvmf_bdev_ctrlr_kv_cmd(void)
+{
+	int rc;
+	struct spdk_bdev bdev = {};
+	struct spdk_io_channel ch = {};
+	struct spdk_nvmf_qpair qpair = {};
+	struct spdk_nvmf_poll_group group = {};
+	struct spdk_nvmf_request req = {};
+	union nvmf_c2h_msg rsp = {};
+	union nvmf_h2c_msg cmd = {};
+	char query[] = "SELECT * FROM S3Object";
+	unsigned char expected_key[16] = "key-0123456789";
+
+	qpair.group = &group;
+	req.qpair = &qpair;
+	req.cmd = &cmd;
+	req.rsp = &rsp;
+	req.iov[0].iov_base = query;
+	req.iov[0].iov_len = sizeof(query);
+	req.iovcnt = 1;
+	req.length = sizeof(query);
+
+	MOCK_SET(spdk_bdev_io_type_supported, true);
+
+	/* Store: key is decoded from CDW15, CDW14, CDW3 and CDW2, options from CDW11 15:08 */
+	cmd.nvme_cmd.opc = SPDK_NVME_OPC_KV_STORE;
+	cmd.nvme_cmd.cdw10 = 16;
+	cmd.nvme_cmd.cdw11 = (SPDK_NVME_KV_STORE_FLAG_MUST_NOT_EXIST << 8) | 14;
+	cmd.nvme_cmd.cdw15 = from_be32(&expected_key[0]);
+	cmd.nvme_cmd.cdw14 = from_be32(&expected_key[4]);
+	cmd.nvme_cmd.rsvd3 = from_be32(&expected_key[8]);
+	cmd.nvme_cmd.rsvd2 = from_be32(&expected_key[12]);
+
+	rc = nvmf_bdev_ctrlr_kv_cmd(&bdev, NULL, &ch, &req);
+	CU_ASSERT(rc == SPDK_NVMF_REQUEST_EXEC_STATUS_ASYNCHRONOUS);
+	CU_ASSERT(g_kv_key_length == 14);
+	CU_ASSERT(memcmp(g_kv_key, expected_key, 14) == 0);
+	CU_ASSERT(g_kv_nbytes == 16);
+	CU_ASSERT(g_kv_options == SPDK_NVME_KV_STORE_FLAG_MUST_NOT_EXIST);
+
+	/* Value longer than the data buffer */
+	cmd.nvme_cmd.cdw10 = sizeof(query) + 1;
+	memset(&rsp, 0, sizeof(rsp));
+
+	rc = nvmf_bdev_ctrlr_kv_cmd(&bdev, NULL, &ch, &req);
+	CU_ASSERT(rc == SPDK_NVMF_REQUEST_EXEC_STATUS_COMPLETE);
+	CU_ASSERT(rsp.nvme_cpl.status.sct == SPDK_NVME_SCT_GENERIC);
+	CU_ASSERT(rsp.nvme_cpl.status.sc == SPDK_NVME_SC_DATA_SGL_LENGTH_INVALID);
+
+	/* Key too long */
+	cmd.nvme_cmd.cdw10 = 16;
+	cmd.nvme_cmd.cdw11 = NVME_KV_MAX_KEY_LENGTH + 1;
+	memset(&rsp, 0, sizeof(rsp));
+
+	rc = nvmf_bdev_ctrlr_kv_cmd(&bdev, NULL, &ch, &req);
+	CU_ASSERT(rc == SPDK_NVMF_REQUEST_EXEC_STATUS_COMPLETE);
+	CU_ASSERT(rsp.nvme_cpl.status.sct == SPDK_NVME_SCT_GENERIC);
+	CU_ASSERT(rsp.nvme_cpl.status.sc == SPDK_NVME_SC_INVALID_KEY_SIZE);
+
+	/* No channel - queue IO */
+	cmd.nvme_cmd.cdw11 = 14;
+	memset(&rsp, 0, sizeof(rsp));
+	MOCK_SET(spdk_bdev_kv_storev, -ENOMEM);
+
+	rc = nvmf_bdev_ctrlr_kv_cmd(&bdev, NULL, &ch, &req);
+	CU_ASSERT(rc == SPDK_NVMF_REQUEST_EXEC_STATUS_ASYNCHRONOUS);
+	CU_ASSERT(group.stat.pending_bdev_io == 1);
+	MOCK_CLEAR(spdk_bdev_kv_storev);
+
+	/* Exist and delete carry no data */
+	req.length = 0;
+	cmd.nvme_cmd.opc = SPDK_NVME_OPC_KV_EXIST;
+	rc = nvmf_bdev_ctrlr_kv_cmd(&bdev, NULL, &ch, &req);
+	CU_ASSERT(rc == SPDK_NVMF_REQUEST_EXEC_STATUS_ASYNCHRONOUS);
+
+	cmd.nvme_cmd.opc = SPDK_NVME_OPC_KV_DELETE;
+	MOCK_SET(spdk_bdev_kv_delete, -EIO);
+	memset(&rsp, 0, sizeof(rsp));
+
+	rc = nvmf_bdev_ctrlr_kv_cmd(&bdev, NULL, &ch, &req);
+	CU_ASSERT(rc == SPDK_NVMF_REQUEST_EXEC_STATUS_COMPLETE);
+	CU_ASSERT(rsp.nvme_cpl.status.sc == SPDK_NVME_SC_INTERNAL_DEVICE_ERROR);
+	MOCK_CLEAR(spdk_bdev_kv_delete);
+
+	/* Exist needs a key, list does not */
+	cmd.nvme_cmd.opc = SPDK_NVME_OPC_KV_EXIST;
+	cmd.nvme_cmd.cdw11 = 0;
+	memset(&rsp, 0, sizeof(rsp));
+
+	rc = nvmf_bdev_ctrlr_kv_cmd(&bdev, NULL, &ch, &req);
+	CU_ASSERT(rc == SPDK_NVMF_REQUEST_EXEC_STATUS_COMPLETE);
+	CU_ASSERT(rsp.nvme_cpl.status.sc == SPDK_NVME_SC_INVALID_KEY_SIZE);
+
+	req.length = sizeof(query);
+	cmd.nvme_cmd.opc = SPDK_NVME_OPC_KV_LIST;
+	rc = nvmf_bdev_ctrlr_kv_cmd(&bdev, NULL, &ch, &req);
+	CU_ASSERT(rc == SPDK_NVMF_REQUEST_EXEC_STATUS_ASYNCHRONOUS);
+
+	/* Query must be NUL terminated */
+	cmd.nvme_cmd.opc = SPDK_NVME_OPC_KV_SEND_SELECT;
+	cmd.nvme_cmd.cdw10 = sizeof(query);
+	cmd.nvme_cmd.cdw11 = 14;
+	rc = nvmf_bdev_ctrlr_kv_cmd(&bdev, NULL, &ch, &req);
+	CU_ASSERT(rc == SPDK_NVMF_REQUEST_EXEC_STATUS_ASYNCHRONOUS);
+
+	cmd.nvme_cmd.cdw10 = strlen(query);
+	memset(&rsp, 0, sizeof(rsp));
+
+	rc = nvmf_bdev_ctrlr_kv_cmd(&bdev, NULL, &ch, &req);
+	CU_ASSERT(rc == SPDK_NVMF_REQUEST_EXEC_STATUS_COMPLETE);
+	CU_ASSERT(rsp.nvme_cpl.status.sc == SPDK_NVME_SC_INVALID_FIELD);
+
+	/* Retrieve select does not use a key */
+	cmd.nvme_cmd.opc = SPDK_NVME_OPC_KV_RETRIEVE_SELECT;
+	cmd.nvme_cmd.cdw10 = sizeof(query);
+	cmd.nvme_cmd.cdw11 = SPDK_NVME_KV_SELECT_NO_FREE;
+	cmd.nvme_cmd.cdw13 = 7;
+	rc = nvmf_bdev_ctrlr_kv_cmd(&bdev, NULL, &ch, &req);
+	CU_ASSERT(rc == SPDK_NVMF_REQUEST_EXEC_STATUS_ASYNCHRONOUS);
+
+	/* Bdevs without the KV API get the raw command */
+	MOCK_SET(spdk_bdev_io_type_supported, false);
+	MOCK_SET(spdk_bdev_nvme_io_passthru, -ENOTSUP);
+	memset(&rsp, 0, sizeof(rsp));
+
+	rc = nvmf_bdev_ctrlr_kv_cmd(&bdev, NULL, &ch, &req);
+	CU_ASSERT(rc == SPDK_NVMF_REQUEST_EXEC_STATUS_COMPLETE);
+	CU_ASSERT(rsp.nvme_cpl.status.sc == SPDK_NVME_SC_INVALID_OPCODE);
+
+	MOCK_CLEAR(spdk_bdev_nvme_io_passthru);
+	MOCK_CLEAR(spdk_bdev_io_type_supported);
+}
+
 int
 main(int argc, char **argv)
 {
@@ -940,6 +1133,7 @@ main(int argc, char **argv)
 	CU_ADD_TEST(suite, test_nvmf_bdev_ctrlr_cmd);
 	CU_ADD_TEST(suite, test_nvmf_bdev_ctrlr_read_write_cmd);
 	CU_ADD_TEST(suite, test_nvmf_bdev_ctrlr_nvme_passthru);
+	CU_ADD_TEST(suite, test_nvmf_bdev_ctrlr_kv_cmd);
 
 	CU_basic_set_mode(CU_BRM_VERBOSE);
 	CU_basic_run_tests();
@@ -28,6 +28,14 @@ function unittest_bdev() {
 	$valgrind $testdir/lib/bdev/scsi_nvme.c/scsi_nvme_ut
 	$valgrind $testdir/lib/bdev/vbdev_lvol.c/vbdev_lvol_ut
 	$valgrind $testdir/lib/bdev/vbdev_zone_block.c/vbdev_zone_block_ut
+	$valgrind $testdir/lib/bdev/kv_emu.c/kv_emu_ut
+	$valgrind $testdir/lib/bdev/kv_cache.c/kv_cache_ut
+	$valgrind $testdir/lib/bdev/kv_shard.c/kv_shard_ut
+	$valgrind $testdir/lib/bdev/kv_mirror.c/kv_mirror_ut
+	$valgrind $testdir/lib/bdev/kv_compress.c/kv_compress_ut
+	$valgrind $testdir/lib/bdev/kv_crc.c/kv_crc_ut
+	$valgrind $testdir/lib/bdev/kv_append.c/kv_append_ut
+	$valgrind $testdir/lib/bdev/kv_zns.c/kv_zns_ut
 	$valgrind $testdir/lib/bdev/mt/bdev.c/bdev_ut
 }
 